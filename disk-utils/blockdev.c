@@ -9,7 +9,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <errno.h>
+#include <time.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "c.h"
 #include "nls.h"
@@ -17,6 +22,7 @@
 #include "pathnames.h"
 #include "closestream.h"
 #include "sysfs.h"
+#include "xalloc.h"
 
 struct bdc {
 	long		ioc;		/* ioctl code */
@@ -213,7 +219,7 @@ static int find_cmd(char *s)
 
 static void do_commands(int fd, char **argv, int d);
 static void report_header(void);
-static void report_device(char *device, int quiet);
+static void report_devices(char **names, int ndevs);
 static void report_all_devices(void);
 
 int main(int argc, char **argv)
@@ -239,12 +245,10 @@ int main(int argc, char **argv)
 	/* --report not together with other commands */
 	if (!strcmp(argv[1], "--report")) {
 		report_header();
-		if (argc > 2) {
-			for (d = 2; d < argc; d++)
-				report_device(argv[d], 0);
-		} else {
+		if (argc > 2)
+			report_devices(argv + 2, argc - 2);
+		else
 			report_all_devices();
-		}
 		return EXIT_SUCCESS;
 	}
 
@@ -407,8 +411,279 @@ static void do_commands(int fd, char **argv, int d)
 	}
 }
 
+/*
+ * --report
+ *
+ * RO, RA, SSZ, size and start are read from the sysfs snapshot, only BSZ
+ * (the soft block size) requires to open the device. The devices are opened
+ * by a pool of threads and the report waits REPORT_TIMEOUT seconds for every
+ * device, so one dead path does not block the whole report. The devices
+ * unknown to sysfs are queried by ioctls.
+ */
+#define REPORT_NTHREADS	16
+#define REPORT_TIMEOUT	5	/* seconds */
+
+enum {
+	REPORT_WAITING = 0,
+	REPORT_RUNNING,
+	REPORT_DONE
+};
+
+struct report_dev {
+	char			*device;
+	struct sysfs_blkdev	*sdev;		/* NULL if not in the snapshot */
+	int			quiet;
+
+	int			state;		/* REPORT_* */
+	struct timespec		started;	/* CLOCK_MONOTONIC */
+	int			err;		/* open() errno, or -1 for ioctls */
+
+	int			ro, ssz, bsz;
+	long			ra;
+	unsigned long long	bytes;
+	uint64_t		start;
+};
+
+struct report {
+	struct report_dev	*devs;
+	size_t			ndevs;
+	size_t			next;		/* the next device for workers */
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+#endif
+};
+
+/* returns open() errno, -1 on ioctl error or 0 */
+static int report_query(struct report_dev *rd)
+{
+	int fd, err = 0;
+
+	fd = open(rd->device, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		return errno;
+
+	if (rd->sdev) {
+		if (ioctl(fd, BLKBSZGET, &rd->bsz) != 0)
+			err = -1;
+		close(fd);
+		return err;
+	}
+
+	if (ioctl(fd, BLKROGET, &rd->ro) == 0 &&
+	    ioctl(fd, BLKRAGET, &rd->ra) == 0 &&
+	    ioctl(fd, BLKSSZGET, &rd->ssz) == 0 &&
+	    ioctl(fd, BLKBSZGET, &rd->bsz) == 0 &&
+	    blkdev_get_size(fd, &rd->bytes) == 0) {
+		struct sysfs_cxt cxt;
+		struct stat st;
+
+		if (fstat(fd, &st) == 0 && S_ISBLK(st.st_mode) &&
+		    sysfs_init(&cxt, st.st_rdev, NULL) == 0) {
+			sysfs_read_u64(&cxt, "start", &rd->start);
+			sysfs_deinit(&cxt);
+		}
+	} else
+		err = -1;
+	close(fd);
+	return err;
+}
+
+/* @timeout: the device has not been queried in time, BSZ is unknown */
+static void report_print(struct report_dev *rd, int err, int timeout)
+{
+	struct sysfs_blkdev *sd = rd->sdev;
+
+	/* the device node does not exist (or the device is gone) */
+	if (err == ENOENT || err == ENXIO)
+		sd = NULL;
+
+	if (sd && (err || timeout)) {
+		/* everything but BSZ is known from sysfs */
+		printf("%s %5ld %5d %5s %10ju %15llu   %s\n",
+		       sd->ro || (sd->wholedisk && sd->wholedisk->ro) ? "ro" : "rw",
+		       (long) sd->read_ahead_kb * 2, sd->logical_block_size, "-",
+		       sd->start, (unsigned long long) sd->size << 9, rd->device);
+		if (timeout && !rd->quiet)
+			warnx(_("%s: the device does not respond"), rd->device);
+	} else if (sd)
+		printf("%s %5ld %5d %5d %10ju %15llu   %s\n",
+		       sd->ro || (sd->wholedisk && sd->wholedisk->ro) ? "ro" : "rw",
+		       (long) sd->read_ahead_kb * 2, sd->logical_block_size,
+		       rd->bsz, sd->start, (unsigned long long) sd->size << 9,
+		       rd->device);
+	else if (timeout) {
+		if (!rd->quiet)
+			warnx(_("%s: the device does not respond"), rd->device);
+	} else if (err > 0) {
+		if (!rd->quiet) {
+			errno = err;
+			warn(_("cannot open %s"), rd->device);
+		}
+	} else if (err) {
+		if (!rd->quiet)
+			warnx(_("ioctl error on %s"), rd->device);
+	} else
+		printf("%s %5ld %5d %5d %10ju %15lld   %s\n",
+		       rd->ro ? "ro" : "rw", rd->ra, rd->ssz, rd->bsz,
+		       rd->start, rd->bytes, rd->device);
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *report_worker(void *data)
+{
+	struct report *rep = (struct report *) data;
+	int err;
+
+	pthread_mutex_lock(&rep->lock);
+	while (rep->next < rep->ndevs) {
+		struct report_dev *rd = &rep->devs[rep->next++];
+
+		rd->state = REPORT_RUNNING;
+		clock_gettime(CLOCK_MONOTONIC, &rd->started);
+		pthread_cond_broadcast(&rep->cond);
+		pthread_mutex_unlock(&rep->lock);
+
+		err = report_query(rd);
+
+		pthread_mutex_lock(&rep->lock);
+		rd->err = err;
+		rd->state = REPORT_DONE;
+		pthread_cond_broadcast(&rep->cond);
+	}
+	pthread_mutex_unlock(&rep->lock);
+	return NULL;
+}
+
+static int report_start_worker(struct report *rep)
+{
+	pthread_attr_t attr;
+	pthread_t tid;
+	int rc;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	rc = pthread_create(&tid, &attr, report_worker, rep);
+	pthread_attr_destroy(&attr);
+	return rc;
+}
+
+static void report_run(struct report *rep)
+{
+	pthread_condattr_t cattr;
+	size_t i, n;
+
+	pthread_mutex_init(&rep->lock, NULL);
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&rep->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	n = min(rep->ndevs, (size_t) REPORT_NTHREADS);
+	for (i = 0; i < n; i++) {
+		if (report_start_worker(rep))
+			break;
+	}
+	if (i == 0) {
+		/* no thread, query in this thread */
+		for (i = 0; i < rep->ndevs; i++) {
+			rep->devs[i].err = report_query(&rep->devs[i]);
+			report_print(&rep->devs[i], rep->devs[i].err, 0);
+		}
+		return;
+	}
+
+	/* print in the original order */
+	pthread_mutex_lock(&rep->lock);
+	for (i = 0; i < rep->ndevs; i++) {
+		struct report_dev *rd = &rep->devs[i];
+		int timeout = 0, err;
+
+		while (rd->state != REPORT_DONE) {
+			struct timespec tmo;
+
+			if (rd->state == REPORT_WAITING) {
+				pthread_cond_wait(&rep->cond, &rep->lock);
+				continue;
+			}
+			tmo = rd->started;
+			tmo.tv_sec += REPORT_TIMEOUT;
+			if (pthread_cond_timedwait(&rep->cond, &rep->lock,
+						   &tmo) == ETIMEDOUT &&
+			    rd->state != REPORT_DONE) {
+				/* the worker is stuck, replace it */
+				timeout = 1;
+				report_start_worker(rep);
+				break;
+			}
+		}
+		/* the stuck worker may still write to @rd */
+		err = timeout ? 0 : rd->err;
+		pthread_mutex_unlock(&rep->lock);
+		report_print(rd, err, timeout);
+		pthread_mutex_lock(&rep->lock);
+	}
+	pthread_mutex_unlock(&rep->lock);
+
+	/* the stuck workers are not joined, nothing is deallocated */
+}
+#else
+static void report_run(struct report *rep)
+{
+	size_t i;
+
+	for (i = 0; i < rep->ndevs; i++) {
+		rep->devs[i].err = report_query(&rep->devs[i]);
+		report_print(&rep->devs[i], rep->devs[i].err, 0);
+	}
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/* @name and @devno are from /proc/partitions, or NULL for a device path */
+static void report_add_device(struct report *rep, struct sysfs_blktopo *topo,
+			      const char *device, const char *name, dev_t devno,
+			      int quiet)
+{
+	struct report_dev *rd;
+
+	if (rep->ndevs % 64 == 0)
+		rep->devs = xrealloc(rep->devs,
+				(rep->ndevs + 64) * sizeof(struct report_dev));
+	rd = &rep->devs[rep->ndevs++];
+	memset(rd, 0, sizeof(*rd));
+
+	rd->device = xstrdup(device);
+	rd->quiet = quiet;
+
+	if (name) {
+		rd->sdev = sysfs_blktopo_get_name(topo, name);
+		if (rd->sdev && rd->sdev->devno != devno)
+			rd->sdev = NULL;
+	} else {
+		struct stat st;
+
+		if (stat(device, &st) == 0 && S_ISBLK(st.st_mode))
+			rd->sdev = sysfs_blktopo_get_devno(topo, st.st_rdev);
+	}
+}
+
+static void report_devices(char **names, int ndevs)
+{
+	struct sysfs_blktopo topo = UL_SYSFSBLKTOPO_EMPTY;
+	struct report rep = { .ndevs = 0 };
+	int i;
+
+	sysfs_blktopo_scan(&topo);
+
+	for (i = 0; i < ndevs; i++)
+		report_add_device(&rep, &topo, names[i], NULL, 0, 0);
+	report_run(&rep);
+}
+
 static void report_all_devices(void)
 {
+	struct sysfs_blktopo topo = UL_SYSFSBLKTOPO_EMPTY;
+	struct report rep = { .ndevs = 0 };
 	FILE *procpt;
 	char line[200];
 	char ptname[200 + 1];
@@ -419,58 +694,27 @@ static void report_all_devices(void)
 	if (!procpt)
 		err(EXIT_FAILURE, _("cannot open %s"), _PATH_PROC_PARTITIONS);
 
+	sysfs_blktopo_scan(&topo);
+
 	while (fgets(line, sizeof(line), procpt)) {
+		char *p;
+
 		if (sscanf(line, " %d %d %d %200[^\n ]",
 			   &ma, &mi, &sz, ptname) != 4)
 			continue;
 
 		sprintf(device, "/dev/%s", ptname);
-		report_device(device, 1);
-	}
 
-	fclose(procpt);
-}
-
-static void report_device(char *device, int quiet)
-{
-	int fd;
-	int ro, ssz, bsz;
-	long ra;
-	unsigned long long bytes;
-	uint64_t start = 0;
-	struct sysfs_cxt cxt;
-	struct stat st;
-
-	fd = open(device, O_RDONLY | O_NONBLOCK);
-	if (fd < 0) {
-		if (!quiet)
-			warn(_("cannot open %s"), device);
-		return;
-	}
-
-	ro = ssz = bsz = 0;
-	ra = 0;
-	if (fstat(fd, &st) == 0) {
-		if (sysfs_init(&cxt, st.st_rdev, NULL))
-			err(EXIT_FAILURE,
-				_("%s: failed to initialize sysfs handler"),
-				device);
-		sysfs_read_u64(&cxt, "start", &start);
-		sysfs_deinit(&cxt);
-	}
-	if (ioctl(fd, BLKROGET, &ro) == 0 &&
-	    ioctl(fd, BLKRAGET, &ra) == 0 &&
-	    ioctl(fd, BLKSSZGET, &ssz) == 0 &&
-	    ioctl(fd, BLKBSZGET, &bsz) == 0 &&
-	    blkdev_get_size(fd, &bytes) == 0) {
-		printf("%s %5ld %5d %5d %10ju %15lld   %s\n",
-		       ro ? "ro" : "rw", ra, ssz, bsz, start, bytes, device);
-	} else {
-		if (!quiet)
-			warnx(_("ioctl error on %s"), device);
+		/* sysfs uses '!' instead of '/', e.g. cciss!c0d0 */
+		for (p = ptname; *p; p++)
+			if (*p == '/')
+				*p = '!';
+		report_add_device(&rep, &topo, device, ptname,
+				  makedev(ma, mi), 1);
 	}
 
-	close(fd);
+	fclose(procpt);
+	report_run(&rep);
 }
 
 static void report_header(void)
@@ -45,8 +45,12 @@
 #include <dirent.h>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <poll.h>
 #include <blkid.h>
 #include <libmount.h>
+#ifdef HAVE_SPAWN_H
+# include <spawn.h>
+#endif
 
 #include "nls.h"
 #include "pathnames.h"
@@ -91,9 +95,12 @@ struct fsck_fs_data
 {
 	const char	*device;
 	dev_t		disk;
+	uint64_t	size;		/* device size in bytes or 0 */
 	unsigned int	stacked:1,
+			irrotational:1,
 			done:1,
-			eval_device:1;
+			eval_device:1,
+			eval_size:1;
 };
 
 /*
@@ -112,6 +119,10 @@ struct fsck_instance {
 	struct rusage rusage;
 	struct libmnt_fs *fs;
 	struct fsck_instance *next;
+
+	int	progress_pipe;	/* read end of the child's -C<fd> or -1 */
+	size_t	progress_sz;	/* bytes in progress_buf */
+	char	progress_buf[256];
 };
 
 #define FLAG_DONE 1
@@ -137,9 +148,12 @@ static int progress;
 static int progress_fd;
 static int force_all_parallel;
 static int report_stats;
+static int report_stats_fd;
 
 static int num_running;
 static int max_running;
+static int max_disk_running = 1;	/* per non-rotational disk */
+static int biggest_first;
 
 static volatile int cancel_requested;
 static int kill_sent;
@@ -154,6 +168,7 @@ static struct libmnt_table *fstab, *mtab;
 static struct libmnt_cache *mntcache;
 
 static int count_slaves(dev_t disk);
+static int is_irrotational_disk(dev_t disk);
 
 static int string_to_int(const char *s)
 {
@@ -256,8 +271,10 @@ static dev_t fs_get_disk(struct libmnt_fs *fs, int check)
 	if (!stat(device, &st) &&
 	    !blkid_devno_to_wholedisk(st.st_rdev, NULL, 0, &data->disk)) {
 
-		if (data->disk)
+		if (data->disk) {
 			data->stacked = count_slaves(data->disk) > 0 ? 1 : 0;
+			data->irrotational = is_irrotational_disk(data->disk);
+		}
 		return data->disk;
 	}
 	return 0;
@@ -269,6 +286,12 @@ static int fs_is_stacked(struct libmnt_fs *fs)
 	return data ? data->stacked : 0;
 }
 
+static int fs_is_irrotational(struct libmnt_fs *fs)
+{
+	struct fsck_fs_data *data = mnt_fs_get_userdata(fs);
+	return data ? data->irrotational : 0;
+}
+
 static int fs_is_done(struct libmnt_fs *fs)
 {
 	struct fsck_fs_data *data = mnt_fs_get_userdata(fs);
@@ -283,25 +306,26 @@ static void fs_set_done(struct libmnt_fs *fs)
 		data->done = 1;
 }
 
-static int is_irrotational_disk(dev_t disk)
+/*
+ * Reads /sys/dev/block/<maj>:<min>/<attr> number
+ */
+static int read_sysfs_devattr(dev_t devno, const char *attr, uintmax_t *res)
 {
 	char path[PATH_MAX];
 	FILE *f;
-	int rc, x;
+	int rc;
 
-
-	rc = snprintf(path, sizeof(path),
-			"/sys/dev/block/%d:%d/queue/rotational",
-			major(disk), minor(disk));
+	rc = snprintf(path, sizeof(path), "/sys/dev/block/%d:%d/%s",
+			major(devno), minor(devno), attr);
 
 	if (rc < 0 || (unsigned int) (rc + 1) > sizeof(path))
-		return 0;
+		return -1;
 
 	f = fopen(path, "r");
 	if (!f)
-		return 0;
+		return -1;
 
-	rc = fscanf(f, "%d", &x);
+	rc = fscanf(f, "%ju", res);
 	if (rc != 1) {
 		if (ferror(f))
 			warn(_("cannot read %s"), path);
@@ -310,7 +334,35 @@ static int is_irrotational_disk(dev_t disk)
 	}
 	fclose(f);
 
-	return rc == 1 ? !x : 0;
+	return rc == 1 ? 0 : -1;
+}
+
+static int is_irrotational_disk(dev_t disk)
+{
+	uintmax_t x;
+
+	return read_sysfs_devattr(disk, "queue/rotational", &x) == 0 ? !x : 0;
+}
+
+/*
+ * Returns size of the device (used to check the biggest filesystems first)
+ */
+static uint64_t fs_get_size(struct libmnt_fs *fs)
+{
+	struct fsck_fs_data *data = fs_create_data(fs);
+
+	if (!data->eval_size) {
+		const char *device = fs_get_device(fs);
+		struct stat st;
+		uintmax_t sectors;
+
+		data->eval_size = 1;
+
+		if (device && !stat(device, &st) && S_ISBLK(st.st_mode) &&
+		    read_sysfs_devattr(st.st_rdev, "size", &sectors) == 0)
+			data->size = sectors << 9;
+	}
+	return data->size;
 }
 
 static void lock_disk(struct fsck_instance *inst)
@@ -318,7 +370,7 @@ static void lock_disk(struct fsck_instance *inst)
 	dev_t disk = fs_get_disk(inst->fs, 1);
 	char *diskname;
 
-	if (!disk || is_irrotational_disk(disk))
+	if (!disk || fs_is_irrotational(inst->fs))
 		return;
 
 	diskname = blkid_devno_to_devname(disk);
@@ -369,6 +421,8 @@ static void free_instance(struct fsck_instance *i)
 {
 	if (lockdisk)
 		unlock_disk(i);
+	if (i->progress_pipe >= 0)
+		close(i->progress_pipe);
 	free(i->prog);
 	mnt_unref_fs(i->fs);
 	free(i);
@@ -482,26 +536,68 @@ static struct libmnt_fs *lookup(char *path)
 	return fs;
 }
 
+/* the fsck.<type> programs, found or not */
+struct fsck_prog {
+	char			*type;
+	char			*path;	/* NULL if not found */
+	struct fsck_prog	*next;
+};
+
+static struct fsck_prog *fsck_progs;
+
 /* Find fsck program for a given fs type. */
 static char *find_fsck(const char *type)
 {
-	char *s;
-	const char *tpl;
-	static char prog[256];
-	char *p = xstrdup(fsck_path);
+	struct fsck_prog *fp;
+	char *s, *p, prog[PATH_MAX];
 	struct stat st;
 
 	/* Are we looking for a program or just a type? */
-	tpl = (strncmp(type, "fsck.", 5) ? "%s/fsck.%s" : "%s/%s");
+	if (!strncmp(type, "fsck.", 5))
+		type += 5;
 
+	for (fp = fsck_progs; fp; fp = fp->next) {
+		if (strcmp(fp->type, type) == 0)
+			return fp->path;
+	}
+
+	fp = xcalloc(1, sizeof(*fp));
+	fp->type = xstrdup(type);
+
+	p = xstrdup(fsck_path);
 	for(s = strtok(p, ":"); s; s = strtok(NULL, ":")) {
-		sprintf(prog, tpl, s, type);
-		if (stat(prog, &st) == 0)
+		snprintf(prog, sizeof(prog), "%s/fsck.%s", s, type);
+		if (stat(prog, &st) == 0) {
+			fp->path = xstrdup(prog);
 			break;
+		}
 	}
 	free(p);
 
-	return(s ? prog : NULL);
+	fp->next = fsck_progs;
+	fsck_progs = fp;
+	return fp->path;
+}
+
+static void free_fsck_progs(void)
+{
+	while (fsck_progs) {
+		struct fsck_prog *fp = fsck_progs;
+
+		fsck_progs = fp->next;
+		free(fp->type);
+		free(fp->path);
+		free(fp);
+	}
+}
+
+/*
+ * The progress of all checkers is multiplexed to the GUI file descriptor if
+ * specified, every checker has its own pipe.
+ */
+static inline int progress_multiplex(void)
+{
+	return progress && progress_fd > 0 && !noexecute;
 }
 
 static int progress_active(void)
@@ -533,6 +629,20 @@ static void print_stats(struct fsck_instance *inst)
 	time_diff = (inst->end_time.tv_sec  - inst->start_time.tv_sec)
 		  + (inst->end_time.tv_usec - inst->start_time.tv_usec) / 1E6;
 
+	if (report_stats_fd) {
+		/* machine readable "<device> <status> <rss> <real> <user> <sys>" */
+		dprintf(report_stats_fd, "%s %d %ld %f %d.%06d %d.%06d\n",
+			fs_get_device(inst->fs),
+			inst->exit_status,
+			inst->rusage.ru_maxrss,
+			time_diff,
+			(int)inst->rusage.ru_utime.tv_sec,
+			(int)inst->rusage.ru_utime.tv_usec,
+			(int)inst->rusage.ru_stime.tv_sec,
+			(int)inst->rusage.ru_stime.tv_usec);
+		return;
+	}
+
 	fprintf(stdout, "%s: status %d, rss %ld, "
 			"real %f, user %d.%06d, sys %d.%06d\n",
 		fs_get_device(inst->fs),
@@ -552,11 +662,12 @@ static void print_stats(struct fsck_instance *inst)
 static int execute(const char *type, struct libmnt_fs *fs, int interactive)
 {
 	char *s, *argv[80], prog[80];
-	int  argc, i;
+	int  argc, i, progress_pipe[2] = { -1, -1 };
 	struct fsck_instance *inst, *p;
 	pid_t	pid;
 
 	inst = xcalloc(1, sizeof(*inst));
+	inst->progress_pipe = -1;
 
 	sprintf(prog, "fsck.%s", type);
 	argv[0] = xstrdup(prog);
@@ -573,7 +684,15 @@ static int execute(const char *type, struct libmnt_fs *fs, int interactive)
 			char tmp[80];
 
 			tmp[0] = 0;
-			if (!progress_active()) {
+			if (progress_multiplex()) {
+				if (pipe(progress_pipe) == 0) {
+					snprintf(tmp, 80, "-C%d", progress_pipe[1]);
+					fcntl(progress_pipe[0], F_SETFD, FD_CLOEXEC);
+					fcntl(progress_pipe[0], F_SETFL, O_NONBLOCK);
+					inst->progress_pipe = progress_pipe[0];
+				} else
+					warn(_("cannot create progress pipe"));
+			} else if (!progress_active()) {
 				snprintf(tmp, 80, "-C%d", progress_fd);
 				inst->flags |= FLAG_PROGRESS;
 			} else if (progress_fd)
@@ -589,6 +708,8 @@ static int execute(const char *type, struct libmnt_fs *fs, int interactive)
 	s = find_fsck(prog);
 	if (s == NULL) {
 		warnx(_("%s: not found"), prog);
+		if (progress_pipe[1] >= 0)
+			close(progress_pipe[1]);
 		free_instance(inst);
 		return ENOENT;
 	}
@@ -614,8 +735,34 @@ static int execute(const char *type, struct libmnt_fs *fs, int interactive)
 	/* Fork and execute the correct program. */
 	if (noexecute)
 		pid = -1;
+#ifdef HAVE_SPAWN_H
+	else {
+		/* posix_spawn() does not copy our address space like fork() */
+		posix_spawn_file_actions_t fa;
+		int rc;
+
+		rc = posix_spawn_file_actions_init(&fa);
+		if (!rc && !interactive)
+			rc = posix_spawn_file_actions_addclose(&fa, 0);
+		if (!rc)
+			rc = posix_spawn(&pid, s, &fa, NULL, argv, environ);
+		posix_spawn_file_actions_destroy(&fa);
+		if (rc) {
+			errno = rc;
+			warn(_("%s: execute failed"), s);
+			if (progress_pipe[1] >= 0)
+				close(progress_pipe[1]);
+			for (i=0; i < argc; i++)
+				free(argv[i]);
+			free_instance(inst);
+			return rc;
+		}
+	}
+#else
 	else if ((pid = fork()) < 0) {
 		warn(_("fork failed"));
+		if (progress_pipe[1] >= 0)
+			close(progress_pipe[1]);
 		free_instance(inst);
 		return errno;
 	} else if (pid == 0) {
@@ -624,6 +771,10 @@ static int execute(const char *type, struct libmnt_fs *fs, int interactive)
 		execv(s, argv);
 		err(FSCK_EX_ERROR, _("%s: execute failed"), s);
 	}
+#endif
+
+	if (progress_pipe[1] >= 0)
+		close(progress_pipe[1]);	/* used by child only */
 
 	for (i=0; i < argc; i++)
 		free(argv[i]);
@@ -664,6 +815,122 @@ static int kill_all(int signum)
 	return n;
 }
 
+/*
+ * e2fsck progress line is "<pass> <current> <max> <device>", the multiplexed
+ * line is extended by "<percent> <eta>" where percent is for the whole check
+ * (the same weights as e2fsck uses for its own progress bar) and eta is in
+ * seconds or -1 if unknown.
+ */
+static void write_progress_line(struct fsck_instance *inst, const char *line)
+{
+	static const int pass_weight[] = { 0, 70, 90, 92, 95, 100 };
+	unsigned long cur, max;
+	char device[256];
+	int pass;
+	double pct = 0;
+	long eta = -1;
+
+	if (sscanf(line, "%d %lu %lu %255s", &pass, &cur, &max, device) != 4)
+		return;
+
+	if (pass > 0 && pass <= 5 && max) {
+		pct = pass_weight[pass - 1] + (double) cur / max *
+			(pass_weight[pass] - pass_weight[pass - 1]);
+		if (pct > 100)
+			pct = 100;
+	}
+	if (pct > 0) {
+		struct timeval now;
+		double elapsed;
+
+		gettimeofday(&now, NULL);
+		elapsed = (now.tv_sec  - inst->start_time.tv_sec)
+			+ (now.tv_usec - inst->start_time.tv_usec) / 1E6;
+		eta = (long) (elapsed * (100 - pct) / pct);
+	}
+
+	dprintf(progress_fd, "%d %lu %lu %s %.1f %ld\n",
+			pass, cur, max, device, pct, eta);
+}
+
+/*
+ * Reads all available data from the checker progress pipe.
+ */
+static void read_progress(struct fsck_instance *inst)
+{
+	for (;;) {
+		char *nl;
+		ssize_t ret = read(inst->progress_pipe,
+				   inst->progress_buf + inst->progress_sz,
+				   sizeof(inst->progress_buf) - inst->progress_sz - 1);
+		if (ret <= 0)
+			break;
+		inst->progress_sz += ret;
+		inst->progress_buf[inst->progress_sz] = '\0';
+
+		while ((nl = strchr(inst->progress_buf, '\n'))) {
+			*nl = '\0';
+			write_progress_line(inst, inst->progress_buf);
+			inst->progress_sz -= nl + 1 - inst->progress_buf;
+			memmove(inst->progress_buf, nl + 1, inst->progress_sz + 1);
+		}
+		/* too long line, drop it */
+		if (inst->progress_sz == sizeof(inst->progress_buf) - 1)
+			inst->progress_sz = 0;
+	}
+}
+
+/*
+ * wait4() wrapper, reads progress pipes of the running checkers while waiting.
+ */
+static pid_t wait_child(int *status, int flags, struct rusage *rusage)
+{
+	struct fsck_instance *inst;
+	struct pollfd *fds = NULL;
+	size_t nfds, i;
+	pid_t pid;
+
+	if (!progress_multiplex())
+		return wait4(-1, status, flags, rusage);
+
+	fds = xcalloc(num_running + 1, sizeof(struct pollfd));
+
+	for (;;) {
+		pid = wait4(-1, status, flags | WNOHANG, rusage);
+		if (pid != 0 || (flags & WNOHANG))
+			break;
+
+		for (nfds = 0, inst = instance_list;
+		     inst && nfds <= (size_t) num_running; inst = inst->next) {
+			if (inst->progress_pipe < 0)
+				continue;
+			fds[nfds].fd = inst->progress_pipe;
+			fds[nfds].events = POLLIN;
+			fds[nfds].revents = 0;
+			nfds++;
+		}
+
+		if (poll(fds, nfds, 100) < 0) {
+			pid = -1;		/* EINTR, caller checks cancel */
+			break;
+		}
+
+		for (i = 0; i < nfds; i++) {
+			if (!fds[i].revents)
+				continue;
+			for (inst = instance_list; inst; inst = inst->next) {
+				if (inst->progress_pipe == fds[i].fd) {
+					read_progress(inst);
+					break;
+				}
+			}
+		}
+	}
+
+	free(fds);
+	return pid;
+}
+
 /*
  * Wait for one child process to exit; when it does, unlink it from
  * the list of executing child processes, and return it.
@@ -699,7 +966,7 @@ static struct fsck_instance *wait_one(int flags)
 	inst = prev = NULL;
 
 	do {
-		pid = wait4(-1, &status, flags, &rusage);
+		pid = wait_child(&status, flags, &rusage);
 		if (cancel_requested && !kill_sent) {
 			kill_all(SIGTERM);
 			kill_sent++;
@@ -747,6 +1014,12 @@ static struct fsck_instance *wait_one(int flags)
 	gettimeofday(&inst->end_time, NULL);
 	memcpy(&inst->rusage, &rusage, sizeof(struct rusage));
 
+	if (inst->progress_pipe >= 0) {
+		read_progress(inst);
+		close(inst->progress_pipe);
+		inst->progress_pipe = -1;
+	}
+
 	if (progress && (inst->flags & FLAG_PROGRESS) &&
 	    !progress_active()) {
 		for (inst2 = instance_list; inst2; inst2 = inst2->next) {
@@ -1126,12 +1399,14 @@ static int count_slaves(dev_t disk)
 
 /*
  * Returns TRUE if a partition on the same disk is already being
- * checked.
+ * checked. The non-rotational disks (SSD, NVMe) allow to check
+ * max_disk_running partitions at the same time.
  */
 static int disk_already_active(struct libmnt_fs *fs)
 {
 	struct fsck_instance *inst;
 	dev_t disk;
+	int limit, nrun = 0;
 
 	if (force_all_parallel)
 		return 0;
@@ -1151,16 +1426,76 @@ static int disk_already_active(struct libmnt_fs *fs)
 	if (!disk || fs_is_stacked(fs))
 		return (instance_list != 0);
 
+	limit = fs_is_irrotational(fs) ? max_disk_running : 1;
+
 	for (inst = instance_list; inst; inst = inst->next) {
 		dev_t idisk = fs_get_disk(inst->fs, 0);
 
-		if (!idisk || disk == idisk)
+		if (!idisk)
+			return 1;
+		if (disk == idisk && limit > 0 && ++nrun >= limit)
 			return 1;
 	}
 
 	return 0;
 }
 
+struct fsck_sched_ent {
+	struct libmnt_fs	*fs;
+	uint64_t		size;
+	size_t			idx;	/* fstab order */
+};
+
+/* the biggest filesystems first, otherwise fstab order */
+static int cmp_sched_ent(const void *a, const void *b)
+{
+	const struct fsck_sched_ent *x = a, *y = b;
+
+	if (x->size != y->size)
+		return x->size > y->size ? -1 : 1;
+	return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+/*
+ * Returns array of the filesystems in order in which the checks are
+ * started within a pass. The default is fstab order. If FSCK_BIGGEST_FIRST
+ * is set then the long checks (big filesystems) are started first, so they
+ * don't delay the end of the pass if started as the last.
+ */
+static struct libmnt_fs **get_sched_fs(size_t *nfs)
+{
+	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_FORWARD);
+	struct fsck_sched_ent *ents;
+	struct libmnt_fs *fs, **res;
+	size_t i, n = 0;
+
+	if (!itr)
+		err(FSCK_EX_ERROR, _("failed to allocate iterator"));
+
+	ents = xcalloc(mnt_table_get_nents(fstab) + 1, sizeof(*ents));
+
+	while (mnt_table_next_fs(fstab, itr, &fs) == 0) {
+		if (fs_is_done(fs))
+			continue;
+		ents[n].fs = fs;
+		ents[n].idx = n;
+		/* serialized checks keep the fstab order */
+		if (biggest_first && !serialize)
+			ents[n].size = fs_get_size(fs);
+		n++;
+	}
+	qsort(ents, n, sizeof(*ents), cmp_sched_ent);
+
+	res = xcalloc(n + 1, sizeof(*res));
+	for (i = 0; i < n; i++)
+		res[i] = ents[i].fs;
+
+	free(ents);
+	mnt_free_iter(itr);
+	*nfs = n;
+	return res;
+}
+
 /* Check all file systems, using the /etc/fstab table. */
 static int check_all(void)
 {
@@ -1169,8 +1504,9 @@ static int check_all(void)
 	int pass_done;
 	int status = FSCK_EX_OK;
 
-	struct libmnt_fs *fs;
+	struct libmnt_fs *fs, **sched;
 	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_FORWARD);
+	size_t i, nsched = 0;
 
 	if (!itr)
 		err(FSCK_EX_ERROR, _("failed to allocate iterator"));
@@ -1225,13 +1561,14 @@ static int check_all(void)
 		}
 	}
 
+	sched = get_sched_fs(&nsched);
+
 	while (not_done_yet) {
 		not_done_yet = 0;
 		pass_done = 1;
 
-		mnt_reset_iter(itr, MNT_ITER_FORWARD);
-
-		while(mnt_table_next_fs(fstab, itr, &fs) == 0) {
+		for (i = 0; i < nsched; i++) {
+			fs = sched[i];
 
 			if (cancel_requested)
 				break;
@@ -1297,6 +1634,7 @@ static int check_all(void)
 	}
 
 	status |= wait_many(FLAG_WAIT_ATLEAST_ONE);
+	free(sched);
 	mnt_free_iter(itr);
 	return status;
 }
@@ -1315,7 +1653,8 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(_(" -N         do not execute, just show what would be done\n"), out);
 	fputs(_(" -P         check filesystems in parallel, including root\n"), out);
 	fputs(_(" -R         skip root filesystem; useful only with '-A'\n"), out);
-	fputs(_(" -r         report statistics for each device checked\n"), out);
+	fputs(_(" -r [<fd>]  report statistics for each device checked;\n"
+		"            file descriptor is for GUIs\n"), out);
 	fputs(_(" -s         serialize the checking operations\n"), out);
 	fputs(_(" -T         do not show the title on startup\n"), out);
 	fputs(_(" -t <type>  specify filesystem types to be checked;\n"
@@ -1417,7 +1756,7 @@ static void parse_argv(int argc, char *argv[])
 						goto next_arg;
 				} else if ((i+1) < argc &&
 					   !strncmp(argv[i+1], "-", 1) == 0) {
-					progress_fd = string_to_int(argv[i]);
+					progress_fd = string_to_int(argv[i+1]);
 					if (progress_fd < 0)
 						progress_fd = 0;
 					else {
@@ -1449,6 +1788,22 @@ static void parse_argv(int argc, char *argv[])
 				break;
 			case 'r':
 				report_stats = 1;
+				if (arg[j+1]) {
+					report_stats_fd = string_to_int(arg+j+1);
+					if (report_stats_fd < 0)
+						report_stats_fd = 0;
+					else
+						goto next_arg;
+				} else if ((i+1) < argc &&
+					   !strncmp(argv[i+1], "-", 1) == 0) {
+					report_stats_fd = string_to_int(argv[i+1]);
+					if (report_stats_fd < 0)
+						report_stats_fd = 0;
+					else {
+						++i;
+						goto next_arg;
+					}
+				}
 				break;
 			case 's':
 				serialize = 1;
@@ -1489,8 +1844,12 @@ static void parse_argv(int argc, char *argv[])
 	}
 	if (getenv("FSCK_FORCE_ALL_PARALLEL"))
 		force_all_parallel++;
+	if (getenv("FSCK_BIGGEST_FIRST"))
+		biggest_first++;
 	if ((tmp = getenv("FSCK_MAX_INST")))
 	    max_running = atoi(tmp);
+	if ((tmp = getenv("FSCK_MAX_DISK_INST")))
+	    max_disk_running = atoi(tmp);
 }
 
 int main(int argc, char *argv[])
@@ -1580,6 +1939,7 @@ int main(int argc, char *argv[])
 	}
 	status |= wait_many(FLAG_WAIT_ALL);
 	free(fsck_path);
+	free_fsck_progs();
 	mnt_unref_cache(mntcache);
 	mnt_unref_table(fstab);
 	mnt_unref_table(mtab);
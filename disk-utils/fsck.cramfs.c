@@ -70,6 +70,9 @@ struct cramfs_super super;	/* just find the cramfs superblock once */
 static int cramfs_is_big_endian = 0;	/* source is big endian */
 static int opt_verbose = 0;	/* 1 = verbose (-v), 2+ = very verbose (-vv) */
 
+static unsigned char *image;	/* read-only mapping of the image or NULL */
+static size_t image_size;	/* size of the mapping */
+
 char *extract_dir = "";		/* extraction directory (-x) */
 
 #define PAD_SIZE 512
@@ -205,6 +208,32 @@ static void test_super(int *start, size_t * length)
 		fprintf(stderr, _("warning: old cramfs format\n"));
 }
 
+/*
+ * Maps the whole filesystem, the mapping is used for the CRC and then for
+ * the filesystem tests, so the image is read from the device only once.
+ * The read() based code is used if mmap() is not possible.
+ */
+static void map_image(size_t length)
+{
+	image_size = length;
+	if ((super.flags & CRAMFS_FLAG_FSID_VERSION_2) && super.size < length)
+		image_size = super.size;
+
+	image = mmap(NULL, image_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (image == MAP_FAILED) {
+		image = NULL;
+		image_size = 0;
+	}
+}
+
+static void unmap_image(void)
+{
+	if (image)
+		munmap(image, image_size);
+	image = NULL;
+	image_size = 0;
+}
+
 static void test_crc(int start)
 {
 	void *buf;
@@ -220,24 +249,15 @@ static void test_crc(int start)
 
 	crc = crc32(0L, Z_NULL, 0);
 
-	buf =
-	    mmap(NULL, super.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-	if (buf == MAP_FAILED) {
-		buf =
-		    mmap(NULL, super.size, PROT_READ | PROT_WRITE,
-			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-		if (buf != MAP_FAILED) {
-			if (lseek(fd, 0, SEEK_SET) == (off_t) -1)
-				err(FSCK_EX_ERROR, _("seek on %s failed"), filename);
-			if (read(fd, buf, super.size) < 0)
-				err(FSCK_EX_ERROR, _("cannot read %s"), filename);
-		}
-	}
-	if (buf != MAP_FAILED) {
-		((struct cramfs_super *)((unsigned char *) buf + start))->fsid.crc =
-		    crc32(0L, Z_NULL, 0);
-		crc = crc32(crc, (unsigned char *) buf + start, super.size - start);
-		munmap(buf, super.size);
+	if (image && image_size == super.size) {
+		/* the CRC is calculated with zero in the CRC field */
+		size_t off = start + offsetof(struct cramfs_super, fsid.crc);
+		uint32_t zero = 0;
+
+		crc = crc32(crc, image + start, off - start);
+		crc = crc32(crc, (unsigned char *) &zero, sizeof(zero));
+		off += sizeof(zero);
+		crc = crc32(crc, image + off, super.size - off);
 	} else {
 		int retval;
 		size_t length = 0;
@@ -288,11 +308,16 @@ static void print_node(char type, struct cramfs_inode *i, char *name)
 }
 
 /*
- * Create a fake "blocked" access
+ * Create a fake "blocked" access, returns pointer to the mapped image if
+ * possible, otherwise the data are read to the buffer.
  */
 static void *romfs_read(unsigned long offset)
 {
 	unsigned int block = offset >> ROMBUFFER_BITS;
+
+	if (image && offset + ROMBUFFERSIZE <= image_size)
+		return image + offset;
+
 	if (block != read_buffer_block) {
 		ssize_t x;
 
@@ -357,6 +382,10 @@ static int uncompress_block(void *src, size_t len)
 
 	if (len > page_size * 2)
 		errx(FSCK_EX_UNCORRECTED, _("data block too large"));
+	/* don't read behind the end of the mapped image */
+	if (image && (unsigned char *) src >= image &&
+	    (unsigned char *) src + len > image + image_size)
+		errx(FSCK_EX_UNCORRECTED, _("data block too large"));
 
 	err = inflate(&stream, Z_FINISH);
 	if (err != Z_STREAM_END)
@@ -698,10 +727,12 @@ int main(int argc, char **argv)
 	filename = argv[optind];
 
 	test_super(&start, &length);
+	map_image(length);
 	test_crc(start);
 #ifdef INCLUDE_FS_TESTS
 	test_fs(start);
 #endif
+	unmap_image();
 
 	if (opt_verbose)
 		printf(_("%s: OK\n"), filename);
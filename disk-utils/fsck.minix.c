@@ -358,13 +358,8 @@ read_block(unsigned int nr, char *addr) {
 		memset(addr, 0, MINIX_BLOCK_SIZE);
 		return;
 	}
-	if (MINIX_BLOCK_SIZE * nr != lseek(IN, MINIX_BLOCK_SIZE * nr, SEEK_SET)) {
-		get_current_name();
-		printf(_("Read error: unable to seek to block in file '%s'\n"),
-		       current_name);
-		memset(addr, 0, MINIX_BLOCK_SIZE);
-		errors_uncorrected = 1;
-	} else if (MINIX_BLOCK_SIZE != read(IN, addr, MINIX_BLOCK_SIZE)) {
+	if (MINIX_BLOCK_SIZE != pread(IN, addr, MINIX_BLOCK_SIZE,
+				      (off_t) MINIX_BLOCK_SIZE * nr)) {
 		get_current_name();
 		printf(_("Read error: bad block in file '%s'\n"), current_name);
 		memset(addr, 0, MINIX_BLOCK_SIZE);
@@ -383,9 +378,8 @@ write_block(unsigned int nr, char *addr) {
 		errors_uncorrected = 1;
 		return;
 	}
-	if (MINIX_BLOCK_SIZE * nr != lseek(IN, MINIX_BLOCK_SIZE * nr, SEEK_SET))
-		die(_("seek failed in write_block"));
-	if (MINIX_BLOCK_SIZE != write(IN, addr, MINIX_BLOCK_SIZE)) {
+	if (MINIX_BLOCK_SIZE != pwrite(IN, addr, MINIX_BLOCK_SIZE,
+				       (off_t) MINIX_BLOCK_SIZE * nr)) {
 		get_current_name();
 		printf(_("Write error: bad block in file '%s'\n"),
 		       current_name);
@@ -1101,9 +1095,38 @@ static int
 bad_zone(int i) {
 	char buffer[1024];
 
-	if (MINIX_BLOCK_SIZE * i != lseek(IN, MINIX_BLOCK_SIZE * i, SEEK_SET))
-		die(_("seek failed in bad_zone"));
-	return (MINIX_BLOCK_SIZE != read(IN, buffer, MINIX_BLOCK_SIZE));
+	return (MINIX_BLOCK_SIZE != pread(IN, buffer, MINIX_BLOCK_SIZE,
+					  (off_t) MINIX_BLOCK_SIZE * i));
+}
+
+/*
+ * Returns the first zone from @i where the bitmap does not match the counted
+ * references. The bitmap is tested a byte (eight zones) at a time, the most
+ * of the zones are usually all used or all free.
+ */
+static unsigned long
+next_bad_count(unsigned long i) {
+	static const unsigned char zero[NBBY], one[NBBY] = {
+		1, 1, 1, 1, 1, 1, 1, 1
+	};
+	unsigned long first = get_first_zone(), nzones = get_nzones();
+
+	for (; i < nzones; i++) {
+		unsigned long bit = i - first + 1;
+
+		if (bit % NBBY == 0 && i + NBBY <= nzones) {
+			unsigned char byte = zone_map[bit / NBBY];
+
+			if ((byte == 0 && !memcmp(zone_count + i, zero, NBBY)) ||
+			    (byte == 0xff && !memcmp(zone_count + i, one, NBBY))) {
+				i += NBBY - 1;
+				continue;
+			}
+		}
+		if (zone_in_use(i) != zone_count[i])
+			break;
+	}
+	return i;
 }
 
 static void
@@ -1141,9 +1164,8 @@ check_counts(void) {
 			}
 		}
 	}
-	for (i = get_first_zone(); i < get_nzones(); i++) {
-		if (zone_in_use(i) == zone_count[i])
-			continue;
+	for (i = next_bad_count(get_first_zone()); i < get_nzones();
+	     i = next_bad_count(i + 1)) {
 		if (!zone_count[i]) {
 			if (bad_zone(i))
 				continue;
@@ -1197,9 +1219,8 @@ check_counts2(void) {
 			}
 		}
 	}
-	for (i = get_first_zone(); i < get_nzones(); i++) {
-		if (zone_in_use(i) == zone_count[i])
-			continue;
+	for (i = next_bad_count(get_first_zone()); i < get_nzones();
+	     i = next_bad_count(i + 1)) {
 		if (!zone_count[i]) {
 			if (bad_zone(i))
 				continue;
@@ -22,6 +22,7 @@
 #include "strutils.h"
 #include "xalloc.h"
 #include "bitops.h"
+#include "all-io.h"
 
 #define BFS_ROOT_INO		2
 #define BFS_NAMELEN		14
@@ -106,7 +107,9 @@ int main(int argc, char **argv)
 	struct bfsde de;
 	struct stat statbuf;
 	time_t now;
-	int c, i, len;
+	char *buf, *p;
+	size_t bufsz;
+	int c, len;
 
 	enum { VERSION_OPTION = CHAR_MAX + 1 };
 	static const struct option longopts[] = {
@@ -251,8 +254,12 @@ int main(int argc, char **argv)
 			le32_to_cpu(sb.s_start) - 1, le32_to_cpu(sb.s_end));
 	}
 
-	if (write(fd, &sb, sizeof(sb)) != sizeof(sb))
-		err(EXIT_FAILURE, _("error writing superblock"));
+	/* the superblock, inodes and root directory entries are written by
+	 * one write() from this buffer */
+	bufsz = (1 + ino_blocks) * BFS_BLOCKSIZE + 2 * sizeof(de);
+	buf = xcalloc(1, bufsz);
+
+	memcpy(buf, &sb, sizeof(sb));
 
 	memset(&ri, 0, sizeof(ri));
 	ri.i_ino = cpu_to_le16(BFS_ROOT_INO);
@@ -272,26 +279,21 @@ int main(int argc, char **argv)
 	ri.i_mtime = cpu_to_le32(now);
 	ri.i_ctime = cpu_to_le32(now);
 
-	if (write(fd, &ri, sizeof(ri)) != sizeof(ri))
-		err(EXIT_FAILURE, _("error writing root inode"));
-
-	memset(&ri, 0, sizeof(ri));
-	for (i = 1; i < inodes; i++)
-		if (write(fd, &ri, sizeof(ri)) != sizeof(ri))
-			err(EXIT_FAILURE, _("error writing inode"));
-
-	if (lseek(fd, (1 + ino_blocks) * BFS_BLOCKSIZE, SEEK_SET) == -1)
-		err(EXIT_FAILURE, _("seek error"));
+	/* the other inodes are zero */
+	memcpy(buf + sizeof(sb), &ri, sizeof(ri));
 
+	p = buf + (1 + ino_blocks) * BFS_BLOCKSIZE;
 	memset(&de, 0, sizeof(de));
 	de.d_ino = cpu_to_le16(BFS_ROOT_INO);
 	memcpy(de.d_name, ".", 1);
-	if (write(fd, &de, sizeof(de)) != sizeof(de))
-		err(EXIT_FAILURE, _("error writing . entry"));
+	memcpy(p, &de, sizeof(de));
 
 	memcpy(de.d_name, "..", 2);
-	if (write(fd, &de, sizeof(de)) != sizeof(de))
-		err(EXIT_FAILURE, _("error writing .. entry"));
+	memcpy(p + sizeof(de), &de, sizeof(de));
+
+	if (write_all(fd, buf, bufsz))
+		err(EXIT_FAILURE, _("error writing superblock"));
+	free(buf);
 
 	if (close_fd(fd) != 0)
 		err(EXIT_FAILURE, _("error closing %s"), device);
@@ -37,11 +37,14 @@
 #include <getopt.h>
 #include <zconf.h>
 #include <zlib.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "c.h"
 #include "cramfs.h"
 #include "closestream.h"
-#include "md5.h"
+#include "xxhash.h"
 #include "nls.h"
 #include "exitcodes.h"
 #include "strutils.h"
@@ -81,7 +84,7 @@ static int warn_size = 0;
 static int warn_uid = 0;
 
 /* entry.flags */
-#define CRAMFS_EFLAG_MD5	1
+#define CRAMFS_EFLAG_HASH	1
 #define CRAMFS_EFLAG_INVALID	2
 
 /* In-core version of inode / directory entry. */
@@ -89,7 +92,7 @@ struct entry {
 	/* stats */
 	unsigned char *name;
 	unsigned int mode, size, uid, gid;
-	unsigned char md5sum[MD5LENGTH];
+	uint64_t hash;		   /* xxhash64 of the data */
 	unsigned char flags;	   /* CRAMFS_EFLAG_* */
 
 	/* FS data */
@@ -186,27 +189,24 @@ do_munmap(char *start, unsigned int size, unsigned int mode){
 		munmap(start, size);
 }
 
-/* compute md5sums, so that we do not have to compare every pair of files */
+/* compute hashes, so that we do not have to compare every pair of files */
 static void
-mdfile(struct entry *e) {
-	MD5_CTX ctx;
+hashfile(struct entry *e) {
 	char *start;
 
 	start = do_mmap(e->path, e->size, e->mode);
 	if (start == NULL) {
 		e->flags |= CRAMFS_EFLAG_INVALID;
 	} else {
-		MD5Init(&ctx);
-		MD5Update(&ctx, (unsigned char *) start, e->size);
-		MD5Final(e->md5sum, &ctx);
+		e->hash = xxhash64(0, start, e->size);
 
 		do_munmap(start, e->size, e->mode);
 
-		e->flags |= CRAMFS_EFLAG_MD5;
+		e->flags |= CRAMFS_EFLAG_HASH;
 	}
 }
 
-/* md5 digests are equal; files are almost certainly the same,
+/* hashes are equal; files are almost certainly the same,
    but just to be sure, do the comparison */
 static int
 identical_file(struct entry *e1, struct entry *e2){
@@ -228,48 +228,198 @@ identical_file(struct entry *e1, struct entry *e2){
 }
 
 /*
- * The longest file name component to allow for in the input directory tree.
- * Ext2fs (and many others) allow up to 255 bytes.  A couple of filesystems
- * allow longer (e.g. smbfs 1024), but there isn't much use in supporting
- * >255-byte names in the input directory tree given that such names get
- * truncated to 255 bytes when written to cramfs.
+ * Independent jobs (e.g. files or blocks) processed by more threads, the
+ * workers call next_job() to get index of the next unprocessed job.
  */
-#define MAX_INPUT_NAMELEN 255
+struct job_queue {
+	size_t			njobs;
+	size_t			next;		/* the first unprocessed job */
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_t		lock;
+#endif
+};
 
-static int find_identical_file(struct entry *orig, struct entry *new, loff_t *fslen_ub)
+static int next_job(struct job_queue *q, size_t *idx)
 {
-	if (orig == new)
-		return 1;
-	if (!orig)
-		return 0;
-	if (orig->size == new->size && orig->path) {
-		if (!orig->flags)
-			mdfile(orig);
-		if (!new->flags)
-			mdfile(new);
-
-		if ((orig->flags & CRAMFS_EFLAG_MD5) &&
-		    (new->flags & CRAMFS_EFLAG_MD5) &&
-		    !memcmp(orig->md5sum, new->md5sum, MD5LENGTH) &&
-		    identical_file(orig, new)) {
-			new->same = orig;
-			*fslen_ub -= new->size;
-			return 1;
+	int rc = 1;
+
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_lock(&q->lock);
+#endif
+	if (q->next < q->njobs) {
+		*idx = q->next++;
+		rc = 0;
+	}
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_unlock(&q->lock);
+#endif
+	return rc;
+}
+
+static void run_jobs(struct job_queue *q, void *(*worker)(void *), void *data)
+{
+#ifdef HAVE_LIBPTHREAD
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nthreads = ncpus > 0 ? ncpus : 1;
+	pthread_t *threads = NULL;
+	size_t n = 0;
+
+	q->next = 0;
+	if (nthreads > q->njobs)
+		nthreads = q->njobs;
+	if (nthreads > 1)
+		threads = xcalloc(nthreads, sizeof(pthread_t));
+
+	pthread_mutex_init(&q->lock, NULL);
+	for (n = 0; threads && n < nthreads; n++) {
+		if (pthread_create(&threads[n], NULL, worker, data))
+			break;
+	}
+	/* if we have no thread, do the jobs in the current thread */
+	if (n == 0)
+		worker(data);
+	while (n > 0)
+		pthread_join(threads[--n], NULL);
+	pthread_mutex_destroy(&q->lock);
+	free(threads);
+#else
+	q->next = 0;
+	worker(data);
+#endif
+}
+
+/*
+ * Identical files elimination -- the files are sorted by size and only the
+ * files with the same size are hashed (by more threads). The files with the
+ * same size and hash are compared byte by byte. The first file in the
+ * directory tree order is stored to the image, the others point to it.
+ */
+struct dedupe_file {
+	struct entry	*e;
+	size_t		order;		/* in the directory tree */
+};
+
+struct hash_queue {
+	struct dedupe_file	*files;
+	struct job_queue	jobs;
+};
+
+static void collect_files(struct entry *e, struct dedupe_file **files,
+			  size_t *nfiles)
+{
+	for (; e; e = e->next) {
+		if (e->size && e->path) {
+			if (*nfiles % 1024 == 0)
+				*files = xrealloc(*files,
+					(*nfiles + 1024) * sizeof(struct dedupe_file));
+			(*files)[*nfiles].e = e;
+			(*files)[*nfiles].order = *nfiles;
+			(*nfiles)++;
 		}
+		collect_files(e->child, files, nfiles);
 	}
-	return find_identical_file(orig->child, new, fslen_ub) ||
-		   find_identical_file(orig->next, new, fslen_ub);
 }
 
-static void eliminate_doubles(struct entry *root, struct entry *orig, loff_t *fslen_ub) {
-	if (orig) {
-		if (orig->size && orig->path)
-			find_identical_file(root,orig, fslen_ub);
-		eliminate_doubles(root,orig->child, fslen_ub);
-		eliminate_doubles(root,orig->next, fslen_ub);
+static int cmp_size(const void *a, const void *b)
+{
+	const struct dedupe_file *x = a, *y = b;
+
+	if (x->e->size != y->e->size)
+		return x->e->size < y->e->size ? -1 : 1;
+	return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static int cmp_hash(const void *a, const void *b)
+{
+	const struct dedupe_file *x = a, *y = b;
+
+	if (x->e->size != y->e->size)
+		return x->e->size < y->e->size ? -1 : 1;
+	if (x->e->hash != y->e->hash)
+		return x->e->hash < y->e->hash ? -1 : 1;
+	return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static void *hash_worker(void *data)
+{
+	struct hash_queue *q = (struct hash_queue *) data;
+	size_t idx;
+
+	while (next_job(&q->jobs, &idx) == 0)
+		hashfile(q->files[idx].e);
+	return NULL;
+}
+
+static void eliminate_doubles(struct entry *root, loff_t *fslen_ub)
+{
+	struct dedupe_file *files = NULL, **reps = NULL;
+	struct hash_queue q = { .files = NULL };
+	size_t nfiles = 0, i, j, n;
+
+	collect_files(root, &files, &nfiles);
+	if (nfiles < 2)
+		goto done;
+
+	/* only the files with the same size are candidates */
+	qsort(files, nfiles, sizeof(struct dedupe_file), cmp_size);
+
+	for (i = 0, n = 0; i < nfiles; i = j) {
+		for (j = i + 1; j < nfiles && files[j].e->size == files[i].e->size; j++)
+			;
+		if (j - i < 2)
+			continue;
+		memmove(&files[n], &files[i], (j - i) * sizeof(struct dedupe_file));
+		n += j - i;
+	}
+	nfiles = n;
+
+	q.files = files;
+	q.jobs.njobs = nfiles;
+	run_jobs(&q.jobs, hash_worker, &q);
+
+	/* remove unreadable files */
+	for (i = 0, n = 0; i < nfiles; i++) {
+		if (files[i].e->flags & CRAMFS_EFLAG_HASH)
+			files[n++] = files[i];
+	}
+	nfiles = n;
+
+	qsort(files, nfiles, sizeof(struct dedupe_file), cmp_hash);
+	reps = xmalloc(nfiles * sizeof(struct dedupe_file *));
+
+	for (i = 0; i < nfiles; i = j) {
+		size_t nreps = 0, k;
+
+		/* files[i..j) have the same size and hash, sorted by order */
+		for (j = i; j < nfiles && files[j].e->size == files[i].e->size &&
+			    files[j].e->hash == files[i].e->hash; j++) {
+			struct entry *e = files[j].e;
+
+			for (k = 0; k < nreps; k++) {
+				if (identical_file(reps[k]->e, e)) {
+					e->same = reps[k]->e;
+					*fslen_ub -= e->size;
+					break;
+				}
+			}
+			if (k == nreps)
+				reps[nreps++] = &files[j];
+		}
 	}
+done:
+	free(reps);
+	free(files);
 }
 
+/*
+ * The longest file name component to allow for in the input directory tree.
+ * Ext2fs (and many others) allow up to 255 bytes.  A couple of filesystems
+ * allow longer (e.g. smbfs 1024), but there isn't much use in supporting
+ * >255-byte names in the input directory tree given that such names get
+ * truncated to 255 bytes when written to cramfs.
+ */
+#define MAX_INPUT_NAMELEN 255
+
 /*
  * We define our own sorting function instead of using alphasort which
  * uses strcoll and changes ordering based on locale information.
@@ -558,6 +708,55 @@ static int is_zero(unsigned char const *begin, unsigned len)
 		return 0;
 }
 
+/*
+ * The file data are compressed in batches of blocks by more threads. The
+ * compressed blocks are stored to the image in the directory tree order
+ * after all the batch is compressed, so the image does not depend on the
+ * number of threads.
+ */
+#define COMPRESS_BATCH	1024	/* blocks in the batch */
+
+struct compress_block {
+	Bytef		*src;
+	uLong		srclen;
+	Bytef		*dst;		/* 2 * blksize bytes */
+	uLongf		dstlen;		/* zero for hole */
+};
+
+struct compress_file {
+	struct entry	*e;
+	char		*start;		/* mmapped data */
+	size_t		first;		/* the first block of the file */
+};
+
+struct compress_batch {
+	struct compress_file	*files;
+	size_t			nfiles;
+	size_t			nblocks;	/* all queued blocks */
+
+	struct compress_block	*blocks;
+	Bytef			*dst;		/* compressed blocks */
+	struct job_queue	jobs;
+};
+
+static void *compress_worker(void *data)
+{
+	struct compress_batch *b = (struct compress_batch *) data;
+	size_t idx;
+
+	while (next_job(&b->jobs, &idx) == 0) {
+		struct compress_block *blk = &b->blocks[idx];
+
+		if (is_zero(blk->src, blk->srclen)) {
+			blk->dstlen = 0;
+			continue;
+		}
+		blk->dstlen = 2 * blksize;
+		compress(blk->dst, &blk->dstlen, blk->src, blk->srclen);
+	}
+	return NULL;
+}
+
 /*
  * One 4-byte pointer per block and then the actual blocked
  * output. The first block does not need an offset pointer,
@@ -569,52 +768,34 @@ static int is_zero(unsigned char const *begin, unsigned len)
  * have gotten here in the first place.
  */
 static unsigned int
-do_compress(char *base, unsigned int offset, unsigned char const *name,
-	    char *path, unsigned int size, unsigned int mode)
+write_blocks(struct compress_batch *b, struct compress_file *f,
+	     char *base, unsigned int offset)
 {
-	unsigned long original_size, original_offset, new_size, blocks, curr;
+	struct entry *e = f->e;
+	unsigned long original_size, original_offset, new_size, blocks, curr, i;
 	long change;
-	char *start;
-	Bytef *p;
 
-	/* get uncompressed data */
-	start = do_mmap(path, size, mode);
-	if (start == NULL)
-		return offset;
-	p = (Bytef *) start;
-
-	original_size = size;
+	original_size = e->size;
 	original_offset = offset;
-	blocks = (size - 1) / blksize + 1;
+	blocks = (e->size - 1) / blksize + 1;
 	curr = offset + 4 * blocks;
 
-	total_blocks += blocks;
-
-	do {
-		uLongf len = 2 * blksize;
-		uLongf input = size;
-		if (input > blksize)
-			input = blksize;
-		size -= input;
-		if (!is_zero (p, input)) {
-			compress((Bytef *)(base + curr), &len, p, input);
-			curr += len;
-		}
-		p += input;
+	for (i = 0; i < blocks; i++) {
+		struct compress_block *blk = &b->blocks[f->first + i];
 
-		if (len > blksize*2) {
+		if (blk->dstlen > blksize*2) {
 			/* (I don't think this can happen with zlib.) */
 			printf(_("AIEEE: block \"compressed\" to > "
 				 "2*blocklength (%ld)\n"),
-			       len);
+			       blk->dstlen);
 			exit(MKFS_EX_ERROR);
 		}
+		memcpy(base + curr, blk->dst, blk->dstlen);
+		curr += blk->dstlen;
 
 		*(uint32_t *) (base + offset) = u32_toggle_endianness(cramfs_is_big_endian, curr);
 		offset += 4;
-	} while (size);
-
-	do_munmap(start, original_size, mode);
+	}
 
 	curr = (curr + 3) & ~3;
 	new_size = curr - original_offset;
@@ -624,11 +805,73 @@ do_compress(char *base, unsigned int offset, unsigned char const *name,
 	change = new_size - original_size;
 	if (verbose)
 		printf(_("%6.2f%% (%+ld bytes)\t%s\n"),
-		       (change * 100) / (double) original_size, change, name);
+		       (change * 100) / (double) original_size, change, e->name);
 
 	return curr;
 }
 
+/*
+ * Compresses all the queued files and writes them to the image.
+ */
+static unsigned int
+flush_batch(struct compress_batch *b, char *base, unsigned int offset)
+{
+	size_t i, n = 0;
+
+	b->blocks = xrealloc(b->blocks, b->nblocks * sizeof(struct compress_block));
+	b->dst = xrealloc(b->dst, b->nblocks * 2 * blksize);
+
+	for (i = 0; i < b->nfiles; i++) {
+		struct compress_file *f = &b->files[i];
+		struct entry *e = f->e;
+		unsigned int size = e->size;
+		Bytef *p;
+
+		if (e->same)
+			continue;
+		/* get uncompressed data */
+		f->start = do_mmap(e->path, e->size, e->mode);
+		if (!f->start)
+			continue;
+		f->first = n;
+		total_blocks += (size - 1) / blksize + 1;
+
+		for (p = (Bytef *) f->start; size; n++) {
+			struct compress_block *blk = &b->blocks[n];
+
+			blk->src = p;
+			blk->srclen = min(size, blksize);
+			blk->dst = b->dst + n * 2 * blksize;
+			p += blk->srclen;
+			size -= blk->srclen;
+		}
+	}
+
+	b->jobs.njobs = n;
+	if (n)
+		run_jobs(&b->jobs, compress_worker, b);
+
+	for (i = 0; i < b->nfiles; i++) {
+		struct compress_file *f = &b->files[i];
+		struct entry *e = f->e;
+
+		if (e->same) {
+			set_data_offset(e, base, e->same->offset);
+			e->offset = e->same->offset;
+			continue;
+		}
+		set_data_offset(e, base, offset);
+		e->offset = offset;
+		if (!f->start)
+			continue;
+		offset = write_blocks(b, f, base, offset);
+		do_munmap(f->start, e->size, e->mode);
+	}
+
+	b->nfiles = 0;
+	b->nblocks = 0;
+	return offset;
+}
 
 /*
  * Traverse the entry tree, writing data for every item that has
@@ -636,26 +879,51 @@ do_compress(char *base, unsigned int offset, unsigned char const *name,
  * regfile).
  */
 static unsigned int
-write_data(struct entry *entry, char *base, unsigned int offset) {
+queue_data(struct compress_batch *b, struct entry *entry,
+	   char *base, unsigned int offset)
+{
 	struct entry *e;
 
 	for (e = entry; e; e = e->next) {
 		if (e->path) {
-			if (e->same) {
-				set_data_offset(e, base, e->same->offset);
-				e->offset = e->same->offset;
-			} else if (e->size) {
-				set_data_offset(e, base, offset);
-				e->offset = offset;
-				offset = do_compress(base, offset, e->name,
-						     e->path, e->size,e->mode);
-			}
+			struct compress_file *f;
+			size_t blocks = 0;
+
+			if (!e->same && !e->size)
+				continue;
+			if (!e->same)
+				blocks = (e->size - 1) / blksize + 1;
+			if (b->nblocks && b->nblocks + blocks > COMPRESS_BATCH)
+				offset = flush_batch(b, base, offset);
+
+			if (b->nfiles % 64 == 0)
+				b->files = xrealloc(b->files,
+					(b->nfiles + 64) * sizeof(struct compress_file));
+			f = &b->files[b->nfiles++];
+			f->e = e;
+			f->start = NULL;
+			f->first = 0;
+			b->nblocks += blocks;
 		} else if (e->child)
-			offset = write_data(e->child, base, offset);
+			offset = queue_data(b, e->child, base, offset);
 	}
 	return offset;
 }
 
+static unsigned int
+write_data(struct entry *entry, char *base, unsigned int offset)
+{
+	struct compress_batch b = { .files = NULL };
+
+	offset = queue_data(&b, entry, base, offset);
+	offset = flush_batch(&b, base, offset);
+
+	free(b.files);
+	free(b.blocks);
+	free(b.dst);
+	return offset;
+}
+
 static unsigned int write_file(char *file, char *base, unsigned int offset)
 {
 	int fd;
@@ -798,7 +1066,7 @@ int main(int argc, char **argv)
 	root_entry->size = parse_directory(root_entry, dirname, &root_entry->child, &fslen_ub);
 
 	/* find duplicate files */
-	eliminate_doubles(root_entry,root_entry, &fslen_ub);
+	eliminate_doubles(root_entry, &fslen_ub);
 
 	/* always allocate a multiple of blksize bytes because that's
 	   what we're going to write later on */
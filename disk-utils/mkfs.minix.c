@@ -73,6 +73,8 @@
 #include <stdlib.h>
 #include <termios.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <mntent.h>
 #include <getopt.h>
 #include <err.h>
@@ -90,11 +92,15 @@
 #define MINIX_ROOT_INO 1
 #define MINIX_BAD_INO 2
 
-#define TEST_BUFFER_BLOCKS 16
+#define TEST_BUFFER_BLOCKS 1024	/* 1MiB O_DIRECT reads */
 #define MAX_GOOD_BLOCKS 512
 
 #define MINIX_MAX_INODES 65535
 
+/* zero out the inode table by BLKZEROOUT if larger than ZERO_MIN */
+#define ZERO_ALIGN	4096
+#define ZERO_MIN	(64 * 1024)
+
 /*
  * Global variables used in minix_programs.h inline fuctions
  */
@@ -185,40 +191,71 @@ static void super_set_state(void)
 	}
 }
 
+/*
+ * Zeroes the area on block devices by BLKZEROOUT, the thin-provisioned
+ * devices don't have to allocate the blocks. The area has to be aligned to
+ * the sector size. Returns 0 on success.
+ */
+static int zero_area(off_t offset, size_t len)
+{
+	uint64_t range[2] = { offset, len };
+	struct stat st;
+
+	if (fstat(DEV, &st) != 0 || !S_ISBLK(st.st_mode))
+		return -1;
+	return ioctl(DEV, BLKZEROOUT, &range);
+}
+
 static void write_tables(void) {
 	unsigned long imaps = get_nimaps();
 	unsigned long zmaps = get_nzmaps();
 	size_t buffsz = get_inode_buffer_size();
+	off_t inode_off = (2 + imaps + zmaps) * MINIX_BLOCK_SIZE;
+	off_t zend = (inode_off + buffsz) & ~(ZERO_ALIGN - 1);
+	size_t used = buffsz, zeros = 0;
+	struct iovec iov[4];
 
 	/* Mark the super block valid. */
 	super_set_state();
 
-	if (lseek(DEV, 0, SEEK_SET))
-		err(MKFS_EX_ERROR, _("%s: seek to boot block failed "
-				   " in write_tables"), device_name);
-	if (write_all(DEV, boot_block_buffer, 512))
-		err(MKFS_EX_ERROR, _("%s: unable to clear boot sector"), device_name);
-	if (MINIX_BLOCK_SIZE != lseek(DEV, MINIX_BLOCK_SIZE, SEEK_SET))
-		err(MKFS_EX_ERROR, _("%s: seek failed in write_tables"), device_name);
-
-	if (write_all(DEV, super_block_buffer, MINIX_BLOCK_SIZE))
-		err(MKFS_EX_ERROR, _("%s: unable to write super-block"), device_name);
+	/* the rest of the inode table is zero, don't write it if possible */
+	while (used && !inode_buffer[used - 1])
+		used--;
+	used = ((inode_off + used + ZERO_ALIGN - 1) & ~(ZERO_ALIGN - 1)) - inode_off;
+	if (zend > (off_t) (inode_off + used)) {
+		zeros = zend - inode_off - used;
+		if (zeros < ZERO_MIN || zero_area(inode_off + used, zeros) != 0)
+			zeros = 0;
+	}
+	if (!zeros)
+		used = buffsz;
 
-	if (write_all(DEV, inode_map, imaps * MINIX_BLOCK_SIZE))
-		err(MKFS_EX_ERROR, _("%s: unable to write inode map"), device_name);
+	if (pwrite_all(DEV, boot_block_buffer, 512, 0))
+		err(MKFS_EX_ERROR, _("%s: unable to clear boot sector"), device_name);
 
-	if (write_all(DEV, zone_map, zmaps * MINIX_BLOCK_SIZE))
-		err(MKFS_EX_ERROR, _("%s: unable to write zone map"), device_name);
+	/* super-block, maps and inodes by one call */
+	iov[0].iov_base = super_block_buffer;
+	iov[0].iov_len = MINIX_BLOCK_SIZE;
+	iov[1].iov_base = inode_map;
+	iov[1].iov_len = imaps * MINIX_BLOCK_SIZE;
+	iov[2].iov_base = zone_map;
+	iov[2].iov_len = zmaps * MINIX_BLOCK_SIZE;
+	iov[3].iov_base = inode_buffer;
+	iov[3].iov_len = used;
+
+	if (pwritev_all(DEV, iov, ARRAY_SIZE(iov), MINIX_BLOCK_SIZE))
+		err(MKFS_EX_ERROR, _("%s: unable to write super-block, maps and inodes"),
+				device_name);
 
-	if (write_all(DEV, inode_buffer, buffsz))
+	/* not aligned end of the inode table */
+	if (used + zeros < buffsz &&
+	    pwrite_all(DEV, inode_buffer + used + zeros, buffsz - used - zeros,
+		       inode_off + used + zeros))
 		err(MKFS_EX_ERROR, _("%s: unable to write inodes"), device_name);
 }
 
 static void write_block(int blk, char * buffer) {
-	if (blk*MINIX_BLOCK_SIZE != lseek(DEV, blk*MINIX_BLOCK_SIZE, SEEK_SET))
-		errx(MKFS_EX_ERROR, _("%s: seek failed in write_block"), device_name);
-
-	if (write_all(DEV, buffer, MINIX_BLOCK_SIZE))
+	if (pwrite_all(DEV, buffer, MINIX_BLOCK_SIZE, (off_t) blk * MINIX_BLOCK_SIZE))
 		errx(MKFS_EX_ERROR, _("%s: write failed in write_block"), device_name);
 }
 
@@ -554,15 +591,10 @@ static void setup_tables(void) {
  */
 static size_t do_check(char * buffer, int try, unsigned int current_block) {
 	ssize_t got;
-	
-	/* Seek to the correct loc. */
-	if (lseek(DEV, current_block * MINIX_BLOCK_SIZE, SEEK_SET) !=
-		       current_block * MINIX_BLOCK_SIZE )
-		err(MKFS_EX_ERROR, _("%s: seek failed during testing of blocks"),
-				device_name);
 
 	/* Try the read */
-	got = read(DEV, buffer, try * MINIX_BLOCK_SIZE);
+	got = pread(DEV, buffer, try * MINIX_BLOCK_SIZE,
+		    (off_t) current_block * MINIX_BLOCK_SIZE);
 	if (got < 0) got = 0;	
 	if (got & (MINIX_BLOCK_SIZE - 1 )) {
 		printf(_("Weird values in do_check: probably bugs\n"));
@@ -588,25 +620,36 @@ static void alarm_intr(int alnum __attribute__ ((__unused__))) {
 
 static void check_blocks(void) {
 	size_t try, got;
-	static char buffer[MINIX_BLOCK_SIZE * TEST_BUFFER_BLOCKS];
+	char *buffer;
 	unsigned long zones = get_nzones();
 	unsigned long first_zone = get_first_zone();
+	unsigned long slow_end = 0;	/* test block by block up to */
+	int flags = fcntl(DEV, F_GETFL);
+
+	/* read the device, not the page cache */
+	if (posix_memalign((void **) &buffer, getpagesize(),
+			   MINIX_BLOCK_SIZE * TEST_BUFFER_BLOCKS))
+		err(MKFS_EX_ERROR, _("%s: unable to allocate buffer for checking"),
+				device_name);
+	if (flags != -1)
+		fcntl(DEV, F_SETFL, flags | O_DIRECT);
 
 	currently_testing=0;
 	signal(SIGALRM,alarm_intr);
 	alarm(5);
 	while (currently_testing < zones) {
-		if (lseek(DEV,currently_testing*MINIX_BLOCK_SIZE,SEEK_SET) !=
-		    currently_testing*MINIX_BLOCK_SIZE)
-			errx(MKFS_EX_ERROR, _("%s: seek failed in check_blocks"),
-					device_name);
-		try = TEST_BUFFER_BLOCKS;
+		try = currently_testing < slow_end ? 1 : TEST_BUFFER_BLOCKS;
 		if (currently_testing + try > zones)
 			try = zones-currently_testing;
 		got = do_check(buffer, try, currently_testing);
 		currently_testing += got;
 		if (got == try)
 			continue;
+		if (try > 1) {
+			/* find the bad blocks in the rest of the area */
+			slow_end = currently_testing - got + try;
+			continue;
+		}
 		if (currently_testing < first_zone)
 			errx(MKFS_EX_ERROR, _("%s: bad blocks before data-area: "
 					"cannot make fs"), device_name);
@@ -614,6 +657,10 @@ static void check_blocks(void) {
 		badblocks++;
 		currently_testing++;
 	}
+	if (flags != -1)
+		fcntl(DEV, F_SETFL, flags);
+	free(buffer);
+
 	if (badblocks > 0)
 		printf(P_("%d bad block\n", "%d bad blocks\n", badblocks), badblocks);
 }
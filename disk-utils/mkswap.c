@@ -306,30 +306,57 @@ page_bad(int page)
 	badpages++;
 }
 
+/* check_blocks() reads more pages at once, the bad pages are found by
+ * page-size reads only in the failed regions */
+#define CHECK_CHUNK_SIZE	(4 * 1024 * 1024)
+
 static void
 check_blocks(void)
 {
-	unsigned int current_page;
-	int do_seek = 1;
+	unsigned long long current_page = 0;
+	size_t i, chunk_pages = max(CHECK_CHUNK_SIZE / pagesize, 1U);
+	int fd, tty = isatty(STDOUT_FILENO), percent = -1;
 	char *buffer;
 
-	buffer = xmalloc(pagesize);
-	current_page = 0;
-	while (current_page < PAGES) {
+	/* O_DIRECT to bypass the page cache, the page reads are buffered
+	 * as the user-specified page size may be smaller than the sector */
+	fd = open(device_name, O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		fd = DEV;
 
+	if (posix_memalign((void **) &buffer, getpagesize(),
+			   chunk_pages * pagesize))
+		err(EXIT_FAILURE, _("cannot allocate %zu bytes"),
+				chunk_pages * pagesize);
+
+	while (current_page < PAGES) {
+		size_t n = min((unsigned long long) chunk_pages,
+			       PAGES - current_page);
 		ssize_t rc;
 
-		if (do_seek && lseek(DEV,current_page*pagesize,SEEK_SET) !=
-		    current_page*pagesize)
-			errx(EXIT_FAILURE, _("seek failed in check_blocks"));
+		rc = pread(fd, buffer, n * pagesize, current_page * pagesize);
+		if (rc < 0 || (size_t) rc != n * pagesize) {
+			for (i = 0; i < n; i++) {
+				rc = pread(DEV, buffer, pagesize,
+					   (current_page + i) * pagesize);
+				if (rc < 0 || (size_t) rc != pagesize)
+					page_bad(current_page + i);
+			}
+		}
+		current_page += n;
 
-		rc = read(DEV, buffer, pagesize);
-		do_seek = (rc < 0 || (size_t) rc != pagesize);
-		if (do_seek)
-			page_bad(current_page);
-		current_page++;
+		if (tty && (int) (current_page * 100 / PAGES) != percent) {
+			percent = current_page * 100 / PAGES;
+			printf(_("\rchecking bad pages: %3d%%"), percent);
+			fflush(stdout);
+		}
 	}
+	if (tty)
+		putchar('\n');
 	printf(P_("%lu bad page\n", "%lu bad pages\n", badpages), badpages);
+
+	if (fd != DEV)
+		close(fd);
 	free(buffer);
 }
 
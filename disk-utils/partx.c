@@ -412,22 +412,120 @@ static void upd_parts_warnx(const char *device, int first, int last)
 				device, first, last);
 }
 
+/*
+ * Snapshot of the kernel partitions of the whole disk, read from sysfs by one
+ * readdir(). The array is indexed by partition number.
+ */
+struct kernel_part {
+	uintmax_t	start;
+	uintmax_t	size;
+	unsigned int	used : 1;
+};
+
+static struct kernel_part *get_kernel_parts(dev_t devno, int *maxpartno)
+{
+	struct sysfs_cxt cxt;
+	struct kernel_part *kp = NULL;
+	struct dirent *d;
+	DIR *dir;
+	int max = 0, rc = 0;
+
+	if (!devno || sysfs_init(&cxt, devno, NULL))
+		return NULL;
+
+	dir = sysfs_opendir(&cxt, NULL);
+	if (!dir) {
+		sysfs_deinit(&cxt);
+		return NULL;
+	}
+
+	while ((d = readdir(dir))) {
+		char path[sizeof(d->d_name) + 16];
+		uint64_t start, size;
+		int n;
+
+		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+			continue;
+		if (!sysfs_is_partition_dirent(dir, d, NULL))
+			continue;
+
+		snprintf(path, sizeof(path), "%s/partition", d->d_name);
+		rc = sysfs_read_int(&cxt, path, &n);
+		if (!rc) {
+			snprintf(path, sizeof(path), "%s/start", d->d_name);
+			rc = sysfs_read_u64(&cxt, path, &start);
+		}
+		if (!rc) {
+			snprintf(path, sizeof(path), "%s/size", d->d_name);
+			rc = sysfs_read_u64(&cxt, path, &size);
+		}
+		if (rc || n <= 0) {
+			rc = -1;	/* old kernel, unknown partition */
+			break;
+		}
+		if (n > max) {
+			int old = kp ? max + 1 : 0;
+
+			kp = xrealloc(kp, (n + 1) * sizeof(struct kernel_part));
+			memset(&kp[old], 0, (n + 1 - old) * sizeof(struct kernel_part));
+			max = n;
+		}
+		kp[n].start = start;
+		kp[n].size = size;
+		kp[n].used = 1;
+	}
+
+	closedir(dir);
+	sysfs_deinit(&cxt);
+
+	if (rc) {
+		free(kp);
+		return NULL;
+	}
+	if (!kp)
+		kp = xcalloc(1, sizeof(struct kernel_part));
+	*maxpartno = max;
+	return kp;
+}
+
+enum {
+	UPD_NONE = 0,
+	UPD_ADD,
+	UPD_DEL,
+	UPD_RESIZE,
+	UPD_DELADD	/* kernel state unknown, delete (or resize) and add */
+};
+
+/*
+ * Updates the kernel partitions by the minimal diff between the kernel and the
+ * partition table -- the unchanged partitions are not touched at all. All the
+ * partitions are deleted at first, then resized and then added, so the new
+ * partitions don't overlap with the old ones.
+ */
 static int upd_parts(int fd, const char *device, dev_t devno,
 		     blkid_partlist ls, int lower, int upper)
 {
-	int i, n, an, nparts, rc = 0, errfirst = 0, errlast = 0, err;
-	blkid_partition par;
-	uintmax_t start, size;
+	int i, n, nparts, kmax = 0, rc = 0, errfirst = 0, errlast = 0;
+	struct kernel_part *kp;
+	blkid_partition *pars;
+	char *act, *failed;
 
 	assert(fd >= 0);
 	assert(device);
 	assert(ls);
 
+	if (!devno) {
+		struct stat st;
+		if (stat(device, &st) == 0)
+			devno = st.st_rdev;
+	}
+	kp = get_kernel_parts(devno, &kmax);
+
 	nparts = blkid_partlist_numof_partitions(ls);
 	if (!lower)
 		lower = 1;
 	if (!upper || lower < 0 || upper < 0) {
-		n = get_max_partno(device, devno);
+		n = kp ? kmax : get_max_partno(device, devno);
 		if (!upper)
 			upper = n > nparts ? n : nparts;
 		else if (upper < 0)
@@ -438,55 +536,106 @@ static int upd_parts(int fd, const char *device, dev_t devno,
 	if (lower > upper) {
 		warnx(_("specified range <%d:%d> "
 			"does not make sense"), lower, upper);
+		free(kp);
 		return -1;
 	}
 
-	for (i = 0, n = lower; n <= upper; n++) {
-		par = blkid_partlist_get_partition(ls, i);
-		an = blkid_partition_get_partno(par);
+	/* partition table indexed by partno */
+	pars = xcalloc(upper + 1, sizeof(blkid_partition));
+	for (i = 0; i < nparts; i++) {
+		blkid_partition par = blkid_partlist_get_partition(ls, i);
 
-		if (lower && n < lower)
+		n = blkid_partition_get_partno(par);
+		if (n >= lower && n <= upper)
+			pars[n] = par;
+	}
+
+	act = xcalloc(upper + 1, sizeof(char));
+	failed = xcalloc(upper + 1, sizeof(char));
+
+	for (n = lower; n <= upper; n++) {
+		struct kernel_part *k = kp && n <= kmax && kp[n].used ? &kp[n] : NULL;
+		uintmax_t start, size;
+
+		if (!kp) {
+			act[n] = pars[n] ? UPD_DELADD : UPD_DEL;
 			continue;
-		if (upper && n > upper)
+		}
+		if (!pars[n]) {
+			act[n] = k ? UPD_DEL : UPD_NONE;
 			continue;
+		}
 
-		start = blkid_partition_get_start(par);
-		size =  blkid_partition_get_size(par);
+		start = blkid_partition_get_start(pars[n]);
+		size =  blkid_partition_get_size(pars[n]);
 
-		if (blkid_partition_is_extended(par))
+		if (blkid_partition_is_extended(pars[n]))
 			/*
 			 * Let's follow the Linux kernel and reduce
 			 * DOS extended partition to 1 or 2 sectors.
 			 */
 			size = min(size, (uintmax_t) 2);
 
+		if (!k)
+			act[n] = UPD_ADD;
+		else if (k->start != start)
+			act[n] = UPD_DELADD;
+		else if (k->size != size)
+			act[n] = UPD_RESIZE;
+		else
+			act[n] = UPD_NONE;
+	}
+
+	/* delete */
+	for (n = lower; n <= upper; n++) {
+		int err;
+
+		if (act[n] != UPD_DEL && act[n] != UPD_DELADD)
+			continue;
+
 		err = partx_del_partition(fd, n);
 		if (err == -1 && errno == ENXIO)
 			err = 0; /* good, it already doesn't exist */
-		if (an == n)
-		{
-			if (i < nparts)
-				i++;
-			if (err == -1 && errno == EBUSY)
-			{
-				/* try to resize */
-				err = partx_resize_partition(fd, n, start, size);
-				if (verbose)
-					printf(_("%s: partition #%d resized\n"), device, n);
-				if (err == 0)
-					continue;
-			}
-			if (err == 0 && partx_add_partition(fd, n, start, size) == 0) {
-				if (verbose)
-					printf(_("%s: partition #%d added\n"), device, n);
-				continue;
-			}
+		else if (err == 0 && verbose && act[n] == UPD_DEL)
+			printf(_("%s: partition #%d removed\n"), device, n);
+
+		if (err == -1 && errno == EBUSY && act[n] == UPD_DELADD && !kp)
+			act[n] = UPD_RESIZE;	/* in use, try to resize */
+		else if (err)
+			failed[n] = 1;
+	}
+
+	/* resize and add */
+	for (n = lower; n <= upper; n++) {
+		uintmax_t start, size;
+
+		if (failed[n] || act[n] == UPD_NONE || act[n] == UPD_DEL)
+			continue;
+
+		start = blkid_partition_get_start(pars[n]);
+		size =  blkid_partition_get_size(pars[n]);
+		if (blkid_partition_is_extended(pars[n]))
+			size = min(size, (uintmax_t) 2);
+
+		if (act[n] == UPD_RESIZE) {
+			if (partx_resize_partition(fd, n, start, size) != 0)
+				failed[n] = 1;
+			else if (verbose)
+				printf(_("%s: partition #%d resized\n"), device, n);
+		} else {
+			if (partx_add_partition(fd, n, start, size) != 0)
+				failed[n] = 1;
+			else if (verbose)
+				printf(_("%s: partition #%d added\n"), device, n);
 		}
-		if (err == 0)
+	}
+
+	for (n = lower; n <= upper; n++) {
+		if (!failed[n])
 			continue;
 		rc = -1;
 		if (verbose)
-			warn(_("%s: updating partition #%d failed"), device, n);
+			warnx(_("%s: updating partition #%d failed"), device, n);
 		if (!errfirst)
 			errlast = errfirst = n;
 		else if (errlast + 1 == n)
@@ -499,6 +648,11 @@ static int upd_parts(int fd, const char *device, dev_t devno,
 
 	if (errfirst)
 		upd_parts_warnx(device, errfirst, errlast);
+
+	free(failed);
+	free(act);
+	free(pars);
+	free(kp);
 	return rc;
 }
 
@@ -621,6 +775,7 @@ static int show_parts(blkid_partlist ls, int tt_flags, int lower, int upper)
 		warn(_("failed to initialize output table"));
 		return -1;
 	}
+	tt_set_name(tt, "partitions");
 
 	for (i = 0; i < ncolumns; i++) {
 		struct colinfo *col = get_column_info(i);
@@ -704,6 +859,7 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(_(" -s, --show           list partitions\n\n"), out);
 	fputs(_(" -b, --bytes          print SIZE in bytes rather than in human readable format\n"), out);
 	fputs(_(" -g, --noheadings     don't print headings for --show\n"), out);
+	fputs(_(" -J, --json           use JSON output format\n"), out);
 	fputs(_(" -n, --nr <n:m>       specify the range of partitions (e.g. --nr 2:4)\n"), out);
 	fputs(_(" -o, --output <list>  define which output columns to use\n"), out);
 	fputs(_(" -P, --pairs          use key=\"value\" output format\n"), out);
@@ -715,7 +871,7 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(USAGE_HELP, out);
 	fputs(USAGE_VERSION, out);
 
-	fputs(_("\nAvailable columns (for --show, --raw or --pairs):\n"), out);
+	fputs(_("\nAvailable columns (for --show, --raw, --pairs or --json):\n"), out);
 
 	for (i = 0; i < NCOLS; i++)
 		fprintf(out, " %10s  %s\n", infos[i].name, _(infos[i].help));
@@ -748,6 +904,7 @@ int main(int argc, char **argv)
 		{ "nr",		required_argument, NULL, 'n' },
 		{ "output",	required_argument, NULL, 'o' },
 		{ "pairs",      no_argument,       NULL, 'P' },
+		{ "json",       no_argument,       NULL, 'J' },
 		{ "help",	no_argument,       NULL, 'h' },
 		{ "version",    no_argument,       NULL, 'V' },
 		{ "verbose",	no_argument,       NULL, 'v' },
@@ -755,7 +912,7 @@ int main(int argc, char **argv)
 	};
 
 	static const ul_excl_t excl[] = {	/* rows and cols in in ASCII order */
-		{ 'P','a','d','l','r','s' },
+		{ 'J','P','a','d','l','r','s' },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -766,7 +923,7 @@ int main(int argc, char **argv)
 	atexit(close_stdout);
 
 	while ((c = getopt_long(argc, argv,
-				"abdglrsuvn:t:o:PhV", long_opts, NULL)) != -1) {
+				"abdglrsuvn:t:o:PJhV", long_opts, NULL)) != -1) {
 
 		err_exclusive_options(c, long_opts, excl, excl_st);
 
@@ -797,6 +954,10 @@ int main(int argc, char **argv)
 			tt_flags |= TT_FL_EXPORT;
 			what = ACT_SHOW;
 			break;
+		case 'J':
+			tt_flags |= TT_FL_JSON;
+			what = ACT_SHOW;
+			break;
 		case 'r':
 			tt_flags |= TT_FL_RAW;
 			what = ACT_SHOW;
@@ -343,6 +343,20 @@ int defined = FALSE;
 int COLUMNS = 80;
 int NUM_ON_SCREEN = 1;
 
+/*
+ * Screen updates -- the whole screen is redrawn only when necessary, otherwise
+ * only the modified partition rows are redrawn (it's visible on slow serial
+ * consoles). See update_screen().
+ */
+#define DIRTY_NONE	0
+#define DIRTY_PARTS	1	/* rows marked in dirty_parts[] */
+#define DIRTY_TABLE	2	/* table header and all rows */
+#define DIRTY_SCREEN	3	/* erase and redraw everything */
+
+int screen_dirty = DIRTY_SCREEN;
+char dirty_parts[MAXIMUM_PARTS];
+int drawn_page = -1;		/* first partition of the drawn table page */
+
 /* Y coordinates */
 int HEADER_START = 0;
 int DISK_TABLE_START = 6;
@@ -360,6 +374,8 @@ int COMMAND_LINE_X = 5;
 
 static void die_x(int ret);
 static void draw_screen(void);
+static void draw_table(void);
+static void draw_row(int i);
 
 /* Guaranteed alloc */
 static void *
@@ -2516,6 +2532,16 @@ draw_screen(void) {
 	    heads, sectors, cylinders);
     mvaddstr(HEADER_START+4, (COLS-strlen(line))/2, line);
 
+    free(line);
+    draw_table();
+}
+
+static void
+draw_table(void) {
+    int i, page = (cur_part/NUM_ON_SCREEN)*NUM_ON_SCREEN;
+
+    move(DISK_TABLE_START, 0);
+    clrtoeol();
     mvaddstr(DISK_TABLE_START, NAME_START, _("Name"));
     mvaddstr(DISK_TABLE_START, FLAGS_START, _("Flags"));
     mvaddstr(DISK_TABLE_START, PTYPE_START-1, _("Part Type"));
@@ -2534,17 +2560,66 @@ draw_screen(void) {
     for (i = 1; i < COLS-1; i++)
 	addch('-');
 
-    if (NUM_ON_SCREEN >= num_parts)
-	for (i = 0; i < num_parts; i++)
-	    draw_partition(i);
-    else
-	for (i = (cur_part/NUM_ON_SCREEN)*NUM_ON_SCREEN;
-	     i < NUM_ON_SCREEN + (cur_part/NUM_ON_SCREEN)*NUM_ON_SCREEN &&
-	     i < num_parts;
-	     i++)
-	    draw_partition(i);
+    for (i = page; i < page + NUM_ON_SCREEN; i++)
+	draw_row(i);
 
-    free(line);
+    drawn_page = page;
+    memset(dirty_parts, 0, sizeof(dirty_parts));
+    screen_dirty = DIRTY_NONE;
+}
+
+/* draws partition or empty row at position of the partition @i */
+static void
+draw_row(int i) {
+    move(i + DISK_TABLE_START + 2 - (cur_part/NUM_ON_SCREEN)*NUM_ON_SCREEN, 0);
+    clrtoeol();
+
+    if (i < num_parts)
+	draw_partition(i);
+}
+
+static void
+mark_dirty(int level) {
+    if (level > screen_dirty)
+	screen_dirty = level;
+}
+
+/* marks partitions @from..@to dirty, @to < 0 means all from @from */
+static void
+mark_parts_dirty(int from, int to) {
+    int i;
+
+    if (from < 0)
+	from = 0;
+    if (to < 0 || to >= MAXIMUM_PARTS)
+	to = MAXIMUM_PARTS - 1;
+    for (i = from; i <= to; i++)
+	dirty_parts[i] = 1;
+    mark_dirty(DIRTY_PARTS);
+}
+
+/* redraws the dirty part of the screen */
+static void
+update_screen(void) {
+    int i, page = (cur_part/NUM_ON_SCREEN)*NUM_ON_SCREEN;
+
+    if (screen_dirty == DIRTY_SCREEN) {
+	draw_screen();
+	return;
+    }
+    if (screen_dirty == DIRTY_TABLE || page != drawn_page) {
+	draw_table();
+	return;
+    }
+    if (screen_dirty == DIRTY_NONE)
+	return;
+
+    for (i = page; i < page + NUM_ON_SCREEN && i < MAXIMUM_PARTS; i++) {
+	if (dirty_parts[i])
+	    draw_row(i);
+    }
+    memset(dirty_parts, 0, sizeof(dirty_parts));
+    screen_dirty = DIRTY_NONE;
 }
 
 static void
@@ -2564,7 +2639,7 @@ draw_cursor(int move) {
 
     if (((cur_part - move)/NUM_ON_SCREEN)*NUM_ON_SCREEN !=
 	(cur_part/NUM_ON_SCREEN)*NUM_ON_SCREEN)
-	draw_screen();
+	draw_table();		/* new page, the header is not changed */
 
     if (arrow_cursor)
 	mvaddstr(DISK_TABLE_START + cur_part + 2
@@ -2613,11 +2688,10 @@ do_curses_fdisk(void) {
 
     fill_p_info();
 
-    draw_screen();
-
     while (!done) {
 	char *s;
 
+	update_screen();
 	draw_cursor(0);
 
 	if (p_info[cur_part].id == FREE_SPACE) {
@@ -2645,17 +2719,18 @@ do_curses_fdisk(void) {
 	case 'D':
 	case 'd':
 	    if (p_info[cur_part].id > 0) {
+		/* the free space rows are merged and renumbered */
+		mark_dirty(DIRTY_TABLE);
 		del_part(cur_part);
 		if (cur_part >= num_parts)
 		    cur_part = num_parts - 1;
-		draw_screen();
 	    } else
 		print_warning(_("Cannot delete an empty partition"));
 	    break;
 	case 'G':
 	case 'g':
 	    if (change_geometry())
-		draw_screen();
+		mark_dirty(DIRTY_SCREEN);
 	    break;
 	case 'M':
 	case 'm':
@@ -2666,7 +2741,7 @@ do_curses_fdisk(void) {
 			p_info[cur_part].offset = 1;
 		    else
 			p_info[cur_part].offset = sectors;
-		    draw_screen();
+		    mark_parts_dirty(cur_part, cur_part);
 		} else if (p_info[cur_part].offset != 0)
 		    p_info[cur_part].offset = 0;
 		else
@@ -2678,7 +2753,7 @@ do_curses_fdisk(void) {
 	case 'n':
 	    if (p_info[cur_part].id == FREE_SPACE) {
 		new_part(cur_part);
-		draw_screen();
+		mark_dirty(DIRTY_TABLE);
 	    } else if (p_info[cur_part].id == UNUSABLE)
 		print_warning(_("This partition is unusable"));
 	    else
@@ -2687,7 +2762,7 @@ do_curses_fdisk(void) {
 	case 'P':
 	case 'p':
 	    print_tables();
-	    draw_screen();
+	    mark_dirty(DIRTY_SCREEN);
 	    break;
 	case 'Q':
 	case 'q':
@@ -2697,7 +2772,7 @@ do_curses_fdisk(void) {
 	case 't':
 	    if (p_info[cur_part].id > 0) {
 		change_id(cur_part);
-		draw_screen();
+		mark_dirty(DIRTY_SCREEN);	/* types list overwrites the table */
 	    } else
 		print_warning(_("Cannot change the type of an empty partition"));
 	    break;
@@ -2711,7 +2786,7 @@ do_curses_fdisk(void) {
 		display_units = CYLINDERS;
 	    else if (display_units == CYLINDERS)
 		display_units = MEGABYTES; 	/* not yet GIGA */
-	    draw_screen();
+	    mark_dirty(DIRTY_TABLE);
 	    break;
 	case 'W':
 	    write_part_table();
@@ -2720,7 +2795,7 @@ do_curses_fdisk(void) {
 	case 'h':
 	case '?':
 	    display_help();
-	    draw_screen();
+	    mark_dirty(DIRTY_SCREEN);
 	    break;
 	case KEY_UP:	/* Up arrow key */
 	case '\020':	/* ^P */
@@ -2734,7 +2809,7 @@ do_curses_fdisk(void) {
 	    break;
 	case REDRAWKEY:
 	    clear();
-	    draw_screen();
+	    mark_dirty(DIRTY_SCREEN);
 	    break;
 	case KEY_HOME:
 		draw_cursor(-cur_part);
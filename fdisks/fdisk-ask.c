@@ -256,7 +256,9 @@ int ask_callback(struct fdisk_context *cxt, struct fdisk_ask *ask,
 		return ask_offset(cxt, ask, buf, sizeof(buf));
 	case FDISK_ASKTYPE_INFO:
 		info_count++;
-		fputs_info(ask, stdout, buf, sizeof(buf));
+		/* don't mix messages with the machine readable output */
+		fputs_info(ask, fdisk_context_is_machine_readable(cxt) ?
+				 stderr : stdout, buf, sizeof(buf));
 		break;
 	case FDISK_ASKTYPE_WARNX:
 		color_fenable(UL_COLOR_RED, stderr);
@@ -280,9 +282,15 @@ int ask_callback(struct fdisk_context *cxt, struct fdisk_ask *ask,
 		DBG(ASK, dbgprint("yes-no ask: reply '%s' [rc=%d]", buf, rc));
 		break;
 	case FDISK_ASKTYPE_TABLE:
-		fputc('\n', stdout);
-		tt_print_table(fdisk_ask_get_table(ask));
+	{
+		struct tt *tb = fdisk_ask_get_table(ask);
+
+		/* nothing printed yet (see TT_FL_STREAM) */
+		if (tb->first_run && !fdisk_context_is_machine_readable(cxt))
+			fputc('\n', stdout);
+		tt_print_table(tb);
 		break;
+	}
 	case FDISK_ASKTYPE_STRING:
 	{
 		char prmt[BUFSIZ];
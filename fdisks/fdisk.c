@@ -19,8 +19,11 @@
 #include <getopt.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <limits.h>
+#include <poll.h>
+#include <signal.h>
 
 #include "c.h"
 #include "xalloc.h"
@@ -58,8 +61,12 @@ static void __attribute__ ((__noreturn__)) usage(FILE *out)
 	fputs(_(" -b <size>         sector size (512, 1024, 2048 or 4096)\n"), out);
 	fputs(_(" -c[=<mode>]       compatible mode: 'dos' or 'nondos' (default)\n"), out);
 	fputs(_(" -h                print this help text\n"), out);
+	fputs(_(" -j <jobs>         list the disks in parallel by <jobs> processes\n"), out);
 	fputs(_(" -c[=<mode>]       compatible mode: 'dos' or 'nondos' (default)\n"), out);
 	fputs(_(" -L[=<when>]       colorize output (auto, always or never)\n"), out);
+	fputs(_(" -o <list>         output columns of the partitions list\n"), out);
+	fputs(_(" -O <format>       format of the partitions list: raw, json, export,\n"
+		"                     stream and noheadings (comma separated)\n"), out);
 	fputs(_(" -t <type>         force fdisk to recognize specified partition table type only\n"), out);
 	fputs(_(" -u[=<unit>]       display units: 'cylinders' or 'sectors' (default)\n"), out);
 	fputs(_(" -v                print program version\n"), out);
@@ -331,6 +338,13 @@ static void print_device_pt(struct fdisk_context *cxt, char *device)
 	if (fdisk_context_assign_device(cxt, device, 1) != 0)	/* read-only */
 		err(EXIT_FAILURE, _("cannot open %s"), device);
 
+	/* the machine readable output contains the partitions only */
+	if (fdisk_context_is_machine_readable(cxt)) {
+		if (fdisk_dev_has_disklabel(cxt))
+			fdisk_list_disklabel(cxt);
+		return;
+	}
+
 	list_disk_geometry(cxt);
 
 	if (fdisk_dev_has_disklabel(cxt))
@@ -338,10 +352,198 @@ static void print_device_pt(struct fdisk_context *cxt, char *device)
 	fputc('\n', stdout);
 }
 
-static void print_all_devices_pt(struct fdisk_context *cxt)
+/*
+ * Parallel listing -- every disk is listed by a child process (with its own
+ * copy of the context), the output is collected by pipes and printed in the
+ * /proc/partitions order. A disk which is not listed within the timeout is
+ * skipped.
+ */
+#define LIST_DEFAULT_TIMEOUT	30	/* seconds */
+
+struct list_buffer {
+	int	fd;		/* pipe from the child or -1 */
+	char	*data;
+	size_t	sz;
+};
+
+struct list_job {
+	char			*devname;
+	pid_t			pid;
+	time_t			start;
+	struct list_buffer	out;
+	struct list_buffer	err;
+	unsigned int		running : 1,
+				done : 1,
+				timeout : 1;
+};
+
+static void list_buffer_read(struct list_buffer *b)
+{
+	char buf[BUFSIZ];
+	ssize_t ret = read(b->fd, buf, sizeof(buf));
+
+	if (ret > 0) {
+		b->data = xrealloc(b->data, b->sz + ret);
+		memcpy(b->data + b->sz, buf, ret);
+		b->sz += ret;
+	} else if (ret == 0 || (errno != EINTR && errno != EAGAIN)) {
+		close(b->fd);
+		b->fd = -1;
+	}
+}
+
+static void list_buffer_flush(struct list_buffer *b, FILE *out)
+{
+	if (b->fd >= 0)
+		close(b->fd);
+	if (b->sz)
+		fwrite(b->data, 1, b->sz, out);
+	free(b->data);
+	b->data = NULL;
+	b->sz = 0;
+}
+
+static void list_job_start(struct fdisk_context *cxt, struct list_job *job)
+{
+	int out[2], errp[2];
+
+	if (pipe(out) != 0 || pipe(errp) != 0)
+		err(EXIT_FAILURE, _("cannot create pipe"));
+
+	fflush(stdout);
+	fflush(stderr);
+
+	job->pid = fork();
+	if (job->pid < 0)
+		err(EXIT_FAILURE, _("fork failed"));
+	if (job->pid == 0) {
+		close(out[0]);
+		close(errp[0]);
+		if (dup2(out[1], STDOUT_FILENO) < 0 ||
+		    dup2(errp[1], STDERR_FILENO) < 0)
+			_exit(EXIT_FAILURE);
+		close(out[1]);
+		close(errp[1]);
+
+		if (!is_ide_cdrom_or_tape(job->devname))
+			print_device_pt(cxt, job->devname);
+		exit(EXIT_SUCCESS);
+	}
+
+	close(out[1]);
+	close(errp[1]);
+	job->out.fd = out[0];
+	job->err.fd = errp[0];
+	job->start = time(NULL);
+	job->running = 1;
+
+	DBG(FRONTEND, dbgprint("list: %s started [pid=%d]", job->devname, job->pid));
+}
+
+static void list_job_finish(struct list_job *job)
+{
+	if (job->timeout)
+		kill(job->pid, SIGKILL);
+	waitpid(job->pid, NULL, 0);
+
+	job->running = 0;
+	job->done = 1;
+	DBG(FRONTEND, dbgprint("list: %s done%s", job->devname,
+				job->timeout ? " [timeout]" : ""));
+}
+
+static void list_devices_parallel(struct fdisk_context *cxt,
+				  char **devs, size_t ndevs, size_t njobs)
+{
+	struct list_job *jobs = xcalloc(ndevs, sizeof(struct list_job));
+	struct pollfd *fds = xcalloc(njobs * 2, sizeof(struct pollfd));
+	size_t i, next_start = 0, next_out = 0, nrunning = 0;
+	unsigned long timeout = LIST_DEFAULT_TIMEOUT;
+	char *str = getenv("FDISK_LIST_TIMEOUT");
+
+	if (str)
+		timeout = strtoul_or_err(str, _("invalid timeout argument"));
+
+	for (i = 0; i < ndevs; i++) {
+		jobs[i].devname = devs[i];
+		jobs[i].out.fd = jobs[i].err.fd = -1;
+	}
+
+	while (next_out < ndevs) {
+		struct list_job *job;
+		size_t nfds = 0;
+		time_t now;
+
+		/* start new jobs */
+		while (nrunning < njobs && next_start < ndevs) {
+			list_job_start(cxt, &jobs[next_start++]);
+			nrunning++;
+		}
+
+		for (i = 0; i < next_start; i++) {
+			job = &jobs[i];
+			if (!job->running)
+				continue;
+			if (job->out.fd >= 0) {
+				fds[nfds].fd = job->out.fd;
+				fds[nfds++].events = POLLIN;
+			}
+			if (job->err.fd >= 0) {
+				fds[nfds].fd = job->err.fd;
+				fds[nfds++].events = POLLIN;
+			}
+		}
+
+		if (nfds && poll(fds, nfds, 1000) < 0 && errno != EINTR)
+			err(EXIT_FAILURE, _("poll failed"));
+
+		now = time(NULL);
+		for (i = 0; i < next_start; i++) {
+			size_t k;
+
+			job = &jobs[i];
+			if (!job->running)
+				continue;
+			for (k = 0; k < nfds; k++) {
+				if (!fds[k].revents)
+					continue;
+				if (fds[k].fd == job->out.fd)
+					list_buffer_read(&job->out);
+				else if (fds[k].fd == job->err.fd)
+					list_buffer_read(&job->err);
+			}
+			if (job->out.fd < 0 && job->err.fd < 0)
+				list_job_finish(job);
+			else if ((unsigned long) (now - job->start) >= timeout) {
+				job->timeout = 1;
+				list_job_finish(job);
+			}
+			if (!job->running)
+				nrunning--;
+		}
+
+		/* print finished jobs in the original order */
+		while (next_out < ndevs && jobs[next_out].done) {
+			job = &jobs[next_out++];
+
+			fflush(stdout);
+			list_buffer_flush(&job->err, stderr);
+			if (job->timeout)
+				warnx(_("%s: timeout, listing skipped"), job->devname);
+			list_buffer_flush(&job->out, stdout);
+		}
+	}
+
+	free(fds);
+	free(jobs);
+}
+
+static void print_all_devices_pt(struct fdisk_context *cxt, size_t njobs)
 {
 	FILE *f;
 	char line[128 + 1];
+	char **devs = NULL;
+	size_t ndevs = 0, i;
 
 	f = fopen(_PATH_PROC_PARTITIONS, "r");
 	if (!f) {
@@ -363,14 +565,26 @@ static void print_all_devices_pt(struct fdisk_context *cxt)
 
 		if (is_whole_disk(devname)) {
 			char *cn = canonicalize_path(devname);
-			if (cn) {
-				if (!is_ide_cdrom_or_tape(cn))
-					print_device_pt(cxt, cn);
-				free(cn);
+			if (!cn)
+				continue;
+			if (njobs > 1) {
+				/* list later in parallel */
+				devs = xrealloc(devs, (ndevs + 1) * sizeof(char *));
+				devs[ndevs++] = cn;
+				continue;
 			}
+			if (!is_ide_cdrom_or_tape(cn))
+				print_device_pt(cxt, cn);
+			free(cn);
 		}
 	}
 	fclose(f);
+
+	if (ndevs)
+		list_devices_parallel(cxt, devs, ndevs, njobs);
+	for (i = 0; i < ndevs; i++)
+		free(devs[i]);
+	free(devs);
 }
 
 static sector_t get_dev_blocks(char *dev)
@@ -398,6 +612,7 @@ int main(int argc, char **argv)
 {
 	int i, c, act = ACT_FDISK;
 	int colormode = UL_COLORMODE_AUTO;
+	size_t njobs = 1;
 	struct fdisk_context *cxt;
 
 	setlocale(LC_ALL, "");
@@ -412,7 +627,7 @@ int main(int argc, char **argv)
 
 	fdisk_context_set_ask(cxt, ask_callback, NULL);
 
-	while ((c = getopt(argc, argv, "b:c::C:hH:lL::sS:t:u::vV")) != -1) {
+	while ((c = getopt(argc, argv, "b:c::C:hH:j:lL::o:O:sS:t:u::vV")) != -1) {
 		switch (c) {
 		case 'b':
 		{
@@ -456,6 +671,10 @@ int main(int argc, char **argv)
 				strtou32_or_err(optarg,
 					_("invalid sectors argument")));
 			break;
+		case 'j':
+			njobs = strtou32_or_err(optarg,
+					_("invalid number of jobs argument"));
+			break;
 		case 'l':
 			act = ACT_LIST;
 			break;
@@ -464,6 +683,14 @@ int main(int argc, char **argv)
 				colormode = colormode_or_err(optarg,
 						_("unsupported color mode"));
 			break;
+		case 'o':
+			if (fdisk_context_set_table_columns(cxt, optarg) != 0)
+				err(EXIT_FAILURE, _("failed to set output columns"));
+			break;
+		case 'O':
+			if (fdisk_context_set_table_format(cxt, optarg) != 0)
+				errx(EXIT_FAILURE, _("unsupported output format: %s"), optarg);
+			break;
 		case 's':
 			act = ACT_SHOWSIZE;
 			break;
@@ -511,7 +738,7 @@ int main(int argc, char **argv)
 			for (k = optind; k < argc; k++)
 				print_device_pt(cxt, argv[k]);
 		} else
-			print_all_devices_pt(cxt);
+			print_all_devices_pt(cxt, njobs);
 		break;
 
 	case ACT_SHOWSIZE:
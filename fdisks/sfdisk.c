@@ -54,6 +54,11 @@
 #include "closestream.h"
 #include "strutils.h"
 
+#ifdef HAVE_LIBFDISK
+# include "libfdisk.h"
+# include "tt.h"
+#endif
+
 struct systypes {
 	unsigned char type;
 	char *name;
@@ -92,6 +97,8 @@ int leave_last = 0;		/* 1: don't allocate the last cylinder */
 int opt_list = 0;
 char *save_sector_file = NULL;
 char *restore_sector_file = NULL;
+char *list_columns = NULL;	/* --output, list by libfdisk */
+char *list_format = NULL;	/* --output-format, list by libfdisk */
 
 /*
  *  A. About seeking
@@ -128,14 +135,19 @@ sseek(char *dev, int fd, unsigned long s) {
 
 /*
  * We preserve all sectors read in a chain - some of these will
- * have to be modified and written back.
+ * have to be modified and written back. The sectors are also hashed
+ * by sector number, so long chains of extended partitions don't
+ * have to be searched linearly.
  */
+#define SECTOR_HASH_SIZE	256
+
 struct sector {
     struct sector *next;
+    struct sector *hnext;	/* next in the same hash bucket */
     unsigned long long sectornumber;
     int to_be_written;
     char data[512];
-} *sectorhead;
+} *sectorhead, *sectorhash[SECTOR_HASH_SIZE];
 
 static void
 free_sectors(void) {
@@ -146,22 +158,23 @@ free_sectors(void) {
 	sectorhead = s->next;
 	free(s);
     }
+    memset(sectorhash, 0, sizeof(sectorhash));
 }
 
 static struct sector *
 get_sector(char *dev, int fd, unsigned long long sno) {
     struct sector *s;
+    size_t h = sno % SECTOR_HASH_SIZE;
 
-    for (s = sectorhead; s; s = s->next)
+    for (s = sectorhash[h]; s; s = s->hnext)
 	if (s->sectornumber == sno)
 	    return s;
 
-    if (!sseek(dev, fd, sno))
-	return 0;
-
     s = xmalloc(sizeof(struct sector));
 
-    if (read(fd, s->data, sizeof(s->data)) != sizeof(s->data)) {
+    /* one syscall rather than lseek() + read() */
+    if (pread(fd, s->data, sizeof(s->data), (off_t) sno << 9)
+		!= sizeof(s->data)) {
 	warn(_("read error on %s - cannot read sector %llu"), dev, sno);
 	free(s);
 	return 0;
@@ -169,6 +182,8 @@ get_sector(char *dev, int fd, unsigned long long sno) {
 
     s->next = sectorhead;
     sectorhead = s;
+    s->hnext = sectorhash[h];
+    sectorhash[h] = s;
     s->sectornumber = sno;
     s->to_be_written = 0;
 
@@ -2354,6 +2369,8 @@ static void usage(FILE * out)
 		"     --print-id            print Id\n"), out);
 	fputs(_(" -l, --list                list partitions of each device\n"
 		" -d, --dump                idem, but in a format suitable for later input\n"
+		"     --output <list>       output columns of the list (see fdisk -o)\n"
+		"     --output-format <fmt> list format: raw, json, export, stream, noheadings\n"
 		" -i, --increment           number cylinders etc. from 1 instead of from 0\n"
 		" -u, --unit <letter>       units to be used; <letter> can be one of\n"
 		"                             S (sectors), C (cylinders), B (blocks), or M (MB)\n"), out);
@@ -2431,7 +2448,9 @@ enum {
     OPT_NOT_INSIDE_OUTER,
     OPT_NESTED,
     OPT_CHAINED,
-    OPT_ONESECTOR
+    OPT_ONESECTOR,
+    OPT_OUTPUT,
+    OPT_OUTPUT_FORMAT
 };
 
 static const struct option long_opts[] = {
@@ -2464,6 +2483,8 @@ static const struct option long_opts[] = {
     { "no-reread",        no_argument, NULL, OPT_NO_REREAD },
     { "IBM",              no_argument, NULL, OPT_LEAVE_LAST },
     { "leave-last",       no_argument, NULL, OPT_LEAVE_LAST },
+    { "output",           required_argument, NULL, OPT_OUTPUT },
+    { "output-format",    required_argument, NULL, OPT_OUTPUT_FORMAT },
 /* dangerous flags - not all completely implemented */
     { "in-order",         no_argument, NULL, OPT_IN_ORDER },
     { "not-in-order",     no_argument, NULL, OPT_NOT_IN_ORDER },
@@ -2667,9 +2688,21 @@ main(int argc, char **argv) {
 	case OPT_LEAVE_LAST:
 	    leave_last = 1;
 	    break;
+	case OPT_OUTPUT:
+	    list_columns = optarg;
+	    break;
+	case OPT_OUTPUT_FORMAT:
+	    list_format = optarg;
+	    break;
 	}
     }
 
+#ifndef HAVE_LIBFDISK
+    if (list_columns || list_format)
+	errx(EXIT_FAILURE, _("--output and --output-format are not supported "
+			     "(compiled without libfdisk)"));
+#endif
+
     if (optind == argc &&
 	(opt_list || opt_out_geom || opt_out_pt_geom || opt_size || verify)) {
 	FILE *procf;
@@ -2778,11 +2811,79 @@ my_open(char *dev, int rw, int silent) {
     return fd;
 }
 
+#ifdef HAVE_LIBFDISK
+/*
+ * The --output and --output-format listing is printed by libfdisk, the same
+ * code as for fdisk -l (all label types, the tt output formats).
+ */
+static int
+list_ask_callback(struct fdisk_context *cxt, struct fdisk_ask *ask,
+		  void *data __attribute__((__unused__))) {
+    switch (fdisk_ask_get_type(ask)) {
+    case FDISK_ASKTYPE_INFO:
+	fputs(fdisk_ask_print_get_mesg(ask),
+	      fdisk_context_is_machine_readable(cxt) ? stderr : stdout);
+	fputc('\n', fdisk_context_is_machine_readable(cxt) ? stderr : stdout);
+	break;
+    case FDISK_ASKTYPE_WARNX:
+	if (!quiet)
+	    warnx("%s", fdisk_ask_print_get_mesg(ask));
+	break;
+    case FDISK_ASKTYPE_WARN:
+	if (!quiet) {
+	    errno = fdisk_ask_print_get_errno(ask);
+	    warn("%s", fdisk_ask_print_get_mesg(ask));
+	}
+	break;
+    case FDISK_ASKTYPE_TABLE:
+	tt_print_table(fdisk_ask_get_table(ask));
+	break;
+    default:
+	return -EINVAL;
+    }
+    return 0;
+}
+
+static void
+list_by_libfdisk(char *dev, int silent) {
+    static struct fdisk_context *cxt;
+
+    if (!cxt) {
+	cxt = fdisk_new_context();
+	if (!cxt)
+	    err(EXIT_FAILURE, _("failed to allocate libfdisk context"));
+	fdisk_context_set_ask(cxt, list_ask_callback, NULL);
+	fdisk_context_enable_listonly(cxt, 1);
+
+	if (list_format && fdisk_context_set_table_format(cxt, list_format))
+	    errx(EXIT_FAILURE, _("unsupported output format: %s"), list_format);
+	if (list_columns && fdisk_context_set_table_columns(cxt, list_columns))
+	    err(EXIT_FAILURE, _("failed to set output columns"));
+    }
+
+    if (fdisk_context_assign_device(cxt, dev, 1) != 0) {	/* read-only */
+	if (!silent)
+	    err(EXIT_FAILURE, _("cannot open %s for reading"), dev);
+	return;
+    }
+    if (!fdisk_context_is_machine_readable(cxt))
+	printf(_("\nDisk %s:\n"), dev);
+    if (fdisk_dev_has_disklabel(cxt))
+	fdisk_list_disklabel(cxt);
+}
+#endif /* HAVE_LIBFDISK */
+
 static void
 do_list(char *dev, int silent) {
     int fd;
     struct disk_desc *z;
 
+#ifdef HAVE_LIBFDISK
+    if (opt_list && !dump && !verify && (list_columns || list_format)) {
+	list_by_libfdisk(dev, silent);
+	return;
+    }
+#endif
     fd = my_open(dev, 0, silent);
     if (fd < 0)
 	return;
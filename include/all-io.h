@@ -12,6 +12,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 #include "c.h"
 
@@ -34,6 +35,59 @@ static inline int write_all(int fd, const void *buf, size_t count)
 	return 0;
 }
 
+/*
+ * The same as write_all(), but writes to @offset and does not modify the
+ * file offset.
+ */
+static inline int pwrite_all(int fd, const void *buf, size_t count, off_t offset)
+{
+	while (count) {
+		ssize_t tmp;
+
+		errno = 0;
+		tmp = pwrite(fd, buf, count, offset);
+		if (tmp > 0) {
+			count -= tmp;
+			offset += tmp;
+			if (count)
+				buf = (void *) ((char *) buf + tmp);
+		} else if (errno != EINTR && errno != EAGAIN)
+			return -1;
+		if (errno == EAGAIN)	/* Try later, *sigh* */
+			usleep(10000);
+	}
+	return 0;
+}
+
+/*
+ * Writes all the @iov buffers to @offset, the @iov array is modified.
+ */
+static inline int pwritev_all(int fd, struct iovec *iov, int iovcnt, off_t offset)
+{
+	while (iovcnt) {
+		ssize_t tmp;
+
+		errno = 0;
+		tmp = pwritev(fd, iov, iovcnt, offset);
+		if (tmp > 0) {
+			offset += tmp;
+			while (iovcnt && (size_t) tmp >= iov->iov_len) {
+				tmp -= iov->iov_len;
+				iov++;
+				iovcnt--;
+			}
+			if (iovcnt) {
+				iov->iov_base = (char *) iov->iov_base + tmp;
+				iov->iov_len -= tmp;
+			}
+		} else if (errno != EINTR && errno != EAGAIN)
+			return -1;
+		if (errno == EAGAIN)	/* Try later, *sigh* */
+			usleep(10000);
+	}
+	return 0;
+}
+
 static inline int fwrite_all(const void *ptr, size_t size,
 			     size_t nmemb, FILE *stream)
 {
@@ -78,5 +132,34 @@ static inline ssize_t read_all(int fd, char *buf, size_t count)
 	return c;
 }
 
+/*
+ * The same as read_all(), but reads from @offset and does not modify the
+ * file offset (so the @fd could be shared between threads).
+ */
+static inline ssize_t pread_all(int fd, char *buf, size_t count, off_t offset)
+{
+	ssize_t ret;
+	ssize_t c = 0;
+	int tries = 0;
+
+	memset(buf, 0, count);
+	while (count > 0) {
+		ret = pread(fd, buf, count, offset);
+		if (ret <= 0) {
+			if ((errno == EAGAIN || errno == EINTR || ret == 0) &&
+			    (tries++ < 5))
+				continue;
+			return c ? c : -1;
+		}
+		if (ret > 0)
+			tries = 0;
+		count -= ret;
+		buf += ret;
+		offset += ret;
+		c += ret;
+	}
+	return c;
+}
+
 
 #endif /* UTIL_LINUX_ALL_IO_H */
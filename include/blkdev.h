@@ -62,6 +62,11 @@
 #  define BLKDISCARDZEROES _IO(0x12,124)
 # endif
 
+/* zero out the range, introduced in 3.7 */
+# ifndef BLKZEROOUT
+#  define BLKZEROOUT _IO(0x12,127)
+# endif
+
 /* filesystem freeze, introduced in 2.6.29 (commit fcccf502) */
 # ifndef FIFREEZE
 #  define FIFREEZE   _IOWR('X', 119, int)    /* Freeze */
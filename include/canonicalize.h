@@ -18,4 +18,11 @@ extern char *canonicalize_path(const char *path);
 extern char *canonicalize_path_restricted(const char *path);
 extern char *canonicalize_dm_name(const char *ptname);
 
+struct canonicalize_cache;
+
+extern struct canonicalize_cache *new_canonicalize_cache(void);
+extern void free_canonicalize_cache(struct canonicalize_cache *cc);
+extern char *canonicalize_path_cached(struct canonicalize_cache *cc,
+				      const char *path);
+
 #endif /* CANONICALIZE_H */
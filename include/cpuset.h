@@ -6,6 +6,7 @@
 #define UTIL_LINUX_CPUSET_H
 
 #include <sched.h>
+#include <sys/types.h>
 
 /*
  * Fallback for old or obscure libcs without dynamically allocated cpusets
@@ -87,6 +88,14 @@ static inline int cpuset_ary_isset(size_t cpu, cpu_set_t **ary, size_t nmemb,
 
 extern int get_max_number_of_cpus(void);
 
+extern ssize_t cpuset_next_set(const cpu_set_t *set, size_t setsize, size_t cpu);
+
+/* iterates over CPUs in the @set, @cpu has to be ssize_t */
+#define cpuset_foreach(cpu, set, setsize) \
+	for ((cpu) = cpuset_next_set((set), (setsize), 0); \
+	     (cpu) >= 0; \
+	     (cpu) = cpuset_next_set((set), (setsize), (cpu) + 1))
+
 extern cpu_set_t *cpuset_alloc(int ncpus, size_t *setsize, size_t *nbits);
 extern void cpuset_free(cpu_set_t *set);
 
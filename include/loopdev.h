@@ -23,6 +23,9 @@
 #define LOOP_GET_STATUS64	0x4C05
 /* #define LOOP_CHANGE_FD	0x4C06 */
 #define LOOP_SET_CAPACITY	0x4C07
+#ifndef LOOP_CONFIGURE
+# define LOOP_CONFIGURE		0x4C0A	/* kernel >= 5.8 */
+#endif
 
 /* /dev/loop-control interface */
 #ifndef LOOP_CTL_ADD
@@ -63,6 +66,17 @@ struct loop_info64 {
 	uint64_t	lo_init[2];
 };
 
+/*
+ * Linux LOOP_CONFIGURE ioctl struct, LOOP_SET_FD and LOOP_SET_STATUS64 in
+ * one step
+ */
+struct loop_config {
+	uint32_t		fd;
+	uint32_t		block_size;
+	struct loop_info64	info;
+	uint64_t		__reserved[8];
+};
+
 #define LOOPDEV_MAJOR		7	/* loop major number */
 #define LOOPDEV_DEFAULT_NNODES	8	/* default number of loop devices */
 
@@ -107,6 +121,24 @@ struct loopdev_cxt {
 
 #define UL_LOOPDEVCXT_EMPTY { .fd = -1, .sysfs = UL_SYSFSCXT_EMPTY }
 
+/*
+ * Snapshot of the used loop devices and the backing files, read from /sys in
+ * one pass. It's expected to be used for more lookups within one operation.
+ */
+struct loopdev_idxent {
+	int		nr;		/* loop<N> */
+	char		*filename;	/* loop/backing_file */
+	uint64_t	offset;		/* loop/offset */
+	dev_t		devno;		/* backing file device and inode */
+	ino_t		ino;
+	unsigned int	has_ino:1;	/* stat() on the backing file succeeded */
+};
+
+struct loopdev_index {
+	struct loopdev_idxent	*ents;	/* sorted by loop<N> number */
+	size_t			nents;
+};
+
 /*
  * loopdev_cxt.flags
  */
@@ -135,9 +167,23 @@ extern int loopdev_is_used(const char *device, const char *filename,
 extern char *loopdev_find_by_backing_file(const char *filename,
 					  uint64_t offset, int flags);
 extern int loopcxt_find_unused(struct loopdev_cxt *lc);
+
+/*
+ * The device returned by loopcxt_find_unused() may be stolen by another
+ * process before loopcxt_setup_device(), the setup fails with EBUSY and the
+ * caller tries the next unused device -- but not forever.
+ */
+#define LOOPDEV_SETUP_MAXTRIES	128
 extern int loopdev_delete(const char *device);
 extern int loopdev_count_by_backing_file(const char *filename, char **loopdev);
 
+extern int loopdev_index_scan(struct loopdev_index *idx);
+extern void loopdev_index_deinit(struct loopdev_index *idx);
+extern struct loopdev_idxent *loopdev_index_get_device(struct loopdev_index *idx,
+					const char *device);
+extern int loopdev_index_is_used(struct loopdev_index *idx, const char *device,
+				 const char *filename, uint64_t offset, int flags);
+
 /*
  * Low-level
  */
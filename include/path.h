@@ -18,6 +18,29 @@ extern uint64_t path_read_u64(const char *path, ...)
 extern int path_exist(const char *path, ...)
 		      __attribute__ ((__format__ (__printf__, 1, 2)));
 
+/* directory relative reading, see lib/path.c */
+struct path_cxt {
+	int	dir_fd;		/* the directory */
+	char	*dir_path;	/* the directory path (with prefix) */
+};
+
+#define UL_PATHCXT_EMPTY { .dir_fd = -1 }
+
+extern int path_init_cxt(struct path_cxt *pc, const char *dir, ...)
+			__attribute__ ((__format__ (__printf__, 2, 3)));
+extern void path_deinit_cxt(struct path_cxt *pc);
+
+extern int path_existat(struct path_cxt *pc, const char *path, ...)
+			__attribute__ ((__format__ (__printf__, 2, 3)));
+extern int path_read_strat(struct path_cxt *pc, char *buf, size_t len,
+			   const char *path, ...)
+			__attribute__ ((__format__ (__printf__, 4, 5)));
+extern int path_read_s32at(struct path_cxt *pc, int *res, const char *path, ...)
+			__attribute__ ((__format__ (__printf__, 3, 4)));
+extern int path_read_u64at(struct path_cxt *pc, uint64_t *res,
+			   const char *path, ...)
+			__attribute__ ((__format__ (__printf__, 3, 4)));
+
 #ifdef HAVE_CPU_SET_T
 # include "cpuset.h"
 
@@ -25,6 +48,12 @@ extern cpu_set_t *path_read_cpuset(int, const char *path, ...)
 			      __attribute__ ((__format__ (__printf__, 2, 3)));
 extern cpu_set_t *path_read_cpulist(int, const char *path, ...)
 			       __attribute__ ((__format__ (__printf__, 2, 3)));
+extern cpu_set_t *path_read_cpusetat(struct path_cxt *pc, int maxcpus,
+				     const char *path, ...)
+			__attribute__ ((__format__ (__printf__, 3, 4)));
+extern cpu_set_t *path_read_cpulistat(struct path_cxt *pc, int maxcpus,
+				      const char *path, ...)
+			__attribute__ ((__format__ (__printf__, 3, 4)));
 extern void path_set_prefix(const char *);
 #endif /* HAVE_CPU_SET_T */
 
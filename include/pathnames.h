@@ -100,6 +100,9 @@
 #define _PATH_SYS_SELINUX	"/sys/fs/selinux"
 #define _PATH_SYS_APPARMOR	"/sys/kernel/security/apparmor"
 
+/* udev database */
+#define _PATH_UDEV_DATA		"/run/udev/data"
+
 #ifndef _PATH_MOUNTED
 # ifdef MOUNTED					/* deprecated */
 #  define _PATH_MOUNTED		MOUNTED
@@ -2,6 +2,7 @@
 #define UTIL_LINUX_PROCUTILS
 
 #include <dirent.h>
+#include <sys/types.h>
 
 struct proc_tasks {
 	DIR *dir;
@@ -28,5 +29,44 @@ extern void proc_processes_filter_by_name(struct proc_processes *ps, const char
 extern void proc_processes_filter_by_uid(struct proc_processes *ps, uid_t uid);
 extern int proc_next_pid(struct proc_processes *ps, pid_t *pid);
 
+/*
+ * Snapshot of all processes, /proc is read only once for all lookups.
+ */
+enum {
+	PROC_NS_MNT = 0,
+	PROC_NS_PID,
+	PROC_NS_NET,
+	PROC_NS_IPC,
+	PROC_NS_UTS,
+	PROC_NS_USER,
+
+	PROC_NS_COUNT
+};
+
+struct proc_entry {
+	pid_t	pid;
+	pid_t	ppid;
+	uid_t	uid;			/* owner of /proc/<pid>/stat */
+	char	comm[64];		/* command name from /proc/<pid>/stat */
+	ino_t	ns[PROC_NS_COUNT];	/* /proc/<pid>/ns/<name> or 0 */
+};
+
+struct proc_snapshot {
+	struct proc_entry	*ents;		/* sorted by PID */
+	struct proc_entry	**byname;	/* sorted by comm and PID */
+	size_t			nents;
+};
+
+enum {
+	PROC_SNAP_NS	= (1 << 0)	/* read namespaces inodes */
+};
+
+extern int proc_snapshot_read(struct proc_snapshot *snap, int flags);
+extern void proc_snapshot_deinit(struct proc_snapshot *snap);
+extern struct proc_entry *proc_snapshot_get_pid(struct proc_snapshot *snap,
+						pid_t pid);
+extern struct proc_entry **proc_snapshot_get_name(struct proc_snapshot *snap,
+						const char *name, size_t *n);
+
 
 #endif /* UTIL_LINUX_PROCUTILS */
@@ -16,6 +16,8 @@
 #include <inttypes.h>
 #include <dirent.h>
 
+struct sysfs_attr;
+
 struct sysfs_cxt {
 	dev_t	devno;
 	int	dir_fd;		/* /sys/block/<name> */
@@ -27,10 +29,13 @@ struct sysfs_cxt {
 			scsi_target,
 			scsi_lun;
 
-	unsigned int	has_hctl : 1;
+	unsigned int	has_hctl : 1,
+			use_cache : 1;	/* cache attributes, see sysfs_enable_cache() */
+
+	struct sysfs_attr *attrs;	/* cached attributes */
 };
 
-#define UL_SYSFSCXT_EMPTY { 0, -1, NULL, NULL, 0, 0, 0, 0, 0 }
+#define UL_SYSFSCXT_EMPTY { 0, -1, NULL, NULL, 0, 0, 0, 0, 0, 0, NULL }
 
 extern char *sysfs_devno_attribute_path(dev_t devno, char *buf,
                                  size_t bufsiz, const char *attr);
@@ -42,6 +47,7 @@ extern dev_t sysfs_devname_to_devno(const char *name, const char *parent);
 extern int sysfs_init(struct sysfs_cxt *cxt, dev_t devno, struct sysfs_cxt *parent)
 					__attribute__ ((warn_unused_result));
 extern void sysfs_deinit(struct sysfs_cxt *cxt);
+extern void sysfs_enable_cache(struct sysfs_cxt *cxt);
 
 extern DIR *sysfs_opendir(struct sysfs_cxt *cxt, const char *attr);
 
@@ -81,4 +87,44 @@ extern int sysfs_scsi_host_is(struct sysfs_cxt *cxt, const char *type);
 extern int sysfs_scsi_has_attribute(struct sysfs_cxt *cxt, const char *attr);
 extern int sysfs_scsi_path_contains(struct sysfs_cxt *cxt, const char *pattern);
 
+/*
+ * Snapshot of the block devices topology (/sys/block)
+ */
+struct sysfs_blkdev {
+	char		*name;		/* kernel name, e.g. "sda1" */
+	dev_t		devno;
+	uint64_t	size;		/* in 512-byte sectors */
+	unsigned int	ro : 1,
+			removable : 1,
+			rotational : 1;
+	uint64_t	start;		/* partitions only, in 512-byte sectors */
+	int		discard_granularity;	/* queue/ (of the whole disk) */
+	int		read_ahead_kb;		/* queue/ */
+	int		logical_block_size;	/* queue/ */
+
+	struct sysfs_blkdev	*wholedisk;	/* partitions only */
+
+	struct sysfs_blkdev	**parts;	/* partitions of the whole disk */
+	size_t			nparts;
+	struct sysfs_blkdev	**holders;	/* holders/ */
+	size_t			nholders;
+	struct sysfs_blkdev	**slaves;	/* slaves/ */
+	size_t			nslaves;
+};
+
+struct sysfs_blktopo {
+	struct sysfs_blkdev	**devs;		/* in readdir order, partitions follow the disk */
+	size_t			ndevs;
+	struct sysfs_blkdev	**byname;	/* sorted by name */
+};
+
+#define UL_SYSFSBLKTOPO_EMPTY { NULL, 0, NULL }
+
+extern int sysfs_blktopo_scan(struct sysfs_blktopo *topo);
+extern void sysfs_blktopo_deinit(struct sysfs_blktopo *topo);
+extern struct sysfs_blkdev *sysfs_blktopo_get_name(struct sysfs_blktopo *topo,
+			const char *name);
+extern struct sysfs_blkdev *sysfs_blktopo_get_devno(struct sysfs_blktopo *topo,
+			dev_t devno);
+
 #endif /* UTIL_LINUX_SYSFS_H */
@@ -30,18 +30,34 @@ enum {
 	TT_FL_NOEXTREMES  = (1 << 9),   /* ignore extreme fields when count column width*/
 
 	TT_FL_FREEDATA	  = (1 << 10),	/* free() data in tt_free_table() */
+
+	/*
+	 * Global flags
+	 */
+	TT_FL_STREAM	  = (1 << 11),	/* print lines as they are added */
+	TT_FL_JSON	  = (1 << 12),	/* JSON output, trees as nested arrays */
 };
 
+/* default number of lines used to count column widths in TT_FL_STREAM mode */
+#define TT_STREAM_NSAMPLE	100
+
 struct tt {
 	size_t	ncols;		/* number of columns */
 	size_t	termwidth;	/* terminal width */
 	int	is_term;	/* is a tty? */
+	int	termforce;	/* termwidth set by tt_set_termwidth() */
 	int	flags;
 	int	first_run;
+	const char *name;	/* JSON name of the table */
+
+	size_t	nlines;		/* number of lines in tb_lines */
+	size_t	nsample;	/* TT_FL_STREAM: lines used to count widths */
 
 	struct list_head	tb_columns;
 	struct list_head	tb_lines;
 
+	struct tt_chunk		*arena;	/* memory for lines and copied data */
+
 	const struct tt_symbols	*symbols;
 };
 
@@ -64,6 +80,8 @@ struct tt_column {
 struct tt_line {
 	struct tt	*table;
 	char		**data;
+	size_t		*widths;		/* cells of printable ASCII data or -1 */
+	char		*copied;		/* data[] copied to the table arena */
 	void		*userdata;
 	size_t		data_sz;		/* strlen of all data */
 
@@ -79,6 +97,9 @@ extern struct tt *tt_new_table(int flags);
 extern void tt_free_table(struct tt *tb);
 extern void tt_remove_lines(struct tt *tb);
 extern int tt_print_table(struct tt *tb);
+extern int tt_set_stream_nsample(struct tt *tb, size_t nsample);
+extern int tt_set_name(struct tt *tb, const char *name);
+extern int tt_set_termwidth(struct tt *tb, size_t width);
 
 extern struct tt_column *tt_define_column(struct tt *tb, const char *name,
 						double whint, int flags);
@@ -88,6 +109,7 @@ extern struct tt_column *tt_get_column(struct tt *tb, size_t colnum);
 extern struct tt_line *tt_add_line(struct tt *tb, struct tt_line *parent);
 
 extern int tt_line_set_data(struct tt_line *ln, int colnum, char *data);
+extern int tt_line_set_data_copy(struct tt_line *ln, int colnum, const char *data);
 extern int tt_line_set_userdata(struct tt_line *ln, void *data);
 
 extern void tt_fputs_quoted(const char *data, FILE *out);
@@ -7,6 +7,37 @@
 # include <wchar.h>
 # include <wctype.h>
 
+# include <stdio.h>
+# include <string.h>
+# include <limits.h>
+
+  /* Single-threaded utils don't need locking for every character */
+# ifndef HAVE_GETWC_UNLOCKED
+#  define getwc_unlocked getwc
+#  define getwchar_unlocked getwchar
+# endif
+
+/*
+ * Writes the wide character to byte oriented stdout. It's much faster than
+ * putwchar(), ASCII is written without conversion. Don't mix with putwchar()
+ * and fputws(), the stream cannot be wide and byte oriented at once.
+ */
+static inline wint_t putwchar_mb(wint_t wc)
+{
+	char buf[MB_LEN_MAX];
+	mbstate_t st;
+	size_t n;
+
+	if (wc < 0x80)
+		return putchar_unlocked(wc) == EOF ? WEOF : wc;
+
+	memset(&st, 0, sizeof(st));
+	n = wcrtomb(buf, wc, &st);
+	if (n == (size_t) -1 || fwrite(buf, 1, n, stdout) != n)
+		return WEOF;
+	return wc;
+}
+
 #else /* !HAVE_WIDECHAR */
 
 # include <ctype.h>
@@ -18,11 +49,14 @@
 # define fgetwc fgetc
 # define getwc getc
 # define getwchar getchar
+# define getwc_unlocked getc
+# define getwchar_unlocked getchar
 # define fgetws fgets
   /* Fallback for output operations */
 # define fputwc fputc
 # define putwc putc
 # define putwchar putchar
+# define putwchar_mb putchar
 # define fputws fputs
   /* Fallback for character classification */
 # define iswgraph isgraph
@@ -0,0 +1,9 @@
+#ifndef UTIL_LINUX_XXHASH_H
+#define UTIL_LINUX_XXHASH_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+extern uint64_t xxhash64(uint64_t seed, const void *data, size_t len);
+
+#endif
@@ -12,6 +12,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -48,9 +49,23 @@ char *canonicalize_dm_name(const char *ptname)
 	return res;
 }
 
+static char *canonicalize_dm_path(char *canonical)
+{
+	char *p = strrchr(canonical, '/');
+
+	if (p && strncmp(p, "/dm-", 4) == 0 && isdigit(*(p + 4))) {
+		char *dm = canonicalize_dm_name(p + 1);
+		if (dm) {
+			free(canonical);
+			return dm;
+		}
+	}
+	return canonical;
+}
+
 char *canonicalize_path(const char *path)
 {
-	char *canonical, *p;
+	char *canonical;
 
 	if (!path || !*path)
 		return NULL;
@@ -59,21 +74,327 @@ char *canonicalize_path(const char *path)
 	if (!canonical)
 		return strdup(path);
 
-	p = strrchr(canonical, '/');
-	if (p && strncmp(p, "/dm-", 4) == 0 && isdigit(*(p + 4))) {
-		char *dm = canonicalize_dm_name(p + 1);
-		if (dm) {
-			free(canonical);
-			return dm;
+	return canonicalize_dm_path(canonical);
+}
+
+/*
+ * The cache of already resolved path components. The key is the canonical
+ * path of the parent directory and the component name, so every component is
+ * checked by lstat() (and readlink()) only once also for paths with long
+ * common prefixes (e.g. /var/lib/kubelet/pods/<id>/volumes/...). The errors
+ * (e.g. ENOENT) are not cached.
+ *
+ * The paths are always absolute and canonical, so there is no need to walk
+ * the paths by openat() -- the kernel lookup is done by one syscall for each
+ * not-yet-cached component.
+ *
+ * The /proc entries (and links to /proc) are never cached, the links like
+ * /proc/self or /proc/<pid>/fd/<N> depend on the process.
+ */
+struct canon_entry {
+	char			*path;		/* canonical parent + '/' + name */
+	char			*real;		/* symlink resolution or NULL */
+	unsigned int		hash;
+	unsigned int		isdir : 1,	/* path (or real) is directory */
+				nocache : 1;	/* not in the cache, free after use */
+	struct canon_entry	*next;
+};
+
+struct canonicalize_cache {
+	struct canon_entry	**buckets;
+	size_t			nbuckets;
+	size_t			nents;
+};
+
+#define CANON_MAXSYMLINKS	40
+#define CANON_MINBUCKETS	64
+
+static void free_canon_entry(struct canon_entry *e)
+{
+	free(e->path);
+	free(e->real);
+	free(e);
+}
+
+static unsigned int canon_hash(const char *str)
+{
+	unsigned int h = 2166136261U;
+
+	for (; *str; str++) {
+		h ^= (unsigned char) *str;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+struct canonicalize_cache *new_canonicalize_cache(void)
+{
+	return calloc(1, sizeof(struct canonicalize_cache));
+}
+
+void free_canonicalize_cache(struct canonicalize_cache *cc)
+{
+	size_t i;
+
+	if (!cc)
+		return;
+
+	for (i = 0; i < cc->nbuckets; i++) {
+		struct canon_entry *e = cc->buckets[i];
+
+		while (e) {
+			struct canon_entry *next = e->next;
+
+			free_canon_entry(e);
+			e = next;
 		}
 	}
+	free(cc->buckets);
+	free(cc);
+}
 
-	return canonical;
+static struct canon_entry *canon_lookup(struct canonicalize_cache *cc,
+					const char *path, unsigned int hash)
+{
+	struct canon_entry *e;
+
+	if (!cc->nbuckets)
+		return NULL;
+
+	for (e = cc->buckets[hash & (cc->nbuckets - 1)]; e; e = e->next) {
+		if (e->hash == hash && strcmp(e->path, path) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+static int canon_add(struct canonicalize_cache *cc, struct canon_entry *e)
+{
+	size_t i;
+
+	if (cc->nents >= cc->nbuckets) {
+		size_t n = cc->nbuckets ? cc->nbuckets * 2 : CANON_MINBUCKETS;
+		struct canon_entry **b = calloc(n, sizeof(struct canon_entry *));
+
+		if (!b)
+			return -ENOMEM;
+
+		/* rehash */
+		for (i = 0; i < cc->nbuckets; i++) {
+			struct canon_entry *x = cc->buckets[i];
+
+			while (x) {
+				struct canon_entry *next = x->next;
+				size_t k = x->hash & (n - 1);
+
+				x->next = b[k];
+				b[k] = x;
+				x = next;
+			}
+		}
+		free(cc->buckets);
+		cc->buckets = b;
+		cc->nbuckets = n;
+	}
+
+	i = e->hash & (cc->nbuckets - 1);
+	e->next = cc->buckets[i];
+	cc->buckets[i] = e;
+	cc->nents++;
+	return 0;
+}
+
+static char *canon_resolve(struct canonicalize_cache *cc, const char *base,
+			   const char *path, int *nlinks, int *isdir);
+
+/*
+ * Returns cache entry for @path (canonical parent + '/' + name) or NULL (and
+ * errno) in case of error.
+ */
+static struct canon_entry *canon_get_entry(struct canonicalize_cache *cc,
+					   char *path, size_t parentsz,
+					   int *nlinks)
+{
+	unsigned int hash = canon_hash(path);
+	struct canon_entry *e = canon_lookup(cc, path, hash);
+	struct stat st;
+
+	if (e)
+		return e;
+
+	if (fstatat(AT_FDCWD, path, &st, AT_SYMLINK_NOFOLLOW) != 0)
+		return NULL;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return NULL;
+
+	if (S_ISLNK(st.st_mode)) {
+		char link[PATH_MAX], *parent;
+		ssize_t sz;
+		int dir = 0;
+
+		if (++*nlinks > CANON_MAXSYMLINKS) {
+			errno = ELOOP;
+			goto err;
+		}
+		sz = readlinkat(AT_FDCWD, path, link, sizeof(link) - 1);
+		if (sz < 0)
+			goto err;
+		link[sz] = '\0';
+
+		parent = strndup(path, parentsz);
+		if (!parent)
+			goto err;
+		e->real = canon_resolve(cc, parent, link, nlinks, &dir);
+		free(parent);
+		if (!e->real)
+			goto err;
+		e->isdir = dir;
+	} else
+		e->isdir = S_ISDIR(st.st_mode) ? 1 : 0;
+
+	e->path = strdup(path);
+	if (!e->path)
+		goto err;
+	e->hash = hash;
+
+	if (strncmp(path, "/proc/", 6) == 0 ||
+	    (e->real && strncmp(e->real, "/proc/", 6) == 0))
+		e->nocache = 1;
+	else if (canon_add(cc, e) != 0)
+		goto err;
+	return e;
+err:
+	free_canon_entry(e);
+	return NULL;
+}
+
+/*
+ * Resolves @path relative to the canonical directory @base ("" for root
+ * directory), the result is never terminated by '/' (except root).
+ */
+static char *canon_resolve(struct canonicalize_cache *cc, const char *base,
+			   const char *path, int *nlinks, int *isdir)
+{
+	char *res;
+	size_t ressz, len;
+	int dir = 1;
+
+	if (*path == '/')
+		base = "";
+
+	len = strlen(base);
+	ressz = len + strlen(path) + 2;
+	res = malloc(ressz);
+	if (!res)
+		return NULL;
+	memcpy(res, base, len + 1);
+
+	while (*path) {
+		struct canon_entry *e;
+		const char *end;
+		size_t sz;
+
+		/* "file/" and "file/name" */
+		if (!dir && *path == '/') {
+			errno = ENOTDIR;
+			goto err;
+		}
+		while (*path == '/')
+			path++;
+		end = strchrnul(path, '/');
+		sz = end - path;
+
+		if (sz == 0 || (sz == 1 && *path == '.')) {
+			path = end;
+			continue;
+		}
+		if (sz == 2 && path[0] == '.' && path[1] == '.') {
+			char *p = strrchr(res, '/');
+
+			if (p)
+				*p = '\0';
+			path = end;
+			continue;
+		}
+
+		/* append "/name" */
+		len = strlen(res);
+		if (len + sz + 2 > ressz) {
+			char *tmp;
+
+			ressz = len + sz + strlen(end) + 2;
+			tmp = realloc(res, ressz);
+			if (!tmp)
+				goto err;
+			res = tmp;
+		}
+		res[len] = '/';
+		memcpy(res + len + 1, path, sz);
+		res[len + 1 + sz] = '\0';
+
+		e = canon_get_entry(cc, res, len, nlinks);
+		if (!e)
+			goto err;
+		dir = e->isdir;
+
+		if (e->real) {
+			size_t rsz = strlen(e->real) + strlen(end) + 2;
+
+			if (rsz > ressz) {
+				char *tmp = realloc(res, rsz);
+
+				if (!tmp) {
+					if (e->nocache)
+						free_canon_entry(e);
+					goto err;
+				}
+				res = tmp;
+				ressz = rsz;
+			}
+			/* "/" is stored as "" */
+			strcpy(res, strcmp(e->real, "/") == 0 ? "" : e->real);
+		}
+		if (e->nocache)
+			free_canon_entry(e);
+		path = end;
+	}
+
+	if (isdir)
+		*isdir = dir;
+	if (!*res)
+		strcpy(res, "/");
+	return res;
+err:
+	free(res);
+	return NULL;
+}
+
+/*
+ * The same as canonicalize_path(), but the path components are cached in @cc.
+ * The relative paths are not cached.
+ */
+char *canonicalize_path_cached(struct canonicalize_cache *cc, const char *path)
+{
+	char *canonical;
+	int nlinks = 0;
+
+	if (!path || !*path)
+		return NULL;
+	if (!cc || *path != '/')
+		return canonicalize_path(path);
+
+	canonical = canon_resolve(cc, "", path, &nlinks, NULL);
+	if (!canonical)
+		return strdup(path);
+
+	return canonicalize_dm_path(canonical);
 }
 
 char *canonicalize_path_restricted(const char *path)
 {
-	char *canonical, *p = NULL;
+	char *canonical;
 	int errsv;
 	uid_t euid;
 	gid_t egid;
@@ -91,16 +412,9 @@ char *canonicalize_path_restricted(const char *path)
 	errsv = errno = 0;
 
 	canonical = realpath(path, NULL);
-	if (canonical) {
-		p = strrchr(canonical, '/');
-		if (p && strncmp(p, "/dm-", 4) == 0 && isdigit(*(p + 4))) {
-			char *dm = canonicalize_dm_name(p + 1);
-			if (dm) {
-				free(canonical);
-				canonical = dm;
-			}
-		}
-	} else
+	if (canonical)
+		canonical = canonicalize_dm_path(canonical);
+	else
 		errsv = errno;
 
 	/* restore */
@@ -119,9 +433,30 @@ int main(int argc, char **argv)
 {
 	if (argc < 2) {
 		fprintf(stderr, "usage: %s <device>\n", argv[0]);
+		fprintf(stderr, "       %s --cached <path> ...\n", argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
+	if (strcmp(argv[1], "--cached") == 0) {
+		struct canonicalize_cache *cc = new_canonicalize_cache();
+		int i, rc = EXIT_SUCCESS;
+
+		for (i = 2; i < argc; i++) {
+			char *real = canonicalize_path(argv[i]),
+			     *cached = canonicalize_path_cached(cc, argv[i]);
+
+			fprintf(stdout, "%s: %s\n", argv[i], cached);
+			if (!real || !cached || strcmp(real, cached) != 0) {
+				fprintf(stdout, "   realpath: %s\n", real);
+				rc = EXIT_FAILURE;
+			}
+			free(real);
+			free(cached);
+		}
+		free_canonicalize_cache(cc);
+		exit(rc);
+	}
+
 	fprintf(stdout, "orig: %s\n", argv[1]);
 	fprintf(stdout, "real: %s\n", canonicalize_path(argv[1]));
 
@@ -7,6 +7,10 @@
  *
  * Based on code from taskset.c and Linux kernel.
  *
+ * The sets are accessed by words (unsigned long, the same as __cpu_mask in
+ * glibc) where possible, the bit-by-bit CPU_*_S() macros are too slow for
+ * sets with thousands of CPUs.
+ *
  * This file may be redistributed under the terms of the
  * GNU Lesser General Public License.
  *
@@ -48,6 +52,71 @@ static inline int char_to_val(int c)
 		return -1;
 }
 
+#define CPUSET_WORD_BITS	(8 * sizeof(unsigned long))
+
+static inline unsigned long *cpuset_words(cpu_set_t *set)
+{
+	return (unsigned long *) set;
+}
+
+/*
+ * Returns the first set (or cleared if @zero is true) bit starting from @cpu,
+ * or the number of bits in the set.
+ */
+static size_t cpuset_find(const cpu_set_t *set, size_t setsize, size_t cpu, int zero)
+{
+	const unsigned long *w = (const unsigned long *) set;
+	size_t nwords = setsize / sizeof(unsigned long);
+	size_t i = cpu / CPUSET_WORD_BITS;
+	unsigned long x;
+
+	if (i >= nwords)
+		return cpuset_nbits(setsize);
+
+	x = zero ? ~w[i] : w[i];
+	x &= ~0UL << (cpu % CPUSET_WORD_BITS);	/* ignore bits before @cpu */
+
+	while (!x) {
+		if (++i >= nwords)
+			return cpuset_nbits(setsize);
+		x = zero ? ~w[i] : w[i];
+	}
+	return i * CPUSET_WORD_BITS + __builtin_ctzl(x);
+}
+
+/*
+ * Returns the next set CPU starting from @cpu, or -1. See also
+ * cpuset_foreach() in cpuset.h.
+ */
+ssize_t cpuset_next_set(const cpu_set_t *set, size_t setsize, size_t cpu)
+{
+	size_t n = cpuset_find(set, setsize, cpu, 0);
+
+	return n < cpuset_nbits(setsize) ? (ssize_t) n : -1;
+}
+
+/* sets CPUs @a..@b (inclusive), the CPUs out of the set are ignored */
+static void cpuset_set_range(cpu_set_t *set, size_t setsize, size_t a, size_t b)
+{
+	unsigned long *w = cpuset_words(set);
+	size_t max = cpuset_nbits(setsize);
+
+	if (a >= max)
+		return;
+	if (b >= max)
+		b = max - 1;
+
+	while (a <= b) {
+		size_t bit = a % CPUSET_WORD_BITS;
+		size_t n = min(CPUSET_WORD_BITS - bit, b - a + 1);
+		unsigned long mask = n == CPUSET_WORD_BITS ?
+					~0UL : ((1UL << n) - 1) << bit;
+
+		w[a / CPUSET_WORD_BITS] |= mask;
+		a += n;
+	}
+}
+
 static const char *nexttoken(const char *q,  int sep)
 {
 	if (q)
@@ -157,34 +226,32 @@ char *cpulist_create(char *str, size_t len,
 	int entry_made = 0;
 	size_t max = cpuset_nbits(setsize);
 
-	for (i = 0; i < max; i++) {
-		if (CPU_ISSET_S(i, setsize, set)) {
-			int rlen;
-			size_t j, run = 0;
-			entry_made = 1;
-			for (j = i + 1; j < max; j++) {
-				if (CPU_ISSET_S(j, setsize, set))
-					run++;
-				else
-					break;
-			}
-			if (!run)
-				rlen = snprintf(ptr, len, "%zd,", i);
-			else if (run == 1) {
-				rlen = snprintf(ptr, len, "%zd,%zd,", i, i + 1);
-				i++;
-			} else {
-				rlen = snprintf(ptr, len, "%zd-%zd,", i, i + run);
-				i += run;
-			}
-			if (rlen < 0 || (size_t) rlen + 1 > len)
-				return NULL;
-			ptr += rlen;
-			if (rlen > 0 && len > (size_t) rlen)
-				len -= rlen;
-			else
-				len = 0;
+	for (i = cpuset_find(set, setsize, 0, 0); i < max;
+	     i = cpuset_find(set, setsize, i + 1, 0)) {
+		int rlen;
+		size_t run;
+
+		entry_made = 1;
+
+		/* the end of the range is the next cleared bit */
+		run = cpuset_find(set, setsize, i + 1, 1) - i - 1;
+
+		if (!run)
+			rlen = snprintf(ptr, len, "%zd,", i);
+		else if (run == 1) {
+			rlen = snprintf(ptr, len, "%zd,%zd,", i, i + 1);
+			i++;
+		} else {
+			rlen = snprintf(ptr, len, "%zd-%zd,", i, i + run);
+			i += run;
 		}
+		if (rlen < 0 || (size_t) rlen + 1 > len)
+			return NULL;
+		ptr += rlen;
+		if (rlen > 0 && len > (size_t) rlen)
+			len -= rlen;
+		else
+			len = 0;
 	}
 	ptr -= entry_made;
 	*ptr = '\0';
@@ -198,24 +265,18 @@ char *cpulist_create(char *str, size_t len,
 char *cpumask_create(char *str, size_t len,
 			cpu_set_t *set, size_t setsize)
 {
+	const unsigned long *w = cpuset_words(set);
 	char *ptr = str;
 	char *ret = NULL;
 	int cpu;
 
 	for (cpu = cpuset_nbits(setsize) - 4; cpu >= 0; cpu -= 4) {
-		char val = 0;
+		char val;
 
 		if (len == (size_t) (ptr - str))
 			break;
 
-		if (CPU_ISSET_S(cpu, setsize, set))
-			val |= 1;
-		if (CPU_ISSET_S(cpu + 1, setsize, set))
-			val |= 2;
-		if (CPU_ISSET_S(cpu + 2, setsize, set))
-			val |= 4;
-		if (CPU_ISSET_S(cpu + 3, setsize, set))
-			val |= 8;
+		val = (w[cpu / CPUSET_WORD_BITS] >> (cpu % CPUSET_WORD_BITS)) & 0xf;
 
 		if (!ret && val)
 			ret = ptr;
@@ -232,7 +293,9 @@ int cpumask_parse(const char *str, cpu_set_t *set, size_t setsize)
 {
 	int len = strlen(str);
 	const char *ptr = str + len - 1;
-	int cpu = 0;
+	unsigned long *w = cpuset_words(set);
+	size_t max = cpuset_nbits(setsize);
+	size_t cpu = 0;
 
 	/* skip 0x, it's all hex anyway */
 	if (len > 1 && !memcmp(str, "0x", 2L))
@@ -250,14 +313,11 @@ int cpumask_parse(const char *str, cpu_set_t *set, size_t setsize)
 		val = char_to_val(*ptr);
 		if (val == (char) -1)
 			return -1;
-		if (val & 1)
-			CPU_SET_S(cpu, setsize, set);
-		if (val & 2)
-			CPU_SET_S(cpu + 1, setsize, set);
-		if (val & 4)
-			CPU_SET_S(cpu + 2, setsize, set);
-		if (val & 8)
-			CPU_SET_S(cpu + 3, setsize, set);
+		/* the sets are always multiple of words, so 4 bits never
+		 * overlap the end of the set */
+		if (val && cpu < max)
+			w[cpu / CPUSET_WORD_BITS] |=
+				(unsigned long) val << (cpu % CPUSET_WORD_BITS);
 		len--;
 		ptr--;
 		cpu += 4;
@@ -311,6 +371,12 @@ int cpulist_parse(const char *str, cpu_set_t *set, size_t setsize, int fail)
 
 		if (!(a <= b))
 			return 1;
+		if (s == 1) {
+			if (fail && b >= max)
+				return 2;
+			cpuset_set_range(set, setsize, a, b);
+			continue;
+		}
 		while (a <= b) {
 			if (fail && (a >= max))
 				return 2;
@@ -42,6 +42,7 @@
 #include "canonicalize.h"
 #include "at.h"
 #include "blkdev.h"
+#include "all-io.h"
 
 #define CONFIG_LOOPDEV_DEBUG
 
@@ -540,6 +541,9 @@ static int loopcxt_next_from_sysfs(struct loopdev_cxt *lc)
 	while ((d = readdir(iter->sysblock))) {
 		char name[256];
 		struct stat st;
+		unsigned int maj, min;
+		FILE *f;
+		int rc;
 
 		DBG(lc, loopdev_debug("iter: check %s", d->d_name));
 
@@ -548,12 +552,30 @@ static int loopcxt_next_from_sysfs(struct loopdev_cxt *lc)
 		    || strncmp(d->d_name, "loop", 4) != 0)
 			continue;
 
-		snprintf(name, sizeof(name), "%s/loop/backing_file", d->d_name);
-		if (fstat_at(fd, _PATH_SYS_BLOCK, name, &st, 0) != 0)
+		rc = snprintf(name, sizeof(name), "%s/loop/backing_file", d->d_name);
+		if (rc < 0 || (size_t) rc >= sizeof(name) ||
+		    fstat_at(fd, _PATH_SYS_BLOCK, name, &st, 0) != 0)
 			continue;
 
-		if (loopiter_set_device(lc, d->d_name) == 0)
-			return 0;
+		/*
+		 * The backing_file exists, so the device is used. Don't call
+		 * loopiter_set_device() to check it again and initialize sysfs
+		 * from /sys/block/loopN/dev rather than by stat() of the
+		 * device node.
+		 */
+		if (loopcxt_set_device(lc, d->d_name) != 0)
+			continue;
+
+		rc = snprintf(name, sizeof(name), "%s/dev", d->d_name);
+		f = rc > 0 && (size_t) rc < sizeof(name) ?
+			fopen_at(fd, _PATH_SYS_BLOCK, name, O_RDONLY, "r") : NULL;
+		if (f) {
+			if (fscanf(f, "%u:%u", &maj, &min) == 2 &&
+			    sysfs_init(&lc->sysfs, makedev(maj, min), NULL) != 0)
+				DBG(lc, loopdev_debug("sysfs: init failed"));
+			fclose(f);
+		}
+		return 0;
 	}
 
 	return 1;
@@ -1162,6 +1184,10 @@ static int loopcxt_check_size(struct loopdev_cxt *lc, int file_fd)
 	return 0;
 }
 
+/* LOOP_CONFIGURE returned EINVAL or ENOTTY, use LOOP_SET_FD and
+ * LOOP_SET_STATUS64 */
+static int loop_configure_unsupported;
+
 /*
  * @cl: context
  *
@@ -1178,11 +1204,14 @@ static int loopcxt_check_size(struct loopdev_cxt *lc, int file_fd)
  * The device is also initialized read-only if the backing file is not
  * possible to open read-write (e.g. read-only FS).
  *
+ * The LOOP_CONFIGURE ioctl is used if supported by kernel, otherwise
+ * LOOP_SET_FD and LOOP_SET_STATUS64.
+ *
  * Returns: <0 on error, 0 on success.
  */
 int loopcxt_setup_device(struct loopdev_cxt *lc)
 {
-	int file_fd, dev_fd, mode = O_RDWR, rc = -1;
+	int file_fd, dev_fd, mode = O_RDWR, rc = -1, has_fd = 0;
 
 	if (!lc || !*lc->device || !lc->filename)
 		return -EINVAL;
@@ -1230,6 +1259,29 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 
 	DBG(lc, loopdev_debug("setup: device open: OK"));
 
+	/*
+	 * Set FD and status by one ioctl
+	 */
+	if (!loop_configure_unsupported) {
+		struct loop_config config = { .fd = file_fd };
+
+		memcpy(&config.info, &lc->info, sizeof(config.info));
+
+		if (ioctl(dev_fd, LOOP_CONFIGURE, &config) == 0) {
+			has_fd = 1;
+			DBG(lc, loopdev_debug("setup: LOOP_CONFIGURE: OK"));
+			goto check_size;
+		}
+		if (errno != EINVAL && errno != ENOTTY) {
+			rc = -errno;
+			DBG(lc, loopdev_debug("LOOP_CONFIGURE failed: %m"));
+			goto err;
+		}
+		/* old kernel, don't try it again */
+		DBG(lc, loopdev_debug("LOOP_CONFIGURE unsupported: %m"));
+		loop_configure_unsupported = 1;
+	}
+
 	/*
 	 * Set FD
 	 */
@@ -1239,6 +1291,7 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 		goto err;
 	}
 
+	has_fd = 1;
 	DBG(lc, loopdev_debug("setup: LOOP_SET_FD: OK"));
 
 	if (ioctl(dev_fd, LOOP_SET_STATUS64, &lc->info)) {
@@ -1248,6 +1301,7 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 
 	DBG(lc, loopdev_debug("setup: LOOP_SET_STATUS64: OK"));
 
+check_size:
 	if ((rc = loopcxt_check_size(lc, file_fd)))
 		goto err;
 
@@ -1262,7 +1316,9 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 err:
 	if (file_fd >= 0)
 		close(file_fd);
-	if (dev_fd >= 0)
+	/* don't detach the device if it has been stolen by another process
+	 * (LOOP_SET_FD returns EBUSY) */
+	if (dev_fd >= 0 && has_fd)
 		ioctl(dev_fd, LOOP_CLR_FD, 0);
 
 	DBG(lc, loopdev_debug("setup failed [rc=%d]", rc));
@@ -1438,6 +1494,230 @@ int loopdev_is_used(const char *device, const char *filename,
 	return rc;
 }
 
+/*
+ * Reads /sys/block/loop<N>/loop/<attr>, the tailing new line is removed.
+ */
+static int idx_read_attr(int dir, const char *name, const char *attr,
+			 char *buf, size_t bufsz)
+{
+	char path[256];
+	ssize_t sz;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/loop/%s", name, attr);
+	fd = open_at(dir, _PATH_SYS_BLOCK, path, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	sz = read_all(fd, buf, bufsz - 1);
+	close(fd);
+	if (sz <= 0)
+		return -EINVAL;
+	if (buf[sz - 1] == '\n')
+		sz--;
+	buf[sz] = '\0';
+	return 0;
+}
+
+static int cmp_idxent(const void *a, const void *b)
+{
+	const struct loopdev_idxent *x = a, *y = b;
+
+	return x->nr < y->nr ? -1 : x->nr > y->nr;
+}
+
+/*
+ * Reads all used loop devices from /sys/block in one pass. The backing files
+ * are identified by stat() on loop/backing_file path rather than by
+ * LOOP_GET_STATUS64 ioctl for each device. The deleted backing files are
+ * compared by name only.
+ *
+ * Returns: 0 on success, <0 on error (for example no /sys or kernel without
+ * loop/ sysfs attributes).
+ */
+int loopdev_index_scan(struct loopdev_index *idx)
+{
+	struct dirent *d;
+	size_t nalloc = 0;
+	DIR *dir;
+	int rc = 0;
+
+	if (!idx)
+		return -EINVAL;
+
+	memset(idx, 0, sizeof(*idx));
+
+	/* loop/ attributes are in /sys since 2.6.37 */
+	if (get_linux_version() < KERNEL_VERSION(2,6,37))
+		return -ENOSYS;
+
+	dir = opendir(_PATH_SYS_BLOCK);
+	if (!dir)
+		return -errno;
+
+	while ((d = readdir(dir))) {
+		struct loopdev_idxent *ent;
+		char buf[PATH_MAX], *end;
+		struct stat st;
+		size_t len;
+		long nr;
+
+		if (strncmp(d->d_name, "loop", 4) != 0)
+			continue;
+		errno = 0;
+		nr = strtol(d->d_name + 4, &end, 10);
+		if (errno || end == d->d_name + 4 || *end || nr < 0)
+			continue;
+
+		/* unused device does not have backing_file attribute */
+		if (idx_read_attr(dirfd(dir), d->d_name, "backing_file",
+				  buf, sizeof(buf)) != 0)
+			continue;
+
+		if (idx->nents == nalloc) {
+			size_t n = nalloc ? nalloc * 2 : 64;
+			struct loopdev_idxent *tmp = realloc(idx->ents,
+							n * sizeof(*tmp));
+			if (!tmp) {
+				rc = -ENOMEM;
+				break;
+			}
+			idx->ents = tmp;
+			nalloc = n;
+		}
+		ent = &idx->ents[idx->nents];
+		memset(ent, 0, sizeof(*ent));
+		ent->nr = nr;
+		ent->filename = strdup(buf);
+		if (!ent->filename) {
+			rc = -ENOMEM;
+			break;
+		}
+		idx->nents++;
+
+		len = strlen(buf);
+		if ((len < 10 || strcmp(buf + len - 10, " (deleted)") != 0) &&
+		    stat(buf, &st) == 0) {
+			ent->devno = st.st_dev;
+			ent->ino = st.st_ino;
+			ent->has_ino = 1;
+		}
+
+		if (idx_read_attr(dirfd(dir), d->d_name, "offset",
+				  buf, sizeof(buf)) == 0)
+			ent->offset = strtoull(buf, NULL, 10);
+	}
+	closedir(dir);
+
+	if (rc) {
+		loopdev_index_deinit(idx);
+		return rc;
+	}
+	if (idx->nents > 1)
+		qsort(idx->ents, idx->nents, sizeof(*idx->ents), cmp_idxent);
+	return 0;
+}
+
+void loopdev_index_deinit(struct loopdev_index *idx)
+{
+	size_t i;
+
+	if (!idx)
+		return;
+	for (i = 0; i < idx->nents; i++)
+		free(idx->ents[i].filename);
+	free(idx->ents);
+	idx->ents = NULL;
+	idx->nents = 0;
+}
+
+/* /dev/loop<N> or /dev/loop/<N> to <N> */
+static int loopdev_name_to_nr(const char *device)
+{
+	const char *p = strrchr(device, '/');
+	int nr, len = 0;
+
+	if (!p)
+		return -1;
+	if ((sscanf(p, "/loop%d%n", &nr, &len) == 1 ||
+	     sscanf(p, "/%d%n", &nr, &len) == 1) && !p[len] && nr >= 0)
+		return nr;
+	return -1;
+}
+
+/*
+ * Returns: the device entry or NULL if the device is not used (or not a
+ * loop device at all).
+ */
+struct loopdev_idxent *loopdev_index_get_device(struct loopdev_index *idx,
+						const char *device)
+{
+	struct loopdev_idxent key = { .nr = -1 };
+
+	if (!idx || !device || !idx->nents)
+		return NULL;
+
+	key.nr = loopdev_name_to_nr(device);
+	if (key.nr < 0)
+		return NULL;
+
+	return bsearch(&key, idx->ents, idx->nents, sizeof(key), cmp_idxent);
+}
+
+/* the same as loopcxt_is_used() */
+static int idxent_is_used(struct loopdev_idxent *ent, struct stat *st,
+			  const char *filename, uint64_t offset, int flags)
+{
+	if (st && ent->has_ino) {
+		if (ent->ino == st->st_ino && ent->devno == st->st_dev)
+			goto found;
+		return 0;
+	}
+	if (filename && strcmp(ent->filename, filename) == 0)
+		goto found;
+	return 0;
+found:
+	if (flags & LOOPDEV_FL_OFFSET)
+		return ent->offset == offset;
+	return 1;
+}
+
+static char *idxent_strdup_device(struct loopdev_idxent *ent)
+{
+	char name[64];
+	struct stat st;
+
+	if (stat(_PATH_DEV_LOOP, &st) == 0 && S_ISDIR(st.st_mode))
+		snprintf(name, sizeof(name), _PATH_DEV_LOOP "/%d", ent->nr);
+	else
+		snprintf(name, sizeof(name), _PATH_DEV "loop%d", ent->nr);
+	return strdup(name);
+}
+
+/*
+ * The same as loopdev_is_used(), but the devices are not probed. Falls back
+ * to loopdev_is_used() if @device does not look like a loop device name.
+ *
+ * Returns: TRUE/FALSE
+ */
+int loopdev_index_is_used(struct loopdev_index *idx, const char *device,
+			  const char *filename, uint64_t offset, int flags)
+{
+	struct loopdev_idxent *ent;
+	struct stat st;
+
+	if (!idx || !device || !filename)
+		return 0;
+	if (loopdev_name_to_nr(device) < 0)
+		return loopdev_is_used(device, filename, offset, flags);
+
+	ent = loopdev_index_get_device(idx, device);
+	if (!ent)
+		return 0;
+
+	return idxent_is_used(ent, stat(filename, &st) == 0 ? &st : NULL,
+			      filename, offset, flags);
+}
+
 int loopdev_delete(const char *device)
 {
 	struct loopdev_cxt lc;
@@ -1489,12 +1769,29 @@ int loopcxt_find_by_backing_file(struct loopdev_cxt *lc, const char *filename,
  */
 char *loopdev_find_by_backing_file(const char *filename, uint64_t offset, int flags)
 {
+	struct loopdev_index idx = { .nents = 0 };
 	struct loopdev_cxt lc;
 	char *res = NULL;
 
 	if (!filename)
 		return NULL;
 
+	if (loopdev_index_scan(&idx) == 0) {
+		struct stat st;
+		int hasst = !stat(filename, &st);
+		size_t i;
+
+		for (i = 0; i < idx.nents; i++) {
+			if (idxent_is_used(&idx.ents[i], hasst ? &st : NULL,
+					   filename, offset, flags)) {
+				res = idxent_strdup_device(&idx.ents[i]);
+				break;
+			}
+		}
+		loopdev_index_deinit(&idx);
+		return res;
+	}
+
 	if (loopcxt_init(&lc, 0))
 		return NULL;
 	if (loopcxt_find_by_backing_file(&lc, filename, offset, flags) == 0)
@@ -1511,12 +1808,27 @@ char *loopdev_find_by_backing_file(const char *filename, uint64_t offset, int fl
  */
 int loopdev_count_by_backing_file(const char *filename, char **loopdev)
 {
+	struct loopdev_index idx = { .nents = 0 };
 	struct loopdev_cxt lc;
 	int count = 0, rc;
 
 	if (!filename)
 		return -1;
 
+	if (loopdev_index_scan(&idx) == 0) {
+		size_t i;
+
+		for (i = 0; i < idx.nents; i++) {
+			if (strcmp(idx.ents[i].filename, filename) != 0)
+				continue;
+			if (loopdev && count == 0)
+				*loopdev = idxent_strdup_device(&idx.ents[i]);
+			count++;
+		}
+		loopdev_index_deinit(&idx);
+		goto done;
+	}
+
 	rc = loopcxt_init(&lc, 0);
 	if (rc)
 		return rc;
@@ -1538,7 +1850,7 @@ int loopdev_count_by_backing_file(const char *filename, char **loopdev)
 	}
 
 	loopcxt_deinit(&lc);
-
+done:
 	if (loopdev && count > 1) {
 		free(*loopdev);
 		*loopdev = NULL;
@@ -1611,7 +1923,7 @@ static void test_loop_scan(int flags, int debug)
 static int test_loop_setup(const char *filename, const char *device, int debug)
 {
 	struct loopdev_cxt lc;
-	int rc;
+	int rc, ntries = 0;
 
 	rc = loopcxt_init(&lc, 0);
 	if (rc)
@@ -1639,7 +1951,7 @@ static int test_loop_setup(const char *filename, const char *device, int debug)
 		if (rc == 0)
 			break;		/* success */
 
-		if (device || rc != -EBUSY)
+		if (device || rc != -EBUSY || ++ntries >= LOOPDEV_SETUP_MAXTRIES)
 			err(EXIT_FAILURE, "failed to setup device for %s",
 					lc.filename);
 
@@ -90,6 +90,16 @@ void MD5Update(struct MD5Context *ctx, unsigned char const *buf, unsigned len)
     }
     /* Process data in 64-byte chunks */
 
+#if !defined(WORDS_BIGENDIAN)
+    /* Aligned data are transformed in place, without the copy */
+    if (((uintptr_t) buf & (sizeof(uint32_t) - 1)) == 0) {
+	while (len >= 64) {
+	    MD5Transform(ctx->buf, (uint32_t const *) buf);
+	    buf += 64;
+	    len -= 64;
+	}
+    }
+#endif
     while (len >= 64) {
 	memcpy(ctx->in, buf, 64);
 	byteReverse(ctx->in, 16);
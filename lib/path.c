@@ -5,6 +5,13 @@
  *
  * Taken from lscpu.c
  *
+ * The path_*at() functions read attributes relative to the directory in
+ * struct path_cxt (for example /sys/devices/system/cpu/cpuN), so the kernel
+ * does not need to resolve the whole path again for the next attribute in
+ * the same directory. These functions
+ * don't allocate memory (except cpusets), don't exit on errors and return
+ * negative errno instead. The prefix is applied to path_init_cxt() only.
+ *
  * Copyright (C) 2008 Cai Qian <qcai@redhat.com>
  * Copyright (C) 2008-2012 Karel Zak <kzak@redhat.com>
  *
@@ -29,11 +36,17 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "all-io.h"
 #include "path.h"
 #include "nls.h"
 #include "c.h"
+#include "xalloc.h"
+
+#ifndef O_PATH
+# define O_PATH	(O_RDONLY | O_DIRECTORY)
+#endif
 
 static size_t prefixlen;
 static char pathbuf[PATH_MAX];
@@ -49,6 +62,34 @@ path_vcreate(const char *path, va_list ap)
 	return pathbuf;
 }
 
+/* reads the file content to @buf, at most @len - 1 bytes */
+static ssize_t
+path_vread(char *buf, size_t len, const char *path, va_list ap)
+{
+	const char *p = path_vcreate(path, ap);
+	ssize_t sz;
+	int fd;
+
+	fd = open(p, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), p);
+
+	sz = read_all(fd, buf, len - 1);
+	close(fd);
+	if (sz <= 0)
+		err(EXIT_FAILURE, _("cannot read %s"), p);
+	buf[sz] = '\0';
+	return sz;
+}
+
+/* the same as fgets() -- only the first line */
+static void
+path_vread_line(char *buf, size_t len, const char *path, va_list ap)
+{
+	path_vread(buf, len, path, ap);
+	buf[strcspn(buf, "\n")] = '\0';
+}
+
 static FILE *
 path_vfopen(const char *mode, int exit_on_error, const char *path, va_list ap)
 {
@@ -89,61 +130,42 @@ path_fopen(const char *mode, int exit_on_error, const char *path, ...)
 void
 path_read_str(char *result, size_t len, const char *path, ...)
 {
-	FILE *fd;
 	va_list ap;
 
 	va_start(ap, path);
-	fd = path_vfopen("r" UL_CLOEXECSTR, 1, path, ap);
+	path_vread_line(result, len, path, ap);
 	va_end(ap);
-
-	if (!fgets(result, len, fd))
-		err(EXIT_FAILURE, _("cannot read %s"), pathbuf);
-	fclose(fd);
-
-	len = strlen(result);
-	if (result[len - 1] == '\n')
-		result[len - 1] = '\0';
 }
 
 int
 path_read_s32(const char *path, ...)
 {
-	FILE *fd;
 	va_list ap;
+	char buf[64];
 	int result;
 
 	va_start(ap, path);
-	fd = path_vfopen("r" UL_CLOEXECSTR, 1, path, ap);
+	path_vread(buf, sizeof(buf), path, ap);
 	va_end(ap);
 
-	if (fscanf(fd, "%d", &result) != 1) {
-		if (ferror(fd))
-			err(EXIT_FAILURE, _("cannot read %s"), pathbuf);
-		else
-			errx(EXIT_FAILURE, _("parse error: %s"), pathbuf);
-	}
-	fclose(fd);
+	if (sscanf(buf, "%d", &result) != 1)
+		errx(EXIT_FAILURE, _("parse error: %s"), pathbuf);
 	return result;
 }
 
 uint64_t
 path_read_u64(const char *path, ...)
 {
-	FILE *fd;
 	va_list ap;
+	char buf[64];
 	uint64_t result;
 
 	va_start(ap, path);
-	fd = path_vfopen("r", 1, path, ap);
+	path_vread(buf, sizeof(buf), path, ap);
 	va_end(ap);
 
-	if (fscanf(fd, "%"SCNu64, &result) != 1) {
-		if (ferror(fd))
-			err(EXIT_FAILURE, _("cannot read %s"), pathbuf);
-		else
-			errx(EXIT_FAILURE, _("parse error: %s"), pathbuf);
-	}
-	fclose(fd);
+	if (sscanf(buf, "%"SCNu64, &result) != 1)
+		errx(EXIT_FAILURE, _("parse error: %s"), pathbuf);
 	return result;
 }
 
@@ -176,34 +198,46 @@ path_exist(const char *path, ...)
 
 #ifdef HAVE_CPU_SET_T
 
-static cpu_set_t *
-path_cpuparse(int maxcpus, int islist, const char *path, va_list ap)
+/* returns 0, -ENOMEM or -EINVAL */
+static int
+path_parse_cpuset(const char *buf, int maxcpus, int islist, cpu_set_t **res)
 {
-	FILE *fd;
 	cpu_set_t *set;
-	size_t setsize, len = maxcpus * 7;
-	char buf[len];
+	size_t setsize;
+	int rc;
 
-	fd = path_vfopen("r" UL_CLOEXECSTR, 1, path, ap);
+	set = cpuset_alloc(maxcpus, &setsize, NULL);
+	if (!set)
+		return -ENOMEM;
 
-	if (!fgets(buf, len, fd))
-		err(EXIT_FAILURE, _("cannot read %s"), pathbuf);
-	fclose(fd);
+	if (islist)
+		rc = cpulist_parse(buf, set, setsize, 0);
+	else
+		rc = cpumask_parse(buf, set, setsize);
+	if (rc) {
+		cpuset_free(set);
+		return -EINVAL;
+	}
+	*res = set;
+	return 0;
+}
 
-	len = strlen(buf);
-	if (buf[len - 1] == '\n')
-		buf[len - 1] = '\0';
+static cpu_set_t *
+path_cpuparse(int maxcpus, int islist, const char *path, va_list ap)
+{
+	cpu_set_t *set = NULL;
+	size_t len = maxcpus * 7;
+	char buf[len];
 
-	set = cpuset_alloc(maxcpus, &setsize, NULL);
-	if (!set)
-		err(EXIT_FAILURE, _("failed to callocate cpu set"));
+	path_vread_line(buf, len, path, ap);
 
-	if (islist) {
-		if (cpulist_parse(buf, set, setsize, 0))
+	switch (path_parse_cpuset(buf, maxcpus, islist, &set)) {
+	case -ENOMEM:
+		err(EXIT_FAILURE, _("failed to callocate cpu set"));
+	case -EINVAL:
+		if (islist)
 			errx(EXIT_FAILURE, _("failed to parse CPU list %s"), buf);
-	} else {
-		if (cpumask_parse(buf, set, setsize))
-			errx(EXIT_FAILURE, _("failed to parse CPU mask %s"), buf);
+		errx(EXIT_FAILURE, _("failed to parse CPU mask %s"), buf);
 	}
 	return set;
 }
@@ -236,6 +270,176 @@ path_read_cpulist(int maxcpus, const char *path, ...)
 
 #endif /* HAVE_CPU_SET_T */
 
+/*
+ * Opens the directory @dir (printf-like format), the global prefix is
+ * applied. Returns 0 or negative errno.
+ */
+int
+path_init_cxt(struct path_cxt *pc, const char *dir, ...)
+{
+	const char *p;
+	va_list ap;
+
+	va_start(ap, dir);
+	p = path_vcreate(dir, ap);
+	va_end(ap);
+
+	pc->dir_fd = open(p, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (pc->dir_fd < 0)
+		return -errno;
+	pc->dir_path = xstrdup(p);
+	return 0;
+}
+
+void
+path_deinit_cxt(struct path_cxt *pc)
+{
+	if (!pc)
+		return;
+	if (pc->dir_fd >= 0)
+		close(pc->dir_fd);
+	free(pc->dir_path);
+	pc->dir_fd = -1;
+	pc->dir_path = NULL;
+}
+
+/* reads at most @len - 1 bytes, returns number of bytes or negative errno */
+static ssize_t
+path_vreadat(struct path_cxt *pc, char *buf, size_t len,
+	     const char *path, va_list ap)
+{
+	char name[PATH_MAX];
+	ssize_t sz;
+	int fd;
+
+	vsnprintf(name, sizeof(name), path, ap);
+
+	fd = openat(pc->dir_fd, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	sz = read_all(fd, buf, len - 1);
+	if (sz < 0)
+		sz = -errno;
+	close(fd);
+	if (sz == 0)
+		sz = -ENODATA;
+	if (sz < 0)
+		return sz;
+
+	buf[sz] = '\0';
+	return sz;
+}
+
+int
+path_existat(struct path_cxt *pc, const char *path, ...)
+{
+	char name[PATH_MAX];
+	va_list ap;
+
+	va_start(ap, path);
+	vsnprintf(name, sizeof(name), path, ap);
+	va_end(ap);
+
+	return faccessat(pc->dir_fd, name, F_OK, 0) == 0;
+}
+
+/* reads the first line of the file, returns 0 or negative errno */
+int
+path_read_strat(struct path_cxt *pc, char *buf, size_t len, const char *path, ...)
+{
+	va_list ap;
+	ssize_t sz;
+
+	va_start(ap, path);
+	sz = path_vreadat(pc, buf, len, path, ap);
+	va_end(ap);
+
+	if (sz < 0)
+		return sz;
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+int
+path_read_s32at(struct path_cxt *pc, int *res, const char *path, ...)
+{
+	char buf[64];
+	va_list ap;
+	ssize_t sz;
+
+	va_start(ap, path);
+	sz = path_vreadat(pc, buf, sizeof(buf), path, ap);
+	va_end(ap);
+
+	if (sz < 0)
+		return sz;
+	return sscanf(buf, "%d", res) == 1 ? 0 : -EINVAL;
+}
+
+int
+path_read_u64at(struct path_cxt *pc, uint64_t *res, const char *path, ...)
+{
+	char buf[64];
+	va_list ap;
+	ssize_t sz;
+
+	va_start(ap, path);
+	sz = path_vreadat(pc, buf, sizeof(buf), path, ap);
+	va_end(ap);
+
+	if (sz < 0)
+		return sz;
+	return sscanf(buf, "%"SCNu64, res) == 1 ? 0 : -EINVAL;
+}
+
+#ifdef HAVE_CPU_SET_T
+
+static cpu_set_t *
+path_cpuparseat(struct path_cxt *pc, int maxcpus, int islist,
+		const char *path, va_list ap)
+{
+	cpu_set_t *set = NULL;
+	size_t len = maxcpus * 7;
+	char buf[len];
+
+	if (path_vreadat(pc, buf, len, path, ap) < 0)
+		return NULL;
+	buf[strcspn(buf, "\n")] = '\0';
+
+	if (path_parse_cpuset(buf, maxcpus, islist, &set) != 0)
+		return NULL;
+	return set;
+}
+
+cpu_set_t *
+path_read_cpusetat(struct path_cxt *pc, int maxcpus, const char *path, ...)
+{
+	va_list ap;
+	cpu_set_t *set;
+
+	va_start(ap, path);
+	set = path_cpuparseat(pc, maxcpus, 0, path, ap);
+	va_end(ap);
+
+	return set;
+}
+
+cpu_set_t *
+path_read_cpulistat(struct path_cxt *pc, int maxcpus, const char *path, ...)
+{
+	va_list ap;
+	cpu_set_t *set;
+
+	va_start(ap, path);
+	set = path_cpuparseat(pc, maxcpus, 1, path, ap);
+	va_end(ap);
+
+	return set;
+}
+
+#endif /* HAVE_CPU_SET_T */
+
 void
 path_set_prefix(const char *prefix)
 {
@@ -21,6 +21,10 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/stat.h>
 
 #include "procutils.h"
 #include "at.h"
@@ -193,6 +197,219 @@ int proc_next_pid(struct proc_processes *ps, pid_t *pid)
 	return 0;
 }
 
+static const char *proc_ns_names[] = {
+	[PROC_NS_MNT]  = "mnt",
+	[PROC_NS_PID]  = "pid",
+	[PROC_NS_NET]  = "net",
+	[PROC_NS_IPC]  = "ipc",
+	[PROC_NS_UTS]  = "uts",
+	[PROC_NS_USER] = "user"
+};
+
+/*
+ * Parses /proc/<pid>/stat, the command name may contain spaces and ')'.
+ */
+static int read_proc_stat(int dir, const char *name, struct proc_entry *e)
+{
+	char buf[BUFSIZ], path[PATH_MAX], *b, *c;
+	struct stat st;
+	ssize_t sz;
+	size_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/stat", name);
+	fd = open_at(dir, "/proc", path, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -errno;
+	}
+	sz = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (sz <= 0)
+		return -EINVAL;
+	buf[sz] = '\0';
+
+	b = strchr(buf, '(');
+	c = strrchr(buf, ')');
+	if (!b || !c || c < b)
+		return -EINVAL;
+
+	len = min((size_t) (c - b - 1), sizeof(e->comm) - 1);
+	memcpy(e->comm, b + 1, len);
+	e->comm[len] = '\0';
+
+	if (sscanf(c + 1, " %*c %d", &e->ppid) != 1)
+		return -EINVAL;
+
+	e->uid = st.st_uid;
+	return 0;
+}
+
+static void read_proc_ns(int dir, const char *name, struct proc_entry *e)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	size_t i;
+
+	for (i = 0; i < PROC_NS_COUNT; i++) {
+		snprintf(path, sizeof(path), "%s/ns/%s", name, proc_ns_names[i]);
+		if (fstat_at(dir, "/proc", path, &st, 0) == 0)
+			e->ns[i] = st.st_ino;
+	}
+}
+
+static int cmp_entry_pid(const void *a, const void *b)
+{
+	const struct proc_entry *x = a, *y = b;
+
+	return x->pid < y->pid ? -1 : x->pid > y->pid;
+}
+
+static int cmp_entry_name(const void *a, const void *b)
+{
+	const struct proc_entry *x = *(struct proc_entry * const *) a,
+				*y = *(struct proc_entry * const *) b;
+	int rc = strcmp(x->comm, y->comm);
+
+	if (rc)
+		return rc;
+	return x->pid < y->pid ? -1 : x->pid > y->pid;
+}
+
+/*
+ * @snap: snapshot to initialize
+ * @flags: PROC_SNAP_* flags
+ *
+ * Reads all processes from /proc (one /proc/<pid>/stat for each process, and
+ * /proc/<pid>/ns/ if PROC_SNAP_NS is specified). The processes which exit
+ * during the scan are silently ignored.
+ *
+ * Returns: 0 on success, negative number on error.
+ */
+int proc_snapshot_read(struct proc_snapshot *snap, int flags)
+{
+	struct dirent *d;
+	size_t nalloc = 0, i;
+	DIR *dir;
+	int rc = 0;
+
+	if (!snap)
+		return -EINVAL;
+
+	memset(snap, 0, sizeof(*snap));
+
+	dir = opendir("/proc");
+	if (!dir)
+		return -errno;
+
+	while ((d = readdir(dir))) {
+		struct proc_entry *e;
+		char *end;
+		long num;
+
+		if (!isdigit((unsigned char) *d->d_name))
+			continue;
+		errno = 0;
+		num = strtol(d->d_name, &end, 10);
+		if (errno || *end || num <= 0)
+			continue;
+
+		if (snap->nents == nalloc) {
+			size_t n = nalloc ? nalloc * 2 : 256;
+			struct proc_entry *tmp = realloc(snap->ents,
+							n * sizeof(*tmp));
+			if (!tmp) {
+				rc = -ENOMEM;
+				break;
+			}
+			snap->ents = tmp;
+			nalloc = n;
+		}
+		e = &snap->ents[snap->nents];
+		memset(e, 0, sizeof(*e));
+		e->pid = num;
+
+		if (read_proc_stat(dirfd(dir), d->d_name, e) != 0)
+			continue;		/* probably already dead */
+		if (flags & PROC_SNAP_NS)
+			read_proc_ns(dirfd(dir), d->d_name, e);
+		snap->nents++;
+	}
+	closedir(dir);
+
+	if (!rc && snap->nents) {
+		snap->byname = malloc(snap->nents * sizeof(struct proc_entry *));
+		if (!snap->byname)
+			rc = -ENOMEM;
+	}
+	if (rc) {
+		proc_snapshot_deinit(snap);
+		return rc;
+	}
+
+	qsort(snap->ents, snap->nents, sizeof(*snap->ents), cmp_entry_pid);
+	for (i = 0; i < snap->nents; i++)
+		snap->byname[i] = &snap->ents[i];
+	qsort(snap->byname, snap->nents, sizeof(*snap->byname), cmp_entry_name);
+	return 0;
+}
+
+void proc_snapshot_deinit(struct proc_snapshot *snap)
+{
+	if (!snap)
+		return;
+	free(snap->ents);
+	free(snap->byname);
+	memset(snap, 0, sizeof(*snap));
+}
+
+struct proc_entry *proc_snapshot_get_pid(struct proc_snapshot *snap, pid_t pid)
+{
+	struct proc_entry key = { .pid = pid };
+
+	if (!snap || !snap->nents)
+		return NULL;
+	return bsearch(&key, snap->ents, snap->nents, sizeof(key), cmp_entry_pid);
+}
+
+/*
+ * @snap: snapshot
+ * @name: command name
+ * @n: returns number of the processes
+ *
+ * Returns: array of the processes with the command @name (sorted by PID), or
+ * NULL if there is no such process.
+ */
+struct proc_entry **proc_snapshot_get_name(struct proc_snapshot *snap,
+					   const char *name, size_t *n)
+{
+	size_t lo = 0, hi, first;
+
+	*n = 0;
+	if (!snap || !name || !snap->nents)
+		return NULL;
+
+	/* the first entry with the name */
+	hi = snap->nents;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (strcmp(snap->byname[mid]->comm, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	first = lo;
+
+	while (lo < snap->nents && strcmp(snap->byname[lo]->comm, name) == 0)
+		lo++;
+
+	*n = lo - first;
+	return *n ? &snap->byname[first] : NULL;
+}
+
 #ifdef TEST_PROGRAM
 
 static int test_tasks(int argc, char *argv[])
@@ -241,11 +458,37 @@ static int test_processes(int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
+static int test_snapshot(int argc, char *argv[])
+{
+	struct proc_snapshot snap;
+	struct proc_entry **ents = NULL;
+	size_t i, n;
+
+	if (proc_snapshot_read(&snap, PROC_SNAP_NS) != 0)
+		err(EXIT_FAILURE, "read processes failed");
+
+	if (argc >= 3 && strcmp(argv[1], "--name") == 0)
+		ents = proc_snapshot_get_name(&snap, argv[2], &n);
+	else
+		n = 0;
+
+	printf("processes: %zu\n", snap.nents);
+	for (i = 0; i < n; i++)
+		printf(" %d [ppid=%d, uid=%u, mntns=%ju]", ents[i]->pid,
+				ents[i]->ppid, (unsigned) ents[i]->uid,
+				(uintmax_t) ents[i]->ns[PROC_NS_MNT]);
+	printf("\n");
+
+	proc_snapshot_deinit(&snap);
+	return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc < 2) {
 		fprintf(stderr, "usage: %1$s --tasks <pid>\n"
-				"       %1$s --processes [---name <name>] [--uid <uid>]\n",
+				"       %1$s --processes [---name <name>] [--uid <uid>]\n"
+				"       %1$s --snapshot [--name <name>]\n",
 				program_invocation_short_name);
 		return EXIT_FAILURE;
 	}
@@ -254,6 +497,8 @@ int main(int argc, char *argv[])
 		return test_tasks(argc - 1, argv + 1);
 	if (strcmp(argv[1], "--processes") == 0)
 		return test_processes(argc - 1, argv + 1);
+	if (strcmp(argv[1], "--snapshot") == 0)
+		return test_snapshot(argc - 1, argv + 1);
 
 	return EXIT_FAILURE;
 }
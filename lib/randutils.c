@@ -11,6 +11,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/time.h>
 
 #include <sys/syscall.h>
@@ -23,6 +24,16 @@
 #define THREAD_LOCAL static
 #endif
 
+#if defined(__linux__) && defined(SYS_getrandom)
+# define USE_GETRANDOM
+# ifndef GRND_NONBLOCK
+#  define GRND_NONBLOCK	0x0001
+# endif
+#endif
+
+/* the source used by the last random_get_bytes() call */
+static const char *random_source;
+
 #if defined(__linux__) && defined(__NR_gettid) && defined(HAVE_JRAND48)
 #define DO_JRAND_MIX
 THREAD_LOCAL unsigned short ul_jrand_seed[3];
@@ -34,9 +45,12 @@ int random_get_fd(void)
 	struct timeval	tv;
 
 	gettimeofday(&tv, 0);
-	fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
-	if (fd == -1)
-		fd = open("/dev/random", O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	random_source = "/dev/urandom";
+	fd = open(random_source, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		random_source = "/dev/random";
+		fd = open(random_source, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	}
 	if (fd >= 0) {
 		i = fcntl(fd, F_GETFD);
 		if (i >= 0)
@@ -57,18 +71,50 @@ int random_get_fd(void)
 }
 
 
+/*
+ * Reads random bytes from the kernel by getrandom(2). It does not block if the
+ * kernel entropy pool is not initialized yet (early boot), the caller falls
+ * back to /dev/urandom in this case.
+ *
+ * Returns number of bytes not filled in.
+ */
+static size_t getrandom_bytes(unsigned char *cp, size_t n)
+{
+#ifdef USE_GETRANDOM
+	while (n > 0) {
+		ssize_t x = syscall(SYS_getrandom, cp, n, GRND_NONBLOCK);
+
+		if (x < 0) {
+			if (errno == EINTR)
+				continue;
+			break;		/* ENOSYS, EAGAIN */
+		}
+		n -= x;
+		cp += x;
+	}
+#endif
+	return n;
+}
+
 /*
  * Generate a stream of random nbytes into buf.
- * Use /dev/urandom if possible, and if not,
+ * Use getrandom() or /dev/urandom if possible, and if not,
  * use glibc pseudo-random functions.
  */
 void random_get_bytes(void *buf, size_t nbytes)
 {
-	size_t i, n = nbytes;
-	int fd = random_get_fd();
+	size_t i, n;
+	int fd;
 	int lose_counter = 0;
 	unsigned char *cp = (unsigned char *) buf;
 
+	random_source = "getrandom() function";
+	n = getrandom_bytes(cp, nbytes);
+	if (n == 0)
+		return;
+	cp += nbytes - n;
+
+	fd = random_get_fd();
 	if (fd >= 0) {
 		while (n > 0) {
 			ssize_t x = read(fd, cp, n);
@@ -84,10 +130,13 @@ void random_get_bytes(void *buf, size_t nbytes)
 
 		close(fd);
 	}
+	if (n == 0)
+		return;
 
+	random_source = "libc pseudo-random functions";
 	/*
-	 * We do this all the time, but this is the only source of
-	 * randomness if /dev/random/urandom is out to lunch.
+	 * This is the only source of randomness if the kernel random
+	 * sources are out to lunch.
 	 */
 	for (cp = buf, i = 0; i < nbytes; i++)
 		*cp++ ^= (rand() >> 7) & 0xFF;
@@ -108,6 +157,15 @@ void random_get_bytes(void *buf, size_t nbytes)
 	return;
 }
 
+/*
+ * Returns the name of the source of the random bytes from the last
+ * random_get_bytes() call.
+ */
+const char *random_tell_source(void)
+{
+	return random_source ? random_source : "none";
+}
+
 #ifdef TEST_PROGRAM
 int main(int argc __attribute__ ((__unused__)),
          char *argv[] __attribute__ ((__unused__)))
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <ctype.h>
 #include <errno.h>
 #include <sys/stat.h>
@@ -27,6 +28,127 @@ static int do_scale_by_power (uintmax_t *x, int base, int power)
 	return 0;
 }
 
+/* isspace() in the C locale */
+static inline int is_blank_c(int c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline int digit_value(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c |= 0x20;
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 10;
+	return 36;
+}
+
+/*
+ * Locale independent and NUL-terminator independent part of strtoumax(). The
+ * @base is 0, 8, 10 or 16 with the usual "0x" and "0" prefixes. The digits
+ * are parsed from @p up to @end. Returns pointer to the first unparsed
+ * character, or NULL if there is no digit at all. The @overflow is set if
+ * the number does not fit into uint64_t, @res is UINT64_MAX in this case.
+ */
+static const char *parse_digits(const char *p, const char *end, int base,
+				uint64_t *res, int *overflow)
+{
+	uint64_t x = 0;
+	const char *start;
+
+	*overflow = 0;
+
+	if ((base == 0 || base == 16) && end - p > 2 && p[0] == '0' &&
+	    (p[1] | 0x20) == 'x' && digit_value(p[2]) < 16) {
+		base = 16;
+		p += 2;
+	} else if (base == 0)
+		base = (p < end && *p == '0') ? 8 : 10;
+
+	for (start = p; p < end; p++) {
+		int d = digit_value(*p);
+
+		if (d >= base)
+			break;
+		if (x > (UINT64_MAX - d) / base)
+			*overflow = 1;
+		else
+			x = x * base + d;
+	}
+	if (p == start)
+		return NULL;
+
+	*res = *overflow ? UINT64_MAX : x;
+	return p;
+}
+
+/*
+ * ul_strtou64() and ul_strtos64() - convert the first @len bytes of @str to
+ * number. The string does not have to be terminated by NUL, but all the @len
+ * bytes have to be used (leading white spaces are ignored). The functions are
+ * locale independent.
+ *
+ * Returns 0 on success, -EINVAL for invalid string and -ERANGE if the number
+ * is out of range.
+ */
+int ul_strtou64(const char *str, size_t len, uint64_t *num, int base)
+{
+	const char *p = str, *end = str + len;
+	uint64_t x = 0;
+	int neg = 0, over;
+
+	if (!str)
+		return -EINVAL;
+	while (p < end && is_blank_c(*p))
+		p++;
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';		/* the same as strtoumax() */
+
+	p = parse_digits(p, end, base, &x, &over);
+	if (!p || p != end)
+		return -EINVAL;
+	if (over) {
+		*num = UINT64_MAX;
+		return -ERANGE;
+	}
+	*num = neg ? -x : x;
+	return 0;
+}
+
+int ul_strtos64(const char *str, size_t len, int64_t *num, int base)
+{
+	const char *p = str, *end = str + len;
+	uint64_t x = 0;
+	int neg = 0, over;
+
+	if (!str)
+		return -EINVAL;
+	while (p < end && is_blank_c(*p))
+		p++;
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+
+	p = parse_digits(p, end, base, &x, &over);
+	if (!p || p != end)
+		return -EINVAL;
+
+	if (neg) {
+		if (over || x > (uint64_t) INT64_MAX + 1) {
+			*num = INT64_MIN;
+			return -ERANGE;
+		}
+		*num = x == (uint64_t) INT64_MAX + 1 ? INT64_MIN : -(int64_t) x;
+	} else {
+		if (over || x > INT64_MAX) {
+			*num = INT64_MAX;
+			return -ERANGE;
+		}
+		*num = x;
+	}
+	return 0;
+}
+
 /*
  * strtosize() - convert string to size (uintmax_t).
  *
@@ -49,55 +171,61 @@ static int do_scale_by_power (uintmax_t *x, int base, int power)
  *
  * Note that the function does not accept numbers with '-' (negative sign)
  * prefix.
+ *
+ * The parse_size_len() parses the first @len bytes of @str only, the string
+ * does not have to be terminated by NUL. The functions are locale
+ * independent and errno is ERANGE if the number does not fit into uintmax_t.
  */
-int parse_size(const char *str, uintmax_t *res, int *power)
+int parse_size_len(const char *str, size_t len, uintmax_t *res, int *power)
 {
-	char *p;
+	const char *p, *end;
+	uint64_t num = 0;
 	uintmax_t x;
-	int base = 1024, rc = 0, pwr = 0;
+	int base = 1024, rc = 0, pwr = 0, over;
 
 	static const char *suf  = "KMGTPEYZ";
 	static const char *suf2 = "kmgtpeyz";
 	const char *sp;
 
 	*res = 0;
+	errno = 0;
 
-	if (!str || !*str)
+	if (!str || !len)
 		goto err;
 
-	/* Only positive numbers are acceptable
-	 *
-	 * Note that this check is not perfect, it would be better to
-	 * use lconv->negative_sign. But coreutils use the same solution,
-	 * so it's probably good enough...
-	 */
-	p = (char *) str;
-	while (isspace((unsigned char) *p))
+	p = str;
+	end = str + len;
+	while (p < end && is_blank_c(*p))
 		p++;
-	if (*p == '-')
-		goto err;
-	p = NULL;
 
-	errno = 0;
-	x = strtoumax(str, &p, 0);
+	/* Only positive numbers are acceptable */
+	if (p < end && *p == '+')
+		p++;
 
-	if (p == str ||
-	    (errno != 0 && (x == UINTMAX_MAX || x == 0)))
+	p = parse_digits(p, end, 0, &num, &over);
+	if (!p)
+		goto err;
+	if (over) {
+		errno = ERANGE;
 		goto err;
+	}
+	x = num;
 
-	if (!p || !*p)
+	if (p == end)
 		goto done;			/* without suffix */
 
 	/*
 	 * Check size suffixes
 	 */
-	if (*(p + 1) == 'i' && *(p + 2) == 'B' && !*(p + 3))
+	if (end - p == 3 && p[1] == 'i' && p[2] == 'B')
 		base = 1024;			/* XiB, 2^N */
-	else if (*(p + 1) == 'B' && !*(p + 2))
+	else if (end - p == 2 && p[1] == 'B')
 		base = 1000;			/* XB, 10^N */
-	else if (*(p + 1))
+	else if (end - p != 1)
 		goto err;			/* unexpected suffix */
 
+	if (!*p)
+		goto err;
 	sp = strchr(suf, *p);
 	if (sp)
 		pwr = (sp - suf) + 1;
@@ -119,6 +247,11 @@ err:
 	return -1;
 }
 
+int parse_size(const char *str, uintmax_t *res, int *power)
+{
+	return parse_size_len(str, str ? strlen(str) : 0, res, power);
+}
+
 int strtosize(const char *str, uintmax_t *res)
 {
 	return parse_size(str, res, NULL);
@@ -219,42 +352,30 @@ uint32_t strtou32_or_err(const char *str, const char *errmesg)
 int64_t strtos64_or_err(const char *str, const char *errmesg)
 {
 	int64_t num;
-	char *end = NULL;
-
-	if (str == NULL || *str == '\0')
-		goto err;
-	errno = 0;
-	num = strtoimax(str, &end, 10);
-
-	if (errno || str == end || (end && *end))
-		goto err;
+	int rc;
 
-	return num;
-err:
-	if (errno)
+	rc = ul_strtos64(str, str ? strlen(str) : 0, &num, 10);
+	if (rc == 0)
+		return num;
+	if (rc == -ERANGE) {
+		errno = ERANGE;
 		err(STRTOXX_EXIT_CODE, "%s: '%s'", errmesg, str);
-
+	}
 	errx(STRTOXX_EXIT_CODE, "%s: '%s'", errmesg, str);
 }
 
 uint64_t strtou64_or_err(const char *str, const char *errmesg)
 {
-	uintmax_t num;
-	char *end = NULL;
-
-	if (str == NULL || *str == '\0')
-		goto err;
-	errno = 0;
-	num = strtoumax(str, &end, 10);
+	uint64_t num;
+	int rc;
 
-	if (errno || str == end || (end && *end))
-		goto err;
-
-	return num;
-err:
-	if (errno)
+	rc = ul_strtou64(str, str ? strlen(str) : 0, &num, 10);
+	if (rc == 0)
+		return num;
+	if (rc == -ERANGE) {
+		errno = ERANGE;
 		err(STRTOXX_EXIT_CODE, "%s: '%s'", errmesg, str);
-
+	}
 	errx(STRTOXX_EXIT_CODE, "%s: '%s'", errmesg, str);
 }
 
@@ -282,42 +403,35 @@ err:
 
 long strtol_or_err(const char *str, const char *errmesg)
 {
-	long num;
-	char *end = NULL;
-
-	if (str == NULL || *str == '\0')
-		goto err;
-	errno = 0;
-	num = strtol(str, &end, 10);
-
-	if (errno || str == end || (end && *end))
-		goto err;
+	int64_t num;
+	int rc;
 
-	return num;
-err:
-	if (errno)
+	rc = ul_strtos64(str, str ? strlen(str) : 0, &num, 10);
+	if (rc == 0 && (num < LONG_MIN || num > LONG_MAX))
+		rc = -ERANGE;
+	if (rc == 0)
+		return num;
+	if (rc == -ERANGE) {
+		errno = ERANGE;
 		err(STRTOXX_EXIT_CODE, "%s: '%s'", errmesg, str);
+	}
 	errx(STRTOXX_EXIT_CODE, "%s: '%s'", errmesg, str);
 }
 
 unsigned long strtoul_or_err(const char *str, const char *errmesg)
 {
-	unsigned long num;
-	char *end = NULL;
+	uint64_t num;
+	int rc;
 
-	if (str == NULL || *str == '\0')
-		goto err;
-	errno = 0;
-	num = strtoul(str, &end, 10);
-
-	if (errno || str == end || (end && *end))
-		goto err;
-
-	return num;
-err:
-	if (errno)
+	rc = ul_strtou64(str, str ? strlen(str) : 0, &num, 10);
+	if (rc == 0 && num > ULONG_MAX)
+		rc = -ERANGE;
+	if (rc == 0)
+		return num;
+	if (rc == -ERANGE) {
+		errno = ERANGE;
 		err(STRTOXX_EXIT_CODE, "%s: '%s'", errmesg, str);
-
+	}
 	errx(STRTOXX_EXIT_CODE, "%s: '%s'", errmesg, str);
 }
 
@@ -688,6 +802,78 @@ int streq_except_trailing_slash(const char *s1, const char *s2)
 
 
 #ifdef TEST_PROGRAM
+#include <time.h>
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the previous implementation: NUL terminated copy and libc strtoumax() */
+static int bench_libc(const char *str, size_t len, uintmax_t *res)
+{
+	char *p = strndup(str, len), *end = NULL;
+	int rc = 0;
+
+	if (!p)
+		return -ENOMEM;
+	errno = 0;
+	*res = strtoumax(p, &end, 0);
+	if (errno || end == p)
+		rc = -EINVAL;
+	free(p);
+	return rc;
+}
+
+static int bench_len(const char *str, size_t len, uintmax_t *res)
+{
+	return parse_size_len(str, len, res, NULL);
+}
+
+/*
+ * Parses the "offset=" values from a mount options string by both
+ * implementations and prints nanoseconds per call.
+ */
+static int bench(size_t count)
+{
+	static const char *opts[] = {
+		"offset=1048576,sizelimit=4096",
+		"offset=0x7e00,ro",
+		"offset=2147483648",
+		"offset=512,loop"
+	};
+	struct {
+		const char *name;
+		int (*fn)(const char *, size_t, uintmax_t *);
+	} impls[] = {
+		{ "strndup+strtoumax", bench_libc },
+		{ "parse_size_len",    bench_len }
+	};
+	size_t i, n;
+	uintmax_t sum, res;
+
+	for (i = 0; i < ARRAY_SIZE(impls); i++) {
+		double start = bench_now(), t;
+
+		sum = 0;
+		for (n = 0; n < count; n++) {
+			const char *o = opts[n % ARRAY_SIZE(opts)] + 7;
+			size_t len = strcspn(o, ",");
+
+			if (impls[i].fn(o, len, &res) != 0)
+				errx(EXIT_FAILURE, "%s: failed to parse '%s'",
+						impls[i].name, o);
+			sum += res;
+		}
+		t = bench_now() - start;
+		printf("%-20s %10zu calls %8.2f ns/call [sum=%ju]\n",
+				impls[i].name, count, t * 1e9 / count, sum);
+	}
+	return EXIT_SUCCESS;
+}
 
 int main(int argc, char *argv[])
 {
@@ -695,10 +881,15 @@ int main(int argc, char *argv[])
 	char *hum, *hum2;
 
 	if (argc < 2) {
-		fprintf(stderr, "usage: %s <number>[suffix]\n",	argv[0]);
+		fprintf(stderr, "usage: %s <number>[suffix]\n"
+				"       %s --bench [<count>]\n", argv[0], argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
+	if (strcmp(argv[1], "--bench") == 0)
+		return bench(argc > 2 ? strtou64_or_err(argv[2], "invalid count")
+				      : 10000000);
+
 	if (strtosize(argv[1], &size))
 		errx(EXIT_FAILURE, "invalid size '%s' value", argv[1]);
 
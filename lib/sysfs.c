@@ -99,11 +99,49 @@ dev_t sysfs_devname_to_devno(const char *name, const char *parent)
 	return dev;
 }
 
+/*
+ * Reads DEVNAME= from /sys/dev/block/<maj:min>/uevent, it's the name of the
+ * node in /dev (for example "cciss/c0d0") as created by kernel devtmpfs.
+ */
+static char *sysfs_uevent_devname(dev_t devno, char *buf, size_t bufsiz)
+{
+	char path[PATH_MAX], line[PATH_MAX];
+	char *name = NULL;
+	size_t sz;
+	FILE *f;
+
+	if (!sysfs_devno_path(devno, path, sizeof(path)))
+		return NULL;
+	sz = strlen(path);
+	if (sz + sizeof("/uevent") > sizeof(path))
+		return NULL;
+	memcpy(path + sz, "/uevent", sizeof("/uevent"));
+
+	f = fopen(path, "r" UL_CLOEXECSTR);
+	if (!f)
+		return NULL;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, "DEVNAME=", 8) != 0)
+			continue;
+		sz = strcspn(line + 8, "\n");
+		if (sz && sz + 1 <= bufsiz) {
+			memcpy(buf, line + 8, sz);
+			buf[sz] = '\0';
+			name = buf;
+		}
+		break;
+	}
+	fclose(f);
+	return name;
+}
+
 /*
  * Returns devname (e.g. "/dev/sda1") for the given devno.
  *
- * Note that the @buf has to be large enough to store /sys/dev/block/<maj:min>
- * symlinks.
+ * The name is read from uevent file or it's the kernel name of the device
+ * (the last component of the /sys/dev/block/<maj:min> symlink). Note that
+ * the @buf has to be large enough to store the symlink.
  *
  * Please, use more robust blkid_devno_to_devname() in your applications.
  */
@@ -114,14 +152,21 @@ char *sysfs_devno_to_devpath(dev_t devno, char *buf, size_t bufsiz)
 	size_t sz;
 	struct stat st;
 
-	if (sysfs_init(&cxt, devno, NULL))
-		return NULL;
+	name = sysfs_uevent_devname(devno, buf, bufsiz);
+	if (!name) {
+		if (sysfs_init(&cxt, devno, NULL))
+			return NULL;
 
-	name = sysfs_get_devname(&cxt, buf, bufsiz);
-	sysfs_deinit(&cxt);
+		name = sysfs_get_devname(&cxt, buf, bufsiz);
+		sysfs_deinit(&cxt);
+		if (!name)
+			return NULL;
 
-	if (!name)
-		return NULL;
+		/* kernel uses '!' rather than '/' in the names */
+		for ( ; (name = strchr(name, '!')); name++)
+			*name = '/';
+		name = buf;
+	}
 
 	sz = strlen(name);
 
@@ -166,6 +211,27 @@ err:
 	return rc;
 }
 
+/*
+ * Cached content of the attribute (or NULL if the attribute does not exist)
+ */
+struct sysfs_attr {
+	char			*name;
+	char			*value;
+	struct sysfs_attr	*next;
+};
+
+/*
+ * Enables attributes cache, all the attributes read by sysfs_read_*(),
+ * sysfs_strdup() and sysfs_scanf() are read only once. It's useful for
+ * utils like lsblk where the same attributes are read more times. The
+ * cache is deallocated by sysfs_deinit().
+ */
+void sysfs_enable_cache(struct sysfs_cxt *cxt)
+{
+	if (cxt)
+		cxt->use_cache = 1;
+}
+
 void sysfs_deinit(struct sysfs_cxt *cxt)
 {
 	if (!cxt)
@@ -175,6 +241,15 @@ void sysfs_deinit(struct sysfs_cxt *cxt)
 	       close(cxt->dir_fd);
 	free(cxt->dir_path);
 
+	while (cxt->attrs) {
+		struct sysfs_attr *a = cxt->attrs;
+
+		cxt->attrs = a->next;
+		free(a->name);
+		free(a->value);
+		free(a);
+	}
+
 	memset(cxt, 0, sizeof(*cxt));
 
 	cxt->dir_fd = -1;
@@ -213,7 +288,7 @@ static int sysfs_open(struct sysfs_cxt *cxt, const char *attr)
 		/* Exception for "queue/<attr>". These attributes are available
 		 * for parental devices only
 		 */
-		fd = open_at(cxt->parent->dir_fd, cxt->dir_path, attr,
+		fd = open_at(cxt->parent->dir_fd, cxt->parent->dir_path, attr,
 				O_RDONLY|O_CLOEXEC);
 	}
 	return fd;
@@ -260,12 +335,61 @@ DIR *sysfs_opendir(struct sysfs_cxt *cxt, const char *attr)
 	return dir;
 }
 
+#define SYSFS_ATTR_BUFSZ	1024
 
-static FILE *sysfs_fopen(struct sysfs_cxt *cxt, const char *attr)
+/*
+ * Reads the attribute content to the @buf (SYSFS_ATTR_BUFSZ bytes), the
+ * content is terminated by zero.
+ *
+ * Returns: number of bytes or -1 in case of error.
+ */
+static ssize_t sysfs_read_attr(struct sysfs_cxt *cxt, const char *attr, char *buf)
 {
-	int fd = sysfs_open(cxt, attr);
+	struct sysfs_attr *a = NULL;
+	ssize_t len;
+	int fd;
+
+	if (cxt->use_cache) {
+		for (a = cxt->attrs; a; a = a->next) {
+			if (strcmp(a->name, attr) != 0)
+				continue;
+			if (!a->value) {
+				errno = ENOENT;
+				return -1;
+			}
+			len = strlen(a->value);
+			memcpy(buf, a->value, len + 1);
+			return len;
+		}
+	}
 
-	return fd < 0 ? NULL : fdopen(fd, "r" UL_CLOEXECSTR);
+	fd = sysfs_open(cxt, attr);
+	if (fd < 0)
+		len = -1;
+	else {
+		/* kernel returns whole sysfs attribute by one read() */
+		do {
+			len = read(fd, buf, SYSFS_ATTR_BUFSZ - 1);
+		} while (len < 0 && errno == EINTR);
+		close(fd);
+	}
+	if (len >= 0)
+		buf[len] = '\0';
+
+	if (cxt->use_cache && (len >= 0 || errno == ENOENT)) {
+		a = calloc(1, sizeof(*a));
+		if (a && (a->name = strdup(attr)) &&
+		    (len < 0 || (a->value = strdup(buf)))) {
+			a->next = cxt->attrs;
+			cxt->attrs = a;
+		} else if (a) {
+			free(a->name);
+			free(a);
+		}
+		if (len < 0)
+			errno = ENOENT;
+	}
+	return len;
 }
 
 
@@ -366,62 +490,74 @@ dev_t sysfs_partno_to_devno(struct sysfs_cxt *cxt, int partno)
 
 int sysfs_scanf(struct sysfs_cxt *cxt,  const char *attr, const char *fmt, ...)
 {
-	FILE *f = sysfs_fopen(cxt, attr);
+	char buf[SYSFS_ATTR_BUFSZ];
 	va_list ap;
 	int rc;
 
-	if (!f)
+	if (sysfs_read_attr(cxt, attr, buf) < 0)
 		return -EINVAL;
 	va_start(ap, fmt);
-	rc = vfscanf(f, fmt, ap);
+	rc = vsscanf(buf, fmt, ap);
 	va_end(ap);
 
-	fclose(f);
 	return rc;
 }
 
 
 int sysfs_read_s64(struct sysfs_cxt *cxt, const char *attr, int64_t *res)
 {
-	int64_t x = 0;
+	char buf[SYSFS_ATTR_BUFSZ], *end;
+	int64_t x;
 
-	if (sysfs_scanf(cxt, attr, "%"SCNd64, &x) == 1) {
-		if (res)
-			*res = x;
-		return 0;
-	}
-	return -1;
+	if (sysfs_read_attr(cxt, attr, buf) <= 0)
+		return -1;
+
+	errno = 0;
+	x = strtoll(buf, &end, 10);
+	if (end == buf || errno)
+		return -1;
+	if (res)
+		*res = x;
+	return 0;
 }
 
 int sysfs_read_u64(struct sysfs_cxt *cxt, const char *attr, uint64_t *res)
 {
-	uint64_t x = 0;
+	char buf[SYSFS_ATTR_BUFSZ], *end;
+	uint64_t x;
 
-	if (sysfs_scanf(cxt, attr, "%"SCNu64, &x) == 1) {
-		if (res)
-			*res = x;
-		return 0;
-	}
-	return -1;
+	if (sysfs_read_attr(cxt, attr, buf) <= 0)
+		return -1;
+
+	errno = 0;
+	x = strtoull(buf, &end, 10);
+	if (end == buf || errno)
+		return -1;
+	if (res)
+		*res = x;
+	return 0;
 }
 
 int sysfs_read_int(struct sysfs_cxt *cxt, const char *attr, int *res)
 {
-	int x = 0;
+	int64_t x = 0;
 
-	if (sysfs_scanf(cxt, attr, "%d", &x) == 1) {
-		if (res)
-			*res = x;
-		return 0;
-	}
-	return -1;
+	if (sysfs_read_s64(cxt, attr, &x) != 0 || x < INT_MIN || x > INT_MAX)
+		return -1;
+	if (res)
+		*res = (int) x;
+	return 0;
 }
 
 char *sysfs_strdup(struct sysfs_cxt *cxt, const char *attr)
 {
-	char buf[1024];
-	return sysfs_scanf(cxt, attr, "%1023[^\n]", buf) == 1 ?
-						strdup(buf) : NULL;
+	char buf[SYSFS_ATTR_BUFSZ];
+
+	if (sysfs_read_attr(cxt, attr, buf) <= 0)
+		return NULL;
+
+	buf[strcspn(buf, "\n")] = '\0';
+	return *buf ? strdup(buf) : NULL;
 }
 
 int sysfs_count_dirents(struct sysfs_cxt *cxt, const char *attr)
@@ -776,6 +912,349 @@ int sysfs_scsi_path_contains(struct sysfs_cxt *cxt, const char *pattern)
 	return strstr(linkc, pattern) != NULL;
 }
 
+/*
+ * Block devices topology snapshot
+ *
+ * The snapshot is created by one walk of /sys/block; it contains all whole
+ * disks, their partitions and holders/slaves dependencies. It's cheaper than
+ * to open and read the sysfs directories again and again for each device
+ * (e.g. sysfs_count_partitions() or sysfs_count_dirents()), and it's
+ * important on systems with thousands of devices.
+ *
+ * The snapshot is not updated, devices hot-plugged after sysfs_blktopo_scan()
+ * are invisible.
+ */
+struct blktopo_link {
+	struct sysfs_blkdev	*dev;
+	char			*name;		/* holder or slave name */
+	int			slave;
+};
+
+static ssize_t read_attr_at(int dir, const char *path, char *buf, size_t bufsz)
+{
+	ssize_t len;
+	int fd = openat(dir, path, O_RDONLY|O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+	do {
+		len = read(fd, buf, bufsz - 1);
+	} while (len < 0 && errno == EINTR);
+	close(fd);
+
+	if (len >= 0)
+		buf[len] = '\0';
+	return len;
+}
+
+static int read_u64_at(int dir, const char *path, uint64_t *res)
+{
+	char buf[64], *end;
+	uint64_t x;
+
+	if (read_attr_at(dir, path, buf, sizeof(buf)) <= 0)
+		return -1;
+	errno = 0;
+	x = strtoull(buf, &end, 10);
+	if (errno || end == buf)
+		return -1;
+	*res = x;
+	return 0;
+}
+
+static int blkdevs_append(struct sysfs_blkdev ***ary, size_t *n,
+			  struct sysfs_blkdev *dev)
+{
+	struct sysfs_blkdev **tmp = realloc(*ary, (*n + 1) * sizeof(*tmp));
+
+	if (!tmp)
+		return -ENOMEM;
+	tmp[(*n)++] = dev;
+	*ary = tmp;
+	return 0;
+}
+
+/*
+ * Adds device from @dir (opened /sys/block/<name> or partition directory).
+ *
+ * Returns: 0 on success, 1 if the directory is not a device, <0 on error.
+ */
+static int blktopo_add_dev(struct sysfs_blktopo *topo, int dir,
+			   const char *name, struct sysfs_blkdev **res)
+{
+	struct sysfs_blkdev *dev;
+	unsigned int maj, min;
+	char buf[64];
+	uint64_t x;
+
+	if (read_attr_at(dir, "dev", buf, sizeof(buf)) <= 0 ||
+	    sscanf(buf, "%u:%u", &maj, &min) != 2)
+		return 1;
+
+	if (topo->ndevs % 64 == 0) {
+		struct sysfs_blkdev **tmp = realloc(topo->devs,
+				(topo->ndevs + 64) * sizeof(*tmp));
+		if (!tmp)
+			return -ENOMEM;
+		topo->devs = tmp;
+	}
+
+	dev = calloc(1, sizeof(*dev));
+	if (!dev)
+		return -ENOMEM;
+	dev->name = strdup(name);
+	if (!dev->name) {
+		free(dev);
+		return -ENOMEM;
+	}
+	dev->devno = makedev(maj, min);
+
+	if (read_u64_at(dir, "size", &x) == 0)
+		dev->size = x;
+	if (read_u64_at(dir, "ro", &x) == 0)
+		dev->ro = x ? 1 : 0;
+	if (read_u64_at(dir, "removable", &x) == 0)
+		dev->removable = x ? 1 : 0;
+
+	topo->devs[topo->ndevs++] = dev;
+	*res = dev;
+	return 0;
+}
+
+/*
+ * Reads names from holders/ or slaves/ @subdir, the names are resolved to
+ * the devices when all /sys/block is scanned.
+ */
+static int blktopo_read_links(int dir, const char *subdir,
+			      struct sysfs_blkdev *dev, int slave,
+			      struct blktopo_link **links, size_t *nlinks)
+{
+	struct dirent *d;
+	DIR *ls;
+	int fd, rc = 0;
+
+	fd = openat(dir, subdir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	ls = fdopendir(fd);
+	if (!ls) {
+		close(fd);
+		return 0;
+	}
+
+	while ((d = xreaddir(ls))) {
+		struct blktopo_link *l;
+
+		if (*nlinks % 64 == 0) {
+			l = realloc(*links, (*nlinks + 64) * sizeof(*l));
+			if (!l) {
+				rc = -ENOMEM;
+				break;
+			}
+			*links = l;
+		}
+		l = &(*links)[*nlinks];
+		l->dev = dev;
+		l->slave = slave;
+		l->name = strdup(d->d_name);
+		if (!l->name) {
+			rc = -ENOMEM;
+			break;
+		}
+		(*nlinks)++;
+	}
+
+	closedir(ls);
+	return rc;
+}
+
+static int blktopo_scan_disk(struct sysfs_blktopo *topo, int dir, const char *name,
+			     struct blktopo_link **links, size_t *nlinks)
+{
+	struct sysfs_blkdev *disk = NULL;
+	struct dirent *d;
+	DIR *pdir;
+	uint64_t x;
+	int fd, rc;
+
+	fd = openat(dir, name, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if (fd < 0)
+		return 0;		/* removed in the meantime */
+
+	rc = blktopo_add_dev(topo, fd, name, &disk);
+	if (rc)
+		goto done;
+
+	if (read_u64_at(fd, "queue/rotational", &x) == 0)
+		disk->rotational = x ? 1 : 0;
+	if (read_u64_at(fd, "queue/discard_granularity", &x) == 0)
+		disk->discard_granularity = x > INT_MAX ? INT_MAX : (int) x;
+	if (read_u64_at(fd, "queue/read_ahead_kb", &x) == 0)
+		disk->read_ahead_kb = x > INT_MAX ? INT_MAX : (int) x;
+	if (read_u64_at(fd, "queue/logical_block_size", &x) == 0)
+		disk->logical_block_size = x > INT_MAX ? INT_MAX : (int) x;
+
+	rc = blktopo_read_links(fd, "holders", disk, 0, links, nlinks);
+	if (!rc)
+		rc = blktopo_read_links(fd, "slaves", disk, 1, links, nlinks);
+	if (rc)
+		goto done;
+
+	/* partitions */
+	rc = dup(fd);
+	if (rc < 0 || !(pdir = fdopendir(rc))) {
+		if (rc >= 0)
+			close(rc);
+		rc = 0;
+		goto done;
+	}
+	rc = 0;
+
+	while (rc == 0 && (d = xreaddir(pdir))) {
+		struct sysfs_blkdev *part = NULL;
+		int pfd;
+
+		if (!sysfs_is_partition_dirent(pdir, d, name))
+			continue;
+
+		pfd = openat(fd, d->d_name, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+		if (pfd < 0)
+			continue;
+
+		rc = blktopo_add_dev(topo, pfd, d->d_name, &part);
+		if (rc == 0) {
+			part->wholedisk = disk;
+			part->rotational = disk->rotational;
+			part->discard_granularity = disk->discard_granularity;
+			part->read_ahead_kb = disk->read_ahead_kb;
+			part->logical_block_size = disk->logical_block_size;
+			if (read_u64_at(pfd, "start", &x) == 0)
+				part->start = x;
+
+			rc = blkdevs_append(&disk->parts, &disk->nparts, part);
+			if (!rc)
+				rc = blktopo_read_links(pfd, "holders", part, 0,
+							links, nlinks);
+			if (!rc)
+				rc = blktopo_read_links(pfd, "slaves", part, 1,
+							links, nlinks);
+		} else if (rc == 1)
+			rc = 0;
+		close(pfd);
+	}
+	closedir(pdir);
+done:
+	close(fd);
+	return rc == 1 ? 0 : rc;
+}
+
+static int cmp_blkdev_name(const void *a, const void *b)
+{
+	return strcmp((*(struct sysfs_blkdev * const *) a)->name,
+		      (*(struct sysfs_blkdev * const *) b)->name);
+}
+
+/*
+ * Scans /sys/block and fills @topo, use sysfs_blktopo_deinit() to deallocate.
+ *
+ * Returns: 0 on success, <0 on error.
+ */
+int sysfs_blktopo_scan(struct sysfs_blktopo *topo)
+{
+	struct blktopo_link *links = NULL;
+	size_t nlinks = 0, i;
+	struct dirent *d;
+	DIR *dir;
+	int rc = 0;
+
+	memset(topo, 0, sizeof(*topo));
+
+	dir = opendir(_PATH_SYS_BLOCK);
+	if (!dir)
+		return -errno;
+
+	while (rc == 0 && (d = xreaddir(dir)))
+		rc = blktopo_scan_disk(topo, dirfd(dir), d->d_name, &links, &nlinks);
+	closedir(dir);
+
+	if (!rc && topo->ndevs) {
+		topo->byname = malloc(topo->ndevs * sizeof(*topo->byname));
+		if (topo->byname) {
+			memcpy(topo->byname, topo->devs,
+			       topo->ndevs * sizeof(*topo->byname));
+			qsort(topo->byname, topo->ndevs, sizeof(*topo->byname),
+			      cmp_blkdev_name);
+		} else
+			rc = -ENOMEM;
+	}
+
+	for (i = 0; i < nlinks; i++) {
+		struct blktopo_link *l = &links[i];
+		struct sysfs_blkdev *dep;
+
+		dep = rc ? NULL : sysfs_blktopo_get_name(topo, l->name);
+		if (dep)
+			rc = l->slave ?
+				blkdevs_append(&l->dev->slaves, &l->dev->nslaves, dep) :
+				blkdevs_append(&l->dev->holders, &l->dev->nholders, dep);
+		free(l->name);
+	}
+	free(links);
+
+	if (rc)
+		sysfs_blktopo_deinit(topo);
+	return rc;
+}
+
+void sysfs_blktopo_deinit(struct sysfs_blktopo *topo)
+{
+	size_t i;
+
+	if (!topo)
+		return;
+
+	for (i = 0; i < topo->ndevs; i++) {
+		struct sysfs_blkdev *dev = topo->devs[i];
+
+		free(dev->name);
+		free(dev->parts);
+		free(dev->holders);
+		free(dev->slaves);
+		free(dev);
+	}
+	free(topo->devs);
+	free(topo->byname);
+	memset(topo, 0, sizeof(*topo));
+}
+
+struct sysfs_blkdev *sysfs_blktopo_get_name(struct sysfs_blktopo *topo,
+					    const char *name)
+{
+	struct sysfs_blkdev key = { .name = (char *) name }, *kp = &key, **res;
+
+	if (!topo || !topo->byname || !name)
+		return NULL;
+
+	res = bsearch(&kp, topo->byname, topo->ndevs, sizeof(*topo->byname),
+		      cmp_blkdev_name);
+	return res ? *res : NULL;
+}
+
+struct sysfs_blkdev *sysfs_blktopo_get_devno(struct sysfs_blktopo *topo,
+					     dev_t devno)
+{
+	size_t i;
+
+	if (!topo)
+		return NULL;
+
+	for (i = 0; i < topo->ndevs; i++) {
+		if (topo->devs[i]->devno == devno)
+			return topo->devs[i];
+	}
+	return NULL;
+}
+
 #ifdef TEST_PROGRAM_SYSFS
 #include <errno.h>
 #include <err.h>
@@ -784,6 +1263,7 @@ int sysfs_scsi_path_contains(struct sysfs_cxt *cxt, const char *pattern)
 int main(int argc, char *argv[])
 {
 	struct sysfs_cxt cxt = UL_SYSFSCXT_EMPTY;
+	struct sysfs_blktopo topo = UL_SYSFSBLKTOPO_EMPTY;
 	char *devname;
 	dev_t devno;
 	char path[PATH_MAX];
@@ -840,6 +1320,22 @@ int main(int argc, char *argv[])
 
 	printf("DEVNAME: %s\n", sysfs_get_devname(&cxt, path, sizeof(path)));
 
+	if (sysfs_blktopo_scan(&topo) == 0) {
+		struct sysfs_blkdev *dev = sysfs_blktopo_get_devno(&topo, devno);
+		size_t n;
+
+		printf("TOPOLOGY: %zu devices\n", topo.ndevs);
+		if (dev) {
+			for (n = 0; n < dev->nparts; n++)
+				printf("\tpartition: %s\n", dev->parts[n]->name);
+			for (n = 0; n < dev->nholders; n++)
+				printf("\tholder: %s\n", dev->holders[n]->name);
+			for (n = 0; n < dev->nslaves; n++)
+				printf("\tslave: %s\n", dev->slaves[n]->name);
+		}
+		sysfs_blktopo_deinit(&topo);
+	}
+
 	sysfs_deinit(&cxt);
 	return EXIT_SUCCESS;
 }
@@ -4,6 +4,7 @@
  * - allows to truncate or wrap data in columns
  * - prints tree if parent->child relation is defined
  * - draws the tree by ASCII or UTF8 lines (depends on terminal setting)
+ * - prints lines as they are added (TT_FL_STREAM, not for trees)
  *
  * Copyright (C) 2010 Karel Zak <kzak@redhat.com>
  *
@@ -102,6 +103,22 @@ static size_t mbs_safe_width(const char *s)
 	return width;
 }
 
+/*
+ * Returns number of bytes in @s. The @width is the number of cells if all the
+ * chars are printable ASCII (so nothing to encode), otherwise (size_t) -1.
+ */
+static size_t ascii_safe_width(const char *s, size_t *width)
+{
+	const unsigned char *p = (const unsigned char *) s;
+	int safe = 1;
+
+	for (; *p; p++)
+		safe &= (*p >= 0x20 && *p < 0x7f);
+
+	*width = safe ? (size_t) (p - (const unsigned char *) s) : (size_t) -1;
+	return p - (const unsigned char *) s;
+}
+
 /*
  * Returns allocated string where all control and non-printable chars are
  * replaced with \x?? hex sequence.
@@ -212,9 +229,143 @@ struct tt *tt_new_table(int flags)
 		tb->symbols = &ascii_tt_symbols;
 
 	tb->first_run = TRUE;
+	tb->nsample = TT_STREAM_NSAMPLE;
 	return tb;
 }
 
+/*
+ * @tb: table
+ * @nsample: number of lines
+ *
+ * In TT_FL_STREAM mode the columns width is counted from the first @nsample
+ * lines (and the width hints) only, the lines are buffered until the sample
+ * is complete. A column is enlarged for too large data in the later lines if
+ * the output still fits to the terminal, otherwise the data are truncated
+ * or wrapped as usual. The sample is not used in raw and export mode.
+ *
+ * Returns: 0 on success, -1 in case of error
+ */
+int tt_set_stream_nsample(struct tt *tb, size_t nsample)
+{
+	if (!tb)
+		return -1;
+	tb->nsample = nsample ? nsample : 1;
+	return 0;
+}
+
+/*
+ * @tb: table
+ * @width: output width
+ *
+ * Sets the output width, the output is reduced to @width also if the
+ * standard output is not a terminal.
+ *
+ * Returns: 0 on success, -1 in case of error
+ */
+int tt_set_termwidth(struct tt *tb, size_t width)
+{
+	if (!tb || !width)
+		return -1;
+	tb->termwidth = width;
+	tb->termforce = 1;
+	return 0;
+}
+
+/*
+ * @tb: table
+ * @name: JSON name of the table (e.g. "blockdevices")
+ *
+ * The name is not copied. The default is "table".
+ *
+ * Returns: 0 on success, -1 in case of error
+ */
+int tt_set_name(struct tt *tb, const char *name)
+{
+	if (!tb)
+		return -1;
+	tb->name = name;
+	return 0;
+}
+
+/* the JSON output is a one object, the lines are not printed in parts */
+static inline int is_stream(struct tt *tb)
+{
+	return (tb->flags & TT_FL_STREAM) &&
+	       !(tb->flags & (TT_FL_TREE | TT_FL_JSON));
+}
+
+/*
+ * Prints and removes all buffered lines if the column widths are already
+ * known (or not necessary in raw and export mode).
+ */
+static int flush_lines(struct tt *tb)
+{
+	int rc;
+
+	if (!tb->nlines)
+		return 0;
+	if (tb->first_run && tb->nlines < tb->nsample &&
+	    !(tb->flags & (TT_FL_RAW | TT_FL_EXPORT)))
+		return 0;	/* sampling */
+
+	rc = tt_print_table(tb);
+	if (!rc)
+		tt_remove_lines(tb);
+	return rc;
+}
+
+/*
+ * The lines and the data copied by tt_line_set_data_copy() are allocated from
+ * large chunks, all the chunks are deallocated by tt_remove_lines() at once.
+ */
+struct tt_chunk {
+	struct tt_chunk	*next;
+	size_t		size;
+	size_t		used;
+	char		data[];
+};
+
+#define TT_CHUNK_SIZE	(64 * 1024)
+
+static void *arena_alloc(struct tt *tb, size_t sz)
+{
+	struct tt_chunk *ch = tb->arena;
+	void *p;
+
+	sz = (sz + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	if (!ch || ch->size - ch->used < sz) {
+		size_t chsz = max(sz, (size_t) TT_CHUNK_SIZE);
+
+		ch = malloc(sizeof(*ch) + chsz);
+		if (!ch)
+			return NULL;
+		ch->size = chsz;
+		ch->used = 0;
+		ch->next = tb->arena;
+		tb->arena = ch;
+	}
+
+	p = ch->data + ch->used;
+	ch->used += sz;
+	return p;
+}
+
+/* deallocates all chunks, the last one is kept for the next lines if @keep */
+static void arena_reset(struct tt *tb, int keep)
+{
+	while (tb->arena) {
+		struct tt_chunk *ch = tb->arena;
+
+		if (keep && !ch->next && ch->size == TT_CHUNK_SIZE) {
+			ch->used = 0;
+			break;
+		}
+		tb->arena = ch->next;
+		free(ch);
+	}
+}
+
 void tt_remove_lines(struct tt *tb)
 {
 	if (!tb)
@@ -229,12 +380,14 @@ void tt_remove_lines(struct tt *tb)
 		list_for_each(p, &tb->tb_columns) {
 			struct tt_column *cl =
 				list_entry(p, struct tt_column, cl_columns);
+			if (ln->copied[cl->seqnum])
+				continue;
 			if ((cl->flags & TT_FL_FREEDATA) || (tb->flags & TT_FL_FREEDATA))
 				free(ln->data[cl->seqnum]);
 		}
-		free(ln->data);
-		free(ln);
 	}
+	arena_reset(tb, TRUE);
+	tb->nlines = 0;
 }
 
 void tt_free_table(struct tt *tb)
@@ -243,6 +396,7 @@ void tt_free_table(struct tt *tb)
 		return;
 
 	tt_remove_lines(tb);
+	arena_reset(tb, FALSE);
 
 	while (!list_empty(&tb->tb_columns)) {
 		struct tt_column *cl = list_entry(tb->tb_columns.next,
@@ -311,20 +465,33 @@ struct tt_column *tt_define_column(struct tt *tb, const char *name,
  * @tb: table
  * @parent: parental line or NULL
  *
+ * In TT_FL_STREAM mode the previously added lines are printed and deallocated
+ * by this function, so the caller must not use them anymore. The @parent is
+ * ignored in this case (the lines are not printed as tree).
+ *
  * Returns: newly allocate line
  */
 struct tt_line *tt_add_line(struct tt *tb, struct tt_line *parent)
 {
-	struct tt_line *ln = NULL;
+	struct tt_line *ln;
+	size_t sz;
 
 	if (!tb || !tb->ncols)
 		goto err;
-	ln = calloc(1, sizeof(*ln));
+	if (is_stream(tb)) {
+		if (flush_lines(tb))
+			goto err;
+		parent = NULL;
+	}
+	/* the line, data[], widths[] and copied[] in one piece */
+	sz = sizeof(*ln) + tb->ncols * (sizeof(char *) + sizeof(size_t) + 1);
+	ln = arena_alloc(tb, sz);
 	if (!ln)
 		goto err;
-	ln->data = calloc(tb->ncols, sizeof(char *));
-	if (!ln->data)
-		goto err;
+	memset(ln, 0, sz);
+	ln->data = (char **) (ln + 1);
+	ln->widths = (size_t *) (ln->data + tb->ncols);
+	ln->copied = (char *) (ln->widths + tb->ncols);
 
 	ln->table = tb;
 	ln->parent = parent;
@@ -333,12 +500,12 @@ struct tt_line *tt_add_line(struct tt *tb, struct tt_line *parent)
 	INIT_LIST_HEAD(&ln->ln_branch);
 
 	list_add_tail(&ln->ln_lines, &tb->tb_lines);
+	tb->nlines++;
 
 	if (parent)
 		list_add_tail(&ln->ln_children, &parent->ln_branch);
 	return ln;
 err:
-	free(ln);
 	return NULL;
 }
 
@@ -361,6 +528,38 @@ struct tt_column *tt_get_column(struct tt *tb, size_t colnum)
 	return NULL;
 }
 
+/*
+ * @ln: line
+ * @colnum: number of column (0..N)
+ * @data: string
+ *
+ * The same as tt_line_set_data(), but @data are copied to the memory
+ * allocated together with the table lines. The copy is never deallocated by
+ * free(), TT_FL_FREEDATA is ignored for the column of this line.
+ *
+ * Returns: 0 on success, -1 in case of error
+ */
+int tt_line_set_data_copy(struct tt_line *ln, int colnum, const char *data)
+{
+	char *p = NULL;
+
+	if (!ln)
+		return -1;
+	if (data) {
+		size_t sz = strlen(data) + 1;
+
+		p = arena_alloc(ln->table, sz);
+		if (!p)
+			return -1;
+		memcpy(p, data, sz);
+	}
+	if (tt_line_set_data(ln, colnum, p))
+		return -1;
+	if (p)
+		ln->copied[colnum] = 1;
+	return 0;
+}
+
 /*
  * @ln: line
  * @colnum: number of column (0..N)
@@ -384,8 +583,10 @@ int tt_line_set_data(struct tt_line *ln, int colnum, char *data)
 	}
 
 	ln->data[cl->seqnum] = data;
+	ln->copied[cl->seqnum] = 0;
+	ln->widths[cl->seqnum] = 0;
 	if (data)
-		ln->data_sz += strlen(data);
+		ln->data_sz += ascii_safe_width(data, &ln->widths[cl->seqnum]);
 	return 0;
 }
 
@@ -461,6 +662,34 @@ static char *line_get_data(struct tt_line *ln, struct tt_column *cl,
 	return buf;
 }
 
+/*
+ * Returns number of cells of the printed data, the width of ASCII data is
+ * cached by tt_line_set_data().
+ */
+static size_t cell_width(struct tt_line *ln, struct tt_column *cl,
+			 char *buf, size_t bufsz)
+{
+	size_t len = ln->widths[cl->seqnum];
+	char *data;
+
+	if (!ln->data[cl->seqnum])
+		return 0;
+
+	if (len != (size_t) -1) {
+		if (cl->flags & TT_FL_TREE) {
+			struct tt_line *x;
+
+			/* all the tree symbols are two cells width */
+			for (x = ln->parent; x; x = x->parent)
+				len += 2;
+		}
+		return len;
+	}
+
+	data = line_get_data(ln, cl, buf, bufsz);
+	return data ? mbs_safe_width(data) : 0;
+}
+
 /*
  * This function counts column width.
  *
@@ -481,8 +710,7 @@ static void count_column_width(struct tt *tb, struct tt_column *cl,
 
 	list_for_each(lp, &tb->tb_lines) {
 		struct tt_line *ln = list_entry(lp, struct tt_line, ln_lines);
-		char *data = line_get_data(ln, cl, buf, bufsz);
-		size_t len = data ? mbs_safe_width(data) : 0;
+		size_t len = cell_width(ln, cl, buf, bufsz);
 
 		if (len == (size_t) -1)		/* ignore broken multibyte strings */
 			len = 0;
@@ -707,14 +935,41 @@ void tt_fputs_nonblank(const char *data, FILE *out)
 	}
 }
 
+/*
+ * TT_FL_STREAM: the column width has been counted from the sample only,
+ * returns a new width for data with @len cells.
+ */
+static size_t enlarge_column(struct tt *tb, struct tt_column *cl, size_t len)
+{
+	if (tb->is_term) {
+		struct list_head *p;
+		size_t width = 0;
+
+		list_for_each(p, &tb->tb_columns) {
+			struct tt_column *x =
+				list_entry(p, struct tt_column, cl_columns);
+
+			width += x->width + (is_last_column(tb, x) ? 0 : 1);
+		}
+		if (width - cl->width + len > tb->termwidth)
+			return cl->width;
+	}
+	cl->width = len;
+	return len;
+}
+
 /*
  * Prints data, data maybe be printed in more formats (raw, NAME=xxx pairs) and
  * control and non-printable chars maybe encoded in \x?? hex encoding.
+ *
+ * The @safe_len is number of cells if the data are printable ASCII (no
+ * encoding, the data are not modified), otherwise (size_t) -1.
  */
-static void print_data(struct tt *tb, struct tt_column *cl, char *data)
+static void print_data(struct tt *tb, struct tt_column *cl, char *data,
+		       size_t safe_len)
 {
 	size_t len = 0, i, width;
-	char *buf;
+	char *buf = NULL;
 
 	if (!data)
 		data = "";
@@ -737,10 +992,14 @@ static void print_data(struct tt *tb, struct tt_column *cl, char *data)
 	}
 
 	/* note that 'len' and 'width' are number of cells, not bytes */
-	buf = mbs_safe_encode(data, &len);
-	data = buf;
-	if (!data)
-		data = "";
+	if (safe_len != (size_t) -1)
+		len = safe_len;
+	else {
+		buf = mbs_safe_encode(data, &len);
+		data = buf;
+		if (!data)
+			data = "";
+	}
 
 	if (!len || len == (size_t) -1) {
 		len = 0;
@@ -751,9 +1010,15 @@ static void print_data(struct tt *tb, struct tt_column *cl, char *data)
 	if (is_last_column(tb, cl) && len < width)
 		width = len;
 
+	if (len > width && is_stream(tb) && !is_last_column(tb, cl) &&
+	    !(cl->flags & TT_FL_TRUNC))
+		width = enlarge_column(tb, cl, len);
+
 	/* truncate data */
 	if (len > width && (cl->flags & TT_FL_TRUNC)) {
-		if (data)
+		if (!buf)
+			len = width;	/* ASCII, cells are bytes */
+		else if (data)
 			len = mbs_truncate(data, &width);
 		if (!data || len == (size_t) -1) {
 			len = 0;
@@ -763,12 +1028,17 @@ static void print_data(struct tt *tb, struct tt_column *cl, char *data)
 	if (data) {
 		if (!(tb->flags & TT_FL_RAW) && (cl->flags & TT_FL_RIGHT)) {
 			size_t xw = cl->width;
-			fprintf(stdout, "%*s", (int) xw, data);
+			if (buf)
+				fprintf(stdout, "%*s", (int) xw, data);
+			else
+				fprintf(stdout, "%*.*s", (int) xw, (int) len, data);
 			if (len < xw)
 				len = xw;
 		}
-		else
+		else if (buf)
 			fputs(data, stdout);
+		else
+			fwrite(data, 1, len, stdout);
 	}
 	for (i = len; i < width; i++)
 		fputc(' ', stdout);		/* padding */
@@ -797,7 +1067,14 @@ static void print_line(struct tt_line *ln, char *buf, size_t bufsz)
 		struct tt_column *cl =
 				list_entry(p, struct tt_column, cl_columns);
 
-		print_data(ln->table, cl, line_get_data(ln, cl, buf, bufsz));
+		size_t len = ln->widths[cl->seqnum];
+
+		/* printable ASCII is printed directly */
+		if (len != (size_t) -1 && !(cl->flags & TT_FL_TREE))
+			print_data(ln->table, cl, ln->data[cl->seqnum], len);
+		else
+			print_data(ln->table, cl,
+				   line_get_data(ln, cl, buf, bufsz), (size_t) -1);
 	}
 	fputc('\n', stdout);
 }
@@ -820,7 +1097,7 @@ static void print_header(struct tt *tb, char *buf, size_t bufsz)
 
 		strncpy(buf, cl->name, bufsz);
 		buf[bufsz - 1] = '\0';
-		print_data(tb, cl, buf);
+		print_data(tb, cl, buf, (size_t) -1);
 	}
 	fputc('\n', stdout);
 }
@@ -871,10 +1148,160 @@ static void print_tree(struct tt *tb, char *buf, size_t bufsz)
 	}
 }
 
+/*
+ * Returns length of the valid UTF-8 multibyte sequence at @p or 0. The
+ * overlong forms, surrogates and code points above U+10FFFF are invalid.
+ */
+static size_t utf8_seqlen(const unsigned char *p)
+{
+	size_t i, len;
+	unsigned char min = 0x80, max = 0xBF;
+
+	if (*p >= 0xC2 && *p <= 0xDF)
+		len = 2;
+	else if (*p >= 0xE0 && *p <= 0xEF) {
+		len = 3;
+		if (*p == 0xE0)
+			min = 0xA0;
+		else if (*p == 0xED)
+			max = 0x9F;
+	} else if (*p >= 0xF0 && *p <= 0xF4) {
+		len = 4;
+		if (*p == 0xF0)
+			min = 0x90;
+		else if (*p == 0xF4)
+			max = 0x8F;
+	} else
+		return 0;
+
+	if (p[1] < min || p[1] > max)
+		return 0;
+	for (i = 2; i < len; i++) {
+		if (p[i] < 0x80 || p[i] > 0xBF)
+			return 0;
+	}
+	return len;
+}
+
+/*
+ * Prints JSON string, the column names are converted to lower case. The
+ * bytes which are not valid UTF-8 are replaced by U+FFFD.
+ */
+static void fputs_json(const char *data, int lower, FILE *out)
+{
+	const unsigned char *p;
+	size_t len;
+
+	fputc('"', out);
+	for (p = (const unsigned char *) data; p && *p; p++) {
+		switch (*p) {
+		case '"':
+		case '\\':
+			fputc('\\', out);
+			fputc(*p, out);
+			break;
+		case '\n':
+			fputs("\\n", out);
+			break;
+		case '\t':
+			fputs("\\t", out);
+			break;
+		default:
+			if (*p < 0x20 || *p == 0x7f)
+				fprintf(out, "\\u%04x", *p);
+			else if (*p < 0x80)
+				fputc(lower ? tolower(*p) : *p, out);
+			else if ((len = utf8_seqlen(p))) {
+				fwrite(p, 1, len, out);
+				p += len - 1;
+			} else
+				fputs("\\ufffd", out);
+			break;
+		}
+	}
+	fputc('"', out);
+}
+
+static void print_json_line(struct tt *tb, struct tt_line *ln,
+			    int indent, int last)
+{
+	struct list_head *p;
+
+	printf("%*s{", indent, "");
+
+	list_for_each(p, &tb->tb_columns) {
+		struct tt_column *cl =
+				list_entry(p, struct tt_column, cl_columns);
+		const char *data = ln->data[cl->seqnum];
+
+		fputs_json(cl->name, 1, stdout);
+		fputs(": ", stdout);
+		if (data && *data)
+			fputs_json(data, 0, stdout);
+		else
+			fputs("null", stdout);
+		if (!is_last_column(tb, cl))
+			fputs(", ", stdout);
+	}
+
+	if ((tb->flags & TT_FL_TREE) && !list_empty(&ln->ln_branch)) {
+		printf(",\n%*s\"children\": [\n", indent + 3, "");
+
+		list_for_each(p, &ln->ln_branch) {
+			struct tt_line *chld =
+				list_entry(p, struct tt_line, ln_children);
+
+			print_json_line(tb, chld, indent + 6,
+					p->next == &ln->ln_branch);
+		}
+		printf("%*s]\n%*s}", indent + 3, "", indent, "");
+	} else
+		fputc('}', stdout);
+
+	fputs(last ? "\n" : ",\n", stdout);
+}
+
+/*
+ *	{
+ *	   "name": [
+ *	      {"col1": "data", "col2": null},
+ *	      {"col1": "data", "col2": "data",
+ *	         "children": [
+ *	            {"col1": "data", "col2": "data"}
+ *	         ]
+ *	      }
+ *	   ]
+ *	}
+ */
+static void print_json(struct tt *tb)
+{
+	struct tt_line *prev = NULL;
+	struct list_head *p;
+
+	fputs("{\n   ", stdout);
+	fputs_json(tb->name ? tb->name : "table", 0, stdout);
+	fputs(": [\n", stdout);
+
+	list_for_each(p, &tb->tb_lines) {
+		struct tt_line *ln = list_entry(p, struct tt_line, ln_lines);
+
+		if ((tb->flags & TT_FL_TREE) && ln->parent)
+			continue;	/* printed as children */
+		if (prev)
+			print_json_line(tb, prev, 6, 0);
+		prev = ln;
+	}
+	if (prev)
+		print_json_line(tb, prev, 6, 1);
+
+	fputs("   ]\n}\n", stdout);
+}
+
 /*
  * @tb: table
  *
- * Prints the table to stdout
+ * Prints the table to stdout. In TT_FL_STREAM mode it prints the lines which
+ * have not been printed by tt_add_line() yet.
  */
 int tt_print_table(struct tt *tb)
 {
@@ -885,8 +1312,14 @@ int tt_print_table(struct tt *tb)
 	if (!tb)
 		return -1;
 
+	if (tb->flags & TT_FL_JSON) {
+		print_json(tb);
+		tb->first_run = FALSE;
+		return 0;
+	}
+
 	if (tb->first_run) {
-		tb->is_term = isatty(STDOUT_FILENO);
+		tb->is_term = tb->termforce || isatty(STDOUT_FILENO);
 
 		if (tb->is_term && !tb->termwidth)
 			tb->termwidth = get_terminal_width();
@@ -934,7 +1367,7 @@ int main(int argc, char *argv[])
 	int flags = 0, notree = 0, i;
 
 	if (argc == 2 && !strcmp(argv[1], "--help")) {
-		printf("%s [--ascii | --raw | --list]\n",
+		printf("%s [--ascii | --raw | --list | --stream | --json]\n",
 				program_invocation_short_name);
 		return EXIT_SUCCESS;
 	} else if (argc == 2 && !strcmp(argv[1], "--ascii")) {
@@ -945,8 +1378,14 @@ int main(int argc, char *argv[])
 	} else if (argc == 2 && !strcmp(argv[1], "--export")) {
 		flags |= TT_FL_EXPORT;
 		notree = 1;
+	} else if (argc == 2 && !strcmp(argv[1], "--json")) {
+		flags |= TT_FL_JSON;
 	} else if (argc == 2 && !strcmp(argv[1], "--list"))
 		notree = 1;
+	else if (argc == 2 && !strcmp(argv[1], "--stream")) {
+		flags |= TT_FL_STREAM;
+		notree = 1;
+	}
 
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
@@ -955,6 +1394,8 @@ int main(int argc, char *argv[])
 	tb = tt_new_table(flags);
 	if (!tb)
 		err(EXIT_FAILURE, "table initialization failed");
+	if (flags & TT_FL_STREAM)
+		tt_set_stream_nsample(tb, 3);
 
 	tt_define_column(tb, "NAME", 0.3, notree ? 0 : TT_FL_TREE);
 	tt_define_column(tb, "FOO", 0.3, TT_FL_TRUNC);
@@ -966,43 +1407,43 @@ int main(int argc, char *argv[])
 		tt_line_set_data(ln, MYCOL_NAME, "AAA");
 		tt_line_set_data(ln, MYCOL_FOO, "a-foo-foo");
 		tt_line_set_data(ln, MYCOL_BAR, "barBar-A");
-		tt_line_set_data(ln, MYCOL_PATH, "/mnt/AAA");
+		tt_line_set_data_copy(ln, MYCOL_PATH, "/mnt/AAA");
 
 		pr = ln = tt_add_line(tb, ln);
 		tt_line_set_data(ln, MYCOL_NAME, "AAA.A");
 		tt_line_set_data(ln, MYCOL_FOO, "a.a-foo-foo");
 		tt_line_set_data(ln, MYCOL_BAR, "barBar-A.A");
-		tt_line_set_data(ln, MYCOL_PATH, "/mnt/AAA/A");
+		tt_line_set_data_copy(ln, MYCOL_PATH, "/mnt/AAA/A");
 
 		ln = tt_add_line(tb, pr);
 		tt_line_set_data(ln, MYCOL_NAME, "AAA.A.AAA");
 		tt_line_set_data(ln, MYCOL_FOO, "a.a.a-foo-foo");
 		tt_line_set_data(ln, MYCOL_BAR, "barBar-A.A.A");
-		tt_line_set_data(ln, MYCOL_PATH, "/mnt/AAA/A/AAA");
+		tt_line_set_data_copy(ln, MYCOL_PATH, "/mnt/AAA/A/AAA");
 
 		ln = tt_add_line(tb, root);
 		tt_line_set_data(ln, MYCOL_NAME, "AAA.B");
 		tt_line_set_data(ln, MYCOL_FOO, "a.b-foo-foo");
 		tt_line_set_data(ln, MYCOL_BAR, "barBar-A.B");
-		tt_line_set_data(ln, MYCOL_PATH, "/mnt/AAA/B");
+		tt_line_set_data_copy(ln, MYCOL_PATH, "/mnt/AAA/B");
 
 		ln = tt_add_line(tb, pr);
 		tt_line_set_data(ln, MYCOL_NAME, "AAA.A.BBB");
 		tt_line_set_data(ln, MYCOL_FOO, "a.a.b-foo-foo");
 		tt_line_set_data(ln, MYCOL_BAR, "barBar-A.A.BBB");
-		tt_line_set_data(ln, MYCOL_PATH, "/mnt/AAA/A/BBB");
+		tt_line_set_data_copy(ln, MYCOL_PATH, "/mnt/AAA/A/BBB");
 
 		ln = tt_add_line(tb, pr);
 		tt_line_set_data(ln, MYCOL_NAME, "AAA.A.CCC");
 		tt_line_set_data(ln, MYCOL_FOO, "a.a.c-foo-foo");
 		tt_line_set_data(ln, MYCOL_BAR, "barBar-A.A.CCC");
-		tt_line_set_data(ln, MYCOL_PATH, "/mnt/AAA/A/CCC");
+		tt_line_set_data_copy(ln, MYCOL_PATH, "/mnt/AAA/A/CCC");
 
 		ln = tt_add_line(tb, root);
 		tt_line_set_data(ln, MYCOL_NAME, "AAA.C");
 		tt_line_set_data(ln, MYCOL_FOO, "a.c-foo-foo");
 		tt_line_set_data(ln, MYCOL_BAR, "barBar-A.C");
-		tt_line_set_data(ln, MYCOL_PATH, "/mnt/AAA/C");
+		tt_line_set_data_copy(ln, MYCOL_PATH, "/mnt/AAA/C");
 	}
 
 	tt_print_table(tb);
@@ -0,0 +1,569 @@
+/*
+ * bincache.c - compact binary (mmap-able) version of the blkid cache file
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * The binary cache is written by blkid_flush_cache() next to the text cache
+ * file (<cachefile>.bin). It's only an accelerator, the text file is still
+ * the primary (and always up-to-date) source of information. The binary file
+ * is ignored if it does not match the text file (inode, size, mtime).
+ *
+ * File format (native byte order, all offsets are relative to the begin of
+ * the file, all strings are offsets to the strings area):
+ *
+ *	header
+ *	devs[ndevs]	devices in the same order as in the text file
+ *	tags[ntags]	tags, tags for the same device are in continuous block
+ *	idx[ntags]	indexes to tags[] sorted by (tag name, tag value)
+ *	strs[]		NUL terminated strings, every string is stored only once
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "blkidP.h"
+#include "all-io.h"
+
+#define BINCACHE_MAGIC		"BLKIDBIN"
+#define BINCACHE_MAGIC_LEN	8
+#define BINCACHE_VERSION	1
+#define BINCACHE_SUFFIX		".bin"
+
+struct bincache_hdr {
+	char		magic[BINCACHE_MAGIC_LEN];
+	uint32_t	version;
+	uint32_t	hdrsize;	/* sizeof(struct bincache_hdr) */
+
+	uint64_t	txt_ino;	/* text cache file inode */
+	uint64_t	txt_size;	/* text cache file size */
+	int64_t		txt_mtime;	/* text cache file mtime */
+
+	uint32_t	ndevs;
+	uint32_t	ntags;
+
+	uint32_t	devs_off;
+	uint32_t	tags_off;
+	uint32_t	idx_off;
+	uint32_t	strs_off;
+	uint32_t	strs_size;
+	uint32_t	padding;
+};
+
+struct bincache_dev {
+	uint32_t	name;
+	uint32_t	first_tag;
+	uint32_t	ntags;
+	int32_t		pri;
+	uint64_t	devno;
+	int64_t		time;
+	int64_t		utime;
+	uint64_t	sig;
+};
+
+struct bincache_tag {
+	uint32_t	name;
+	uint32_t	value;
+	uint32_t	dev;
+};
+
+/*
+ * Strings table used when the binary file is generated
+ */
+struct bincache_strs {
+	char		*data;
+	size_t		size;
+	size_t		alloc;
+
+	uint32_t	*hash;		/* open addressing, offset + 1 or 0 */
+	size_t		hashsz;
+};
+
+static char *bincache_filename(const char *filename)
+{
+	char *bin = malloc(strlen(filename) + sizeof(BINCACHE_SUFFIX));
+
+	if (bin)
+		sprintf(bin, "%s" BINCACHE_SUFFIX, filename);
+	return bin;
+}
+
+static size_t hash_string(const char *str)
+{
+	size_t h = 5381;
+
+	while (*str)
+		h = (h << 5) + h + (unsigned char) *str++;
+	return h;
+}
+
+/* returns offset of the string in the strings area, or -1 on error */
+static int64_t strs_intern(struct bincache_strs *st, const char *str)
+{
+	size_t i, len = strlen(str) + 1;
+
+	for (i = hash_string(str) & (st->hashsz - 1); st->hash[i];
+	     i = (i + 1) & (st->hashsz - 1)) {
+		if (strcmp(st->data + st->hash[i] - 1, str) == 0)
+			return st->hash[i] - 1;
+	}
+
+	if (st->size + len > UINT32_MAX - 1)
+		return -1;
+	if (st->size + len > st->alloc) {
+		size_t sz = (st->size + len) * 2;
+		char *tmp = realloc(st->data, sz);
+
+		if (!tmp)
+			return -1;
+		st->data = tmp;
+		st->alloc = sz;
+	}
+	memcpy(st->data + st->size, str, len);
+	st->hash[i] = st->size + 1;
+	st->size += len;
+
+	return st->hash[i] - 1;
+}
+
+static const char *bincache_str(const char *map, const struct bincache_hdr *hdr,
+				uint32_t off)
+{
+	return map + hdr->strs_off + off;
+}
+
+static int cmp_tag(const char *map, const struct bincache_hdr *hdr,
+		   const struct bincache_tag *tag,
+		   const char *name, const char *value)
+{
+	int rc = strcmp(bincache_str(map, hdr, tag->name), name);
+
+	if (rc == 0)
+		rc = strcmp(bincache_str(map, hdr, tag->value), value);
+	return rc;
+}
+
+/* used for qsort() when the file is generated */
+struct bincache_sortent {
+	const char	*name;
+	const char	*value;
+	uint32_t	idx;
+};
+
+static int cmp_sortent(const void *a, const void *b)
+{
+	const struct bincache_sortent *sa = a, *sb = b;
+	int rc = strcmp(sa->name, sb->name);
+
+	if (rc == 0)
+		rc = strcmp(sa->value, sb->value);
+	return rc;
+}
+
+static int bincache_wanted_dev(blkid_dev dev)
+{
+	/* the same rules as for the text file, see blkid_flush_cache() */
+	return dev->bid_type && dev->bid_name[0] == '/' &&
+	       !(dev->bid_flags & BLKID_BID_FL_REMOVABLE);
+}
+
+/*
+ * Generates <filename>.bin from the devices in the cache. The @filename is
+ * the already written text cache file.
+ */
+int blkid__write_bincache(blkid_cache cache, const char *filename)
+{
+	struct bincache_strs strs = { .data = NULL };
+	struct bincache_hdr *hdr = NULL;
+	struct bincache_dev *devs;
+	struct bincache_tag *tags;
+	uint32_t *idx;
+	struct list_head *p, *t;
+	struct stat st;
+	size_t ndevs = 0, ntags = 0, i, sz;
+	char *buf = NULL, *bin = NULL, *tmp = NULL;
+	int fd = -1, rc = -BLKID_ERR_MEM;
+
+	bin = bincache_filename(filename);
+	if (!bin)
+		goto done;
+
+	if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+		rc = -BLKID_ERR_CACHE;
+		goto done;
+	}
+
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+
+		if (!bincache_wanted_dev(dev))
+			continue;
+		ndevs++;
+		list_for_each(t, &dev->bid_tags)
+			ntags++;
+	}
+
+	for (strs.hashsz = 64; strs.hashsz < (ndevs + ntags * 2) * 2;
+	     strs.hashsz <<= 1);
+	strs.hash = calloc(strs.hashsz, sizeof(uint32_t));
+	if (!strs.hash)
+		goto done;
+
+	sz = sizeof(*hdr) + ndevs * sizeof(*devs) + ntags * sizeof(*tags)
+			  + ntags * sizeof(*idx);
+	devs = calloc(1, ndevs * sizeof(*devs) + ntags * sizeof(*tags) + 1);
+	if (!devs)
+		goto done;
+	tags = (struct bincache_tag *) (devs + ndevs);
+
+	/* devices and tags */
+	i = 0;
+	ntags = 0;
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+		struct bincache_dev *d = &devs[i];
+		int64_t off;
+
+		if (!bincache_wanted_dev(dev))
+			continue;
+		if ((off = strs_intern(&strs, dev->bid_name)) < 0)
+			goto done_devs;
+
+		d->name = off;
+		d->first_tag = ntags;
+		d->pri = dev->bid_pri;
+		d->devno = dev->bid_devno;
+		d->time = dev->bid_time;
+		d->utime = dev->bid_utime;
+		d->sig = dev->bid_sig;
+
+		list_for_each(t, &dev->bid_tags) {
+			blkid_tag tag = list_entry(t, struct blkid_struct_tag,
+						   bit_tags);
+			struct bincache_tag *x = &tags[ntags];
+
+			if ((off = strs_intern(&strs, tag->bit_name)) < 0)
+				goto done_devs;
+			x->name = off;
+			if ((off = strs_intern(&strs, tag->bit_val)) < 0)
+				goto done_devs;
+			x->value = off;
+			x->dev = i;
+			ntags++;
+			d->ntags++;
+		}
+		i++;
+	}
+
+	buf = calloc(1, sz + strs.size);
+	if (!buf)
+		goto done_devs;
+
+	hdr = (struct bincache_hdr *) buf;
+	memcpy(hdr->magic, BINCACHE_MAGIC, BINCACHE_MAGIC_LEN);
+	hdr->version = BINCACHE_VERSION;
+	hdr->hdrsize = sizeof(*hdr);
+	hdr->txt_ino = st.st_ino;
+	hdr->txt_size = st.st_size;
+	hdr->txt_mtime = st.st_mtime;
+	hdr->ndevs = ndevs;
+	hdr->ntags = ntags;
+	hdr->devs_off = sizeof(*hdr);
+	hdr->tags_off = hdr->devs_off + ndevs * sizeof(*devs);
+	hdr->idx_off = hdr->tags_off + ntags * sizeof(*tags);
+	hdr->strs_off = hdr->idx_off + ntags * sizeof(*idx);
+	hdr->strs_size = strs.size;
+
+	memcpy(buf + hdr->devs_off, devs, ndevs * sizeof(*devs));
+	memcpy(buf + hdr->tags_off, tags, ntags * sizeof(*tags));
+	if (strs.size)
+		memcpy(buf + hdr->strs_off, strs.data, strs.size);
+
+	/* tags index */
+	if (ntags) {
+		struct bincache_sortent *ents = malloc(ntags * sizeof(*ents));
+
+		if (!ents)
+			goto done_devs;
+		for (i = 0; i < ntags; i++) {
+			ents[i].name = strs.data + tags[i].name;
+			ents[i].value = strs.data + tags[i].value;
+			ents[i].idx = i;
+		}
+		qsort(ents, ntags, sizeof(*ents), cmp_sortent);
+
+		idx = (uint32_t *) (buf + hdr->idx_off);
+		for (i = 0; i < ntags; i++)
+			idx[i] = ents[i].idx;
+		free(ents);
+	}
+
+	/* write to temporary file and rename */
+	tmp = malloc(strlen(bin) + 8);
+	if (!tmp)
+		goto done_devs;
+	sprintf(tmp, "%s-XXXXXX", bin);
+	fd = mkostemp(tmp, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC);
+	if (fd < 0) {
+		rc = -errno;
+		goto done_devs;
+	}
+	if (fchmod(fd, 0644) != 0 ||
+	    write_all(fd, buf, sz + strs.size) != 0 ||
+	    close(fd) != 0) {
+		rc = -errno;
+		if (fd >= 0)
+			close(fd);
+		unlink(tmp);
+		goto done_devs;
+	}
+	if (rename(tmp, bin) != 0) {
+		rc = -errno;
+		unlink(tmp);
+		goto done_devs;
+	}
+
+	DBG(SAVE, blkid_debug("written binary cache %s (%zu devices, %zu tags, "
+				"%zu bytes of strings)", bin, ndevs, ntags, strs.size));
+	rc = 0;
+done_devs:
+	free(devs);
+done:
+	if (rc)
+		DBG(SAVE, blkid_debug("failed to write binary cache [rc=%d]", rc));
+	free(tmp);
+	free(buf);
+	free(strs.data);
+	free(strs.hash);
+	free(bin);
+	return rc;
+}
+
+static int bincache_verify(const char *map, size_t mapsz)
+{
+	const struct bincache_hdr *hdr = (const struct bincache_hdr *) map;
+	const struct bincache_dev *devs;
+	const struct bincache_tag *tags;
+	const uint32_t *idx;
+	size_t i;
+
+	if (mapsz < sizeof(*hdr) ||
+	    memcmp(hdr->magic, BINCACHE_MAGIC, BINCACHE_MAGIC_LEN) != 0 ||
+	    hdr->version != BINCACHE_VERSION ||
+	    hdr->hdrsize != sizeof(*hdr))
+		return -1;
+
+	if (hdr->devs_off != sizeof(*hdr) ||
+	    hdr->tags_off != hdr->devs_off + (uint64_t) hdr->ndevs * sizeof(*devs) ||
+	    hdr->idx_off != hdr->tags_off + (uint64_t) hdr->ntags * sizeof(*tags) ||
+	    hdr->strs_off != hdr->idx_off + (uint64_t) hdr->ntags * sizeof(*idx) ||
+	    (uint64_t) hdr->strs_off + hdr->strs_size != mapsz)
+		return -1;
+
+	if (hdr->strs_size && map[mapsz - 1] != '\0')
+		return -1;
+
+	devs = (const struct bincache_dev *) (map + hdr->devs_off);
+	tags = (const struct bincache_tag *) (map + hdr->tags_off);
+	idx = (const uint32_t *) (map + hdr->idx_off);
+
+	for (i = 0; i < hdr->ndevs; i++) {
+		if (devs[i].name >= hdr->strs_size ||
+		    devs[i].first_tag > hdr->ntags ||
+		    devs[i].ntags > hdr->ntags - devs[i].first_tag)
+			return -1;
+	}
+	for (i = 0; i < hdr->ntags; i++) {
+		if (tags[i].name >= hdr->strs_size ||
+		    tags[i].value >= hdr->strs_size ||
+		    tags[i].dev >= hdr->ndevs ||
+		    idx[i] >= hdr->ntags)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Maps <cachefile>.bin if the file is consistent with the text cache file.
+ * The text cache file is not parsed at all in this case, the cache is
+ * marked by BLKID_BIC_FL_UNPARSED and the text file is read on demand by
+ * blkid_read_cache().
+ *
+ * Returns: 0 on success, <0 on error or if the binary file is not usable.
+ */
+int blkid__open_bincache(blkid_cache cache)
+{
+	struct stat st, txt;
+	char *bin;
+	void *map;
+	int fd;
+
+	if (!cache->bic_filename)
+		return -BLKID_ERR_PARAM;
+
+	bin = bincache_filename(cache->bic_filename);
+	if (!bin)
+		return -BLKID_ERR_MEM;
+	fd = open(bin, O_RDONLY|O_CLOEXEC);
+	free(bin);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    stat(cache->bic_filename, &txt) != 0) {
+		close(fd);
+		return -BLKID_ERR_CACHE;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	if (bincache_verify(map, st.st_size) != 0) {
+		DBG(CACHE, blkid_debug("binary cache: invalid file"));
+		goto unusable;
+	} else {
+		const struct bincache_hdr *hdr = map;
+
+		if (hdr->txt_ino != (uint64_t) txt.st_ino ||
+		    hdr->txt_size != (uint64_t) txt.st_size ||
+		    hdr->txt_mtime != (int64_t) txt.st_mtime) {
+			DBG(CACHE, blkid_debug("binary cache: out of sync with %s",
+						cache->bic_filename));
+			goto unusable;
+		}
+	}
+
+	DBG(CACHE, blkid_debug("binary cache: mapped %zu bytes",
+				(size_t) st.st_size));
+	cache->bic_map = map;
+	cache->bic_mapsz = st.st_size;
+	cache->bic_ftime = txt.st_mtime;
+	cache->bic_flags |= BLKID_BIC_FL_UNPARSED;
+	return 0;
+unusable:
+	munmap(map, st.st_size);
+	return -BLKID_ERR_CACHE;
+}
+
+void blkid__close_bincache(blkid_cache cache)
+{
+	if (!cache->bic_map)
+		return;
+
+	munmap(cache->bic_map, cache->bic_mapsz);
+	cache->bic_map = NULL;
+	cache->bic_mapsz = 0;
+}
+
+/* creates in-memory device from the mapped device */
+static blkid_dev bincache_new_dev(blkid_cache cache, const char *map,
+				   const struct bincache_hdr *hdr,
+				   const struct bincache_dev *d)
+{
+	const struct bincache_tag *tags = (const struct bincache_tag *)
+						(map + hdr->tags_off);
+	const char *name = bincache_str(map, hdr, d->name);
+	unsigned int flags = cache->bic_flags;
+	blkid_dev dev;
+	size_t i;
+
+	/* already in memory? */
+	dev = blkid__cache_find_dev(cache, name);
+	if (dev)
+		return dev;
+
+	dev = blkid_new_dev();
+	if (!dev)
+		return NULL;
+	dev->bid_name = strdup(name);
+	if (!dev->bid_name) {
+		blkid_free_dev(dev);
+		return NULL;
+	}
+	dev->bid_devno = d->devno;
+	dev->bid_time = d->time;
+	dev->bid_utime = d->utime;
+	dev->bid_pri = d->pri;
+	dev->bid_sig = d->sig;
+	blkid__cache_add_dev(cache, dev);
+
+	for (i = d->first_tag; i < d->first_tag + d->ntags; i++) {
+		const char *val = bincache_str(map, hdr, tags[i].value);
+
+		if (blkid_set_tag(dev, bincache_str(map, hdr, tags[i].name),
+				  val, strlen(val)) < 0) {
+			blkid_free_dev(dev);
+			dev = NULL;
+			break;
+		}
+	}
+
+	/* the device is the same as on disk, nothing to save */
+	cache->bic_flags = flags;
+	return dev;
+}
+
+/*
+ * Returns the highest priority (existing) device with the tag @type=@value
+ * from the binary cache. Only the matching device is allocated.
+ */
+blkid_dev blkid__bincache_find_dev(blkid_cache cache,
+				   const char *type, const char *value)
+{
+	const char *map = cache->bic_map;
+	const struct bincache_hdr *hdr;
+	const struct bincache_dev *devs, *best = NULL;
+	const struct bincache_tag *tags;
+	const uint32_t *idx;
+	size_t lo, hi;
+
+	if (!map)
+		return NULL;
+
+	hdr = (const struct bincache_hdr *) map;
+	devs = (const struct bincache_dev *) (map + hdr->devs_off);
+	tags = (const struct bincache_tag *) (map + hdr->tags_off);
+	idx = (const uint32_t *) (map + hdr->idx_off);
+
+	/* lower bound */
+	lo = 0;
+	hi = hdr->ntags;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (cmp_tag(map, hdr, &tags[idx[mid]], type, value) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < hdr->ntags; lo++) {
+		const struct bincache_tag *tag = &tags[idx[lo]];
+		const struct bincache_dev *d = &devs[tag->dev];
+
+		if (cmp_tag(map, hdr, tag, type, value) != 0)
+			break;
+		if ((!best || d->pri > best->pri) &&
+		    access(bincache_str(map, hdr, d->name), F_OK) == 0)
+			best = d;
+	}
+
+	if (!best) {
+		DBG(CACHE, blkid_debug("binary cache: %s=%s not found", type, value));
+		return NULL;
+	}
+
+	DBG(CACHE, blkid_debug("binary cache: %s=%s found on %s", type, value,
+				bincache_str(map, hdr, best->name)));
+	return bincache_new_dev(cache, map, hdr, best);
+}
@@ -20,6 +20,7 @@
 /* #define CONFIG_BLKID_VERIFY_UDEV 1 */
 
 #include <sys/types.h>
+#include <sys/time.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <stdio.h>
@@ -33,6 +34,24 @@
 #include "blkid.h"
 #include "list.h"
 
+/*
+ * Hash table used by cache to index devices by name and tags by NAME=value.
+ * The entries are embedded in the indexed structs.
+ */
+struct blkid_hash_entry {
+	struct list_head	list;		/* entries in the same bucket */
+	size_t			hashval;
+};
+
+#define BLKID_HASH_MINSIZE	64
+
+struct blkid_hash {
+	struct list_head	*buckets;
+	size_t			size;		/* number of buckets (power of 2) */
+	size_t			nents;		/* number of entries */
+	struct list_head	inline_buckets[BLKID_HASH_MINSIZE];
+};
+
 /*
  * This describes the attributes of a specific device.
  * We can traverse all of the tags by bid_tags (linking to the tag bit_names).
@@ -51,8 +70,10 @@ struct blkid_struct_dev
 	time_t			bid_time;	/* Last update time of device */
 	suseconds_t		bid_utime;	/* Last update time (microseconds) */
 	unsigned int		bid_flags;	/* Device status bitflags */
+	uint64_t		bid_sig;	/* Device content signature or 0 */
 	char			*bid_label;	/* Shortcut to device LABEL */
 	char			*bid_uuid;	/* Shortcut to binary UUID */
+	struct blkid_hash_entry	bid_hash;	/* Devices by name in the cache */
 };
 
 #define BLKID_BID_FL_VERIFIED	0x0001	/* Device data validated from disk */
@@ -73,6 +94,7 @@ struct blkid_struct_tag
 	char			*bit_name;	/* NAME of tag (shared) */
 	char			*bit_val;	/* value of tag */
 	blkid_dev		bit_dev;	/* pointer to device */
+	struct blkid_hash_entry	bit_hash;	/* Tags by NAME=value in the cache */
 };
 typedef struct blkid_struct_tag *blkid_tag;
 
@@ -87,6 +109,22 @@ enum {
 	BLKID_NCHAINS		/* number of chains */
 };
 
+/*
+ * Probing statistics, see blkid_probe_enable_stats()
+ */
+#define BLKID_NSTATS	(BLKID_STAT_SKIPPED + 1)
+
+struct blkid_prstat {
+	uint64_t	stats[BLKID_NSTATS];	/* BLKID_STAT_* counters */
+};
+
+/* saved state for blkid_probe_start_stat() and blkid_probe_stop_stat() */
+struct blkid_statctx {
+	struct blkid_prstat	*prev;		/* previous pr->cur_stat */
+	struct timeval		start;
+	int			active;		/* boolean */
+};
+
 struct blkid_chain {
 	const struct blkid_chaindrv *driver;	/* chain driver */
 
@@ -96,6 +134,7 @@ struct blkid_chain {
 	int		idx;		/* index of the current prober (or -1) */
 	unsigned long	*fltr;		/* filter or NULL */
 	void		*data;		/* private chain data or NULL */
+	struct blkid_prstat *stats;	/* per prober statistics + chain, or NULL */
 };
 
 /*
@@ -179,11 +218,46 @@ struct blkid_idinfo
 
 struct blkid_bufinfo {
 	unsigned char		*data;
-	blkid_loff_t		off;
+	blkid_loff_t		off;	/* offset within the pool */
 	blkid_loff_t		len;
 	struct list_head	bufs;	/* list of buffers */
 };
 
+/*
+ * Buffers shared by the probe, its clones and the whole-disk probe. The
+ * buffer offsets are absolute (from the begin of the device), the
+ * blkid_struct_probe->pool_off is the begin of the probed device in the pool
+ * (e.g. offset of the partition if the pool is shared with whole-disk probe).
+ */
+struct blkid_bufpool {
+	int			refcount;
+	struct list_head	buffers;	/* list of buffers */
+	struct blkid_bufinfo	**bufidx;	/* non-overlapping buffers sorted by offset */
+	size_t			nbufidx;	/* number of buffers in bufidx */
+	size_t			bufidx_max;	/* allocated size of bufidx */
+};
+
+/*
+ * The smallest read unit used by blkid_probe_get_buffer(), requests are
+ * aligned and rounded up to max(sector size, BLKID_PROBE_IOSIZE_MIN).
+ */
+#define BLKID_PROBE_IOSIZE_MIN	4096
+
+/*
+ * The end of the device is read by one request of this size, see
+ * get_readahead_area().
+ */
+#define BLKID_PROBE_TAILSZ	(512 * 1024)
+
+/*
+ * Area wiped by mkfs-like utils (e.g. pvcreate), see blkid_probe_set_wiper()
+ */
+struct blkid_wiper {
+	blkid_loff_t		off;		/* begin of the wiped area */
+	blkid_loff_t		size;		/* size of the wiped area */
+	struct blkid_chain	*chain;		/* superblock, partition, ... */
+};
+
 /*
  * Low-level probing control struct
  */
@@ -201,26 +275,46 @@ struct blkid_struct_probe
 	int			flags;		/* private libray flags */
 	int			prob_flags;	/* always zeroized by blkid_do_*() */
 
-	blkid_loff_t		wipe_off;	/* begin of the wiped area */
-	blkid_loff_t		wipe_size;	/* size of the wiped area */
-	struct blkid_chain	*wipe_chain;	/* superblock, partition, ... */
+	struct blkid_wiper	*wipers;	/* wiped areas sorted by offset */
+	size_t			nwipers;	/* number of used wipers[] */
+	size_t			wipers_max;	/* size of allocated wipers[] */
 
-	struct list_head	buffers;	/* list of buffers */
+	const unsigned char	*membuf;	/* caller's data, see blkid_probe_set_buffer() */
+	size_t			membufsz;	/* size of membuf */
+	blkid_probe_read_fn	read_fn;	/* reads data outside membuf */
+	void			*read_data;	/* read_fn() private data */
+
+	struct blkid_bufpool	*pool;		/* buffers or NULL */
+	blkid_loff_t		pool_off;	/* begin of the device in the pool */
 
 	struct blkid_chain	chains[BLKID_NCHAINS];	/* array of chains */
 	struct blkid_chain	*cur_chain;		/* current chain */
+	struct blkid_prstat	*cur_stat;		/* statistics for I/O or NULL */
 
 	struct blkid_prval	vals[BLKID_NVALS];	/* results */
 	int			nvals;		/* number of assigned vals */
 
+	blkid_probe_value_fn	value_fn;	/* results callback or NULL */
+	void			*value_data;	/* value_fn() private data */
+
 	struct blkid_struct_probe *parent;	/* for clones */
 	struct blkid_struct_probe *disk_probe;	/* whole-disk probing */
+	int			disk_refcount;	/* shared whole-disk probe only */
 };
 
+#ifdef HAVE_TLS
+#define THREAD_LOCAL static __thread
+#else
+#define THREAD_LOCAL static
+#endif
+
 /* private flags library flags */
 #define BLKID_FL_PRIVATE_FD	(1 << 1)	/* see blkid_new_probe_from_filename() */
 #define BLKID_FL_TINY_DEV	(1 << 2)	/* <= 1.47MiB (floppy or so) */
 #define BLKID_FL_CDROM_DEV	(1 << 3)	/* is a CD/DVD drive */
+#define BLKID_FL_PT_PARSED	(1 << 4)	/* whole-disk PT already parsed */
+#define BLKID_FL_PT_NONE	(1 << 5)	/* whole-disk without PT */
+#define BLKID_FL_PARALLEL	(1 << 6)	/* see blkid_probe_enable_parallel() */
 
 /* private per-probing flags */
 #define BLKID_PROBE_FL_IGNORE_PT (1 << 1)	/* ignore partition table */
@@ -228,8 +322,9 @@ struct blkid_struct_probe
 
 extern int blkid_probe_ignore_backup(blkid_probe pr);
 
-extern blkid_probe blkid_clone_probe(blkid_probe parent);
 extern blkid_probe blkid_probe_get_wholedisk_probe(blkid_probe pr);
+extern void blkid_probe_drop_wholedisk_probe(blkid_probe pr);
+extern void blkid_probe_finish_wholedisk_probe(blkid_probe disk);
 
 /*
  * Evaluation methods (for blkid_eval_* API)
@@ -249,6 +344,13 @@ struct blkid_config {
 	int nevals;			/* number of elems in eval array */
 	int uevent;			/* SEND_UEVENT=<yes|not> option */
 	char *cachefile;		/* CACHE_FILE=<path> option */
+
+	int refcount;			/* shared by blkid_read_config(NULL) */
+	char *filename;			/* the config file */
+	dev_t file_dev;			/* the file when parsed */
+	ino_t file_ino;
+	off_t file_size;
+	time_t file_mtime;
 };
 
 extern struct blkid_config *blkid_read_config(const char *filename)
@@ -284,10 +386,21 @@ struct blkid_struct_cache
 	unsigned int		bic_flags;	/* Status flags of the cache */
 	char			*bic_filename;	/* filename of cache */
 	blkid_probe		probe;		/* low-level probing stuff */
+
+	void			*bic_map;	/* mmap()ed binary cache file */
+	size_t			bic_mapsz;	/* size of the mapping */
+
+	struct blkid_hash	bic_devhash;	/* devices by name */
+	struct blkid_hash	bic_taghash;	/* tags by NAME=value */
+
+	int			bic_uevent_fd;	/* netlink socket or -1 */
+	int			bic_refcount;	/* references to the shared cache */
 };
 
 #define BLKID_BIC_FL_PROBED	0x0002	/* We probed /proc/partition devices */
 #define BLKID_BIC_FL_CHANGED	0x0004	/* Cache has changed from disk */
+#define BLKID_BIC_FL_UNPARSED	0x0008	/* Text cache file not parsed yet */
+#define BLKID_BIC_FL_SHARED	0x0010	/* blkid_get_shared_cache() */
 
 /* config file */
 #define BLKID_CONFIG_FILE	"/etc/blkid.conf"
@@ -373,6 +486,41 @@ extern void blkid__scan_dir(char *, dev_t, struct dir_list **, char **)
 extern int blkid_driver_has_major(const char *drvname, int major)
 			__attribute__((warn_unused_result));
 
+/* bincache.c */
+extern int blkid__write_bincache(blkid_cache cache, const char *filename)
+			__attribute__((nonnull));
+extern int blkid__open_bincache(blkid_cache cache)
+			__attribute__((nonnull));
+extern void blkid__close_bincache(blkid_cache cache)
+			__attribute__((nonnull));
+extern blkid_dev blkid__bincache_find_dev(blkid_cache cache,
+			const char *type, const char *value)
+			__attribute__((nonnull));
+
+/* cache.c */
+extern void blkid__hash_init(struct blkid_hash *h)
+			__attribute__((nonnull));
+extern void blkid__hash_free(struct blkid_hash *h)
+			__attribute__((nonnull));
+extern void blkid__hash_add(struct blkid_hash *h, struct blkid_hash_entry *e,
+			size_t hashval)
+			__attribute__((nonnull));
+extern void blkid__hash_del(struct blkid_hash *h, struct blkid_hash_entry *e)
+			__attribute__((nonnull));
+extern size_t blkid__hash_string(const char *str, size_t seed)
+			__attribute__((nonnull));
+extern struct list_head *blkid__hash_bucket(struct blkid_hash *h,
+			size_t hashval)
+			__attribute__((nonnull));
+
+#define blkid__hash_tag(name, value) \
+	blkid__hash_string(value, blkid__hash_string(name, 0))
+
+extern void blkid__cache_add_dev(blkid_cache cache, blkid_dev dev)
+			__attribute__((nonnull));
+extern blkid_dev blkid__cache_find_dev(blkid_cache cache, const char *devname)
+			__attribute__((nonnull));
+
 /* lseek.c */
 extern blkid_loff_t blkid_llseek(int fd, blkid_loff_t offset, int whence);
 
@@ -384,6 +532,28 @@ extern void blkid_read_cache(blkid_cache cache)
 extern int blkid_flush_cache(blkid_cache cache)
 			__attribute__((nonnull));
 
+/* devname.c */
+extern void blkid__probe_devno(blkid_cache cache, const char *ptname, dev_t devno)
+			__attribute__((nonnull));
+
+/* uevent.c */
+extern void blkid__close_uevents(blkid_cache cache)
+			__attribute__((nonnull));
+
+/* verify.c */
+extern int blkid__verify_needed(blkid_dev dev, struct stat *st)
+			__attribute__((nonnull));
+extern int blkid__probe_dev(blkid_probe pr, const char *devname, uint64_t *sig)
+			__attribute__((nonnull));
+extern void blkid__probe_dev_touch(blkid_cache cache, blkid_dev dev,
+			struct stat *st, uint64_t sig)
+			__attribute__((nonnull));
+extern void blkid__probe_dev_done(blkid_probe pr)
+			__attribute__((nonnull));
+extern void blkid__probe_dev_apply(blkid_cache cache, blkid_dev dev,
+			blkid_probe pr, struct stat *st, uint64_t sig)
+			__attribute__((nonnull));
+
 /* cache */
 extern char *blkid_safe_getenv(const char *arg)
 			__attribute__((nonnull))
@@ -418,6 +588,13 @@ extern int blkid_probe_is_cdrom(blkid_probe pr)
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
 
+extern void blkid_probe_start_stat(blkid_probe pr, struct blkid_chain *chn,
+				size_t idx, struct blkid_statctx *sc);
+extern void blkid_probe_stop_stat(blkid_probe pr, struct blkid_statctx *sc);
+extern void blkid_probe_skip_stat(struct blkid_chain *chn, size_t idx);
+
+extern void blkid_probe_prefetch_area(blkid_probe pr,
+				blkid_loff_t off, blkid_loff_t len);
 extern unsigned char *blkid_probe_get_buffer(blkid_probe pr,
                                 blkid_loff_t off, blkid_loff_t len)
 			__attribute__((nonnull))
@@ -21,9 +21,24 @@
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 #include "blkidP.h"
 #include "env.h"
 
+/* the process-wide cache, see blkid_get_shared_cache() */
+static blkid_cache shared_cache;
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+# define lock_shared()		pthread_mutex_lock(&shared_lock)
+# define unlock_shared()	pthread_mutex_unlock(&shared_lock)
+#else
+# define lock_shared()
+# define unlock_shared()
+#endif
+
 /**
  * SECTION:cache
  * @title: Cache
@@ -73,8 +88,8 @@ char *blkid_get_cache_filename(struct blkid_config *conf)
 		if (!c)
 			filename = strdup(get_default_cache_filename());
 		else {
-			filename = c->cachefile;  /* already allocated */
-			c->cachefile = NULL;
+			/* the config is shared, don't modify it */
+			filename = c->cachefile ? strdup(c->cachefile) : NULL;
 			blkid_free_config(c);
 		}
 	}
@@ -107,6 +122,9 @@ int blkid_get_cache(blkid_cache *ret_cache, const char *filename)
 
 	INIT_LIST_HEAD(&cache->bic_devs);
 	INIT_LIST_HEAD(&cache->bic_tags);
+	blkid__hash_init(&cache->bic_devhash);
+	blkid__hash_init(&cache->bic_taghash);
+	cache->bic_uevent_fd = -1;
 
 	if (filename && !*filename)
 		filename = NULL;
@@ -115,23 +133,121 @@ int blkid_get_cache(blkid_cache *ret_cache, const char *filename)
 	else
 		cache->bic_filename = blkid_get_cache_filename(NULL);
 
-	blkid_read_cache(cache);
+	/* use the binary cache if possible, the text file is parsed on demand */
+	if (!cache->bic_filename || blkid__open_bincache(cache) != 0)
+		blkid_read_cache(cache);
 	*ret_cache = cache;
 	return 0;
 }
 
+/* returns 1 if the shared cache still matches the cache file */
+static int is_shared_cache_valid(blkid_cache cache, const char *filename)
+{
+	struct stat st;
+
+	if (!filename || !cache->bic_filename)
+		return filename == cache->bic_filename;
+	if (strcmp(filename, cache->bic_filename) != 0)
+		return 0;
+	if (cache->bic_flags & BLKID_BIC_FL_CHANGED)
+		return 1;		/* don't lose unsaved changes */
+	if (stat(filename, &st) != 0)
+		return cache->bic_ftime == 0;
+
+	return st.st_mtime == cache->bic_ftime;
+}
+
+static void free_cache(blkid_cache cache);
+
+/**
+ * blkid_get_shared_cache:
+ * @cache: pointer to return cache handler
+ *
+ * Returns the default cache shared by all callers in the process. The cache
+ * and the config file are parsed only once, the cache is read again (for the
+ * next callers) when the config or the cache file has been modified by
+ * another process. It's recommended for daemons and other long-running
+ * processes which evaluate tags repeatedly.
+ *
+ * Use blkid_put_cache() to release the cache. The handler may be used by
+ * more threads, but the calls for the same handler have to be serialized.
+ *
+ * Returns: 0 on success or number less than zero in case of error.
+ */
+int blkid_get_shared_cache(blkid_cache *ret_cache)
+{
+	blkid_cache cache, old = NULL;
+	char *filename;
+	int rc = 0;
+
+	if (!ret_cache)
+		return -BLKID_ERR_PARAM;
+
+	blkid_init_debug(0);
+	filename = blkid_get_cache_filename(NULL);
+
+	lock_shared();
+	if (shared_cache && !is_shared_cache_valid(shared_cache, filename)) {
+		DBG(CACHE, blkid_debug("shared cache: %s modified, re-reading",
+					filename ? filename : "default cache"));
+		old = shared_cache;
+		shared_cache = NULL;
+		if (--old->bic_refcount > 0)
+			old = NULL;		/* still used */
+	}
+	if (!shared_cache) {
+		rc = blkid_get_cache(&cache, filename);
+		if (rc == 0) {
+			cache->bic_flags |= BLKID_BIC_FL_SHARED;
+			cache->bic_refcount = 1;	/* the library reference */
+			shared_cache = cache;
+		}
+	}
+	if (shared_cache) {
+		shared_cache->bic_refcount++;
+		*ret_cache = shared_cache;
+	}
+	unlock_shared();
+
+	free_cache(old);
+	free(filename);
+	return rc;
+}
+
 /**
  * blkid_put_cache:
  * @cache: cache handler
  *
- * Saves changes to cache file.
+ * Saves changes to cache file. The cache from blkid_get_shared_cache() is
+ * deallocated after the last reference.
  */
 void blkid_put_cache(blkid_cache cache)
+{
+	if (!cache)
+		return;
+
+	if (cache->bic_flags & BLKID_BIC_FL_SHARED) {
+		int refs;
+
+		lock_shared();
+		refs = --cache->bic_refcount;
+		if (refs > 0)
+			(void) blkid_flush_cache(cache);
+		unlock_shared();
+		if (refs > 0)
+			return;
+	}
+	free_cache(cache);
+}
+
+static void free_cache(blkid_cache cache)
 {
 	if (!cache)
 		return;
 
 	(void) blkid_flush_cache(cache);
+	blkid__close_bincache(cache);
+	blkid__close_uevents(cache);
 
 	DBG(CACHE, blkid_debug("freeing cache struct"));
 
@@ -163,6 +279,8 @@ void blkid_put_cache(blkid_cache cache)
 
 	blkid_free_probe(cache->probe);
 
+	blkid__hash_free(&cache->bic_devhash);
+	blkid__hash_free(&cache->bic_taghash);
 	free(cache->bic_filename);
 	free(cache);
 }
@@ -181,6 +299,9 @@ void blkid_gc_cache(blkid_cache cache)
 	if (!cache)
 		return;
 
+	if (cache->bic_flags & BLKID_BIC_FL_UNPARSED)
+		blkid_read_cache(cache);
+
 	list_for_each_safe(p, pnext, &cache->bic_devs) {
 		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
 		if (stat(dev->bid_name, &st) < 0) {
@@ -193,6 +314,119 @@ void blkid_gc_cache(blkid_cache cache)
 	}
 }
 
+/*
+ * Hash tables to index devices and tags in the cache. The tables never
+ * shrink, and if allocation of the larger table fails then the old table is
+ * used (the chains are only longer).
+ */
+void blkid__hash_init(struct blkid_hash *h)
+{
+	size_t i;
+
+	h->buckets = h->inline_buckets;
+	h->size = BLKID_HASH_MINSIZE;
+	h->nents = 0;
+
+	for (i = 0; i < h->size; i++)
+		INIT_LIST_HEAD(&h->buckets[i]);
+}
+
+void blkid__hash_free(struct blkid_hash *h)
+{
+	if (h->buckets != h->inline_buckets)
+		free(h->buckets);
+	h->buckets = NULL;
+	h->size = h->nents = 0;
+}
+
+size_t blkid__hash_string(const char *str, size_t seed)
+{
+	size_t h = seed ? seed : 5381;
+
+	while (*str)
+		h = (h << 5) + h + (unsigned char) *str++;
+	return h;
+}
+
+struct list_head *blkid__hash_bucket(struct blkid_hash *h, size_t hashval)
+{
+	return &h->buckets[hashval & (h->size - 1)];
+}
+
+static void hash_resize(struct blkid_hash *h, size_t size)
+{
+	struct list_head *buckets;
+	size_t i;
+
+	buckets = malloc(size * sizeof(struct list_head));
+	if (!buckets)
+		return;
+	for (i = 0; i < size; i++)
+		INIT_LIST_HEAD(&buckets[i]);
+
+	for (i = 0; i < h->size; i++) {
+		while (!list_empty(&h->buckets[i])) {
+			struct blkid_hash_entry *e = list_entry(h->buckets[i].next,
+						struct blkid_hash_entry, list);
+			list_del(&e->list);
+			list_add_tail(&e->list, &buckets[e->hashval & (size - 1)]);
+		}
+	}
+
+	if (h->buckets != h->inline_buckets)
+		free(h->buckets);
+	h->buckets = buckets;
+	h->size = size;
+}
+
+void blkid__hash_add(struct blkid_hash *h, struct blkid_hash_entry *e,
+		     size_t hashval)
+{
+	if (h->nents >= h->size)
+		hash_resize(h, h->size << 1);
+
+	e->hashval = hashval;
+	list_add_tail(&e->list, blkid__hash_bucket(h, hashval));
+	h->nents++;
+}
+
+void blkid__hash_del(struct blkid_hash *h, struct blkid_hash_entry *e)
+{
+	if (list_empty(&e->list))
+		return;		/* not hashed */
+	list_del_init(&e->list);
+	h->nents--;
+}
+
+/*
+ * Adds a new device to the cache, the device name has to be already defined.
+ */
+void blkid__cache_add_dev(blkid_cache cache, blkid_dev dev)
+{
+	dev->bid_cache = cache;
+	list_add_tail(&dev->bid_devs, &cache->bic_devs);
+	blkid__hash_add(&cache->bic_devhash, &dev->bid_hash,
+			blkid__hash_string(dev->bid_name, 0));
+}
+
+blkid_dev blkid__cache_find_dev(blkid_cache cache, const char *devname)
+{
+	struct list_head *p, *bucket;
+	size_t hv = blkid__hash_string(devname, 0);
+
+	bucket = blkid__hash_bucket(&cache->bic_devhash, hv);
+
+	list_for_each(p, bucket) {
+		struct blkid_hash_entry *e = list_entry(p,
+					struct blkid_hash_entry, list);
+		blkid_dev dev = list_entry(e, struct blkid_struct_dev, bid_hash);
+
+		if (e->hashval == hv && strcmp(dev->bid_name, devname) == 0)
+			return dev;
+	}
+	return NULL;
+}
+
 #ifdef TEST_PROGRAM
 int main(int argc, char** argv)
 {
@@ -23,9 +23,25 @@
 #include <stdint.h>
 #include <stdarg.h>
 
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
 #include "blkidP.h"
 #include "env.h"
 
+/* the default config file, see blkid_read_config() */
+static struct blkid_config *shared_conf;
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+# define lock_config()		pthread_mutex_lock(&config_lock)
+# define unlock_config()	pthread_mutex_unlock(&config_lock)
+#else
+# define lock_config()
+# define unlock_config()
+#endif
+
 static int parse_evaluate(struct blkid_config *conf, char *s)
 {
 	while(s && *s) {
@@ -110,20 +126,20 @@ static int parse_next(FILE *fd, struct blkid_config *conf)
 }
 
 /* return real config data or built-in default */
-struct blkid_config *blkid_read_config(const char *filename)
+static struct blkid_config *parse_config(const char *filename)
 {
 	struct blkid_config *conf;
-	FILE *f;
-
-	if (!filename)
-		filename = safe_getenv("BLKID_CONF");
-	if (!filename)
-		filename = BLKID_CONFIG_FILE;
+	struct stat st;
+	FILE *f = NULL;
 
 	conf = (struct blkid_config *) calloc(1, sizeof(*conf));
 	if (!conf)
 		return NULL;
 	conf->uevent = -1;
+	conf->refcount = 1;
+	conf->filename = strdup(filename);
+	if (!conf->filename)
+		goto err;
 
 	DBG(CONFIG, blkid_debug("reading config file: %s.", filename));
 
@@ -132,6 +148,12 @@ struct blkid_config *blkid_read_config(const char *filename)
 		DBG(CONFIG, blkid_debug("%s: does not exist, using built-in default", filename));
 		goto dflt;
 	}
+	if (fstat(fileno(f), &st) == 0) {
+		conf->file_dev = st.st_dev;
+		conf->file_ino = st.st_ino;
+		conf->file_size = st.st_size;
+		conf->file_mtime = st.st_mtime;
+	}
 	while (!feof(f)) {
 		if (parse_next(f, conf)) {
 			DBG(CONFIG, blkid_debug("%s: parse error", filename));
@@ -152,19 +174,84 @@ dflt:
 		fclose(f);
 	return conf;
 err:
+	free(conf->cachefile);
+	free(conf->filename);
 	free(conf);
-	fclose(f);
+	if (f)
+		fclose(f);
 	return NULL;
 }
 
-void blkid_free_config(struct blkid_config *conf)
+/* returns 1 if the file has not been modified since @conf has been parsed */
+static int is_config_valid(struct blkid_config *conf, const char *filename)
 {
-	if (!conf)
+	struct stat st;
+
+	if (strcmp(conf->filename, filename) != 0)
+		return 0;
+	if (stat(filename, &st) != 0)
+		return conf->file_ino == 0;	/* still does not exist */
+
+	return conf->file_dev == st.st_dev &&
+	       conf->file_ino == st.st_ino &&
+	       conf->file_size == st.st_size &&
+	       conf->file_mtime == st.st_mtime;
+}
+
+static void unref_config(struct blkid_config *conf)
+{
+	conf->refcount--;
+	if (conf->refcount > 0)
 		return;
 	free(conf->cachefile);
+	free(conf->filename);
 	free(conf);
 }
 
+/*
+ * The default config file (@filename is NULL) is parsed only once for all
+ * threads, the file is parsed again when modified. The returned config is
+ * read-only, use blkid_free_config() to release it.
+ */
+struct blkid_config *blkid_read_config(const char *filename)
+{
+	struct blkid_config *conf;
+
+	if (filename)
+		return parse_config(filename);
+
+	filename = safe_getenv("BLKID_CONF");
+	if (!filename)
+		filename = BLKID_CONFIG_FILE;
+
+	lock_config();
+	if (shared_conf && !is_config_valid(shared_conf, filename)) {
+		DBG(CONFIG, blkid_debug("%s: modified, dropping cached config", filename));
+		unref_config(shared_conf);
+		shared_conf = NULL;
+	}
+	if (!shared_conf)
+		shared_conf = parse_config(filename);
+	else
+		DBG(CONFIG, blkid_debug("%s: using cached config", filename));
+
+	conf = shared_conf;
+	if (conf)
+		conf->refcount++;
+	unlock_config();
+
+	return conf;
+}
+
+void blkid_free_config(struct blkid_config *conf)
+{
+	if (!conf)
+		return;
+	lock_config();
+	unref_config(conf);
+	unlock_config();
+}
+
 #ifdef TEST_PROGRAM
 /*
  * usage: tst_config [<filename>]
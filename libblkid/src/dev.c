@@ -39,6 +39,7 @@ blkid_dev blkid_new_dev(void)
 
 	INIT_LIST_HEAD(&dev->bid_devs);
 	INIT_LIST_HEAD(&dev->bid_tags);
+	INIT_LIST_HEAD(&dev->bid_hash.list);
 
 	return dev;
 }
@@ -54,6 +55,8 @@ void blkid_free_dev(blkid_dev dev)
 	DBG(DEV, blkid_debug_dump_dev(dev));
 
 	list_del(&dev->bid_devs);
+	if (dev->bid_cache)
+		blkid__hash_del(&dev->bid_cache->bic_devhash, &dev->bid_hash);
 	while (!list_empty(&dev->bid_tags)) {
 		blkid_tag tag = list_entry(dev->bid_tags.next,
 					   struct blkid_struct_tag,
@@ -133,6 +136,9 @@ blkid_dev_iterate blkid_dev_iterate_begin(blkid_cache cache)
 		return NULL;
 	}
 
+	if (cache->bic_flags & BLKID_BIC_FL_UNPARSED)
+		blkid_read_cache(cache);
+
 	iter = malloc(sizeof(struct blkid_struct_dev_iterate));
 	if (iter) {
 		iter->magic = DEV_ITERATE_MAGIC;
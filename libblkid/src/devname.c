@@ -33,6 +33,9 @@
 #include <errno.h>
 #endif
 #include <time.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "blkidP.h"
 
@@ -49,21 +52,18 @@
  */
 blkid_dev blkid_get_dev(blkid_cache cache, const char *devname, int flags)
 {
-	blkid_dev dev = NULL, tmp;
+	blkid_dev dev = NULL;
 	struct list_head *p, *pnext;
 
 	if (!cache || !devname)
 		return NULL;
 
-	list_for_each(p, &cache->bic_devs) {
-		tmp = list_entry(p, struct blkid_struct_dev, bid_devs);
-		if (strcmp(tmp->bid_name, devname))
-			continue;
+	if (cache->bic_flags & BLKID_BIC_FL_UNPARSED)
+		blkid_read_cache(cache);
 
-		DBG(DEVNAME, blkid_debug("found devname %s in cache", tmp->bid_name));
-		dev = tmp;
-		break;
-	}
+	dev = blkid__cache_find_dev(cache, devname);
+	if (dev)
+		DBG(DEVNAME, blkid_debug("found devname %s in cache", dev->bid_name));
 
 	if (!dev && (flags & BLKID_DEV_CREATE)) {
 		if (access(devname, F_OK) < 0)
@@ -73,8 +73,11 @@ blkid_dev blkid_get_dev(blkid_cache cache, const char *devname, int flags)
 			return NULL;
 		dev->bid_time = INT_MIN;
 		dev->bid_name = strdup(devname);
-		dev->bid_cache = cache;
-		list_add_tail(&dev->bid_devs, &cache->bic_devs);
+		if (!dev->bid_name) {
+			blkid_free_dev(dev);
+			return NULL;
+		}
+		blkid__cache_add_dev(cache, dev);
 		cache->bic_flags |= BLKID_BIC_FL_CHANGED;
 	}
 
@@ -150,6 +153,21 @@ static int is_dm_leaf(const char *devname)
 	return ret;
 }
 
+static void set_dev_pri(blkid_dev dev, const char *ptname,
+			int pri, int removable)
+{
+	if (pri)
+		dev->bid_pri = pri;
+	else if (!strncmp(dev->bid_name, "/dev/mapper/", 11)) {
+		dev->bid_pri = BLKID_PRI_DM;
+		if (is_dm_leaf(ptname))
+			dev->bid_pri += 5;
+	} else if (!strncmp(ptname, "md", 2))
+		dev->bid_pri = BLKID_PRI_MD;
+	if (removable)
+		dev->bid_flags |= BLKID_BID_FL_REMOVABLE;
+}
+
 /*
  * Probe a single block device to add to the device cache.
  */
@@ -225,19 +243,17 @@ get_dev:
 	free(devname);
 
 set_pri:
-	if (dev) {
-		if (pri)
-			dev->bid_pri = pri;
-		else if (!strncmp(dev->bid_name, "/dev/mapper/", 11)) {
-			dev->bid_pri = BLKID_PRI_DM;
-			if (is_dm_leaf(ptname))
-				dev->bid_pri += 5;
-		} else if (!strncmp(ptname, "md", 2))
-			dev->bid_pri = BLKID_PRI_MD;
-		if (removable)
-			dev->bid_flags |= BLKID_BID_FL_REMOVABLE;
-	}
-	return;
+	if (dev)
+		set_dev_pri(dev, ptname, pri, removable);
+}
+
+/*
+ * Probes (or re-verifies) the device @devno, the @ptname is the kernel name
+ * of the device (e.g. "sda1"), see uevent.c.
+ */
+void blkid__probe_devno(blkid_cache cache, const char *ptname, dev_t devno)
+{
+	probe_one(cache, ptname, devno, 0, 0, 0);
 }
 
 #define PROC_PARTITIONS "/proc/partitions"
@@ -412,10 +428,257 @@ ubi_probe_all(blkid_cache cache, int only_if_new)
 	}
 }
 
+/*
+ * Parallel probing -- probe_all() adds devices from /proc/partitions to the
+ * queue and the queue is processed by more threads. The threads share the
+ * cache (protected by the queue lock), but every thread uses a private
+ * blkid_probe and the devices are read without the lock.
+ */
+struct probe_job {
+	char		ptname[128 + 1];
+	dev_t		devno;
+	blkid_dev	dev;		/* newly added device */
+};
+
+struct probe_queue {
+	blkid_cache		cache;
+	struct probe_job	*jobs;
+	size_t			njobs;
+	size_t			nalloc;
+	size_t			next;		/* the first unprocessed job */
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_t		lock;
+#endif
+};
+
+static inline void queue_lock(struct probe_queue *q __attribute__((__unused__)))
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_lock(&q->lock);
+#endif
+}
+
+static inline void queue_unlock(struct probe_queue *q __attribute__((__unused__)))
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_unlock(&q->lock);
+#endif
+}
+
+static int queue_add(struct probe_queue *q, const char *ptname, dev_t devno)
+{
+	struct probe_job *job;
+
+	if (q->njobs == q->nalloc) {
+		size_t n = q->nalloc ? q->nalloc * 2 : 64;
+
+		job = realloc(q->jobs, n * sizeof(struct probe_job));
+		if (!job)
+			return -ENOMEM;
+		q->jobs = job;
+		q->nalloc = n;
+	}
+
+	job = &q->jobs[q->njobs++];
+	memset(job, 0, sizeof(*job));
+	strncpy(job->ptname, ptname, sizeof(job->ptname) - 1);
+	job->devno = devno;
+
+	DBG(DEVNAME, blkid_debug("queued %s, devno 0x%04X",
+				ptname, (unsigned int) devno));
+	return 0;
+}
+
+/*
+ * Translates /proc/partitions name to the device path, the same as
+ * probe_one() but without the cache.
+ */
+static char *ptname_to_devname(const char *ptname, dev_t devno)
+{
+	const char **dir;
+	char *devname = NULL;
+
+	if (!strncmp(ptname, "dm-", 3) && isdigit(ptname[3])) {
+		devname = canonicalize_dm_name(ptname);
+		if (!devname)
+			blkid__scan_dir("/dev/mapper", devno, 0, &devname);
+		if (devname)
+			return devname;
+	}
+
+	for (dir = dirlist; *dir; dir++) {
+		struct stat st;
+		char device[256];
+
+		snprintf(device, sizeof(device), "%s/%s", *dir, ptname);
+		if (stat(device, &st) == 0 && S_ISBLK(st.st_mode) &&
+		    st.st_rdev == devno)
+			return strdup(device);
+	}
+
+	blkid__scan_dir("/dev/mapper", devno, 0, &devname);
+	if (!devname)
+		devname = blkid_devno_to_devname(devno);
+	return devname;
+}
+
+static void probe_job(struct probe_queue *q, struct probe_job *job,
+		      blkid_probe pr)
+{
+	blkid_cache cache = q->cache;
+	blkid_dev dev;
+	struct list_head *p;
+	struct stat st;
+	char *devname = NULL;
+	uint64_t sig = 0;
+	int rc, need;
+
+	/* the device is already in the cache */
+	queue_lock(q);
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev tmp = list_entry(p, struct blkid_struct_dev, bid_devs);
+		if (tmp->bid_devno == job->devno) {
+			devname = strdup(tmp->bid_name);
+			break;
+		}
+	}
+	queue_unlock(q);
+
+	if (devname && (stat(devname, &st) != 0 || st.st_rdev != job->devno)) {
+		free(devname);
+		devname = NULL;
+	}
+	if (!devname) {
+		devname = ptname_to_devname(job->ptname, job->devno);
+		if (!devname || stat(devname, &st) != 0) {
+			free(devname);
+			return;
+		}
+	}
+
+	queue_lock(q);
+	dev = blkid_get_dev(cache, devname, BLKID_DEV_FIND);
+	if (!dev) {
+		dev = blkid_get_dev(cache, devname, BLKID_DEV_CREATE);
+		job->dev = dev;
+	}
+	need = dev ? blkid__verify_needed(dev, &st) : 0;
+	if (need) {
+		sig = dev->bid_sig;
+		blkid_probe_set_superblocks_hint(pr, dev->bid_type);
+	}
+	queue_unlock(q);
+
+	if (!dev)
+		goto done;
+
+	rc = need ? blkid__probe_dev(pr, devname, &sig) : 0;
+
+	queue_lock(q);
+	if (need && rc == 2)
+		blkid__probe_dev_touch(cache, dev, &st, sig);
+	else if (need && rc == 0)
+		blkid__probe_dev_apply(cache, dev, pr, &st, sig);
+	else if (need && !(rc == -1 &&
+		 (errno == EPERM || errno == EACCES || errno == ENOENT))) {
+		/* found nothing, or error */
+		blkid_free_dev(dev);
+		dev = job->dev = NULL;
+	}
+	if (dev)
+		set_dev_pri(dev, job->ptname, 0, 0);
+	queue_unlock(q);
+
+	if (need)
+		blkid__probe_dev_done(pr);
+done:
+	free(devname);
+}
+
+static void *probe_worker(void *data)
+{
+	struct probe_queue *q = (struct probe_queue *) data;
+	blkid_probe pr = blkid_new_probe();
+
+	if (!pr)
+		return NULL;
+
+	for (;;) {
+		struct probe_job *job = NULL;
+
+		queue_lock(q);
+		if (q->next < q->njobs)
+			job = &q->jobs[q->next++];
+		queue_unlock(q);
+
+		if (!job)
+			break;
+		probe_job(q, job, pr);
+	}
+
+	blkid_free_probe(pr);
+	return NULL;
+}
+
+static void queue_run(struct probe_queue *q, int nthreads)
+{
+	size_t i;
+#ifdef HAVE_LIBPTHREAD
+	pthread_t *threads = NULL;
+	int n = 0;
+
+	if (nthreads <= 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpus > 0 ? ncpus : 1;
+	}
+	if ((size_t) nthreads > q->njobs)
+		nthreads = q->njobs;
+	if (nthreads > 1)
+		threads = calloc(nthreads, sizeof(pthread_t));
+	if (threads) {
+		DBG(DEVNAME, blkid_debug("probing %zu devices by %d threads",
+					q->njobs, nthreads));
+		for (n = 0; n < nthreads; n++) {
+			if (pthread_create(&threads[n], NULL, probe_worker, q))
+				break;
+		}
+	}
+	/* if we have no thread, probe in the current thread */
+	if (n == 0)
+		probe_worker(q);
+	while (n > 0)
+		pthread_join(threads[--n], NULL);
+	free(threads);
+#else
+	(void) nthreads;
+	probe_worker(q);
+#endif
+	/* keep the newly added devices in the /proc/partitions order */
+	for (i = 0; i < q->njobs; i++) {
+		blkid_dev dev = q->jobs[i].dev;
+
+		if (dev) {
+			list_del(&dev->bid_devs);
+			list_add_tail(&dev->bid_devs, &q->cache->bic_devs);
+		}
+	}
+}
+
+static void probe_or_queue(blkid_cache cache, struct probe_queue *q,
+			   const char *ptname, dev_t devno, int only_if_new)
+{
+	if (!q || queue_add(q, ptname, devno) != 0)
+		probe_one(cache, ptname, devno, 0, only_if_new, 0);
+}
+
 /*
  * Read the device data for all available block devices in the system.
+ *
+ * If @q is not NULL then devices from /proc/partitions are not probed, but
+ * added to the queue and probed by @nthreads threads.
  */
-static int probe_all(blkid_cache cache, int only_if_new)
+static int probe_all(blkid_cache cache, int only_if_new,
+		     struct probe_queue *q, int nthreads)
 {
 	FILE *proc;
 	char line[1024];
@@ -481,8 +744,8 @@ static int probe_all(blkid_cache cache, int only_if_new)
 				   ptname, (unsigned int) devs[which]));
 
 			if (sz > 1)
-				probe_one(cache, ptname, devs[which], 0,
-					  only_if_new, 0);
+				probe_or_queue(cache, q, ptname, devs[which],
+					  only_if_new);
 			lens[which] = 0;	/* mark as checked */
 		}
 
@@ -516,17 +779,21 @@ static int probe_all(blkid_cache cache, int only_if_new)
 		if (lens[last] && strncmp(ptnames[last], ptname, lens[last])) {
 			DBG(DEVNAME, blkid_debug("whole dev %s, devno 0x%04X",
 				   ptnames[last], (unsigned int) devs[last]));
-			probe_one(cache, ptnames[last], devs[last], 0,
-				  only_if_new, 0);
+			probe_or_queue(cache, q, ptnames[last], devs[last],
+				  only_if_new);
 			lens[last] = 0;
 		}
 	}
 
 	/* Handle the last device if it wasn't partitioned */
 	if (lens[which])
-		probe_one(cache, ptname, devs[which], 0, only_if_new, 0);
+		probe_or_queue(cache, q, ptname, devs[which], only_if_new);
 
 	fclose(proc);
+
+	if (q && q->njobs)
+		queue_run(q, nthreads);
+
 	blkid_flush_cache(cache);
 	return 0;
 }
@@ -591,7 +858,7 @@ int blkid_probe_all(blkid_cache cache)
 	int ret;
 
 	DBG(PROBE, blkid_debug("Begin blkid_probe_all()"));
-	ret = probe_all(cache, 0);
+	ret = probe_all(cache, 0, NULL, 0);
 	if (ret == 0) {
 		cache->bic_time = time(0);
 		cache->bic_flags |= BLKID_BIC_FL_PROBED;
@@ -600,6 +867,47 @@ int blkid_probe_all(blkid_cache cache)
 	return ret;
 }
 
+/**
+ * blkid_probe_all_parallel:
+ * @cache: cache handler
+ * @nthreads: number of threads or zero (number of online CPUs)
+ *
+ * The same as blkid_probe_all(), but the block devices from /proc/partitions
+ * are probed by @nthreads threads. It's useful on systems with many slow
+ * devices (e.g. SAN LUNs). The @cache must not be used by another thread
+ * until the function returns.
+ *
+ * If the library has been compiled without threads support then the devices
+ * are probed serially.
+ *
+ * Returns: 0 on success, or number less than zero in case of error.
+ */
+int blkid_probe_all_parallel(blkid_cache cache, int nthreads)
+{
+	struct probe_queue q;
+	int ret;
+
+	DBG(PROBE, blkid_debug("Begin blkid_probe_all_parallel()"));
+
+	memset(&q, 0, sizeof(q));
+	q.cache = cache;
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_init(&q.lock, NULL);
+#endif
+	ret = probe_all(cache, 0, &q, nthreads);
+	if (ret == 0) {
+		cache->bic_time = time(0);
+		cache->bic_flags |= BLKID_BIC_FL_PROBED;
+	}
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_destroy(&q.lock);
+#endif
+	free(q.jobs);
+
+	DBG(PROBE, blkid_debug("End blkid_probe_all_parallel() [rc=%d]", ret));
+	return ret;
+}
+
 /**
  * blkid_probe_all_new:
  * @cache: cache handler
@@ -613,7 +921,7 @@ int blkid_probe_all_new(blkid_cache cache)
 	int ret;
 
 	DBG(PROBE, blkid_debug("Begin blkid_probe_all_new()"));
-	ret = probe_all(cache, 1);
+	ret = probe_all(cache, 1, NULL, 0);
 	DBG(PROBE, blkid_debug("End blkid_probe_all_new() [rc=%d]", ret));
 	return ret;
 }
@@ -214,12 +214,64 @@ static char *scandev_devno_to_devpath(dev_t devno)
 	return devname;
 }
 
+/*
+ * The last resolved devno to devname conversions. The /dev scan is expensive
+ * on systems with large /dev, so the result is remembered. The entry is
+ * verified by stat() before use, the device node may be removed or reused.
+ */
+#define DEVNO_MEMO_NENTS	8
+
+struct devno_memo {
+	dev_t	devno;
+	char	name[128];
+};
+
+THREAD_LOCAL struct devno_memo devno_memo[DEVNO_MEMO_NENTS];
+THREAD_LOCAL size_t devno_memo_next;
+
+static char *devno_memo_get(dev_t devno)
+{
+	struct stat st;
+	size_t i;
+
+	for (i = 0; i < DEVNO_MEMO_NENTS; i++) {
+		struct devno_memo *m = &devno_memo[i];
+
+		if (!*m->name || m->devno != devno)
+			continue;
+		if (stat(m->name, &st) == 0 && S_ISBLK(st.st_mode)
+		    && st.st_rdev == devno)
+			return strdup(m->name);
+
+		*m->name = '\0';	/* obsolete */
+		break;
+	}
+	return NULL;
+}
+
+static void devno_memo_add(dev_t devno, const char *name)
+{
+	struct devno_memo *m;
+	size_t sz = strlen(name);
+
+	if (sz + 1 > sizeof(m->name))
+		return;
+
+	m = &devno_memo[devno_memo_next];
+	devno_memo_next = (devno_memo_next + 1) % DEVNO_MEMO_NENTS;
+
+	m->devno = devno;
+	memcpy(m->name, name, sz + 1);
+}
+
 /**
  * blkid_devno_to_devname:
  * @devno: device number
  *
  * This function finds the pathname to a block device with a given
- * device number.
+ * device number. The name is read from sysfs (uevent DEVNAME=), the
+ * /dev is scanned only if sysfs is not available. The last results are
+ * cached.
  *
  * Returns: a pointer to allocated memory to the pathname on success,
  * and NULL on failure.
@@ -229,6 +281,13 @@ char *blkid_devno_to_devname(dev_t devno)
 	char *path = NULL;
 	char buf[PATH_MAX];
 
+	path = devno_memo_get(devno);
+	if (path) {
+		DBG(DEVNO, blkid_debug("found devno 0x%04llx as %s (cached)",
+					(long long)devno, path));
+		return path;
+	}
+
 	path = sysfs_devno_to_devpath(devno, buf, sizeof(buf));
 	if (path)
 		path = strdup(path);
@@ -240,6 +299,7 @@ char *blkid_devno_to_devname(dev_t devno)
 			   (unsigned long) devno));
 	} else {
 		DBG(DEVNO, blkid_debug("found devno 0x%04llx as %s", (long long)devno, path));
+		devno_memo_add(devno, path);
 	}
 
 	return path;
@@ -179,13 +179,26 @@ static int replace_whitespace(const char *str, char *to, size_t len)
 	return 0;
 }
 
-static int is_whitelisted(char c, const char *white)
+/* [0-9A-Za-z#+-.:=@_] without strchr(), it's called for every char */
+static inline int is_safe_ascii(char c)
 {
 	if ((c >= '0' && c <= '9') ||
 	    (c >= 'A' && c <= 'Z') ||
-	    (c >= 'a' && c <= 'z') ||
-	    strchr("#+-.:=@_", c) != NULL ||
-	    (white != NULL && strchr(white, c) != NULL))
+	    (c >= 'a' && c <= 'z'))
+		return 1;
+
+	switch (c) {
+	case '#': case '+': case '-': case '.':
+	case ':': case '=': case '@': case '_':
+		return 1;
+	}
+	return 0;
+}
+
+static int is_whitelisted(char c, const char *white)
+{
+	if (is_safe_ascii(c) ||
+	    (white != NULL && c != '\0' && strchr(white, c) != NULL))
 		return 1;
 	return 0;
 }
@@ -233,13 +246,54 @@ static int replace_chars(char *str, const char *white)
 	return replaced;
 }
 
+/*
+ * Returns true if all the four UTF-16 characters at @p are non-zero 7-bit
+ * ASCII, the check is done for all the characters at once. The masks are
+ * defined by bytes, so the result does not depend on the CPU byte order.
+ */
+static inline int is_ascii_utf16(const unsigned char *p, int enc)
+{
+	static const unsigned char le_mask[] =
+			{ 0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff };
+	static const unsigned char be_mask[] =
+			{ 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80 };
+	static const unsigned char le_high[] = { 0, 1, 0, 1, 0, 1, 0, 1 };
+	static const unsigned char be_high[] = { 1, 0, 1, 0, 1, 0, 1, 0 };
+	uint64_t w, mask, high;
+
+	memcpy(&w, p, sizeof(w));
+	memcpy(&mask, enc == BLKID_ENC_UTF16LE ? le_mask : be_mask, sizeof(mask));
+
+	/* high bytes have to be zero, low bytes < 0x80 */
+	if (w & mask)
+		return 0;
+
+	/* low bytes have to be non-zero (the high bytes are masked by 1) */
+	memcpy(&high, enc == BLKID_ENC_UTF16LE ? le_high : be_high, sizeof(high));
+	w |= high;
+	return ((w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL) == 0;
+}
+
 size_t blkid_encode_to_utf8(int enc, unsigned char *dest, size_t len,
 			const unsigned char *src, size_t count)
 {
 	size_t i, j;
 	uint16_t c;
+	int lo = enc == BLKID_ENC_UTF16LE ? 0 : 1;	/* offset of low byte */
 
 	for (j = i = 0; i + 2 <= count; i += 2) {
+		/* plain ASCII, four characters at once */
+		while (i + 8 <= count && j + 4 < len &&
+		       is_ascii_utf16(&src[i], enc)) {
+			dest[j++] = src[i + lo];
+			dest[j++] = src[i + 2 + lo];
+			dest[j++] = src[i + 4 + lo];
+			dest[j++] = src[i + 6 + lo];
+			i += 8;
+		}
+		if (i + 2 > count)
+			break;
+
 		if (enc == BLKID_ENC_UTF16LE)
 			c = (src[i+1] << 8) | src[i];
 		else /* BLKID_ENC_UTF16BE */
@@ -290,6 +344,14 @@ int blkid_encode_string(const char *str, char *str_enc, size_t len)
 	for (i = 0, j = 0; str[i] != '\0'; i++) {
 		int seqlen;
 
+		if (is_safe_ascii(str[i])) {
+			/* the most common case, don't check for UTF-8 */
+			if (j + 4 >= len)
+				goto err;
+			str_enc[j++] = str[i];
+			continue;
+		}
+
 		seqlen = utf8_encoded_valid_unichar(&str[i]);
 		if (seqlen > 1) {
 			if (len-j < (size_t)seqlen)
@@ -298,10 +360,14 @@ int blkid_encode_string(const char *str, char *str_enc, size_t len)
 			j += seqlen;
 			i += (seqlen-1);
 		} else if (str[i] == '\\' || !is_whitelisted(str[i], NULL)) {
+			static const char hex[] = "0123456789abcdef";
+
 			if (len-j < 4)
 				goto err;
-			sprintf(&str_enc[j], "\\x%02x", (unsigned char) str[i]);
-			j += 4;
+			str_enc[j++] = '\\';
+			str_enc[j++] = 'x';
+			str_enc[j++] = hex[((unsigned char) str[i]) >> 4];
+			str_enc[j++] = hex[((unsigned char) str[i]) & 0xf];
 		} else {
 			if (len-j < 1)
 				goto err;
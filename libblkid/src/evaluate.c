@@ -21,6 +21,7 @@
 #endif
 #include <stdint.h>
 #include <stdarg.h>
+#include <dirent.h>
 
 #include "pathnames.h"
 #include "canonicalize.h"
@@ -132,8 +133,42 @@ int blkid_send_uevent(const char *devname, const char *action)
 	return rc;
 }
 
+/* udev /dev/disk/by-* directories */
+static const struct udev_dir {
+	const char	*token;
+	const char	*path;
+} udev_dirs[] = {
+	{ "UUID",	_PATH_DEV_BYUUID },
+	{ "LABEL",	_PATH_DEV_BYLABEL },
+	{ "PARTLABEL",	_PATH_DEV_BYPARTLABEL },
+	{ "PARTUUID",	_PATH_DEV_BYPARTUUID }
+};
+
+/* parsed spec for blkid_evaluate_tags() */
+struct blkid_tag_spec {
+	char	*token;
+	char	*value;
+};
+
+static int cmp_names(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static const struct udev_dir *get_udev_dir(const char *token)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(udev_dirs); i++) {
+		if (!strcmp(token, udev_dirs[i].token))
+			return &udev_dirs[i];
+	}
+	return NULL;
+}
+
 static char *evaluate_by_udev(const char *token, const char *value, int uevent)
 {
+	const struct udev_dir *dir;
 	char dev[PATH_MAX];
 	char *path = NULL;
 	size_t len;
@@ -141,20 +176,13 @@ static char *evaluate_by_udev(const char *token, const char *value, int uevent)
 
 	DBG(EVALUATE, blkid_debug("evaluating by udev %s=%s", token, value));
 
-	if (!strcmp(token, "UUID"))
-		strcpy(dev, _PATH_DEV_BYUUID "/");
-	else if (!strcmp(token, "LABEL"))
-		strcpy(dev, _PATH_DEV_BYLABEL "/");
-	else if (!strcmp(token, "PARTLABEL"))
-		strcpy(dev, _PATH_DEV_BYPARTLABEL "/");
-	else if (!strcmp(token, "PARTUUID"))
-		strcpy(dev, _PATH_DEV_BYPARTUUID "/");
-	else {
+	dir = get_udev_dir(token);
+	if (!dir) {
 		DBG(EVALUATE, blkid_debug("unsupported token %s", token));
 		return NULL;	/* unsupported tag */
 	}
 
-	len = strlen(dev);
+	len = snprintf(dev, sizeof(dev), "%s/", dir->path);
 	if (blkid_encode_string(value, &dev[len], sizeof(dev) - len) != 0)
 		return NULL;
 
@@ -299,26 +327,224 @@ char *blkid_evaluate_spec(const char *spec, blkid_cache *cache)
 	return res;
 }
 
+/*
+ * Reads names of all entries from udev /dev/disk/by-* directory, the result
+ * is sorted for bsearch(). Returns number of the names.
+ */
+static size_t read_udev_dir(const char *path, char ***names)
+{
+	DIR *dir;
+	struct dirent *d;
+	size_t n = 0, nalloc = 0;
+	char **res = NULL;
+
+	*names = NULL;
+
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	while ((d = readdir(dir))) {
+		char *name;
+
+		if (d->d_name[0] == '.')
+			continue;
+		if (n == nalloc) {
+			char **tmp;
+
+			nalloc = nalloc ? nalloc * 2 : 32;
+			tmp = realloc(res, nalloc * sizeof(char *));
+			if (!tmp)
+				break;
+			res = tmp;
+		}
+		name = strdup(d->d_name);
+		if (!name)
+			break;
+		res[n++] = name;
+	}
+	closedir(dir);
+
+	if (n)
+		qsort(res, n, sizeof(char *), cmp_names);
+
+	DBG(EVALUATE, blkid_debug("%s: %zu entries", path, n));
+	*names = res;
+	return n;
+}
+
+static void free_names(char **names, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		free(names[i]);
+	free(names);
+}
+
+/*
+ * Evaluates all unresolved @tags by one readdir() for each udev directory,
+ * the symlinks are used only if they exist in the directory.
+ */
+static void evaluate_tags_by_udev(struct blkid_tag_spec *tags, size_t ntags,
+				  char **results, int uevent)
+{
+	size_t i, d;
+
+	for (d = 0; d < ARRAY_SIZE(udev_dirs); d++) {
+		char **names = NULL;
+		size_t nnames = 0;
+		int dir_read = 0;
+
+		for (i = 0; i < ntags; i++) {
+			char enc[PATH_MAX], *p = enc;
+
+			if (results[i] || !tags[i].value ||
+			    strcmp(tags[i].token, udev_dirs[d].token) != 0)
+				continue;
+			if (!dir_read) {
+				nnames = read_udev_dir(udev_dirs[d].path, &names);
+				dir_read = 1;
+			}
+			if (!nnames)
+				break;
+			if (blkid_encode_string(tags[i].value, enc, sizeof(enc)) != 0)
+				continue;
+			if (!bsearch(&p, names, nnames, sizeof(char *), cmp_names))
+				continue;
+
+			results[i] = evaluate_by_udev(tags[i].token,
+						      tags[i].value, uevent);
+		}
+		free_names(names, nnames);
+	}
+}
+
+/**
+ * blkid_evaluate_tags:
+ * @specs: array of unparsed tags (e.g. "LABEL=foo") or paths
+ * @nspecs: number of items in @specs
+ * @results: array (with @nspecs items) for the results
+ * @cache: pointer to cache (or NULL when you don't want to re-use the cache)
+ *
+ * The same as blkid_evaluate_spec(), but evaluates more specs at once. This
+ * is faster than to call blkid_evaluate_spec() for each item, the config file
+ * is read only once, every udev /dev/disk/by-* directory is read only once
+ * and all the specs not found by udev share the same cache, so the block
+ * devices are scanned only once.
+ *
+ * The @results items are allocated strings with device names, or NULL if the
+ * spec cannot be evaluated.
+ *
+ * Returns: number of the evaluated specs or negative number in case of error.
+ */
+int blkid_evaluate_tags(const char **specs, size_t nspecs, char **results,
+			blkid_cache *cache)
+{
+	struct blkid_config *conf = NULL;
+	struct blkid_tag_spec *tags;
+	blkid_cache c = cache ? *cache : NULL;
+	size_t i, nres = 0, ntags = 0;
+	int e;
+
+	if (!specs || !results)
+		return -EINVAL;
+
+	memset(results, 0, nspecs * sizeof(char *));
+	if (!nspecs)
+		return 0;
+
+	if (!c)
+		blkid_init_debug(0);
+
+	tags = calloc(nspecs, sizeof(struct blkid_tag_spec));
+	if (!tags)
+		return -ENOMEM;
+
+	for (i = 0; i < nspecs; i++) {
+		const char *spec = specs[i];
+
+		if (!spec)
+			continue;
+		if (!strchr(spec, '=')) {
+			results[i] = canonicalize_path(spec);
+			continue;
+		}
+		if (blkid_parse_tag_string(spec, &tags[i].token, &tags[i].value))
+			continue;
+		if (tags[i].value)
+			ntags++;
+		else
+			results[i] = canonicalize_path(spec);
+	}
+
+	DBG(EVALUATE, blkid_debug("evaluating %zu specs (%zu tags)", nspecs, ntags));
+
+	if (ntags)
+		conf = blkid_read_config(NULL);
+
+	for (e = 0; conf && e < conf->nevals; e++) {
+		if (conf->eval[e] == BLKID_EVAL_UDEV)
+			evaluate_tags_by_udev(tags, nspecs, results, conf->uevent);
+
+		else if (conf->eval[e] == BLKID_EVAL_SCAN) {
+			for (i = 0; i < nspecs; i++) {
+				if (results[i] || !tags[i].value)
+					continue;
+				results[i] = evaluate_by_scan(tags[i].token,
+						tags[i].value, &c, conf);
+			}
+		}
+	}
+
+	for (i = 0; i < nspecs; i++) {
+		if (results[i])
+			nres++;
+		free(tags[i].token);
+		free(tags[i].value);
+	}
+	free(tags);
+	blkid_free_config(conf);
+
+	if (cache)
+		*cache = c;
+	else if (c)
+		blkid_put_cache(c);
+
+	DBG(EVALUATE, blkid_debug("evaluated %zu of %zu specs", nres, nspecs));
+	return nres;
+}
 
 #ifdef TEST_PROGRAM
 int main(int argc, char *argv[])
 {
 	blkid_cache cache = NULL;
-	char *res;
+	char **res;
+	int i, rc;
 
 	if (argc < 2) {
-		fprintf(stderr, "usage: %s <tag> | <spec>\n", argv[0]);
+		fprintf(stderr, "usage: %s <tag> | <spec> [...]\n", argv[0]);
 		return EXIT_FAILURE;
 	}
 
 	blkid_init_debug(0);
 
-	res = blkid_evaluate_spec(argv[1], &cache);
-	if (res)
-		printf("%s\n", res);
+	res = calloc(argc - 1, sizeof(char *));
+	if (!res)
+		return EXIT_FAILURE;
+
+	rc = blkid_evaluate_tags((const char **) argv + 1, argc - 1, res, &cache);
+	for (i = 0; i < argc - 1; i++) {
+		if (argc > 2)
+			printf("%s: %s\n", argv[i + 1], res[i] ? res[i] : "<none>");
+		else if (res[i])
+			printf("%s\n", res[i]);
+		free(res[i]);
+	}
+	free(res);
 	if (cache)
 		blkid_put_cache(cache);
 
-	return res ? EXIT_SUCCESS : EXIT_FAILURE;
+	return rc == argc - 1 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 #endif
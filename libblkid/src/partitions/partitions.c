@@ -187,6 +187,12 @@ struct blkid_struct_partition {
 	blkid_parttable	tab;		/* partition table */
 };
 
+/* index to partlist, see partlist_find_by_start() */
+struct blkid_partidx {
+	blkid_loff_t	start;
+	int		n;		/* index to ls->parts[] */
+};
+
 /* exported as opaque type "blkid_partlist" */
 struct blkid_struct_partlist {
 	int		next_partno;	/* next partition number */
@@ -196,6 +202,9 @@ struct blkid_struct_partlist {
 	int		nparts_max;	/* max.number of partitions */
 	blkid_partition	parts;		/* array of partitions */
 
+	struct blkid_partidx *sorted;	/* parts[] sorted by start */
+	int		nsorted;	/* number of items in sorted[] */
+
 	struct list_head l_tabs;	/* list of partition tables */
 };
 
@@ -352,11 +361,13 @@ static void reset_partlist(blkid_partlist ls)
 		/* already initialized - reset */
 		int tmp_nparts = ls->nparts_max;
 		blkid_partition tmp_parts = ls->parts;
+		struct blkid_partidx *tmp_sorted = ls->sorted;
 
 		memset(ls, 0, sizeof(struct blkid_struct_partlist));
 
 		ls->nparts_max = tmp_nparts;
 		ls->parts = tmp_parts;
+		ls->sorted = tmp_sorted;
 	}
 
 	ls->nparts = 0;
@@ -399,6 +410,7 @@ static void partitions_free_data(blkid_probe pr __attribute__((__unused__)),
 
 	/* deallocate partitions and partlist */
 	free(ls->parts);
+	free(ls->sorted);
 	free(ls);
 }
 
@@ -580,7 +592,7 @@ static int partitions_probe(blkid_probe pr, struct blkid_chain *chn)
 	if (chn->binary)
 		partitions_init_data(chn);
 
-	if (!pr->wipe_size && (pr->prob_flags & BLKID_PROBE_FL_IGNORE_PT))
+	if (!pr->nwipers && (pr->prob_flags & BLKID_PROBE_FL_IGNORE_PT))
 		goto details_only;
 
 	DBG(LOWPROBE, blkid_debug("--> starting probing loop [PARTS idx=%d]",
@@ -589,16 +601,23 @@ static int partitions_probe(blkid_probe pr, struct blkid_chain *chn)
 	i = chn->idx < 0 ? 0 : chn->idx + 1U;
 
 	for ( ; i < ARRAY_SIZE(idinfos); i++) {
+		struct blkid_statctx sc;
 		const char *name;
+		int res;
 
 		chn->idx = i;
 
 		/* apply filter */
-		if (chn->fltr && blkid_bmp_get_item(chn->fltr, i))
+		if (chn->fltr && blkid_bmp_get_item(chn->fltr, i)) {
+			blkid_probe_skip_stat(chn, i);
 			continue;
+		}
 
 		/* apply checks from idinfo */
-		if (idinfo_probe(pr, idinfos[i], chn) != 0)
+		blkid_probe_start_stat(pr, chn, i, &sc);
+		res = idinfo_probe(pr, idinfos[i], chn);
+		blkid_probe_stop_stat(pr, &sc);
+		if (res != 0)
 			continue;
 
 		name = idinfos[i]->name;
@@ -699,9 +718,31 @@ int blkid_partitions_do_subprobe(blkid_probe pr, blkid_partition parent,
 	return rc;
 }
 
+/*
+ * Returns partition table of the whole-disk. The table is parsed only once,
+ * the whole-disk probe is shared by all partitions of the disk (see
+ * blkid_probe_get_wholedisk_probe()).
+ */
+static blkid_partlist get_wholedisk_partlist(blkid_probe disk_pr, int *cached)
+{
+	*cached = disk_pr->flags & BLKID_FL_PT_PARSED ? 1 : 0;
+
+	if (*cached)
+		DBG(LOWPROBE, blkid_debug("parts: use already parsed whole-disk PT"));
+	else {
+		if (!blkid_probe_get_partitions(disk_pr))
+			disk_pr->flags |= BLKID_FL_PT_NONE;
+		disk_pr->flags |= BLKID_FL_PT_PARSED;
+		blkid_probe_finish_wholedisk_probe(disk_pr);
+	}
+
+	return disk_pr->flags & BLKID_FL_PT_NONE ? NULL :
+			blkid_probe_get_partlist(disk_pr);
+}
+
 static int blkid_partitions_probe_partition(blkid_probe pr)
 {
-	int rc = 1;
+	int rc = 1, cached;
 	blkid_probe disk_pr = NULL;
 	blkid_partlist ls;
 	blkid_partition par;
@@ -716,11 +757,22 @@ static int blkid_partitions_probe_partition(blkid_probe pr)
 		goto nothing;
 
 	/* parse PT */
-	ls = blkid_probe_get_partitions(disk_pr);
+	ls = get_wholedisk_partlist(disk_pr, &cached);
+	par = ls ? blkid_partlist_devno_to_partition(ls, devno) : NULL;
+
+	if (!par && cached) {
+		/* the PT has been parsed for another partition, it's
+		 * probably obsolete, try it again */
+		blkid_probe_drop_wholedisk_probe(pr);
+		disk_pr = blkid_probe_get_wholedisk_probe(pr);
+		if (!disk_pr)
+			goto nothing;
+		ls = get_wholedisk_partlist(disk_pr, &cached);
+		par = ls ? blkid_partlist_devno_to_partition(ls, devno) : NULL;
+	}
 	if (!ls)
 		goto nothing;
 
-	par = blkid_partlist_devno_to_partition(ls, devno);
 	if (par) {
 		const char *v;
 		blkid_parttable tab = blkid_partition_get_table(par);
@@ -901,6 +953,85 @@ blkid_partition blkid_partlist_get_partition(blkid_partlist ls, int n)
 	return &ls->parts[n];
 }
 
+static int cmp_partidx(const void *a, const void *b)
+{
+	const struct blkid_partidx *x = (const struct blkid_partidx *) a,
+				   *y = (const struct blkid_partidx *) b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return x->n - y->n;
+}
+
+/*
+ * The partitions are not modified after blkid_partlist_add_partition(), so
+ * the index is valid until a new partition is added to the list.
+ */
+static int partlist_build_index(blkid_partlist ls)
+{
+	int i;
+
+	if (ls->sorted && ls->nsorted == ls->nparts)
+		return 0;
+
+	free(ls->sorted);
+	ls->nsorted = 0;
+	ls->sorted = malloc(ls->nparts * sizeof(struct blkid_partidx));
+	if (!ls->sorted)
+		return -ENOMEM;
+
+	for (i = 0; i < ls->nparts; i++) {
+		ls->sorted[i].start = ls->parts[i].start;
+		ls->sorted[i].n = i;
+	}
+	qsort(ls->sorted, ls->nparts, sizeof(struct blkid_partidx), cmp_partidx);
+	ls->nsorted = ls->nparts;
+	return 0;
+}
+
+static int partition_match(blkid_partition par, uint64_t start, uint64_t size)
+{
+	if (par->start != (blkid_loff_t) start)
+		return 0;
+	if (par->size == (blkid_loff_t) size)
+		return 1;
+
+	/* exception for extended dos partitions */
+	return blkid_partition_is_extended(par) && size <= 1024;
+}
+
+/*
+ * Returns the first partition (in order of the list) which matches with
+ * @start and @size.
+ */
+static blkid_partition partlist_find_by_start(blkid_partlist ls,
+					uint64_t start, uint64_t size)
+{
+	int lo = 0, hi;
+
+	if (!ls->nparts || partlist_build_index(ls) != 0)
+		return NULL;
+
+	/* lower bound for @start */
+	hi = ls->nsorted;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (ls->sorted[mid].start < (blkid_loff_t) start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < ls->nsorted && ls->sorted[lo].start == (blkid_loff_t) start; lo++) {
+		blkid_partition par = &ls->parts[ls->sorted[lo].n];
+
+		if (partition_match(par, start, size))
+			return par;
+	}
+	return NULL;
+}
+
 /**
  * blkid_partlist_devno_to_partition:
  * @ls: partitions list
@@ -908,6 +1039,8 @@ blkid_partition blkid_partlist_get_partition(blkid_partlist ls, int n)
  *
  * This function tries to get start and size for @devno from sysfs and
  * returns a partition from @ls which matches with the values from sysfs.
+ * The partition number from sysfs (if available) is used as a hint, the
+ * start and size are always verified.
  *
  * This function is necessary when you want to make a relation between an entry
  * in the partition table (@ls) and block devices in your system.
@@ -918,7 +1051,8 @@ blkid_partition blkid_partlist_devno_to_partition(blkid_partlist ls, dev_t devno
 {
 	struct sysfs_cxt sysfs;
 	uint64_t start, size;
-	int i, rc, partno = 0;
+	blkid_partition par;
+	int i, rc, partno = 0, hint = 0;
 
 	if (!ls)
 		return NULL;
@@ -933,6 +1067,8 @@ blkid_partition blkid_partlist_devno_to_partition(blkid_partlist ls, dev_t devno
 	rc = sysfs_read_u64(&sysfs, "size", &size);
 	if (!rc) {
 		rc = sysfs_read_u64(&sysfs, "start", &start);
+		if (!rc && sysfs_read_int(&sysfs, "partition", &hint) != 0)
+			hint = 0;
 		if (rc) {
 			/* try to get partition number from DM uuid.
 			 */
@@ -968,7 +1104,7 @@ blkid_partition blkid_partlist_devno_to_partition(blkid_partlist ls, dev_t devno
 		 * and an entry in partition table.
 		 */
 		 for (i = 0; i < ls->nparts; i++) {
-			 blkid_partition par = &ls->parts[i];
+			 par = &ls->parts[i];
 
 			 if (partno != blkid_partition_get_partno(par))
 				 continue;
@@ -981,21 +1117,24 @@ blkid_partition blkid_partlist_devno_to_partition(blkid_partlist ls, dev_t devno
 		 return NULL;
 	}
 
-	DBG(LOWPROBE, blkid_debug("searching by offset/size"));
-
-	for (i = 0; i < ls->nparts; i++) {
-		blkid_partition par = &ls->parts[i];
+	/*
+	 * The kernel partition number is usually the same as the partition
+	 * number in the list, so try it at first.
+	 */
+	if (hint > 0 && hint <= ls->nparts) {
+		par = &ls->parts[hint - 1];
 
-		if (blkid_partition_get_start(par) == (blkid_loff_t) start &&
-		    blkid_partition_get_size(par) == (blkid_loff_t) size)
+		if (par->partno == hint && partition_match(par, start, size)) {
+			DBG(LOWPROBE, blkid_debug("found by sysfs partno %d", hint));
 			return par;
+		}
+	}
 
-		/* exception for extended dos partitions */
-		if (blkid_partition_get_start(par) == (blkid_loff_t) start &&
-		    blkid_partition_is_extended(par) && size <= 1024)
-			return par;
+	DBG(LOWPROBE, blkid_debug("searching by offset/size"));
 
-	}
+	par = partlist_find_by_start(ls, start, size);
+	if (par)
+		return par;
 
 	DBG(LOWPROBE, blkid_debug("not found partition for device"));
 	return NULL;
@@ -49,6 +49,17 @@
  *
  * overwrites the previous probing result for the partitions chain, the superblocks
  * result is not modified.
+ *
+ * The library reads from the device by positional reads (pread()) only and
+ * never modifies the file offset of the assigned file descriptor (the
+ * exception is blkid_do_wipe() which writes to the device). It means that the
+ * same file descriptor could be shared between more probes or between
+ * a probe and the application.
+ *
+ * The probe struct itself is not protected by any lock. It is safe to use
+ * more probes in more threads at the same time, but one probe (and all its
+ * clones that share buffers with the probe, see blkid_clone_probe()) has to be
+ * used by one thread only.
  */
 
 /**
@@ -107,9 +118,104 @@
 #ifdef HAVE_LIBUUID
 # include <uuid.h>
 #endif
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
 
 #include "blkidP.h"
 #include "all-io.h"
+#include "sysfs.h"
+
+/*
+ * The whole-disk probe is shared by all partitions of the disk probed in the
+ * same thread (for example udev probes the partitions one by one), so the
+ * partition table is parsed only once for the disk. The probe is reference
+ * counted, the cache keeps one reference.
+ *
+ * The cached probe is dropped if the whole-disk device is probed again (the
+ * disk has been changed), if the disk size or the device node modification
+ * time is different or if the partition is not found in the cached partition
+ * table (the partition start and size are always verified against sysfs, see
+ * blkid_partlist_devno_to_partition()).
+ *
+ * The cache is per-thread, the cached probe is deallocated by pthread key
+ * destructor when the thread exits.
+ */
+struct wholedisk_cache {
+	blkid_probe	disk;
+	char		*path;		/* whole-disk device node */
+	time_t		mtime;		/* device node times when cached */
+	time_t		ctime;
+	long		mtime_nsec;
+	long		ctime_nsec;
+};
+
+THREAD_LOCAL struct wholedisk_cache wholedisk_cache;
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_key_t wholedisk_key;
+static pthread_once_t wholedisk_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void unref_wholedisk_probe(blkid_probe disk)
+{
+	if (disk && --disk->disk_refcount <= 0) {
+		DBG(LOWPROBE, blkid_debug("free wholedisk probe"));
+		blkid_free_probe(disk);
+	}
+}
+
+static void drop_wholedisk_cache(void)
+{
+	unref_wholedisk_probe(wholedisk_cache.disk);
+	free(wholedisk_cache.path);
+	memset(&wholedisk_cache, 0, sizeof(wholedisk_cache));
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void wholedisk_cache_destructor(void *data __attribute__((__unused__)))
+{
+	DBG(LOWPROBE, blkid_debug("thread exit, drop wholedisk cache"));
+	drop_wholedisk_cache();
+}
+
+static void wholedisk_key_init(void)
+{
+	if (pthread_key_create(&wholedisk_key, wholedisk_cache_destructor))
+		DBG(LOWPROBE, blkid_debug("failed to create wholedisk cache key"));
+}
+#endif
+
+/*
+ * Stores @disk (opened from @path) to the cache, the cache takes over @path.
+ */
+static void set_wholedisk_cache(blkid_probe disk, char *path)
+{
+	struct stat st;
+
+	drop_wholedisk_cache();
+
+	if (!path || stat(path, &st) != 0) {
+		free(path);
+		return;		/* nothing to validate the cache with */
+	}
+
+	wholedisk_cache.disk = disk;
+	wholedisk_cache.path = path;
+	wholedisk_cache.mtime = st.st_mtime;
+	wholedisk_cache.ctime = st.st_ctime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	wholedisk_cache.mtime_nsec = st.st_mtim.tv_nsec;
+	wholedisk_cache.ctime_nsec = st.st_ctim.tv_nsec;
+#endif
+	disk->disk_refcount++;
+
+#ifdef HAVE_LIBPTHREAD
+	/* register the destructor, any non-NULL value will do */
+	pthread_once(&wholedisk_once, wholedisk_key_init);
+	pthread_setspecific(wholedisk_key, &wholedisk_cache);
+#endif
+}
 
 /* chains */
 extern const struct blkid_chaindrv superblocks_drv;
@@ -127,6 +233,10 @@ static const struct blkid_chaindrv *chains_drvs[] = {
 
 static void blkid_probe_reset_vals(blkid_probe pr);
 static void blkid_probe_reset_buffer(blkid_probe pr);
+static struct blkid_bufpool *get_bufpool(blkid_probe pr);
+static void ref_bufpool(struct blkid_bufpool *pool);
+static void unref_bufpool(struct blkid_bufpool *pool);
+static void report_chain_values(blkid_probe pr, struct blkid_chain *chn);
 
 /**
  * blkid_new_probe:
@@ -151,15 +261,26 @@ blkid_probe blkid_new_probe(void)
 		pr->chains[i].flags = chains_drvs[i]->dflt_flags;
 		pr->chains[i].enabled = chains_drvs[i]->dflt_enabled;
 	}
-	INIT_LIST_HEAD(&pr->buffers);
 	return pr;
 }
 
-/*
- * Clone @parent, the new clone shares all, but except:
+/**
+ * blkid_clone_probe:
+ * @parent: probe
+ *
+ * Clones @parent, the new clone shares all, but except:
  *
  *	- probing result
  *	- bufferes if another device (or offset) is set to the prober
+ *
+ * The clone shares buffers with @parent (also if the probing area is changed
+ * by blkid_probe_set_dimension()), so the clone and the @parent must not be
+ * used by more threads at the same time. The clone is detached from the
+ * shared buffers (and uses private buffers) after blkid_probe_set_device()
+ * call; the file descriptor from @parent could be used for this purpose, for
+ * example to probe partitions of the same disk in parallel threads.
+ *
+ * Returns: a pointer to the newly allocated probe struct or NULL in case of error.
  */
 blkid_probe blkid_clone_probe(blkid_probe parent)
 {
@@ -175,16 +296,28 @@ blkid_probe blkid_clone_probe(blkid_probe parent)
 		return NULL;
 
 	pr->fd = parent->fd;
+	pr->membuf = parent->membuf;
+	pr->membufsz = parent->membufsz;
+	pr->read_fn = parent->read_fn;
+	pr->read_data = parent->read_data;
 	pr->off = parent->off;
 	pr->size = parent->size;
 	pr->devno = parent->devno;
 	pr->disk_devno = parent->disk_devno;
 	pr->blkssz = parent->blkssz;
+	pr->mode = parent->mode;
 	pr->flags = parent->flags;
 	pr->parent = parent;
 
 	pr->flags &= ~BLKID_FL_PRIVATE_FD;
 
+	/* share buffers */
+	pr->pool = get_bufpool(parent);
+	if (pr->pool) {
+		ref_bufpool(pr->pool);
+		pr->pool_off = parent->pool_off;
+	}
+
 	return pr;
 }
 
@@ -251,12 +384,14 @@ void blkid_free_probe(blkid_probe pr)
 		if (ch->driver->free_data)
 			ch->driver->free_data(pr, ch->data);
 		free(ch->fltr);
+		free(ch->stats);
 	}
 
 	if ((pr->flags & BLKID_FL_PRIVATE_FD) && pr->fd >= 0)
 		close(pr->fd);
-	blkid_probe_reset_buffer(pr);
-	blkid_free_probe(pr->disk_probe);
+	unref_bufpool(pr->pool);
+	free(pr->wipers);
+	unref_wholedisk_probe(pr->disk_probe);
 
 	DBG(LOWPROBE, blkid_debug("free probe %p", pr));
 	free(pr);
@@ -346,6 +481,22 @@ static const char *blkid_probe_get_probername(blkid_probe pr)
 	return NULL;
 }
 
+/*
+ * Calls the chain @fn, the statistics for I/O outside the probing functions
+ * are accounted to the chain itself.
+ */
+static int chain_probe(blkid_probe pr, struct blkid_chain *chn,
+		       int (*fn)(blkid_probe, struct blkid_chain *))
+{
+	struct blkid_statctx sc;
+	int rc;
+
+	blkid_probe_start_stat(pr, chn, chn->driver->nidinfos, &sc);
+	rc = fn(pr, chn);
+	blkid_probe_stop_stat(pr, &sc);
+	return rc;
+}
+
 void *blkid_probe_get_binary_data(blkid_probe pr, struct blkid_chain *chn)
 {
 	int rc, org_prob_flags;
@@ -365,7 +516,7 @@ void *blkid_probe_get_binary_data(blkid_probe pr, struct blkid_chain *chn)
 	chn->binary = TRUE;
 	blkid_probe_chain_reset_position(chn);
 
-	rc = chn->driver->probe(pr, chn);
+	rc = chain_probe(pr, chn, chn->driver->probe);
 
 	chn->binary = FALSE;
 	blkid_probe_chain_reset_position(chn);
@@ -531,95 +682,390 @@ int __blkid_probe_filter_types(blkid_probe pr, int chain, int flag, char *names[
 	return 0;
 }
 
-unsigned char *blkid_probe_get_buffer(blkid_probe pr,
-				blkid_loff_t off, blkid_loff_t len)
+static struct blkid_bufpool *new_bufpool(void)
 {
-	struct list_head *p;
-	struct blkid_bufinfo *bf = NULL;
+	struct blkid_bufpool *pool = calloc(1, sizeof(struct blkid_bufpool));
 
-	if (pr->size <= 0)
+	if (!pool)
 		return NULL;
 
-	if (pr->parent &&
-	    pr->parent->devno == pr->devno &&
-	    pr->parent->off <= pr->off &&
-	    pr->parent->off + pr->parent->size >= pr->off + pr->size) {
-		/*
-		 * This is a cloned prober and points to the same area as
-		 * parent. Let's use parent's buffers.
-		 *
-		 * Note that pr->off (and pr->parent->off) is always from the
-		 * beginig of the device.
-		 */
-		return blkid_probe_get_buffer(pr->parent,
-				pr->off + off - pr->parent->off, len);
+	pool->refcount = 1;
+	INIT_LIST_HEAD(&pool->buffers);
+	return pool;
+}
+
+static void reset_bufpool(struct blkid_bufpool *pool)
+{
+	uint64_t read_ct = 0, len_ct = 0;
+
+	if (list_empty(&pool->buffers))
+		return;
+
+	while (!list_empty(&pool->buffers)) {
+		struct blkid_bufinfo *bf = list_entry(pool->buffers.next,
+						struct blkid_bufinfo, bufs);
+		read_ct++;
+		len_ct += bf->len;
+		list_del(&bf->bufs);
+		free(bf);
 	}
 
-	list_for_each(p, &pr->buffers) {
-		struct blkid_bufinfo *x =
-				list_entry(p, struct blkid_bufinfo, bufs);
+	DBG(LOWPROBE, blkid_debug("buffers summary: %"PRIu64" bytes "
+			"by %"PRIu64" pread() call(s)",
+			len_ct, read_ct));
+
+	INIT_LIST_HEAD(&pool->buffers);
+	pool->nbufidx = 0;
+}
 
-		if (x->off <= off && off + len <= x->off + x->len) {
-			DBG(LOWPROBE, blkid_debug("\treuse buffer: off=%jd len=%jd pr=%p",
-							x->off, x->len, pr));
-			bf = x;
-			break;
-		}
+/*
+ * The clones detached from the pool by blkid_probe_set_device() may be freed
+ * in parallel threads, so the reference counter is atomic.
+ */
+static void ref_bufpool(struct blkid_bufpool *pool)
+{
+	__sync_add_and_fetch(&pool->refcount, 1);
+}
+
+static void unref_bufpool(struct blkid_bufpool *pool)
+{
+	if (!pool || __sync_sub_and_fetch(&pool->refcount, 1) > 0)
+		return;
+
+	reset_bufpool(pool);
+	free(pool->bufidx);
+	free(pool);
+}
+
+/*
+ * Shares buffers between the partition probe @pr and the whole-disk probe
+ * @disk. It's possible only if one of the probes does not have any buffer
+ * yet, otherwise the pools are kept private.
+ */
+static void share_wholedisk_bufpool(blkid_probe pr, blkid_probe disk)
+{
+	struct sysfs_cxt sysfs;
+	uint64_t start;
+	int rc;
+
+	if (pr->membuf || disk->membuf || (pr->pool && pr->pool == disk->pool))
+		return;
+	if (disk->flags & BLKID_FL_PT_PARSED)
+		return;		/* cached whole-disk, see blkid_probe_finish_wholedisk_probe() */
+	if (pr->pool && !list_empty(&pr->pool->buffers) &&
+	    disk->pool && !list_empty(&disk->pool->buffers))
+		return;
+	if (!disk->pool && (!pr->pool || list_empty(&pr->pool->buffers)))
+		return;		/* nothing to share */
+
+	if (sysfs_init(&sysfs, pr->devno, NULL))
+		return;
+	rc = sysfs_read_u64(&sysfs, "start", &start);
+	sysfs_deinit(&sysfs);
+	if (rc)
+		return;
+
+	if (disk->pool && (!pr->pool || list_empty(&pr->pool->buffers))) {
+		unref_bufpool(pr->pool);
+		pr->pool = disk->pool;
+		pr->pool_off = disk->pool_off + (blkid_loff_t) (start << 9);
+		ref_bufpool(pr->pool);
+	} else {
+		unref_bufpool(disk->pool);
+		disk->pool = pr->pool;
+		disk->pool_off = pr->pool_off - (blkid_loff_t) (start << 9);
+		ref_bufpool(disk->pool);
 	}
-	if (!bf) {
-		ssize_t ret;
 
-		if (blkid_llseek(pr->fd, pr->off + off, SEEK_SET) < 0)
-			return NULL;
+	DBG(LOWPROBE, blkid_debug("sharing buffers with whole-disk probe "
+			"(partition start=%"PRIu64")", start));
+}
 
-		/* allocate info and space for data by why call */
-		bf = calloc(1, sizeof(struct blkid_bufinfo) + len);
-		if (!bf)
-			return NULL;
+/*
+ * Returns pool for the probe, the pool is allocated on demand.
+ */
+static struct blkid_bufpool *get_bufpool(blkid_probe pr)
+{
+	if (!pr->pool && pr->disk_probe && pr->devno &&
+	    pr->disk_probe->devno != pr->devno &&
+	    blkid_probe_get_wholedisk_devno(pr) == pr->disk_probe->devno)
+		/* another partition of the already used disk */
+		share_wholedisk_bufpool(pr, pr->disk_probe);
+	if (!pr->pool) {
+		pr->pool = new_bufpool();
+		pr->pool_off = 0;
+	}
+	return pr->pool;
+}
 
-		bf->data = ((unsigned char *) bf) + sizeof(struct blkid_bufinfo);
-		bf->len = len;
-		bf->off = off;
-		INIT_LIST_HEAD(&bf->bufs);
+/*
+ * Returns index of the first buffer in pool->bufidx which ends after @pos (it
+ * means the only buffer which could contain @pos), or pool->nbufidx.
+ */
+static size_t bufidx_lookup(struct blkid_bufpool *pool, blkid_loff_t pos)
+{
+	size_t lo = 0, hi = pool->nbufidx;
 
-		DBG(LOWPROBE, blkid_debug("\tbuffer read: off=%jd len=%jd pr=%p",
-				off, len, pr));
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct blkid_bufinfo *x = pool->bufidx[mid];
 
-		ret = read(pr->fd, bf->data, len);
-		if (ret != (ssize_t) len) {
-			free(bf);
-			return NULL;
+		if (x->off + x->len <= pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Replaces buffers bufidx[idx..idx+nold-1] by @bf. The old buffers are not
+ * deallocated (they are still in pool->buffers list) because the probing
+ * functions may still use pointers to the old data.
+ */
+static int bufidx_replace(struct blkid_bufpool *pool, size_t idx, size_t nold,
+			  struct blkid_bufinfo *bf)
+{
+	if (nold == 0) {
+		if (pool->nbufidx == pool->bufidx_max) {
+			size_t max = pool->bufidx_max ? pool->bufidx_max * 2 : 16;
+			struct blkid_bufinfo **tmp;
+
+			tmp = realloc(pool->bufidx, max * sizeof(*tmp));
+			if (!tmp)
+				return -ENOMEM;
+			pool->bufidx = tmp;
+			pool->bufidx_max = max;
 		}
-		list_add_tail(&bf->bufs, &pr->buffers);
+		memmove(pool->bufidx + idx + 1, pool->bufidx + idx,
+				(pool->nbufidx - idx) * sizeof(*pool->bufidx));
+		pool->nbufidx++;
+	} else if (nold > 1) {
+		memmove(pool->bufidx + idx + 1, pool->bufidx + idx + nold,
+				(pool->nbufidx - idx - nold) * sizeof(*pool->bufidx));
+		pool->nbufidx -= nold - 1;
 	}
 
-	return off ? bf->data + (off - bf->off) : bf->data;
+	pool->bufidx[idx] = bf;
+	return 0;
 }
 
+/*
+ * Returns buffer from the pool which contains the whole area or NULL.
+ */
+static struct blkid_bufinfo *bufidx_find(struct blkid_bufpool *pool,
+				blkid_loff_t pos, blkid_loff_t len)
+{
+	size_t idx = bufidx_lookup(pool, pos);
 
-static void blkid_probe_reset_buffer(blkid_probe pr)
+	if (idx < pool->nbufidx) {
+		struct blkid_bufinfo *x = pool->bufidx[idx];
+
+		if (x->off <= pos && pos + len <= x->off + x->len)
+			return x;
+	}
+	return NULL;
+}
+
+/*
+ * Reads buffer, the @pos is offset within the pool
+ */
+static struct blkid_bufinfo *read_buffer(blkid_probe pr,
+				blkid_loff_t pos, blkid_loff_t len)
 {
-	uint64_t read_ct = 0, len_ct = 0;
+	struct blkid_bufinfo *bf;
+	blkid_loff_t devoff = pos - pr->pool_off;
+	ssize_t ret;
 
-	if (!pr || list_empty(&pr->buffers))
-		return;
+	if (devoff < 0)
+		return NULL;
 
-	DBG(LOWPROBE, blkid_debug("reseting probing buffers pr=%p", pr));
+	/* allocate info and space for data by why call */
+	bf = calloc(1, sizeof(struct blkid_bufinfo) + len);
+	if (!bf)
+		return NULL;
 
-	while (!list_empty(&pr->buffers)) {
-		struct blkid_bufinfo *bf = list_entry(pr->buffers.next,
-						struct blkid_bufinfo, bufs);
-		read_ct++;
-		len_ct += bf->len;
-		list_del(&bf->bufs);
+	bf->data = ((unsigned char *) bf) + sizeof(struct blkid_bufinfo);
+	bf->len = len;
+	bf->off = pos;
+	INIT_LIST_HEAD(&bf->bufs);
+
+	DBG(LOWPROBE, blkid_debug("\tbuffer read: off=%jd len=%jd pr=%p",
+			devoff, len, pr));
+
+	if (pr->membuf) {
+		/* caller-supplied memory, read outside the memory */
+		errno = EINVAL;
+		ret = pr->read_fn ? pr->read_fn(pr->read_data, bf->data,
+						len, devoff) : -1;
+	} else
+		/* positional read, the file offset is never modified */
+		ret = pread_all(pr->fd, (char *) bf->data, len, devoff);
+
+	if (pr->cur_stat) {
+		pr->cur_stat->stats[BLKID_STAT_READS]++;
+		if (ret > 0)
+			pr->cur_stat->stats[BLKID_STAT_BYTES] += ret;
+	}
+	if (ret != (ssize_t) len) {
 		free(bf);
+		return NULL;
 	}
+	return bf;
+}
 
-	DBG(LOWPROBE, blkid_debug("buffers summary: %"PRIu64" bytes "
-			"by %"PRIu64" read() call(s)",
-			len_ct, read_ct));
+/*
+ * Read-ahead: align the area to the I/O size (the alignment is relative to
+ * the begin of the device), but never read behind the end of the probing area
+ * if the request itself is within the area.
+ *
+ * All requests to the end of the probing area are extended to the whole
+ * tail window, it's read only once for all the RAID probers and GPT backup
+ * header.
+ */
+static void get_readahead_area(blkid_probe pr,
+				blkid_loff_t off, blkid_loff_t len,
+				blkid_loff_t *start, blkid_loff_t *end)
+{
+	blkid_loff_t iosz = max(blkid_probe_get_sectorsize(pr),
+				(unsigned int) BLKID_PROBE_IOSIZE_MIN);
+
+	if (pr->size >= 2 * BLKID_PROBE_TAILSZ &&
+	    off >= pr->size - BLKID_PROBE_TAILSZ && off + len <= pr->size) {
+		off = pr->size - BLKID_PROBE_TAILSZ;
+		len = BLKID_PROBE_TAILSZ;
+	}
+
+	*start = pr->off + off;
+	*start -= *start % iosz;
+	*start = max(*start, pr->off) - pr->off;
+
+	*end = pr->off + off + len;
+	*end = ((*end + iosz - 1) / iosz) * iosz;
+	*end = min(*end - pr->off, max(pr->size, off + len));
+}
+
+/*
+ * Announces that the area will be read by blkid_probe_get_buffer() soon. The
+ * kernel starts to read all the announced areas asynchronously, so when the
+ * probing functions need more areas then call this function for all of them
+ * first, and the later blkid_probe_get_buffer() calls wait for the I/O only
+ * once (the requests are submitted in parallel rather than one by one).
+ *
+ * Nothing is done if the area is already cached.
+ */
+void blkid_probe_prefetch_area(blkid_probe pr,
+				blkid_loff_t off, blkid_loff_t len)
+{
+	blkid_loff_t start, end;
+
+	if (pr->size <= 0 || pr->membuf)
+		return;
+
+	if (pr->pool && bufidx_find(pr->pool, pr->pool_off + pr->off + off, len))
+		return;
+
+	get_readahead_area(pr, off, len, &start, &end);
+
+	DBG(LOWPROBE, blkid_debug("\tprefetch: off=%jd len=%jd pr=%p",
+				start, end - start, pr));
+#if defined(POSIX_FADV_WILLNEED) && defined(HAVE_POSIX_FADVISE)
+	posix_fadvise(pr->fd, pr->off + start, end - start, POSIX_FADV_WILLNEED);
+#endif
+}
+
+unsigned char *blkid_probe_get_buffer(blkid_probe pr,
+				blkid_loff_t off, blkid_loff_t len)
+{
+	struct blkid_bufpool *pool;
+	struct blkid_bufinfo *bf = NULL;
+	blkid_loff_t start, end, base;
+	size_t idx, n;
+
+	if (pr->size <= 0)
+		return NULL;
+
+	if (pr->membuf && pr->off + off >= 0 &&
+	    pr->off + off + len <= (blkid_loff_t) pr->membufsz) {
+		/* zero-copy, data from caller's memory */
+		if (pr->cur_stat)
+			pr->cur_stat->stats[BLKID_STAT_HITS]++;
+		return (unsigned char *) pr->membuf + pr->off + off;
+	}
+
+	pool = get_bufpool(pr);
+	if (!pool)
+		return NULL;
+
+	/* the pool offsets are from the begin of the (whole) device */
+	base = pr->pool_off + pr->off;
+
+	bf = bufidx_find(pool, base + off, len);
+	if (pr->cur_stat)
+		pr->cur_stat->stats[bf ? BLKID_STAT_HITS : BLKID_STAT_MISSES]++;
+	if (bf) {
+		DBG(LOWPROBE, blkid_debug("\treuse buffer: off=%jd len=%jd pr=%p",
+						bf->off - base, bf->len, pr));
+		return bf->data + (base + off - bf->off);
+	}
+
+	get_readahead_area(pr, off, len, &start, &end);
+	start += base;
+	end += base;
+
+	/* coalesce with all overlapping buffers */
+	idx = bufidx_lookup(pool, start);
+	for (n = 0; idx + n < pool->nbufidx; n++) {
+		struct blkid_bufinfo *x = pool->bufidx[idx + n];
+
+		if (x->off >= end)
+			break;
+		start = min(start, x->off);
+		end = max(end, x->off + x->len);
+	}
+
+	bf = read_buffer(pr, start, end - start);
+	if (!bf && (start != base + off || end != base + off + len)) {
+		/* read-ahead failed (e.g. bad sectors or the coalesced area
+		 * is out of the device), try the exact area; such buffer is
+		 * not indexed, but freed by reset_buffer() */
+		DBG(LOWPROBE, blkid_debug("\tread-ahead failed, reading exact area"));
+		bf = read_buffer(pr, base + off, len);
+		if (!bf)
+			return NULL;
+		list_add_tail(&bf->bufs, &pool->buffers);
+		return bf->data;
+	}
+	if (!bf)
+		return NULL;
+
+	list_add_tail(&bf->bufs, &pool->buffers);
+
+	/* ENOMEM is not fatal here, the buffer is only not indexed */
+	bufidx_replace(pool, idx, n, bf);
+
+	return bf->data + (base + off - bf->off);
+}
+
+/*
+ * Deallocates buffers, or detaches the probe from the pool if the pool is
+ * shared with another probe.
+ */
+static void blkid_probe_reset_buffer(blkid_probe pr)
+{
+	if (!pr || !pr->pool)
+		return;
+
+	if (pr->pool->refcount > 1) {
+		DBG(LOWPROBE, blkid_debug("detaching from shared buffers pr=%p", pr));
+		unref_bufpool(pr->pool);
+		pr->pool = NULL;
+		pr->pool_off = 0;
+		return;
+	}
 
-	INIT_LIST_HEAD(&pr->buffers);
+	DBG(LOWPROBE, blkid_debug("reseting probing buffers pr=%p", pr));
+	reset_bufpool(pr->pool);
 }
 
 /*
@@ -638,6 +1084,34 @@ int blkid_probe_is_cdrom(blkid_probe pr)
 	return pr && (pr->flags & BLKID_FL_CDROM_DEV);
 }
 
+/* resets the probe and assigns a new device */
+static void probe_reset_device(blkid_probe pr, int fd, blkid_loff_t off)
+{
+	blkid_reset_probe(pr);
+	blkid_probe_reset_buffer(pr);
+
+	if ((pr->flags & BLKID_FL_PRIVATE_FD) && pr->fd >= 0)
+		close(pr->fd);
+
+	pr->flags &= ~BLKID_FL_PRIVATE_FD;
+	pr->flags &= ~BLKID_FL_TINY_DEV;
+	pr->parent = NULL;		/* detach clone */
+	pr->flags &= ~BLKID_FL_CDROM_DEV;
+	pr->prob_flags = 0;
+	pr->fd = fd;
+	pr->membuf = NULL;
+	pr->membufsz = 0;
+	pr->read_fn = NULL;
+	pr->read_data = NULL;
+	pr->off = off;
+	pr->size = 0;
+	pr->devno = 0;
+	pr->disk_devno = 0;
+	pr->mode = 0;
+	pr->blkssz = 0;
+	pr->nwipers = 0;
+}
+
 /**
  * blkid_probe_set_device:
  * @pr: probe
@@ -658,26 +1132,7 @@ int blkid_probe_set_device(blkid_probe pr, int fd,
 	if (!pr)
 		return -1;
 
-	blkid_reset_probe(pr);
-	blkid_probe_reset_buffer(pr);
-
-	if ((pr->flags & BLKID_FL_PRIVATE_FD) && pr->fd >= 0)
-		close(pr->fd);
-
-	pr->flags &= ~BLKID_FL_PRIVATE_FD;
-	pr->flags &= ~BLKID_FL_TINY_DEV;
-	pr->flags &= ~BLKID_FL_CDROM_DEV;
-	pr->prob_flags = 0;
-	pr->fd = fd;
-	pr->off = off;
-	pr->size = 0;
-	pr->devno = 0;
-	pr->disk_devno = 0;
-	pr->mode = 0;
-	pr->blkssz = 0;
-	pr->wipe_off = 0;
-	pr->wipe_size = 0;
-	pr->wipe_chain = NULL;
+	probe_reset_device(pr, fd, off);
 
 #if defined(POSIX_FADV_RANDOM) && defined(HAVE_POSIX_FADVISE)
 	/* Disable read-ahead */
@@ -717,6 +1172,12 @@ int blkid_probe_set_device(blkid_probe pr, int fd,
 	if (pr->size <= 1440 * 1024 && !S_ISCHR(sb.st_mode))
 		pr->flags |= BLKID_FL_TINY_DEV;
 
+	/* the whole-disk is probed again, the cached partition table
+	 * for its partitions is probably obsolete */
+	if (wholedisk_cache.disk && wholedisk_cache.disk != pr && pr->devno &&
+	    wholedisk_cache.disk->devno == pr->devno)
+		drop_wholedisk_cache();
+
 #ifdef CDROM_GET_CAPABILITY
 	if (S_ISBLK(sb.st_mode) &&
 	    !blkid_probe_is_tiny(pr) &&
@@ -738,16 +1199,80 @@ err:
 
 }
 
-int blkid_probe_get_dimension(blkid_probe pr,
-		blkid_loff_t *off, blkid_loff_t *size)
+/**
+ * blkid_probe_set_buffer:
+ * @pr: probe
+ * @buf: device (image) data
+ * @bufsz: size of @buf
+ * @size: size of the whole device (zero means @bufsz)
+ *
+ * Assigns the caller's memory to the probe control struct. The data are used
+ * directly (without copying) by the probing functions. The memory has to be
+ * valid until the probe is deallocated or assigned to another device.
+ *
+ * If the @size is larger than @bufsz then areas outside @buf are read by
+ * callback defined by blkid_probe_set_read_function(), or probing functions
+ * ignore such areas if no callback is defined.
+ *
+ * The device is handled as a regular file (image).
+ *
+ * Returns: -1 in case of failure, or 0 on success.
+ */
+int blkid_probe_set_buffer(blkid_probe pr, const void *buf,
+		size_t bufsz, blkid_loff_t size)
 {
-	if (!pr)
+	if (!pr || !buf || !bufsz || size < 0)
 		return -1;
 
-	*off = pr->off;
-	*size = pr->size;
-	return 0;
-}
+	probe_reset_device(pr, -1, 0);
+
+	pr->membuf = buf;
+	pr->membufsz = bufsz;
+	pr->mode = S_IFREG;
+	pr->size = size ? size : (blkid_loff_t) bufsz;
+
+	if (pr->size <= 1440 * 1024)
+		pr->flags |= BLKID_FL_TINY_DEV;
+
+	DBG(LOWPROBE, blkid_debug("ready for low-probing in memory, bufsz=%zu, size=%jd",
+				bufsz, pr->size));
+	return 0;
+}
+
+/**
+ * blkid_probe_set_read_function:
+ * @pr: probe
+ * @fn: read callback or NULL
+ * @data: private data for @fn
+ *
+ * Defines function to read areas outside of the memory assigned by
+ * blkid_probe_set_buffer(). The callback has to return number of read bytes
+ * (which has to be the same as requested count) or -1 in case of error. The
+ * offset is relative to the begin of the device.
+ *
+ * Returns: -1 in case of failure, or 0 on success.
+ */
+int blkid_probe_set_read_function(blkid_probe pr,
+		blkid_probe_read_fn fn, void *data)
+{
+	if (!pr || !pr->membuf)
+		return -1;
+
+	pr->read_fn = fn;
+	pr->read_data = data;
+	return 0;
+}
+
+int blkid_probe_get_dimension(blkid_probe pr,
+		blkid_loff_t *off, blkid_loff_t *size)
+{
+	if (!pr)
+		return -1;
+
+	*off = pr->off;
+	*size = pr->size;
+	return 0;
+}
 
 int blkid_probe_set_dimension(blkid_probe pr,
 		blkid_loff_t off, blkid_loff_t size)
@@ -771,7 +1296,10 @@ int blkid_probe_set_dimension(blkid_probe pr,
 	if (pr->size <= 1440 * 1024 && !S_ISCHR(pr->mode))
 		pr->flags |= BLKID_FL_TINY_DEV;
 
-	blkid_probe_reset_buffer(pr);
+	/* the buffers are addressed from the begin of the device, so shared
+	 * buffers are still usable for the new area */
+	if (pr->pool && pr->pool->refcount == 1)
+		blkid_probe_reset_buffer(pr);
 
 	return 0;
 }
@@ -920,10 +1448,13 @@ int blkid_do_probe(blkid_probe pr)
 			continue;
 
 		/* rc: -1 = error, 0 = success, 1 = no result */
-		rc = chn->driver->probe(pr, chn);
+		rc = chain_probe(pr, chn, chn->driver->probe);
 
 	} while (rc == 1);
 
+	if (rc == 0)
+		report_chain_values(pr, pr->cur_chain);
+
 	return rc;
 }
 
@@ -1108,68 +1639,217 @@ int blkid_probe_step_back(blkid_probe pr)
 	return 0;
 }
 
-/**
- * blkid_do_safeprobe:
- * @pr: prober
- *
- * This function gathers probing results from all enabled chains and checks
- * for ambivalent results (e.g. more filesystems on the device).
- *
- * This is string-based NAME=value interface only.
- *
- * Note about suberblocks chain -- the function does not check for filesystems
- * when a RAID signature is detected.  The function also does not check for
- * collision between RAIDs. The first detected RAID is returned. The function
- * checks for collision between partition table and RAID signature -- it's
- * recommended to enable partitions chain together with superblocks chain.
- *
- * Returns: 0 on success, 1 if nothing is detected, -2 if ambivalen result is
- * detected and -1 on case of error.
+#ifdef HAVE_LIBPTHREAD
+/*
+ * The topology chain is mostly sysfs and ioctl() work, so it's probed by
+ * a private clone of the probe in another thread while the main thread reads
+ * superblocks and partition tables. The clone does not share buffers.
  */
-int blkid_do_safeprobe(blkid_probe pr)
+struct chain_thread {
+	pthread_t	thread;
+	blkid_probe	pr;		/* private clone */
+	int		safe;		/* safeprobe or probe */
+	int		rc;
+};
+
+static void *chain_thread_probe(void *data)
+{
+	struct chain_thread *ct = (struct chain_thread *) data;
+	struct blkid_chain *chn = &ct->pr->chains[BLKID_CHAIN_TOPLGY];
+
+	ct->pr->cur_chain = chn;
+	blkid_probe_chain_reset_position(chn);
+	ct->rc = ct->safe ? chn->driver->safeprobe(ct->pr, chn) :
+			    chn->driver->probe(ct->pr, chn);
+	blkid_probe_chain_reset_position(chn);
+	return NULL;
+}
+
+static int start_chain_thread(blkid_probe pr, struct chain_thread *ct, int safe)
+{
+	struct blkid_chain *org = &pr->chains[BLKID_CHAIN_TOPLGY], *chn;
+	blkid_probe tp;
+
+	if (!(pr->flags & BLKID_FL_PARALLEL) || !org->enabled || org->stats
+	    || (!pr->chains[BLKID_CHAIN_SUBLKS].enabled &&
+		!pr->chains[BLKID_CHAIN_PARTS].enabled))
+		return -1;
+
+	tp = blkid_clone_probe(pr);
+	if (!tp)
+		return -1;
+
+	/* private buffers (if any) */
+	unref_bufpool(tp->pool);
+	tp->pool = NULL;
+
+	chn = &tp->chains[BLKID_CHAIN_TOPLGY];
+	chn->enabled = TRUE;
+	chn->flags = org->flags;
+	chn->binary = FALSE;
+
+	ct->pr = tp;
+	ct->safe = safe;
+	ct->rc = 1;
+
+	/* the old values, as the chain does it for sequential probing */
+	blkid_probe_chain_reset_vals(pr, org);
+
+	if (pthread_create(&ct->thread, NULL, chain_thread_probe, ct)) {
+		blkid_free_probe(tp);
+		return -1;
+	}
+	DBG(LOWPROBE, blkid_debug("chain %s: started in thread", org->driver->name));
+	return 0;
+}
+
+/*
+ * Waits for the thread and moves the values to @pr, the values are in the
+ * same order as from sequential probing (sorted by chains).
+ */
+static int join_chain_thread(blkid_probe pr, struct chain_thread *ct)
 {
-	int i, count = 0, rc = 0;
+	struct blkid_chain *chn = &pr->chains[BLKID_CHAIN_TOPLGY];
+	blkid_probe tp = ct->pr;
+	int i, n, pos;
 
+	pthread_join(ct->thread, NULL);
+
+	DBG(LOWPROBE, blkid_debug("chain %s: thread finished [rc=%d]",
+				chn->driver->name, ct->rc));
+
+	if (ct->rc == 0) {
+		for (pos = 0; pos < pr->nvals; pos++) {
+			if (pr->vals[pos].chain->driver->id > BLKID_CHAIN_TOPLGY)
+				break;
+		}
+		n = min(tp->nvals, BLKID_NVALS - pr->nvals);
+
+		memmove(&pr->vals[pos + n], &pr->vals[pos],
+			(pr->nvals - pos) * sizeof(struct blkid_prval));
+		for (i = 0; i < n; i++) {
+			pr->vals[pos + i] = tp->vals[i];
+			pr->vals[pos + i].chain = chn;
+		}
+		pr->nvals += n;
+	}
+
+	blkid_free_probe(tp);
+	return ct->rc;
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/*
+ * blkid_do_safeprobe() and blkid_do_fullprobe()
+ */
+static int probe_chains(blkid_probe pr, int safe)
+{
+	int i, count = 0, rc = 0, threaded = 0, deferred = 0;
+#ifdef HAVE_LIBPTHREAD
+	struct chain_thread ct;
+#endif
 	if (!pr)
 		return -1;
 
 	blkid_probe_start(pr);
 
-	pr->prob_flags |= BLKID_PROBE_FL_IGNORE_BACKUP;
+	if (safe)
+		pr->prob_flags |= BLKID_PROBE_FL_IGNORE_BACKUP;
 
+#ifdef HAVE_LIBPTHREAD
+	threaded = start_chain_thread(pr, &ct, safe) == 0;
+#endif
 	for (i = 0; i < BLKID_NCHAINS; i++) {
 		struct blkid_chain *chn;
 
 		chn = pr->cur_chain = &pr->chains[i];
 		chn->binary = FALSE;		/* for sure... */
 
-		DBG(LOWPROBE, blkid_debug("chain safeprobe %s %s",
+		DBG(LOWPROBE, blkid_debug("chain %s %s: %s",
+				safe ? "safeprobe" : "fullprobe",
 				chn->driver->name,
 				chn->enabled? "ENABLED" : "DISABLED"));
 
 		if (!chn->enabled)
 			continue;
+		if (threaded && i == BLKID_CHAIN_TOPLGY)
+			continue;
 
 		blkid_probe_chain_reset_position(chn);
 
-		rc = chn->driver->safeprobe(pr, chn);
+		rc = chain_probe(pr, chn, safe ? chn->driver->safeprobe :
+						 chn->driver->probe);
 
 		blkid_probe_chain_reset_position(chn);
 
 		/* rc: -2 ambivalent, -1 = error, 0 = success, 1 = no result */
 		if (rc < 0)
 			goto done;	/* error */
-		if (rc == 0)
+		if (rc == 0) {
 			count++;	/* success */
+
+			/* report in the chains order */
+			if (threaded && i > BLKID_CHAIN_TOPLGY)
+				deferred |= (1 << i);
+			else
+				report_chain_values(pr, chn);
+		}
 	}
 
 done:
+#ifdef HAVE_LIBPTHREAD
+	if (threaded) {
+		int trc = join_chain_thread(pr, &ct);
+
+		if (rc >= 0 && trc < 0) {
+			/* the next chains would not be probed sequentially */
+			for (i = BLKID_CHAIN_TOPLGY + 1; i < BLKID_NCHAINS; i++) {
+				if (pr->chains[i].enabled)
+					blkid_probe_chain_reset_vals(pr, &pr->chains[i]);
+			}
+			rc = trc;
+		}
+		if (rc >= 0) {
+			if (trc == 0) {
+				count++;
+				report_chain_values(pr, &pr->chains[BLKID_CHAIN_TOPLGY]);
+			}
+			for (i = BLKID_CHAIN_TOPLGY + 1; i < BLKID_NCHAINS; i++) {
+				if (deferred & (1 << i))
+					report_chain_values(pr, &pr->chains[i]);
+			}
+		}
+	}
+#endif
 	blkid_probe_end(pr);
 	if (rc < 0)
 		return rc;
 	return count ? 0 : 1;
 }
 
+/**
+ * blkid_do_safeprobe:
+ * @pr: prober
+ *
+ * This function gathers probing results from all enabled chains and checks
+ * for ambivalent results (e.g. more filesystems on the device).
+ *
+ * This is string-based NAME=value interface only.
+ *
+ * Note about suberblocks chain -- the function does not check for filesystems
+ * when a RAID signature is detected.  The function also does not check for
+ * collision between RAIDs. The first detected RAID is returned. The function
+ * checks for collision between partition table and RAID signature -- it's
+ * recommended to enable partitions chain together with superblocks chain.
+ *
+ * Returns: 0 on success, 1 if nothing is detected, -2 if ambivalen result is
+ * detected and -1 on case of error.
+ */
+int blkid_do_safeprobe(blkid_probe pr)
+{
+	return probe_chains(pr, TRUE);
+}
+
 /**
  * blkid_do_fullprobe:
  * @pr: prober
@@ -1184,44 +1864,7 @@ done:
  */
 int blkid_do_fullprobe(blkid_probe pr)
 {
-	int i, count = 0, rc = 0;
-
-	if (!pr)
-		return -1;
-
-	blkid_probe_start(pr);
-
-	for (i = 0; i < BLKID_NCHAINS; i++) {
-		struct blkid_chain *chn;
-
-		chn = pr->cur_chain = &pr->chains[i];
-		chn->binary = FALSE;		/* for sure... */
-
-		DBG(LOWPROBE, blkid_debug("chain fullprobe %s: %s",
-				chn->driver->name,
-				chn->enabled? "ENABLED" : "DISABLED"));
-
-		if (!chn->enabled)
-			continue;
-
-		blkid_probe_chain_reset_position(chn);
-
-		rc = chn->driver->probe(pr, chn);
-
-		blkid_probe_chain_reset_position(chn);
-
-		/* rc: -1 = error, 0 = success, 1 = no result */
-		if (rc < 0)
-			goto done;	/* error */
-		if (rc == 0)
-			count++;	/* success */
-	}
-
-done:
-	blkid_probe_end(pr);
-	if (rc < 0)
-		return rc;
-	return count ? 0 : 1;
+	return probe_chains(pr, FALSE);
 }
 
 /* same sa blkid_probe_get_buffer() but works with 512-sectors */
@@ -1429,6 +2072,45 @@ int blkid_probe_is_wholedisk(blkid_probe pr)
 	return devno == disk_devno;
 }
 
+static int wholedisk_cache_is_modified(const struct stat *st)
+{
+	if (st->st_mtime != wholedisk_cache.mtime ||
+	    st->st_ctime != wholedisk_cache.ctime)
+		return 1;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	if (st->st_mtim.tv_nsec != wholedisk_cache.mtime_nsec ||
+	    st->st_ctim.tv_nsec != wholedisk_cache.ctime_nsec)
+		return 1;
+#endif
+	return 0;
+}
+
+static int wholedisk_cache_is_valid(dev_t disk)
+{
+	struct sysfs_cxt sysfs;
+	struct stat st;
+	uint64_t sz;
+	int rc;
+
+	if (!wholedisk_cache.disk || wholedisk_cache.disk->devno != disk)
+		return 0;
+
+	/* the disk has been written by device node (e.g. by fdisk) */
+	if (stat(wholedisk_cache.path, &st) != 0 || st.st_rdev != disk ||
+	    wholedisk_cache_is_modified(&st)) {
+		DBG(LOWPROBE, blkid_debug("wholedisk %s modified, drop cache",
+					wholedisk_cache.path));
+		return 0;
+	}
+
+	if (sysfs_init(&sysfs, disk, NULL))
+		return 0;
+	rc = sysfs_read_u64(&sysfs, "size", &sz);
+	sysfs_deinit(&sysfs);
+
+	return rc == 0 && (blkid_loff_t) (sz << 9) == wholedisk_cache.disk->size;
+}
+
 blkid_probe blkid_probe_get_wholedisk_probe(blkid_probe pr)
 {
 	dev_t disk;
@@ -1444,10 +2126,16 @@ blkid_probe blkid_probe_get_wholedisk_probe(blkid_probe pr)
 
 	if (pr->disk_probe && pr->disk_probe->devno != disk) {
 		/* we have disk prober, but for another disk... close it */
-		blkid_free_probe(pr->disk_probe);
+		unref_wholedisk_probe(pr->disk_probe);
 		pr->disk_probe = NULL;
 	}
 
+	if (!pr->disk_probe && wholedisk_cache_is_valid(disk)) {
+		DBG(LOWPROBE, blkid_debug("use cached wholedisk probe"));
+		pr->disk_probe = wholedisk_cache.disk;
+		pr->disk_probe->disk_refcount++;
+	}
+
 	if (!pr->disk_probe) {
 		/* Open a new disk prober */
 		char *disk_path = blkid_devno_to_devname(disk);
@@ -1459,15 +2147,52 @@ blkid_probe blkid_probe_get_wholedisk_probe(blkid_probe pr)
 
 		pr->disk_probe = blkid_new_probe_from_filename(disk_path);
 
-		free(disk_path);
-
-		if (!pr->disk_probe)
+		if (!pr->disk_probe) {
+			free(disk_path);
 			return NULL;	/* ENOMEM? */
+		}
+
+		pr->disk_probe->disk_refcount = 1;	/* @pr */
+		set_wholedisk_cache(pr->disk_probe, disk_path);
 	}
 
+	share_wholedisk_bufpool(pr, pr->disk_probe);
 	return pr->disk_probe;
 }
 
+/*
+ * Called when the whole-disk PT is parsed. The device is closed to not keep
+ * it open in the cache and the buffers are not shared with the next
+ * partitions, they would be obsolete after the partitions are modified.
+ */
+void blkid_probe_finish_wholedisk_probe(blkid_probe disk)
+{
+	if ((disk->flags & BLKID_FL_PRIVATE_FD) && disk->fd >= 0) {
+		close(disk->fd);
+		disk->fd = -1;
+	}
+	unref_bufpool(disk->pool);
+	disk->pool = NULL;
+	disk->pool_off = 0;
+}
+
+/*
+ * Forgets the whole-disk probe of the @pr and removes it from the cache.
+ */
+void blkid_probe_drop_wholedisk_probe(blkid_probe pr)
+{
+	if (pr->parent)
+		pr = pr->parent;
+	if (!pr->disk_probe)
+		return;
+
+	DBG(LOWPROBE, blkid_debug("drop wholedisk probe"));
+	if (pr->disk_probe == wholedisk_cache.disk)
+		drop_wholedisk_cache();
+	unref_wholedisk_probe(pr->disk_probe);
+	pr->disk_probe = NULL;
+}
+
 /**
  * blkid_probe_get_size:
  * @pr: probe
@@ -1507,6 +2232,201 @@ int blkid_probe_get_fd(blkid_probe pr)
 	return pr ? pr->fd : -1;
 }
 
+/**
+ * blkid_probe_enable_stats:
+ * @pr: probe
+ * @enable: TRUE/FALSE
+ *
+ * Enables or disables probing statistics. The statistics are gathered for
+ * each probing function (prober) and chain until the statistics are disabled;
+ * the next blkid_probe_enable_stats(pr, TRUE) call resets all the counters.
+ * The counters are not reset by blkid_reset_probe() or by
+ * blkid_probe_set_device(). Use blkid_probe_get_stats() to read the counters.
+ *
+ * Returns: 0 on success, or -1 in case of error.
+ */
+int blkid_probe_enable_stats(blkid_probe pr, int enable)
+{
+	int i;
+
+	if (!pr)
+		return -1;
+
+	for (i = 0; i < BLKID_NCHAINS; i++) {
+		struct blkid_chain *chn = &pr->chains[i];
+
+		free(chn->stats);
+		chn->stats = NULL;
+	}
+	pr->cur_stat = NULL;
+
+	if (!enable)
+		return 0;
+
+	for (i = 0; i < BLKID_NCHAINS; i++) {
+		struct blkid_chain *chn = &pr->chains[i];
+
+		/* the last item is for the chain itself */
+		chn->stats = calloc(chn->driver->nidinfos + 1,
+				    sizeof(struct blkid_prstat));
+		if (!chn->stats) {
+			blkid_probe_enable_stats(pr, FALSE);
+			return -1;
+		}
+	}
+
+	DBG(LOWPROBE, blkid_debug("probing statistics enabled"));
+	return 0;
+}
+
+/**
+ * blkid_probe_enable_parallel:
+ * @pr: probe
+ * @enable: TRUE/FALSE
+ *
+ * Enables or disables probing of independent chains in more threads by
+ * blkid_do_safeprobe() and blkid_do_fullprobe(). The topology chain (mostly
+ * sysfs and ioctl() calls) is probed in another thread while superblocks and
+ * partitions are read from the device, so the probing time on slow devices
+ * is about the time of the slowest chain. The result is the same as from the
+ * sequential probing. The threads are private, the probe still has to be used
+ * by one thread only.
+ *
+ * The chains are probed sequentially if the probing statistics are enabled,
+ * see blkid_probe_enable_stats().
+ *
+ * Returns: 0 on success, or -1 in case of error (or if threads are not
+ * supported).
+ */
+int blkid_probe_enable_parallel(blkid_probe pr, int enable)
+{
+	if (!pr)
+		return -1;
+#ifdef HAVE_LIBPTHREAD
+	if (enable)
+		pr->flags |= BLKID_FL_PARALLEL;
+	else
+		pr->flags &= ~BLKID_FL_PARALLEL;
+	return 0;
+#else
+	return enable ? -1 : 0;
+#endif
+}
+
+/**
+ * blkid_probe_get_stats:
+ * @pr: probe
+ * @idx: number of the statistics item
+ * @chain: returns name of the chain (e.g. "superblocks") or NULL
+ * @name: returns name of the prober (e.g. "ext4") or NULL
+ * @stats: array for the counters (BLKID_STAT_* are indexes to the array)
+ * @nstats: number of items in the @stats array
+ *
+ * Returns statistics for the probing function or for the chain. The items
+ * are sorted by chains, the last item of each chain describes the chain
+ * itself (then the @name is NULL) and the chain counters are summary for all
+ * the chain probers; the time is the total time spent in the chain.
+ *
+ * <example>
+ *   <title>print time spent in probing functions</title>
+ *   <programlisting>
+ *	uint64_t stats[BLKID_STAT_SKIPPED + 1];
+ *	const char *chain, *name;
+ *	size_t i;
+ *
+ *	for (i = 0; blkid_probe_get_stats(pr, i, &chain, &name,
+ *			stats, sizeof(stats) / sizeof(stats[0])) == 0; i++) {
+ *		if (name && stats[BLKID_STAT_CALLS])
+ *			printf("%s %s: %ju usec\n", chain, name,
+ *					stats[BLKID_STAT_TIME]);
+ *	}
+ *   </programlisting>
+ * </example>
+ *
+ * Returns: 0 on success, 1 if @idx is out of range or -1 in case of error
+ * (e.g. the statistics are not enabled).
+ */
+int blkid_probe_get_stats(blkid_probe pr, size_t idx,
+			const char **chain, const char **name,
+			uint64_t *stats, size_t nstats)
+{
+	struct blkid_chain *chn = NULL;
+	size_t i, n;
+
+	if (!pr || !pr->chains[0].stats)
+		return -1;
+
+	for (i = 0; i < BLKID_NCHAINS; i++) {
+		chn = &pr->chains[i];
+		if (idx <= chn->driver->nidinfos)
+			break;
+		idx -= chn->driver->nidinfos + 1;
+	}
+	if (i == BLKID_NCHAINS)
+		return 1;
+
+	if (chain)
+		*chain = chn->driver->name;
+	if (name)
+		*name = idx < chn->driver->nidinfos ?
+				chn->driver->idinfos[idx]->name : NULL;
+	if (!stats)
+		return 0;
+
+	nstats = min(nstats, (size_t) BLKID_NSTATS);
+	for (n = 0; n < nstats; n++)
+		stats[n] = chn->stats[idx].stats[n];
+
+	if (idx == chn->driver->nidinfos) {
+		/* chain summary -- all counters, except time and calls */
+		for (i = 0; i < chn->driver->nidinfos; i++) {
+			for (n = 0; n < nstats; n++) {
+				if (n != BLKID_STAT_TIME && n != BLKID_STAT_CALLS)
+					stats[n] += chn->stats[i].stats[n];
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Starts accounting for the prober @idx (or for the chain if @idx is
+ * chn->driver->nidinfos). The nested calls are supported, the previous
+ * state is saved in @sc and restored by blkid_probe_stop_stat().
+ */
+void blkid_probe_start_stat(blkid_probe pr, struct blkid_chain *chn,
+			    size_t idx, struct blkid_statctx *sc)
+{
+	sc->active = chn->stats != NULL;
+	if (!sc->active)
+		return;
+
+	sc->prev = pr->cur_stat;
+	pr->cur_stat = &chn->stats[idx];
+	pr->cur_stat->stats[BLKID_STAT_CALLS]++;
+	gettimeofday(&sc->start, NULL);
+}
+
+void blkid_probe_stop_stat(blkid_probe pr, struct blkid_statctx *sc)
+{
+	struct timeval now;
+
+	if (!sc->active)
+		return;
+
+	gettimeofday(&now, NULL);
+	pr->cur_stat->stats[BLKID_STAT_TIME] +=
+			(now.tv_sec - sc->start.tv_sec) * 1000000 +
+			(now.tv_usec - sc->start.tv_usec);
+	pr->cur_stat = sc->prev;
+}
+
+void blkid_probe_skip_stat(struct blkid_chain *chn, size_t idx)
+{
+	if (chn->stats)
+		chn->stats[idx].stats[BLKID_STAT_SKIPPED]++;
+}
+
 /**
  * blkid_probe_get_sectorsize:
  * @pr: probe or NULL (for NULL returns 512)
@@ -1584,6 +2504,60 @@ int blkid_probe_get_value(blkid_probe pr, int num, const char **name,
 	return 0;
 }
 
+/**
+ * blkid_probe_set_value_function:
+ * @pr: probe
+ * @fn: callback or NULL
+ * @userdata: private data for @fn
+ *
+ * Defines function to report probing results. The callback is called for
+ * each value (the same as returned by blkid_probe_get_value()) as soon as the
+ * result of a chain is final, it means after every successful
+ * blkid_do_probe() call and for every chain with a result in
+ * blkid_do_safeprobe() and blkid_do_fullprobe(). The callback is not called
+ * if nothing is detected or for ambivalent results.
+ *
+ * The @data and @name arguments point to the probing result (nothing is
+ * copied) and they are valid only within the callback. If the callback
+ * returns non-zero then the rest of the values are not reported for the
+ * current chain.
+ *
+ * This is more effective than to iterate over the values when the values are
+ * immediately printed or serialized; the probing result is still available
+ * by blkid_probe_get_value() after the probing.
+ *
+ * Returns: 0 on success, or -1 in case of error.
+ */
+int blkid_probe_set_value_function(blkid_probe pr,
+		blkid_probe_value_fn fn, void *userdata)
+{
+	if (!pr)
+		return -1;
+
+	pr->value_fn = fn;
+	pr->value_data = userdata;
+	return 0;
+}
+
+/* calls value_fn() for all @chn values */
+static void report_chain_values(blkid_probe pr, struct blkid_chain *chn)
+{
+	int i;
+
+	if (!pr->value_fn)
+		return;
+
+	for (i = 0; i < pr->nvals; i++) {
+		struct blkid_prval *v = &pr->vals[i];
+
+		if (v->chain != chn)
+			continue;
+		if (pr->value_fn(pr, v->name, (char *) v->data, v->len,
+				 pr->value_data) != 0)
+			break;
+	}
+}
+
 /**
  * blkid_probe_lookup_value:
  * @pr: probe
@@ -1675,12 +2649,9 @@ void blkid_unparse_uuid(const unsigned char *uuid, char *str, size_t len)
 /* like uuid_is_null() from libuuid, but works with arbitrary size of UUID */
 int blkid_uuid_is_empty(const unsigned char *buf, size_t len)
 {
-	size_t i;
-
-	for (i = 0; i < len; i++)
-		if (buf[i])
-			return 0;
-	return 1;
+	/* the first byte is zero and all the others are the same as the
+	 * previous ones, memcmp() compares by words */
+	return len == 0 || (buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0);
 }
 
 /* Removes whitespace from the right-hand side of a string (trailing
@@ -1735,9 +2706,9 @@ size_t blkid_ltrim_whitespace(unsigned char *str)
  * partition table is very unusual, because PT is pretty visible (parsed and
  * interpreted by kernel).
  *
- * Note that we usually expect only one signature on the device, it means that
- * we have to remember only one wiped area from previously successfully
- * detected signature.
+ * The wiped areas are kept as a set of non-overlapping intervals sorted by
+ * offset. If a new area overlaps with an already defined area then the
+ * new area wins (the later detected signature is the more important).
  *
  * blkid_probe_set_wiper() -- defines wiped area (e.g. LVM)
  * blkid_probe_use_wiper() -- try to use area (e.g. MBR)
@@ -1745,17 +2716,64 @@ size_t blkid_ltrim_whitespace(unsigned char *str)
  * Note that there is not relation between _wiper and blkid_to_wipe().
  *
  */
+
+/* returns index of the first wiper which ends after @off */
+static size_t wipers_lookup(blkid_probe pr, blkid_loff_t off)
+{
+	size_t lo = 0, hi = pr->nwipers;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct blkid_wiper *w = &pr->wipers[mid];
+
+		if (w->off + w->size <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void wipers_remove(blkid_probe pr, size_t idx)
+{
+	memmove(&pr->wipers[idx], &pr->wipers[idx + 1],
+		(pr->nwipers - idx - 1) * sizeof(struct blkid_wiper));
+	pr->nwipers--;
+}
+
+static int wipers_insert(blkid_probe pr, size_t idx, blkid_loff_t off,
+			 blkid_loff_t size, struct blkid_chain *chn)
+{
+	if (pr->nwipers == pr->wipers_max) {
+		size_t max = pr->wipers_max ? pr->wipers_max * 2 : 4;
+		struct blkid_wiper *tmp = realloc(pr->wipers, max * sizeof(*tmp));
+
+		if (!tmp)
+			return -ENOMEM;
+		pr->wipers = tmp;
+		pr->wipers_max = max;
+	}
+	memmove(&pr->wipers[idx + 1], &pr->wipers[idx],
+		(pr->nwipers - idx) * sizeof(struct blkid_wiper));
+	pr->wipers[idx].off = off;
+	pr->wipers[idx].size = size;
+	pr->wipers[idx].chain = chn;
+	pr->nwipers++;
+	return 0;
+}
+
 void blkid_probe_set_wiper(blkid_probe pr, blkid_loff_t off, blkid_loff_t size)
 {
 	struct blkid_chain *chn;
+	blkid_loff_t end = off + size;
+	size_t i;
 
 	if (!pr)
 		return;
 
 	if (!size) {
-		DBG(LOWPROBE, blkid_debug("zeroize wiper"));
-		pr->wipe_size = pr->wipe_off = 0;
-		pr->wipe_chain = NULL;
+		DBG(LOWPROBE, blkid_debug("zeroize wipers"));
+		pr->nwipers = 0;
 		return;
 	}
 
@@ -1765,15 +2783,51 @@ void blkid_probe_set_wiper(blkid_probe pr, blkid_loff_t off, blkid_loff_t size)
 	    chn->idx < 0 || (size_t) chn->idx >= chn->driver->nidinfos)
 		return;
 
-	pr->wipe_size = size;
-	pr->wipe_off = off;
-	pr->wipe_chain = chn;
+	/* cut the new area from the already defined areas */
+	i = wipers_lookup(pr, off);
+	while (i < pr->nwipers && pr->wipers[i].off < end) {
+		struct blkid_wiper *w = &pr->wipers[i];
+		blkid_loff_t wend = w->off + w->size;
+
+		if (w->off < off && wend > end) {
+			/* split */
+			if (wipers_insert(pr, i + 1, end, wend - end, w->chain))
+				return;
+			pr->wipers[i].size = off - pr->wipers[i].off;
+			i++;
+			break;
+		} else if (w->off < off) {
+			w->size = off - w->off;
+			i++;
+		} else if (wend > end) {
+			w->size = wend - end;
+			w->off = end;
+			break;
+		} else
+			wipers_remove(pr, i);
+	}
+
+	/* merge with the same chain neighbours */
+	if (i > 0 && pr->wipers[i - 1].chain == chn &&
+	    pr->wipers[i - 1].off + pr->wipers[i - 1].size == off) {
+		i--;
+		off = pr->wipers[i].off;
+		wipers_remove(pr, i);
+	}
+	if (i < pr->nwipers && pr->wipers[i].chain == chn &&
+	    pr->wipers[i].off == end) {
+		end += pr->wipers[i].size;
+		wipers_remove(pr, i);
+	}
+
+	if (wipers_insert(pr, i, off, end - off, chn))
+		return;
 
 	DBG(LOWPROBE,
-		blkid_debug("wiper set to %s::%s off=%jd size=%jd",
+		blkid_debug("wiper set to %s::%s off=%jd size=%jd [%zu wipers]",
 			chn->driver->name,
 			chn->driver->idinfos[chn->idx]->name,
-			pr->wipe_off, pr->wipe_size));
+			off, end - off, pr->nwipers));
 	return;
 }
 
@@ -1783,13 +2837,20 @@ void blkid_probe_set_wiper(blkid_probe pr, blkid_loff_t off, blkid_loff_t size)
 int blkid_probe_is_wiped(blkid_probe pr, struct blkid_chain **chn,
 		     blkid_loff_t off, blkid_loff_t size)
 {
-	if (!pr || !size)
+	size_t i;
+
+	if (!pr || !size || !pr->nwipers)
 		return 0;
 
-	if (pr->wipe_off <= off && off + size <= pr->wipe_off + pr->wipe_size) {
-		if (chn)
-			*chn = pr->wipe_chain;
-		return 1;
+	i = wipers_lookup(pr, off);
+	if (i < pr->nwipers) {
+		struct blkid_wiper *w = &pr->wipers[i];
+
+		if (w->off <= off && off + size <= w->off + w->size) {
+			if (chn)
+				*chn = w->chain;
+			return 1;
+		}
 	}
 	return 0;
 }
@@ -1803,9 +2864,18 @@ void blkid_probe_use_wiper(blkid_probe pr, blkid_loff_t off, blkid_loff_t size)
 	struct blkid_chain *chn = NULL;
 
 	if (blkid_probe_is_wiped(pr, &chn, off, size) && chn) {
+		size_t i;
+
 		DBG(LOWPROBE, blkid_debug("previously wiped area modified "
 				       " -- ignore previous results"));
-		blkid_probe_set_wiper(pr, 0, 0);
+
+		/* forget all areas wiped by the ignored chain */
+		for (i = 0; i < pr->nwipers; ) {
+			if (pr->wipers[i].chain == chn)
+				wipers_remove(pr, i);
+			else
+				i++;
+		}
 		blkid_probe_chain_reset_vals(pr, chn);
 	}
 }
@@ -58,6 +58,8 @@ static void debug_dump_dev(blkid_dev dev);
  *	The following tags may be present, depending on the device contents
  *	<LABEL="label">	(user supplied) label (volume name, etc)
  *	<UUID="uuid">	(generated) universally unique identifier (serial no)
+ *	<SIG="sig">	signature of the device content, the device is not
+ *			probed again if the signature has not been changed
  */
 
 static char *skip_over_blank(char *cp)
@@ -230,6 +232,17 @@ static int parse_dev(blkid_cache cache, blkid_dev *dev, char **cp)
 		return -BLKID_ERR_MEM;
 	}
 
+	/*
+	 * Don't overwrite already verified device (e.g. device from the
+	 * binary cache) by possibly out of date information.
+	 */
+	if ((*dev)->bid_flags & BLKID_BID_FL_VERIFIED) {
+		DBG(READ, blkid_debug("%s already verified, ignore", name));
+		*dev = NULL;
+		free(name);
+		return 0;
+	}
+
 	free(name);
 	return 1;
 }
@@ -318,6 +331,8 @@ static int parse_tag(blkid_cache cache, blkid_dev dev, char **cp)
 		dev->bid_devno = STRTOULL(value, 0, 0);
 	else if (!strcmp(name, "PRI"))
 		dev->bid_pri = strtol(value, 0, 0);
+	else if (!strcmp(name, "SIG"))
+		dev->bid_sig = STRTOULL(value, 0, 0);
 	else if (!strcmp(name, "TIME")) {
 		char *end = NULL;
 		dev->bid_time = STRTOULL(value, &end, 0);
@@ -386,10 +401,15 @@ void blkid_read_cache(blkid_cache cache)
 	char buf[4096];
 	int fd, lineno = 0;
 	struct stat st;
+	unsigned int unparsed, changed;
 
 	if (!cache)
 		return;
 
+	unparsed = cache->bic_flags & BLKID_BIC_FL_UNPARSED;
+	changed = cache->bic_flags & BLKID_BIC_FL_CHANGED;
+	cache->bic_flags &= ~BLKID_BIC_FL_UNPARSED;
+
 	/*
 	 * If the file doesn't exist, then we just return an empty
 	 * struct so that the cache can be populated.
@@ -398,8 +418,9 @@ void blkid_read_cache(blkid_cache cache)
 		return;
 	if (fstat(fd, &st) < 0)
 		goto errout;
-	if ((st.st_mtime == cache->bic_ftime) ||
-	    (cache->bic_flags & BLKID_BIC_FL_CHANGED)) {
+	if (!unparsed &&
+	    ((st.st_mtime == cache->bic_ftime) ||
+	     (cache->bic_flags & BLKID_BIC_FL_CHANGED))) {
 		DBG(CACHE, blkid_debug("skipping re-read of %s",
 					cache->bic_filename));
 		goto errout;
@@ -435,9 +456,12 @@ void blkid_read_cache(blkid_cache cache)
 	fclose(file);
 
 	/*
-	 * Initially we do not need to write out the cache file.
+	 * Initially we do not need to write out the cache file, but keep
+	 * changes in devices allocated from the binary cache.
 	 */
 	cache->bic_flags &= ~BLKID_BIC_FL_CHANGED;
+	if (unparsed)
+		cache->bic_flags |= changed;
 	cache->bic_ftime = st.st_mtime;
 
 	return;
@@ -14,6 +14,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
@@ -43,6 +44,8 @@ static int save_dev(blkid_dev dev, FILE *file)
 
 	if (dev->bid_pri)
 		fprintf(file, " PRI=\"%d\"", dev->bid_pri);
+	if (dev->bid_sig)
+		fprintf(file, " SIG=\"0x%016"PRIx64"\"", dev->bid_sig);
 	list_for_each(p, &dev->bid_tags) {
 		blkid_tag tag = list_entry(p, struct blkid_struct_tag, bit_tags);
 		fprintf(file, " %s=\"%s\"", tag->bit_name,tag->bit_val);
@@ -68,6 +71,11 @@ int blkid_flush_cache(blkid_cache cache)
 	if (!cache)
 		return -BLKID_ERR_PARAM;
 
+	/* don't lose devices which have not been read from the file yet */
+	if ((cache->bic_flags & BLKID_BIC_FL_CHANGED) &&
+	    (cache->bic_flags & BLKID_BIC_FL_UNPARSED))
+		blkid_read_cache(cache);
+
 	if (list_empty(&cache->bic_devs) ||
 	    !(cache->bic_flags & BLKID_BIC_FL_CHANGED)) {
 		DBG(SAVE, blkid_debug("skipping cache file write"));
@@ -177,6 +185,11 @@ int blkid_flush_cache(blkid_cache cache)
 						opened, filename));
 			} else {
 				DBG(SAVE, blkid_debug("moved temp cache %s", opened));
+				blkid__write_bincache(cache, filename);
+
+				/* don't re-read our own changes */
+				if (stat(filename, &st) == 0)
+					cache->bic_ftime = st.st_mtime;
 			}
 		}
 	}
@@ -169,9 +169,8 @@ static int is_str_empty(const unsigned char *str, size_t len)
 int probe_iso9660(blkid_probe pr, const struct blkid_idmag *mag)
 {
 	struct iso_volume_descriptor *iso;
-	unsigned char label[32];
-	int i;
-	int off;
+	unsigned char label[32], *vds = NULL;
+	int i, nvds;
 
 	if (strcmp(mag->magic, "CDROM") == 0)
 		return probe_iso9660_hsfs(pr, mag);
@@ -198,16 +197,21 @@ int probe_iso9660(blkid_probe pr, const struct blkid_idmag *mag)
 	if (! probe_iso9660_set_uuid(pr, &iso->modified))
 		probe_iso9660_set_uuid(pr, &iso->created);
 
-	/* Joliet Extension and Boot Record */
-	off = ISO_VD_OFFSET;
-	for (i = 0; i < ISO_VD_MAX; i++) {
-		struct boot_record *boot= (struct boot_record *)
-			blkid_probe_get_buffer(pr,
-					off,
-					max(sizeof(struct boot_record),
-					    sizeof(struct iso_volume_descriptor)));
-
-		if (boot == NULL || boot->vd_type == ISO_VD_END)
+	/* Joliet Extension and Boot Record, all the descriptors are read by
+	 * one request */
+	nvds = ISO_VD_MAX;
+	if (pr->size < ISO_VD_OFFSET + ISO_VD_MAX * ISO_SECTOR_SIZE)
+		nvds = pr->size > ISO_VD_OFFSET ?
+			(pr->size - ISO_VD_OFFSET) / ISO_SECTOR_SIZE : 0;
+	if (nvds > 0)
+		vds = blkid_probe_get_buffer(pr, ISO_VD_OFFSET,
+					     nvds * ISO_SECTOR_SIZE);
+
+	for (i = 0; vds && i < nvds; i++) {
+		struct boot_record *boot = (struct boot_record *)
+					   (vds + i * ISO_SECTOR_SIZE);
+
+		if (boot->vd_type == ISO_VD_END)
 			break;
 
 		if (boot->vd_type == ISO_VD_BOOT_RECORD) {
@@ -216,7 +220,6 @@ int probe_iso9660(blkid_probe pr, const struct blkid_idmag *mag)
 				blkid_probe_set_id_label(pr, "BOOT_SYSTEM_ID",
 							boot->boot_system_id,
 							sizeof(boot->boot_system_id));
-			off += ISO_SECTOR_SIZE;
 			continue;
 		}
 
@@ -224,7 +227,6 @@ int probe_iso9660(blkid_probe pr, const struct blkid_idmag *mag)
 		iso = (struct iso_volume_descriptor *) boot;
 
 		if (iso->vd_type != ISO_VD_SUPPLEMENTARY) {
-			off += ISO_SECTOR_SIZE;
 			continue;
 		}
 
@@ -247,7 +249,6 @@ int probe_iso9660(blkid_probe pr, const struct blkid_idmag *mag)
 					BLKID_ENC_UTF16BE);
 			goto has_label;
 		}
-		off += ISO_SECTOR_SIZE;
 	}
 
 	/* Joliet not found, let use standard iso label */
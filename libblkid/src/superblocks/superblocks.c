@@ -18,6 +18,9 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdarg.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "superblocks.h"
 
@@ -78,6 +81,7 @@
 
 static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn);
 static int superblocks_safeprobe(blkid_probe pr, struct blkid_chain *chn);
+static void superblocks_free(blkid_probe pr, void *data);
 
 static int blkid_probe_set_usage(blkid_probe pr, int usage);
 
@@ -170,8 +174,106 @@ const struct blkid_chaindrv superblocks_drv = {
 	.has_fltr     = TRUE,
 	.probe        = superblocks_probe,
 	.safeprobe    = superblocks_safeprobe,
+	.free_data    = superblocks_free
 };
 
+/*
+ * Magic strings index -- all magic strings from idinfos[] sorted by the
+ * (1KiB aligned) offset. The index is used to read every offset only once
+ * and to skip probing functions without a matching magic string, see
+ * superblocks_check_magics().
+ */
+struct sb_magic {
+	blkid_loff_t			off;	/* offset of the 1KiB buffer */
+	size_t				idx;	/* idinfos[] index */
+	const struct blkid_idmag	*mag;
+};
+
+static struct sb_magic *sb_magics;
+static size_t sb_nmagics;
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_once_t sb_magics_once = PTHREAD_ONCE_INIT;
+#endif
+
+static int cmp_sb_magic(const void *a, const void *b)
+{
+	const struct sb_magic *ma = (const struct sb_magic *) a,
+			      *mb = (const struct sb_magic *) b;
+
+	if (ma->off != mb->off)
+		return ma->off < mb->off ? -1 : 1;
+	return ma->idx < mb->idx ? -1 : ma->idx > mb->idx ? 1 : 0;
+}
+
+static void init_sb_magics(void)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag;
+
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++)
+			n++;
+	}
+
+	sb_magics = calloc(n, sizeof(struct sb_magic));
+	if (!sb_magics)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag;
+
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++) {
+			struct sb_magic *x = &sb_magics[sb_nmagics++];
+
+			x->off = (mag->kboff + (mag->sboff >> 10)) << 10;
+			x->idx = i;
+			x->mag = mag;
+		}
+	}
+
+	qsort(sb_magics, sb_nmagics, sizeof(struct sb_magic), cmp_sb_magic);
+}
+
+static void get_sb_magics(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_once(&sb_magics_once, init_sb_magics);
+#else
+	if (!sb_magics)
+		init_sb_magics();
+#endif
+}
+
+/*
+ * Private chain data
+ */
+struct superblocks_data {
+	int		hint;		/* idinfos[] index of expected type or -1 */
+	unsigned long	*nomagic;	/* probers without matching magic string */
+	unsigned long	*hint_fltr;	/* filter for hinted safeprobe */
+};
+
+static struct superblocks_data *get_superblocks_data(struct blkid_chain *chn)
+{
+	struct superblocks_data *sd = (struct superblocks_data *) chn->data;
+	size_t sz = blkid_bmp_nbytes(ARRAY_SIZE(idinfos));
+
+	if (sd)
+		return sd;
+
+	sd = calloc(1, sizeof(struct superblocks_data) + 2 * sz);
+	if (!sd)
+		return NULL;
+
+	sd->hint = -1;
+	sd->nomagic = (unsigned long *) (sd + 1);
+	sd->hint_fltr = (unsigned long *) ((char *) sd->nomagic + sz);
+	chn->data = sd;
+	return sd;
+}
+
 /**
  * blkid_probe_enable_superblocks:
  * @pr: probe
@@ -197,6 +299,12 @@ int blkid_probe_enable_superblocks(blkid_probe pr, int enable)
  * Sets probing flags to the superblocks prober. This function is optional, the
  * default are BLKID_SUBLKS_DEFAULTS flags.
  *
+ * The BLKID_SUBLKS_ZEROSKIP flag makes the first probing on the device
+ * cheaper if the device is zeroed (for example a newly provisioned LUN). The
+ * first and the last MiBs of the device and all other areas with magic strings
+ * are read at once and if all the areas contain zeros only then the probing
+ * functions are not called at all and the chain returns "nothing found".
+ *
  * Returns: 0 on success, or -1 in case of error.
  */
 int blkid_probe_set_superblocks_flags(blkid_probe pr, int flags)
@@ -208,6 +316,52 @@ int blkid_probe_set_superblocks_flags(blkid_probe pr, int flags)
 	return 0;
 }
 
+/**
+ * blkid_probe_set_superblocks_hint:
+ * @pr: prober
+ * @type: expected filesystem (or RAID, ...) type or NULL
+ *
+ * Sets the type that the caller expects on the device (for example from
+ * fstab or from the blkid cache). The hint is used by blkid_do_safeprobe(),
+ * the hinted prober is tried together with RAID probers and probers which
+ * have magic strings within the same I/O area only (the area is always read
+ * by the hinted prober). If the hinted type is detected and there is no
+ * collision with another type then the result is returned without calling
+ * the other probing functions. Otherwise the standard probing is used.
+ *
+ * Note that blkid_do_safeprobe() with the hint does not detect filesystem
+ * signatures outside the area.
+ *
+ * The hint is kept until blkid_probe_set_superblocks_hint(pr, NULL) call.
+ * Unknown types are silently ignored.
+ *
+ * Returns: 0 on success, or -1 in case of error.
+ */
+int blkid_probe_set_superblocks_hint(blkid_probe pr, const char *type)
+{
+	struct superblocks_data *sd;
+	size_t i;
+
+	if (!pr)
+		return -1;
+
+	sd = get_superblocks_data(&pr->chains[BLKID_CHAIN_SUBLKS]);
+	if (!sd)
+		return -1;
+
+	sd->hint = -1;
+	for (i = 0; type && i < ARRAY_SIZE(idinfos); i++) {
+		if (strcmp(idinfos[i]->name, type) == 0) {
+			sd->hint = i;
+			break;
+		}
+	}
+
+	DBG(LOWPROBE, blkid_debug("superblocks hint: %s",
+			sd->hint >= 0 ? idinfos[sd->hint]->name : "none"));
+	return 0;
+}
+
 /**
  * blkid_probe_reset_superblocks_filter:
  * @pr: prober
@@ -329,6 +483,161 @@ int blkid_superblocks_get_name(size_t idx, const char **name, int *usage)
 	return -1;
 }
 
+/*
+ * Returns 1 if the probing function is useless for the device.
+ */
+static int idinfo_is_ignored(blkid_probe pr, const struct blkid_idinfo *id)
+{
+	if (id->minsz && id->minsz > pr->size)
+		return 1;	/* the device is too small */
+
+	/* don't probe for RAIDs, swap or journal on CD/DVDs */
+	if ((id->usage & (BLKID_USAGE_RAID | BLKID_USAGE_OTHER)) &&
+	    blkid_probe_is_cdrom(pr))
+		return 1;
+
+	/* don't probe for RAIDs on floppies */
+	if ((id->usage & BLKID_USAGE_RAID) && blkid_probe_is_tiny(pr))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Reads all the magic string offsets (every offset only once) and marks in
+ * nomagic bitmap all probing functions where no magic string matches. The
+ * functions without magic strings are never marked.
+ */
+static void superblocks_check_magics(blkid_probe pr, struct blkid_chain *chn)
+{
+	struct superblocks_data *sd;
+	unsigned long *nomagic;
+	unsigned char *buf = NULL;
+	blkid_loff_t off = -1;
+	size_t i;
+
+	get_sb_magics();
+	if (!sb_magics)
+		return;
+
+	sd = get_superblocks_data(chn);
+	if (!sd)
+		return;
+	nomagic = sd->nomagic;
+
+	/* mark all with magic strings, and unmark on match */
+	memset(nomagic, 0, blkid_bmp_nbytes(ARRAY_SIZE(idinfos)));
+	for (i = 0; i < sb_nmagics; i++)
+		blkid_bmp_set_item(nomagic, sb_magics[i].idx);
+
+	/* submit all reads at once */
+	for (i = 0; i < sb_nmagics; i++) {
+		const struct sb_magic *x = &sb_magics[i];
+
+		if ((chn->fltr && blkid_bmp_get_item(chn->fltr, x->idx)) ||
+		    idinfo_is_ignored(pr, idinfos[x->idx]))
+			continue;
+		if (x->off != off) {
+			off = x->off;
+			blkid_probe_prefetch_area(pr, off, 1024);
+		}
+	}
+
+	off = -1;
+	for (i = 0; i < sb_nmagics; i++) {
+		const struct sb_magic *x = &sb_magics[i];
+		const struct blkid_idinfo *id = idinfos[x->idx];
+
+		if ((chn->fltr && blkid_bmp_get_item(chn->fltr, x->idx)) ||
+		    idinfo_is_ignored(pr, id))
+			continue;
+
+		if (x->off != off) {
+			off = x->off;
+			buf = blkid_probe_get_buffer(pr, off, 1024);
+		}
+		if (buf && !memcmp(x->mag->magic,
+				   buf + (x->mag->sboff & 0x3ff), x->mag->len))
+			blkid_bmp_unset_item(nomagic, x->idx);
+	}
+}
+
+/* the areas of the device checked by superblocks_is_zeroed() */
+#define SUBLKS_ZERO_HEADSZ	(1024 * 1024)
+#define SUBLKS_ZERO_TAILSZ	(2 * 1024 * 1024)	/* RAIDs up to -1.5MiB */
+
+static int is_zeroed(const unsigned char *buf, size_t len)
+{
+	size_t i, n = min(len, (size_t) 16);
+
+	for (i = 0; i < n; i++)
+		if (buf[i])
+			return 0;
+
+	/* the first 16 bytes are zero, memcmp() (vectorized by libc) of the
+	 * buffer with itself shifted by 16 bytes checks the rest */
+	return len <= 16 || memcmp(buf, buf + 16, len - 16) == 0;
+}
+
+/*
+ * Returns 1 if the begin and the end of the device (where the probing
+ * functions without magic strings look for the superblocks) and all the
+ * magic string areas contain zeros only.
+ */
+static int superblocks_is_zeroed(blkid_probe pr)
+{
+	blkid_loff_t head, tail = 0, off = -1;
+	unsigned char *buf;
+	size_t i;
+
+	get_sb_magics();
+	if (!sb_magics)
+		return 0;
+
+	head = min(pr->size, (blkid_loff_t) SUBLKS_ZERO_HEADSZ);
+	if (pr->size > head)
+		tail = max(head, pr->size - SUBLKS_ZERO_TAILSZ);
+
+	for (i = 0; i < sb_nmagics; i++) {
+		const struct sb_magic *x = &sb_magics[i];
+
+		if (x->off != off && x->off >= head && x->off < tail) {
+			off = x->off;
+			blkid_probe_prefetch_area(pr, off, 1024);
+		}
+	}
+
+	buf = blkid_probe_get_buffer(pr, 0, head);
+	if (!buf || !is_zeroed(buf, head))
+		return 0;
+	if (tail) {
+		buf = blkid_probe_get_buffer(pr, tail, pr->size - tail);
+		if (!buf || !is_zeroed(buf, pr->size - tail))
+			return 0;
+	}
+
+	off = -1;
+	for (i = 0; i < sb_nmagics; i++) {
+		const struct sb_magic *x = &sb_magics[i];
+
+		if (x->off == off || x->off < head || x->off >= tail)
+			continue;
+		off = x->off;
+		buf = blkid_probe_get_buffer(pr, off, 1024);
+		if (!buf || !is_zeroed(buf, 1024))
+			return 0;
+	}
+
+	DBG(LOWPROBE, blkid_debug("zeroed device, ignore probing functions"));
+	return 1;
+}
+
+static void superblocks_free(blkid_probe pr __attribute__((__unused__)),
+			     void *data)
+{
+	free(data);
+}
+
 /*
  * The blkid_do_probe() backend.
  */
@@ -349,12 +658,20 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 		 * is 1 byte */
 		goto nothing;
 
+	if (chn->idx < 0) {
+		if ((chn->flags & BLKID_SUBLKS_ZEROSKIP) &&
+		    superblocks_is_zeroed(pr))
+			goto nothing;
+		superblocks_check_magics(pr, chn);
+	}
+
 	i = chn->idx < 0 ? 0 : chn->idx + 1U;
 
 	for ( ; i < ARRAY_SIZE(idinfos); i++) {
 		const struct blkid_idinfo *id;
 		const struct blkid_idmag *mag = NULL;
 		blkid_loff_t off = 0;
+		struct blkid_statctx sc;
 		int rc = 0;
 
 		chn->idx = i;
@@ -362,33 +679,37 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 
 		if (chn->fltr && blkid_bmp_get_item(chn->fltr, i)) {
 			DBG(LOWPROBE, blkid_debug("filter out: %s", id->name));
+			blkid_probe_skip_stat(chn, i);
 			continue;
 		}
 
-		if (id->minsz && id->minsz > pr->size)
-			continue;	/* the device is too small */
-
-		/* don't probe for RAIDs, swap or journal on CD/DVDs */
-		if ((id->usage & (BLKID_USAGE_RAID | BLKID_USAGE_OTHER)) &&
-		    blkid_probe_is_cdrom(pr))
+		if (idinfo_is_ignored(pr, id)) {
+			blkid_probe_skip_stat(chn, i);
 			continue;
+		}
 
-		/* don't probe for RAIDs on floppies */
-		if ((id->usage & BLKID_USAGE_RAID) && blkid_probe_is_tiny(pr))
-			continue;
+		if (chn->data &&
+		    blkid_bmp_get_item(((struct superblocks_data *) chn->data)->nomagic, i)) {
+			blkid_probe_skip_stat(chn, i);
+			continue;	/* no magic string found by index */
+		}
 
 		DBG(LOWPROBE, blkid_debug("[%zd] %s:", i, id->name));
 
-		if (blkid_probe_get_idmag(pr, id, &off, &mag))
-			continue;
+		blkid_probe_start_stat(pr, chn, i, &sc);
+		rc = blkid_probe_get_idmag(pr, id, &off, &mag);
 
 		/* final check by probing function */
-		if (id->probefunc) {
+		if (!rc && id->probefunc) {
 			DBG(LOWPROBE, blkid_debug("\tcall probefunc()"));
-			if (id->probefunc(pr, mag) != 0) {
+			rc = id->probefunc(pr, mag);
+			if (rc != 0)
 				blkid_probe_chain_reset_vals(pr, chn);
-				continue;
-			}
+		}
+		blkid_probe_stop_stat(pr, &sc);
+		if (rc != 0) {
+			rc = 0;
+			continue;
 		}
 
 		/* all cheks passed */
@@ -432,7 +753,7 @@ nothing:
  * The function does not probe for ambivalent results on very small devices
  * (e.g. floppies), on small devices the first detected filesystem is returned.
  */
-static int superblocks_safeprobe(blkid_probe pr, struct blkid_chain *chn)
+static int __superblocks_safeprobe(blkid_probe pr, struct blkid_chain *chn)
 {
 	struct blkid_prval vals[BLKID_NVALS_SUBLKS];
 	int nvals = BLKID_NVALS_SUBLKS;
@@ -494,6 +815,77 @@ static int superblocks_safeprobe(blkid_probe pr, struct blkid_chain *chn)
 	return 0;
 }
 
+/*
+ * Filters out all probers except the hinted prober, RAIDs and probers with a
+ * magic string in the same I/O areas as the magic strings of the hinted
+ * prober. The RAIDs are always probed, a RAID member must not be used as a
+ * filesystem.
+ */
+static void set_hint_filter(struct blkid_chain *chn, struct superblocks_data *sd)
+{
+	const struct blkid_idmag *mag;
+	size_t sz = blkid_bmp_nbytes(ARRAY_SIZE(idinfos));
+	size_t i;
+
+	memset(sd->hint_fltr, 0xff, sz);
+	blkid_bmp_unset_item(sd->hint_fltr, sd->hint);
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		if (idinfos[i]->usage & BLKID_USAGE_RAID)
+			blkid_bmp_unset_item(sd->hint_fltr, i);
+	}
+
+	for (mag = &idinfos[sd->hint]->magics[0]; mag->magic; mag++) {
+		blkid_loff_t area = ((mag->kboff + (mag->sboff >> 10)) << 10)
+					/ BLKID_PROBE_IOSIZE_MIN;
+
+		for (i = 0; i < sb_nmagics; i++) {
+			if (sb_magics[i].off / BLKID_PROBE_IOSIZE_MIN == area)
+				blkid_bmp_unset_item(sd->hint_fltr, sb_magics[i].idx);
+		}
+	}
+
+	/* apply the caller's filter */
+	if (chn->fltr) {
+		for (i = 0; i < sz / sizeof(unsigned long); i++)
+			sd->hint_fltr[i] |= chn->fltr[i];
+	}
+}
+
+static int superblocks_safeprobe(blkid_probe pr, struct blkid_chain *chn)
+{
+	struct superblocks_data *sd = (struct superblocks_data *) chn->data;
+	unsigned long *fltr;
+	int rc;
+
+	if (!sd || sd->hint < 0 || chn->idx >= 0 ||
+	    (chn->fltr && blkid_bmp_get_item(chn->fltr, sd->hint)))
+		return __superblocks_safeprobe(pr, chn);
+
+	get_sb_magics();
+	if (!sb_magics)
+		return __superblocks_safeprobe(pr, chn);
+
+	DBG(LOWPROBE, blkid_debug("hinted safeprobe [%s]", idinfos[sd->hint]->name));
+
+	set_hint_filter(chn, sd);
+
+	fltr = chn->fltr;
+	chn->fltr = sd->hint_fltr;
+	rc = __superblocks_safeprobe(pr, chn);
+	chn->fltr = fltr;
+
+	if (rc < 0 || (rc == 0 && chn->idx == sd->hint))
+		return rc;	/* error, ambivalent or expected result */
+
+	/* nothing or something unexpected, try all probers */
+	DBG(LOWPROBE, blkid_debug("hint not confirmed, probing all"));
+	blkid_probe_chain_reset_vals(pr, chn);
+	chn->idx = -1;
+
+	return __superblocks_safeprobe(pr, chn);
+}
+
 int blkid_probe_set_version(blkid_probe pr, const char *version)
 {
 	struct blkid_chain *chn = blkid_probe_get_chain(pr);
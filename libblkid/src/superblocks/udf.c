@@ -57,12 +57,17 @@ struct volume_structure_descriptor {
 } __attribute__((packed));
 
 #define UDF_VSD_OFFSET			0x8000LL
+#define UDF_VSD_SIZE			0x800
+#define UDF_VSD_MAX			64	/* searched for NSR descriptor */
+#define UDF_VDS_MAX			64	/* searched for label */
 
 static int probe_udf(blkid_probe pr,
 		const struct blkid_idmag *mag __attribute__((__unused__)))
 {
 	struct volume_descriptor *vd;
 	struct volume_structure_descriptor *vsd;
+	unsigned char *vsds, *vds;
+	unsigned int nvsds;
 	unsigned int bs;
 	unsigned int pbs[2];
 	unsigned int b;
@@ -77,15 +82,25 @@ static int probe_udf(blkid_probe pr,
 	pbs[0] = blkid_probe_get_sectorsize(pr);
 	pbs[1] = 0x800;
 
-	/* check for a Volume Structure Descriptor (VSD); each is
-	 * 2048 bytes long */
-	for (b = 0; b < 0x8000; b += 0x800) {
-		vsd = (struct volume_structure_descriptor *)
-			blkid_probe_get_buffer(pr,
-					UDF_VSD_OFFSET + b,
-					sizeof(*vsd));
-		if (!vsd)
+	/* all the Volume Structure Descriptors (VSD) we care about are read
+	 * by one request; each is 2048 bytes long */
+	if (pr->size <= UDF_VSD_OFFSET)
+		return 1;
+	nvsds = min((blkid_loff_t) UDF_VSD_MAX,
+		    (blkid_loff_t) ((pr->size - UDF_VSD_OFFSET) / UDF_VSD_SIZE));
+	if (!nvsds)
+		return 1;
+	vsds = blkid_probe_get_buffer(pr, UDF_VSD_OFFSET,
+				      (blkid_loff_t) nvsds * UDF_VSD_SIZE);
+	if (!vsds)
+		return 1;
+
+	/* check for a VSD within the first 32KiB */
+	for (b = 0; b < 0x8000 / UDF_VSD_SIZE; b++) {
+		if (b == nvsds)
 			return 1;
+		vsd = (struct volume_structure_descriptor *)
+			(vsds + b * UDF_VSD_SIZE);
 		if (vsd->id[0] != '\0')
 			goto nsr;
 	}
@@ -93,13 +108,9 @@ static int probe_udf(blkid_probe pr,
 
 nsr:
 	/* search the list of VSDs for a NSR descriptor */
-	for (b = 0; b < 64; b++) {
+	for (b = 0; b < nvsds; b++) {
 		vsd = (struct volume_structure_descriptor *)
-			blkid_probe_get_buffer(pr,
-					UDF_VSD_OFFSET + ((blkid_loff_t) b * 0x800),
-					sizeof(*vsd));
-		if (!vsd)
-			return -1;
+			(vsds + b * UDF_VSD_SIZE);
 		if (vsd->id[0] == '\0')
 			return -1;
 		if (memcmp(vsd->id, "NSR02", 5) == 0)
@@ -132,14 +143,15 @@ real_blksz:
 	loc = le32_to_cpu(vd->type.anchor.location);
 
 	/* check if the list is usable */
-	for (b = 0; b < count; b++) {
-		vd = (struct volume_descriptor *)
-			blkid_probe_get_buffer(pr,
-					(blkid_loff_t) (loc + b) * bs,
-					sizeof(*vd));
-		if (!vd)
-			return -1;
-	}
+	if (((blkid_loff_t) loc + count) * bs > pr->size)
+		return -1;
+
+	/* read the begin of the list by one request */
+	count = min(count, (unsigned int) UDF_VDS_MAX);
+	vds = count ? blkid_probe_get_buffer(pr, (blkid_loff_t) loc * bs,
+					     (blkid_loff_t) count * bs) : NULL;
+	if (count && !vds)
+		return -1;
 
 	/* Try extract all possible ISO9660 information -- if there is
 	 * usable LABEL in ISO header then use it, otherwise read UDF
@@ -150,12 +162,7 @@ real_blksz:
 
 	/* Read UDF label */
 	for (b = 0; b < count; b++) {
-		vd = (struct volume_descriptor *)
-			blkid_probe_get_buffer(pr,
-					(blkid_loff_t) (loc + b) * bs,
-					sizeof(*vd));
-		if (!vd)
-			return -1;
+		vd = (struct volume_descriptor *) (vds + (size_t) b * bs);
 		type = le16_to_cpu(vd->tag.id);
 		if (type == 0)
 			break;
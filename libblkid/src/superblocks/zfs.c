@@ -33,6 +33,10 @@ struct zfs_uberblock {
 #define ZFS_TRIES	64
 #define ZFS_WANT	 4
 
+/* the uberblocks are checked every 4KiB within the ring of the label */
+#define ZFS_UB_STRIDE	4096
+#define ZFS_RING_SIZE	(VDEV_LABEL_SIZE - VDEV_LABEL_UBERBLOCK)
+
 #define DATA_TYPE_UINT64 8
 #define DATA_TYPE_STRING 9
 
@@ -159,57 +163,88 @@ static void zfs_extract_guid_name(blkid_probe pr, loff_t offset)
 #define zdebug(fmt, ...)	do {} while(0)
 /*#define zdebug(fmt, a...)	fprintf(stderr, fmt, ##a)*/
 
+/*
+ * Checks the uberblock ring of the label at @label. The whole ring is read
+ * by one request; the last found uberblock is returned in @ub.
+ */
+static int zfs_scan_uberblocks(blkid_probe pr, loff_t label, int *found,
+			       struct zfs_uberblock **ub, loff_t *ub_offset,
+			       int *swab_endian)
+{
+	uint64_t swab_magic = swab64(UBERBLOCK_MAGIC);
+	unsigned char *ring;
+	size_t i;
+
+	ring = blkid_probe_get_buffer(pr, label + VDEV_LABEL_UBERBLOCK,
+				      ZFS_RING_SIZE);
+	if (ring == NULL)
+		return -1;
+
+	for (i = 0; i < ZFS_TRIES / 2 && *found < ZFS_WANT; i++) {
+		struct zfs_uberblock *u = (struct zfs_uberblock *)
+					  (ring + i * ZFS_UB_STRIDE);
+
+		if (u->ub_magic == UBERBLOCK_MAGIC)
+			*swab_endian = 0;
+		else if (u->ub_magic == swab_magic)
+			*swab_endian = 1;
+		else
+			continue;
+
+		*ub = u;
+		*ub_offset = label + VDEV_LABEL_UBERBLOCK + i * ZFS_UB_STRIDE;
+		(*found)++;
+
+		zdebug("probe_zfs: found %s-endian uberblock at %llu\n",
+		       *swab_endian ? "big" : "little", *ub_offset >> 10);
+	}
+	return 0;
+}
+
 /* ZFS has 128x1kB host-endian root blocks, stored in 2 areas at the start
  * of the disk, and 2 areas at the end of the disk.  Check only some of them...
- * #4 (@ 132kB) is the first one written on a new filesystem. */
+ * #4 (@ 132kB) is the first one written on a new filesystem.
+ *
+ * The labels at the end of the disk are checked only if the front labels
+ * contain some, but not enough, uberblocks. */
 static int probe_zfs(blkid_probe pr,
 		const struct blkid_idmag *mag __attribute__((__unused__)))
 {
-	uint64_t swab_magic = swab64(UBERBLOCK_MAGIC);
-	struct zfs_uberblock *ub;
-	int swab_endian;
-	loff_t offset, ub_offset;
-	int tried;
-	int found;
+	struct zfs_uberblock *ub = NULL;
+	int swab_endian = 0;
+	loff_t ub_offset = 0;
+	int found = 0;
 
 	zdebug("probe_zfs\n");
+
 	/* Look for at least 4 uberblocks to ensure a positive match */
-	for (tried = found = 0, offset = VDEV_LABEL_UBERBLOCK;
-	     tried < ZFS_TRIES && found < ZFS_WANT;
-	     tried++, offset += 4096) {
-		/* also try the second uberblock copy */
-		if (tried == (ZFS_TRIES / 2))
-			offset = VDEV_LABEL_SIZE + VDEV_LABEL_UBERBLOCK;
-
-		ub = (struct zfs_uberblock *)
-			blkid_probe_get_buffer(pr, offset,
-					       sizeof(struct zfs_uberblock));
-		if (ub == NULL)
-			return -1;
-
-		if (ub->ub_magic == UBERBLOCK_MAGIC) {
-			ub_offset = offset;
-			found++;
-		}
+	if (zfs_scan_uberblocks(pr, 0, &found,
+				&ub, &ub_offset, &swab_endian))
+		return -1;
+	if (found < ZFS_WANT &&
+	    zfs_scan_uberblocks(pr, VDEV_LABEL_SIZE, &found,
+				&ub, &ub_offset, &swab_endian))
+		return -1;
 
-		if ((swab_endian = (ub->ub_magic == swab_magic))) {
-			ub_offset = offset;
-			found++;
-		}
+	if (found > 0 && found < ZFS_WANT) {
+		/* the disk size is aligned to the label size */
+		loff_t end = (pr->size & ~(VDEV_LABEL_SIZE - 1))
+				- 2 * VDEV_LABEL_SIZE;
 
-		zdebug("probe_zfs: found %s-endian uberblock at %llu\n",
-		       swab_endian ? "big" : "little", offset >> 10);
+		if (zfs_scan_uberblocks(pr, end, &found,
+					&ub, &ub_offset, &swab_endian) == 0
+		    && found < ZFS_WANT)
+			zfs_scan_uberblocks(pr, end + VDEV_LABEL_SIZE, &found,
+					    &ub, &ub_offset, &swab_endian);
 	}
 
-	if (found < 4)
+	if (found < ZFS_WANT)
 		return -1;
 
-	/* If we found the 4th uberblock, then we will have exited from the
-	 * scanning loop immediately, and ub will be a valid uberblock. */
 	blkid_probe_sprintf_version(pr, "%" PRIu64, swab_endian ?
 				    swab64(ub->ub_version) : ub->ub_version);
 
-	zfs_extract_guid_name(pr, offset);
+	zfs_extract_guid_name(pr, ub_offset);
 
 	if (blkid_probe_set_magic(pr, ub_offset,
 				sizeof(ub->ub_magic),
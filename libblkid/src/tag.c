@@ -26,6 +26,7 @@ static blkid_tag blkid_new_tag(void)
 
 	INIT_LIST_HEAD(&tag->bit_tags);
 	INIT_LIST_HEAD(&tag->bit_names);
+	INIT_LIST_HEAD(&tag->bit_hash.list);
 
 	return tag;
 }
@@ -53,6 +54,9 @@ void blkid_free_tag(blkid_tag tag)
 
 	list_del(&tag->bit_tags);	/* list of tags for this device */
 	list_del(&tag->bit_names);	/* list of tags with this type */
+	if (tag->bit_dev && tag->bit_dev->bid_cache)
+		blkid__hash_del(&tag->bit_dev->bid_cache->bic_taghash,
+				&tag->bit_hash);
 
 	free(tag->bit_name);
 	free(tag->bit_val);
@@ -159,6 +163,14 @@ int blkid_set_tag(blkid_dev dev, const char *name,
 		}
 		free(t->bit_val);
 		t->bit_val = val;
+
+		if (dev->bid_cache) {
+			struct blkid_hash *h = &dev->bid_cache->bic_taghash;
+
+			blkid__hash_del(h, &t->bit_hash);
+			blkid__hash_add(h, &t->bit_hash,
+					blkid__hash_tag(t->bit_name, val));
+		}
 	} else {
 		/* Existing tag not present, add to device */
 		if (!(t = blkid_new_tag()))
@@ -185,6 +197,9 @@ int blkid_set_tag(blkid_dev dev, const char *name,
 					      &dev->bid_cache->bic_tags);
 			}
 			list_add_tail(&t->bit_names, &head->bit_names);
+			blkid__hash_add(&dev->bid_cache->bic_taghash,
+					&t->bit_hash,
+					blkid__hash_tag(t->bit_name, val));
 		}
 	}
 
@@ -339,15 +354,30 @@ blkid_dev blkid_find_dev_with_tag(blkid_cache cache,
 					 const char *type,
 					 const char *value)
 {
-	blkid_tag	head;
 	blkid_dev	dev;
 	int		pri;
-	struct list_head *p;
+	struct list_head *p, *bucket;
 	int		probe_new = 0;
 
 	if (!cache || !type || !value)
 		return NULL;
 
+	/*
+	 * Try the binary cache first, only the matching device is allocated
+	 * and the text cache file is not parsed at all if the device is valid.
+	 */
+	if (cache->bic_flags & BLKID_BIC_FL_UNPARSED) {
+		dev = blkid__bincache_find_dev(cache, type, value);
+		if (dev)
+			dev = blkid_verify(cache, dev);
+		if (dev) {
+			blkid_tag tag = blkid_find_tag_dev(dev, type);
+
+			if (tag && !strcmp(tag->bit_val, value))
+				return dev;
+		}
+	}
+
 	blkid_read_cache(cache);
 
 	DBG(TAG, blkid_debug("looking for %s=%s in cache", type, value));
@@ -355,19 +385,19 @@ blkid_dev blkid_find_dev_with_tag(blkid_cache cache,
 try_again:
 	pri = -1;
 	dev = 0;
-	head = blkid_find_head_cache(cache, type);
-
-	if (head) {
-		list_for_each(p, &head->bit_names) {
-			blkid_tag tmp = list_entry(p, struct blkid_struct_tag,
-						   bit_names);
-
-			if (!strcmp(tmp->bit_val, value) &&
-			    (tmp->bit_dev->bid_pri > pri) &&
-			    !access(tmp->bit_dev->bid_name, F_OK)) {
-				dev = tmp->bit_dev;
-				pri = dev->bid_pri;
-			}
+	bucket = blkid__hash_bucket(&cache->bic_taghash,
+				    blkid__hash_tag(type, value));
+
+	list_for_each(p, bucket) {
+		blkid_tag tmp = list_entry(p, struct blkid_struct_tag,
+					   bit_hash.list);
+
+		if (!strcmp(tmp->bit_val, value) &&
+		    !strcmp(tmp->bit_name, type) &&
+		    (tmp->bit_dev->bid_pri > pri) &&
+		    !access(tmp->bit_dev->bid_name, F_OK)) {
+			dev = tmp->bit_dev;
+			pri = dev->bid_pri;
 		}
 	}
 	if (dev && !(dev->bid_flags & BLKID_BID_FL_VERIFIED)) {
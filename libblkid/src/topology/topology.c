@@ -13,6 +13,7 @@
 #include <stddef.h>
 
 #include "topology.h"
+#include "sysfs.h"
 
 /**
  * SECTION:topology
@@ -47,6 +48,12 @@
  * is zero. The MINIMUM_IO_SIZE should be always defined if kernel provides
  * topology information.
  *
+ * The topology probers (ioctl, md, dm, lvm, ...) are tried in order by default.
+ * The BLKID_TOPOLOGY_SYSFS flag (see blkid_probe_set_topology_flags()) forces
+ * the chain to read /sys/dev/block/<devno>/queue only; the queue limits are
+ * cached per whole-disk device number in the probe, so the next calls for the
+ * same disk (or another partition on the same disk) don't read sysfs again.
+ *
  * Binary interface:
  *
  * blkid_probe_get_topology()
@@ -57,6 +64,22 @@ static int topology_probe(blkid_probe pr, struct blkid_chain *chn);
 static void topology_free(blkid_probe pr, void *data);
 static int topology_is_complete(blkid_probe pr);
 static int topology_set_logical_sector_size(blkid_probe pr);
+static int topology_set_value(blkid_probe pr, const char *name,
+				size_t structoff, unsigned long data);
+
+/*
+ * Cached sysfs values, see topology_probe_sysfs()
+ */
+struct topology_sysfs_cache {
+	dev_t		disk;			/* whole-disk devno or 0 */
+	unsigned long	minimum_io_size;
+	unsigned long	optimal_io_size;
+	unsigned long	logical_sector_size;
+	unsigned long	physical_sector_size;
+
+	dev_t		devno;			/* devno of the alignment_offset */
+	int		alignment_offset;
+};
 
 /*
  * Binary interface
@@ -67,6 +90,9 @@ struct blkid_struct_topology {
 	unsigned long	optimal_io_size;
 	unsigned long	logical_sector_size;
 	unsigned long	physical_sector_size;
+
+	/* private, not reset by topology_probe() */
+	struct topology_sysfs_cache cache;
 };
 
 /*
@@ -116,6 +142,23 @@ int blkid_probe_enable_topology(blkid_probe pr, int enable)
 	return 0;
 }
 
+/**
+ * blkid_probe_set_topology_flags:
+ * @pr: prober
+ * @flags: BLKID_TOPOLOGY_* flags
+ *
+ * Sets probing flags to the topology prober. This function is optional.
+ *
+ * Returns: 0 on success, or -1 in case of error.
+ */
+int blkid_probe_set_topology_flags(blkid_probe pr, int flags)
+{
+	if (!pr)
+		return -1;
+	pr->chains[BLKID_CHAIN_TOPLGY].flags = flags;
+	return 0;
+}
+
 /**
  * blkid_probe_get_topology:
  * @pr: probe
@@ -139,6 +182,91 @@ blkid_topology blkid_probe_get_topology(blkid_probe pr)
 			&pr->chains[BLKID_CHAIN_TOPLGY]);
 }
 
+static int read_queue_limits(struct topology_sysfs_cache *c, dev_t disk)
+{
+	struct sysfs_cxt sysfs;
+	uint64_t data;
+	int rc = 1;
+
+	if (sysfs_init(&sysfs, disk, NULL) != 0)
+		return 1;
+
+	memset(c, 0, offsetof(struct topology_sysfs_cache, devno));
+
+	if (sysfs_read_u64(&sysfs, "queue/minimum_io_size", &data) != 0)
+		goto done;		/* old kernel, nothing */
+	c->minimum_io_size = data;
+
+	if (sysfs_read_u64(&sysfs, "queue/optimal_io_size", &data) == 0)
+		c->optimal_io_size = data;
+	if (sysfs_read_u64(&sysfs, "queue/logical_block_size", &data) == 0)
+		c->logical_sector_size = data;
+	if (sysfs_read_u64(&sysfs, "queue/physical_block_size", &data) == 0)
+		c->physical_sector_size = data;
+
+	c->disk = disk;
+	rc = 0;
+done:
+	sysfs_deinit(&sysfs);
+	return rc;
+}
+
+/*
+ * Reads topology from sysfs only. The queue/ limits are per whole-disk (the
+ * partitions don't have the directory) and they are cached, alignment_offset
+ * is per device.
+ */
+static int topology_probe_sysfs(blkid_probe pr, struct blkid_chain *chn)
+{
+	struct blkid_struct_topology *tp = (struct blkid_struct_topology *) chn->data;
+	struct topology_sysfs_cache *c = &tp->cache;
+	dev_t devno, disk;
+
+	devno = blkid_probe_get_devno(pr);
+	if (!devno)
+		return 1;
+	disk = blkid_probe_get_wholedisk_devno(pr);
+	if (!disk)
+		disk = devno;
+
+	if (c->disk != disk) {
+		DBG(LOWPROBE, blkid_debug("topology: reading sysfs queue limits "
+				"for %u:%u", major(disk), minor(disk)));
+		if (read_queue_limits(c, disk) != 0) {
+			c->disk = 0;
+			return 1;
+		}
+	} else
+		DBG(LOWPROBE, blkid_debug("topology: using cached limits"));
+
+	if (c->devno != devno) {
+		struct sysfs_cxt sysfs;
+		int64_t data;
+
+		c->alignment_offset = 0;
+		if (sysfs_init(&sysfs, devno, NULL) == 0) {
+			if (sysfs_read_s64(&sysfs, "alignment_offset", &data) == 0)
+				c->alignment_offset = (int) data;
+			sysfs_deinit(&sysfs);
+		}
+		c->devno = devno;
+	}
+
+	if (blkid_topology_set_minimum_io_size(pr, c->minimum_io_size) ||
+	    blkid_topology_set_optimal_io_size(pr, c->optimal_io_size) ||
+	    blkid_topology_set_physical_sector_size(pr, c->physical_sector_size) ||
+	    blkid_topology_set_alignment_offset(pr, c->alignment_offset))
+		return -1;
+
+	if (!c->logical_sector_size)
+		return topology_set_logical_sector_size(pr);
+
+	return topology_set_value(pr,
+			"LOGICAL_SECTOR_SIZE",
+			offsetof(struct blkid_struct_topology, logical_sector_size),
+			c->logical_sector_size);
+}
+
 /*
  * The blkid_do_probe() backend.
  */
@@ -152,13 +280,13 @@ static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 	if (!S_ISBLK(pr->mode))
 		return -1;	/* nothing, works with block devices only */
 
-	if (chn->binary) {
+	if (chn->binary || (chn->flags & BLKID_TOPOLOGY_SYSFS)) {
 		DBG(LOWPROBE, blkid_debug("initialize topology binary data"));
 
 		if (chn->data)
-			/* reset binary data */
+			/* reset binary data (but keep the cache) */
 			memset(chn->data, 0,
-					sizeof(struct blkid_struct_topology));
+				offsetof(struct blkid_struct_topology, cache));
 		else {
 			chn->data = calloc(1,
 					sizeof(struct blkid_struct_topology));
@@ -169,6 +297,13 @@ static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 
 	blkid_probe_chain_reset_vals(pr, chn);
 
+	if (chn->flags & BLKID_TOPOLOGY_SYSFS) {
+		if (chn->idx >= 0)
+			return 1;	/* already done */
+		chn->idx = ARRAY_SIZE(idinfos) - 1;
+		return topology_probe_sysfs(pr, chn);
+	}
+
 	DBG(LOWPROBE, blkid_debug("--> starting probing loop [TOPOLOGY idx=%d]",
 		chn->idx));
 
@@ -180,8 +315,14 @@ static int topology_probe(blkid_probe pr, struct blkid_chain *chn)
 		chn->idx = i;
 
 		if (id->probefunc) {
+			struct blkid_statctx sc;
+			int rc;
+
 			DBG(LOWPROBE, blkid_debug("%s: call probefunc()", id->name));
-			if (id->probefunc(pr, NULL) != 0)
+			blkid_probe_start_stat(pr, chn, i, &sc);
+			rc = id->probefunc(pr, NULL);
+			blkid_probe_stop_stat(pr, &sc);
+			if (rc != 0)
 				continue;
 		}
 
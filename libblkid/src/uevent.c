@@ -0,0 +1,338 @@
+/*
+ * uevent.c - keep the in-memory cache up-to-date by kernel uevents
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * The kernel sends an uevent (NETLINK_KOBJECT_UEVENT) for every added,
+ * changed and removed block device. The "change" event is also generated by
+ * udev when a device opened for writing is closed, so the events are enough
+ * to follow all changes in the system without periodic rescans.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#ifdef HAVE_LINUX_NETLINK_H
+# include <sys/socket.h>
+# include <linux/netlink.h>
+#endif
+
+#include "blkidP.h"
+
+#ifdef HAVE_LINUX_NETLINK_H
+
+/* see UEVENT_BUFFER_SIZE in kernel */
+#define BLKID_UEVENT_BUFSZ	8192
+
+/* kernel multicast group for uevents */
+#define BLKID_UEVENT_GROUP	1
+
+struct uevent {
+	const char	*action;
+	const char	*subsystem;
+	const char	*devname;
+	int		major;
+	int		minor;
+};
+
+static int parse_uevent(struct uevent *ev, char *buf, size_t sz)
+{
+	size_t i;
+
+	memset(ev, 0, sizeof(*ev));
+	ev->major = ev->minor = -1;
+
+	/* the first line is "<action>@<devpath>" */
+	if (!memchr(buf, '@', strnlen(buf, sz)))
+		return -EINVAL;
+
+	for (i = strnlen(buf, sz) + 1; i < sz; i += strnlen(buf + i, sz - i) + 1) {
+		char *key = buf + i;
+
+		if (!strncmp(key, "ACTION=", 7))
+			ev->action = key + 7;
+		else if (!strncmp(key, "SUBSYSTEM=", 10))
+			ev->subsystem = key + 10;
+		else if (!strncmp(key, "DEVNAME=", 8))
+			ev->devname = key + 8;
+		else if (!strncmp(key, "MAJOR=", 6))
+			ev->major = atoi(key + 6);
+		else if (!strncmp(key, "MINOR=", 6))
+			ev->minor = atoi(key + 6);
+	}
+
+	if (!ev->action || !ev->subsystem || !ev->devname ||
+	    ev->major < 0 || ev->minor < 0)
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Removes all the devices with @devno or @devname from the cache.
+ */
+static void remove_devices(blkid_cache cache, dev_t devno, const char *devname)
+{
+	struct list_head *p, *pnext;
+
+	list_for_each_safe(p, pnext, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+
+		if (dev->bid_devno == devno || !strcmp(dev->bid_name, devname)) {
+			DBG(PROBE, blkid_debug("uevent: removing %s", dev->bid_name));
+			blkid_free_dev(dev);
+			cache->bic_flags |= BLKID_BIC_FL_CHANGED;
+		}
+	}
+}
+
+/*
+ * Forces re-verification of the devices with @devno. The content signature
+ * (see verify.c) is kept, so unchanged devices are not probed again.
+ */
+static void invalidate_devices(blkid_cache cache, dev_t devno)
+{
+	struct list_head *p;
+
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+
+		if (dev->bid_devno == devno) {
+			dev->bid_time = 0;
+			dev->bid_flags &= ~BLKID_BID_FL_VERIFIED;
+		}
+	}
+}
+
+static int apply_uevent(blkid_cache cache, struct uevent *ev)
+{
+	dev_t devno = makedev(ev->major, ev->minor);
+
+	if (strcmp(ev->subsystem, "block") != 0)
+		return 0;
+
+	DBG(PROBE, blkid_debug("uevent: %s %s [%d:%d]",
+			ev->action, ev->devname, ev->major, ev->minor));
+
+	if (!strcmp(ev->action, "remove")) {
+		char devname[PATH_MAX];
+
+		snprintf(devname, sizeof(devname), "/dev/%s", ev->devname);
+		remove_devices(cache, devno, devname);
+
+	} else if (!strcmp(ev->action, "add") ||
+		   !strcmp(ev->action, "change") ||
+		   !strcmp(ev->action, "move") ||
+		   !strcmp(ev->action, "online")) {
+		invalidate_devices(cache, devno);
+		blkid__probe_devno(cache, ev->devname, devno);
+	} else
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Events have been lost (receive buffer overflow), use the standard way.
+ */
+static int rescan_all(blkid_cache cache)
+{
+	struct list_head *p;
+
+	DBG(PROBE, blkid_debug("uevent: events lost, rescanning all devices"));
+
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+		dev->bid_time = 0;
+	}
+	return blkid_probe_all(cache);
+}
+
+/**
+ * blkid_cache_get_uevent_fd:
+ * @cache: cache handler
+ *
+ * Opens (on the first call) netlink socket to receive kernel block device
+ * events. The file descriptor is non-blocking and it's possible to use it
+ * in poll() or select(); call blkid_cache_process_uevents() when the file
+ * descriptor is readable. The descriptor is closed by blkid_put_cache().
+ *
+ * The standard use case is a long running process which keeps the @cache in
+ * memory: call blkid_probe_all() once after blkid_cache_get_uevent_fd() and
+ * then only process the events.
+ *
+ * Returns: file descriptor or negative number in case of error.
+ */
+int blkid_cache_get_uevent_fd(blkid_cache cache)
+{
+	struct sockaddr_nl snl;
+	int fd, rc;
+
+	if (!cache)
+		return -EINVAL;
+	if (cache->bic_uevent_fd >= 0)
+		return cache->bic_uevent_fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+			NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -errno;
+
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	snl.nl_groups = BLKID_UEVENT_GROUP;
+
+	if (bind(fd, (struct sockaddr *) &snl, sizeof(snl)) != 0) {
+		rc = -errno;
+		close(fd);
+		return rc;
+	}
+
+	DBG(CACHE, blkid_debug("uevent: listening on fd %d", fd));
+	cache->bic_uevent_fd = fd;
+	return fd;
+}
+
+/**
+ * blkid_cache_process_uevents:
+ * @cache: cache handler
+ *
+ * Reads all pending events from the file descriptor returned by
+ * blkid_cache_get_uevent_fd() and applies the changes to @cache: added and
+ * changed block devices are (re)probed, removed devices are removed from
+ * the cache. If some events have been lost (the process has been too slow)
+ * then all devices are re-verified by blkid_probe_all().
+ *
+ * The function does not wait for new events.
+ *
+ * Returns: number of applied block device events, or negative number in case
+ * of error.
+ */
+int blkid_cache_process_uevents(blkid_cache cache)
+{
+	char *buf;
+	int count = 0;
+
+	if (!cache || cache->bic_uevent_fd < 0)
+		return -EINVAL;
+
+	if (cache->bic_flags & BLKID_BIC_FL_UNPARSED)
+		blkid_read_cache(cache);
+
+	buf = malloc(BLKID_UEVENT_BUFSZ);
+	if (!buf)
+		return -ENOMEM;
+
+	for (;;) {
+		struct sockaddr_nl snl;
+		struct iovec iov = { .iov_base = buf, .iov_len = BLKID_UEVENT_BUFSZ - 1 };
+		struct msghdr msg = {
+			.msg_name = &snl,
+			.msg_namelen = sizeof(snl),
+			.msg_iov = &iov,
+			.msg_iovlen = 1
+		};
+		struct uevent ev;
+		ssize_t sz;
+
+		sz = recvmsg(cache->bic_uevent_fd, &msg, MSG_DONTWAIT);
+		if (sz < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				if (rescan_all(cache) == 0)
+					count++;
+				continue;
+			}
+			if (errno != EAGAIN)
+				count = -errno;
+			break;
+		}
+
+		/* accept kernel messages only */
+		if (msg.msg_namelen != sizeof(snl) || snl.nl_pid != 0 ||
+		    (msg.msg_flags & MSG_TRUNC))
+			continue;
+
+		buf[sz] = '\0';
+		if (parse_uevent(&ev, buf, sz) == 0)
+			count += apply_uevent(cache, &ev);
+	}
+
+	free(buf);
+	return count;
+}
+
+#else /* !HAVE_LINUX_NETLINK_H */
+
+int blkid_cache_get_uevent_fd(blkid_cache cache __attribute__((__unused__)))
+{
+	return -ENOSYS;
+}
+
+int blkid_cache_process_uevents(blkid_cache cache __attribute__((__unused__)))
+{
+	return -ENOSYS;
+}
+
+#endif /* HAVE_LINUX_NETLINK_H */
+
+void blkid__close_uevents(blkid_cache cache)
+{
+	if (cache->bic_uevent_fd >= 0)
+		close(cache->bic_uevent_fd);
+	cache->bic_uevent_fd = -1;
+}
+
+#ifdef TEST_PROGRAM
+#include <poll.h>
+
+int main(int argc, char **argv)
+{
+	blkid_cache cache = NULL;
+	struct pollfd fds;
+	int rc;
+
+	blkid_init_debug(0);
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [cachefile]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (blkid_get_cache(&cache, argc == 2 ? argv[1] : "/dev/null") < 0) {
+		fprintf(stderr, "error creating cache\n");
+		return EXIT_FAILURE;
+	}
+
+	fds.fd = blkid_cache_get_uevent_fd(cache);
+	fds.events = POLLIN;
+	if (fds.fd < 0) {
+		fprintf(stderr, "cannot listen for uevents: %s\n", strerror(-fds.fd));
+		return EXIT_FAILURE;
+	}
+	blkid_probe_all(cache);
+
+	while (poll(&fds, 1, -1) > 0) {
+		blkid_dev_iterate iter;
+		blkid_dev dev;
+
+		rc = blkid_cache_process_uevents(cache);
+		if (rc <= 0)
+			continue;
+
+		printf("%d event(s) applied, cache:\n", rc);
+		iter = blkid_dev_iterate_begin(cache);
+		while (blkid_dev_next(iter, &dev) == 0)
+			printf("\t%s\n", blkid_dev_devname(dev));
+		blkid_dev_iterate_end(iter);
+	}
+
+	blkid_put_cache(cache);
+	return EXIT_SUCCESS;
+}
+#endif
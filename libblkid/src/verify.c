@@ -20,6 +20,14 @@
 #include <errno.h>
 #endif
 #include "blkidP.h"
+#include "crc64.h"
+#include "sysfs.h"
+
+/*
+ * Size of the area at the begin of the device used for the device content
+ * signature.
+ */
+#define BLKID_SIG_AREA		4096
 
 static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
 {
@@ -48,139 +56,275 @@ static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
 }
 
 /*
- * Verify that the data in dev is consistent with what is on the actual
- * block device (using the devname field only).  Normally this will be
- * called when finding items in the cache, but for long running processes
- * is also desirable to revalidate an item before use.
- *
- * If we are unable to revalidate the data, we return the old data and
- * do not set the BLKID_BID_FL_VERIFIED flag on it.
+ * Returns 1 if the @dev data have to be revalidated (the device has been
+ * modified or the cache data are too old), 0 if the cached data are usable.
  */
-blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
+int blkid__verify_needed(blkid_dev dev, struct stat *st)
 {
-	blkid_tag_iterate iter;
-	const char *type, *value;
-	struct stat st;
 	time_t diff, now;
-	int fd;
-
-	if (!dev || !cache)
-		return NULL;
 
 	now = time(0);
 	diff = now - dev->bid_time;
 
-	if (stat(dev->bid_name, &st) < 0) {
-		DBG(PROBE, blkid_debug("blkid_verify: error %m (%d) while "
-			   "trying to stat %s", errno,
-			   dev->bid_name));
-	open_err:
-		if ((errno == EPERM) || (errno == EACCES) || (errno == ENOENT)) {
-			/* We don't have read permission, just return cache data. */
-			DBG(PROBE, blkid_debug("returning unverified data for %s",
-						dev->bid_name));
-			return dev;
-		}
-		blkid_free_dev(dev);
-		return NULL;
-	}
-
 	if (now >= dev->bid_time &&
 #ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
-	    (st.st_mtime < dev->bid_time ||
-	        (st.st_mtime == dev->bid_time &&
-		 st.st_mtim.tv_nsec / 1000 <= dev->bid_utime)) &&
+	    (st->st_mtime < dev->bid_time ||
+	        (st->st_mtime == dev->bid_time &&
+		 st->st_mtim.tv_nsec / 1000 <= dev->bid_utime)) &&
 #else
-	    st.st_mtime <= dev->bid_time &&
+	    st->st_mtime <= dev->bid_time &&
 #endif
 	    (diff < BLKID_PROBE_MIN ||
 		(dev->bid_flags & BLKID_BID_FL_VERIFIED &&
 		 diff < BLKID_PROBE_INTERVAL)))
-		return dev;
+		return 0;
 
 #ifndef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
 	DBG(PROBE, blkid_debug("need to revalidate %s (cache time %lu, stat time %lu,\t"
 		   "time since last check %lu)",
 		   dev->bid_name, (unsigned long)dev->bid_time,
-		   (unsigned long)st.st_mtime, (unsigned long)diff));
+		   (unsigned long)st->st_mtime, (unsigned long)diff));
 #else
 	DBG(PROBE, blkid_debug("need to revalidate %s (cache time %lu.%lu, stat time %lu.%lu,\t"
 		   "time since last check %lu)",
 		   dev->bid_name,
 		   (unsigned long)dev->bid_time, (unsigned long)dev->bid_utime,
-		   (unsigned long)st.st_mtime, (unsigned long)st.st_mtim.tv_nsec / 1000,
+		   (unsigned long)st->st_mtime, (unsigned long)st->st_mtim.tv_nsec / 1000,
 		   (unsigned long)diff));
 #endif
+	return 1;
+}
 
-	if (!cache->probe) {
-		cache->probe = blkid_new_probe();
-		if (!cache->probe) {
-			blkid_free_dev(dev);
-			return NULL;
+static uint64_t sig_add(uint64_t sig, const void *data, size_t len)
+{
+	return crc64(sig, (const unsigned char *) data, len);
+}
+
+/*
+ * Returns a cheap signature of the device content -- library version, device
+ * size, disk sequence number (if supported by kernel), modification and change
+ * time of the device (or image file) and checksum of the first BLKID_SIG_AREA
+ * bytes. The area is read by the probe buffers, so the read is reused by the
+ * probing. The signature is never 0.
+ */
+static uint64_t get_dev_signature(blkid_probe pr)
+{
+	blkid_loff_t size = blkid_probe_get_size(pr);
+	dev_t devno = blkid_probe_get_devno(pr);
+	uint64_t sig = 0;
+	unsigned char *buf;
+	struct stat st;
+
+	sig = sig_add(sig, LIBBLKID_VERSION, sizeof(LIBBLKID_VERSION));
+	sig = sig_add(sig, &size, sizeof(size));
+
+	if (devno) {
+		struct sysfs_cxt cxt = UL_SYSFSCXT_EMPTY;
+		uint64_t seq;
+
+		if (sysfs_init(&cxt, devno, NULL) == 0) {
+			if (sysfs_read_u64(&cxt, "diskseq", &seq) == 0 ||
+			    sysfs_read_u64(&cxt, "../diskseq", &seq) == 0)
+				sig = sig_add(sig, &seq, sizeof(seq));
+			sysfs_deinit(&cxt);
 		}
 	}
 
-	fd = open(dev->bid_name, O_RDONLY|O_CLOEXEC);
+	if (fstat(blkid_probe_get_fd(pr), &st) == 0) {
+		sig = sig_add(sig, &st.st_mtime, sizeof(st.st_mtime));
+		sig = sig_add(sig, &st.st_ctime, sizeof(st.st_ctime));
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+		sig = sig_add(sig, &st.st_mtim.tv_nsec, sizeof(st.st_mtim.tv_nsec));
+		sig = sig_add(sig, &st.st_ctim.tv_nsec, sizeof(st.st_ctim.tv_nsec));
+#endif
+	}
+
+	buf = blkid_probe_get_buffer(pr, 0,
+			min(size, (blkid_loff_t) BLKID_SIG_AREA));
+	if (buf)
+		sig = sig_add(sig, buf, min(size, (blkid_loff_t) BLKID_SIG_AREA));
+
+	return sig ? sig : 1;
+}
+
+/*
+ * Probes @devname by @pr, the result is kept in @pr until the next
+ * blkid__probe_dev() or blkid__probe_dev_done() call.
+ *
+ * The @sig is the previous device content signature (or 0) and it's
+ * overwritten by the current signature. The device is not probed if
+ * the signature has not been changed.
+ *
+ * Returns: 0 if something has been detected, 1 if nothing found, 2 if the
+ * device has not been changed, -1 if the device cannot be opened (errno is
+ * set) and -2 in case of probing error.
+ */
+int blkid__probe_dev(blkid_probe pr, const char *devname, uint64_t *sig)
+{
+	uint64_t oldsig = *sig;
+	int fd, rc;
+
+	fd = open(devname, O_RDONLY|O_CLOEXEC);
 	if (fd < 0) {
 		DBG(PROBE, blkid_debug("blkid_verify: error %m (%d) while "
-					"opening %s", errno,
-					dev->bid_name));
-		goto open_err;
+					"opening %s", errno, devname));
+		return -1;
 	}
 
-	if (blkid_probe_set_device(cache->probe, fd, 0, 0)) {
+	if (blkid_probe_set_device(pr, fd, 0, 0)) {
 		/* failed to read the device */
 		close(fd);
-		blkid_free_dev(dev);
-		return NULL;
+		return -2;
 	}
 
-	/* remove old cache info */
-	iter = blkid_tag_iterate_begin(dev);
-	while (blkid_tag_next(iter, &type, &value) == 0)
-		blkid_set_tag(dev, type, NULL, 0);
-	blkid_tag_iterate_end(iter);
+	*sig = get_dev_signature(pr);
+	if (oldsig && oldsig == *sig) {
+		DBG(PROBE, blkid_debug("%s: signature not changed, "
+					"skip probing", devname));
+		close(fd);
+		return 2;
+	}
 
 	/* enable superblocks probing */
-	blkid_probe_enable_superblocks(cache->probe, TRUE);
-	blkid_probe_set_superblocks_flags(cache->probe,
+	blkid_probe_enable_superblocks(pr, TRUE);
+	blkid_probe_set_superblocks_flags(pr,
 		BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
 		BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE);
 
 	/* enable partitions probing */
-	blkid_probe_enable_partitions(cache->probe, TRUE);
-	blkid_probe_set_partitions_flags(cache->probe, BLKID_PARTS_ENTRY_DETAILS);
+	blkid_probe_enable_partitions(pr, TRUE);
+	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
 
 	/* probe */
-	if (blkid_do_safeprobe(cache->probe)) {
-		/* found nothing or error */
-		blkid_free_dev(dev);
-		dev = NULL;
-	}
+	rc = blkid_do_safeprobe(pr);
 
-	if (dev) {
+	close(fd);
+	return rc == 0 ? 0 : 1;
+}
+
+/*
+ * Resets probing result and filters after blkid__probe_dev().
+ */
+void blkid__probe_dev_done(blkid_probe pr)
+{
+	blkid_reset_probe(pr);
+	blkid_probe_reset_superblocks_filter(pr);
+	blkid_probe_set_superblocks_hint(pr, NULL);
+}
+
+/*
+ * Marks @dev as verified now.
+ */
+void blkid__probe_dev_touch(blkid_cache cache, blkid_dev dev,
+			    struct stat *st, uint64_t sig)
+{
 #ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
-		struct timeval tv;
-		if (!gettimeofday(&tv, NULL)) {
-			dev->bid_time = tv.tv_sec;
-			dev->bid_utime = tv.tv_usec;
-		} else
+	struct timeval tv;
+
+	if (!gettimeofday(&tv, NULL)) {
+		dev->bid_time = tv.tv_sec;
+		dev->bid_utime = tv.tv_usec;
+	} else
 #endif
-			dev->bid_time = time(0);
+		dev->bid_time = time(0);
 
-		dev->bid_devno = st.st_rdev;
-		dev->bid_flags |= BLKID_BID_FL_VERIFIED;
-		cache->bic_flags |= BLKID_BIC_FL_CHANGED;
+	dev->bid_devno = st->st_rdev;
+	dev->bid_sig = sig;
+	dev->bid_flags |= BLKID_BID_FL_VERIFIED;
+	cache->bic_flags |= BLKID_BIC_FL_CHANGED;
+}
 
-		blkid_probe_to_tags(cache->probe, dev);
+/*
+ * Replaces @dev tags with the result from @pr and marks @dev as verified.
+ */
+void blkid__probe_dev_apply(blkid_cache cache, blkid_dev dev,
+			    blkid_probe pr, struct stat *st, uint64_t sig)
+{
+	blkid_tag_iterate iter;
+	const char *type, *value;
 
-		DBG(PROBE, blkid_debug("%s: devno 0x%04llx, type %s",
-			   dev->bid_name, (long long)st.st_rdev, dev->bid_type));
+	/* remove old cache info */
+	iter = blkid_tag_iterate_begin(dev);
+	while (blkid_tag_next(iter, &type, &value) == 0)
+		blkid_set_tag(dev, type, NULL, 0);
+	blkid_tag_iterate_end(iter);
+
+	blkid__probe_dev_touch(cache, dev, st, sig);
+	blkid_probe_to_tags(pr, dev);
+
+	DBG(PROBE, blkid_debug("%s: devno 0x%04llx, type %s",
+		   dev->bid_name, (long long)st->st_rdev, dev->bid_type));
+}
+
+/*
+ * Verify that the data in dev is consistent with what is on the actual
+ * block device (using the devname field only).  Normally this will be
+ * called when finding items in the cache, but for long running processes
+ * is also desirable to revalidate an item before use.
+ *
+ * If we are unable to revalidate the data, we return the old data and
+ * do not set the BLKID_BID_FL_VERIFIED flag on it.
+ */
+blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
+{
+	struct stat st;
+	uint64_t sig;
+	int rc;
+
+	if (!dev || !cache)
+		return NULL;
+
+	if (stat(dev->bid_name, &st) < 0) {
+		DBG(PROBE, blkid_debug("blkid_verify: error %m (%d) while "
+			   "trying to stat %s", errno,
+			   dev->bid_name));
+	open_err:
+		if ((errno == EPERM) || (errno == EACCES) || (errno == ENOENT)) {
+			/* We don't have read permission, just return cache data. */
+			DBG(PROBE, blkid_debug("returning unverified data for %s",
+						dev->bid_name));
+			return dev;
+		}
+		blkid_free_dev(dev);
+		return NULL;
 	}
 
-	blkid_reset_probe(cache->probe);
-	blkid_probe_reset_superblocks_filter(cache->probe);
-	close(fd);
+	if (!blkid__verify_needed(dev, &st))
+		return dev;
+
+	if (!cache->probe) {
+		cache->probe = blkid_new_probe();
+		if (!cache->probe) {
+			blkid_free_dev(dev);
+			return NULL;
+		}
+	}
+
+	sig = dev->bid_sig;
+
+	/* the device is usually not reformatted, try the cached type first */
+	blkid_probe_set_superblocks_hint(cache->probe, dev->bid_type);
+
+	rc = blkid__probe_dev(cache->probe, dev->bid_name, &sig);
+	if (rc == -1)
+		goto open_err;
+	if (rc == -2) {
+		blkid_free_dev(dev);
+		return NULL;
+	}
+
+	if (rc == 2)
+		/* not changed, cached tags are valid */
+		blkid__probe_dev_touch(cache, dev, &st, sig);
+	else if (rc == 0)
+		blkid__probe_dev_apply(cache, dev, cache->probe, &st, sig);
+	else {
+		/* found nothing or error */
+		blkid_free_dev(dev);
+		dev = NULL;
+	}
+
+	blkid__probe_dev_done(cache->probe);
 	return dev;
 }
 
@@ -6,6 +6,109 @@
 
 #include "fdiskP.h"
 
+#include <sys/stat.h>
+
+/*
+ * Topology cache -- the topology and the kernel geometry are the same for
+ * all assignments of the same block device, so libblkid and the ioctls are
+ * called only once for each device. The cache is owned by the top-level
+ * context (nested contexts use the parent's cache) and it's keyed by the
+ * device number and size, so a reconfigured device (e.g. loop device) does
+ * not match the old entry.
+ */
+struct fdisk_topocache {
+	dev_t		devno;
+	uint64_t	nsects;		/* device size in 512-byte sectors */
+
+	unsigned long	min_io_size;
+	unsigned long	optimal_io_size;
+	unsigned long	phy_sector_size;
+	unsigned long	sector_size;
+	unsigned long	alignment_offset;
+
+	unsigned int	heads;
+	sector_t	sectors;
+
+	unsigned int	has_topology : 1,
+			has_geometry : 1;
+
+	struct fdisk_topocache *next;
+};
+
+static struct fdisk_topocache **topocache_head(struct fdisk_context *cxt)
+{
+	while (cxt->parent)
+		cxt = cxt->parent;
+	return &cxt->topocache;
+}
+
+static struct fdisk_topocache *get_topology_cache(struct fdisk_context *cxt,
+						  int create)
+{
+	struct fdisk_topocache *tc, **head;
+	unsigned long long nsects;
+	struct stat st;
+
+	if (cxt->dev_fd < 0 || fstat(cxt->dev_fd, &st) != 0 ||
+	    !S_ISBLK(st.st_mode))
+		return NULL;		/* cache block devices only */
+	if (blkdev_get_sectors(cxt->dev_fd, &nsects) != 0)
+		return NULL;
+
+	head = topocache_head(cxt);
+	for (tc = *head; tc; tc = tc->next) {
+		if (tc->devno == st.st_rdev && tc->nsects == nsects)
+			return tc;
+	}
+	if (!create)
+		return NULL;
+
+	tc = calloc(1, sizeof(*tc));
+	if (!tc)
+		return NULL;
+	tc->devno = st.st_rdev;
+	tc->nsects = nsects;
+	tc->next = *head;
+	*head = tc;
+	return tc;
+}
+
+/**
+ * fdisk_invalidate_topology_cache:
+ * @cxt: fdisk context
+ * @devno: device number or 0 for all devices
+ *
+ * libfdisk caches the device topology and geometry for all assignments of the
+ * same block device to the context (and its nested contexts). The cache has
+ * to be invalidated if the device properties have been changed without change
+ * of the device size.
+ *
+ * Returns: number of the dropped cache entries.
+ */
+int fdisk_invalidate_topology_cache(struct fdisk_context *cxt, dev_t devno)
+{
+	struct fdisk_topocache **tc;
+	int n = 0;
+
+	assert(cxt);
+
+	tc = topocache_head(cxt);
+	while (*tc) {
+		struct fdisk_topocache *x = *tc;
+
+		if (devno && x->devno != devno) {
+			tc = &x->next;
+			continue;
+		}
+		*tc = x->next;
+		free(x);
+		n++;
+	}
+
+	DBG(TOPOLOGY, dbgprint("topology cache: %d entries dropped", n));
+	return n;
+}
+
 /*
  * Alignment according to logical granulity (usually 1MiB)
  */
@@ -294,6 +397,7 @@ int fdisk_reset_device_properties(struct fdisk_context *cxt)
  */
 int fdisk_discover_geometry(struct fdisk_context *cxt)
 {
+	struct fdisk_topocache *tc;
 	sector_t nsects;
 
 	assert(cxt);
@@ -306,7 +410,20 @@ int fdisk_discover_geometry(struct fdisk_context *cxt)
 		cxt->total_sectors = (nsects / (cxt->sector_size >> 9));
 
 	/* what the kernel/bios thinks the geometry is */
-	blkdev_get_geometry(cxt->dev_fd, &cxt->geom.heads, (unsigned int *) &cxt->geom.sectors);
+	tc = get_topology_cache(cxt, 1);
+	if (tc && tc->has_geometry) {
+		DBG(GEOMETRY, dbgprint("using cached geometry"));
+		cxt->geom.heads = tc->heads;
+		cxt->geom.sectors = tc->sectors;
+	} else {
+		blkdev_get_geometry(cxt->dev_fd, &cxt->geom.heads,
+				    (unsigned int *) &cxt->geom.sectors);
+		if (tc) {
+			tc->heads = cxt->geom.heads;
+			tc->sectors = cxt->geom.sectors;
+			tc->has_geometry = 1;
+		}
+	}
 
 	/* obtained heads and sectors */
 	recount_geometry(cxt);
@@ -323,9 +440,26 @@ int fdisk_discover_topology(struct fdisk_context *cxt)
 #ifdef HAVE_LIBBLKID
 	blkid_probe pr;
 #endif
+	struct fdisk_topocache *tc;
+
 	assert(cxt);
 	assert(cxt->sector_size == 0);
 
+	tc = get_topology_cache(cxt, 1);
+	if (tc && tc->has_topology) {
+		DBG(TOPOLOGY, dbgprint("%s: using cached topology", cxt->dev_path));
+		cxt->min_io_size = tc->min_io_size;
+		cxt->optimal_io_size = tc->optimal_io_size;
+		cxt->phy_sector_size = tc->phy_sector_size;
+		cxt->sector_size = tc->sector_size;
+		cxt->alignment_offset = tc->alignment_offset;
+
+		cxt->io_size = cxt->optimal_io_size;
+		if (!cxt->io_size)
+			cxt->io_size = cxt->min_io_size;
+		return 0;
+	}
+
 	DBG(TOPOLOGY, dbgprint("%s: discovering topology...", cxt->dev_path));
 #ifdef HAVE_LIBBLKID
 	DBG(TOPOLOGY, dbgprint("initialize libblkid prober"));
@@ -360,6 +494,15 @@ int fdisk_discover_topology(struct fdisk_context *cxt)
 	if (!cxt->io_size)
 		cxt->io_size = cxt->sector_size;
 
+	if (tc) {
+		tc->min_io_size = cxt->min_io_size;
+		tc->optimal_io_size = cxt->optimal_io_size;
+		tc->phy_sector_size = cxt->phy_sector_size;
+		tc->sector_size = cxt->sector_size;
+		tc->alignment_offset = cxt->alignment_offset;
+		tc->has_topology = 1;
+	}
+
 	DBG(TOPOLOGY, dbgprint("result: log/phy sector size: %ld/%ld",
 			cxt->sector_size, cxt->phy_sector_size));
 	 DBG(TOPOLOGY, dbgprint("result: fdisk/min/optimal io: %ld/%ld/%ld",
@@ -521,6 +521,120 @@ int fdisk_print_table(struct fdisk_context *cxt, struct tt *tb)
 	return rc;
 }
 
+/*
+ * Allocates the output table for partitions listing, the format is defined by
+ * fdisk_context_set_table_format().
+ */
+int fdisk_init_table(struct fdisk_context *cxt, struct fdisk_table *tb)
+{
+	assert(cxt);
+	assert(tb);
+
+	memset(tb, 0, sizeof(*tb));
+
+	tb->tt = tt_new_table(TT_FL_FREEDATA | cxt->table_flags);
+	if (!tb->tt)
+		return -ENOMEM;
+	tt_set_name(tb->tt, "partitions");
+	return 0;
+}
+
+void fdisk_deinit_table(struct fdisk_table *tb)
+{
+	size_t i;
+
+	if (!tb)
+		return;
+
+	tt_free_table(tb->tt);
+	for (i = 0; i < tb->ncols; i++)
+		free(tb->names[i]);
+
+	memset(tb, 0, sizeof(*tb));
+}
+
+/* returns 1 if @name (@sz bytes) is in comma separated @list */
+static int is_column_requested(const char *list, const char *name, size_t sz)
+{
+	while (list && *list) {
+		const char *end = strchr(list, ',');
+		size_t len = end ? (size_t) (end - list) : strlen(list);
+
+		if (len == sz && strncasecmp(list, name, sz) == 0)
+			return 1;
+		list = end ? end + 1 : NULL;
+	}
+	return 0;
+}
+
+/*
+ * Defines the next column of the partitions listing. The @name is the
+ * untranslated header (use N_()), it's translated for the human readable
+ * output only.
+ *
+ * Returns: 0 on success, < 0 on error.
+ */
+int fdisk_table_define_column(struct fdisk_context *cxt,
+			      struct fdisk_table *tb, const char *name,
+			      double whint, int flags)
+{
+	const char *hdr;
+	size_t sz;
+	int *colnum;
+
+	assert(cxt);
+	assert(tb);
+	assert(tb->tt);
+	assert(name);
+
+	if (tb->ncols >= FDISK_TABLE_MAXCOLS)
+		return -EINVAL;
+
+	/* the column is always counted, the driver uses fixed numbers */
+	colnum = &tb->cols[tb->ncols++];
+	*colnum = -1;
+
+	/* ignore blanks used to align the translated headers, e.g. "Blocks " */
+	sz = strlen(name);
+	while (sz && name[sz - 1] == ' ')
+		sz--;
+
+	if (cxt->table_columns &&
+	    !is_column_requested(cxt->table_columns, name, sz))
+		return 0;
+
+	hdr = _(name);
+	if (fdisk_context_is_machine_readable(cxt)) {
+		hdr = name;
+		if (sz != strlen(name)) {
+			hdr = tb->names[tb->ncols - 1] = strndup(name, sz);
+			if (!hdr)
+				return -ENOMEM;
+		}
+	}
+	if (!tt_define_column(tb->tt, hdr, whint, flags))
+		return -ENOMEM;
+
+	*colnum = tb->tt->ncols - 1;
+	return 0;
+}
+
+/*
+ * Sets @data (allocated string) of the column @colnum as defined by the label
+ * driver. The data of the columns not requested by user are deallocated.
+ */
+int fdisk_table_set_data(struct fdisk_table *tb, struct tt_line *ln,
+			 size_t colnum, char *data)
+{
+	assert(tb);
+
+	if (colnum >= tb->ncols || tb->cols[colnum] < 0) {
+		free(data);
+		return 0;
+	}
+	return tt_line_set_data(ln, tb->cols[colnum], data);
+}
+
 #define is_print_ask(a) (fdisk_is_ask(a, WARN) || fdisk_is_ask(a, WARNX) || fdisk_is_ask(a, INFO))
 
 int fdisk_ask_print_get_errno(struct fdisk_ask *ask)
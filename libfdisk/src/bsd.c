@@ -333,7 +333,7 @@ static int bsd_list_disklabel(struct fdisk_context *cxt)
 {
 	struct bsd_disklabel *d = self_disklabel(cxt);
 	struct bsd_partition *p;
-	struct tt *tb = NULL;
+	struct fdisk_table tb;
 	int i, rc, trunc = TT_FL_TRUNC;
 
 	assert(cxt);
@@ -383,22 +383,22 @@ static int bsd_list_disklabel(struct fdisk_context *cxt)
 
 	fdisk_colon(cxt, _("partitions: %d"), d->d_npartitions);
 
-	tb = tt_new_table(TT_FL_FREEDATA);
-	if (!tb)
-		return -ENOMEM;
+	rc = fdisk_init_table(cxt, &tb);
+	if (rc)
+		return rc;
 
 	/* don't trunc anything in expert mode */
 	if (fdisk_context_display_details(cxt))
 		trunc = 0;
 
-	tt_define_column(tb, _("#"),        1, 0);
-	tt_define_column(tb, _("Start"),    9, TT_FL_RIGHT);
-	tt_define_column(tb, _("End"),      9, TT_FL_RIGHT);
-	tt_define_column(tb, _("Size"),     9, TT_FL_RIGHT);
-	tt_define_column(tb, _("Type"),     8, 0);
-	tt_define_column(tb, _("fsize"),    5, trunc);
-	tt_define_column(tb, _("bsize"),    5, trunc);
-	tt_define_column(tb, _("cpg"),      5, trunc);
+	fdisk_table_define_column(cxt, &tb, N_("#"),        1, 0);
+	fdisk_table_define_column(cxt, &tb, N_("Start"),    9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("End"),      9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Size"),     9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Type"),     8, 0);
+	fdisk_table_define_column(cxt, &tb, N_("fsize"),    5, trunc);
+	fdisk_table_define_column(cxt, &tb, N_("bsize"),    5, trunc);
+	fdisk_table_define_column(cxt, &tb, N_("cpg"),      5, trunc);
 
 	for (i = 0, p = d->d_partitions; i < d->d_npartitions; i++, p++) {
 		char *s;
@@ -406,33 +406,33 @@ static int bsd_list_disklabel(struct fdisk_context *cxt)
 
 		if (!p->p_size)
 			continue;
-		ln = tt_add_line(tb, NULL);
+		ln = tt_add_line(tb.tt, NULL);
 		if (!ln)
 			continue;
 
 		if (asprintf(&s, "%c", i + 'a') > 0)
-			tt_line_set_data(ln, 0, s);
+			fdisk_table_set_data(&tb, ln, 0, s);
 
 		if (fdisk_context_use_cylinders(cxt) && d->d_secpercyl) {
 			if (asprintf(&s, "%u%c",
 					p->p_offset / d->d_secpercyl + 1,
 					p->p_offset % d->d_secpercyl ? '*' : ' ') > 0)
-				tt_line_set_data(ln, 1, s);
+				fdisk_table_set_data(&tb, ln, 1, s);
 			if (asprintf(&s, "%u%c",
 					(p->p_offset + p->p_size + d->d_secpercyl - 1) / d->d_secpercyl,
 					(p->p_offset + p->p_size) % d->d_secpercyl ? '*' : ' ') > 0)
-				tt_line_set_data(ln, 2, s);
+				fdisk_table_set_data(&tb, ln, 2, s);
 			if (asprintf(&s, "%u%c",
 					p->p_size / d->d_secpercyl,
 					p->p_size % d->d_secpercyl ? '*' : ' ') > 0)
-				tt_line_set_data(ln, 3, s);
+				fdisk_table_set_data(&tb, ln, 3, s);
 		} else {
 			if (asprintf(&s, "%u", p->p_offset) > 0)
-				tt_line_set_data(ln, 1, s);
+				fdisk_table_set_data(&tb, ln, 1, s);
 			if (asprintf(&s, "%u", p->p_offset + p->p_size - 1) > 0)
-				tt_line_set_data(ln, 2, s);
+				fdisk_table_set_data(&tb, ln, 2, s);
 			if (asprintf(&s, "%u", p->p_size) > 0)
-				tt_line_set_data(ln, 3, s);
+				fdisk_table_set_data(&tb, ln, 3, s);
 		}
 
 		if ((unsigned) p->p_fstype < BSD_FSMAXTYPES)
@@ -440,22 +440,22 @@ static int bsd_list_disklabel(struct fdisk_context *cxt)
 		else
 			rc = asprintf(&s, "%x", p->p_fstype);
 		if (rc > 0)
-			tt_line_set_data(ln, 4, s);
+			fdisk_table_set_data(&tb, ln, 4, s);
 
 		if (p->p_fstype == BSD_FS_UNUSED
 		    || p->p_fstype == BSD_FS_BSDFFS) {
 			if (asprintf(&s, "%u", p->p_fsize) > 0)
-				tt_line_set_data(ln, 5, s);
+				fdisk_table_set_data(&tb, ln, 5, s);
 			if (asprintf(&s, "%u", p->p_fsize * p->p_frag) > 0)
-				tt_line_set_data(ln, 6, s);
+				fdisk_table_set_data(&tb, ln, 6, s);
 		}
 		if (p->p_fstype == BSD_FS_BSDFFS
 		    && asprintf(&s, "%u", p->p_cpg) > 0)
-			tt_line_set_data(ln, 7, s);
+			fdisk_table_set_data(&tb, ln, 7, s);
 	}
 
-	rc = fdisk_print_table(cxt, tb);
-	tt_free_table(tb);
+	rc = fdisk_print_table(cxt, tb.tt);
+	fdisk_deinit_table(&tb);
 
 	return rc;
 }
@@ -596,10 +596,12 @@ int fdisk_bsd_write_bootstrap(struct fdisk_context *cxt)
 		goto done;
 	}
 	if (write_all(cxt->dev_fd, l->bsdbuffer, BSD_BBSIZE)) {
-		fdisk_warn(cxt, _("cannot write %s"), cxt->dev_path);
 		rc = -errno;
+		fdisk_invalidate_sectors(cxt);
+		fdisk_warn(cxt, _("cannot write %s"), cxt->dev_path);
 		goto done;
 	}
+	fdisk_invalidate_sectors(cxt);
 
 	fdisk_sinfo(cxt, FDISK_INFO_SUCCESS,
 			_("Bootstrap installed on %s."), cxt->dev_path);
@@ -695,8 +697,8 @@ static int bsd_readlabel(struct fdisk_context *cxt)
 {
 	struct fdisk_bsd_label *l;
 	struct bsd_disklabel *d;
-	int t;
-	off_t offset = 0;
+	int t, rc;
+	sector_t start = 0;
 
 	l = self_label(cxt);
 	d = self_disklabel(cxt);
@@ -704,12 +706,15 @@ static int bsd_readlabel(struct fdisk_context *cxt)
 	if (l->dos_part)
 		/* BSD is nested within DOS partition, get the begin of the
 		 * partition. Note that DOS uses native sector size. */
-		offset = dos_partition_get_start(l->dos_part) * cxt->sector_size;
+		start = dos_partition_get_start(l->dos_part);
 
-	if (lseek(cxt->dev_fd, offset, SEEK_SET) == -1)
-		return -1;
-	if (read_all(cxt->dev_fd, l->bsdbuffer, sizeof(l->bsdbuffer)) < 0)
-		return errno ? -errno : -1;
+	if (sizeof(l->bsdbuffer) % cxt->sector_size)
+		return -EINVAL;
+	rc = fdisk_read_sectors(cxt, start,
+				sizeof(l->bsdbuffer) / cxt->sector_size,
+				l->bsdbuffer);
+	if (rc)
+		return rc;
 
 	/* The offset to begin of the disk label. Note that BSD uses
 	 * 512-byte (default) sectors. */
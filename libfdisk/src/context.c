@@ -3,6 +3,7 @@
 #endif
 
 #include "fdiskP.h"
+#include "strutils.h"
 
 struct fdisk_context *fdisk_new_context(void)
 {
@@ -62,6 +63,10 @@ struct fdisk_context *fdisk_new_nested_context(struct fdisk_context *parent,
 
 	cxt->geom = parent->geom;
 
+	cxt->table_flags =	parent->table_flags;
+	if (parent->table_columns)
+		cxt->table_columns = strdup(parent->table_columns);
+
 	if (name) {
 		if (strcmp(name, "bsd") == 0)
 			lb = cxt->labels[ cxt->nlabels++ ] = fdisk_new_bsd_label(cxt);
@@ -176,6 +181,7 @@ static void reset_context(struct fdisk_context *cxt)
 	cxt->dev_path = NULL;
 	cxt->firstsector = NULL;
 
+	fdisk_free_sectors(cxt);
 	fdisk_zeroize_device_properties(cxt);
 
 	cxt->label = NULL;
@@ -331,12 +337,17 @@ void fdisk_free_context(struct fdisk_context *cxt)
 	for (i = 0; i < cxt->nlabels; i++) {
 		if (!cxt->labels[i])
 			continue;
+		fdisk_free_parttypes_index(cxt->labels[i]);
 		if (cxt->labels[i]->op->free)
 			cxt->labels[i]->op->free(cxt->labels[i]);
 		else
 			free(cxt->labels[i]);
 	}
 
+	if (!cxt->parent)
+		fdisk_invalidate_topology_cache(cxt, 0);
+
+	free(cxt->table_columns);
 	free(cxt);
 }
 
@@ -403,6 +414,82 @@ int fdisk_context_listonly(struct fdisk_context *cxt)
 	return cxt->listonly == 1;
 }
 
+/**
+ * fdisk_context_set_table_format:
+ * cxt: context
+ * str: comma separated list of "raw", "json", "export", "stream" and
+ *      "noheadings", or NULL
+ *
+ * Sets the output format of the partitions listing. The "raw", "json" and
+ * "export" formats are machine readable, the column names are not translated
+ * in this case. The "stream" format prints the partitions as they are
+ * listed. NULL means the default human readable output.
+ *
+ * Returns: 0 on success, < 0 on error.
+ */
+int fdisk_context_set_table_format(struct fdisk_context *cxt, const char *str)
+{
+	int flags = 0;
+
+	assert(cxt);
+
+	while (str && *str) {
+		const char *end = strchr(str, ',');
+		size_t sz = end ? (size_t) (end - str) : strlen(str);
+
+		if (sz == 3 && strncmp(str, "raw", sz) == 0)
+			flags |= TT_FL_RAW;
+		else if (sz == 4 && strncmp(str, "json", sz) == 0)
+			flags |= TT_FL_JSON;
+		else if (sz == 6 && strncmp(str, "export", sz) == 0)
+			flags |= TT_FL_EXPORT;
+		else if (sz == 6 && strncmp(str, "stream", sz) == 0)
+			flags |= TT_FL_STREAM;
+		else if (sz == 10 && strncmp(str, "noheadings", sz) == 0)
+			flags |= TT_FL_NOHEADINGS;
+		else
+			return -EINVAL;
+
+		str = end ? end + 1 : NULL;
+	}
+
+	/* JSON is printed by tt_print_table() only */
+	if (flags & TT_FL_JSON)
+		flags &= ~TT_FL_STREAM;
+
+	DBG(CONTEXT, dbgprint("table flags: 0x%x", flags));
+	cxt->table_flags = flags;
+	return 0;
+}
+
+/**
+ * fdisk_context_set_table_columns:
+ * cxt: context
+ * str: comma separated list of the column names or NULL
+ *
+ * Selects the columns of the partitions listing. The names are compared
+ * case-insensitive with the untranslated column headers (e.g. "Device",
+ * "Start", "Size"); the columns not supported by the current label are
+ * ignored. NULL means all columns.
+ *
+ * Returns: 0 on success, < 0 on error.
+ */
+int fdisk_context_set_table_columns(struct fdisk_context *cxt, const char *str)
+{
+	assert(cxt);
+
+	if (!strdup_to_struct_member(cxt, table_columns, str) && str)
+		return -ENOMEM;
+	return 0;
+}
+
+/* Returns 1 if the partitions listing is in raw, JSON or export format. */
+int fdisk_context_is_machine_readable(struct fdisk_context *cxt)
+{
+	assert(cxt);
+	return (cxt->table_flags & (TT_FL_RAW | TT_FL_JSON | TT_FL_EXPORT)) ? 1 : 0;
+}
+
 
 /*
  * @str: "cylinder" or "sector".
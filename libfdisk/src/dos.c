@@ -195,13 +195,7 @@ static int seek_sector(struct fdisk_context *cxt, sector_t secno)
 static int read_sector(struct fdisk_context *cxt, sector_t secno,
 			unsigned char *buf)
 {
-	int rc = seek_sector(cxt, secno);
-
-	if (rc < 0)
-		return rc;
-
-	return read(cxt->dev_fd, buf, cxt->sector_size) !=
-			(ssize_t) cxt->sector_size ? -errno : 0;
+	return fdisk_read_sectors(cxt, secno, 1, buf);
 }
 
 /* Allocate a buffer and read a partition table sector */
@@ -1021,7 +1015,7 @@ static int add_partition(struct fdisk_context *cxt, size_t n, struct fdisk_partt
 	return 0;
 }
 
-static int add_logical(struct fdisk_context *cxt)
+static int add_logical(struct fdisk_context *cxt, struct fdisk_parttype *t)
 {
 	struct dos_partition *p4 = self_partition(cxt, 4);
 
@@ -1045,7 +1039,7 @@ static int add_logical(struct fdisk_context *cxt)
 	}
 	fdisk_info(cxt, _("Adding logical partition %zu"),
 			cxt->label->nparts_max);
-	return add_partition(cxt, cxt->label->nparts_max - 1, NULL);
+	return add_partition(cxt, cxt->label->nparts_max - 1, t);
 }
 
 static void check(struct fdisk_context *cxt, size_t n,
@@ -1265,7 +1259,7 @@ static int dos_add_partition(
 	if (!free_primary) {
 		if (l->ext_offset) {
 			fdisk_info(cxt, _("All primary partitions are in use."));
-			rc = add_logical(cxt);
+			rc = add_logical(cxt, t);
 		} else
 			fdisk_info(cxt, _("If you want to create more than "
 				"four partitions, you must replace a "
@@ -1313,7 +1307,7 @@ static int dos_add_partition(
 				rc = add_partition(cxt, j, t);
 			goto done;
 		} else if (c == 'l' && l->ext_offset) {
-			rc = add_logical(cxt);
+			rc = add_logical(cxt, t);
 			goto done;
 		} else if (c == 'e' && !l->ext_offset) {
 			int j = get_partition_unused_primary(cxt);
@@ -1541,30 +1535,30 @@ static int dos_fulllist_disklabel(struct fdisk_context *cxt, int ext)
 {
 	int rc;
 	size_t i;
-	struct tt *tb = NULL;
+	struct fdisk_table tb;
 
 	assert(cxt);
 	assert(cxt->label);
 	assert(fdisk_is_disklabel(cxt, DOS));
 
-	tb = tt_new_table(TT_FL_FREEDATA);
-	if (!tb)
-		return -ENOMEM;
+	rc = fdisk_init_table(cxt, &tb);
+	if (rc)
+		return rc;
 
-	tt_define_column(tb, _("Nr"), 2, TT_FL_RIGHT);
-	tt_define_column(tb, _("AF"), 2, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Nr"), 2, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("AF"), 2, TT_FL_RIGHT);
 
-	tt_define_column(tb, _("Hd"),  4, TT_FL_RIGHT);
-	tt_define_column(tb, _("Sec"), 4, TT_FL_RIGHT);
-	tt_define_column(tb, _("Cyl"), 5, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Hd"),  4, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Sec"), 4, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Cyl"), 5, TT_FL_RIGHT);
 
-	tt_define_column(tb, _("Hd"),  4, TT_FL_RIGHT);
-	tt_define_column(tb, _("Sec"), 4, TT_FL_RIGHT);
-	tt_define_column(tb, _("Cyl"), 5, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Hd"),  4, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Sec"), 4, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Cyl"), 5, TT_FL_RIGHT);
 
-	tt_define_column(tb, _("Start"), 9, TT_FL_RIGHT);
-	tt_define_column(tb, _("Size"),  9, TT_FL_RIGHT);
-	tt_define_column(tb, _("Id"),    2, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Start"), 9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Size"),  9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Id"),    2, TT_FL_RIGHT);
 
 	for (i = 0 ; i < cxt->label->nparts_max; i++) {
 		struct pte *pe = self_pte(cxt, i);
@@ -1575,45 +1569,45 @@ static int dos_fulllist_disklabel(struct fdisk_context *cxt, int ext)
 		p = ext ? pe->ex_entry : pe->pt_entry;
 		if (!p)
 			continue;
-		ln = tt_add_line(tb, NULL);
+		ln = tt_add_line(tb.tt, NULL);
 		if (!ln)
 			continue;
 
 		if (asprintf(&str, "%zu",  i + 1) > 0)
-			tt_line_set_data(ln, 0, str);		/* Nr */
+			fdisk_table_set_data(&tb, ln, 0, str);		/* Nr */
 		if (asprintf(&str, "%02x", p->boot_ind) > 0)
-			tt_line_set_data(ln, 1, str);		/* AF */
+			fdisk_table_set_data(&tb, ln, 1, str);		/* AF */
 
 		if (asprintf(&str, "%d", p->bh) > 0)
-			tt_line_set_data(ln, 2, str);		/* Hd */
+			fdisk_table_set_data(&tb, ln, 2, str);		/* Hd */
 		if (asprintf(&str, "%d", sector(p->bs)) > 0)
-			tt_line_set_data(ln, 3, str);		/* Sec */
+			fdisk_table_set_data(&tb, ln, 3, str);		/* Sec */
 		if (asprintf(&str, "%d", cylinder(p->bs, p->bc)) > 0)
-			tt_line_set_data(ln, 4, str);		/* Cyl */
+			fdisk_table_set_data(&tb, ln, 4, str);		/* Cyl */
 
 		if (asprintf(&str, "%d", p->eh) > 0)
-			tt_line_set_data(ln, 5, str);		/* Hd */
+			fdisk_table_set_data(&tb, ln, 5, str);		/* Hd */
 		if (asprintf(&str, "%d", sector(p->es)) > 0)
-			tt_line_set_data(ln, 6, str);		/* Sec */
+			fdisk_table_set_data(&tb, ln, 6, str);		/* Sec */
 		if (asprintf(&str, "%d", cylinder(p->es, p->ec)) > 0)
-			tt_line_set_data(ln, 7, str);		/* Cyl */
+			fdisk_table_set_data(&tb, ln, 7, str);		/* Cyl */
 
 		if (asprintf(&str, "%lu",
 			(unsigned long) dos_partition_get_start(p)) > 0)
-			tt_line_set_data(ln, 8, str);		/* Start */
+			fdisk_table_set_data(&tb, ln, 8, str);		/* Start */
 		if (asprintf(&str, "%lu",
 			(unsigned long) dos_partition_get_size(p)) > 0)
-			tt_line_set_data(ln, 9, str);		/* End */
+			fdisk_table_set_data(&tb, ln, 9, str);		/* End */
 
 		if (asprintf(&str, "%02x", p->sys_ind) > 0)
-			tt_line_set_data(ln, 10, str);		/* Id */
+			fdisk_table_set_data(&tb, ln, 10, str);		/* Id */
 
 		check_consistency(cxt, p, i);
 		fdisk_warn_alignment(cxt, get_abs_partition_start(pe), i);
 	}
 
-	rc = fdisk_print_table(cxt, tb);
-	tt_free_table(tb);
+	rc = fdisk_print_table(cxt, tb.tt);
+	fdisk_deinit_table(&tb);
 
 	return rc;
 }
@@ -1627,7 +1621,8 @@ static int dos_list_disklabel(struct fdisk_context *cxt)
 {
 	int rc = 0, trunc = TT_FL_TRUNC;
 	size_t i;
-	struct tt *tb = NULL;
+	struct fdisk_table tb;
+	const char *pad;
 
 	assert(cxt);
 	assert(cxt->label);
@@ -1642,22 +1637,25 @@ static int dos_list_disklabel(struct fdisk_context *cxt)
 	if (fdisk_context_display_details(cxt))
 		return dos_fulllist_disklabel(cxt, 0);
 
-	tb = tt_new_table(TT_FL_FREEDATA);
-	if (!tb)
-		return -ENOMEM;
+	rc = fdisk_init_table(cxt, &tb);
+	if (rc)
+		return rc;
 
 	/* don't trunc anything in expert mode */
 	if (fdisk_context_display_details(cxt))
 		trunc = 0;
 
-	tt_define_column(tb, _("Device"), 0.1, 0);
-	tt_define_column(tb, _("Boot"),     1, 0);
-	tt_define_column(tb, _("Start"),    9, TT_FL_RIGHT);
-	tt_define_column(tb, _("End"),      9, TT_FL_RIGHT);
+	/* blanks to align the human readable output only */
+	pad = fdisk_context_is_machine_readable(cxt) ? "" : " ";
+
+	fdisk_table_define_column(cxt, &tb, N_("Device"), 0.1, 0);
+	fdisk_table_define_column(cxt, &tb, N_("Boot"),     1, 0);
+	fdisk_table_define_column(cxt, &tb, N_("Start"),    9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("End"),      9, TT_FL_RIGHT);
 	/* TRANSLATORS: keep one blank space behind 'Blocks' */
-	tt_define_column(tb, _("Blocks "),  5, TT_FL_RIGHT);
-	tt_define_column(tb, _("Id"),       2, TT_FL_RIGHT);
-	tt_define_column(tb, _("System"), 0.1, trunc);
+	fdisk_table_define_column(cxt, &tb, N_("Blocks "),  5, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Id"),       2, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("System"), 0.1, trunc);
 
 	for (i = 0; i < cxt->label->nparts_max; i++) {
 		struct pte *pe = self_pte(cxt, i);
@@ -1669,7 +1667,7 @@ static int dos_list_disklabel(struct fdisk_context *cxt)
 
 		if (!is_used_partition(p))
 			continue;
-		ln = tt_add_line(tb, NULL);
+		ln = tt_add_line(tb.tt, NULL);
 		if (!ln)
 			continue;
 
@@ -1685,40 +1683,40 @@ static int dos_list_disklabel(struct fdisk_context *cxt)
 
 		str = fdisk_partname(cxt->dev_path, i + 1);
 		if (str)
-			tt_line_set_data(ln, 0, str);		/* device */
+			fdisk_table_set_data(&tb, ln, 0, str);		/* device */
 
 		str = strdup(p->boot_ind ?
-			     p->boot_ind == ACTIVE_FLAG ? "*" : "?" : " ");
+			     p->boot_ind == ACTIVE_FLAG ? "*" : "?" : pad);
 		if (str)
-			tt_line_set_data(ln, 1,	str);		/* boot flag */
+			fdisk_table_set_data(&tb, ln, 1,	str);		/* boot flag */
 
 		if (asprintf(&str, "%lu", (unsigned long) cround(cxt,
 					get_abs_partition_start(pe))) > 0)
-			tt_line_set_data(ln, 2, str);		/* start */
+			fdisk_table_set_data(&tb, ln, 2, str);		/* start */
 
 		if (asprintf(&str, "%lu", (unsigned long) cround(cxt,
 				get_abs_partition_start(pe)
 				+ psects - (psects ? 1 : 0))) > 0)
-			tt_line_set_data(ln, 3, str);		/* end */
+			fdisk_table_set_data(&tb, ln, 3, str);		/* end */
 
-		if (asprintf(&str, "%lu%c", (unsigned long) pblocks,
-				podd ? '+' : ' ') > 0)
-			tt_line_set_data(ln, 4, str);		/* blocks<flag> */
+		if (asprintf(&str, "%lu%s", (unsigned long) pblocks,
+				podd ? "+" : pad) > 0)
+			fdisk_table_set_data(&tb, ln, 4, str);		/* blocks<flag> */
 
 		if (asprintf(&str, "%x",  p->sys_ind) > 0)
-			tt_line_set_data(ln, 5, str);		/* id */
+			fdisk_table_set_data(&tb, ln, 5, str);		/* id */
 
 		str = strdup(type ? type->name : _("Unknown"));
 		if (str)
-			tt_line_set_data(ln, 6, str);
+			fdisk_table_set_data(&tb, ln, 6, str);
 
 		check_consistency(cxt, p, i);
 		fdisk_warn_alignment(cxt, get_abs_partition_start(pe), i);
 		fdisk_free_parttype(type);
 	}
 
-	rc = fdisk_print_table(cxt, tb);
-	tt_free_table(tb);
+	rc = fdisk_print_table(cxt, tb.tt);
+	fdisk_deinit_table(&tb);
 
 	/* Is partition table in disk order? It need not be, but... */
 	/* partition table entries are not checked for correct order if this
@@ -197,6 +197,11 @@ struct fdisk_label {
 	struct fdisk_parttype	*parttypes;	/* supported partitions types */
 	size_t			nparttypes;	/* number of items in parttypes[] */
 
+	/* parttypes[] hash tables, allocated on first use (see parttype.c) */
+	struct fdisk_parttype	**types_bycode;
+	struct fdisk_parttype	**types_bystr;
+	size_t			types_hashsz;	/* number of slots, power of 2 */
+
 	size_t			nparts_max;	/* maximal number of partitions */
 	size_t			nparts_cur;	/* number of currently used partitions */
 
@@ -262,6 +267,17 @@ struct fdisk_ask {
 	} data;
 };
 
+/*
+ * Cached on-disk sectors, see fdisk_read_sectors()
+ */
+#define FDISK_SECTORS_CACHE_SIZE	32
+
+struct fdisk_sector {
+	sector_t	lba;
+	unsigned char	*data;		/* sector_size bytes */
+	unsigned int	used : 1;
+};
+
 struct fdisk_context {
 	int dev_fd;         /* device descriptor */
 	char *dev_path;     /* device path */
@@ -279,6 +295,10 @@ struct fdisk_context {
 		     display_details : 1,	/* expert display mode */
 		     listonly : 1;		/* list partition, nothing else */
 
+	/* partitions listing, see fdisk_context_set_table_format() */
+	int	table_flags;		/* TT_FL_{RAW,JSON,EXPORT,STREAM,...} */
+	char	*table_columns;		/* comma separated list of columns */
+
 	/* alignment */
 	unsigned long grain;		/* alignment unit */
 	sector_t first_lba;		/* recommended begin of the first partition */
@@ -302,6 +322,12 @@ struct fdisk_context {
 	void	*ask_data;		/* ask_cb() data */
 
 	struct fdisk_context	*parent;	/* for nested PT */
+	struct fdisk_topocache	*topocache;	/* see alignment.c */
+
+	/* sectors cache */
+	struct fdisk_sector	sectors[FDISK_SECTORS_CACHE_SIZE];
+	size_t			sectors_next;	/* the next slot to reuse */
+	unsigned long		sectors_size;	/* sector size of the cached data */
 };
 
 /* context.c */
@@ -310,7 +336,6 @@ extern int __fdisk_context_switch_label(struct fdisk_context *cxt,
 
 extern int fdisk_context_use_cylinders(struct fdisk_context *cxt);
 extern int fdisk_context_display_details(struct fdisk_context *cxt);
-extern int fdisk_context_enable_listonly(struct fdisk_context *cxt, int enable);
 extern int fdisk_context_listonly(struct fdisk_context *cxt);
 
 
@@ -347,8 +372,15 @@ extern void fdisk_zeroize_device_properties(struct fdisk_context *cxt);
 /* utils.c */
 extern void fdisk_zeroize_firstsector(struct fdisk_context *cxt);
 extern int fdisk_read_firstsector(struct fdisk_context *cxt);
+extern int fdisk_read_sectors(struct fdisk_context *cxt, sector_t lba,
+			      size_t nsectors, void *buf);
+extern void fdisk_invalidate_sectors(struct fdisk_context *cxt);
+extern void fdisk_free_sectors(struct fdisk_context *cxt);
 extern char *fdisk_partname(const char *dev, size_t partno);
 
+/* parttype.c */
+extern void fdisk_free_parttypes_index(struct fdisk_label *lb);
+
 /* label.c */
 extern int fdisk_probe_labels(struct fdisk_context *cxt);
 extern void fdisk_deinit_label(struct fdisk_label *lb);
@@ -357,9 +389,30 @@ extern void fdisk_deinit_label(struct fdisk_label *lb);
 /* ask.c */
 extern int fdisk_ask_partnum(struct fdisk_context *cxt, size_t *partnum, int wantnew);
 
-extern struct tt *fdisk_ask_get_table(struct fdisk_ask *ask);
 extern int fdisk_print_table(struct fdisk_context *cxt, struct tt *tb);
 
+/*
+ * Partitions listing -- the label drivers define all columns and set data by
+ * the column numbers, the columns not requested by the user are not added to
+ * the output table.
+ */
+#define FDISK_TABLE_MAXCOLS	16
+
+struct fdisk_table {
+	struct tt	*tt;
+	size_t		ncols;				/* defined by the driver */
+	int		cols[FDISK_TABLE_MAXCOLS];	/* driver column -> tt column or -1 */
+	char		*names[FDISK_TABLE_MAXCOLS];	/* allocated headers */
+};
+
+extern int fdisk_init_table(struct fdisk_context *cxt, struct fdisk_table *tb);
+extern void fdisk_deinit_table(struct fdisk_table *tb);
+extern int fdisk_table_define_column(struct fdisk_context *cxt,
+			struct fdisk_table *tb, const char *name,
+			double whint, int flags);
+extern int fdisk_table_set_data(struct fdisk_table *tb, struct tt_line *ln,
+			size_t colnum, char *data);
+
 extern int fdisk_info_new_partition(
 			struct fdisk_context *cxt,
 			int num, sector_t start, sector_t stop,
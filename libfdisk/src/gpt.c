@@ -17,6 +17,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
 #include <uuid.h>
 
 #include "fdiskP.h"
@@ -233,6 +234,18 @@ static struct fdisk_parttype gpt_parttypes[] =
 /*
  * in-memory fdisk GPT stuff
  */
+/* used area on the disk, see gpt_get_extents() */
+struct gpt_extent {
+	uint64_t	start;
+	uint64_t	end;
+};
+
+/* binary type GUID and pointer to gpt_parttypes[] */
+struct gpt_type_slot {
+	struct gpt_guid		guid;
+	struct fdisk_parttype	*type;
+};
+
 struct fdisk_gpt_label {
 	struct fdisk_label	head;		/* generic part */
 
@@ -240,6 +253,14 @@ struct fdisk_gpt_label {
 	struct gpt_header	*pheader;	/* primary header */
 	struct gpt_header	*bheader;	/* backup header */
 	struct gpt_entry	*ents;		/* entries (partitions) */
+
+	struct gpt_extent	*exts;		/* sorted used areas (or NULL) */
+	size_t			nexts;		/* number of the used areas */
+
+	struct gpt_type_slot	*types;		/* hashed binary GUIDs of the types */
+	size_t			ntypes;		/* number of slots, power of 2 */
+
+	unsigned int		bents_unchecked : 1;	/* backup entries CRC not verified yet */
 };
 
 static void gpt_deinit(struct fdisk_label *lb);
@@ -596,44 +617,125 @@ static uint64_t last_lba(struct fdisk_context *cxt)
 static ssize_t read_lba(struct fdisk_context *cxt, uint64_t lba,
 			void *buffer, const size_t bytes)
 {
-	off_t offset = lba * cxt->sector_size;
+	unsigned char *buf;
+	int rc;
+
+	if (bytes > cxt->sector_size)
+		return -1;
 
-	if (lseek(cxt->dev_fd, offset, SEEK_SET) == (off_t) -1)
+	/* read whole sector through the context sectors cache */
+	buf = malloc(cxt->sector_size);
+	if (!buf)
 		return -1;
-	return read(cxt->dev_fd, buffer, bytes) != bytes;
+	rc = fdisk_read_sectors(cxt, lba, 1, buf);
+	if (!rc)
+		memcpy(buffer, buf, bytes);
+	free(buf);
+	return rc ? -1 : 0;
 }
 
 
-/* Returns the GPT entry array */
+/* the entries array is read (and checksummed) in chunks of this size */
+#define GPT_ENTRIES_CHUNK	(64 * 1024)
+
+/* Returns size of the entries array in bytes or 0 on error */
+static size_t gpt_get_entarr_size(struct gpt_header *header)
+{
+	uint64_t sz = (uint64_t) le32_to_cpu(header->npartition_entries) *
+		      le32_to_cpu(header->sizeof_partition_entry);
+
+	if (sz > SSIZE_MAX) {
+		DBG(LABEL, dbgprint("error: entries array too large"));
+		return 0;
+	}
+	return sz;
+}
+
+/*
+ * Reads @sz bytes of the entries array from the device. If @buf is NULL then
+ * the data are only checksummed by @chunk buffer. Returns CRC of the data in
+ * @crc.
+ */
+static int gpt_read_entarr(struct fdisk_context *cxt,
+			   struct gpt_header *header,
+			   unsigned char *buf,
+			   size_t sz,
+			   uint32_t *crc)
+{
+	unsigned char *chunk = NULL;
+	size_t done = 0;
+	off_t offset;
+	int rc = -1;
+
+	offset = le64_to_cpu(header->partition_entry_lba) * cxt->sector_size;
+	if (offset != lseek(cxt->dev_fd, offset, SEEK_SET))
+		return -1;
+	if (!buf) {
+		chunk = malloc(GPT_ENTRIES_CHUNK);
+		if (!chunk)
+			return -ENOMEM;
+	}
+
+	*crc = ~0L;
+	while (done < sz) {
+		size_t len = min(sz - done, (size_t) GPT_ENTRIES_CHUNK);
+		unsigned char *p = buf ? buf + done : chunk;
+
+		if (read_all(cxt->dev_fd, (char *) p, len) != (ssize_t) len)
+			goto done;
+		*crc = crc32(*crc, p, len);
+		done += len;
+	}
+	*crc ^= ~0L;
+	rc = 0;
+done:
+	free(chunk);
+	return rc;
+}
+
+/*
+ * Returns the GPT entry array, the entries are read in chunks and the
+ * checksum of the array is computed on the fly.
+ */
 static struct gpt_entry *gpt_read_entries(struct fdisk_context *cxt,
-					 struct gpt_header *header)
+					 struct gpt_header *header,
+					 uint32_t *crc)
 {
-	ssize_t sz;
+	size_t sz;
 	struct gpt_entry *ret = NULL;
-	off_t offset;
 
 	assert(cxt);
 	assert(header);
 
-	sz = le32_to_cpu(header->npartition_entries) *
-	     le32_to_cpu(header->sizeof_partition_entry);
+	sz = gpt_get_entarr_size(header);
+	if (!sz)
+		return NULL;
 
 	ret = calloc(1, sz);
 	if (!ret)
 		return NULL;
-	offset = le64_to_cpu(header->partition_entry_lba) *
-		       cxt->sector_size;
-
-	if (offset != lseek(cxt->dev_fd, offset, SEEK_SET))
-		goto fail;
-	if (sz != read(cxt->dev_fd, ret, sz))
-		goto fail;
 
+	if (gpt_read_entarr(cxt, header, (unsigned char *) ret, sz, crc) != 0) {
+		free(ret);
+		return NULL;
+	}
 	return ret;
+}
 
-fail:
-	free(ret);
-	return NULL;
+/*
+ * Verifies checksum of the entries array on the device without keeping the
+ * array in memory. Returns 1 if the checksum is valid, otherwise 0.
+ */
+static int gpt_check_disk_entarr_crc(struct fdisk_context *cxt,
+				     struct gpt_header *header)
+{
+	size_t sz = gpt_get_entarr_size(header);
+	uint32_t crc;
+
+	if (!sz || gpt_read_entarr(cxt, header, NULL, sz, &crc) != 0)
+		return 0;
+
+	return crc == le32_to_cpu(header->partition_entry_array_crc32);
 }
 
 static inline uint32_t count_crc32(const unsigned char *buf, size_t len)
@@ -769,6 +871,9 @@ static int gpt_check_signature(struct gpt_header *header)
  * Return the specified GPT Header, or NULL upon failure/invalid.
  * Note that all tests must pass to ensure a valid header,
  * we do not rely on only testing the signature for a valid probe.
+ *
+ * The entries array is read and verified only if @_ents is not NULL,
+ * use gpt_check_disk_entarr_crc() to verify the array later.
  */
 static struct gpt_header *gpt_read_header(struct fdisk_context *cxt,
 					  uint64_t lba,
@@ -776,7 +881,7 @@ static struct gpt_header *gpt_read_header(struct fdisk_context *cxt,
 {
 	struct gpt_header *header = NULL;
 	struct gpt_entry *ents = NULL;
-	uint32_t hsz;
+	uint32_t hsz, crc;
 
 	if (!cxt)
 		return NULL;
@@ -796,12 +901,13 @@ static struct gpt_header *gpt_read_header(struct fdisk_context *cxt,
 		goto invalid;
 
 	/* read and verify entries */
-	ents = gpt_read_entries(cxt, header);
-	if (!ents)
-		goto invalid;
-
-	if (!gpt_check_entryarr_crc(header, ents))
-		goto invalid;
+	if (_ents) {
+		ents = gpt_read_entries(cxt, header, &crc);
+		if (!ents)
+			goto invalid;
+		if (crc != le32_to_cpu(header->partition_entry_array_crc32))
+			goto invalid;
+	}
 
 	if (!gpt_check_lba_sanity(cxt, header))
 		goto invalid;
@@ -817,8 +923,6 @@ static struct gpt_header *gpt_read_header(struct fdisk_context *cxt,
 
 	if (_ents)
 		*_ents = ents;
-	else
-		free(ents);
 
 	DBG(LABEL, dbgprint("found valid GPT Header on LBA %ju", lba));
 	return header;
@@ -936,44 +1040,165 @@ static inline int partition_overlap(struct gpt_entry *e1, struct gpt_entry *e2)
 	return (start1 && start2 && (start1 <= end2) != (end1 < start2));
 }
 
+static int cmp_entry_start(const void *a, const void *b, void *data)
+{
+	struct gpt_entry *e = (struct gpt_entry *) data;
+	uint64_t sa = gpt_partition_start(&e[*(const uint32_t *) a]);
+	uint64_t sb = gpt_partition_start(&e[*(const uint32_t *) b]);
+
+	return sa < sb ? -1 : sa > sb ? 1 : 0;
+}
+
 /*
- * Find any paritions that overlap.
+ * Find any paritions that overlap. The used entries are sorted by start
+ * sector, so it's enough to compare every entry with the entry which ends
+ * as the last one from the previous entries.
  */
 static uint32_t partition_check_overlaps(struct gpt_header *header, struct gpt_entry *e)
 {
-	uint32_t i, j;
+	uint32_t i, n = 0, *idx, last, rc = 0;
 
-	for (i = 0; i < le32_to_cpu(header->npartition_entries); i++)
-		for (j = 0; j < i; j++) {
-			if (partition_unused(&e[i]) ||
-			    partition_unused(&e[j]))
-				continue;
-			if (partition_overlap(&e[i], &e[j])) {
-				DBG(LABEL, dbgprint("GPT partitions overlap detected [%u vs. %u]", i, j));
-				return i + 1;
-			}
+	idx = malloc(le32_to_cpu(header->npartition_entries) * sizeof(uint32_t));
+	if (!idx)
+		return 0;
+
+	for (i = 0; i < le32_to_cpu(header->npartition_entries); i++) {
+		if (!partition_unused(&e[i]))
+			idx[n++] = i;
+	}
+	qsort_r(idx, n, sizeof(uint32_t), cmp_entry_start, e);
+
+	for (i = 1, last = 0; n && i < n; i++) {
+		if (partition_overlap(&e[idx[i]], &e[idx[last]])) {
+			DBG(LABEL, dbgprint("GPT partitions overlap detected [%u vs. %u]",
+						idx[i], idx[last]));
+			rc = max(idx[i], idx[last]) + 1;
+			break;
 		}
+		if (gpt_partition_end(&e[idx[i]]) > gpt_partition_end(&e[idx[last]]))
+			last = i;
+	}
 
-	return 0;
+	free(idx);
+	return rc;
+}
+
+static int cmp_extent(const void *a, const void *b)
+{
+	const struct gpt_extent *x = a, *y = b;
+
+	return x->start < y->start ? -1 : x->start > y->start ? 1 : 0;
+}
+
+/*
+ * Returns sorted array of the used areas on the disk, the overlapping and
+ * adjacent partitions are merged to one area. The array is built on demand
+ * and kept up to date by gpt_add_extent() and gpt_reset_extents().
+ */
+static struct gpt_extent *gpt_get_extents(struct fdisk_gpt_label *gpt)
+{
+	struct gpt_extent *x;
+	uint32_t i, n, nents;
+
+	if (gpt->exts || !gpt->pheader || !gpt->ents)
+		return gpt->exts;
+
+	nents = le32_to_cpu(gpt->pheader->npartition_entries);
+	x = malloc((nents + 1) * sizeof(struct gpt_extent));
+	if (!x)
+		return NULL;
+
+	for (i = 0, n = 0; i < nents; i++) {
+		struct gpt_entry *e = &gpt->ents[i];
+
+		if (partition_unused(e) ||
+		    gpt_partition_start(e) > gpt_partition_end(e))
+			continue;
+		x[n].start = gpt_partition_start(e);
+		x[n].end = gpt_partition_end(e);
+		n++;
+	}
+	qsort(x, n, sizeof(struct gpt_extent), cmp_extent);
+
+	/* merge */
+	for (i = 1, gpt->nexts = n ? 1 : 0; i < n; i++) {
+		struct gpt_extent *l = &x[gpt->nexts - 1];
+
+		if (x[i].start <= l->end + 1) {
+			if (x[i].end > l->end)
+				l->end = x[i].end;
+		} else
+			x[gpt->nexts++] = x[i];
+	}
+
+	DBG(LABEL, dbgprint("GPT extents: %zu areas for %u partitions", gpt->nexts, n));
+	gpt->exts = x;
+	return x;
+}
+
+static void gpt_reset_extents(struct fdisk_gpt_label *gpt)
+{
+	free(gpt->exts);
+	gpt->exts = NULL;
+	gpt->nexts = 0;
+}
+
+/* Returns index of the first area which ends at or after @lba */
+static size_t gpt_find_extent(struct fdisk_gpt_label *gpt, uint64_t lba)
+{
+	size_t lo = 0, hi = gpt->nexts;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (gpt->exts[mid].end < lba)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Adds a new used area to the (already built) extents array */
+static void gpt_add_extent(struct fdisk_gpt_label *gpt, uint64_t start, uint64_t end)
+{
+	size_t i, j;
+
+	if (!gpt->exts)
+		return;		/* will be built on demand */
+
+	/* the array is allocated for all entries, so there is always space */
+	i = gpt_find_extent(gpt, start ? start - 1 : 0);
+	j = i;
+	while (j < gpt->nexts && gpt->exts[j].start <= end + 1)
+		j++;		/* areas merged with the new area */
+
+	if (i < j) {
+		start = min(start, gpt->exts[i].start);
+		end = max(end, gpt->exts[j - 1].end);
+	}
+	if (i + 1 != j)
+		memmove(&gpt->exts[i + 1], &gpt->exts[j],
+			(gpt->nexts - j) * sizeof(struct gpt_extent));
+	gpt->nexts = gpt->nexts + 1 - (j - i);
+	gpt->exts[i].start = start;
+	gpt->exts[i].end = end;
 }
 
 /*
  * Find the first available block after the starting point; returns 0 if
  * there are no available blocks left, or error. From gdisk.
  */
-static uint64_t find_first_available(struct gpt_header *header,
-				     struct gpt_entry *e, uint64_t start)
+static uint64_t find_first_available(struct fdisk_gpt_label *gpt, uint64_t start)
 {
-	uint64_t first;
-	uint32_t i, first_moved = 0;
-
-	uint64_t fu, lu;
+	uint64_t first, fu, lu;
+	size_t i;
 
-	if (!header || !e)
+	if (!gpt->pheader || !gpt_get_extents(gpt))
 		return 0;
 
-	fu = le64_to_cpu(header->first_usable_lba);
-	lu = le64_to_cpu(header->last_usable_lba);
+	fu = le64_to_cpu(gpt->pheader->first_usable_lba);
+	lu = le64_to_cpu(gpt->pheader->last_usable_lba);
 
 	/*
 	 * Begin from the specified starting point or from the first usable
@@ -982,25 +1207,12 @@ static uint64_t find_first_available(struct gpt_header *header,
 	first = start < fu ? fu : start;
 
 	/*
-	 * Now search through all partitions; if first is within an
-	 * existing partition, move it to the next sector after that
-	 * partition and repeat. If first was moved, set firstMoved
-	 * flag; repeat until firstMoved is not set, so as to catch
-	 * cases where partitions are out of sequential order....
+	 * ...if first is within a used area, move it to the next sector after
+	 * the area (the adjacent partitions are merged to one area).
 	 */
-	do {
-		first_moved = 0;
-		for (i = 0; i < le32_to_cpu(header->npartition_entries); i++) {
-			if (partition_unused(&e[i]))
-				continue;
-			if (first < gpt_partition_start(&e[i]))
-				continue;
-			if (first <= gpt_partition_end(&e[i])) {
-				first = gpt_partition_end(&e[i]) + 1;
-				first_moved = 1;
-			}
-		}
-	} while (first_moved == 1);
+	i = gpt_find_extent(gpt, first);
+	if (i < gpt->nexts && gpt->exts[i].start <= first)
+		first = gpt->exts[i].end + 1;
 
 	if (first > lu)
 		first = 0;
@@ -1010,49 +1222,41 @@ static uint64_t find_first_available(struct gpt_header *header,
 
 
 /* Returns last available sector in the free space pointed to by start. From gdisk. */
-static uint64_t find_last_free(struct gpt_header *header,
-			       struct gpt_entry *e, uint64_t start)
+static uint64_t find_last_free(struct fdisk_gpt_label *gpt, uint64_t start)
 {
-	uint32_t i;
 	uint64_t nearest_start;
+	size_t i;
 
-	if (!header || !e)
+	if (!gpt->pheader || !gpt_get_extents(gpt))
 		return 0;
 
-	nearest_start = le64_to_cpu(header->last_usable_lba);
+	nearest_start = le64_to_cpu(gpt->pheader->last_usable_lba);
 
-	for (i = 0; i < le32_to_cpu(header->npartition_entries); i++) {
-		uint64_t ps = gpt_partition_start(&e[i]);
-
-		if (nearest_start > ps && ps > start)
-			nearest_start = ps - 1;
-	}
+	/* the first area which starts after @start */
+	i = gpt_find_extent(gpt, start);
+	if (i < gpt->nexts && gpt->exts[i].start <= start)
+		i++;
+	if (i < gpt->nexts && gpt->exts[i].start < nearest_start)
+		nearest_start = gpt->exts[i].start - 1;
 
 	return nearest_start;
 }
 
 /* Returns the last free sector on the disk. From gdisk. */
-static uint64_t find_last_free_sector(struct gpt_header *header,
-				      struct gpt_entry *e)
+static uint64_t find_last_free_sector(struct fdisk_gpt_label *gpt)
 {
-	uint32_t i, last_moved;
 	uint64_t last = 0;
+	size_t i;
 
-	if (!header || !e)
+	if (!gpt->pheader || !gpt_get_extents(gpt))
 		goto done;
 
 	/* start by assuming the last usable LBA is available */
-	last = le64_to_cpu(header->last_usable_lba);
-	do {
-		last_moved = 0;
-		for (i = 0; i < le32_to_cpu(header->npartition_entries); i++) {
-			if ((last >= gpt_partition_start(&e[i])) &&
-			    (last <= gpt_partition_end(&e[i]))) {
-				last = gpt_partition_start(&e[i]) - 1;
-				last_moved = 1;
-			}
-		}
-	} while (last_moved == 1);
+	last = le64_to_cpu(gpt->pheader->last_usable_lba);
+
+	i = gpt_find_extent(gpt, last);
+	if (i < gpt->nexts && gpt->exts[i].start <= last)
+		last = gpt->exts[i].start - 1;
 done:
 	return last;
 }
@@ -1062,18 +1266,18 @@ done:
  * space on the disk. Returns 0 if there are no available blocks left.
  * From gdisk.
  */
-static uint64_t find_first_in_largest(struct gpt_header *header, struct gpt_entry *e)
+static uint64_t find_first_in_largest(struct fdisk_gpt_label *gpt)
 {
 	uint64_t start = 0, first_sect, last_sect;
 	uint64_t segment_size, selected_size = 0, selected_segment = 0;
 
-	if (!header || !e)
+	if (!gpt->pheader || !gpt->ents)
 		goto done;
 
 	do {
-		first_sect =  find_first_available(header, e, start);
+		first_sect =  find_first_available(gpt, start);
 		if (first_sect != 0) {
-			last_sect = find_last_free(header, e, first_sect);
+			last_sect = find_last_free(gpt, first_sect);
 			segment_size = last_sect - first_sect + 1;
 
 			if (segment_size > selected_size) {
@@ -1092,8 +1296,8 @@ done:
  * Find the total number of free sectors, the number of segments in which
  * they reside, and the size of the largest of those segments. From gdisk.
  */
-static uint64_t get_free_sectors(struct fdisk_context *cxt, struct gpt_header *header,
-				 struct gpt_entry *e, uint32_t *nsegments,
+static uint64_t get_free_sectors(struct fdisk_context *cxt,
+				 struct fdisk_gpt_label *gpt, uint32_t *nsegments,
 				 uint64_t *largest_segment)
 {
 	uint32_t num = 0;
@@ -1105,9 +1309,9 @@ static uint64_t get_free_sectors(struct fdisk_context *cxt, struct gpt_header *h
 		goto done;
 
 	do {
-		first_sect = find_first_available(header, e, start);
+		first_sect = find_first_available(gpt, start);
 		if (first_sect) {
-			last_sect = find_last_free(header, e, first_sect);
+			last_sect = find_last_free(gpt, first_sect);
 			segment_sz = last_sect - first_sect + 1;
 
 			if (segment_sz > largest_seg)
@@ -1151,12 +1355,14 @@ static int gpt_probe_label(struct fdisk_context *cxt)
 	gpt->pheader = gpt_read_header(cxt, GPT_PRIMARY_PARTITION_TABLE_LBA,
 				       &gpt->ents);
 
-	if (gpt->pheader)
-		/* primary OK, try backup from alternative LBA */
+	if (gpt->pheader) {
+		/* primary OK, try backup from alternative LBA, the backup
+		 * entries are verified later by gpt_verify_disklabel() */
 		gpt->bheader = gpt_read_header(cxt,
 					le64_to_cpu(gpt->pheader->alternative_lba),
 					NULL);
-	else
+		gpt->bents_unchecked = gpt->bheader ? 1 : 0;
+	} else
 		/* primary corrupted -- try last LBA */
 		gpt->bheader = gpt_read_header(cxt, last_lba(cxt), &gpt->ents);
 
@@ -1277,7 +1483,9 @@ static int gpt_list_disklabel(struct fdisk_context *cxt)
 	struct gpt_header *h;
 	uint64_t fu;
 	uint64_t lu;
-	struct tt *tb = NULL;
+	struct fdisk_table tb;
+	struct fdisk_parttype *t = NULL;
+	struct gpt_guid t_guid;
 
 	assert(cxt);
 	assert(cxt->label);
@@ -1288,9 +1496,9 @@ static int gpt_list_disklabel(struct fdisk_context *cxt)
 	fu = le64_to_cpu(gpt->pheader->first_usable_lba);
 	lu = le64_to_cpu(gpt->pheader->last_usable_lba);
 
-	tb = tt_new_table(TT_FL_FREEDATA);
-	if (!tb)
-		return -ENOMEM;
+	rc = fdisk_init_table(cxt, &tb);
+	if (rc)
+		return rc;
 
 	/* don't trunc anything in expert mode */
 	if (fdisk_context_display_details(cxt)) {
@@ -1301,16 +1509,16 @@ static int gpt_list_disklabel(struct fdisk_context *cxt)
 		fdisk_colon(cxt, _("Partitions entries LBA: %ju"), h->partition_entry_lba);
 		fdisk_colon(cxt, _("Allocated partition entries: %u"), h->npartition_entries);
 	}
-	tt_define_column(tb, _("Device"), 0.1, 0);
-	tt_define_column(tb, _("Start"),   12, TT_FL_RIGHT);
-	tt_define_column(tb, _("End"),     12, TT_FL_RIGHT);
-	tt_define_column(tb, _("Size"),     6, TT_FL_RIGHT);
-	tt_define_column(tb, _("Type"),   0.1, trunc);
+	fdisk_table_define_column(cxt, &tb, N_("Device"), 0.1, 0);
+	fdisk_table_define_column(cxt, &tb, N_("Start"),   12, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("End"),     12, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Size"),     6, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Type"),   0.1, trunc);
 
 	if (fdisk_context_display_details(cxt)) {
-		tt_define_column(tb, _("UUID"),  36, 0);
-		tt_define_column(tb, _("Name"), 0.2, trunc);
-		tt_define_column(tb, _("Attributes"), 0, 0);
+		fdisk_table_define_column(cxt, &tb, N_("UUID"),  36, 0);
+		fdisk_table_define_column(cxt, &tb, N_("Name"), 0.2, trunc);
+		fdisk_table_define_column(cxt, &tb, N_("Attributes"), 0, 0);
 	}
 
 	for (i = 0; i < le32_to_cpu(h->npartition_entries); i++) {
@@ -1318,7 +1526,6 @@ static int gpt_list_disklabel(struct fdisk_context *cxt)
 		char *sizestr = NULL, *p;
 		uint64_t start = gpt_partition_start(e);
 		uint64_t size = gpt_partition_size(e);
-		struct fdisk_parttype *t;
 		struct tt_line *ln;
 		char u_str[37];
 
@@ -1327,7 +1534,7 @@ static int gpt_list_disklabel(struct fdisk_context *cxt)
 		/* the partition has to inside usable range */
 		if (start < fu || start + size - 1 > lu)
 			continue;
-		ln = tt_add_line(tb, NULL);
+		ln = tt_add_line(tb.tt, NULL);
 		if (!ln)
 			continue;
 
@@ -1337,20 +1544,27 @@ static int gpt_list_disklabel(struct fdisk_context *cxt)
 		else
 			sizestr = size_to_human_string(SIZE_SUFFIX_1LETTER,
 					       size * cxt->sector_size);
-		t = fdisk_get_partition_type(cxt, i);
+
+		/* the partitions usually share a few types, don't convert
+		 * the GUID and search in the types for each partition */
+		if (!t || memcmp(&t_guid, &e->type, sizeof(t_guid)) != 0) {
+			fdisk_free_parttype(t);
+			t = gpt_get_partition_type(cxt, i);
+			memcpy(&t_guid, &e->type, sizeof(t_guid));
+		}
 
 		/* basic columns */
 		p = fdisk_partname(cxt->dev_path, i + 1);
 		if (p)
-			tt_line_set_data(ln, 0, p);
+			fdisk_table_set_data(&tb, ln, 0, p);
 		if (asprintf(&p, "%ju", start) > 0)
-			tt_line_set_data(ln, 1, p);
+			fdisk_table_set_data(&tb, ln, 1, p);
 		if (asprintf(&p, "%ju", gpt_partition_end(e)) > 0)
-			tt_line_set_data(ln, 2, p);
+			fdisk_table_set_data(&tb, ln, 2, p);
 		if (sizestr)
-			tt_line_set_data(ln, 3, sizestr);
+			fdisk_table_set_data(&tb, ln, 3, sizestr);
 		if (t && t->name)
-			tt_line_set_data(ln, 4, strdup(t->name));
+			fdisk_table_set_data(&tb, ln, 4, strdup(t->name));
 
 		/* expert menu column(s) */
 		if (fdisk_context_display_details(cxt)) {
@@ -1360,24 +1574,24 @@ static int gpt_list_disklabel(struct fdisk_context *cxt)
 					sizeof(e->name));
 
 			if (guid_to_string(&e->partition_guid, u_str))
-				tt_line_set_data(ln, 5, strdup(u_str));
+				fdisk_table_set_data(&tb, ln, 5, strdup(u_str));
 			if (name)
-				tt_line_set_data(ln, 6, name);
+				fdisk_table_set_data(&tb, ln, 6, name);
 			if (asprintf(&p, "%s%s%s%s",
 					e->attr.required_to_function ? "Required " : "",
 					e->attr.legacy_bios_bootable ? "LegacyBoot " : "",
 					e->attr.no_blockio_protocol  ? "NoBlockIO " : "",
 					guid_attrs_to_string(&e->attr, &buf)) > 0)
-				tt_line_set_data(ln, 7, p);
+				fdisk_table_set_data(&tb, ln, 7, p);
 			free(buf);
 		}
 
 		fdisk_warn_alignment(cxt, start, i);
-		fdisk_free_parttype(t);
 	}
 
-	rc = fdisk_print_table(cxt, tb);
-	tt_free_table(tb);
+	fdisk_free_parttype(t);
+	rc = fdisk_print_table(cxt, tb.tt);
+	fdisk_deinit_table(&tb);
 
 	return rc;
 }
@@ -1575,6 +1789,16 @@ static int gpt_verify_disklabel(struct fdisk_context *cxt)
 		fdisk_warnx(cxt, _("Invalid partition entry checksum."));
 	}
 
+	/* the backup array on disk is stale if the label has been modified */
+	if (gpt->bheader && gpt->bents_unchecked &&
+	    !fdisk_label_is_changed(cxt->label)) {
+		if (!gpt_check_disk_entarr_crc(cxt, gpt->bheader)) {
+			nerror++;
+			fdisk_warnx(cxt, _("Invalid backup partition entry checksum."));
+		}
+		gpt->bents_unchecked = 0;
+	}
+
 	if (!gpt_check_lba_sanity(cxt, gpt->pheader)) {
 		nerror++;
 		fdisk_warnx(cxt, _("Invalid primary header LBA sanity checks."));
@@ -1640,7 +1864,7 @@ static int gpt_verify_disklabel(struct fdisk_context *cxt)
 		       partitions_in_use(gpt->pheader, gpt->ents),
 		       le32_to_cpu(gpt->pheader->npartition_entries));
 
-		free_sectors = get_free_sectors(cxt, gpt->pheader, gpt->ents,
+		free_sectors = get_free_sectors(cxt, gpt,
 						&nsegments, &largest_segment);
 		if (largest_segment)
 			strsz = size_to_human_string(SIZE_SUFFIX_SPACE | SIZE_SUFFIX_3LETTER,
@@ -1684,6 +1908,7 @@ static int gpt_delete_partition(struct fdisk_context *cxt,
 	else {
 		gpt_recompute_crc(gpt->pheader, gpt->ents);
 		gpt_recompute_crc(gpt->bheader, gpt->ents);
+		gpt_reset_extents(gpt);		/* rebuilt on demand */
 		cxt->label->nparts_cur--;
 		fdisk_label_set_changed(cxt->label, 1);
 	}
@@ -1783,17 +2008,17 @@ static int gpt_add_partition(
 		return -EINVAL;
 	}
 
-	if (!get_free_sectors(cxt, pheader, ents, NULL, NULL)) {
+	if (!get_free_sectors(cxt, gpt, NULL, NULL)) {
 		fdisk_warnx(cxt, _("No free sectors available."));
 		return -ENOSPC;
 	}
 
-	disk_f = find_first_available(pheader, ents, 0);
-	disk_l = find_last_free_sector(pheader, ents);
+	disk_f = find_first_available(gpt, 0);
+	disk_l = find_last_free_sector(gpt);
 
 	/* the default is the largest free space */
-	dflt_f = find_first_in_largest(pheader, ents);
-	dflt_l = find_last_free(pheader, ents, dflt_f);
+	dflt_f = find_first_in_largest(gpt);
+	dflt_l = find_last_free(gpt, dflt_f);
 
 	/* align the default in range <dflt_f,dflt_l>*/
 	dflt_f = fdisk_align_lba_in_range(cxt, dflt_f, dflt_f, dflt_l);
@@ -1819,7 +2044,7 @@ static int gpt_add_partition(
 			goto done;
 
 		user_f = fdisk_ask_number_get_result(ask);
-		if (user_f != find_first_available(pheader, ents, user_f)) {
+		if (user_f != find_first_available(gpt, user_f)) {
 			fdisk_warnx(cxt, _("Sector %ju already used."), user_f);
 			continue;
 		}
@@ -1827,7 +2052,7 @@ static int gpt_add_partition(
 		fdisk_reset_ask(ask);
 
 		/* Last sector */
-		dflt_l = find_last_free(pheader, ents, user_f);
+		dflt_l = find_last_free(gpt, user_f);
 
 		fdisk_ask_set_query(ask, _("Last sector, +sectors or +size{K,M,G,T,P}"));
 		fdisk_ask_set_type(ask, FDISK_ASKTYPE_OFFSET);
@@ -1854,6 +2079,7 @@ static int gpt_add_partition(
 	else {
 		struct fdisk_parttype *t;
 
+		gpt_add_extent(gpt, user_f, user_l);
 		cxt->label->nparts_cur++;
 		fdisk_label_set_changed(cxt->label, 1);
 
@@ -2001,6 +2227,64 @@ static int gpt_set_disklabel_id(struct fdisk_context *cxt)
 	return 0;
 }
 
+static size_t gpt_hash_guid(const struct gpt_guid *guid)
+{
+	const unsigned char *p = (const unsigned char *) guid;
+	size_t i, h = 2166136261U;
+
+	for (i = 0; i < sizeof(*guid); i++)
+		h = (h ^ p[i]) * 16777619U;
+	return h;
+}
+
+/*
+ * Lookups partition type by on-disk GUID, the GUIDs of the supported types are
+ * converted to binary and hashed on the first use, so there is no string
+ * conversion for the known types.
+ */
+static struct fdisk_parttype *gpt_get_parttype_from_guid(
+		struct fdisk_context *cxt,
+		const struct gpt_guid *guid)
+{
+	struct fdisk_gpt_label *gpt = self_label(cxt);
+	struct fdisk_label *lb = cxt->label;
+	size_t x;
+
+	if (!gpt->types) {
+		size_t i, sz = 16;
+
+		while (sz < lb->nparttypes * 2)
+			sz <<= 1;
+		gpt->types = calloc(sz, sizeof(struct gpt_type_slot));
+		if (!gpt->types)
+			return NULL;
+		gpt->ntypes = sz;
+
+		for (i = 0; i < lb->nparttypes; i++) {
+			struct fdisk_parttype *t = &lb->parttypes[i];
+			struct gpt_guid g;
+
+			if (!t->typestr || string_to_guid(t->typestr, &g) != 0)
+				continue;
+			for (x = gpt_hash_guid(&g) & (sz - 1); gpt->types[x].type;
+			     x = (x + 1) & (sz - 1)) {
+				if (!memcmp(&gpt->types[x].guid, &g, sizeof(g)))
+					break;
+			}
+			if (gpt->types[x].type)
+				continue;	/* duplicate, the first wins */
+			gpt->types[x].guid = g;
+			gpt->types[x].type = t;
+		}
+	}
+
+	for (x = gpt_hash_guid(guid) & (gpt->ntypes - 1); gpt->types[x].type;
+	     x = (x + 1) & (gpt->ntypes - 1)) {
+		if (!memcmp(&gpt->types[x].guid, guid, sizeof(*guid)))
+			return gpt->types[x].type;
+	}
+	return NULL;
+}
 
 static struct fdisk_parttype *gpt_get_partition_type(
 		struct fdisk_context *cxt,
@@ -2019,10 +2303,10 @@ static struct fdisk_parttype *gpt_get_partition_type(
 	if ((uint32_t) i >= le32_to_cpu(gpt->pheader->npartition_entries))
 		return NULL;
 
-	guid_to_string(&gpt->ents[i].type, str);
-	t = fdisk_get_parttype_from_string(cxt, str);
+	t = gpt_get_parttype_from_guid(cxt, &gpt->ents[i].type);
 	if (!t)
-		t = fdisk_new_unknown_parttype(0, str);
+		t = fdisk_new_unknown_parttype(0,
+				guid_to_string(&gpt->ents[i].type, str));
 
 	return t;
 }
@@ -2278,6 +2562,20 @@ static void gpt_deinit(struct fdisk_label *lb)
 	gpt->ents = NULL;
 	gpt->pheader = NULL;
 	gpt->bheader = NULL;
+	gpt->bents_unchecked = 0;
+	gpt_reset_extents(gpt);
+}
+
+static void gpt_free(struct fdisk_label *lb)
+{
+	struct fdisk_gpt_label *gpt = (struct fdisk_gpt_label *) lb;
+
+	if (!gpt)
+		return;
+
+	gpt_deinit(lb);
+	free(gpt->types);
+	free(gpt);
 }
 
 static const struct fdisk_label_operations gpt_operations =
@@ -2299,6 +2597,7 @@ static const struct fdisk_label_operations gpt_operations =
 
 	.part_get_status = gpt_get_partition_status,
 
+	.free		= gpt_free,
 	.deinit		= gpt_deinit
 };
 
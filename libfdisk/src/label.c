@@ -75,12 +75,18 @@ int fdisk_dev_is_disklabel(struct fdisk_context *cxt, enum fdisk_labeltype l)
  */
 int fdisk_write_disklabel(struct fdisk_context *cxt)
 {
+	int rc;
+
 	if (!cxt || !cxt->label)
 		return -EINVAL;
 	if (!cxt->label->op->write)
 		return -ENOSYS;
 
-	return cxt->label->op->write(cxt);
+	rc = cxt->label->op->write(cxt);
+
+	/* drop cached sectors also on error, the write may be incomplete */
+	fdisk_invalidate_sectors(cxt);
+	return rc;
 }
 
 int fdisk_require_geometry(struct fdisk_context *cxt)
@@ -25,8 +25,10 @@
 extern "C" {
 #endif
 
+#include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 struct fdisk_context;
 struct fdisk_label;
@@ -101,6 +103,11 @@ extern const char *fdisk_context_get_unit(struct fdisk_context *cxt, int n);
 extern unsigned int fdisk_context_get_units_per_sector(struct fdisk_context *cxt);
 
 extern int fdisk_context_enable_details(struct fdisk_context *cxt, int enable);
+extern int fdisk_context_enable_listonly(struct fdisk_context *cxt, int enable);
+
+extern int fdisk_context_set_table_format(struct fdisk_context *cxt, const char *str);
+extern int fdisk_context_set_table_columns(struct fdisk_context *cxt, const char *str);
+extern int fdisk_context_is_machine_readable(struct fdisk_context *cxt);
 
 /* parttype.c */
 extern struct fdisk_parttype *fdisk_get_parttype_from_code(struct fdisk_context *cxt,
@@ -153,6 +160,7 @@ extern int fdisk_partition_toggle_flag(struct fdisk_context *cxt, size_t partnum
 /* alignment.c */
 extern int fdisk_reset_alignment(struct fdisk_context *cxt);
 extern int fdisk_reset_device_properties(struct fdisk_context *cxt);
+extern int fdisk_invalidate_topology_cache(struct fdisk_context *cxt, dev_t devno);
 
 extern int fdisk_save_user_geometry(struct fdisk_context *cxt,
 			    unsigned int cylinders,
@@ -212,6 +220,20 @@ extern int fdisk_dos_list_extended(struct fdisk_context *cxt);
 
 #define DOS_FLAG_ACTIVE	1
 
+/* script.c */
+struct fdisk_script_entry {
+	size_t		partno;		/* partition number or 0 for the first unused */
+	uint64_t	start;		/* first sector or 0 for default */
+	uint64_t	size;		/* number of sectors or 0 for the rest of free space */
+	const char	*type;		/* partition type or NULL for default */
+	int		kind;		/* DOS 'p'rimary, 'e'xtended, 'l'ogical or 0 */
+};
+
+extern int fdisk_apply_script(struct fdisk_context *cxt, const char *label,
+			      struct fdisk_script_entry *ents, size_t nents);
+extern int fdisk_apply_script_file(struct fdisk_context *cxt,
+			      const char *label, FILE *f);
+
 /* ask.c */
 #define fdisk_is_ask(a, x) (fdisk_ask_get_type(a) == FDISK_ASKTYPE_ ## x)
 
@@ -263,6 +285,8 @@ extern int fdisk_ask_yesno(struct fdisk_context *cxt, const char *query, int *re
 extern uint64_t fdisk_ask_yesno_get_result(struct fdisk_ask *ask);
 extern int fdisk_ask_yesno_set_result(struct fdisk_ask *ask, uint64_t result);
 
+extern struct tt *fdisk_ask_get_table(struct fdisk_ask *ask);
+
 extern int fdisk_info(struct fdisk_context *cxt, const char *fmt, ...)
 			__attribute__ ((__format__ (__printf__, 2, 3)));
 extern int fdisk_colon(struct fdisk_context *cxt, const char *fmt, ...)
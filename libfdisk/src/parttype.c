@@ -5,6 +5,79 @@
 
 #include "fdiskP.h"
 
+/*
+ * The label partition types are hashed by code and by (case insensitive)
+ * type string. The hash tables use open addressing and they are allocated on
+ * the first lookup. The first type wins if the table contains duplicates, it's
+ * the same as the original linear search.
+ */
+static size_t hash_code(unsigned int code)
+{
+	return code * 2654435761U;
+}
+
+static size_t hash_string(const char *str)
+{
+	size_t h = 5381;
+
+	for (; *str; str++)
+		h = (h * 33) ^ tolower((unsigned char) *str);
+	return h;
+}
+
+static int build_parttypes_index(struct fdisk_label *lb)
+{
+	size_t i, sz = 16;
+
+	while (sz < lb->nparttypes * 2)
+		sz <<= 1;
+
+	lb->types_bycode = calloc(sz, sizeof(struct fdisk_parttype *));
+	lb->types_bystr = calloc(sz, sizeof(struct fdisk_parttype *));
+	if (!lb->types_bycode || !lb->types_bystr) {
+		fdisk_free_parttypes_index(lb);
+		return -ENOMEM;
+	}
+	lb->types_hashsz = sz;
+
+	for (i = 0; i < lb->nparttypes; i++) {
+		struct fdisk_parttype *t = &lb->parttypes[i];
+		size_t x;
+
+		for (x = hash_code(t->type) & (sz - 1); lb->types_bycode[x];
+		     x = (x + 1) & (sz - 1)) {
+			if (lb->types_bycode[x]->type == t->type)
+				break;
+		}
+		if (!lb->types_bycode[x])
+			lb->types_bycode[x] = t;
+
+		if (!t->typestr)
+			continue;
+		for (x = hash_string(t->typestr) & (sz - 1); lb->types_bystr[x];
+		     x = (x + 1) & (sz - 1)) {
+			if (strcasecmp(lb->types_bystr[x]->typestr, t->typestr) == 0)
+				break;
+		}
+		if (!lb->types_bystr[x])
+			lb->types_bystr[x] = t;
+	}
+
+	DBG(LABEL, dbgprint("%s: hashed %zu partition types [slots=%zu]",
+				lb->name, lb->nparttypes, sz));
+	return 0;
+}
+
+void fdisk_free_parttypes_index(struct fdisk_label *lb)
+{
+	if (!lb)
+		return;
+	free(lb->types_bycode);
+	free(lb->types_bystr);
+	lb->types_bycode = lb->types_bystr = NULL;
+	lb->types_hashsz = 0;
+}
+
 /**
  * fdisk_get_parttype_from_code:
  * @cxt: fdisk context
@@ -18,14 +91,21 @@ struct fdisk_parttype *fdisk_get_parttype_from_code(
 				struct fdisk_context *cxt,
 				unsigned int code)
 {
-	size_t i;
+	struct fdisk_label *lb;
+	size_t x;
 
 	if (!fdisk_get_nparttypes(cxt))
 		return NULL;
 
-	for (i = 0; i < cxt->label->nparttypes; i++)
-		if (cxt->label->parttypes[i].type == code)
-			return &cxt->label->parttypes[i];
+	lb = cxt->label;
+	if (!lb->types_hashsz && build_parttypes_index(lb) != 0)
+		return NULL;
+
+	for (x = hash_code(code) & (lb->types_hashsz - 1); lb->types_bycode[x];
+	     x = (x + 1) & (lb->types_hashsz - 1)) {
+		if (lb->types_bycode[x]->type == code)
+			return lb->types_bycode[x];
+	}
 
 	return NULL;
 }
@@ -43,15 +123,21 @@ struct fdisk_parttype *fdisk_get_parttype_from_string(
 				struct fdisk_context *cxt,
 				const char *str)
 {
-	size_t i;
+	struct fdisk_label *lb;
+	size_t x;
 
-	if (!fdisk_get_nparttypes(cxt))
+	if (!fdisk_get_nparttypes(cxt) || !str)
+		return NULL;
+
+	lb = cxt->label;
+	if (!lb->types_hashsz && build_parttypes_index(lb) != 0)
 		return NULL;
 
-	for (i = 0; i < cxt->label->nparttypes; i++)
-		if (cxt->label->parttypes[i].typestr
-		    &&strcasecmp(cxt->label->parttypes[i].typestr, str) == 0)
-			return &cxt->label->parttypes[i];
+	for (x = hash_string(str) & (lb->types_hashsz - 1); lb->types_bystr[x];
+	     x = (x + 1) & (lb->types_hashsz - 1)) {
+		if (strcasecmp(lb->types_bystr[x]->typestr, str) == 0)
+			return lb->types_bystr[x];
+	}
 
 	return NULL;
 }
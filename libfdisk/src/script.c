@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * Non-interactive partitioning -- the partitions are created by the label
+ * drivers, but the dialogs are answered from the script rather than by user.
+ * It means that the script is verified and aligned by the same code as the
+ * interactive input. All changes are in memory only, the caller is expected
+ * to call fdisk_write_disklabel() and fdisk_reread_partition_table() once
+ * for the whole script.
+ *
+ * The script is a list of partitions, one line for each partition:
+ *
+ *	<start>,<size>,<type>,<kind>
+ *
+ * where <start> and <size> are numbers of sectors or sizes with {K,M,G,...}
+ * suffix, <type> is partition type code or string and
+ * <kind> is 'p', 'e' or 'l' for DOS primary, extended and logical partitions.
+ * Empty (or missing) fields mean default values, lines starting with '#'
+ * are ignored.
+ */
+#include <ctype.h>
+
+#include "fdiskP.h"
+#include "strutils.h"
+
+struct script_ask {
+	struct fdisk_script_entry	*ent;
+	int				nnumbers;	/* answered NUMBER dialogs */
+	int				noffsets;	/* answered OFFSET dialogs */
+
+	/* the original callback, used for messages */
+	int	(*ask_cb)(struct fdisk_context *, struct fdisk_ask *, void *);
+	void	*ask_data;
+};
+
+static int script_ask_number(struct fdisk_context *cxt,
+			     struct fdisk_ask *ask,
+			     uint64_t num)
+{
+	uint64_t low = fdisk_ask_number_get_low(ask),
+		 high = fdisk_ask_number_get_high(ask);
+
+	if (num < low || num > high) {
+		fdisk_warnx(cxt, _("%s: value %ju out of range <%ju-%ju>."),
+				fdisk_ask_get_query(ask), num, low, high);
+		return -ERANGE;
+	}
+	return fdisk_ask_number_set_result(ask, num);
+}
+
+static int script_ask_callback(struct fdisk_context *cxt,
+			       struct fdisk_ask *ask,
+			       void *data)
+{
+	struct script_ask *sa = (struct script_ask *) data;
+	struct fdisk_script_entry *ent = sa->ent;
+
+	switch (fdisk_ask_get_type(ask)) {
+	case FDISK_ASKTYPE_NUMBER:
+		/* fdisk_ask_partnum() is the only dialog with range */
+		if (fdisk_ask_number_get_range(ask))
+			return script_ask_number(cxt, ask,
+					ent->partno ? ent->partno :
+					fdisk_ask_number_get_default(ask));
+
+		/* the driver asks again if the sector is already used */
+		if (sa->nnumbers++) {
+			fdisk_warnx(cxt, _("Sector %ju already used."), ent->start);
+			return -EINVAL;
+		}
+		return script_ask_number(cxt, ask,
+				ent->start ? ent->start :
+					     fdisk_ask_number_get_default(ask));
+	case FDISK_ASKTYPE_OFFSET:
+		if (sa->noffsets++)
+			return -EINVAL;
+		if (!ent->size)
+			return script_ask_number(cxt, ask,
+					fdisk_ask_number_get_default(ask));
+
+		/* the same as "+<size>" in the dialog, the driver aligns
+		 * end of the partition */
+		fdisk_ask_number_set_relative(ask, 1);
+		return script_ask_number(cxt, ask,
+				fdisk_ask_number_get_base(ask) + ent->size);
+	case FDISK_ASKTYPE_STRING:
+	{
+		/* DOS primary/extended/logical dialog */
+		char *str = calloc(1, 2);
+
+		if (!str)
+			return -ENOMEM;
+		if (ent->kind)
+			*str = ent->kind;
+		return fdisk_ask_string_set_result(ask, str);
+	}
+	case FDISK_ASKTYPE_INFO:
+	case FDISK_ASKTYPE_WARNX:
+	case FDISK_ASKTYPE_WARN:
+		if (sa->ask_cb)
+			return sa->ask_cb(cxt, ask, sa->ask_data);
+		return 0;
+	default:
+		DBG(LABEL, dbgprint("script: unsupported dialog type %d",
+					fdisk_ask_get_type(ask)));
+		return -EINVAL;
+	}
+}
+
+static int script_add_partition(struct fdisk_context *cxt,
+				struct fdisk_script_entry *ent,
+				struct script_ask *sa)
+{
+	struct fdisk_parttype *t = NULL;
+	size_t partnum = 0, nparts = cxt->label->nparts_cur;
+	int rc;
+
+	if (ent->type) {
+		t = fdisk_parse_parttype(cxt, ent->type);
+		if (!t) {
+			fdisk_warnx(cxt, _("Unsupported partition type '%s'."),
+					ent->type);
+			return -EINVAL;
+		}
+	}
+
+	if (!(cxt->label->flags & FDISK_LABEL_FL_ADDPART_NOPARTNO)) {
+		if (ent->partno)
+			partnum = ent->partno - 1;
+		else {
+			/* the first unused partition */
+			while (partnum < cxt->label->nparts_max &&
+			       fdisk_partition_is_used(cxt, partnum))
+				partnum++;
+		}
+		if (partnum >= cxt->label->nparts_max) {
+			rc = -ERANGE;
+			goto done;
+		}
+	}
+
+	DBG(LABEL, dbgprint("script: adding partition %zu [start=%ju, size=%ju]",
+				partnum, ent->start, ent->size));
+
+	sa->ent = ent;
+	sa->nnumbers = sa->noffsets = 0;
+
+	rc = cxt->label->op->part_add(cxt, partnum, t);
+
+	/* some drivers return success also if nothing has been added */
+	if (rc == 0 && cxt->label->nparts_cur == nparts)
+		rc = -EINVAL;
+done:
+	fdisk_free_parttype(t);
+	return rc;
+}
+
+/**
+ * fdisk_apply_script:
+ * @cxt: fdisk context
+ * @label: create a new disk label of this type or NULL
+ * @ents: array of the partitions
+ * @nents: number of the partitions
+ *
+ * Adds all the partitions to the in-memory partition table. The partitions
+ * are verified and aligned by the label driver in the same way as
+ * interactively entered partitions. The default start/size (zero in @ents)
+ * means the first available sector and the rest of the free space.
+ *
+ * The function does not write anything to the device.
+ *
+ * Returns: 0 on success, otherwise a negative error code and the index of
+ * the failed entry is reported by fdisk_warnx().
+ */
+int fdisk_apply_script(struct fdisk_context *cxt, const char *label,
+		       struct fdisk_script_entry *ents, size_t nents)
+{
+	struct script_ask sa = { .ent = NULL };
+	unsigned int cyl_units;
+	size_t i;
+	int rc = 0;
+
+	if (!cxt)
+		return -EINVAL;
+
+	if (label) {
+		rc = fdisk_create_disklabel(cxt, label);
+		if (rc)
+			return rc;
+	}
+	if (!cxt->label || !cxt->label->op->part_add)
+		return -EINVAL;
+	if (fdisk_missing_geometry(cxt))
+		return -EINVAL;
+
+	DBG(LABEL, dbgprint("script: applying %zu partitions", nents));
+
+	/* redirect dialogs to the script */
+	sa.ask_cb = cxt->ask_cb;
+	sa.ask_data = cxt->ask_data;
+	cxt->ask_cb = script_ask_callback;
+	cxt->ask_data = &sa;
+
+	/* the script is always in sectors */
+	cyl_units = cxt->display_in_cyl_units;
+	cxt->display_in_cyl_units = 0;
+
+	for (i = 0; i < nents; i++) {
+		rc = script_add_partition(cxt, &ents[i], &sa);
+		if (rc)
+			break;
+	}
+
+	cxt->display_in_cyl_units = cyl_units;
+	cxt->ask_cb = sa.ask_cb;
+	cxt->ask_data = sa.ask_data;
+
+	if (rc)
+		fdisk_warnx(cxt, _("Failed to apply script entry %zu."), i + 1);
+	return rc;
+}
+
+static char *next_field(char **str)
+{
+	char *p = *str, *sep;
+
+	if (!p)
+		return NULL;
+	sep = strchr(p, ',');
+	if (sep) {
+		*sep = '\0';
+		*str = sep + 1;
+	} else
+		*str = NULL;
+
+	p = (char *) skip_space(p);
+	sep = p + strlen(p);
+	while (sep > p && isspace((unsigned char) *(sep - 1)))
+		*(--sep) = '\0';
+	return *p ? p : NULL;
+}
+
+/* number of sectors or size with {K,M,G,...} suffix */
+static int parse_sectors(struct fdisk_context *cxt, const char *str, uint64_t *res)
+{
+	uintmax_t num;
+	int pwr = 0;
+
+	if (parse_size(str, &num, &pwr) != 0)
+		return -EINVAL;
+	if (pwr)	/* the "num" is in bytes */
+		num = (num + cxt->sector_size / 2) / cxt->sector_size;
+	*res = num;
+	return 0;
+}
+
+/*
+ * Parses one line of the script, the type is allocated.
+ */
+static int parse_script_line(struct fdisk_context *cxt, char *line,
+			     struct fdisk_script_entry *ent)
+{
+	char *p, *str = line;
+
+	memset(ent, 0, sizeof(*ent));
+
+	/* start */
+	p = next_field(&str);
+	if (p && parse_sectors(cxt, p, &ent->start) != 0)
+		return -EINVAL;
+
+	/* size */
+	p = next_field(&str);
+	if (p && parse_sectors(cxt, p, &ent->size) != 0)
+		return -EINVAL;
+
+	/* type */
+	p = next_field(&str);
+	if (p) {
+		ent->type = strdup(p);
+		if (!ent->type)
+			return -ENOMEM;
+	}
+
+	/* kind */
+	p = next_field(&str);
+	if (p) {
+		ent->kind = tolower(*p);
+		if (!strchr("pel", ent->kind))
+			return -EINVAL;
+	}
+	return 0;
+}
+
+/**
+ * fdisk_apply_script_file:
+ * @cxt: fdisk context
+ * @label: create a new disk label of this type or NULL
+ * @f: script file
+ *
+ * Reads the script from @f and calls fdisk_apply_script(). See the top of
+ * libfdisk/src/script.c for the format of the script.
+ *
+ * Returns: 0 on success, otherwise a negative error code.
+ */
+int fdisk_apply_script_file(struct fdisk_context *cxt, const char *label, FILE *f)
+{
+	struct fdisk_script_entry *ents = NULL;
+	size_t nents = 0, i, nlines = 0;
+	char buf[BUFSIZ];
+	int rc = 0;
+
+	if (!cxt || !f)
+		return -EINVAL;
+
+	while (fgets(buf, sizeof(buf), f)) {
+		char *p = (char *) skip_space(buf);
+		struct fdisk_script_entry *tmp;
+
+		nlines++;
+		if (!*p || *p == '#')
+			continue;
+
+		tmp = realloc(ents, (nents + 1) * sizeof(*ents));
+		if (!tmp) {
+			rc = -ENOMEM;
+			goto done;
+		}
+		ents = tmp;
+
+		rc = parse_script_line(cxt, p, &ents[nents]);
+		if (rc) {
+			fdisk_warnx(cxt, _("Script: parse error at line %zu."), nlines);
+			free((char *) ents[nents].type);
+			goto done;
+		}
+		nents++;
+	}
+
+	rc = fdisk_apply_script(cxt, label, ents, nents);
+done:
+	for (i = 0; i < nents; i++)
+		free((char *) ents[i].type);
+	free(ents);
+	return rc;
+}
+
+#ifdef TEST_PROGRAM
+
+static int test_ask_callback(struct fdisk_context *cxt __attribute__((__unused__)),
+			     struct fdisk_ask *ask,
+			     void *data __attribute__((__unused__)))
+{
+	const char *msg = fdisk_ask_print_get_mesg(ask);
+
+	if (msg)
+		printf("%s\n", msg);
+	return 0;
+}
+
+int test_apply(struct fdisk_test *ts, int argc, char *argv[])
+{
+	struct fdisk_context *cxt;
+	const char *label = argc > 3 ? argv[3] : NULL;
+	FILE *f;
+	int rc;
+
+	if (argc < 3)
+		return -EINVAL;
+
+	f = fopen(argv[2], "r");
+	if (!f)
+		return -errno;
+
+	cxt = fdisk_new_context();
+	fdisk_context_set_ask(cxt, test_ask_callback, NULL);
+
+	rc = fdisk_context_assign_device(cxt, argv[1], 0);
+	if (!rc)
+		rc = fdisk_apply_script_file(cxt, label, f);
+	if (!rc)
+		rc = fdisk_write_disklabel(cxt);
+	if (!rc)
+		fdisk_reread_partition_table(cxt);
+
+	fclose(f);
+	fdisk_free_context(cxt);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct fdisk_test tss[] = {
+		{ "--apply",  test_apply,  "<device> <script> [<label>]  apply script and write" },
+		{ NULL }
+	};
+
+	return fdisk_run_test(tss, argc, argv);
+}
+
+#endif
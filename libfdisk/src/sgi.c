@@ -248,7 +248,7 @@ static int sgi_probe_label(struct fdisk_context *cxt)
 
 static int sgi_list_table(struct fdisk_context *cxt)
 {
-	struct tt *tb = NULL;
+	struct fdisk_table tb;
 	struct sgi_disklabel *sgilabel = self_disklabel(cxt);
 	struct sgi_device_parameter *sgiparam = &sgilabel->devparam;
 	size_t i, used;
@@ -267,18 +267,18 @@ static int sgi_list_table(struct fdisk_context *cxt)
 	/*
 	 * Partitions
 	 */
-	tb = tt_new_table(TT_FL_FREEDATA);
-	if (!tb)
-		return -ENOMEM;
+	rc = fdisk_init_table(cxt, &tb);
+	if (rc)
+		return rc;
 
-	tt_define_column(tb, _("Pt#"),      3, TT_FL_RIGHT);
-	tt_define_column(tb, _("Device"), 0.2, 0);
-	tt_define_column(tb, _("Info"),     2, 0);
-	tt_define_column(tb, _("Start"),    9, TT_FL_RIGHT);
-	tt_define_column(tb, _("End"),      9, TT_FL_RIGHT);
-	tt_define_column(tb, _("Sectors"),  9, TT_FL_RIGHT);
-	tt_define_column(tb, _("Id"),       2, TT_FL_RIGHT);
-	tt_define_column(tb, _("System"), 0.2, TT_FL_TRUNC);
+	fdisk_table_define_column(cxt, &tb, N_("Pt#"),      3, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Device"), 0.2, 0);
+	fdisk_table_define_column(cxt, &tb, N_("Info"),     2, 0);
+	fdisk_table_define_column(cxt, &tb, N_("Start"),    9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("End"),      9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Sectors"),  9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Id"),       2, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("System"), 0.2, TT_FL_TRUNC);
 
 	for (i = 0, used = 0; i < cxt->label->nparts_max; i++) {
 		uint32_t start, len;
@@ -288,7 +288,7 @@ static int sgi_list_table(struct fdisk_context *cxt)
 		if (sgi_get_num_sectors(cxt, i) == 0)
 			continue;
 
-		ln = tt_add_line(tb, NULL);
+		ln = tt_add_line(tb.tt, NULL);
 		if (!ln)
 			continue;
 		start = sgi_get_start_sector(cxt, i);
@@ -296,47 +296,48 @@ static int sgi_list_table(struct fdisk_context *cxt)
 		t = fdisk_get_partition_type(cxt, i);
 
 		if (asprintf(&p, "%zu:", i + 1) > 0)
-			tt_line_set_data(ln, 0, p);	/* # */
+			fdisk_table_set_data(&tb, ln, 0, p);	/* # */
 		p = fdisk_partname(cxt->dev_path, i + 1);
 		if (p)
-			tt_line_set_data(ln, 1, p);	/* Device */
+			fdisk_table_set_data(&tb, ln, 1, p);	/* Device */
 
 		p = sgi_get_swappartition(cxt) == (int) i ? "swap" :
 		    sgi_get_bootpartition(cxt) == (int) i ? "boot" : NULL;
 		if (p)
-			tt_line_set_data(ln, 2, strdup(p));	/* Info */
+			fdisk_table_set_data(&tb, ln, 2, strdup(p));	/* Info */
 
 		if (asprintf(&p, "%ju", (uintmax_t) fdisk_scround(cxt, start)) > 0)
-			tt_line_set_data(ln, 3, p);	/* Start */
+			fdisk_table_set_data(&tb, ln, 3, p);	/* Start */
 		if (asprintf(&p, "%ju",	(uintmax_t) fdisk_scround(cxt, start + len) - 1) > 0)
-			tt_line_set_data(ln, 4, p);	/* End */
+			fdisk_table_set_data(&tb, ln, 4, p);	/* End */
 		if (asprintf(&p, "%ju",	(uintmax_t) len) > 0)
-			tt_line_set_data(ln, 5, p);	/* Sectors*/
+			fdisk_table_set_data(&tb, ln, 5, p);	/* Sectors*/
 		if (asprintf(&p, "%2x", t->type) > 0)
-			tt_line_set_data(ln, 6, p);	/* type ID */
+			fdisk_table_set_data(&tb, ln, 6, p);	/* type ID */
 		if (t->name)
-			tt_line_set_data(ln, 7, strdup(t->name)); /* type Name */
+			fdisk_table_set_data(&tb, ln, 7, strdup(t->name)); /* type Name */
 		fdisk_free_parttype(t);
 		used++;
 	}
 
 	if (used)
-		rc = fdisk_print_table(cxt, tb);
-	tt_free_table(tb);
+		rc = fdisk_print_table(cxt, tb.tt);
+	fdisk_deinit_table(&tb);
 	if (rc)
 		return rc;
 
 	/*
 	 * Volumes
 	 */
-	tb = tt_new_table(TT_FL_FREEDATA);
-	if (!tb)
-		return -ENOMEM;
+	rc = fdisk_init_table(cxt, &tb);
+	if (rc)
+		return rc;
+	tt_set_name(tb.tt, "volumes");
 
-	tt_define_column(tb, _("#"),       3, TT_FL_RIGHT);
-	tt_define_column(tb, _("Name"),  0.2, 0);
-	tt_define_column(tb, _("Sector"),  2, TT_FL_RIGHT);
-	tt_define_column(tb, _("Size"),    9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("#"),       3, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Name"),  0.2, 0);
+	fdisk_table_define_column(cxt, &tb, N_("Sector"),  2, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Size"),    9, TT_FL_RIGHT);
 
 	for (i = 0, used = 0; i < SGI_MAXVOLUMES; i++) {
 		struct tt_line *ln;
@@ -344,25 +345,25 @@ static int sgi_list_table(struct fdisk_context *cxt)
 			 len = be32_to_cpu(sgilabel->volume[i].num_bytes);
 		if (!len)
 			continue;
-		ln = tt_add_line(tb, NULL);
+		ln = tt_add_line(tb.tt, NULL);
 		if (!ln)
 			continue;
 		if (asprintf(&p, "%zu:", i) > 0)
-			tt_line_set_data(ln, 0, p);		/* # */
+			fdisk_table_set_data(&tb, ln, 0, p);		/* # */
 		if (*sgilabel->volume[i].name)
-			tt_line_set_data(ln, 1,
+			fdisk_table_set_data(&tb, ln, 1,
 				strndup((char *) sgilabel->volume[i].name,
 				        sizeof(sgilabel->volume[i].name)));	/* Name */
 		if (asprintf(&p, "%ju", (uintmax_t) start) > 0)
-			tt_line_set_data(ln, 2, p);	/* Sector */
+			fdisk_table_set_data(&tb, ln, 2, p);	/* Sector */
 		if (asprintf(&p, "%ju",	(uintmax_t) len) > 0)
-			tt_line_set_data(ln, 3, p);	/* Size */
+			fdisk_table_set_data(&tb, ln, 3, p);	/* Size */
 		used++;
 	}
 
 	if (used)
-		rc = fdisk_print_table(cxt, tb);
-	tt_free_table(tb);
+		rc = fdisk_print_table(cxt, tb.tt);
+	fdisk_deinit_table(&tb);
 
 	fdisk_colon(cxt, _("Bootfile: %s"), sgilabel->boot_file);
 
@@ -668,7 +668,8 @@ static int sun_delete_partition(struct fdisk_context *cxt,
 static int sun_list_disklabel(struct fdisk_context *cxt)
 {
 	struct sun_disklabel *sunlabel;
-	struct tt *tb = NULL;
+	struct fdisk_table tb;
+	const char *pad;
 	size_t i;
 	int rc;
 
@@ -692,18 +693,21 @@ static int sun_list_disklabel(struct fdisk_context *cxt)
 		       *sunlabel->vtoc.volume_id ? sunlabel->vtoc.volume_id : _("<none>"));
 	}
 
-	tb = tt_new_table(TT_FL_FREEDATA);
-	if (!tb)
-		return -ENOMEM;
+	rc = fdisk_init_table(cxt, &tb);
+	if (rc)
+		return rc;
+
+	/* blanks to align the human readable output only */
+	pad = fdisk_context_is_machine_readable(cxt) ? "" : " ";
 
-	tt_define_column(tb, _("Device"), 0.2, 0);
-	tt_define_column(tb, _("Flag"),     2, TT_FL_RIGHT);
-	tt_define_column(tb, _("Start"),    9, TT_FL_RIGHT);
-	tt_define_column(tb, _("End"),      9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Device"), 0.2, 0);
+	fdisk_table_define_column(cxt, &tb, N_("Flag"),     2, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Start"),    9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("End"),      9, TT_FL_RIGHT);
 	/* TRANSLATORS: keep one blank space behind 'Blocks' */
-	tt_define_column(tb, _("Blocks "),  9, TT_FL_RIGHT);
-	tt_define_column(tb, _("Id"),       2, TT_FL_RIGHT);
-	tt_define_column(tb, _("System"), 0.2, TT_FL_TRUNC);
+	fdisk_table_define_column(cxt, &tb, N_("Blocks "),  9, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("Id"),       2, TT_FL_RIGHT);
+	fdisk_table_define_column(cxt, &tb, N_("System"), 0.2, TT_FL_TRUNC);
 
 	for (i = 0 ; i < cxt->label->nparts_max; i++) {
 		struct sun_partition *part = &sunlabel->partitions[i];
@@ -715,7 +719,7 @@ static int sun_list_disklabel(struct fdisk_context *cxt)
 
 		if (!part->num_sectors)
 			continue;
-		ln = tt_add_line(tb, NULL);
+		ln = tt_add_line(tb.tt, NULL);
 		if (!ln)
 			continue;
 
@@ -728,30 +732,30 @@ static int sun_list_disklabel(struct fdisk_context *cxt)
 
 		p = fdisk_partname(cxt->dev_path, i + 1);
 		if (p)
-			tt_line_set_data(ln, 0, p);	/* devname */
+			fdisk_table_set_data(&tb, ln, 0, p);	/* devname */
 		if ((flags & SUN_FLAG_UNMNT || flags & SUN_FLAG_RONLY)
 		    && asprintf(&p, "%c%c",
 				flags & SUN_FLAG_UNMNT ? 'u' : ' ',
 				flags & SUN_FLAG_RONLY ? 'r' : ' ') > 0)
-			tt_line_set_data(ln, 1, p);	/* flags */
+			fdisk_table_set_data(&tb, ln, 1, p);	/* flags */
 		if (asprintf(&p, "%ju", (uintmax_t) fdisk_scround(cxt, start)) > 0)
-			tt_line_set_data(ln, 2, p);	/* start */
+			fdisk_table_set_data(&tb, ln, 2, p);	/* start */
 		if (asprintf(&p, "%ju",	(uintmax_t) fdisk_scround(cxt, start + len - 1)) > 0)
-			tt_line_set_data(ln, 3, p);	/* end */
-		if (asprintf(&p, "%lu%c",
+			fdisk_table_set_data(&tb, ln, 3, p);	/* end */
+		if (asprintf(&p, "%lu%s",
 				(unsigned long) len / 2,
-				len & 1 ? '+' : ' ') > 0)
-			tt_line_set_data(ln, 4, p);	/* blocks + flag */
+				len & 1 ? "+" : pad) > 0)
+			fdisk_table_set_data(&tb, ln, 4, p);	/* blocks + flag */
 		if (asprintf(&p, "%2x", t->type) > 0)
-			tt_line_set_data(ln, 5, p);	/* type ID */
+			fdisk_table_set_data(&tb, ln, 5, p);	/* type ID */
 		if (t->name)
-			tt_line_set_data(ln, 6, strdup(t->name)); /* type Name */
+			fdisk_table_set_data(&tb, ln, 6, strdup(t->name)); /* type Name */
 
 		fdisk_free_parttype(t);
 	}
 
-	rc = fdisk_print_table(cxt, tb);
-	tt_free_table(tb);
+	rc = fdisk_print_table(cxt, tb.tt);
+	fdisk_deinit_table(&tb);
 
 	return rc;
 }
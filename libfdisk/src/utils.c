@@ -17,10 +17,140 @@ void fdisk_zeroize_firstsector(struct fdisk_context *cxt)
 	memset(cxt->firstsector, 0, cxt->sector_size);
 }
 
-int fdisk_read_firstsector(struct fdisk_context *cxt)
+static struct fdisk_sector *get_cached_sector(struct fdisk_context *cxt,
+					      sector_t lba)
+{
+	size_t i;
+
+	for (i = 0; i < FDISK_SECTORS_CACHE_SIZE; i++) {
+		struct fdisk_sector *s = &cxt->sectors[i];
+
+		if (s->used && s->lba == lba)
+			return s;
+	}
+	return NULL;
+}
+
+static void add_cached_sector(struct fdisk_context *cxt, sector_t lba,
+			      const unsigned char *data)
+{
+	struct fdisk_sector *s = get_cached_sector(cxt, lba);
+
+	if (!s) {
+		s = &cxt->sectors[cxt->sectors_next];
+		cxt->sectors_next = (cxt->sectors_next + 1) % FDISK_SECTORS_CACHE_SIZE;
+	}
+	if (!s->data) {
+		s->data = malloc(cxt->sector_size);
+		if (!s->data) {
+			s->used = 0;
+			return;
+		}
+	}
+	memcpy(s->data, data, cxt->sector_size);
+	s->lba = lba;
+	s->used = 1;
+}
+
+/*
+ * Reads @nsectors from @lba to @buf. The label drivers read the same sectors
+ * (first sector, GPT headers, EBRs, nested labels) from more places -- probing,
+ * label switching, device properties reset, ... so all the sectors are cached in
+ * the context. The cache is invalidated by fdisk_invalidate_sectors(), it's
+ * necessary to call it always when anything is written to the device.
+ *
+ * Returns: 0 on success, negative errno on error.
+ */
+int fdisk_read_sectors(struct fdisk_context *cxt, sector_t lba,
+		       size_t nsectors, void *buf)
 {
+	unsigned char *p = buf;
+	size_t i, sz;
 	ssize_t r;
 
+	assert(cxt);
+	assert(cxt->sector_size);
+	assert(buf);
+
+	if (cxt->dev_fd < 0 || !nsectors)
+		return -EINVAL;
+
+	if (cxt->sectors_size != cxt->sector_size) {
+		/* sector size modified by user or topology reset */
+		fdisk_free_sectors(cxt);
+		cxt->sectors_size = cxt->sector_size;
+	}
+
+	for (i = 0; i < nsectors; i++) {
+		struct fdisk_sector *s = get_cached_sector(cxt, lba + i);
+
+		if (!s)
+			break;
+		memcpy(p + i * cxt->sector_size, s->data, cxt->sector_size);
+	}
+	if (i == nsectors) {
+		DBG(CONTEXT, dbgprint("sectors %ju-%ju: cached",
+				(uintmax_t) lba, (uintmax_t) lba + nsectors - 1));
+		return 0;
+	}
+
+	DBG(CONTEXT, dbgprint("sectors %ju-%ju: reading",
+				(uintmax_t) lba, (uintmax_t) lba + nsectors - 1));
+
+	sz = nsectors * cxt->sector_size;
+	r = pread(cxt->dev_fd, buf, sz, (off_t) lba * cxt->sector_size);
+	if (r != (ssize_t) sz) {
+		if (!errno)
+			errno = EINVAL;	/* probably too small file/device */
+		return -errno;
+	}
+
+	/* don't flush whole cache by large areas */
+	if (nsectors <= FDISK_SECTORS_CACHE_SIZE / 2) {
+		for (i = 0; i < nsectors; i++)
+			add_cached_sector(cxt, lba + i, p + i * cxt->sector_size);
+	}
+	return 0;
+}
+
+/*
+ * Drops all cached sectors, the nested context shares the device with the
+ * parent, so the parent's cache is invalidated too.
+ */
+void fdisk_invalidate_sectors(struct fdisk_context *cxt)
+{
+	for (; cxt; cxt = cxt->parent) {
+		size_t i;
+
+		DBG(CONTEXT, dbgprint("invalidate sectors cache"));
+		for (i = 0; i < FDISK_SECTORS_CACHE_SIZE; i++)
+			cxt->sectors[i].used = 0;
+		cxt->sectors_next = 0;
+	}
+}
+
+/*
+ * Deallocates the sectors cache
+ */
+void fdisk_free_sectors(struct fdisk_context *cxt)
+{
+	size_t i;
+
+	if (!cxt)
+		return;
+
+	for (i = 0; i < FDISK_SECTORS_CACHE_SIZE; i++) {
+		free(cxt->sectors[i].data);
+		cxt->sectors[i].data = NULL;
+		cxt->sectors[i].used = 0;
+	}
+	cxt->sectors_next = 0;
+}
+
+int fdisk_read_firstsector(struct fdisk_context *cxt)
+{
+	int rc;
+
 	assert(cxt);
 	assert(cxt->sector_size);
 
@@ -34,16 +164,10 @@ int fdisk_read_firstsector(struct fdisk_context *cxt)
 	} else
 		fdisk_zeroize_firstsector(cxt);
 
-	r = read(cxt->dev_fd, cxt->firstsector, cxt->sector_size);
-
-	if (r != cxt->sector_size) {
-		if (!errno)
-			errno = EINVAL;	/* probably too small file/device */
-		DBG(TOPOLOGY, dbgprint("failed to read first sector %m"));
-		return -errno;
-	}
-
-	return 0;
+	rc = fdisk_read_sectors(cxt, 0, 1, cxt->firstsector);
+	if (rc)
+		DBG(TOPOLOGY, dbgprint("failed to read first sector [rc=%d]", rc));
+	return rc;
 }
 
 /*
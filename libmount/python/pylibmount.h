@@ -83,6 +83,7 @@ typedef struct {
 	struct libmnt_table		*tab;
 	struct libmnt_iter		*iter;
 	PyObject			*errcb;
+	FsObject			*proxy;		/* see Table.next_fs_proxy() */
 } TableObject;
 
 extern PyTypeObject TableType;
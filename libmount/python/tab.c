@@ -498,6 +498,161 @@ static PyObject *Table_next_fs(TableObject *self)
 	return PyObjectResultFs(fs);
 }
 
+#define Table_next_fs_proxy_HELP "next_fs_proxy()\n\n" \
+		"The same as Table.next_fs(), but always returns the same Fs object\n" \
+		"(the proxy) which is re-assigned to the next filesystem in the table.\n" \
+		"It's cheaper than Table.next_fs() for large tables. Don't keep\n" \
+		"the object, use Fs.copy_fs() if you need the entry later. The\n" \
+		"iterator is shared with Table.next_fs().\n" \
+		"\n" \
+		"Returns Fs proxy, raises an exception in case of an error and\n" \
+		"None at end of list."
+static PyObject *Table_next_fs_proxy(TableObject *self)
+{
+	struct libmnt_fs *fs;
+	int rc;
+
+	/* Reset the builtin iterator after reaching the end of the list */
+	rc = mnt_table_next_fs(self->tab, self->iter, &fs);
+	if (rc == 1) {
+		mnt_reset_iter(self->iter, MNT_ITER_FORWARD);
+		Py_RETURN_NONE;
+	} else if (rc)
+		return UL_RaiseExc(-rc);
+
+	if (!self->proxy) {
+		self->proxy = PyObject_New(FsObject, &FsType);
+		if (!self->proxy)
+			return UL_RaiseExc(ENOMEM);
+		self->proxy->fs = NULL;
+		DBG(TAB, pymnt_debug_h(self, "new proxy py-obj %p", self->proxy));
+	}
+
+	/* don't use fs userdata, the proxy does not belong to any fs */
+	mnt_ref_fs(fs);
+	mnt_unref_fs(self->proxy->fs);
+	self->proxy->fs = fs;
+
+	Py_INCREF(self->proxy);
+	return (PyObject *) self->proxy;
+}
+
+struct table_column {
+	const char *name;
+	const char *(*get_str)(struct libmnt_fs *fs);
+	int (*get_int)(struct libmnt_fs *fs);
+};
+
+static const struct table_column table_columns[] = {
+	{ "source",	mnt_fs_get_source },
+	{ "srcpath",	mnt_fs_get_srcpath },
+	{ "root",	mnt_fs_get_root },
+	{ "target",	mnt_fs_get_target },
+	{ "fstype",	mnt_fs_get_fstype },
+	{ "options",	mnt_fs_get_options },
+	{ "vfs_options", mnt_fs_get_vfs_options },
+	{ "opt_fields",	mnt_fs_get_optional_fields },
+	{ "fs_options",	mnt_fs_get_fs_options },
+	{ "usr_options", mnt_fs_get_user_options },
+	{ "attributes",	mnt_fs_get_attributes },
+	{ "comment",	mnt_fs_get_comment },
+	{ "id",		NULL, mnt_fs_get_id },
+	{ "parent",	NULL, mnt_fs_get_parent_id },
+	{ "freq",	NULL, mnt_fs_get_freq },
+	{ "passno",	NULL, mnt_fs_get_passno }
+};
+
+static const struct table_column *get_table_column(PyObject *o)
+{
+	const char *name;
+	size_t i;
+
+	if (!PyArg_Parse(o, "s", &name))
+		return NULL;
+	for (i = 0; i < sizeof(table_columns) / sizeof(table_columns[0]); i++) {
+		if (strcmp(table_columns[i].name, name) == 0)
+			return &table_columns[i];
+	}
+	PyErr_Format(PyExc_ValueError, "unknown column '%s'", name);
+	return NULL;
+}
+
+#define Table_get_columns_HELP "get_columns(name, ...)\n\n" \
+		"Returns data for all filesystems in the table by one call, without\n" \
+		"Fs objects. The names are Fs attributes (\"source\", \"srcpath\",\n" \
+		"\"root\", \"target\", \"fstype\", \"options\", \"vfs_options\",\n" \
+		"\"opt_fields\", \"fs_options\", \"usr_options\", \"attributes\",\n" \
+		"\"comment\", \"id\", \"parent\", \"freq\" or \"passno\").\n" \
+		"\n" \
+		"Example:\n" \
+		"<informalexample>\n" \
+		"<programlisting>\n" \
+		"targets, types = tb.get_columns(\"target\", \"fstype\")\n" \
+		"</programlisting>\n" \
+		"</informalexample>\n" \
+		"\n" \
+		"Returns a tuple with one tuple of values for each name."
+static PyObject *Table_get_columns(TableObject *self, PyObject *args)
+{
+	const struct table_column **cols = NULL;
+	struct libmnt_iter *itr = NULL;
+	struct libmnt_fs *fs;
+	PyObject *result = NULL;
+	Py_ssize_t i, ncols = PyTuple_Size(args);
+	int row = 0, nents = mnt_table_get_nents(self->tab);
+
+	if (ncols <= 0) {
+		PyErr_SetString(PyExc_TypeError, ARG_ERR);
+		return NULL;
+	}
+	cols = malloc(ncols * sizeof(*cols));
+	if (!cols)
+		return UL_RaiseExc(ENOMEM);
+
+	for (i = 0; i < ncols; i++) {
+		cols[i] = get_table_column(PyTuple_GET_ITEM(args, i));
+		if (!cols[i])
+			goto done;
+	}
+
+	result = PyTuple_New(ncols);
+	if (!result)
+		goto done;
+	for (i = 0; i < ncols; i++) {
+		PyObject *col = PyTuple_New(nents);
+
+		if (!col)
+			goto err;
+		PyTuple_SET_ITEM(result, i, col);
+	}
+
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr) {
+		UL_RaiseExc(ENOMEM);
+		goto err;
+	}
+
+	while (row < nents && mnt_table_next_fs(self->tab, itr, &fs) == 0) {
+		for (i = 0; i < ncols; i++) {
+			PyObject *val = cols[i]->get_str ?
+				PyObjectResultStr(cols[i]->get_str(fs)) :
+				PyObjectResultInt(cols[i]->get_int(fs));
+			if (!val)
+				goto err;
+			PyTuple_SET_ITEM(PyTuple_GET_ITEM(result, i), row, val);
+		}
+		row++;
+	}
+	goto done;
+err:
+	Py_DECREF(result);
+	result = NULL;
+done:
+	mnt_free_iter(itr);
+	free(cols);
+	return result;
+}
+
 static PyMethodDef Table_methods[] = {
 	{"enable_comments", (PyCFunction)Table_enable_comments, METH_VARARGS|METH_KEYWORDS, Table_enable_comments_HELP},
 	{"find_pair", (PyCFunction)Table_find_pair, METH_VARARGS|METH_KEYWORDS, Table_find_pair_HELP},
@@ -516,6 +671,8 @@ static PyMethodDef Table_methods[] = {
 	{"add_fs", (PyCFunction)Table_add_fs, METH_VARARGS|METH_KEYWORDS, Table_add_fs_HELP},
 	{"remove_fs", (PyCFunction)Table_remove_fs, METH_VARARGS|METH_KEYWORDS, Table_remove_fs_HELP},
 	{"next_fs", (PyCFunction)Table_next_fs, METH_NOARGS, Table_next_fs_HELP},
+	{"next_fs_proxy", (PyCFunction)Table_next_fs_proxy, METH_NOARGS, Table_next_fs_proxy_HELP},
+	{"get_columns", (PyCFunction)Table_get_columns, METH_VARARGS, Table_get_columns_HELP},
 	{"write_file", (PyCFunction)Table_write_file, METH_VARARGS|METH_KEYWORDS, Table_write_file_HELP},
 	{"replace_file", (PyCFunction)Table_replace_file, METH_VARARGS|METH_KEYWORDS, Table_replace_file_HELP},
 	{NULL}
@@ -553,6 +710,7 @@ static void Table_destructor(TableObject *self)
 
 	mnt_free_iter(self->iter);
 	Py_XDECREF(self->errcb);
+	Py_XDECREF(self->proxy);
 	PyFree(self);
 }
 
@@ -568,6 +726,7 @@ static PyObject *Table_new(PyTypeObject *type,
 		self->tab = NULL;
 		self->iter = NULL;
 		self->errcb = NULL;
+		self->proxy = NULL;
 	}
 	return (PyObject *)self;
 }
@@ -86,6 +86,22 @@ def test_parse(ts, argv):
 		print("Trailing comment:\n\"{:s}\"".format(tb.trailing_comment))
 	return 0
 
+def test_columns(ts, argv):
+	tb = create_table(argv[1], False)
+	names = argv[2:] or ["source", "target", "fstype"]
+
+	rows = list(zip(*tb.get_columns(*names)))
+	for row in rows:
+		print(" ".join(str(x) for x in row))
+
+	# the same data by the proxy iterator
+	prox = [tuple(getattr(fs, x) for x in names)
+			for fs in iter(ft.partial(tb.next_fs_proxy), None)]
+	if prox != rows:
+		print("proxy iterator returns different data")
+		return -1
+	return 0
+
 def test_find(ts, argv, dr):
 	if len(argv) != 4:
 		print("try --help")
@@ -152,6 +168,7 @@ def test_find_mountpoint(ts, argv):
 
 tss = (
 	( "--parse",    test_parse,        "<file> [--comments] parse and print(tab" ),
+	( "--columns",  test_columns,      "<file> [<name> ...] print columns" ),
 	( "--find-forward",  test_find_fw, "<file> <source|target> <string>" ),
 	( "--find-backward", test_find_bw, "<file> <source|target> <string>" ),
 	( "--find-pair",     test_find_pair, "<file> <source> <target>" ),
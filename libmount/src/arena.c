@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * arena.c - simple bump allocator for parsed tables
+ *
+ * The memory is allocated in chunks and it's never deallocated per object,
+ * all the chunks are deallocated when the last reference to the arena is
+ * dropped. Every libmnt_fs allocated from the arena (or with strings from the
+ * arena) holds one reference.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mountP.h"
+
+#define MNT_ARENA_CHUNKSZ	(64 * 1024)
+#define MNT_ARENA_ALIGN(_s)	(((_s) + 7) & ~((size_t) 7))
+
+struct libmnt_arena_chunk {
+	struct libmnt_arena_chunk *next;
+	size_t		size;		/* size of data[] */
+	size_t		used;		/* already allocated bytes */
+	char		data[];
+};
+
+struct libmnt_arena *mnt_new_arena(void)
+{
+	struct libmnt_arena *ar = calloc(1, sizeof(*ar));
+
+	if (!ar)
+		return NULL;
+	ar->refcount = 1;
+	return ar;
+}
+
+void mnt_ref_arena(struct libmnt_arena *ar)
+{
+	if (ar)
+		ar->refcount++;
+}
+
+void mnt_unref_arena(struct libmnt_arena *ar)
+{
+	struct libmnt_arena_chunk *ch;
+
+	if (!ar || --ar->refcount > 0)
+		return;
+
+	while ((ch = ar->chunks)) {
+		ar->chunks = ch->next;
+		free(ch);
+	}
+	free(ar);
+}
+
+/*
+ * Returns zeroized memory, the first chunk is the active one.
+ */
+void *mnt_arena_alloc(struct libmnt_arena *ar, size_t sz)
+{
+	struct libmnt_arena_chunk *ch;
+	void *p;
+
+	assert(ar);
+
+	sz = MNT_ARENA_ALIGN(sz);
+	ch = ar->chunks;
+
+	if (!ch || ch->size - ch->used < sz) {
+		size_t chsz = sz > MNT_ARENA_CHUNKSZ / 4 ? sz : MNT_ARENA_CHUNKSZ;
+
+		ch = malloc(sizeof(*ch) + chsz);
+		if (!ch)
+			return NULL;
+		ch->size = chsz;
+		ch->used = 0;
+		ch->next = ar->chunks;
+		ar->chunks = ch;
+	}
+
+	p = ch->data + ch->used;
+	ch->used += sz;
+	memset(p, 0, sz);
+	return p;
+}
+
+char *mnt_arena_strdup(struct libmnt_arena *ar, const char *str)
+{
+	size_t sz;
+	char *p;
+
+	if (!str)
+		return NULL;
+	sz = strlen(str) + 1;
+	p = mnt_arena_alloc(ar, sz);
+	if (p)
+		memcpy(p, str, sz);
+	return p;
+}
+
+/*
+ * Reads the whole stream to a new chunk, the data are terminated by '\0'. The
+ * files from /proc have no size, so the buffer is enlarged until EOF.
+ *
+ * Returns: pointer to the data and @sz is set to the number of read bytes.
+ */
+char *mnt_arena_read_stream(struct libmnt_arena *ar, FILE *f, size_t *sz)
+{
+	struct libmnt_arena_chunk *ch = NULL;
+	size_t len = 0, bufsz = 256 * 1024;
+
+	assert(ar);
+	assert(f);
+
+	do {
+		struct libmnt_arena_chunk *tmp;
+
+		if (ch && len == bufsz)
+			bufsz *= 2;
+		tmp = realloc(ch, sizeof(*ch) + bufsz + 1);
+		if (!tmp)
+			goto err;
+		ch = tmp;
+		len += fread(ch->data + len, 1, bufsz - len, f);
+		if (ferror(f))
+			goto err;
+	} while (!feof(f));
+
+	ch->data[len] = '\0';
+	ch->size = ch->used = len + 1;
+
+	/* the active chunk has to be the first */
+	if (ar->chunks) {
+		ch->next = ar->chunks->next;
+		ar->chunks->next = ch;
+	} else {
+		ch->next = NULL;
+		ar->chunks = ch;
+	}
+
+	if (sz)
+		*sz = len;
+	return ch->data;
+err:
+	free(ch);
+	return NULL;
+}
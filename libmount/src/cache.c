@@ -30,26 +30,44 @@
 
 /*
  * Canonicalized (resolved) paths & tags cache
+ *
+ * The paths and tags are in separate hash tables, the tags are also hashed by
+ * device name (for mnt_cache_find_tag_value()). All the entries are in LRU
+ * list, the least recently used entries are removed if the cache limit is
+ * set (see mnt_cache_set_limit()).
  */
-#define MNT_CACHE_CHUNKSZ	128
+#define MNT_CACHE_MINBUCKETS	64
 
 #define MNT_CACHE_ISTAG		(1 << 1) /* entry is TAG */
 #define MNT_CACHE_ISPATH	(1 << 2) /* entry is path */
 #define MNT_CACHE_TAGREAD	(1 << 3) /* tag read by mnt_cache_read_tags() */
+#define MNT_CACHE_NOTAGS	(1 << 4) /* probing failed, the result is remembered */
 
 /* path cache entry */
 struct mnt_cache_entry {
 	char			*key;	/* search key (e.g. uncanonicalized path) */
 	char			*value;	/* value (e.g. canonicalized path) */
 	int			flag;
+
+	unsigned int		hash;	 /* hash of the key */
+	unsigned int		devhash; /* tags: hash of the value (devname) */
+	struct mnt_cache_entry	*next;	 /* next in paths[] or tags[] bucket */
+	struct mnt_cache_entry	*devnext;/* tags: next in devs[] bucket */
+	struct list_head	lru;	 /* the most recently used first */
 };
 
 struct libmnt_cache {
-	struct mnt_cache_entry	*ents;
+	struct mnt_cache_entry	**paths;	/* path -> canonicalized path */
+	struct mnt_cache_entry	**tags;		/* NAME=value -> devname */
+	struct mnt_cache_entry	**devs;		/* devname -> tags */
+	size_t			nbuckets;
 	size_t			nents;
-	size_t			nallocs;
+	size_t			limit;		/* max number of entries or 0 */
+	struct list_head	lru;
 	int			refcount;
 
+	struct canonicalize_cache *cc;	/* resolved path components */
+
 	/* blkid_evaluate_tag() works in two ways:
 	 *
 	 * 1/ all tags are evaluated by udev /dev/disk/by-* symlinks,
@@ -74,9 +92,18 @@ struct libmnt_cache *mnt_new_cache(void)
 		return NULL;
 	DBG(CACHE, mnt_debug_h(cache, "alloc"));
 	cache->refcount = 1;
+	INIT_LIST_HEAD(&cache->lru);
 	return cache;
 }
 
+static void free_entry(struct mnt_cache_entry *e)
+{
+	if (e->value != e->key)
+		free(e->value);
+	free(e->key);
+	free(e);
+}
+
 /**
  * mnt_free_cache:
  * @cache: pointer to struct libmnt_cache instance
@@ -86,23 +113,24 @@ struct libmnt_cache *mnt_new_cache(void)
  */
 void mnt_free_cache(struct libmnt_cache *cache)
 {
-	size_t i;
-
 	if (!cache)
 		return;
 
 	DBG(CACHE, mnt_debug_h(cache, "free"));
 	WARN_REFCOUNT(CACHE, cache, cache->refcount);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (e->value != e->key)
-			free(e->value);
-		free(e->key);
+	while (!list_empty(&cache->lru)) {
+		struct mnt_cache_entry *e = list_entry(cache->lru.next,
+					struct mnt_cache_entry, lru);
+		list_del(&e->lru);
+		free_entry(e);
 	}
-	free(cache->ents);
+	free(cache->paths);
+	free(cache->tags);
+	free(cache->devs);
 	if (cache->bc)
 		blkid_put_cache(cache->bc);
+	free_canonicalize_cache(cache->cc);
 	free(cache);
 }
 
@@ -137,6 +165,151 @@ void mnt_unref_cache(struct libmnt_cache *cache)
 	}
 }
 
+/* FNV-1a of @a or @a=@b (tag name and value) */
+static unsigned int hash_strings(const char *a, const char *b)
+{
+	unsigned int h = 2166136261U;
+	const char *p;
+
+	for (p = a; *p; p++) {
+		h ^= (unsigned char) *p;
+		h *= 16777619U;
+	}
+	if (b) {
+		h ^= '=';
+		h *= 16777619U;
+		for (p = b; *p; p++) {
+			h ^= (unsigned char) *p;
+			h *= 16777619U;
+		}
+	}
+	return h;
+}
+
+static inline size_t bucket(struct libmnt_cache *cache, unsigned int hash)
+{
+	return hash & (cache->nbuckets - 1);
+}
+
+static void hash_entry(struct libmnt_cache *cache, struct mnt_cache_entry *e)
+{
+	size_t i = bucket(cache, e->hash);
+
+	if (e->flag & MNT_CACHE_ISPATH) {
+		e->next = cache->paths[i];
+		cache->paths[i] = e;
+	} else {
+		e->next = cache->tags[i];
+		cache->tags[i] = e;
+
+		i = bucket(cache, e->devhash);
+		e->devnext = cache->devs[i];
+		cache->devs[i] = e;
+	}
+}
+
+static void unhash_entry(struct libmnt_cache *cache, struct mnt_cache_entry *e)
+{
+	struct mnt_cache_entry **pp;
+
+	pp = (e->flag & MNT_CACHE_ISPATH) ? &cache->paths[bucket(cache, e->hash)]
+					  : &cache->tags[bucket(cache, e->hash)];
+	for (; *pp; pp = &(*pp)->next) {
+		if (*pp == e) {
+			*pp = e->next;
+			break;
+		}
+	}
+	if (e->flag & MNT_CACHE_ISPATH)
+		return;
+
+	for (pp = &cache->devs[bucket(cache, e->devhash)]; *pp; pp = &(*pp)->devnext) {
+		if (*pp == e) {
+			*pp = e->devnext;
+			break;
+		}
+	}
+}
+
+static int resize_cache(struct libmnt_cache *cache, size_t nbuckets)
+{
+	struct mnt_cache_entry **paths, **tags, **devs;
+	struct list_head *p;
+
+	paths = calloc(nbuckets, sizeof(struct mnt_cache_entry *));
+	tags = calloc(nbuckets, sizeof(struct mnt_cache_entry *));
+	devs = calloc(nbuckets, sizeof(struct mnt_cache_entry *));
+	if (!paths || !tags || !devs) {
+		free(paths);
+		free(tags);
+		free(devs);
+		return -ENOMEM;
+	}
+
+	free(cache->paths);
+	free(cache->tags);
+	free(cache->devs);
+	cache->paths = paths;
+	cache->tags = tags;
+	cache->devs = devs;
+	cache->nbuckets = nbuckets;
+
+	/* from the oldest, the most recently used will be first in buckets */
+	list_for_each_backwardly(p, &cache->lru)
+		hash_entry(cache, list_entry(p, struct mnt_cache_entry, lru));
+	return 0;
+}
+
+static void remove_entry(struct libmnt_cache *cache, struct mnt_cache_entry *e)
+{
+	DBG(CACHE, mnt_debug_h(cache, "remove entry (%s): %s: %s",
+			(e->flag & MNT_CACHE_ISPATH) ? "path" : "tag",
+			e->value, e->key));
+	unhash_entry(cache, e);
+	list_del(&e->lru);
+	free_entry(e);
+	cache->nents--;
+}
+
+/*
+ * Removes the least recently used entries if the cache is bigger than the
+ * limit. The tags read by mnt_cache_read_tags() are removed together, otherwise
+ * the device would be incomplete in the cache. The entry @keep (the new one) is
+ * never removed.
+ */
+static void shrink_cache(struct libmnt_cache *cache, struct mnt_cache_entry *keep)
+{
+	while (cache->limit && cache->nents > cache->limit) {
+		struct mnt_cache_entry *e = list_entry(cache->lru.prev,
+					struct mnt_cache_entry, lru);
+		if (e == keep)
+			break;
+
+		if (e->flag & MNT_CACHE_TAGREAD) {
+			struct mnt_cache_entry *x, *next;
+			size_t i = bucket(cache, e->devhash);
+
+			for (x = cache->devs[i]; x; x = next) {
+				next = x->devnext;
+				if (x != e && x != keep &&
+				    (x->flag & MNT_CACHE_TAGREAD) &&
+				    strcmp(x->value, e->value) == 0)
+					remove_entry(cache, x);
+			}
+		}
+		remove_entry(cache, e);
+	}
+}
+
+/* marks @e as the most recently used */
+static inline void touch_entry(struct libmnt_cache *cache,
+			       struct mnt_cache_entry *e)
+{
+	if (cache->limit) {
+		list_del(&e->lru);
+		list_add(&e->lru, &cache->lru);
+	}
+}
 
 /* note that the @key could be the same pointer as @value */
 static int cache_add_entry(struct libmnt_cache *cache, char *key,
@@ -148,26 +321,36 @@ static int cache_add_entry(struct libmnt_cache *cache, char *key,
 	assert(value);
 	assert(key);
 
-	if (cache->nents == cache->nallocs) {
-		size_t sz = cache->nallocs + MNT_CACHE_CHUNKSZ;
+	if (cache->nents >= cache->nbuckets * 2 &&
+	    resize_cache(cache, cache->nbuckets ?
+				cache->nbuckets * 2 : MNT_CACHE_MINBUCKETS))
+		return -ENOMEM;
 
-		e = realloc(cache->ents, sz * sizeof(struct mnt_cache_entry));
-		if (!e)
-			return -ENOMEM;
-		cache->ents = e;
-		cache->nallocs = sz;
-	}
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return -ENOMEM;
 
-	e = &cache->ents[cache->nents];
 	e->key = key;
 	e->value = value;
 	e->flag = flag;
+
+	if (flag & MNT_CACHE_ISPATH)
+		e->hash = hash_strings(key, NULL);
+	else {
+		e->hash = hash_strings(key, key + strlen(key) + 1);
+		e->devhash = hash_strings(value, NULL);
+	}
+
+	hash_entry(cache, e);
+	list_add(&e->lru, &cache->lru);
 	cache->nents++;
 
 	DBG(CACHE, mnt_debug_h(cache, "add entry [%2zd] (%s): %s: %s",
 			cache->nents,
 			(flag & MNT_CACHE_ISPATH) ? "path" : "tag",
 			value, key));
+
+	shrink_cache(cache, e);
 	return 0;
 }
 
@@ -212,20 +395,22 @@ static int cache_add_tag(struct libmnt_cache *cache, const char *tagname,
  */
 static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
+	unsigned int hash;
 
 	assert(cache);
 	assert(path);
 
-	if (!cache || !path)
+	if (!cache || !path || !cache->nents)
 		return NULL;
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISPATH))
-			continue;
-		if (strcmp(path, e->key) == 0)
+	hash = hash_strings(path, NULL);
+
+	for (e = cache->paths[bucket(cache, hash)]; e; e = e->next) {
+		if (e->hash == hash && strcmp(path, e->key) == 0) {
+			touch_entry(cache, e);
 			return e->value;
+		}
 	}
 	return NULL;
 }
@@ -236,25 +421,54 @@ static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 static const char *cache_find_tag(struct libmnt_cache *cache,
 			const char *token, const char *value)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
+	unsigned int hash;
 	size_t tksz;
 
 	assert(cache);
 	assert(token);
 	assert(value);
 
-	if (!cache || !token || !value)
+	if (!cache || !token || !value || !cache->nents)
 		return NULL;
 
 	tksz = strlen(token);
+	hash = hash_strings(token, value);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISTAG))
-			continue;
-		if (strcmp(token, e->key) == 0 &&
-		    strcmp(value, e->key + tksz + 1) == 0)
+	for (e = cache->tags[bucket(cache, hash)]; e; e = e->next) {
+		if (e->hash == hash &&
+		    strcmp(token, e->key) == 0 &&
+		    strcmp(value, e->key + tksz + 1) == 0) {
+			touch_entry(cache, e);
 			return e->value;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Returns tag entry for @devname, if @token is NULL then returns the first
+ * entry read by mnt_cache_read_tags().
+ */
+static struct mnt_cache_entry *cache_find_devname(struct libmnt_cache *cache,
+			const char *devname, const char *token)
+{
+	struct mnt_cache_entry *e;
+	unsigned int hash;
+
+	if (!cache->nents)
+		return NULL;
+
+	hash = hash_strings(devname, NULL);
+
+	for (e = cache->devs[bucket(cache, hash)]; e; e = e->devnext) {
+		if (e->devhash != hash || strcmp(e->value, devname) != 0)
+			continue;
+		if (token ? strcmp(token, e->key) == 0 :
+			    (e->flag & MNT_CACHE_TAGREAD) != 0) {
+			touch_entry(cache, e);
+			return e;
+		}
 	}
 	return NULL;
 }
@@ -262,24 +476,47 @@ static const char *cache_find_tag(struct libmnt_cache *cache,
 static char *cache_find_tag_value(struct libmnt_cache *cache,
 			const char *devname, const char *token)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
 
 	assert(cache);
 	assert(devname);
 	assert(token);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISTAG))
-			continue;
-		if (strcmp(e->value, devname) == 0 &&	/* dev name */
-		    strcmp(token, e->key) == 0)	/* tag name */
-			return e->key + strlen(token) + 1;	/* tag value */
-	}
-
+	e = cache_find_devname(cache, devname, token);
+	if (e)
+		return e->key + strlen(token) + 1;	/* tag value */
 	return NULL;
 }
 
+/**
+ * mnt_cache_set_limit:
+ * @cache: pointer to struct libmnt_cache instance
+ * @limit: maximal number of the cached paths and tags or zero
+ *
+ * Sets the maximal number of entries in the cache, the least recently used
+ * entries are removed from the cache if the limit is reached. The default is
+ * no limit, the limit is useful for long-running processes (daemons) which
+ * use the same cache for years.
+ *
+ * Note that the strings returned by the cache (e.g. mnt_resolve_path())
+ * are deallocated when the entry is removed, so the limit has to be much
+ * larger than the number of strings the application uses at the same time
+ * (e.g. 2 x the number of entries in the tables where the cache is used).
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_cache_set_limit(struct libmnt_cache *cache, size_t limit)
+{
+	assert(cache);
+	if (!cache)
+		return -EINVAL;
+
+	DBG(CACHE, mnt_debug_h(cache, "set limit to %zu", limit));
+	cache->limit = limit;
+	shrink_cache(cache, NULL);
+	return 0;
+}
+
 /**
  * mnt_cache_read_tags
  * @cache: pointer to struct libmnt_cache instance
@@ -292,6 +529,7 @@ static char *cache_find_tag_value(struct libmnt_cache *cache,
  */
 int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
 {
+	struct mnt_cache_entry *e;
 	blkid_probe pr;
 	size_t i, ntags = 0;
 	int rc;
@@ -307,13 +545,16 @@ int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
 	DBG(CACHE, mnt_debug_h(cache, "tags for %s requested", devname));
 
 	/* check if device is already cached */
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_TAGREAD))
-			continue;
-		if (strcmp(e->value, devname) == 0)
-			/* tags have already been read */
-			return 0;
+	e = cache_find_devname(cache, devname, NULL);
+	if (e) {
+		if (e->flag & MNT_CACHE_NOTAGS) {
+			/* already probed without result */
+			DBG(CACHE, mnt_debug_h(cache, "%s: cached probing result: %s",
+					devname, e->key + 1));
+			return strcmp(e->key + 1, "ambivalent") == 0 ? -2 : -1;
+		}
+		/* tags have already been read */
+		return 0;
 	}
 
 	pr =  blkid_new_probe_from_filename(devname);
@@ -360,6 +601,19 @@ int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
 	blkid_free_probe(pr);
 	return ntags ? 0 : 1;
 error:
+	/*
+	 * Remember nothing detected (1) and ambivalent (-2) results, so the
+	 * device is not probed again for the next tag or filesystem type
+	 * request. The empty tag name is never used by tag lookups.
+	 */
+	if (rc == 1 || rc == -2) {
+		char *dev = strdup(devname);
+
+		if (dev && cache_add_tag(cache, "",
+					 rc == -2 ? "ambivalent" : "none", dev,
+					 MNT_CACHE_TAGREAD | MNT_CACHE_NOTAGS))
+			free(dev);
+	}
 	blkid_free_probe(pr);
 	return rc < 0 ? rc : -1;
 }
@@ -495,7 +749,15 @@ char *mnt_resolve_path(const char *path, struct libmnt_cache *cache)
 		p = (char *) cache_find_path(cache, path);
 
 	if (!p) {
-		p = canonicalize_path(path);
+		if (cache) {
+			/* the path components are cached too, the paths with
+			 * the same prefix are resolved without lstat() for
+			 * each component */
+			if (!cache->cc)
+				cache->cc = new_canonicalize_cache();
+			p = canonicalize_path_cached(cache->cc, path);
+		} else
+			p = canonicalize_path(path);
 
 		if (p && cache) {
 			value = p;
@@ -606,7 +868,95 @@ error:
 	return NULL;
 }
 
+/**
+ * mnt_cache_resolve_table_tags:
+ * @cache: paths cache
+ * @tb: table (usually fstab)
+ * @match_func: function returning 1 for the entries to resolve, or NULL
+ * @userdata: extra data for @match_func
+ *
+ * Resolves all not yet cached tags (LABEL=, UUID=, ...) from @tb by one
+ * blkid_evaluate_tags() call and stores the results to @cache. It's faster
+ * than to resolve the tags one by one by mnt_resolve_spec() -- udev
+ * directories are read only once and block devices are scanned only once.
+ *
+ * The @match_func allows to skip the entries the caller is not interested
+ * in (e.g. noauto filesystems), all the entries are resolved if NULL.
+ *
+ * The later mnt_resolve_tag(), mnt_resolve_spec() and mnt_table_find_*()
+ * calls use the cached results.
+ *
+ * Returns: number of resolved tags or negative number in case of error.
+ */
+int mnt_cache_resolve_table_tags(struct libmnt_cache *cache,
+				 struct libmnt_table *tb,
+				 int (*match_func)(struct libmnt_fs *, void *),
+				 void *userdata)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	const char **specs = NULL;
+	char **res = NULL;
+	size_t i, n = 0;
+	int rc = 0, count = 0;
+
+	assert(cache);
+	assert(tb);
+
+	if (!cache || !tb)
+		return -EINVAL;
+	if (!mnt_table_get_nents(tb))
+		return 0;
+
+	specs = calloc(mnt_table_get_nents(tb), sizeof(char *));
+	if (!specs)
+		return -ENOMEM;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		const char *t, *v;
+
+		if (mnt_fs_get_tag(fs, &t, &v) != 0 || cache_find_tag(cache, t, v))
+			continue;
+		if (match_func && !match_func(fs, userdata))
+			continue;
+		specs[n++] = mnt_fs_get_source(fs);
+	}
+	if (!n)
+		goto done;
+
+	DBG(CACHE, mnt_debug_h(cache, "resolving %zu tags", n));
 
+	res = calloc(n, sizeof(char *));
+	if (!res) {
+		rc = -ENOMEM;
+		goto done;
+	}
+	rc = blkid_evaluate_tags(specs, n, res, &cache->bc);
+	if (rc < 0)
+		goto done;
+	rc = 0;
+
+	for (i = 0; i < n; i++) {
+		char *t = NULL, *v = NULL;
+
+		if (!res[i])
+			continue;
+		if (blkid_parse_tag_string(specs[i], &t, &v) == 0 &&
+		    !cache_find_tag(cache, t, v) &&
+		    cache_add_tag(cache, t, v, res[i], 0) == 0) {
+			res[i] = NULL;		/* now owned by cache */
+			count++;
+		}
+		free(t);
+		free(v);
+		free(res[i]);
+	}
+done:
+	free(specs);
+	free(res);
+	return rc ? rc : count;
+}
 
 /**
  * mnt_resolve_spec:
@@ -687,7 +1037,7 @@ int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 {
 	char line[BUFSIZ];
 	struct libmnt_cache *cache;
-	size_t i;
+	struct list_head *p;
 
 	cache = mnt_new_cache();
 	if (!cache)
@@ -722,8 +1072,8 @@ int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 		}
 	}
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
+	list_for_each_backwardly(p, &cache->lru) {
+		struct mnt_cache_entry *e = list_entry(p, struct mnt_cache_entry, lru);
 		if (!(e->flag & MNT_CACHE_ISTAG))
 			continue;
 
@@ -34,6 +34,37 @@
 #include "mountP.h"
 
 #include <sys/wait.h>
+#ifdef HAVE_SPAWN_H
+# include <spawn.h>
+
+extern char **environ;
+#endif
+
+static void free_children(struct libmnt_context *cxt);
+
+/* looked up /sbin/[u]mount.<type> helper, see mnt_context_prepare_helper() */
+struct libmnt_helper {
+	char			*name;	/* <name>.<type> */
+	char			*path;	/* NULL if not found */
+	struct list_head	helpers;
+};
+
+/* frees all or only the "not found" (@notfound) helpers */
+static void free_helpers(struct libmnt_context *cxt, int notfound)
+{
+	struct list_head *p, *pnext;
+
+	list_for_each_safe(p, pnext, &cxt->helpers) {
+		struct libmnt_helper *hl = list_entry(p,
+					struct libmnt_helper, helpers);
+		if (notfound && hl->path)
+			continue;
+		list_del(&hl->helpers);
+		free(hl->name);
+		free(hl->path);
+		free(hl);
+	}
+}
 
 /**
  * mnt_new_context:
@@ -50,6 +81,7 @@ struct libmnt_context *mnt_new_context(void)
 		return NULL;
 
 	INIT_LIST_HEAD(&cxt->addmounts);
+	INIT_LIST_HEAD(&cxt->helpers);
 
 	ruid = getuid();
 	euid = geteuid();
@@ -57,6 +89,7 @@ struct libmnt_context *mnt_new_context(void)
 	mnt_context_reset_status(cxt);
 
 	cxt->loopdev_fd = -1;
+	cxt->mtab_fd = -1;
 
 	/* if we're really root and aren't running setuid */
 	cxt->restricted = (uid_t) 0 == ruid && ruid == euid ? 0 : 1;
@@ -88,6 +121,8 @@ void mnt_free_context(struct libmnt_context *cxt)
 
 	free(cxt->fstype_pattern);
 	free(cxt->optstr_pattern);
+	mnt_free_pattern(cxt->fstype_pat);
+	mnt_free_pattern(cxt->optstr_pat);
 
 	mnt_unref_table(cxt->fstab);
 	mnt_unref_cache(cxt->cache);
@@ -96,7 +131,12 @@ void mnt_free_context(struct libmnt_context *cxt)
 	mnt_free_lock(cxt->lock);
 	mnt_free_update(cxt->update);
 
-	free(cxt->children);
+	free_children(cxt);
+	free_helpers(cxt, 0);
+
+	if (cxt->mtab_fd >= 0)
+		close(cxt->mtab_fd);
+	mnt_free_filesystems(cxt->filesystems);
 
 	DBG(CXT, mnt_debug_h(cxt, "<---- free"));
 	free(cxt);
@@ -109,8 +149,9 @@ void mnt_free_context(struct libmnt_context *cxt)
  * Resets all information in the context that is directly related to
  * the latest mount (spec, source, target, mount options, ...).
  *
- * The match patterns, cached fstab, cached canonicalized paths and tags and
- * [e]uid are not reset. You have to use
+ * The match patterns, cached fstab, cached canonicalized paths and tags,
+ * found /sbin/[u]mount.<type> helpers and [e]uid are not reset. You have
+ * to use
  *
  *	mnt_context_set_fstab(cxt, NULL);
  *	mnt_context_set_cache(cxt, NULL);
@@ -140,6 +181,9 @@ int mnt_reset_context(struct libmnt_context *cxt)
 	free(cxt->helper);
 	free(cxt->orig_user);
 
+	/* the helper could be installed before the next mount */
+	free_helpers(cxt, 1);
+
 	cxt->fs = NULL;
 	cxt->mtab = NULL;
 	cxt->helper = NULL;
@@ -854,6 +898,10 @@ int mnt_context_set_fstype_pattern(struct libmnt_context *cxt, const char *patte
 	}
 	free(cxt->fstype_pattern);
 	cxt->fstype_pattern = p;
+
+	/* compiled for mnt_context_next_{u,}mount(), NULL if too long */
+	mnt_free_pattern(cxt->fstype_pat);
+	cxt->fstype_pat = p ? mnt_compile_fstype_pattern(p) : NULL;
 	return 0;
 }
 
@@ -880,9 +928,46 @@ int mnt_context_set_options_pattern(struct libmnt_context *cxt, const char *patt
 	}
 	free(cxt->optstr_pattern);
 	cxt->optstr_pattern = p;
+
+	/* compiled for mnt_context_next_{u,}mount(), NULL if too long */
+	mnt_free_pattern(cxt->optstr_pat);
+	cxt->optstr_pat = p ? mnt_compile_options_pattern(p) : NULL;
 	return 0;
 }
 
+/*
+ * Returns 1 if @fs matches the fstype and options patterns (or if the
+ * patterns are not set).
+ */
+int mnt_context_match_patterns(struct libmnt_context *cxt, struct libmnt_fs *fs)
+{
+	const char *type, *optstr;
+
+	assert(cxt);
+	assert(fs);
+
+	if (cxt->fstype_pattern) {
+		type = mnt_fs_get_fstype(fs);
+
+		if (!cxt->fstype_pat || !type) {
+			if (!mnt_fs_match_fstype(fs, cxt->fstype_pattern))
+				return 0;
+		} else if (!mnt_pattern_match_fstype(cxt->fstype_pat, type))
+			return 0;
+	}
+
+	if (cxt->optstr_pattern) {
+		optstr = mnt_fs_get_options(fs);
+
+		if (!cxt->optstr_pat) {
+			if (!mnt_fs_match_options(fs, cxt->optstr_pattern))
+				return 0;
+		} else if (!mnt_pattern_match_options(cxt->optstr_pat, optstr))
+			return 0;
+	}
+	return 1;
+}
+
 /**
  * mnt_context_set_fstab:
  * @cxt: mount context
@@ -993,6 +1078,33 @@ int mnt_context_get_mtab(struct libmnt_context *cxt, struct libmnt_table **tb)
 	return 0;
 }
 
+/**
+ * mnt_context_set_mtab:
+ * @cxt: mount context
+ * @tb: mtab or NULL
+ *
+ * Sets already parsed mtab (or mountinfo with merged utab) to the context, so
+ * the context does not read the file again. It's useful when the application
+ * works with the same table for more (u)mount operations, for example
+ * umount(8) --recursive. The reference counter of @tb is incremented.
+ *
+ * The table is forgotten by mnt_reset_context(), and the context does not
+ * update the table after (u)mount.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_context_set_mtab(struct libmnt_context *cxt, struct libmnt_table *tb)
+{
+	assert(cxt);
+	if (!cxt)
+		return -EINVAL;
+
+	mnt_ref_table(tb);		/* new */
+	mnt_unref_table(cxt->mtab);	/* old */
+	cxt->mtab = tb;
+	return 0;
+}
+
 /*
  * Allows to specify a filter for tab file entries. The filter is called by
  * the table parser. Currently used for mtab and utab only.
@@ -1601,35 +1713,14 @@ none:
 	return mnt_fs_set_fstype(cxt->fs, "none");
 }
 
-/*
- * The default is to use fstype from cxt->fs, this could be overwritten by
- * @type. The @act is MNT_ACT_{MOUNT,UMOUNT}.
- *
- * Returns: 0 on success or negative number in case of error. Note that success
- * does not mean that there is any usable helper, you have to check cxt->helper.
- */
-int mnt_context_prepare_helper(struct libmnt_context *cxt, const char *name,
-				const char *type)
+/* searches for <name>.<type> in FS_SEARCH_PATH, returns allocated path */
+static int find_helper(struct libmnt_context *cxt, const char *name,
+		       const char *type, char **res)
 {
 	char search_path[] = FS_SEARCH_PATH;		/* from config.h */
 	char *p = NULL, *path;
 
-	assert(cxt);
-	assert(cxt->fs);
-	assert((cxt->flags & MNT_FL_MOUNTFLAGS_MERGED));
-
-	if (!type)
-		type = mnt_fs_get_fstype(cxt->fs);
-
-	if (type && strchr(type, ','))
-		return 0;			/* type is fstype pattern */
-
-	if (mnt_context_is_nohelpers(cxt)
-	    || !type
-	    || !strcmp(type, "none")
-	    || strstr(type, "/..")		/* don't try to smuggle path */
-	    || mnt_fs_is_swaparea(cxt->fs))
-		return 0;
+	*res = NULL;
 
 	path = strtok_r(search_path, ":", &p);
 	while (path) {
@@ -1658,13 +1749,165 @@ int mnt_context_prepare_helper(struct libmnt_context *cxt, const char *name,
 		if (rc)
 			continue;
 
-		free(cxt->helper);
-		cxt->helper = strdup(helper);
-		if (!cxt->helper)
+		*res = strdup(helper);
+		return *res ? 0 : -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * The default is to use fstype from cxt->fs, this could be overwritten by
+ * @type. The @act is MNT_ACT_{MOUNT,UMOUNT}.
+ *
+ * The found helper is remembered in the context for the next mounts, so
+ * "mount -a" does not stat() the same paths again. The "not found" result is
+ * remembered only until mnt_reset_context(), it's used when more filesystem
+ * types are tried for the same mount.
+ *
+ * Returns: 0 on success or negative number in case of error. Note that success
+ * does not mean that there is any usable helper, you have to check cxt->helper.
+ */
+int mnt_context_prepare_helper(struct libmnt_context *cxt, const char *name,
+				const char *type)
+{
+	struct libmnt_helper *hl = NULL;
+	struct list_head *p;
+	char key[PATH_MAX];
+	int rc;
+
+	assert(cxt);
+	assert(cxt->fs);
+	assert((cxt->flags & MNT_FL_MOUNTFLAGS_MERGED));
+
+	if (!type)
+		type = mnt_fs_get_fstype(cxt->fs);
+
+	if (type && strchr(type, ','))
+		return 0;			/* type is fstype pattern */
+
+	if (mnt_context_is_nohelpers(cxt)
+	    || !type
+	    || !strcmp(type, "none")
+	    || strstr(type, "/..")		/* don't try to smuggle path */
+	    || mnt_fs_is_swaparea(cxt->fs))
+		return 0;
+
+	rc = snprintf(key, sizeof(key), "%s.%s", name, type);
+	if (rc < 0 || (size_t) rc >= sizeof(key))
+		return 0;
+
+	list_for_each(p, &cxt->helpers) {
+		struct libmnt_helper *x = list_entry(p, struct libmnt_helper, helpers);
+
+		if (strcmp(x->name, key) == 0) {
+			hl = x;
+			DBG(CXT, mnt_debug_h(cxt, "%-25s ... %s [cached]", key,
+					hl->path ? hl->path : "not found"));
+			break;
+		}
+	}
+
+	if (!hl) {
+		hl = calloc(1, sizeof(*hl));
+		if (!hl)
 			return -ENOMEM;
+		hl->name = strdup(key);
+		rc = hl->name ? find_helper(cxt, name, type, &hl->path) : -ENOMEM;
+		if (rc) {
+			free(hl->name);
+			free(hl);
+			return rc;
+		}
+		list_add_tail(&hl->helpers, &cxt->helpers);
+	}
+
+	if (!hl->path)
 		return 0;
+
+	free(cxt->helper);
+	cxt->helper = strdup(hl->path);
+	if (!cxt->helper)
+		return -ENOMEM;
+	return 0;
+}
+
+/*
+ * Executes cxt->helper with @args (NULL terminated, args[0] is the helper)
+ * and waits for the helper. The helper runs with the real UID and GID.
+ *
+ * Returns: 0 if the helper has been executed (see cxt->helper_status) or
+ * negative number in case of error (also in cxt->helper_exec_status).
+ */
+int mnt_context_exec_helper(struct libmnt_context *cxt, const char **args)
+{
+	pid_t pid;
+	int rc, st;
+
+	assert(cxt);
+	assert(cxt->helper);
+	assert(args);
+
+#ifdef CONFIG_LIBMOUNT_DEBUG
+	{
+		int i;
+
+		for (i = 0; args[i]; i++)
+			DBG(CXT, mnt_debug_h(cxt, "argv[%d] = \"%s\"",
+							i, args[i]));
+	}
+#endif
+	DBG_FLUSH;
+
+#ifdef HAVE_SPAWN_H
+	{
+		/* posix_spawn() does not copy the address space of the
+		 * (maybe huge) caller like fork() */
+		posix_spawnattr_t attr;
+
+		rc = posix_spawnattr_init(&attr);
+		if (!rc)
+			rc = posix_spawnattr_setflags(&attr, POSIX_SPAWN_RESETIDS);
+		if (!rc)
+			rc = posix_spawn(&pid, cxt->helper, NULL, &attr,
+					 (char * const *) args, environ);
+		posix_spawnattr_destroy(&attr);
+		if (rc) {
+			cxt->helper_exec_status = -rc;
+			DBG(CXT, mnt_debug_h(cxt, "posix_spawn() failed [rc=%d]", rc));
+			return -rc;
+		}
+	}
+#else
+	switch ((pid = fork())) {
+	case 0:
+		if (setgid(getgid()) < 0)
+			_exit(EXIT_FAILURE);
+
+		if (setuid(getuid()) < 0)
+			_exit(EXIT_FAILURE);
+
+		execv(cxt->helper, (char * const *) args);
+		_exit(EXIT_FAILURE);
+	case -1:
+		rc = cxt->helper_exec_status = -errno;
+		DBG(CXT, mnt_debug_h(cxt, "fork() failed"));
+		return rc;
+	}
+#endif
+
+	while (waitpid(pid, &st, 0) < 0) {
+		if (errno != EINTR) {
+			rc = cxt->helper_exec_status = -errno;
+			DBG(CXT, mnt_debug_h(cxt, "waitpid() failed"));
+			return rc;
+		}
 	}
+	cxt->helper_status = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
 
+	DBG(CXT, mnt_debug_h(cxt, "%s executed [status=%d]",
+				cxt->helper, cxt->helper_status));
+	cxt->helper_exec_status = 0;
 	return 0;
 }
 
@@ -1677,16 +1920,47 @@ int mnt_context_merge_mflags(struct libmnt_context *cxt)
 
 	DBG(CXT, mnt_debug_h(cxt, "merging mount flags"));
 
-	rc = mnt_context_get_mflags(cxt, &fl);
-	if (rc)
-		return rc;
-	cxt->mountflags = fl;
+	if (!(cxt->flags & MNT_FL_MOUNTFLAGS_MERGED) &&
+	    cxt->fs && mnt_fs_get_options(cxt->fs)) {
+		unsigned long ufl = 0;
+		struct list_head *p;
+		struct libmnt_optlist *ol = mnt_new_optlist();
 
-	fl = 0;
-	rc = mnt_context_get_user_mflags(cxt, &fl);
-	if (rc)
-		return rc;
-	cxt->user_mountflags = fl;
+		/* the options string contains also userspace options, it's
+		 * enough to parse it only once for the both maps
+		 */
+		if (!ol)
+			return -ENOMEM;
+		rc = mnt_optlist_append_optstr(ol, mnt_fs_get_options(cxt->fs));
+		if (!rc)
+			rc = mnt_optlist_get_flags(ol, &fl,
+				    mnt_get_builtin_optmap(MNT_LINUX_MAP));
+		if (!rc)
+			rc = mnt_optlist_get_flags(ol, &ufl,
+				    mnt_get_builtin_optmap(MNT_USERSPACE_MAP));
+		mnt_free_optlist(ol);
+		if (rc)
+			return rc;
+
+		list_for_each(p, &cxt->addmounts) {
+			struct libmnt_addmount *ad =
+				list_entry(p, struct libmnt_addmount, mounts);
+			fl |= ad->mountflags;
+		}
+		cxt->mountflags |= fl;
+		cxt->user_mountflags |= ufl;
+	} else {
+		rc = mnt_context_get_mflags(cxt, &fl);
+		if (rc)
+			return rc;
+		cxt->mountflags = fl;
+
+		fl = 0;
+		rc = mnt_context_get_user_mflags(cxt, &fl);
+		if (rc)
+			return rc;
+		cxt->user_mountflags = fl;
+	}
 
 	DBG(CXT, mnt_debug_h(cxt, "final flags: VFS=%08lx user=%08lx",
 			cxt->mountflags, cxt->user_mountflags));
@@ -2210,26 +2484,188 @@ int mnt_context_is_fs_mounted(struct libmnt_context *cxt,
 	return 0;
 }
 
-static int mnt_context_add_child(struct libmnt_context *cxt, pid_t pid)
+/**
+ * mnt_context_set_fork_limit:
+ * @cxt: mount context
+ * @max: maximal number of running children or 0 (default) for unlimited
+ *
+ * Sets the maximal number of the children running at the same time for
+ * mnt_context_next_mount() when fork is enabled (see mount(8) man page,
+ * option -F).
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_context_set_fork_limit(struct libmnt_context *cxt, int max)
+{
+	if (!cxt || max < 0)
+		return -EINVAL;
+	cxt->maxchildren = max;
+	return 0;
+}
+
+/**
+ * mnt_context_set_child_cb:
+ * @cxt: mount context
+ * @cb: function called when a child finished or NULL
+ *
+ * The callback is called with the filesystem mounted by the child and with
+ * the child's waitpid(2) status. The children are waited in
+ * mnt_context_next_mount() and in mnt_context_wait_for_children(), so the
+ * order of the callbacks does not have to follow the order of the
+ * filesystems in fstab.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_context_set_child_cb(struct libmnt_context *cxt,
+		void (*cb)(struct libmnt_context *, struct libmnt_fs *, int))
+{
+	if (!cxt)
+		return -EINVAL;
+	cxt->child_cb = cb;
+	return 0;
+}
+
+static int mnt_context_add_child(struct libmnt_context *cxt, pid_t pid,
+				 struct libmnt_fs *fs)
 {
-	pid_t *pids;
+	struct libmnt_child *ch;
 
 	assert(cxt);
 	if (!cxt)
 		return -EINVAL;
 
-	pids = realloc(cxt->children, sizeof(pid_t) * cxt->nchildren + 1);
-	if (!pids)
+	ch = realloc(cxt->children, sizeof(*ch) * (cxt->nchildren + 1));
+	if (!ch)
 		return -ENOMEM;
 
 	DBG(CXT, mnt_debug_h(cxt, "add new child %d", pid));
-	cxt->children = pids;
-	cxt->children[cxt->nchildren++] = pid;
+	cxt->children = ch;
+
+	ch = &cxt->children[cxt->nchildren++];
+	memset(ch, 0, sizeof(*ch));
+	ch->pid = pid;
+	ch->fs = fs;
+	mnt_ref_fs(fs);
 
+	cxt->nrunning++;
 	return 0;
 }
 
-int mnt_fork_context(struct libmnt_context *cxt)
+/*
+ * Returns 1 if the child has been waited, 0 if it is still running (only
+ * with @nohang).
+ */
+static int wait_for_child(struct libmnt_context *cxt,
+			  struct libmnt_child *ch, int nohang)
+{
+	int rc, status = 0;
+
+	if (ch->done)
+		return 1;
+	do {
+		errno = 0;
+		rc = waitpid(ch->pid, &status, nohang ? WNOHANG : 0);
+
+	} while (rc == -1 && errno == EINTR);
+
+	if (rc == 0)
+		return 0;		/* still running */
+
+	DBG(CXT, mnt_debug_h(cxt, "child %d finished [status=%d]",
+				ch->pid, rc == -1 ? -1 : status));
+
+	/* waitpid() error means that the child does not exist anymore, the
+	 * status is unknown */
+	ch->status = rc == -1 ? -1 : status;
+	ch->done = 1;
+	cxt->nrunning--;
+
+	if (cxt->child_cb)
+		cxt->child_cb(cxt, ch->fs, ch->status);
+	return 1;
+}
+
+/* returns 1 if @path is equal to @dir or in the @dir */
+static int is_path_under(const char *path, const char *dir)
+{
+	size_t sz;
+
+	if (!path || !dir)
+		return 0;
+
+	sz = strlen(dir);
+	while (sz && dir[sz - 1] == '/')
+		sz--;
+	if (strncmp(path, dir, sz) != 0)
+		return 0;
+	return path[sz] == '\0' || path[sz] == '/';
+}
+
+/*
+ * Returns 1 if @fs has to be mounted after @x, it means that @x is mounted
+ * on the path of the @fs target or source, or both use the same source
+ * device.
+ */
+static int is_fs_dependent(struct libmnt_fs *fs, struct libmnt_fs *x)
+{
+	const char *tgt = mnt_fs_get_target(fs),
+		   *src = mnt_fs_get_srcpath(fs),
+		   *xtgt = mnt_fs_get_target(x),
+		   *xsrc = mnt_fs_get_srcpath(x);
+
+	if (is_path_under(tgt, xtgt) || is_path_under(xtgt, tgt))
+		return 1;
+
+	/* ignore pseudo filesystems sources like "tmpfs" or "none" */
+	if (!src || *src != '/')
+		return 0;
+	if (is_path_under(src, xtgt))
+		return 1;
+	if (xsrc && strcmp(src, xsrc) == 0)
+		return 1;
+	return 0;
+}
+
+/*
+ * Waits for the children which mount filesystems required by @fs and for a
+ * free slot if the number of the running children is limited.
+ */
+int mnt_context_wait_for_deps(struct libmnt_context *cxt, struct libmnt_fs *fs)
+{
+	int i;
+
+	for (i = 0; i < cxt->nchildren && cxt->nrunning; i++) {
+		struct libmnt_child *ch = &cxt->children[i];
+
+		if (!ch->done && is_fs_dependent(fs, ch->fs)) {
+			DBG(CXT, mnt_debug_h(cxt, "%s depends on %s (child %d)",
+					mnt_fs_get_target(fs),
+					mnt_fs_get_target(ch->fs), ch->pid));
+			wait_for_child(cxt, ch, 0);
+		}
+	}
+
+	while (cxt->maxchildren && cxt->nrunning >= cxt->maxchildren) {
+		struct libmnt_child *first = NULL;
+		int n = 0;
+
+		for (i = 0; i < cxt->nchildren; i++) {
+			struct libmnt_child *ch = &cxt->children[i];
+
+			if (ch->done)
+				continue;
+			if (!first)
+				first = ch;
+			n += wait_for_child(cxt, ch, 1);
+		}
+		if (!n && first)
+			/* nothing finished, wait for the oldest child */
+			wait_for_child(cxt, first, 0);
+	}
+	return 0;
+}
+
+int mnt_fork_context(struct libmnt_context *cxt, struct libmnt_fs *fs)
 {
 	int rc = 0;
 	pid_t pid;
@@ -2256,13 +2692,36 @@ int mnt_fork_context(struct libmnt_context *cxt)
 		break;
 
 	default:
-		rc = mnt_context_add_child(cxt, pid);
+		rc = mnt_context_add_child(cxt, pid, fs);
 		break;
 	}
 
 	return rc;
 }
 
+static void free_children(struct libmnt_context *cxt)
+{
+	int i;
+
+	for (i = 0; i < cxt->nchildren; i++)
+		mnt_unref_fs(cxt->children[i].fs);
+
+	free(cxt->children);
+	cxt->children = NULL;
+	cxt->nchildren = 0;
+	cxt->nrunning = 0;
+}
+
+/**
+ * mnt_context_wait_for_children:
+ * @cxt: mount context
+ * @nchildren: returns number of children
+ * @nerrs: returns number of children which failed
+ *
+ * Waits for all the children forked by mnt_context_next_mount().
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
 int mnt_context_wait_for_children(struct libmnt_context *cxt,
 				  int *nchildren, int *nerrs)
 {
@@ -2275,35 +2734,24 @@ int mnt_context_wait_for_children(struct libmnt_context *cxt,
 	assert(mnt_context_is_parent(cxt));
 
 	for (i = 0; i < cxt->nchildren; i++) {
-		pid_t pid = cxt->children[i];
-		int rc = 0, ret = 0;
-
-		if (!pid)
-			continue;
-		do {
-			DBG(CXT, mnt_debug_h(cxt,
-					"waiting for child (%d/%d): %d",
-					i + 1, cxt->nchildren, pid));
-			errno = 0;
-			rc = waitpid(pid, &ret, 0);
+		struct libmnt_child *ch = &cxt->children[i];
 
-		} while (rc == -1 && errno == EINTR);
+		DBG(CXT, mnt_debug_h(cxt, "waiting for child (%d/%d): %d",
+					i + 1, cxt->nchildren, ch->pid));
+		wait_for_child(cxt, ch, 0);
 
 		if (nchildren)
 			(*nchildren)++;
 
-		if (rc != -1 && nerrs) {
-			if (WIFEXITED(ret))
-				(*nerrs) += WEXITSTATUS(ret) == 0 ? 0 : 1;
+		if (ch->status != -1 && nerrs) {
+			if (WIFEXITED(ch->status))
+				(*nerrs) += WEXITSTATUS(ch->status) == 0 ? 0 : 1;
 			else
 				(*nerrs)++;
 		}
-		cxt->children[i] = 0;
 	}
 
-	cxt->nchildren = 0;
-	free(cxt->children);
-	cxt->children = NULL;
+	free_children(cxt);
 	return 0;
 }
 
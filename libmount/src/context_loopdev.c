@@ -140,7 +140,7 @@ int mnt_context_setup_loopdev(struct libmnt_context *cxt)
 	char *val = NULL;
 	size_t len;
 	struct loopdev_cxt lc;
-	int rc = 0, lo_flags = 0;
+	int rc = 0, lo_flags = 0, ntries = 0;
 	uint64_t offset = 0, sizelimit = 0;
 
 	assert(cxt->fs);
@@ -263,7 +263,8 @@ int mnt_context_setup_loopdev(struct libmnt_context *cxt)
 		if (!rc)
 			break;		/* success */
 
-		if (loopdev || rc != -EBUSY) {
+		if (loopdev || rc != -EBUSY ||
+		    ++ntries >= LOOPDEV_SETUP_MAXTRIES) {
 			DBG(CXT, mnt_debug_h(cxt, "failed to setup device"));
 			rc = -MNT_ERR_LOOPDEV;
 			goto done;
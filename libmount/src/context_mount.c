@@ -18,10 +18,12 @@
 
 #include <sys/wait.h>
 #include <sys/mount.h>
+#include <poll.h>
 
 #include "linux_version.h"
 #include "mountP.h"
 #include "strutils.h"
+#include "pathnames.h"
 
 /*
  * Kernel supports only one MS_PROPAGATION flag change by one mount(2) syscall,
@@ -136,6 +138,7 @@ static int fix_optstr(struct libmnt_context *cxt)
 	char *name, *val;
 	size_t namesz, valsz;
 	struct libmnt_fs *fs;
+	struct libmnt_optlist *ol = NULL;
 #ifdef HAVE_LIBSELINUX
 	int se_fix = 0, se_rem = 0;
 	static const struct libmnt_optname selinux_options[] = {
@@ -177,10 +180,20 @@ static int fix_optstr(struct libmnt_context *cxt)
 	 * save the original user=<name> to call the helpers with an unchanged
 	 * "user" setting.
 	 */
+	ol = mnt_new_optlist();
+	if (!ol) {
+		rc = -ENOMEM;
+		goto done;
+	}
+	rc = mnt_optlist_append_optstr(ol, fs->user_optstr);
+	if (rc)
+		goto done;
+
 	if (cxt->user_mountflags & MNT_MS_USER) {
-		if (!mnt_optstr_get_option(fs->user_optstr,
-					"user", &val, &valsz) && val) {
-			cxt->orig_user = strndup(val, valsz);
+		const char *user = mnt_opt_get_value(
+					mnt_optlist_get_option(ol, "user"));
+		if (user) {
+			cxt->orig_user = strdup(user);
 			if (!cxt->orig_user) {
 				rc = -ENOMEM;
 				goto done;
@@ -190,28 +203,34 @@ static int fix_optstr(struct libmnt_context *cxt)
 	}
 
 	/*
-	 * Sync mount options with mount flags
+	 * Sync mount options with mount flags, the empty options strings
+	 * are converted to NULL
 	 */
-	DBG(CXT, mnt_debug_h(cxt, "mount: fixing vfs optstr"));
-	rc = mnt_optstr_apply_flags(&fs->vfs_optstr, cxt->mountflags,
-				mnt_get_builtin_optmap(MNT_LINUX_MAP));
-	if (rc)
-		goto done;
-
 	DBG(CXT, mnt_debug_h(cxt, "mount: fixing user optstr"));
-	rc = mnt_optstr_apply_flags(&fs->user_optstr, cxt->user_mountflags,
+	rc = mnt_optlist_apply_flags(ol, cxt->user_mountflags,
 				mnt_get_builtin_optmap(MNT_USERSPACE_MAP));
+	if (!rc) {
+		free(fs->user_optstr);
+		rc = mnt_optlist_to_optstr(ol, &fs->user_optstr);
+	}
 	if (rc)
 		goto done;
 
-	if (fs->vfs_optstr && *fs->vfs_optstr == '\0') {
+	DBG(CXT, mnt_debug_h(cxt, "mount: fixing vfs optstr"));
+	mnt_reset_optlist(ol);
+	rc = mnt_optlist_append_optstr(ol, fs->vfs_optstr);
+	if (!rc)
+		rc = mnt_optlist_apply_flags(ol, cxt->mountflags,
+				mnt_get_builtin_optmap(MNT_LINUX_MAP));
+	if (!rc) {
 		free(fs->vfs_optstr);
-		fs->vfs_optstr = NULL;
-	}
-	if (fs->user_optstr && *fs->user_optstr == '\0') {
-		free(fs->user_optstr);
-		fs->user_optstr = NULL;
+		rc = mnt_optlist_to_optstr(ol, &fs->vfs_optstr);
 	}
+	mnt_free_optlist(ol);
+	ol = NULL;
+	if (rc)
+		goto done;
+
 	if (cxt->mountflags & MS_PROPAGATION) {
 		rc = init_propagation(cxt);
 		if (rc)
@@ -294,6 +313,7 @@ static int fix_optstr(struct libmnt_context *cxt)
 	fs->optstr = NULL;
 	fs->optstr = mnt_fs_strdup_options(fs);
 done:
+	mnt_free_optlist(ol);
 	cxt->flags |= MNT_FL_MOUNTOPTS_FIXED;
 
 	DBG(CXT, mnt_debug_h(cxt, "fixed options [rc=%d]: "
@@ -534,8 +554,9 @@ int mnt_context_mount_setopt(struct libmnt_context *cxt, int c, char *arg)
 
 static int exec_helper(struct libmnt_context *cxt)
 {
+	const char *args[12], *type;
 	char *o = NULL;
-	int rc;
+	int rc, i = 0;
 
 	assert(cxt);
 	assert(cxt->fs);
@@ -548,69 +569,31 @@ static int exec_helper(struct libmnt_context *cxt)
 	if (rc)
 		return -EINVAL;
 
-	DBG_FLUSH;
-
-	switch (fork()) {
-	case 0:
-	{
-		const char *args[12], *type;
-		int i = 0;
-
-		if (setgid(getgid()) < 0)
-			exit(EXIT_FAILURE);
-
-		if (setuid(getuid()) < 0)
-			exit(EXIT_FAILURE);
-
-		type = mnt_fs_get_fstype(cxt->fs);
-
-		args[i++] = cxt->helper;		/* 1 */
-		args[i++] = mnt_fs_get_srcpath(cxt->fs);/* 2 */
-		args[i++] = mnt_fs_get_target(cxt->fs);	/* 3 */
-
-		if (mnt_context_is_sloppy(cxt))
-			args[i++] = "-s";		/* 4 */
-		if (mnt_context_is_fake(cxt))
-			args[i++] = "-f";		/* 5 */
-		if (mnt_context_is_nomtab(cxt))
-			args[i++] = "-n";		/* 6 */
-		if (mnt_context_is_verbose(cxt))
-			args[i++] = "-v";		/* 7 */
-		if (o) {
-			args[i++] = "-o";		/* 8 */
-			args[i++] = o;			/* 9 */
-		}
-		if (type && !endswith(cxt->helper, type)) {
-			args[i++] = "-t";		/* 10 */
-			args[i++] = type;		/* 11 */
-		}
-		args[i] = NULL;				/* 12 */
-#ifdef CONFIG_LIBMOUNT_DEBUG
-		for (i = 0; args[i]; i++)
-			DBG(CXT, mnt_debug_h(cxt, "argv[%d] = \"%s\"",
-							i, args[i]));
-#endif
-		DBG_FLUSH;
-		execv(cxt->helper, (char * const *) args);
-		exit(EXIT_FAILURE);
+	type = mnt_fs_get_fstype(cxt->fs);
+
+	args[i++] = cxt->helper;		/* 1 */
+	args[i++] = mnt_fs_get_srcpath(cxt->fs);/* 2 */
+	args[i++] = mnt_fs_get_target(cxt->fs);	/* 3 */
+
+	if (mnt_context_is_sloppy(cxt))
+		args[i++] = "-s";		/* 4 */
+	if (mnt_context_is_fake(cxt))
+		args[i++] = "-f";		/* 5 */
+	if (mnt_context_is_nomtab(cxt))
+		args[i++] = "-n";		/* 6 */
+	if (mnt_context_is_verbose(cxt))
+		args[i++] = "-v";		/* 7 */
+	if (o) {
+		args[i++] = "-o";		/* 8 */
+		args[i++] = o;			/* 9 */
 	}
-	default:
-	{
-		int st;
-		wait(&st);
-		cxt->helper_status = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
-
-		DBG(CXT, mnt_debug_h(cxt, "%s executed [status=%d]",
-					cxt->helper, cxt->helper_status));
-		cxt->helper_exec_status = rc = 0;
-		break;
+	if (type && !endswith(cxt->helper, type)) {
+		args[i++] = "-t";		/* 10 */
+		args[i++] = type;		/* 11 */
 	}
+	args[i] = NULL;				/* 12 */
 
-	case -1:
-		cxt->helper_exec_status = rc = -errno;
-		DBG(CXT, mnt_debug_h(cxt, "fork() failed"));
-		break;
-	}
+	rc = mnt_context_exec_helper(cxt, args);
 
 	free(o);
 	return rc;
@@ -800,14 +783,22 @@ static int do_mount_by_pattern(struct libmnt_context *cxt, const char *pattern)
 	 */
 	DBG(CXT, mnt_debug_h(cxt, "trying to mount by filesystems lists"));
 
-	rc = mnt_get_filesystems(&filesystems, neg ? pattern : NULL);
-	if (rc)
+	/* the lists are cached and re-read only if modified */
+	mnt_free_filesystems(cxt->filesystems);
+	rc = mnt_get_filesystems(&cxt->filesystems, NULL);
+	if (rc) {
+		cxt->filesystems = NULL;	/* already deallocated */
 		return rc;
+	}
+	filesystems = cxt->filesystems;
 
 	if (filesystems == NULL)
 		return -MNT_ERR_NOFSTYPE;
 
+	rc = -MNT_ERR_NOFSTYPE;
 	for (fp = filesystems; *fp; fp++) {
+		if (neg && !mnt_match_fstype(*fp, pattern))
+			continue;
 		rc = do_mount(cxt, *fp);
 		if (mnt_context_get_status(cxt))
 			break;
@@ -815,7 +806,6 @@ static int do_mount_by_pattern(struct libmnt_context *cxt, const char *pattern)
 		    mnt_context_get_syscall_errno(cxt) != ENODEV)
 			break;
 	}
-	mnt_free_filesystems(filesystems);
 	return rc;
 }
 
@@ -1024,6 +1014,172 @@ int mnt_context_mount(struct libmnt_context *cxt)
 	return rc;
 }
 
+/*
+ * mount -a batch mode
+ *
+ * The mtab is parsed only once for all mnt_context_next_mount() calls and it
+ * is patched in memory after each successful mount. The kernel mountinfo
+ * poll event is used to detect changes done by someone else; the table is
+ * re-read from the kernel in this case.
+ */
+static int mountinfo_count_entries(int fd)
+{
+	char buf[BUFSIZ];
+	ssize_t sz;
+	int n = 0;
+
+	if (lseek(fd, 0, SEEK_SET) != 0)
+		return -errno;
+
+	while ((sz = read(fd, buf, sizeof(buf))) != 0) {
+		char *p = buf;
+
+		if (sz < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		while ((p = memchr(p, '\n', buf + sz - p))) {
+			n++;
+			p++;
+		}
+	}
+	return n;
+}
+
+static int mtab_is_outdated(struct libmnt_context *cxt)
+{
+	struct pollfd fds[1];
+	int rc;
+
+	if (cxt->mtab_fd < 0)
+		return 0;
+
+	fds[0].fd = cxt->mtab_fd;
+	fds[0].events = POLLPRI;
+	fds[0].revents = 0;
+
+	/* poll() also resets the event */
+	rc = poll(fds, 1, 0);
+	if (rc <= 0 || !(fds[0].revents & (POLLPRI | POLLERR)))
+		return 0;
+
+	if (cxt->mtab_nowned) {
+		/*
+		 * The event may be triggered by our own changes (mtab already
+		 * patched) as well as by someone else at the same time. Compare
+		 * the kernel with the snapshot taken before our update.
+		 */
+		int nents = mountinfo_count_entries(cxt->mtab_fd);
+		int expected = cxt->mtab_nents + cxt->mtab_nowned;
+
+		cxt->mtab_nowned = 0;
+		if (nents == expected)
+			return 0;
+		DBG(CXT, mnt_debug_h(cxt, "batch: mountinfo %d entries, "
+					"expected %d", nents, expected));
+	}
+	return 1;
+}
+
+static int mtab_add_mounted(struct libmnt_context *cxt)
+{
+	struct libmnt_table *tb = cxt->mtab;
+	struct libmnt_fs *fs, *x, *first = NULL;
+	struct libmnt_iter itr;
+	char *root = NULL, *dir;
+	int rc, nents;
+
+	if (!tb || !cxt->fs)
+		return 0;
+
+	/*
+	 * Let's be paranoid, re-read the table for all the non-trivial mounts
+	 * where we are not able to guess the result.
+	 */
+	if ((cxt->mountflags & (MS_BIND | MS_MOVE | MS_REMOUNT | MS_PROPAGATION))
+	    || mnt_context_helper_executed(cxt)
+	    || !list_empty(&cxt->addmounts)
+	    || mnt_fs_is_swaparea(cxt->fs)) {
+		DBG(CXT, mnt_debug_h(cxt, "batch: drop mtab"));
+		mnt_unref_table(cxt->mtab);
+		cxt->mtab = NULL;
+		return 0;
+	}
+
+	fs = mnt_copy_fs(NULL, cxt->fs);
+	if (!fs)
+		return -ENOMEM;
+
+	mnt_table_first_fs(tb, &first);
+	if (first && mnt_fs_is_kernel(first) && mnt_fs_get_root(first)) {
+		/* mountinfo -- root, IDs and kernel flag are expected */
+		mnt_table_get_fs_root(tb, cxt->fs, cxt->mountflags, &root);
+		rc = mnt_fs_set_root(fs, root ? root : "/");
+		free(root);
+		if (rc)
+			goto done;
+
+		fs->flags |= MNT_FS_KERNEL;
+		fs->id = 0;
+		fs->parent = 0;
+
+		mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+		while (mnt_table_next_fs(tb, &itr, &x) == 0) {
+			if (x->id > fs->id)
+				fs->id = x->id;
+		}
+		fs->id++;
+
+		dir = strdup(mnt_fs_get_target(fs));
+		if (dir && stripoff_last_component(dir)) {
+			x = mnt_table_find_mountpoint(tb, *dir ? dir : "/",
+						      MNT_ITER_BACKWARD);
+			if (x)
+				fs->parent = x->id;
+		}
+		free(dir);
+	}
+
+	nents = mnt_table_get_nents(tb);
+	rc = mnt_table_add_fs(tb, fs);
+	if (!rc) {
+		if (!cxt->mtab_nowned)
+			cxt->mtab_nents = nents;	/* snapshot */
+		cxt->mtab_nowned++;
+		DBG(CXT, mnt_debug_h(cxt, "batch: mtab patched [%s]",
+					mnt_fs_get_target(fs)));
+	}
+done:
+	mnt_unref_fs(fs);
+	return rc;
+}
+
+/*
+ * Returns 0 for the fstab entries ignored by mnt_context_next_mount().
+ */
+static int is_next_mount_candidate(struct libmnt_fs *fs, void *data)
+{
+	struct libmnt_context *cxt = (struct libmnt_context *) data;
+	const char *o = mnt_fs_get_user_options(fs),
+		   *tgt = mnt_fs_get_target(fs);
+
+	/*  ignore swap */
+	if (mnt_fs_is_swaparea(fs) ||
+
+	/* ignore root filesystem */
+	   (tgt && (strcmp(tgt, "/") == 0 || strcmp(tgt, "root") == 0)) ||
+
+	/* ignore noauto filesystems */
+	   (o && mnt_optstr_get_option(o, "noauto", NULL, NULL) == 0) ||
+
+	/* ignore filesystems which don't match type and options patterns */
+	   !mnt_context_match_patterns(cxt, fs))
+		return 0;
+
+	return 1;
+}
+
 /**
  * mnt_context_next_mount:
  * @cxt: context
@@ -1060,7 +1216,6 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 			   int *ignored)
 {
 	struct libmnt_table *fstab, *mtab;
-	const char *o, *tgt;
 	int rc, mounted = 0;
 
 	if (ignored)
@@ -1080,31 +1235,19 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 	if (rc)
 		return rc;
 
+	/* the first call -- resolve all fstab tags at once */
+	if (!itr->head && cxt->cache)
+		mnt_cache_resolve_table_tags(cxt->cache, fstab,
+					     is_next_mount_candidate, cxt);
+
 	rc = mnt_table_next_fs(fstab, itr, fs);
 	if (rc != 0)
 		return rc;	/* more filesystems (or error) */
 
-	o = mnt_fs_get_user_options(*fs);
-	tgt = mnt_fs_get_target(*fs);
-
-	DBG(CXT, mnt_debug_h(cxt, "next-mount: trying %s", tgt));
-
-	/*  ignore swap */
-	if (mnt_fs_is_swaparea(*fs) ||
-
-	/* ignore root filesystem */
-	   (tgt && (strcmp(tgt, "/") == 0 || strcmp(tgt, "root") == 0)) ||
-
-	/* ignore noauto filesystems */
-	   (o && mnt_optstr_get_option(o, "noauto", NULL, NULL) == 0) ||
+	DBG(CXT, mnt_debug_h(cxt, "next-mount: trying %s",
+				mnt_fs_get_target(*fs)));
 
-	/* ignore filesystems which don't match options patterns */
-	   (cxt->fstype_pattern && !mnt_fs_match_fstype(*fs,
-					cxt->fstype_pattern)) ||
-
-	/* ignore filesystems which don't match type patterns */
-	   (cxt->optstr_pattern && !mnt_fs_match_options(*fs,
-					cxt->optstr_pattern))) {
+	if (!is_next_mount_candidate(*fs, cxt)) {
 		if (ignored)
 			*ignored = 1;
 		DBG(CXT, mnt_debug_h(cxt, "next-mount: not-match "
@@ -1116,6 +1259,27 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 		return 0;
 	}
 
+	/* wait for the children which mount filesystems required by @fs */
+	if (mnt_context_is_fork(cxt)) {
+		rc = mnt_context_wait_for_deps(cxt, *fs);
+		if (rc)
+			return rc;
+	}
+
+	if (cxt->mtab_fd < 0) {
+		/* open before the mtab parsing to not miss any change */
+		cxt->mtab_fd = open(_PATH_PROC_MOUNTINFO, O_RDONLY | O_CLOEXEC);
+		if (cxt->mtab_fd >= 0 && cxt->mtab) {
+			/* parsed before the fd has been opened, re-read */
+			mnt_unref_table(cxt->mtab);
+			cxt->mtab = NULL;
+		}
+	} else if (mtab_is_outdated(cxt) && cxt->mtab) {
+		DBG(CXT, mnt_debug_h(cxt, "batch: mountinfo changed, re-read mtab"));
+		mnt_unref_table(cxt->mtab);
+		cxt->mtab = NULL;
+	}
+
 	/* ignore already mounted filesystems */
 	rc = mnt_context_is_fs_mounted(cxt, *fs, &mounted);
 	if (rc)
@@ -1127,7 +1291,7 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 	}
 
 	if (mnt_context_is_fork(cxt)) {
-		rc = mnt_fork_context(cxt);
+		rc = mnt_fork_context(cxt, *fs);
 		if (rc)
 			return rc;		/* fork error */
 
@@ -1143,6 +1307,8 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 		rc = mnt_context_mount(cxt);
 		if (mntrc)
 			*mntrc = rc;
+		if (!mnt_context_is_child(cxt) && mnt_context_get_status(cxt) == 1)
+			mtab_add_mounted(cxt);
 	}
 
 	if (mnt_context_is_child(cxt)) {
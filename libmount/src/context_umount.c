@@ -441,7 +441,8 @@ eperm:
 
 static int exec_helper(struct libmnt_context *cxt)
 {
-	int rc;
+	const char *args[10], *type;
+	int i = 0;
 
 	assert(cxt);
 	assert(cxt->fs);
@@ -449,69 +450,28 @@ static int exec_helper(struct libmnt_context *cxt)
 	assert((cxt->flags & MNT_FL_MOUNTFLAGS_MERGED));
 	assert(cxt->helper_exec_status == 1);
 
-	DBG_FLUSH;
-
-	switch (fork()) {
-	case 0:
-	{
-		const char *args[10], *type;
-		int i = 0;
-
-		if (setgid(getgid()) < 0)
-			exit(EXIT_FAILURE);
-
-		if (setuid(getuid()) < 0)
-			exit(EXIT_FAILURE);
-
-		type = mnt_fs_get_fstype(cxt->fs);
-
-		args[i++] = cxt->helper;			/* 1 */
-		args[i++] = mnt_fs_get_target(cxt->fs);		/* 2 */
-
-		if (mnt_context_is_nomtab(cxt))
-			args[i++] = "-n";			/* 3 */
-		if (mnt_context_is_lazy(cxt))
-			args[i++] = "-l";			/* 4 */
-		if (mnt_context_is_force(cxt))
-			args[i++] = "-f";			/* 5 */
-		if (mnt_context_is_verbose(cxt))
-			args[i++] = "-v";			/* 6 */
-		if (mnt_context_is_rdonly_umount(cxt))
-			args[i++] = "-r";			/* 7 */
-		if (type && !endswith(cxt->helper, type)) {
-			args[i++] = "-t";			/* 8 */
-			args[i++] = (char *) type;	/* 9 */
-		}
+	type = mnt_fs_get_fstype(cxt->fs);
 
-		args[i] = NULL;					/* 10 */
-#ifdef CONFIG_LIBMOUNT_DEBUG
-		for (i = 0; args[i]; i++)
-			DBG(CXT, mnt_debug_h(cxt, "argv[%d] = \"%s\"",
-							i, args[i]));
-#endif
-		DBG_FLUSH;
-		execv(cxt->helper, (char * const *) args);
-		exit(EXIT_FAILURE);
-	}
-	default:
-	{
-		int st;
-		wait(&st);
-		cxt->helper_status = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
-
-		DBG(CXT, mnt_debug_h(cxt, "%s executed [status=%d]",
-					cxt->helper, cxt->helper_status));
-		cxt->helper_exec_status = rc = 0;
-		break;
-	}
+	args[i++] = cxt->helper;			/* 1 */
+	args[i++] = mnt_fs_get_target(cxt->fs);		/* 2 */
 
-	case -1:
-		cxt->helper_exec_status = rc = -errno;
-		DBG(CXT, mnt_debug_h(cxt, "fork() failed"));
-		break;
+	if (mnt_context_is_nomtab(cxt))
+		args[i++] = "-n";			/* 3 */
+	if (mnt_context_is_lazy(cxt))
+		args[i++] = "-l";			/* 4 */
+	if (mnt_context_is_force(cxt))
+		args[i++] = "-f";			/* 5 */
+	if (mnt_context_is_verbose(cxt))
+		args[i++] = "-v";			/* 6 */
+	if (mnt_context_is_rdonly_umount(cxt))
+		args[i++] = "-r";			/* 7 */
+	if (type && !endswith(cxt->helper, type)) {
+		args[i++] = "-t";			/* 8 */
+		args[i++] = type;			/* 9 */
 	}
+	args[i] = NULL;					/* 10 */
 
-	return rc;
+	return mnt_context_exec_helper(cxt, args);
 }
 
 /*
@@ -928,13 +888,8 @@ int mnt_context_next_umount(struct libmnt_context *cxt,
 
 	DBG(CXT, mnt_debug_h(cxt, "next-umount: trying %s", tgt));
 
-	/* ignore filesystems which don't match options patterns */
-	if ((cxt->fstype_pattern && !mnt_fs_match_fstype(*fs,
-					cxt->fstype_pattern)) ||
-
-	/* ignore filesystems which don't match type patterns */
-	   (cxt->optstr_pattern && !mnt_fs_match_options(*fs,
-					cxt->optstr_pattern))) {
+	/* ignore filesystems which don't match type and options patterns */
+	if (!mnt_context_match_patterns(cxt, *fs)) {
 		if (ignored)
 			*ignored = 1;
 		DBG(CXT, mnt_debug_h(cxt, "next-umount: not-match "
@@ -952,5 +907,14 @@ int mnt_context_next_umount(struct libmnt_context *cxt,
 	rc = mnt_context_umount(cxt);
 	if (mntrc)
 		*mntrc = rc;
+
+	/* keep the in-memory mtab up to date rather than re-read it for the
+	 * next filesystem, @fs is still referenced by cxt->fs */
+	if (mnt_context_get_status(cxt) == 1
+	    && !(cxt->mountflags & MS_REMOUNT)
+	    && cxt->mtab == mtab && (*fs)->tab == mtab) {
+		DBG(CXT, mnt_debug_h(cxt, "batch: remove %s from mtab", tgt));
+		mnt_table_remove_fs(mtab, *fs);
+	}
 	return 0;
 }
@@ -38,6 +38,51 @@ struct libmnt_fs *mnt_new_fs(void)
 	return fs;
 }
 
+/*
+ * mnt_new_arena_fs:
+ * @ar: arena
+ *
+ * Allocates the fs in the arena, used by parser for tables with enabled arena
+ * (see mnt_table_enable_arena()). The fs references the arena.
+ */
+struct libmnt_fs *mnt_new_arena_fs(struct libmnt_arena *ar)
+{
+	struct libmnt_fs *fs = mnt_arena_alloc(ar, sizeof(*fs));
+	if (!fs)
+		return NULL;
+
+	fs->refcount = 1;
+	fs->arena = ar;
+	fs->arena_flags = MNT_FS_ARENA_STRUCT;
+	mnt_ref_arena(ar);
+	INIT_LIST_HEAD(&fs->ents);
+	return fs;
+}
+
+/*
+ * The indexes of the table and the cached hashes are based on source and
+ * target.
+ */
+static void reset_table_indexes(struct libmnt_fs *fs)
+{
+	fs->hashed = 0;
+	if (fs->tab)
+		mnt_table_reset_indexes(fs->tab);
+}
+
+/*
+ * The strings from the parser are not allocated, they are in the arena
+ * (marked by @flag in fs->arena_flags). The arena is never modified,
+ * mnt_fs_set_* functions replace the string by a new private copy.
+ */
+static void free_str(struct libmnt_fs *fs, char *str, unsigned int flag)
+{
+	if (fs->arena_flags & flag)
+		fs->arena_flags &= ~flag;
+	else
+		free(str);
+}
+
 /**
  * mnt_free_fs:
  * @fs: fs pointer
@@ -49,30 +94,36 @@ struct libmnt_fs *mnt_new_fs(void)
  */
 void mnt_free_fs(struct libmnt_fs *fs)
 {
+	struct libmnt_arena *ar;
+
 	if (!fs)
 		return;
+	reset_table_indexes(fs);
 	list_del(&fs->ents);
 
 	/*DBG(FS, mnt_debug_h(fs, "free"));*/
 	WARN_REFCOUNT(FS, fs, fs->refcount);
 
-	free(fs->source);
+	free_str(fs, fs->source, MNT_FS_ARENA_SOURCE);
 	free(fs->bindsrc);
 	free(fs->tagname);
 	free(fs->tagval);
-	free(fs->root);
+	free_str(fs, fs->root, MNT_FS_ARENA_ROOT);
 	free(fs->swaptype);
-	free(fs->target);
-	free(fs->fstype);
+	free_str(fs, fs->target, MNT_FS_ARENA_TARGET);
+	free_str(fs, fs->fstype, MNT_FS_ARENA_FSTYPE);
 	free(fs->optstr);
 	free(fs->vfs_optstr);
 	free(fs->fs_optstr);
 	free(fs->user_optstr);
 	free(fs->attrs);
-	free(fs->opt_fields);
+	free_str(fs, fs->opt_fields, MNT_FS_ARENA_OPTFIELDS);
 	free(fs->comment);
 
-	free(fs);
+	ar = fs->arena;
+	if (!(fs->arena_flags & MNT_FS_ARENA_STRUCT))
+		free(fs);
+	mnt_unref_arena(ar);
 }
 
 /**
@@ -83,15 +134,28 @@ void mnt_free_fs(struct libmnt_fs *fs)
  */
 void mnt_reset_fs(struct libmnt_fs *fs)
 {
+	struct libmnt_arena *ar;
+	unsigned int arflags;
 	int ref;
 
 	if (!fs)
 		return;
 
+	reset_table_indexes(fs);
 	ref = fs->refcount;
+	ar = fs->arena;
+	arflags = fs->arena_flags & MNT_FS_ARENA_STRUCT;
+
+	/* keep the arena if the fs itself is in the arena */
+	if (!arflags) {
+		mnt_unref_arena(ar);
+		ar = NULL;
+	}
 	memset(fs, 0, sizeof(*fs));
 	INIT_LIST_HEAD(&fs->ents);
 	fs->refcount = ref;
+	fs->arena = ar;
+	fs->arena_flags = arflags;
 }
 
 /**
@@ -185,6 +249,7 @@ struct libmnt_fs *mnt_copy_fs(struct libmnt_fs *dest,
 	}
 
 	/*DBG(FS, mnt_debug_h(dest, "copy from %p", src));*/
+	reset_table_indexes(dest);
 
 	dest->id         = src->id;
 	dest->parent     = src->parent;
@@ -381,7 +446,9 @@ int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 	}
 
 	if (fs->source != source)
-		free(fs->source);
+		free_str(fs, fs->source, MNT_FS_ARENA_SOURCE);
+
+	reset_table_indexes(fs);
 
 	free(fs->tagname);
 	free(fs->tagval);
@@ -467,6 +534,41 @@ int mnt_fs_streq_target(struct libmnt_fs *fs, const char *path)
 	return fs && streq_except_trailing_slash(mnt_fs_get_target(fs), path);
 }
 
+/*
+ * Returns hash of the target (see mnt_hash_path()), the hash is calculated
+ * only once and it's kept until the target is modified. The target has to be
+ * set.
+ */
+uint64_t mnt_fs_get_target_hash(struct libmnt_fs *fs)
+{
+	assert(fs);
+	assert(fs->target);
+
+	if (!(fs->hashed & MNT_FS_HASHED_TARGET)) {
+		fs->target_hash = mnt_hash_path(fs->target);
+		fs->hashed |= MNT_FS_HASHED_TARGET;
+	}
+	return fs->target_hash;
+}
+
+/*
+ * Returns hash of the source path, see mnt_fs_get_target_hash(). The source
+ * path has to be set.
+ */
+uint64_t mnt_fs_get_srcpath_hash(struct libmnt_fs *fs)
+{
+	assert(fs);
+
+	if (!(fs->hashed & MNT_FS_HASHED_SRCPATH)) {
+		const char *p = mnt_fs_get_srcpath(fs);
+
+		assert(p);
+		fs->srcpath_hash = mnt_hash_path(p);
+		fs->hashed |= MNT_FS_HASHED_SRCPATH;
+	}
+	return fs->srcpath_hash;
+}
+
 /**
  * mnt_fs_get_tag:
  * @fs: fs
@@ -545,8 +647,9 @@ int mnt_fs_set_target(struct libmnt_fs *fs, const char *target)
 		if (!p)
 			return -ENOMEM;
 	}
-	free(fs->target);
+	free_str(fs, fs->target, MNT_FS_ARENA_TARGET);
 	fs->target = p;
+	reset_table_indexes(fs);
 
 	return 0;
 }
@@ -657,7 +760,7 @@ int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 	assert(fs);
 
 	if (fstype != fs->fstype)
-		free(fs->fstype);
+		free_str(fs, fs->fstype, MNT_FS_ARENA_FSTYPE);
 
 	fs->fstype = fstype;
 	fs->flags &= ~MNT_FS_PSEUDO;
@@ -1144,7 +1247,7 @@ int mnt_fs_set_root(struct libmnt_fs *fs, const char *root)
 		if (!p)
 			return -ENOMEM;
 	}
-	free(fs->root);
+	free_str(fs, fs->root, MNT_FS_ARENA_ROOT);
 	fs->root = p;
 	return 0;
 }
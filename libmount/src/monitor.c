@@ -0,0 +1,509 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+
+/**
+ * SECTION: monitor
+ * @title: Monitor
+ * @short_description: interface to monitor mount tables
+ *
+ * The monitor keeps the last parsed mountinfo and returns only the changes
+ * between the previous and the current state. The file descriptor returned by
+ * mnt_monitor_get_fd() is usable in poll() or epoll() based event loops
+ * (wait for POLLPRI). The monitor is reference counted, so one instance could
+ * be shared by more consumers in the same process; every consumer uses its
+ * own iterator to read the changes.
+ *
+ * <informalexample>
+ *   <programlisting>
+ *	struct libmnt_monitor *mn = mnt_new_monitor();
+ *	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_FORWARD);
+ *	struct libmnt_fs *old, *new;
+ *	int oper;
+ *
+ *	mnt_monitor_set_coalesce(mn, 100);
+ *
+ *	while (mnt_monitor_wait(mn, -1) > 0) {
+ *		mnt_reset_iter(itr, MNT_ITER_FORWARD);
+ *		while (mnt_monitor_next_change(mn, itr, &old, &new, &oper) == 0)
+ *			printf("%s\n", mnt_fs_get_target(new ? new : old));
+ *	}
+ *   </programlisting>
+ * </informalexample>
+ */
+#include <poll.h>
+#include <sys/time.h>
+
+#include "mountP.h"
+#include "pathnames.h"
+
+struct libmnt_monitor {
+	int		refcount;
+	char		*filename;	/* monitored file */
+	FILE		*f;
+	int		coalesce;	/* coalescing window in milliseconds */
+	int		interval;	/* minimal time between parsings */
+	struct timeval	last;		/* the last parsing */
+
+	struct libmnt_table *tb;	/* the current state */
+	struct libmnt_table *tb_new;	/* unused table for the next parsing */
+	struct libmnt_tabdiff *diff;	/* the last change set */
+
+	int (*errcb)(struct libmnt_table *tb, const char *filename, int line);
+};
+
+/**
+ * mnt_new_monitor:
+ *
+ * The initial refcount is 1, and needs to be decremented to
+ * release the resources of the monitor. The default is to monitor
+ * /proc/self/mountinfo.
+ *
+ * Returns: newly allocated monitor or NULL in case of error.
+ */
+struct libmnt_monitor *mnt_new_monitor(void)
+{
+	struct libmnt_monitor *mn = calloc(1, sizeof(*mn));
+
+	if (!mn)
+		return NULL;
+
+	mn->refcount = 1;
+	DBG(MONITOR, mnt_debug_h(mn, "alloc"));
+	return mn;
+}
+
+/**
+ * mnt_ref_monitor:
+ * @mn: monitor pointer
+ *
+ * Increments reference counter.
+ */
+void mnt_ref_monitor(struct libmnt_monitor *mn)
+{
+	if (mn)
+		mn->refcount++;
+}
+
+static void monitor_close(struct libmnt_monitor *mn)
+{
+	if (mn->f)
+		fclose(mn->f);
+	mn->f = NULL;
+
+	mnt_unref_table(mn->tb);
+	mnt_unref_table(mn->tb_new);
+	mn->tb = mn->tb_new = NULL;
+
+	mnt_free_tabdiff(mn->diff);
+	mn->diff = NULL;
+}
+
+/**
+ * mnt_unref_monitor:
+ * @mn: monitor pointer
+ *
+ * De-increments reference counter, on zero the @mn is automatically
+ * deallocated.
+ */
+void mnt_unref_monitor(struct libmnt_monitor *mn)
+{
+	if (!mn)
+		return;
+
+	mn->refcount--;
+	if (mn->refcount <= 0) {
+		DBG(MONITOR, mnt_debug_h(mn, "free"));
+		monitor_close(mn);
+		free(mn->filename);
+		free(mn);
+	}
+}
+
+/**
+ * mnt_monitor_set_file:
+ * @mn: monitor pointer
+ * @filename: mountinfo file or NULL for /proc/self/mountinfo
+ *
+ * Sets the monitored file. The change is applied by the next
+ * mnt_monitor_get_fd() call, the current state is discarded.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_monitor_set_file(struct libmnt_monitor *mn, const char *filename)
+{
+	char *p = NULL;
+
+	if (!mn)
+		return -EINVAL;
+	if (filename) {
+		p = strdup(filename);
+		if (!p)
+			return -ENOMEM;
+	}
+
+	monitor_close(mn);
+	free(mn->filename);
+	mn->filename = p;
+	return 0;
+}
+
+/**
+ * mnt_monitor_set_coalesce:
+ * @mn: monitor pointer
+ * @msec: coalescing window in milliseconds
+ *
+ * All the change notifications which arrive within @msec milliseconds after
+ * the first notification are merged and the table is parsed only once. The
+ * default is zero (parse after every notification).
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_monitor_set_coalesce(struct libmnt_monitor *mn, int msec)
+{
+	if (!mn || msec < 0)
+		return -EINVAL;
+	mn->coalesce = msec;
+	return 0;
+}
+
+/**
+ * mnt_monitor_set_interval:
+ * @mn: monitor pointer
+ * @msec: minimal time between two parsings in milliseconds
+ *
+ * Limits how often the monitored file is parsed. If a notification arrives
+ * sooner than @msec milliseconds after the previous parsing, then
+ * mnt_monitor_process_event() waits for the rest of the interval and all the
+ * notifications within the interval are merged to one change set. The
+ * notification after a quiet period is processed without delay. The default
+ * is zero (no limit).
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_monitor_set_interval(struct libmnt_monitor *mn, int msec)
+{
+	if (!mn || msec < 0)
+		return -EINVAL;
+	mn->interval = msec;
+	return 0;
+}
+
+/**
+ * mnt_monitor_set_parser_errcb:
+ * @mn: monitor pointer
+ * @cb: pointer to callback function
+ *
+ * The callback is used for all the tables parsed by the monitor, see
+ * mnt_table_set_parser_errcb().
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_monitor_set_parser_errcb(struct libmnt_monitor *mn,
+		int (*cb)(struct libmnt_table *tb, const char *filename, int line))
+{
+	if (!mn)
+		return -EINVAL;
+
+	mn->errcb = cb;
+	if (mn->tb)
+		mnt_table_set_parser_errcb(mn->tb, cb);
+	if (mn->tb_new)
+		mnt_table_set_parser_errcb(mn->tb_new, cb);
+	return 0;
+}
+
+static const char *monitor_filename(struct libmnt_monitor *mn)
+{
+	return mn->filename ? mn->filename : _PATH_PROC_MOUNTINFO;
+}
+
+static int monitor_parse(struct libmnt_monitor *mn, struct libmnt_table *tb)
+{
+	mnt_reset_table(tb);
+	rewind(mn->f);
+	return mnt_table_parse_stream(tb, mn->f, monitor_filename(mn));
+}
+
+/* opens the file and reads the initial state */
+static int monitor_open(struct libmnt_monitor *mn)
+{
+	const char *filename = monitor_filename(mn);
+	int rc = -ENOMEM;
+
+	if (mn->f)
+		return 0;
+
+	DBG(MONITOR, mnt_debug_h(mn, "open %s", filename));
+
+	mn->tb = mnt_new_table();
+	mn->tb_new = mnt_new_table();
+	mn->diff = mnt_new_tabdiff();
+	if (!mn->tb || !mn->tb_new || !mn->diff)
+		goto err;
+
+	mnt_table_set_parser_errcb(mn->tb, mn->errcb);
+	mnt_table_set_parser_errcb(mn->tb_new, mn->errcb);
+
+	mn->f = fopen(filename, "r" UL_CLOEXECSTR);
+	if (!mn->f) {
+		rc = -errno;
+		goto err;
+	}
+
+	rc = monitor_parse(mn, mn->tb);
+	if (rc)
+		goto err;
+	return 0;
+err:
+	DBG(MONITOR, mnt_debug_h(mn, "failed to open %s [rc=%d]", filename, rc));
+	monitor_close(mn);
+	return rc;
+}
+
+/**
+ * mnt_monitor_get_fd:
+ * @mn: monitor pointer
+ *
+ * Opens the monitored file (if not opened yet) and reads the initial state.
+ * The returned file descriptor is owned by the monitor, wait for POLLPRI and
+ * then call mnt_monitor_process_event().
+ *
+ * Returns: file descriptor or negative number in case of error.
+ */
+int mnt_monitor_get_fd(struct libmnt_monitor *mn)
+{
+	int rc;
+
+	if (!mn)
+		return -EINVAL;
+
+	rc = monitor_open(mn);
+	if (rc)
+		return rc;
+	return fileno(mn->f);
+}
+
+/**
+ * mnt_monitor_get_table:
+ * @mn: monitor pointer
+ * @tb: returns the current state
+ *
+ * The table is owned by the monitor and it is valid until the next
+ * mnt_monitor_process_event() call, use mnt_ref_table() to keep it for
+ * longer time.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_monitor_get_table(struct libmnt_monitor *mn, struct libmnt_table **tb)
+{
+	int rc;
+
+	if (!mn || !tb)
+		return -EINVAL;
+
+	rc = monitor_open(mn);
+	if (!rc)
+		*tb = mn->tb;
+	return rc;
+}
+
+static long monitor_elapsed(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000 +
+	       (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/*
+ * Eats all notifications within the coalescing window or until the end of
+ * the minimal interval since the last parsing.
+ */
+static void monitor_coalesce(struct libmnt_monitor *mn)
+{
+	struct pollfd fds[1];
+	struct timeval start;
+	long left, wait = mn->coalesce;
+
+	if (mn->interval && timerisset(&mn->last)) {
+		left = mn->interval - monitor_elapsed(&mn->last);
+		if (left > wait)
+			wait = left;
+	}
+	if (wait <= 0)
+		return;
+
+	DBG(MONITOR, mnt_debug_h(mn, "waiting %ld ms for more events", wait));
+
+	fds[0].fd = fileno(mn->f);
+	fds[0].events = POLLPRI;
+
+	gettimeofday(&start, NULL);
+	left = wait;
+
+	while (left > 0) {
+		int rc = poll(fds, 1, left);
+
+		if (rc < 0 && errno != EINTR)
+			break;
+		left = wait - monitor_elapsed(&start);
+	}
+}
+
+/**
+ * mnt_monitor_process_event:
+ * @mn: monitor pointer
+ *
+ * Reads the monitored file and compares the new state with the previous
+ * state. Call this function when the file descriptor returned by
+ * mnt_monitor_get_fd() is ready. The changes are available by
+ * mnt_monitor_next_change() until the next call.
+ *
+ * Returns: number of changes, negative number in case of error.
+ */
+int mnt_monitor_process_event(struct libmnt_monitor *mn)
+{
+	struct libmnt_table *tmp;
+	int rc;
+
+	if (!mn)
+		return -EINVAL;
+
+	rc = monitor_open(mn);
+	if (rc)
+		return rc;
+
+	monitor_coalesce(mn);
+
+	rc = monitor_parse(mn, mn->tb_new);
+	gettimeofday(&mn->last, NULL);
+	if (!rc)
+		rc = mnt_diff_tables(mn->diff, mn->tb, mn->tb_new);
+	if (rc < 0)
+		return rc;
+
+	/* the change set keeps references to the old entries */
+	tmp = mn->tb;
+	mn->tb = mn->tb_new;
+	mn->tb_new = tmp;
+	mnt_reset_table(mn->tb_new);
+
+	DBG(MONITOR, mnt_debug_h(mn, "%d changes", rc));
+	return rc;
+}
+
+/**
+ * mnt_monitor_wait:
+ * @mn: monitor pointer
+ * @timeout: number of milliseconds, -1 to block indefinitely
+ *
+ * Waits for a change notification and processes it, see
+ * mnt_monitor_process_event(). Note that the change set could be empty
+ * (e.g. mount and umount within the coalescing window).
+ *
+ * Returns: 1 on success, 0 on timeout or negative number in case of error.
+ */
+int mnt_monitor_wait(struct libmnt_monitor *mn, int timeout)
+{
+	struct pollfd fds[1];
+	int rc;
+
+	rc = mnt_monitor_get_fd(mn);
+	if (rc < 0)
+		return rc;
+
+	fds[0].fd = rc;
+	fds[0].events = POLLPRI;
+
+	rc = poll(fds, 1, timeout);
+	if (rc < 0)
+		return -errno;
+	if (rc == 0)
+		return 0;		/* timeout */
+
+	rc = mnt_monitor_process_event(mn);
+	return rc < 0 ? rc : 1;
+}
+
+/**
+ * mnt_monitor_next_change:
+ * @mn: monitor pointer
+ * @itr: iterator
+ * @old_fs: returns the old entry or NULL if new entry added
+ * @new_fs: returns the new entry or NULL if old entry removed
+ * @oper: MNT_TABDIFF_{MOVE,UMOUNT,REMOUNT,MOUNT} flags
+ *
+ * Returns the changes detected by the last mnt_monitor_process_event() call,
+ * see mnt_tabdiff_next_change().
+ *
+ * Returns: 0 on success, negative number in case of error or 1 at the end of list.
+ */
+int mnt_monitor_next_change(struct libmnt_monitor *mn,
+			    struct libmnt_iter *itr,
+			    struct libmnt_fs **old_fs,
+			    struct libmnt_fs **new_fs,
+			    int *oper)
+{
+	if (!mn || !itr)
+		return -EINVAL;
+	if (!mn->diff)
+		return 1;
+
+	return mnt_tabdiff_next_change(mn->diff, itr, old_fs, new_fs, oper);
+}
+
+#ifdef TEST_PROGRAM
+
+int test_monitor(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_monitor *mn;
+	struct libmnt_iter *itr;
+	int rc = -1;
+
+	mn = mnt_new_monitor();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+
+	if (!mn || !itr) {
+		warnx("failed to allocate resources");
+		goto done;
+	}
+	if (argc > 1)
+		mnt_monitor_set_coalesce(mn, atoi(argv[1]));
+	if (argc > 2)
+		mnt_monitor_set_interval(mn, atoi(argv[2]));
+
+	rc = mnt_monitor_get_fd(mn);
+	if (rc < 0)
+		goto done;
+
+	while ((rc = mnt_monitor_wait(mn, -1)) > 0) {
+		struct libmnt_fs *old, *new;
+		int oper;
+
+		mnt_reset_iter(itr, MNT_ITER_FORWARD);
+		while (mnt_monitor_next_change(mn, itr, &old, &new, &oper) == 0)
+			printf("%d: %s\n", oper, mnt_fs_get_target(new ? new : old));
+		fflush(stdout);
+	}
+done:
+	mnt_unref_monitor(mn);
+	mnt_free_iter(itr);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct libmnt_test tss[] = {
+		{ "--monitor", test_monitor, "[<coalesce> [<interval>]] prints changes" },
+		{ NULL }
+	};
+
+	return mnt_run_test(tss, argc, argv);
+}
+
+#endif /* TEST_PROGRAM */
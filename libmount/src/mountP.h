@@ -49,6 +49,7 @@
 #define MNT_DEBUG_UTILS		(1 << 9)
 #define MNT_DEBUG_CXT		(1 << 10)
 #define MNT_DEBUG_DIFF		(1 << 11)
+#define MNT_DEBUG_MONITOR	(1 << 12)
 #define MNT_DEBUG_ALL		0xFFFF
 
 #ifdef CONFIG_LIBMOUNT_DEBUG
@@ -169,6 +170,37 @@ extern void mnt_free_filesystems(char **filesystems);
 
 extern char *mnt_get_kernel_cmdline_option(const char *name);
 
+extern uint64_t mnt_hash_string(const char *str, size_t len);
+extern uint64_t mnt_hash_path(const char *path);
+
+/*
+ * Compiled mnt_match_fstype() and mnt_match_options() pattern
+ */
+#define MNT_PATTERN_MAXITEMS	64
+
+struct libmnt_pattern_item {
+	const char	*name;		/* points to libmnt_pattern->str */
+	size_t		len;
+	uint64_t	hash;		/* options only */
+	unsigned int	no : 1;		/* "no" prefix */
+};
+
+struct libmnt_pattern {
+	char		*str;		/* the original pattern */
+	char		*buf;		/* the items, allocated together with @str */
+	int		no;		/* fstype: global "no" prefix */
+	size_t		nitems;
+	struct libmnt_pattern_item items[MNT_PATTERN_MAXITEMS];
+};
+
+extern struct libmnt_pattern *mnt_compile_fstype_pattern(const char *pattern);
+extern struct libmnt_pattern *mnt_compile_options_pattern(const char *pattern);
+extern void mnt_free_pattern(struct libmnt_pattern *pat);
+extern int mnt_pattern_match_fstype(const struct libmnt_pattern *pat,
+				    const char *type);
+extern int mnt_pattern_match_options(const struct libmnt_pattern *pat,
+				     const char *optstr);
+
 /* tab.c */
 extern int mnt_table_set_parser_fltrcb(	struct libmnt_table *tb,
 					int (*cb)(struct libmnt_fs *, void *),
@@ -205,6 +237,17 @@ struct libmnt_iter {
 	} while(0)
 
 
+/*
+ * Memory for libmnt_fs structs and strings (see arena.c). The memory is
+ * deallocated when the last libmnt_fs which uses the arena is deallocated.
+ */
+struct libmnt_arena_chunk;
+
+struct libmnt_arena {
+	int		refcount;	/* reference counter */
+	struct libmnt_arena_chunk *chunks;	/* the first is the active one */
+};
+
 /*
  * This struct represents one entry in a mtab/fstab/mountinfo file.
  * (note that fstab[1] means the first column from fstab, and so on...)
@@ -250,6 +293,16 @@ struct libmnt_fs {
 	char		*comment;	/* fstab comment */
 
 	void		*userdata;	/* library independent data */
+
+	struct libmnt_table *tab;	/* table the fs belongs to or NULL */
+	size_t		treepos;	/* position in the table tree index */
+	uint64_t	target_hash;	/* see mnt_fs_get_target_hash() */
+	uint64_t	srcpath_hash;	/* see mnt_fs_get_srcpath_hash() */
+	unsigned int	hashed;		/* MNT_FS_HASHED_* valid hashes */
+	struct libmnt_arena *arena;	/* memory for the struct and strings
+					 * (source, root, target, fstype,
+					 * opt_fields) or NULL */
+	unsigned int	arena_flags;	/* MNT_FS_ARENA_* in the arena */
 };
 
 /*
@@ -261,10 +314,43 @@ struct libmnt_fs {
 #define MNT_FS_KERNEL	(1 << 4) /* data from /proc/{mounts,self/mountinfo} */
 #define MNT_FS_MERGED	(1 << 5) /* already merged data from /run/mount/utab */
 
+/*
+ * fs members allocated in the arena
+ */
+#define MNT_FS_ARENA_STRUCT	(1 << 1)
+#define MNT_FS_ARENA_SOURCE	(1 << 2)
+#define MNT_FS_ARENA_ROOT	(1 << 3)
+#define MNT_FS_ARENA_TARGET	(1 << 4)
+#define MNT_FS_ARENA_FSTYPE	(1 << 5)
+#define MNT_FS_ARENA_OPTFIELDS	(1 << 6)
+#define MNT_FS_ARENA_LINE	(1 << 7) /* the parsed line (parser only) */
+
+/*
+ * fs cached hashes
+ */
+#define MNT_FS_HASHED_TARGET	(1 << 1)
+#define MNT_FS_HASHED_SRCPATH	(1 << 2)
+
 #define mnt_fs_is_regular(_f)	(!(mnt_fs_is_pseudofs(_f) \
 				   || mnt_fs_is_netfs(_f) \
 				   || mnt_fs_is_swaparea(_f)))
 
+/*
+ * Table indexes (see tab_index.c)
+ */
+enum {
+	MNT_INDEX_TARGET = 0,
+	MNT_INDEX_SRCPATH,
+	MNT_INDEX_DEVNO,
+	MNT_INDEX_LOOPDEV,		/* kernel /dev/loopN filesystems */
+
+	MNT_NINDEXES
+};
+
+struct libmnt_index;
+struct libmnt_idxent;
+struct libmnt_tree;
+
 /*
  * mtab/fstab/mountinfo file
  */
@@ -277,6 +363,10 @@ struct libmnt_table {
 	char		*comm_tail;	/* Last comment in file */
 
 	struct libmnt_cache *cache;		/* canonicalized paths/tags cache */
+	struct libmnt_arena *arena;		/* memory for parsed entries or NULL */
+	struct libmnt_index *indexes[MNT_NINDEXES];	/* built on demand */
+	struct libmnt_tree *tree;		/* parent/child index */
+	struct loopdev_index *loopidx;		/* used loop devices snapshot */
 
         int		(*errcb)(struct libmnt_table *tb,
 				 const char *filename, int line);
@@ -284,6 +374,12 @@ struct libmnt_table {
 	int		(*fltrcb)(struct libmnt_fs *fs, void *data);
 	void		*fltrcb_data;
 
+	int		(*linecb)(struct libmnt_table *tb, const char *line,
+				  void *data);
+	void		*linecb_data;
+
+	int		nlines;		/* mnt_table_parse_next_fs() line counter */
+	pid_t		tid;		/* mnt_table_parse_next_fs() /proc/<tid> */
 
 	struct list_head	ents;	/* list of entries (libmnt_fs) */
 	void		*userdata;
@@ -312,6 +408,16 @@ struct libmnt_addmount {
 	struct list_head	mounts;
 };
 
+/*
+ * mount -a --fork child
+ */
+struct libmnt_child {
+	pid_t		pid;
+	struct libmnt_fs *fs;		/* mounted filesystem (from fstab) */
+	int		status;		/* waitpid() status */
+	unsigned int	done : 1;	/* already waited */
+};
+
 /*
  * Mount context -- high-level API
  */
@@ -322,6 +428,8 @@ struct libmnt_context
 
 	char	*fstype_pattern;	/* for mnt_match_fstype() */
 	char	*optstr_pattern;	/* for mnt_match_options() */
+	struct libmnt_pattern *fstype_pat;	/* compiled fstype_pattern */
+	struct libmnt_pattern *optstr_pat;	/* compiled optstr_pattern */
 
 	struct libmnt_fs *fs;		/* filesystem description (type, mountpoint, device, ...) */
 
@@ -362,13 +470,23 @@ struct libmnt_context
 	char	*helper;	/* name of the used /sbin/[u]mount.<type> helper */
 	int	helper_status;	/* helper wait(2) status */
 	int	helper_exec_status; /* 1: not called yet, 0: success, <0: -errno */
+	struct list_head helpers;	/* looked up helpers (see context.c) */
 
 	char	*orig_user;	/* original (non-fixed) user= option */
 
-	pid_t	*children;	/* "mount -a --fork" PIDs */
+	struct libmnt_child *children;	/* "mount -a --fork" children */
 	int	nchildren;	/* number of children */
+	int	nrunning;	/* number of not yet finished children */
+	int	maxchildren;	/* max number of running children or 0 */
 	pid_t	pid;		/* 0=parent; PID=child */
 
+	void	(*child_cb)(struct libmnt_context *, struct libmnt_fs *, int);
+
+	char	**filesystems;	/* /etc/filesystems and /proc/filesystems */
+
+	int	mtab_fd;	/* mount -a: mountinfo fd to detect changes */
+	int	mtab_nowned;	/* mount -a: own mtab changes not seen on mtab_fd */
+	int	mtab_nents;	/* mount -a: mtab entries before own changes */
 
 	int	syscall_status;	/* 1: not called yet, 0: success, <0: -errno */
 };
@@ -399,6 +517,29 @@ struct libmnt_context
 /* default flags */
 #define MNT_FL_DEFAULT		0
 
+/* arena.c */
+extern struct libmnt_arena *mnt_new_arena(void);
+extern void mnt_ref_arena(struct libmnt_arena *ar);
+extern void mnt_unref_arena(struct libmnt_arena *ar);
+extern void *mnt_arena_alloc(struct libmnt_arena *ar, size_t sz);
+extern char *mnt_arena_strdup(struct libmnt_arena *ar, const char *str);
+extern char *mnt_arena_read_stream(struct libmnt_arena *ar, FILE *f, size_t *sz);
+
+/* tab_index.c */
+extern void mnt_table_reset_indexes(struct libmnt_table *tb);
+extern int mnt_table_index_ntags(struct libmnt_table *tb);
+extern struct loopdev_index *mnt_table_get_loopdev_index(struct libmnt_table *tb);
+extern int mnt_table_index_nkernel(struct libmnt_table *tb);
+extern int mnt_table_index_next(struct libmnt_table *tb, int type,
+			 const char *path, dev_t devno,
+			 struct libmnt_idxent **cur,
+			 struct libmnt_fs **fs, int *pos);
+extern int mnt_table_index_find(struct libmnt_table *tb, int type,
+			 const char *path, dev_t devno, int direction,
+			 struct libmnt_fs **res);
+extern int mnt_table_tree_next_child(struct libmnt_table *tb, int parent_id,
+			 struct libmnt_fs *last, struct libmnt_fs **chld);
+
 /* lock.c */
 extern int mnt_lock_use_simplelock(struct libmnt_lock *ml, int enable);
 
@@ -410,6 +551,30 @@ extern const struct libmnt_optmap *mnt_optmap_get_entry(
                              size_t namelen,
 			     const struct libmnt_optmap **mapent);
 
+/* map entry for option without value (e.g. "noexec", not "offset=") */
+#define mnt_optmap_entry_novalue(e) \
+		(e && (e)->name && !strchr((e)->name, '=') && !((e)->mask & MNT_PREFIX))
+
+/* optlist.c */
+struct libmnt_opt;
+struct libmnt_optlist;
+
+extern struct libmnt_optlist *mnt_new_optlist(void);
+extern void mnt_reset_optlist(struct libmnt_optlist *ol);
+extern void mnt_free_optlist(struct libmnt_optlist *ol);
+extern int mnt_optlist_append_option(struct libmnt_optlist *ol,
+			const char *name, const char *value);
+extern int mnt_optlist_append_optstr(struct libmnt_optlist *ol, const char *optstr);
+extern struct libmnt_opt *mnt_optlist_get_option(struct libmnt_optlist *ol,
+			const char *name);
+extern const char *mnt_opt_get_value(struct libmnt_opt *opt);
+extern int mnt_optlist_remove_option(struct libmnt_optlist *ol, const char *name);
+extern int mnt_optlist_get_flags(struct libmnt_optlist *ol, unsigned long *flags,
+			const struct libmnt_optmap *map);
+extern int mnt_optlist_apply_flags(struct libmnt_optlist *ol, unsigned long flags,
+			const struct libmnt_optmap *map);
+extern int mnt_optlist_to_optstr(struct libmnt_optlist *ol, char **optstr);
+
 /* optstr.c */
 extern int mnt_optstr_remove_option_at(char **optstr, char *begin, char *end);
 extern int mnt_optstr_fix_gid(char **optstr, char *value, size_t valsz, char **next);
@@ -418,19 +583,26 @@ extern int mnt_optstr_fix_secontext(char **optstr, char *value, size_t valsz, ch
 extern int mnt_optstr_fix_user(char **optstr);
 
 /* fs.c */
+extern struct libmnt_fs *mnt_new_arena_fs(struct libmnt_arena *ar);
 extern struct libmnt_fs *mnt_copy_mtab_fs(const struct libmnt_fs *fs)
 			__attribute__((nonnull));
 extern int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 			__attribute__((nonnull(1)));
 extern int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 			__attribute__((nonnull(1)));
+extern uint64_t mnt_fs_get_target_hash(struct libmnt_fs *fs);
+extern uint64_t mnt_fs_get_srcpath_hash(struct libmnt_fs *fs);
 
 /* context.c */
+extern int mnt_context_match_patterns(struct libmnt_context *cxt,
+				      struct libmnt_fs *fs);
 extern int mnt_context_prepare_srcpath(struct libmnt_context *cxt);
 extern int mnt_context_prepare_target(struct libmnt_context *cxt);
 extern int mnt_context_guess_fstype(struct libmnt_context *cxt);
 extern int mnt_context_prepare_helper(struct libmnt_context *cxt,
 				      const char *name, const char *type);
+extern int mnt_context_exec_helper(struct libmnt_context *cxt,
+				   const char **args);
 extern int mnt_context_prepare_update(struct libmnt_context *cxt);
 extern int mnt_context_merge_mflags(struct libmnt_context *cxt);
 extern int mnt_context_update_tabs(struct libmnt_context *cxt);
@@ -451,7 +623,8 @@ extern int mnt_context_setup_loopdev(struct libmnt_context *cxt);
 extern int mnt_context_delete_loopdev(struct libmnt_context *cxt);
 extern int mnt_context_clear_loopdev(struct libmnt_context *cxt);
 
-extern int mnt_fork_context(struct libmnt_context *cxt);
+extern int mnt_fork_context(struct libmnt_context *cxt, struct libmnt_fs *fs);
+extern int mnt_context_wait_for_deps(struct libmnt_context *cxt, struct libmnt_fs *fs);
 
 extern int mnt_context_set_tabfilter(struct libmnt_context *cxt,
 				     int (*fltr)(struct libmnt_fs *, void *),
@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+
+/**
+ * SECTION: nscache
+ * @title: Namespaces cache
+ * @short_description: mountinfo tables shared by processes in the same namespace
+ *
+ * The /proc/<pid>/mountinfo files are the same for all processes which use
+ * the same mount namespace and the same root directory. The namespaces cache
+ * parses the file only once for all such processes and returns the same
+ * reference counted table. It's useful for applications which walk all
+ * /proc/<pid>/mountinfo files.
+ *
+ * The namespace is identified by the /proc/<pid>/ns/mnt inode, the root
+ * directory by the /proc/<pid>/root device and inode numbers (processes in
+ * chroot have different mountinfo).
+ *
+ * The tables are not updated, use mnt_reset_nscache() to drop the cached
+ * tables (for example before the next /proc walk).
+ *
+ * <informalexample>
+ *   <programlisting>
+ *	struct libmnt_nscache *nsc = mnt_new_nscache();
+ *	struct libmnt_table *tb;
+ *
+ *	for (each pid) {
+ *		if (mnt_nscache_get_table(nsc, pid, &tb) == 0) {
+ *			...
+ *			mnt_unref_table(tb);
+ *		}
+ *	}
+ *	mnt_unref_nscache(nsc);
+ *   </programlisting>
+ * </informalexample>
+ */
+#include <sys/stat.h>
+
+#include "mountP.h"
+
+struct nscache_entry {
+	dev_t	ns_dev;		/* /proc/<pid>/ns/mnt */
+	ino_t	ns_ino;
+	dev_t	root_dev;	/* /proc/<pid>/root */
+	ino_t	root_ino;
+
+	struct libmnt_table	*tb;
+	struct list_head	ents;
+};
+
+struct libmnt_nscache {
+	int			refcount;
+	size_t			nents;
+	struct list_head	ents;
+
+	struct libmnt_cache	*cache;	/* paths cache for the tables */
+	int (*errcb)(struct libmnt_table *tb, const char *filename, int line);
+};
+
+/**
+ * mnt_new_nscache:
+ *
+ * The initial refcount is 1, and needs to be decremented to
+ * release the resources of the cache.
+ *
+ * Returns: newly allocated namespaces cache or NULL in case of error.
+ */
+struct libmnt_nscache *mnt_new_nscache(void)
+{
+	struct libmnt_nscache *nsc = calloc(1, sizeof(*nsc));
+
+	if (!nsc)
+		return NULL;
+
+	nsc->refcount = 1;
+	INIT_LIST_HEAD(&nsc->ents);
+
+	DBG(TAB, mnt_debug_h(nsc, "nscache: alloc"));
+	return nsc;
+}
+
+/**
+ * mnt_ref_nscache:
+ * @nsc: namespaces cache
+ *
+ * Increments reference counter.
+ */
+void mnt_ref_nscache(struct libmnt_nscache *nsc)
+{
+	if (nsc)
+		nsc->refcount++;
+}
+
+/**
+ * mnt_reset_nscache:
+ * @nsc: namespaces cache
+ *
+ * Drops all cached tables. The tables still referenced by the application
+ * are not deallocated.
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_reset_nscache(struct libmnt_nscache *nsc)
+{
+	if (!nsc)
+		return -EINVAL;
+
+	DBG(TAB, mnt_debug_h(nsc, "nscache: reset [nents=%zu]", nsc->nents));
+
+	while (!list_empty(&nsc->ents)) {
+		struct nscache_entry *e = list_entry(nsc->ents.next,
+						struct nscache_entry, ents);
+		list_del(&e->ents);
+		mnt_unref_table(e->tb);
+		free(e);
+	}
+	nsc->nents = 0;
+	return 0;
+}
+
+/**
+ * mnt_unref_nscache:
+ * @nsc: namespaces cache
+ *
+ * De-increments reference counter, on zero the @nsc is automatically
+ * deallocated.
+ */
+void mnt_unref_nscache(struct libmnt_nscache *nsc)
+{
+	if (!nsc)
+		return;
+
+	nsc->refcount--;
+	if (nsc->refcount <= 0) {
+		DBG(TAB, mnt_debug_h(nsc, "nscache: free"));
+		mnt_reset_nscache(nsc);
+		mnt_unref_cache(nsc->cache);
+		free(nsc);
+	}
+}
+
+/**
+ * mnt_nscache_set_cache:
+ * @nsc: namespaces cache
+ * @mpc: paths cache or NULL
+ *
+ * Sets the paths cache for the newly parsed tables, see mnt_table_set_cache().
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_nscache_set_cache(struct libmnt_nscache *nsc, struct libmnt_cache *mpc)
+{
+	if (!nsc)
+		return -EINVAL;
+
+	mnt_ref_cache(mpc);		/* new */
+	mnt_unref_cache(nsc->cache);	/* old */
+	nsc->cache = mpc;
+	return 0;
+}
+
+/**
+ * mnt_nscache_set_parser_errcb:
+ * @nsc: namespaces cache
+ * @cb: pointer to callback function
+ *
+ * The error callback for the newly parsed tables, see
+ * mnt_table_set_parser_errcb().
+ *
+ * Returns: 0 on success, negative number in case of error.
+ */
+int mnt_nscache_set_parser_errcb(struct libmnt_nscache *nsc,
+		int (*cb)(struct libmnt_table *tb, const char *filename, int line))
+{
+	if (!nsc)
+		return -EINVAL;
+	nsc->errcb = cb;
+	return 0;
+}
+
+static int get_pid_ns(pid_t pid, struct nscache_entry *e)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "/proc/%d/ns/mnt", (int) pid);
+	if (stat(path, &st) != 0)
+		return -errno;
+	e->ns_dev = st.st_dev;
+	e->ns_ino = st.st_ino;
+
+	snprintf(path, sizeof(path), "/proc/%d/root", (int) pid);
+	if (stat(path, &st) != 0)
+		return -errno;
+	e->root_dev = st.st_dev;
+	e->root_ino = st.st_ino;
+	return 0;
+}
+
+static int is_same_ns(struct nscache_entry *a, struct nscache_entry *b)
+{
+	return a->ns_ino == b->ns_ino && a->ns_dev == b->ns_dev &&
+	       a->root_ino == b->root_ino && a->root_dev == b->root_dev;
+}
+
+/**
+ * mnt_nscache_get_table:
+ * @nsc: namespaces cache
+ * @pid: process ID
+ * @tb: returns mountinfo table
+ *
+ * Returns mountinfo of the process @pid. The /proc/<pid>/mountinfo is parsed
+ * only if there is no cached table for the namespace and root directory of the
+ * process. The reference counter of the table is incremented, use
+ * mnt_unref_table() when the table is no more necessary.
+ *
+ * Returns: 0 on success, negative number in case of error (for example,
+ * -ENOENT if the process does not exist).
+ */
+int mnt_nscache_get_table(struct libmnt_nscache *nsc, pid_t pid,
+			  struct libmnt_table **tb)
+{
+	struct nscache_entry key, *e;
+	struct list_head *p;
+	char path[PATH_MAX];
+	int rc;
+
+	if (!nsc || !tb)
+		return -EINVAL;
+	*tb = NULL;
+
+	rc = get_pid_ns(pid, &key);
+	if (rc)
+		return rc;
+
+	list_for_each(p, &nsc->ents) {
+		e = list_entry(p, struct nscache_entry, ents);
+		if (is_same_ns(e, &key)) {
+			DBG(TAB, mnt_debug_h(nsc, "nscache: %d: cached", pid));
+			mnt_ref_table(e->tb);
+			*tb = e->tb;
+			return 0;
+		}
+	}
+
+	DBG(TAB, mnt_debug_h(nsc, "nscache: %d: parsing", pid));
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return -ENOMEM;
+	e->tb = mnt_new_table();
+	if (!e->tb) {
+		free(e);
+		return -ENOMEM;
+	}
+	if (nsc->errcb)
+		mnt_table_set_parser_errcb(e->tb, nsc->errcb);
+	if (nsc->cache)
+		mnt_table_set_cache(e->tb, nsc->cache);
+
+	snprintf(path, sizeof(path), "/proc/%d/mountinfo", (int) pid);
+	rc = mnt_table_parse_file(e->tb, path);
+
+	/* the process may change the namespace (or exit) during parsing */
+	if (!rc)
+		rc = get_pid_ns(pid, e);
+	if (rc) {
+		mnt_unref_table(e->tb);
+		free(e);
+		return rc;
+	}
+
+	mnt_ref_table(e->tb);
+	*tb = e->tb;
+
+	if (is_same_ns(e, &key)) {
+		list_add_tail(&e->ents, &nsc->ents);
+		nsc->nents++;
+	} else {
+		/* don't cache, namespace changed */
+		mnt_unref_table(e->tb);
+		free(e);
+	}
+	return 0;
+}
+
+/**
+ * mnt_nscache_get_nents:
+ * @nsc: namespaces cache
+ *
+ * Returns: number of the cached tables (namespaces).
+ */
+int mnt_nscache_get_nents(struct libmnt_nscache *nsc)
+{
+	return nsc ? (int) nsc->nents : 0;
+}
+
+#ifdef TEST_PROGRAM
+
+int test_pids(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_nscache *nsc = mnt_new_nscache();
+	int i;
+
+	if (!nsc)
+		return -ENOMEM;
+
+	for (i = 1; i < argc; i++) {
+		struct libmnt_table *tb = NULL;
+		pid_t pid = strtol(argv[i], NULL, 10);
+		int rc = mnt_nscache_get_table(nsc, pid, &tb);
+
+		if (rc) {
+			printf("%d: failed [rc=%d]\n", pid, rc);
+			continue;
+		}
+		printf("%d: %p [nents=%d]\n", pid, (void *) tb,
+				mnt_table_get_nents(tb));
+		mnt_unref_table(tb);
+	}
+
+	printf("namespaces: %d\n", mnt_nscache_get_nents(nsc));
+	mnt_unref_nscache(nsc);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct libmnt_test tss[] = {
+		{ "--pids", test_pids, "<pid> [...] parse mountinfo for the processes" },
+		{ NULL }
+	};
+
+	return mnt_run_test(tss, argc, argv);
+}
+
+#endif /* TEST_PROGRAM */
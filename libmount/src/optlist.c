@@ -0,0 +1,518 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * optlist.c - parsed mount options
+ *
+ * The options string is parsed only once and the options are resolved to the
+ * built-in MNT_LINUX_MAP and MNT_USERSPACE_MAP maps when added to the list.
+ * The list could be modified in place (e.g. by mnt_optlist_apply_flags()) and
+ * it's converted back to the string only when necessary.
+ */
+#include "mountP.h"
+
+struct libmnt_opt {
+	char			*name;
+	char			*value;	/* NULL or value, "" for "name=" */
+
+	const struct libmnt_optmap *map;	/* NULL for FS specific option */
+	const struct libmnt_optmap *ent;	/* entry in the map */
+
+	struct list_head	opts;
+};
+
+struct libmnt_optlist {
+	struct list_head	opts;
+};
+
+struct libmnt_optlist *mnt_new_optlist(void)
+{
+	struct libmnt_optlist *ol = calloc(1, sizeof(*ol));
+
+	if (!ol)
+		return NULL;
+
+	INIT_LIST_HEAD(&ol->opts);
+	DBG(OPTIONS, mnt_debug_h(ol, "alloc"));
+	return ol;
+}
+
+static void free_opt(struct libmnt_opt *opt)
+{
+	list_del(&opt->opts);
+	free(opt->name);
+	free(opt->value);
+	free(opt);
+}
+
+void mnt_reset_optlist(struct libmnt_optlist *ol)
+{
+	if (!ol)
+		return;
+
+	while (!list_empty(&ol->opts)) {
+		struct libmnt_opt *opt = list_entry(ol->opts.next,
+						struct libmnt_opt, opts);
+		free_opt(opt);
+	}
+}
+
+void mnt_free_optlist(struct libmnt_optlist *ol)
+{
+	if (!ol)
+		return;
+
+	DBG(OPTIONS, mnt_debug_h(ol, "free"));
+	mnt_reset_optlist(ol);
+	free(ol);
+}
+
+static int is_builtin_map(const struct libmnt_optmap *map)
+{
+	return map == mnt_get_builtin_optmap(MNT_LINUX_MAP) ||
+	       map == mnt_get_builtin_optmap(MNT_USERSPACE_MAP);
+}
+
+/*
+ * Returns the entry from @map for the option or NULL if the option is not
+ * defined in the map. The built-in maps are resolved when the option is added.
+ */
+static const struct libmnt_optmap *opt_get_entry(struct libmnt_opt *opt,
+					const struct libmnt_optmap *map)
+{
+	const struct libmnt_optmap *maps[1];
+	const struct libmnt_optmap *ent = NULL;
+
+	if (is_builtin_map(map))
+		return opt->map == map ? opt->ent : NULL;
+
+	maps[0] = map;
+	mnt_optmap_get_entry(maps, 1, opt->name, strlen(opt->name), &ent);
+	return ent;
+}
+
+static struct libmnt_opt *new_opt(const char *name, size_t namesz,
+				  const char *value, size_t valsz)
+{
+	struct libmnt_opt *opt;
+	const struct libmnt_optmap *maps[2];
+
+	assert(name);
+	assert(namesz);
+
+	opt = calloc(1, sizeof(*opt));
+	if (!opt)
+		return NULL;
+
+	INIT_LIST_HEAD(&opt->opts);
+
+	opt->name = strndup(name, namesz);
+	if (!opt->name)
+		goto err;
+	if (value) {
+		opt->value = strndup(value, valsz);
+		if (!opt->value)
+			goto err;
+	}
+
+	maps[0] = mnt_get_builtin_optmap(MNT_LINUX_MAP);
+	maps[1] = mnt_get_builtin_optmap(MNT_USERSPACE_MAP);
+	opt->map = mnt_optmap_get_entry(maps, 2, name, namesz, &opt->ent);
+	return opt;
+err:
+	free_opt(opt);
+	return NULL;
+}
+
+/*
+ * Adds a new option to the end of the list, @value is optional.
+ */
+int mnt_optlist_append_option(struct libmnt_optlist *ol,
+			      const char *name, const char *value)
+{
+	struct libmnt_opt *opt;
+
+	if (!ol || !name || !*name)
+		return -EINVAL;
+
+	opt = new_opt(name, strlen(name), value, value ? strlen(value) : 0);
+	if (!opt)
+		return -ENOMEM;
+	list_add_tail(&opt->opts, &ol->opts);
+	return 0;
+}
+
+/*
+ * Parses @optstr and adds all the options to the end of the list.
+ */
+int mnt_optlist_append_optstr(struct libmnt_optlist *ol, const char *optstr)
+{
+	char *name, *value, *str = (char *) optstr;
+	size_t namesz, valsz;
+	int rc;
+
+	if (!ol)
+		return -EINVAL;
+	if (!optstr)
+		return 0;
+
+	while ((rc = mnt_optstr_next_option(&str, &name, &namesz,
+						&value, &valsz)) == 0) {
+		struct libmnt_opt *opt = new_opt(name, namesz, value, valsz);
+
+		if (!opt)
+			return -ENOMEM;
+		list_add_tail(&opt->opts, &ol->opts);
+	}
+	return rc < 0 ? rc : 0;
+}
+
+/*
+ * Returns the first option of the @name or NULL.
+ */
+struct libmnt_opt *mnt_optlist_get_option(struct libmnt_optlist *ol,
+					  const char *name)
+{
+	struct list_head *p;
+
+	if (!ol || !name)
+		return NULL;
+
+	list_for_each(p, &ol->opts) {
+		struct libmnt_opt *opt = list_entry(p, struct libmnt_opt, opts);
+
+		if (strcmp(opt->name, name) == 0)
+			return opt;
+	}
+	return NULL;
+}
+
+const char *mnt_opt_get_value(struct libmnt_opt *opt)
+{
+	return opt ? opt->value : NULL;
+}
+
+/*
+ * Removes all options of the @name.
+ *
+ * Returns: 0 on success, 1 if the option not found.
+ */
+int mnt_optlist_remove_option(struct libmnt_optlist *ol, const char *name)
+{
+	struct list_head *p, *pnext;
+	int rc = 1;
+
+	if (!ol || !name)
+		return -EINVAL;
+
+	list_for_each_safe(p, pnext, &ol->opts) {
+		struct libmnt_opt *opt = list_entry(p, struct libmnt_opt, opts);
+
+		if (strcmp(opt->name, name) == 0) {
+			free_opt(opt);
+			rc = 0;
+		}
+	}
+	return rc;
+}
+
+/*
+ * The same as mnt_optstr_get_flags(), but for the parsed options.
+ */
+int mnt_optlist_get_flags(struct libmnt_optlist *ol, unsigned long *flags,
+			  const struct libmnt_optmap *map)
+{
+	const struct libmnt_optmap *umap = NULL;
+	struct list_head *p;
+
+	if (!ol || !flags || !map)
+		return -EINVAL;
+
+	if (map == mnt_get_builtin_optmap(MNT_LINUX_MAP))
+		/*
+		 * the "user" is interpreted as MS_NO{EXEC,SUID,DEV}
+		 */
+		umap = mnt_get_builtin_optmap(MNT_USERSPACE_MAP);
+
+	list_for_each(p, &ol->opts) {
+		struct libmnt_opt *opt = list_entry(p, struct libmnt_opt, opts);
+		const struct libmnt_optmap *ent = opt_get_entry(opt, map);
+		int valsz = opt->value && *opt->value;
+
+		if (ent) {
+			if (!ent->id)
+				continue;
+			/* ignore name=<value> if options map expects <name> only */
+			if (valsz && mnt_optmap_entry_novalue(ent))
+				continue;
+			if (ent->mask & MNT_INVERT)
+				*flags &= ~ent->id;
+			else
+				*flags |= ent->id;
+
+		} else if (umap && opt->map == umap && opt->ent &&
+			   opt->ent->id && !valsz) {
+			/*
+			 * Special case -- translate "user" (but no user=) to
+			 * MS_ options
+			 */
+			ent = opt->ent;
+			if (ent->mask & MNT_INVERT)
+				continue;
+			if (ent->id & (MNT_MS_OWNER | MNT_MS_GROUP))
+				*flags |= MS_OWNERSECURE;
+			else if (ent->id & (MNT_MS_USER | MNT_MS_USERS))
+				*flags |= MS_SECURE;
+		}
+	}
+	return 0;
+}
+
+/*
+ * The same as mnt_optstr_apply_flags(), but for the parsed options.
+ */
+int mnt_optlist_apply_flags(struct libmnt_optlist *ol, unsigned long flags,
+			    const struct libmnt_optmap *map)
+{
+	struct list_head *p, *pnext, *begin;
+	const struct libmnt_optmap *ent;
+	unsigned long fl = flags;
+
+	if (!ol || !map)
+		return -EINVAL;
+
+	DBG(OPTIONS, mnt_debug_h(ol, "applying 0x%08lx flags", flags));
+
+	begin = ol->opts.next;
+
+	/*
+	 * There is a convention that 'rw/ro' flags are always at the beginning of
+	 * the string (although the 'rw' is unnecessary).
+	 */
+	if (map == mnt_get_builtin_optmap(MNT_LINUX_MAP)) {
+		const char *o = (fl & MS_RDONLY) ? "ro" : "rw";
+		struct libmnt_opt *first = list_empty(&ol->opts) ? NULL :
+				list_entry(ol->opts.next, struct libmnt_opt, opts);
+
+		if (first && !first->value &&
+		    (!strcmp(first->name, "rw") || !strcmp(first->name, "ro"))) {
+			/* already set, be paranoid and fix it */
+			if (strcmp(first->name, o) != 0) {
+				struct libmnt_opt *x = new_opt(o, 2, NULL, 0);
+
+				if (!x)
+					return -ENOMEM;
+				list_add(&x->opts, &first->opts);
+				free_opt(first);
+				first = x;
+			}
+		} else {
+			first = new_opt(o, 2, NULL, 0);
+			if (!first)
+				return -ENOMEM;
+			list_add(&first->opts, &ol->opts);
+		}
+		fl &= ~MS_RDONLY;
+		begin = first->opts.next;
+	}
+
+	/* remove options that are missing in @flags */
+	for (p = begin, pnext = p->next; p != &ol->opts; p = pnext, pnext = p->next) {
+		struct libmnt_opt *opt = list_entry(p, struct libmnt_opt, opts);
+
+		ent = opt_get_entry(opt, map);
+		if (!ent || !ent->id)
+			continue;
+		/* ignore name=<value> if options map expects <name> only */
+		if (opt->value && *opt->value && mnt_optmap_entry_novalue(ent))
+			continue;
+
+		if (ent->id == MS_RDONLY ||
+		    (ent->mask & MNT_INVERT) ||
+		    (fl & ent->id) != (unsigned long) ent->id)
+			free_opt(opt);
+
+		if (!(ent->mask & MNT_INVERT))
+			fl &= ~ent->id;
+	}
+
+	if (!fl)
+		return 0;
+
+	/* add missing options */
+	for (ent = map; ent && ent->name; ent++) {
+		const char *e;
+		struct libmnt_opt *opt;
+
+		if ((ent->mask & MNT_INVERT)
+		    || ent->id == 0
+		    || (fl & ent->id) != (unsigned long) ent->id)
+			continue;
+
+		/* don't add options which require values (e.g. offset=%d) */
+		e = strchr(ent->name, '=');
+		if (e) {
+			if (e > ent->name && *(e - 1) == '[')
+				e--;			/* name[=] */
+			else
+				continue;		/* name= */
+		} else
+			e = ent->name + strlen(ent->name);
+
+		opt = new_opt(ent->name, e - ent->name, NULL, 0);
+		if (!opt)
+			return -ENOMEM;
+		list_add_tail(&opt->opts, &ol->opts);
+	}
+	return 0;
+}
+
+/*
+ * Converts the list to the options string. The result is NULL if the list is
+ * empty.
+ */
+int mnt_optlist_to_optstr(struct libmnt_optlist *ol, char **optstr)
+{
+	struct list_head *p;
+	size_t sz = 0;
+	char *str;
+
+	if (!ol || !optstr)
+		return -EINVAL;
+
+	*optstr = NULL;
+
+	list_for_each(p, &ol->opts) {
+		struct libmnt_opt *opt = list_entry(p, struct libmnt_opt, opts);
+
+		sz += strlen(opt->name) + 1;		/* ',' or '\0' */
+		if (opt->value)
+			sz += strlen(opt->value) + 1;	/* '=' */
+	}
+	if (!sz)
+		return 0;
+
+	str = *optstr = malloc(sz);
+	if (!str)
+		return -ENOMEM;
+
+	list_for_each(p, &ol->opts) {
+		struct libmnt_opt *opt = list_entry(p, struct libmnt_opt, opts);
+
+		if (str > *optstr)
+			*str++ = ',';
+		str = stpcpy(str, opt->name);
+		if (opt->value) {
+			*str++ = '=';
+			str = stpcpy(str, opt->value);
+		}
+	}
+	*str = '\0';
+	return 0;
+}
+
+#ifdef TEST_PROGRAM
+
+static int print_optlist(struct libmnt_optlist *ol)
+{
+	char *str = NULL;
+	int rc = mnt_optlist_to_optstr(ol, &str);
+
+	if (!rc)
+		printf("optstr: %s\n", str ? str : "");
+	free(str);
+	return rc;
+}
+
+int test_flags(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_optlist *ol;
+	unsigned long fl = 0;
+	int rc;
+
+	if (argc < 2)
+		return -EINVAL;
+
+	ol = mnt_new_optlist();
+	rc = mnt_optlist_append_optstr(ol, argv[1]);
+	if (!rc)
+		rc = mnt_optlist_get_flags(ol, &fl,
+				mnt_get_builtin_optmap(MNT_LINUX_MAP));
+	if (!rc) {
+		printf("mountflags:           0x%08lx\n", fl);
+		fl = 0;
+		rc = mnt_optlist_get_flags(ol, &fl,
+				mnt_get_builtin_optmap(MNT_USERSPACE_MAP));
+	}
+	if (!rc)
+		printf("userspace-mountflags: 0x%08lx\n", fl);
+
+	mnt_free_optlist(ol);
+	return rc;
+}
+
+int test_apply(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_optlist *ol;
+	unsigned long flags;
+	int rc, map;
+
+	if (argc < 4)
+		return -EINVAL;
+
+	if (!strcmp(argv[1], "--user"))
+		map = MNT_USERSPACE_MAP;
+	else if (!strcmp(argv[1], "--linux"))
+		map = MNT_LINUX_MAP;
+	else {
+		fprintf(stderr, "unknown option '%s'\n", argv[1]);
+		return -EINVAL;
+	}
+
+	flags = strtoul(argv[3], NULL, 16);
+	printf("flags:  0x%08lx\n", flags);
+
+	ol = mnt_new_optlist();
+	rc = mnt_optlist_append_optstr(ol, argv[2]);
+	if (!rc)
+		rc = mnt_optlist_apply_flags(ol, flags, mnt_get_builtin_optmap(map));
+	if (!rc)
+		rc = print_optlist(ol);
+
+	mnt_free_optlist(ol);
+	return rc;
+}
+
+int test_remove(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_optlist *ol;
+	int rc;
+
+	if (argc < 3)
+		return -EINVAL;
+
+	ol = mnt_new_optlist();
+	rc = mnt_optlist_append_optstr(ol, argv[1]);
+	if (!rc)
+		rc = mnt_optlist_remove_option(ol, argv[2]);
+	if (rc >= 0)
+		rc = print_optlist(ol);
+
+	mnt_free_optlist(ol);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct libmnt_test tss[] = {
+		{ "--flags",  test_flags,  "<optstr>                  convert options to MS_* flags" },
+		{ "--apply",  test_apply,  "--{linux,user} <optstr> <mask>  apply mask to optstr" },
+		{ "--remove", test_remove, "<optstr> <name>           remove name in optstr" },
+		{ NULL }
+	};
+
+	return mnt_run_test(tss, argc, argv);
+}
+#endif /* TEST_PROGRAM */
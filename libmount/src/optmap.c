@@ -194,6 +194,154 @@ const struct libmnt_optmap *mnt_get_builtin_optmap(int id)
 	return NULL;
 }
 
+/*
+ * Hash index for the built-in maps. The index is built on the first lookup
+ * and it's never modified later. More threads may build the index at the
+ * same time, so every thread builds a private copy and only the first one is
+ * published by compare-and-swap; the others are deallocated.
+ */
+#define OPTMAP_NBUCKETS	64
+
+struct optmap_index {
+	const struct libmnt_optmap *map;
+	int		nprefixes;
+	unsigned char	buckets[OPTMAP_NBUCKETS];	/* entry index + 1 */
+	unsigned char	next[ARRAY_SIZE(linux_flags_map) > ARRAY_SIZE(userspace_opts_map) ?
+			     ARRAY_SIZE(linux_flags_map) :
+			     ARRAY_SIZE(userspace_opts_map)];
+	unsigned char	prefixes[4];			/* MNT_PREFIX entries */
+};
+
+static const struct libmnt_optmap *optmap_indexed_maps[] = {
+	linux_flags_map,
+	userspace_opts_map
+};
+
+static struct optmap_index *optmap_indexes[ARRAY_SIZE(optmap_indexed_maps)];
+
+/* the entries are indexed by name without "=" or "[=]" suffix */
+static size_t optmap_namelen(const char *name)
+{
+	return strcspn(name, "=[");
+}
+
+static unsigned int optmap_hash(const char *name, size_t namelen)
+{
+	unsigned int h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < namelen; i++) {
+		h ^= (unsigned char) name[i];
+		h *= 16777619U;
+	}
+	return h % OPTMAP_NBUCKETS;
+}
+
+static struct optmap_index *get_optmap_index(const struct libmnt_optmap *map)
+{
+	struct optmap_index *idx;
+	size_t i, n, x;
+
+	for (x = 0; x < ARRAY_SIZE(optmap_indexed_maps); x++) {
+		if (optmap_indexed_maps[x] == map)
+			break;
+	}
+	if (x == ARRAY_SIZE(optmap_indexed_maps))
+		return NULL;
+
+	idx = optmap_indexes[x];
+	__sync_synchronize();
+	if (idx)
+		return idx;
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return NULL;
+	idx->map = map;
+
+	for (n = 0; map[n].name; n++);
+
+	/* add in reverse order to keep the first entry at the begin of the chain */
+	for (i = n; i > 0; i--) {
+		const struct libmnt_optmap *ent = &map[i - 1];
+		unsigned int h;
+
+		if (ent->mask & MNT_PREFIX)
+			continue;
+		h = optmap_hash(ent->name, optmap_namelen(ent->name));
+		idx->next[i - 1] = idx->buckets[h];
+		idx->buckets[h] = i;
+	}
+	for (i = 0; i < n; i++) {
+		if ((map[i].mask & MNT_PREFIX) &&
+		    idx->nprefixes < (int) ARRAY_SIZE(idx->prefixes))
+			idx->prefixes[idx->nprefixes++] = i;
+	}
+
+	/* publish, or use the index from another thread */
+	if (!__sync_bool_compare_and_swap(&optmap_indexes[x], NULL, idx)) {
+		free(idx);
+		idx = optmap_indexes[x];
+	}
+	return idx;
+}
+
+static const struct libmnt_optmap *optmap_index_find(struct optmap_index *idx,
+				const char *name, size_t namelen)
+{
+	const struct libmnt_optmap *map = idx->map, *res = NULL;
+	int i, x;
+
+	for (x = idx->buckets[optmap_hash(name, namelen)]; x; x = idx->next[x - 1]) {
+		const struct libmnt_optmap *ent = &map[x - 1];
+
+		if (optmap_namelen(ent->name) == namelen &&
+		    strncmp(ent->name, name, namelen) == 0) {
+			res = ent;
+			break;
+		}
+	}
+
+	/* the prefix entries which are before @res in the map have priority */
+	for (i = 0; i < idx->nprefixes; i++) {
+		const struct libmnt_optmap *ent = &map[idx->prefixes[i]];
+
+		if (res && ent > res)
+			break;
+		if (startswith(name, ent->name))
+			return ent;
+	}
+	return res;
+}
+
+static const struct libmnt_optmap *optmap_find(const struct libmnt_optmap *map,
+				const char *name, size_t namelen)
+{
+	const struct libmnt_optmap *ent;
+	struct optmap_index *idx;
+	const char *p;
+
+	/* the index does not cover names with the suffix chars */
+	idx = memchr(name, '=', namelen) || memchr(name, '[', namelen) ?
+			NULL : get_optmap_index(map);
+	if (idx)
+		return optmap_index_find(idx, name, namelen);
+
+	for (ent = map; ent && ent->name; ent++) {
+		if (ent->mask & MNT_PREFIX) {
+			if (startswith(name, ent->name))
+				return ent;
+			continue;
+		}
+		if (strncmp(ent->name, name, namelen))
+			continue;
+		p = ent->name + namelen;
+		if (*p == '\0' || *p == '=' || *p == '[')
+			return ent;
+	}
+	return NULL;
+}
+
 /*
  * Looks up the @name in @maps and returns a map and in @mapent
  * returns the map entry
@@ -216,27 +364,12 @@ const struct libmnt_optmap *mnt_optmap_get_entry(
 		*mapent = NULL;
 
 	for (i = 0; i < nmaps; i++) {
-		const struct libmnt_optmap *map = maps[i];
-		const struct libmnt_optmap *ent;
-		const char *p;
-
-		for (ent = map; ent && ent->name; ent++) {
-			if (ent->mask & MNT_PREFIX) {
-				if (startswith(name, ent->name)) {
-					if (mapent)
-						*mapent = ent;
-					return map;
-				}
-				continue;
-			}
-			if (strncmp(ent->name, name, namelen))
-				continue;
-			p = ent->name + namelen;
-			if (*p == '\0' || *p == '=' || *p == '[') {
-				if (mapent)
-					*mapent = ent;
-				return map;
-			}
+		const struct libmnt_optmap *ent = optmap_find(maps[i], name, namelen);
+
+		if (ent) {
+			if (mapent)
+				*mapent = ent;
+			return maps[i];
 		}
 	}
 	return NULL;
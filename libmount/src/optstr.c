@@ -35,9 +35,6 @@ struct libmnt_optloc {
 
 #define mnt_init_optloc(_ol)	(memset((_ol), 0, sizeof(struct libmnt_optloc)))
 
-#define mnt_optmap_entry_novalue(e) \
-		(e && (e)->name && !strchr((e)->name, '=') && !((e)->mask & MNT_PREFIX))
-
 /*
  * Parses the first option from @optstr. The @optstr pointer is set to the beginning
  * of the next option.
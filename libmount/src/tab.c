@@ -106,8 +106,10 @@ int mnt_reset_table(struct libmnt_table *tb)
 				                  struct libmnt_fs, ents);
 		mnt_table_remove_fs(tb, fs);
 	}
+	mnt_table_reset_indexes(tb);
 
 	tb->nents = 0;
+	tb->nlines = 0;
 	return 0;
 }
 
@@ -164,6 +166,7 @@ void mnt_free_table(struct libmnt_table *tb)
 	DBG(TAB, mnt_debug_h(tb, "free"));
 
 	mnt_unref_cache(tb->cache);
+	mnt_unref_arena(tb->arena);
 	free(tb->comm_intro);
 	free(tb->comm_tail);
 	free(tb);
@@ -257,6 +260,44 @@ void mnt_table_enable_comments(struct libmnt_table *tb, int enable)
 		tb->comms = enable;
 }
 
+/**
+ * mnt_table_enable_arena:
+ * @tb: pointer to tab
+ * @enable: TRUE or FALSE
+ *
+ * Enables allocation of the parsed filesystems from one per-table memory
+ * arena. The filesystem entries and the most of their strings are not
+ * allocated separately, and for large tables (thousands of entries) parsing
+ * and deallocation is faster. The function has to be called before
+ * the table is parsed.
+ *
+ * The entries from the arena are usable in the same way as any other
+ * filesystem entries, mnt_fs_set_* functions make a private copy of the
+ * modified strings. The arena is deallocated when the table and all the
+ * parsed filesystems are deallocated.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_table_enable_arena(struct libmnt_table *tb, int enable)
+{
+	assert(tb);
+	if (!tb)
+		return -EINVAL;
+
+	if (enable && !tb->arena) {
+		tb->arena = mnt_new_arena();
+		if (!tb->arena)
+			return -ENOMEM;
+	} else if (!enable && tb->arena) {
+		/* the already parsed entries keep the arena */
+		mnt_unref_arena(tb->arena);
+		tb->arena = NULL;
+	}
+
+	DBG(TAB, mnt_debug_h(tb, "arena %s", enable ? "ENABLED" : "DISABLED"));
+	return 0;
+}
+
 /**
  * mnt_table_with_comments:
  * @tb: pointer to table
@@ -444,7 +485,9 @@ int mnt_table_add_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 
 	mnt_ref_fs(fs);
 	list_add_tail(&fs->ents, &tb->ents);
+	fs->tab = tb;
 	tb->nents++;
+	mnt_table_reset_indexes(tb);
 
 	DBG(TAB, mnt_debug_h(tb, "add entry: %s %s",
 			mnt_fs_get_source(fs), mnt_fs_get_target(fs)));
@@ -472,6 +515,8 @@ int mnt_table_remove_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 
 	list_del(&fs->ents);
 	INIT_LIST_HEAD(&fs->ents);	/* otherwise FS still points to the list */
+	fs->tab = NULL;
+	mnt_table_reset_indexes(tb);
 
 	mnt_unref_fs(fs);
 	tb->nents--;
@@ -540,8 +585,8 @@ int mnt_table_get_root_fs(struct libmnt_table *tb, struct libmnt_fs **root)
 int mnt_table_next_child_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
 			struct libmnt_fs *parent, struct libmnt_fs **chld)
 {
-	struct libmnt_fs *fs;
-	int parent_id, lastchld_id = 0, chld_id = 0;
+	struct libmnt_fs *last = NULL;
+	int parent_id, rc;
 
 	if (!tb || !itr || !parent)
 		return -EINVAL;
@@ -553,37 +598,15 @@ int mnt_table_next_child_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
 	if (!parent_id)
 		return -EINVAL;
 
-	/* get ID of the previously returned child */
-	if (itr->head && itr->p != itr->head) {
-		MNT_ITER_ITERATE(itr, fs, struct libmnt_fs, ents);
-		lastchld_id = mnt_fs_get_id(fs);
-	}
-
-	*chld = NULL;
-
-	mnt_reset_iter(itr, MNT_ITER_FORWARD);
-	while(mnt_table_next_fs(tb, itr, &fs) == 0) {
-		int id;
-
-		if (mnt_fs_get_parent_id(fs) != parent_id)
-			continue;
+	/* get the previously returned child */
+	if (itr->head && itr->p != itr->head)
+		MNT_ITER_ITERATE(itr, last, struct libmnt_fs, ents);
 
-		id = mnt_fs_get_id(fs);
-
-		/* avoid an infinite loop. This only happens in rare cases
-		 * such as in early userspace when the rootfs is its own parent */
-		if (id == parent_id)
-			continue;
-
-		if ((!lastchld_id || id > lastchld_id) &&
-		    (!*chld || id < chld_id)) {
-			*chld = fs;
-			chld_id = id;
-		}
-	}
-
-	if (!chld_id)
-		return 1;	/* end of iterator */
+	rc = mnt_table_tree_next_child(tb, parent_id, last, chld);
+	if (rc == 1)
+		mnt_reset_iter(itr, MNT_ITER_FORWARD);
+	if (rc)
+		return rc;	/* end of iterator or error */
 
 	/* set the iterator to the @chld for the next call */
 	mnt_table_set_iter(tb, itr, *chld);
@@ -730,6 +753,8 @@ static int mnt_table_move_parent(struct libmnt_table *tb, int oldid, int newid)
 		if (fs->parent == oldid)
 			fs->parent = newid;
 	}
+
+	mnt_table_reset_indexes(tb);	/* the tree is modified */
 	return 0;
 }
 
@@ -749,6 +774,9 @@ static int mnt_table_move_parent(struct libmnt_table *tb, int oldid, int newid)
  * @MNT_UNIQ_FORWARD:  remove later mounted filesystems
  * @MNT_UNIQ_KEEPTREE: keep parent->id relation ship stil valid
  *
+ * The function compares all the filesystems with each other, see also
+ * mnt_table_uniq_fs_by_key() for large tables.
+ *
  * Returns: negative number in case of error, or 0 o success.
  */
 int mnt_table_uniq_fs(struct libmnt_table *tb, int flags,
@@ -803,6 +831,171 @@ int mnt_table_uniq_fs(struct libmnt_table *tb, int flags,
 	return 0;
 }
 
+struct uniq_ent {
+	struct libmnt_fs	*fs;
+	uint64_t		hash;
+	struct uniq_ent		*next;
+};
+
+struct uniq_parent {
+	int	id;		/* removed filesystem */
+	int	parent;		/* its parent */
+};
+
+static int cmp_uniq_parents(const void *a, const void *b)
+{
+	const struct uniq_parent *x = a, *y = b;
+
+	return x->id < y->id ? -1 : x->id > y->id;
+}
+
+/*
+ * Sets parents of the filesystems to the nearest not removed ancestor, the
+ * same as mnt_table_move_parent() for each removed filesystem, but by one
+ * pass over the table.
+ */
+static void uniq_move_parents(struct libmnt_table *tb,
+			      struct uniq_parent *rm, size_t nrm)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+
+	qsort(rm, nrm, sizeof(*rm), cmp_uniq_parents);
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		struct uniq_parent key = { .id = fs->parent }, *x;
+		size_t n = 0;
+
+		while (n++ < nrm &&
+		       (x = bsearch(&key, rm, nrm, sizeof(*rm), cmp_uniq_parents)))
+			key.id = x->parent;
+		fs->parent = key.id;
+	}
+}
+
+static int uniq_get_key(struct libmnt_fs *fs, int key, uint64_t *hash)
+{
+	switch (key) {
+	case MNT_UNIQ_TARGET:
+		if (!mnt_fs_get_target(fs))
+			return 0;
+		*hash = mnt_fs_get_target_hash(fs);
+		return 1;
+	case MNT_UNIQ_SOURCE:
+		if (!mnt_fs_get_srcpath(fs))
+			return 0;
+		*hash = mnt_fs_get_srcpath_hash(fs);
+		return 1;
+	}
+	return 0;
+}
+
+static int uniq_is_equal(struct libmnt_fs *a, struct libmnt_fs *b, int key)
+{
+	if (key == MNT_UNIQ_TARGET)
+		return mnt_fs_streq_target(a, mnt_fs_get_target(b));
+	return mnt_fs_streq_srcpath(a, mnt_fs_get_srcpath(b));
+}
+
+/**
+ * mnt_table_uniq_fs_by_key:
+ * @tb: table
+ * @flags: MNT_UNIQ_*
+ * @key: MNT_UNIQ_TARGET or MNT_UNIQ_SOURCE
+ *
+ * The same as mnt_table_uniq_fs(), but the filesystems are compared by the
+ * target (see mnt_fs_streq_target()) or by the source path (see
+ * mnt_fs_streq_srcpath()). The filesystems are hashed and this
+ * function is much faster than the generic mnt_table_uniq_fs() for large
+ * tables. The filesystems without the target or the source path are not
+ * removed.
+ *
+ * Returns: negative number in case of error, or 0 o success.
+ */
+int mnt_table_uniq_fs_by_key(struct libmnt_table *tb, int flags, int key)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	struct uniq_ent *ents, **buckets;
+	struct uniq_parent *rm = NULL;
+	size_t nbuckets, nents = 0, nrm = 0;
+	int direction = MNT_ITER_BACKWARD;
+
+	assert(tb);
+
+	if (!tb || (key != MNT_UNIQ_TARGET && key != MNT_UNIQ_SOURCE))
+		return -EINVAL;
+	if (list_empty(&tb->ents))
+		return 0;
+
+	if (flags & MNT_UNIQ_FORWARD)
+		direction = MNT_ITER_FORWARD;
+	if ((flags & MNT_UNIQ_KEEPTREE) && !is_mountinfo(tb))
+		flags &= ~MNT_UNIQ_KEEPTREE;
+
+	/* power of two, about two entries per bucket */
+	for (nbuckets = 16; nbuckets < (size_t) tb->nents / 2; nbuckets <<= 1);
+
+	ents = calloc(tb->nents, sizeof(*ents));
+	buckets = calloc(nbuckets, sizeof(*buckets));
+	if (flags & MNT_UNIQ_KEEPTREE)
+		rm = calloc(tb->nents, sizeof(*rm));
+	if (!ents || !buckets || ((flags & MNT_UNIQ_KEEPTREE) && !rm)) {
+		free(ents);
+		free(buckets);
+		free(rm);
+		return -ENOMEM;
+	}
+
+	DBG(TAB, mnt_debug_h(tb, "de-duplicate by %s",
+				key == MNT_UNIQ_TARGET ? "target" : "source"));
+	mnt_reset_iter(&itr, direction);
+
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		struct uniq_ent *x, **b;
+		uint64_t hash;
+
+		if (!uniq_get_key(fs, key, &hash))
+			continue;
+
+		b = &buckets[hash & (nbuckets - 1)];
+		for (x = *b; x; x = x->next) {
+			if (x->hash == hash && uniq_is_equal(x->fs, fs, key))
+				break;
+		}
+
+		if (!x) {
+			/* the first, keep it */
+			x = &ents[nents++];
+			x->fs = fs;
+			x->hash = hash;
+			x->next = *b;
+			*b = x;
+			continue;
+		}
+
+		if (rm) {
+			rm[nrm].id = mnt_fs_get_id(fs);
+			rm[nrm].parent = mnt_fs_get_parent_id(fs);
+			nrm++;
+		}
+		DBG(TAB, mnt_debug_h(tb, "remove duplicate %s",
+					mnt_fs_get_target(fs)));
+		mnt_table_remove_fs(tb, fs);
+	}
+
+	if (nrm) {
+		uniq_move_parents(tb, rm, nrm);
+		mnt_table_reset_indexes(tb);	/* the tree is modified */
+	}
+
+	free(ents);
+	free(buckets);
+	free(rm);
+	return 0;
+}
+
 /**
  * mnt_table_set_iter:
  * @tb: tab pointer
@@ -905,22 +1098,16 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
 	DBG(TAB, mnt_debug_h(tb, "lookup TARGET: '%s'", path));
 
 	/* native @target */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, path))
-			return fs;
-	}
+	if (mnt_table_index_find(tb, MNT_INDEX_TARGET, path, 0, direction, &fs) == 1)
+		return fs;
 	if (!tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
 		return NULL;
 
 	DBG(TAB, mnt_debug_h(tb, "lookup canonical TARGET: '%s'", cn));
 
 	/* canonicalized paths in struct libmnt_table */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, cn))
-			return fs;
-	}
+	if (mnt_table_index_find(tb, MNT_INDEX_TARGET, cn, 0, direction, &fs) == 1)
+		return fs;
 
 	/* non-canonicaled path in struct libmnt_table
 	 * -- note that mountpoint in /proc/self/mountinfo is already
@@ -979,13 +1166,8 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 	DBG(TAB, mnt_debug_h(tb, "lookup SRCPATH: '%s'", path));
 
 	/* native paths */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_srcpath(fs, path))
-			return fs;
-		if (mnt_fs_get_tag(fs, NULL, NULL) == 0)
-			ntags++;
-	}
+	if (mnt_table_index_find(tb, MNT_INDEX_SRCPATH, path, 0, direction, &fs) == 1)
+		return fs;
 
 	if (!path || !tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
 		return NULL;
@@ -993,15 +1175,14 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 	DBG(TAB, mnt_debug_h(tb, "lookup canonical SRCPATH: '%s'", cn));
 
 	nents = mnt_table_get_nents(tb);
+	ntags = mnt_table_index_ntags(tb);
+	if (ntags < 0)
+		return NULL;
 
 	/* canonicalized paths in struct libmnt_table */
-	if (ntags < nents) {
-		mnt_reset_iter(&itr, direction);
-		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-			if (mnt_fs_streq_srcpath(fs, cn))
-				return fs;
-		}
-	}
+	if (ntags < nents &&
+	    mnt_table_index_find(tb, MNT_INDEX_SRCPATH, cn, 0, direction, &fs) == 1)
+		return fs;
 
 	/* evaluated tag */
 	if (ntags) {
@@ -1022,8 +1203,12 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 			}
 		} else if (rc < 0 && errno == EACCES) {
 			/* @path is inaccessible, try evaluating all TAGs in @tb
-			 * by udev symlinks -- this could be expensive on systems
-			 * with a huge fstab/mtab */
+			 * by udev symlinks -- all the TAGs are resolved at once,
+			 * it's expensive one by one on systems with a huge
+			 * fstab/mtab */
+			if (ntags > 1)
+				mnt_cache_resolve_table_tags(tb->cache, tb, NULL, NULL);
+
 			 while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
 				 const char *t, *v, *x;
 				 if (mnt_fs_get_tag(fs, &t, &v))
@@ -1144,6 +1329,42 @@ struct libmnt_fs *mnt_table_find_source(struct libmnt_table *tb,
 	return fs;
 }
 
+static struct libmnt_fs *find_pair_by_index(struct libmnt_table *tb,
+				const char *source, const char *target,
+				int direction)
+{
+	struct libmnt_fs *fs, *res = NULL;
+	const char *paths[2];
+	int i, pos, respos = 0;
+
+	paths[0] = target;
+	paths[1] = tb->cache ? mnt_resolve_path(target, tb->cache) : NULL;
+
+	for (i = 0; i < 2; i++) {
+		struct libmnt_idxent *cur = NULL;
+
+		if (!paths[i] || (i == 1 && strcmp(paths[0], paths[1]) == 0))
+			continue;
+
+		while (mnt_table_index_next(tb, MNT_INDEX_TARGET, paths[i], 0,
+					    &cur, &fs, &pos) == 0) {
+			/* the candidates are sorted by position */
+			if (res && direction == MNT_ITER_FORWARD && pos >= respos)
+				break;
+			if (res && direction == MNT_ITER_BACKWARD && pos <= respos)
+				continue;
+			if (!mnt_fs_match_target(fs, target, tb->cache) ||
+			    !mnt_fs_match_source(fs, source, tb->cache))
+				continue;
+			res = fs;
+			respos = pos;
+			if (direction == MNT_ITER_FORWARD)
+				break;
+		}
+	}
+	return res;
+}
+
 /**
  * mnt_table_find_pair
  * @tb: tab pointer
@@ -1173,6 +1394,13 @@ struct libmnt_fs *mnt_table_find_pair(struct libmnt_table *tb, const char *sourc
 
 	DBG(TAB, mnt_debug_h(tb, "lookup SOURCE: %s TARGET: %s", source, target));
 
+	/* Without cache or if all the targets are canonicalized by kernel
+	 * the target is equal to @target or to the canonicalized @target,
+	 * so it's enough to check the entries from the target index.
+	 */
+	if (!tb->cache || mnt_table_index_nkernel(tb) == tb->nents)
+		return find_pair_by_index(tb, source, target, direction);
+
 	mnt_reset_iter(&itr, direction);
 	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
 
@@ -1199,7 +1427,6 @@ struct libmnt_fs *mnt_table_find_devno(struct libmnt_table *tb,
 				       dev_t devno, int direction)
 {
 	struct libmnt_fs *fs = NULL;
-	struct libmnt_iter itr;
 
 	assert(tb);
 
@@ -1210,14 +1437,8 @@ struct libmnt_fs *mnt_table_find_devno(struct libmnt_table *tb,
 
 	DBG(TAB, mnt_debug_h(tb, "lookup DEVNO: %d", (int) devno));
 
-	mnt_reset_iter(&itr, direction);
-
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_get_devno(fs) == devno)
-			return fs;
-	}
-
-	return NULL;
+	mnt_table_index_find(tb, MNT_INDEX_DEVNO, NULL, devno, direction, &fs);
+	return fs;
 }
 
 /*
@@ -1335,6 +1556,70 @@ err:
 	return NULL;
 }
 
+/*
+ * Returns 1 if @fs (from mountinfo/mtab) is @fstab_fs, see
+ * mnt_table_is_fs_mounted().
+ */
+static int is_mounted_as(struct libmnt_table *tb, struct libmnt_fs *fs,
+			 struct libmnt_fs *fstab_fs, const char *src,
+			 dev_t devno, const char *root, const char *tgt,
+			 char **xtgt)
+{
+	int eq = mnt_fs_streq_srcpath(fs, src);
+
+	if (!eq && devno && mnt_fs_get_devno(fs) == devno)
+		eq = 1;
+
+	if (!eq) {
+		/* The source does not match. Maybe the source is a loop
+		 * device backing file.
+		 */
+		struct loopdev_index *loopidx;
+		uint64_t offset = 0;
+		char *val;
+		size_t len;
+		int flags;
+
+		if (!mnt_fs_is_kernel(fs) ||
+		    !mnt_fs_get_srcpath(fs) ||
+		    !startswith(mnt_fs_get_srcpath(fs), "/dev/loop"))
+			return 0;	/* does not look like loopdev */
+
+		if (mnt_fs_get_option(fstab_fs, "offset", &val, &len) == 0 &&
+		    mnt_parse_offset(val, len, &offset)) {
+			DBG(FS, mnt_debug_h(fstab_fs, "failed to parse offset="));
+			return 0;
+		} else
+			flags = LOOPDEV_FL_OFFSET;
+
+		loopidx = mnt_table_get_loopdev_index(tb);
+		if (loopidx)
+			return loopdev_index_is_used(loopidx,
+					mnt_fs_get_srcpath(fs), src, offset, flags);
+
+		return loopdev_is_used(mnt_fs_get_srcpath(fs), src, offset, flags);
+	}
+
+	if (root) {
+		const char *r = mnt_fs_get_root(fs);
+		if (!r || strcmp(r, root) != 0)
+			return 0;
+	}
+
+	/*
+	 * Compare target, try to minimize the number of situations when we
+	 * need to canonicalize the path to avoid readlink() on
+	 * mountpoints.
+	 */
+	if (!*xtgt) {
+		if (mnt_fs_streq_target(fs, tgt))
+			return 1;
+		if (tb->cache)
+			*xtgt = mnt_resolve_path(tgt, tb->cache);
+	}
+	return *xtgt && mnt_fs_streq_target(fs, *xtgt);
+}
+
 /**
  * mnt_table_is_fs__mounted:
  * @tb: /proc/self/mountinfo file
@@ -1357,8 +1642,11 @@ err:
  */
 int mnt_table_is_fs_mounted(struct libmnt_table *tb, struct libmnt_fs *fstab_fs)
 {
-	struct libmnt_iter itr;
+	static const int idxs[] = {
+		MNT_INDEX_SRCPATH, MNT_INDEX_DEVNO, MNT_INDEX_LOOPDEV
+	};
 	struct libmnt_fs *fs;
+	size_t i;
 
 	char *root = NULL;
 	const char *src = NULL, *tgt = NULL;
@@ -1410,63 +1698,18 @@ int mnt_table_is_fs_mounted(struct libmnt_table *tb, struct libmnt_fs *fstab_fs)
 		DBG(FS, mnt_debug_h(fstab_fs, "- ignore (no source/target)"));
 		goto done;
 	}
-	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
-
-	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
-
-		int eq = mnt_fs_streq_srcpath(fs, src);
-
-		if (!eq && devno && mnt_fs_get_devno(fs) == devno)
-			eq = 1;
+	/* all the possible candidates are in the source, devno and
+	 * loop devices indexes */
+	for (i = 0; i < ARRAY_SIZE(idxs) && !rc; i++) {
+		struct libmnt_idxent *cur = NULL;
 
-		if (!eq) {
-			/* The source does not match. Maybe the source is a loop
-			 * device backing file.
-			 */
-			uint64_t offset = 0;
-			char *val;
-			size_t len;
-			int flags;
-
-			if (!mnt_fs_is_kernel(fs) ||
-			    !mnt_fs_get_srcpath(fs) ||
-			    !startswith(mnt_fs_get_srcpath(fs), "/dev/loop"))
-				continue;	/* does not look like loopdev */
-
-			if (mnt_fs_get_option(fstab_fs, "offset", &val, &len) == 0 &&
-			    mnt_parse_offset(val, len, &offset)) {
-				DBG(FS, mnt_debug_h(fstab_fs, "failed to parse offset="));
-				continue;
-			} else
-				flags = LOOPDEV_FL_OFFSET;
-
-			if (loopdev_is_used(mnt_fs_get_srcpath(fs), src, offset, flags))
-				break;
-		}
-
-		if (root) {
-			const char *r = mnt_fs_get_root(fs);
-			if (!r || strcmp(r, root) != 0)
-				continue;
-		}
-
-		/*
-		 * Compare target, try to minimize the number of situations when we
-		 * need to canonicalize the path to avoid readlink() on
-		 * mountpoints.
-		 */
-		if (!xtgt) {
-			if (mnt_fs_streq_target(fs, tgt))
-				break;
-			if (tb->cache)
-				xtgt = mnt_resolve_path(tgt, tb->cache);
-		}
-		if (xtgt && mnt_fs_streq_target(fs, xtgt))
-			break;
+		if (idxs[i] == MNT_INDEX_DEVNO && !devno)
+			continue;
+		while (!rc && mnt_table_index_next(tb, idxs[i], src, devno,
+						   &cur, &fs, NULL) == 0)
+			rc = is_mounted_as(tb, fs, fstab_fs, src, devno,
+					   root, tgt, &xtgt);
 	}
-
-	if (fs)
-		rc = 1;		/* success */
 done:
 	free(root);
 
@@ -1572,6 +1815,42 @@ done:
 	return rc;
 }
 
+static int stream_linecb(struct libmnt_table *tb __attribute__((unused)),
+			 const char *line, void *data)
+{
+	return data && !strstr(line, (char *) data);
+}
+
+int test_stream(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb;
+	struct libmnt_fs *fs;
+	FILE *f;
+	int rc = -1;
+
+	f = fopen(argv[1], "r" UL_CLOEXECSTR);
+	if (!f) {
+		warn("%s: open failed", argv[1]);
+		return -1;
+	}
+	tb = mnt_new_table();
+	if (!tb)
+		goto done;
+	mnt_table_set_parser_errcb(tb, parser_errcb);
+	mnt_table_set_parser_linecb(tb, stream_linecb, argc > 2 ? argv[2] : NULL);
+
+	while ((rc = mnt_table_parse_next_fs(tb, f, argv[1], &fs)) == 0) {
+		mnt_fs_print_debug(fs, stdout);
+		mnt_unref_fs(fs);
+	}
+	if (rc == 1)
+		rc = mnt_table_get_nents(tb);	/* always 0 */
+done:
+	mnt_unref_table(tb);
+	fclose(f);
+	return rc;
+}
+
 int test_find(struct libmnt_test *ts, int argc, char *argv[], int dr)
 {
 	struct libmnt_table *tb;
@@ -1750,7 +2029,12 @@ static int test_uniq(struct libmnt_test *ts, int argc, char *argv[])
 	if (!tb)
 		goto done;
 
-	if (mnt_table_uniq_fs(tb, 0, test_uniq_cmp) == 0) {
+	if (strcmp(argv[0], "--uniq-target-key") == 0)
+		rc = mnt_table_uniq_fs_by_key(tb, 0, MNT_UNIQ_TARGET);
+	else
+		rc = mnt_table_uniq_fs(tb, 0, test_uniq_cmp);
+
+	if (rc == 0) {
 		struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_FORWARD);
 		struct libmnt_fs *fs;
 		if (!itr)
@@ -1758,7 +2042,6 @@ static int test_uniq(struct libmnt_test *ts, int argc, char *argv[])
 		while (mnt_table_next_fs(tb, itr, &fs) == 0)
 			mnt_fs_print_debug(fs, stdout);
 		mnt_free_iter(itr);
-		rc = 0;
 	}
 done:
 	mnt_unref_table(tb);
@@ -1769,9 +2052,11 @@ int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
 	{ "--parse",    test_parse,        "<file> [--comments] parse and print tab" },
+	{ "--stream",   test_stream,       "<file> [<string>] parse lines with <string> entry by entry" },
 	{ "--find-forward",  test_find_fw, "<file> <source|target> <string>" },
 	{ "--find-backward", test_find_bw, "<file> <source|target> <string>" },
 	{ "--uniq-target",   test_uniq,    "<file>" },
+	{ "--uniq-target-key", test_uniq,  "<file>" },
 	{ "--find-pair",     test_find_pair, "<file> <source> <target>" },
 	{ "--find-mountpoint", test_find_mountpoint, "<path>" },
 	{ "--copy-fs",       test_copy_fs, "<file>  copy root FS from the file" },
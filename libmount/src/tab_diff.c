@@ -19,6 +19,7 @@ struct tabdiff_entry {
 	struct libmnt_fs *new_fs;	/* pointer to the new FS */
 
 	struct list_head changes;
+	struct tabdiff_entry *idnext;	/* next entry in the mount ID bucket */
 };
 
 struct libmnt_tabdiff {
@@ -26,6 +27,9 @@ struct libmnt_tabdiff {
 
 	struct list_head changes;	/* list with modified entries */
 	struct list_head unused;	/* list with unused entries */
+
+	struct tabdiff_entry **ids;	/* new mounts hashed by mount ID */
+	size_t nids;			/* number of buckets */
 };
 
 /**
@@ -77,7 +81,13 @@ void mnt_free_tabdiff(struct libmnt_tabdiff *df)
 			                  struct tabdiff_entry, changes);
 		free_tabdiff_entry(de);
 	}
+	while (!list_empty(&df->unused)) {
+		struct tabdiff_entry *de = list_entry(df->unused.next,
+			                  struct tabdiff_entry, changes);
+		free_tabdiff_entry(de);
+	}
 
+	free(df->ids);
 	free(df);
 }
 
@@ -184,19 +194,61 @@ static int tabdiff_add_entry(struct libmnt_tabdiff *df, struct libmnt_fs *old,
 	return 0;
 }
 
-static struct tabdiff_entry *tabdiff_get_mount(struct libmnt_tabdiff *df,
-					       const char *src,
-					       int id)
+#define tabdiff_id_bucket(_df, _id)	((unsigned int) (_id) & ((_df)->nids - 1))
+
+/*
+ * Hashes the newly mounted entries by mount ID, it's used to detect moved
+ * filesystems without rescanning the list of the changes for every umounted
+ * entry.
+ */
+static int tabdiff_hash_mounts(struct libmnt_tabdiff *df)
 {
 	struct list_head *p;
+	size_t sz = 64;
 
 	assert(df);
 
-	list_for_each(p, &df->changes) {
+	while (sz < (size_t) df->nchanges * 2)
+		sz <<= 1;
+
+	if (sz > df->nids) {
+		struct tabdiff_entry **x = realloc(df->ids, sz * sizeof(*x));
+
+		if (!x)
+			return -ENOMEM;
+		df->ids = x;
+		df->nids = sz;
+	}
+	memset(df->ids, 0, df->nids * sizeof(*df->ids));
+
+	/* add from the tail to keep the list order in the buckets */
+	list_for_each_backwardly(p, &df->changes) {
 		struct tabdiff_entry *de;
+		unsigned int h;
 
 		de = list_entry(p, struct tabdiff_entry, changes);
+		if (de->oper != MNT_TABDIFF_MOUNT || !de->new_fs)
+			continue;
 
+		h = tabdiff_id_bucket(df, mnt_fs_get_id(de->new_fs));
+		de->idnext = df->ids[h];
+		df->ids[h] = de;
+	}
+	return 0;
+}
+
+static struct tabdiff_entry *tabdiff_get_mount(struct libmnt_tabdiff *df,
+					       const char *src,
+					       int id)
+{
+	struct tabdiff_entry *de;
+
+	assert(df);
+
+	if (!df->nids)
+		return NULL;
+
+	for (de = df->ids[tabdiff_id_bucket(df, id)]; de; de = de->idnext) {
 		if (de->oper == MNT_TABDIFF_MOUNT && de->new_fs &&
 		    mnt_fs_get_id(de->new_fs) == id) {
 
@@ -280,6 +332,9 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 		}
 	}
 
+	if (tabdiff_hash_mounts(df))
+		return -ENOMEM;
+
 	/* search umounted or moved */
 	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
 	while(mnt_table_next_fs(old_tab, &itr, &fs) == 0) {
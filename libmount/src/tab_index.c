@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * tab_index.c - hash indexes for mnt_table_find_*() functions
+ *
+ * The indexes are built on demand (the first lookup) and deallocated when the
+ * table is modified by mnt_table_add_fs() or mnt_table_remove_fs(), or when
+ * the source or the target of any filesystem in the table is modified.
+ *
+ * The tree index is an array sorted by parent ID and ID, the children of the
+ * filesystem are in the array together and in the order of mounting.
+ *
+ * The loop devices index is a snapshot of the used loop devices from /sys, it
+ * does not describe the table, but it's used to compare the table entries
+ * with backing files and it's dropped together with the other indexes.
+ *
+ * The hash is calculated from the path without the trailing slash, so all
+ * the paths which are equal for mnt_fs_streq_target() and
+ * mnt_fs_streq_srcpath() are in the same bucket. The caller is always
+ * responsible for verifying the candidates. The path hashes are cached in
+ * libmnt_fs, so the index rebuilt after the table modification does not hash
+ * the paths again.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "mountP.h"
+#include "strutils.h"
+#include "loopdev.h"
+
+struct libmnt_idxent {
+	struct libmnt_fs	*fs;
+	int			pos;	/* position in the table */
+	uint64_t		hash;
+	struct libmnt_idxent	*next;	/* next entry in the bucket */
+};
+
+struct libmnt_index {
+	size_t			nbuckets;
+	int			ntags;	/* SRCPATH: entries with TAG source */
+	int			nkernel;/* TARGET: entries from kernel */
+	struct libmnt_idxent	**buckets;
+	struct libmnt_idxent	ents[];
+};
+
+struct libmnt_treeent {
+	int			parent;	/* parent ID */
+	int			id;	/* ID */
+	size_t			pos;	/* position in the table */
+	struct libmnt_fs	*fs;
+};
+
+struct libmnt_tree {
+	size_t			nents;
+	struct libmnt_treeent	*ents;	/* sorted by parent and ID */
+};
+
+static uint64_t hash_devno(dev_t devno)
+{
+	unsigned long long x = (unsigned long long) devno;
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
+/*
+ * Returns 1 and the hash if the @fs has to be in the index @type.
+ */
+static int get_fs_hash(struct libmnt_fs *fs, int type, uint64_t *hash)
+{
+	const char *p;
+
+	switch (type) {
+	case MNT_INDEX_TARGET:
+		if (!mnt_fs_get_target(fs))
+			return 0;
+		*hash = mnt_fs_get_target_hash(fs);
+		return 1;
+	case MNT_INDEX_SRCPATH:
+		if (!mnt_fs_get_srcpath(fs))
+			return 0;
+		*hash = mnt_fs_get_srcpath_hash(fs);
+		return 1;
+	case MNT_INDEX_DEVNO:
+		*hash = hash_devno(mnt_fs_get_devno(fs));
+		return 1;
+	case MNT_INDEX_LOOPDEV:
+		/* see mnt_table_is_fs_mounted() */
+		p = mnt_fs_get_srcpath(fs);
+		if (!mnt_fs_is_kernel(fs) || !p || !startswith(p, "/dev/loop"))
+			return 0;
+		*hash = 0;
+		return 1;
+	}
+	return 0;
+}
+
+static struct libmnt_index *build_index(struct libmnt_table *tb, int type)
+{
+	struct libmnt_iter itr;
+	struct libmnt_index *idx;
+	struct libmnt_idxent **tails;
+	struct libmnt_fs *fs;
+	size_t n = 0, i;
+	int pos = 0;
+
+	idx = calloc(1, sizeof(*idx) + tb->nents * sizeof(struct libmnt_idxent));
+	if (!idx)
+		return NULL;
+
+	/* power of two, about two entries per bucket */
+	for (idx->nbuckets = 16; idx->nbuckets < (size_t) tb->nents / 2;
+	     idx->nbuckets <<= 1);
+
+	idx->buckets = calloc(idx->nbuckets, sizeof(struct libmnt_idxent *));
+	tails = calloc(idx->nbuckets, sizeof(struct libmnt_idxent *));
+	if (!idx->buckets || !tails) {
+		free(tails);
+		free(idx->buckets);
+		free(idx);
+		return NULL;
+	}
+
+	/* the buckets are in the same order as the table */
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0 && n < (size_t) tb->nents) {
+		struct libmnt_idxent *ent = &idx->ents[n];
+		uint64_t hash;
+
+		if (type == MNT_INDEX_SRCPATH && mnt_fs_get_tag(fs, NULL, NULL) == 0)
+			idx->ntags++;
+		if (type == MNT_INDEX_TARGET && mnt_fs_is_kernel(fs))
+			idx->nkernel++;
+		if (!get_fs_hash(fs, type, &hash)) {
+			pos++;
+			continue;
+		}
+
+		ent->fs = fs;
+		ent->pos = pos++;
+		ent->hash = hash;
+
+		i = hash & (idx->nbuckets - 1);
+		if (tails[i])
+			tails[i]->next = ent;
+		else
+			idx->buckets[i] = ent;
+		tails[i] = ent;
+		n++;
+	}
+
+	free(tails);
+
+	DBG(TAB, mnt_debug_h(tb, "index %d: %zu entries, %zu buckets",
+				type, n, idx->nbuckets));
+	return idx;
+}
+
+static struct libmnt_index *get_index(struct libmnt_table *tb, int type)
+{
+	assert(type >= 0 && type < MNT_NINDEXES);
+
+	if (!tb->indexes[type])
+		tb->indexes[type] = build_index(tb, type);
+	return tb->indexes[type];
+}
+
+/*
+ * Deallocates all indexes, called when the table is modified.
+ */
+void mnt_table_reset_indexes(struct libmnt_table *tb)
+{
+	size_t i;
+
+	if (tb->tree) {
+		free(tb->tree->ents);
+		free(tb->tree);
+		tb->tree = NULL;
+	}
+
+	if (tb->loopidx) {
+		loopdev_index_deinit(tb->loopidx);
+		free(tb->loopidx);
+		tb->loopidx = NULL;
+	}
+
+	for (i = 0; i < MNT_NINDEXES; i++) {
+		struct libmnt_index *idx = tb->indexes[i];
+
+		if (!idx)
+			continue;
+		free(idx->buckets);
+		free(idx);
+		tb->indexes[i] = NULL;
+	}
+}
+
+/*
+ * Returns the used loop devices snapshot (built on the first call), or NULL
+ * if /sys is not usable -- use loopdev_is_used() in this case.
+ */
+struct loopdev_index *mnt_table_get_loopdev_index(struct libmnt_table *tb)
+{
+	if (!tb->loopidx) {
+		struct loopdev_index *idx = calloc(1, sizeof(*idx));
+
+		if (!idx)
+			return NULL;
+		if (loopdev_index_scan(idx) != 0) {
+			free(idx);
+			return NULL;
+		}
+		DBG(TAB, mnt_debug_h(tb, "index: %zu loop devices", idx->nents));
+		tb->loopidx = idx;
+	}
+	return tb->loopidx;
+}
+
+/*
+ * Returns the number of entries with TAG in the source, or negative number in
+ * case of error.
+ */
+int mnt_table_index_ntags(struct libmnt_table *tb)
+{
+	struct libmnt_index *idx = get_index(tb, MNT_INDEX_SRCPATH);
+
+	return idx ? idx->ntags : -ENOMEM;
+}
+
+/*
+ * Returns the number of entries from kernel, or negative number in case of
+ * error.
+ */
+int mnt_table_index_nkernel(struct libmnt_table *tb)
+{
+	struct libmnt_index *idx = get_index(tb, MNT_INDEX_TARGET);
+
+	return idx ? idx->nkernel : -ENOMEM;
+}
+
+/*
+ * Iterates over the index @type candidates for @path (or @devno for
+ * MNT_INDEX_DEVNO, nothing for MNT_INDEX_LOOPDEV). The candidates are returned
+ * in the table order. The @cur has to be NULL for the first call and @pos
+ * (optional) returns the position of the entry in the table. The entries
+ * without the path are not in the index, see mnt_table_index_find() for
+ * NULL @path.
+ *
+ * Returns: 0 on success, 1 at the end, negative number in case of error.
+ */
+int mnt_table_index_next(struct libmnt_table *tb, int type,
+			 const char *path, dev_t devno,
+			 struct libmnt_idxent **cur,
+			 struct libmnt_fs **fs, int *pos)
+{
+	struct libmnt_idxent *ent;
+	uint64_t hash;
+
+	assert(tb);
+	assert(cur);
+	assert(fs);
+
+	switch (type) {
+	case MNT_INDEX_DEVNO:
+		hash = hash_devno(devno);
+		break;
+	case MNT_INDEX_LOOPDEV:
+		hash = 0;
+		break;
+	default:
+		if (!path)
+			return 1;
+		hash = mnt_hash_path(path);
+		break;
+	}
+
+	if (*cur)
+		ent = (*cur)->next;
+	else {
+		struct libmnt_index *idx = get_index(tb, type);
+
+		if (!idx)
+			return -ENOMEM;
+		ent = idx->buckets[hash & (idx->nbuckets - 1)];
+	}
+
+	for (; ent; ent = ent->next) {
+		if (ent->hash != hash)
+			continue;
+		*cur = ent;
+		*fs = ent->fs;
+		if (pos)
+			*pos = ent->pos;
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * The entries without target or srcpath (e.g. pseudo filesystems without
+ * source) are not in the indexes, but mnt_fs_streq_*() functions match them
+ * with NULL @path.
+ */
+static int find_null_path(struct libmnt_table *tb, int type, int direction,
+			  struct libmnt_fs **res)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+
+	mnt_reset_iter(&itr, direction);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		if (type == MNT_INDEX_TARGET ? mnt_fs_streq_target(fs, NULL) :
+					       mnt_fs_streq_srcpath(fs, NULL)) {
+			*res = fs;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * The first (MNT_ITER_FORWARD) or the last (MNT_ITER_BACKWARD) entry with
+ * the target (MNT_INDEX_TARGET), srcpath (MNT_INDEX_SRCPATH) equal to @path,
+ * or with @devno (MNT_INDEX_DEVNO).
+ *
+ * Returns: 1 if found, 0 if not found, negative number in case of error.
+ */
+int mnt_table_index_find(struct libmnt_table *tb, int type,
+			 const char *path, dev_t devno, int direction,
+			 struct libmnt_fs **res)
+{
+	struct libmnt_idxent *cur = NULL;
+	struct libmnt_fs *fs;
+	int rc;
+
+	*res = NULL;
+
+	if (!path && (type == MNT_INDEX_TARGET || type == MNT_INDEX_SRCPATH))
+		return find_null_path(tb, type, direction, res);
+
+	while ((rc = mnt_table_index_next(tb, type, path, devno,
+					  &cur, &fs, NULL)) == 0) {
+		int eq;
+
+		switch (type) {
+		case MNT_INDEX_TARGET:
+			eq = mnt_fs_streq_target(fs, path);
+			break;
+		case MNT_INDEX_SRCPATH:
+			eq = mnt_fs_streq_srcpath(fs, path);
+			break;
+		case MNT_INDEX_DEVNO:
+			eq = mnt_fs_get_devno(fs) == devno;
+			break;
+		default:
+			eq = 1;
+			break;
+		}
+		if (!eq)
+			continue;
+		*res = fs;
+		if (direction == MNT_ITER_FORWARD)
+			break;
+	}
+
+	return rc < 0 ? rc : *res ? 1 : 0;
+}
+
+static int cmp_treeents(const void *a, const void *b)
+{
+	const struct libmnt_treeent *x = a, *y = b;
+
+	if (x->parent != y->parent)
+		return x->parent < y->parent ? -1 : 1;
+	if (x->id != y->id)
+		return x->id < y->id ? -1 : 1;
+	if (x->pos != y->pos)
+		return x->pos < y->pos ? -1 : 1;
+	return 0;
+}
+
+static struct libmnt_tree *get_tree(struct libmnt_table *tb)
+{
+	struct libmnt_iter itr;
+	struct libmnt_tree *tree;
+	struct libmnt_fs *fs;
+	size_t i;
+
+	if (tb->tree)
+		return tb->tree;
+
+	tree = calloc(1, sizeof(*tree));
+	if (!tree)
+		return NULL;
+	tree->ents = calloc(tb->nents ? tb->nents : 1, sizeof(struct libmnt_treeent));
+	if (!tree->ents) {
+		free(tree);
+		return NULL;
+	}
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0 && tree->nents < (size_t) tb->nents) {
+		struct libmnt_treeent *ent = &tree->ents[tree->nents++];
+
+		ent->parent = mnt_fs_get_parent_id(fs);
+		ent->id = mnt_fs_get_id(fs);
+		ent->pos = tree->nents - 1;
+		ent->fs = fs;
+	}
+
+	/* qsort() is not stable, the position in the table is the last key, so
+	 * the filesystems with the same parent and ID are in the table order */
+	qsort(tree->ents, tree->nents, sizeof(struct libmnt_treeent), cmp_treeents);
+
+	for (i = 0; i < tree->nents; i++)
+		tree->ents[i].fs->treepos = i;
+
+	DBG(TAB, mnt_debug_h(tb, "tree index: %zu entries", tree->nents));
+	tb->tree = tree;
+	return tree;
+}
+
+/* returns the first entry which is not less than @parent and @id */
+static size_t tree_lower_bound(struct libmnt_tree *tree, int parent, int id)
+{
+	struct libmnt_treeent key = { .parent = parent, .id = id };
+	size_t lo = 0, hi = tree->nents;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (cmp_treeents(&tree->ents[mid], &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Returns the child of @parent_id with the lowest ID greater than ID of @last
+ * (if @last is not NULL). If @last is the previous child from the tree index
+ * then the next child is found in constant time.
+ *
+ * Returns: 0 on success, 1 at the end, negative number in case of error.
+ */
+int mnt_table_tree_next_child(struct libmnt_table *tb, int parent_id,
+			      struct libmnt_fs *last, struct libmnt_fs **chld)
+{
+	struct libmnt_tree *tree = get_tree(tb);
+	int last_id = last ? mnt_fs_get_id(last) : 0;
+	size_t i;
+
+	*chld = NULL;
+	if (!tree)
+		return -ENOMEM;
+
+	if (last && last->tab == tb && last->treepos < tree->nents &&
+	    tree->ents[last->treepos].fs == last &&
+	    tree->ents[last->treepos].parent == parent_id)
+		i = last->treepos + 1;
+	else
+		i = tree_lower_bound(tree, parent_id, last_id);
+
+	for (; i < tree->nents && tree->ents[i].parent == parent_id; i++) {
+		struct libmnt_treeent *ent = &tree->ents[i];
+
+		/* avoid an infinite loop. This only happens in rare cases
+		 * such as in early userspace when the rootfs is its own parent */
+		if (ent->id == parent_id)
+			continue;
+		if (last_id && ent->id <= last_id)
+			continue;
+		if (!ent->id)
+			continue;
+		*chld = ent->fs;
+		return 0;
+	}
+
+	return 1;
+}
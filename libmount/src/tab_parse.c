@@ -45,65 +45,106 @@ static int next_number(char **s, int *num)
 }
 
 /*
- * Parses one line from {fs,m}tab
+ * Returns the next space separated field (terminated by '\0') from @s.
+ */
+static char *next_field(char **s)
+{
+	char *p = (char *) skip_blank(*s), *e;
+
+	if (!*p)
+		return NULL;
+	for (e = p; *e && *e != ' ' && *e != '\t'; e++);
+	if (*e)
+		*e++ = '\0';
+	*s = e;
+	return p;
+}
+
+/* unmangles in place, but only if necessary */
+static void unmangle_field(char *str)
+{
+	if (strchr(str, '\\'))
+		unmangle_string(str);
+}
+
+/*
+ * Returns @str if the line is in the fs arena, otherwise returns a copy.
+ */
+static char *field_to_str(struct libmnt_fs *fs, char *str)
+{
+	unmangle_field(str);
+
+	if (!fs->arena)
+		return strdup(str);
+	if (fs->arena_flags & MNT_FS_ARENA_LINE)
+		return str;
+	return mnt_arena_strdup(fs->arena, str);
+}
+
+/* marks field_to_str() result assigned to @fs */
+static void mark_field(struct libmnt_fs *fs, const char *str, unsigned int flag)
+{
+	if (str && fs->arena)
+		fs->arena_flags |= flag;
+}
+
+/* frees field_to_str() result on error */
+static void free_field(struct libmnt_fs *fs, char *str)
+{
+	if (!fs->arena)
+		free(str);
+}
+
+/*
+ * Parses one line from {fs,m}tab, the line is modified.
  */
 static int mnt_parse_table_line(struct libmnt_fs *fs, char *s)
 {
-	int rc, n = 0, xrc;
-	char *src = NULL, *fstype = NULL, *optstr = NULL;
+	char *f[4], *src = NULL, *fstype = NULL;
+	size_t i;
+	int rc;
 
-	rc = sscanf(s,	UL_SCNsA" "	/* (1) source */
-			UL_SCNsA" "	/* (2) target */
-			UL_SCNsA" "	/* (3) FS type */
-			UL_SCNsA" "	/* (4) options */
-			"%n",		/* byte count */
+	/* (1) source, (2) target, (3) FS type, (4) options */
+	for (i = 0; i < ARRAY_SIZE(f); i++)
+		f[i] = next_field(&s);
 
-			&src,
-			&fs->target,
-			&fstype,
-			&optstr,
-			&n);
-	xrc = rc;
+	if (!f[2]) {
+		DBG(TAB, mnt_debug("tab parse error: [fields]"));
+		return -EINVAL;
+	}
 
-	if (rc == 3 || rc == 4) {			/* options are optional */
-		unmangle_string(src);
-		unmangle_string(fs->target);
-		unmangle_string(fstype);
+	src = field_to_str(fs, f[0]);
+	fs->target = field_to_str(fs, f[1]);
+	mark_field(fs, fs->target, MNT_FS_ARENA_TARGET);
+	fstype = field_to_str(fs, f[2]);
 
-		if (optstr && *optstr)
-			unmangle_string(optstr);
+	if (!src || !fs->target || !fstype) {
+		rc = -ENOMEM;
+		goto err;
+	}
 
-		/* note that __foo functions do not reallocate the string
-		 */
-		rc = __mnt_fs_set_source_ptr(fs, src);
+	/* note that __foo functions do not reallocate the string
+	 */
+	rc = __mnt_fs_set_source_ptr(fs, src);
+	if (!rc) {
+		mark_field(fs, src, MNT_FS_ARENA_SOURCE);
+		src = NULL;
+		rc = __mnt_fs_set_fstype_ptr(fs, fstype);
 		if (!rc) {
-			src = NULL;
-			rc = __mnt_fs_set_fstype_ptr(fs, fstype);
-			if (!rc)
-				fstype = NULL;
+			mark_field(fs, fstype, MNT_FS_ARENA_FSTYPE);
+			fstype = NULL;
 		}
-		if (!rc && optstr)
-			rc = mnt_fs_set_options(fs, optstr);
-		free(optstr);
-		optstr = NULL;
-	} else {
-		DBG(TAB, mnt_debug("tab parse error: [sscanf rc=%d]: '%s'", rc, s));
-		rc = -EINVAL;
 	}
-
-	if (rc) {
-		free(src);
-		free(fstype);
-		free(optstr);
-		DBG(TAB, mnt_debug("tab parse error: [set vars, rc=%d]\n", rc));
-		return rc;	/* error */
+	if (!rc && f[3]) {			/* options are optional */
+		unmangle_field(f[3]);
+		rc = mnt_fs_set_options(fs, f[3]);
 	}
+	if (rc)
+		goto err;
 
 	fs->passno = fs->freq = 0;
 
-	if (xrc == 4 && n)
-		s = (char *) skip_blank(s + n);
-	if (xrc == 4 && *s) {
+	if (f[3] && *(s = (char *) skip_blank(s))) {
 		if (next_number(&s, &fs->freq) != 0) {
 			if (*s) {
 				DBG(TAB, mnt_debug("tab parse error: [freq]"));
@@ -115,86 +156,111 @@ static int mnt_parse_table_line(struct libmnt_fs *fs, char *s)
 		}
 	}
 
+	return rc;
+err:
+	free_field(fs, src);
+	free_field(fs, fstype);
+	DBG(TAB, mnt_debug("tab parse error: [set vars, rc=%d]\n", rc));
 	return rc;
 }
 
 /*
- * Parses one line from a mountinfo file
+ * Parses one line from a mountinfo file, the line is modified. If the line is
+ * in the fs arena then the strings are not copied.
  */
 static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, char *s)
 {
-	int rc, end = 0;
+	char *f[6], *fstype, *src, *fsopts, *end = NULL;
 	unsigned int maj, min;
-	char *fstype = NULL, *src = NULL, *p;
-
-	rc = sscanf(s,	"%u "		/* (1) id */
-			"%u "		/* (2) parent */
-			"%u:%u "	/* (3) maj:min */
-			UL_SCNsA" "	/* (4) mountroot */
-			UL_SCNsA" "	/* (5) target */
-			UL_SCNsA	/* (6) vfs options (fs-independent) */
-			"%n",		/* number of read bytes */
-
-			&fs->id,
-			&fs->parent,
-			&maj, &min,
-			&fs->root,
-			&fs->target,
-			&fs->vfs_optstr,
-			&end);
-
-	if (rc >= 7 && end > 0)
-		s += end;
+	size_t i;
+	int rc;
 
-	/* (7) optional fields, terminated by " - " */
-	p = strstr(s, " - ");
-	if (!p) {
-		DBG(TAB, mnt_debug("mountinfo parse error: separator not found"));
-		return -EINVAL;
+	/* (1) id, (2) parent, (3) maj:min, (4) mountroot, (5) target,
+	 * (6) vfs options (fs-independent) */
+	for (i = 0; i < ARRAY_SIZE(f); i++) {
+		f[i] = next_field(&s);
+		if (!f[i])
+			goto err;
 	}
-	if (p > s + 1)
-		fs->opt_fields = strndup(s + 1, p - s - 1);
-	s = p + 3;
-
-	rc += sscanf(s,	UL_SCNsA" "	/* (8) FS type */
-			UL_SCNsA" "	/* (9) source */
-			UL_SCNsA,	/* (10) fs options (fs specific) */
 
-			&fstype,
-			&src,
-			&fs->fs_optstr);
+	errno = 0;
+	fs->id = strtoul(f[0], &end, 10);
+	if (errno || *end)
+		goto err;
+	fs->parent = strtoul(f[1], &end, 10);
+	if (errno || *end)
+		goto err;
+	if (sscanf(f[2], "%u:%u", &maj, &min) != 2)
+		goto err;
 
-	if (rc >= 10) {
-		fs->flags |= MNT_FS_KERNEL;
-		fs->devno = makedev(maj, min);
+	/* (7) optional fields, terminated by " - " */
+	s = (char *) skip_blank(s);
+	if (*s == '-' && (s[1] == ' ' || s[1] == '\t'))
+		s += 2;
+	else {
+		char *p = strstr(s, " - ");
+
+		if (!p) {
+			DBG(TAB, mnt_debug("mountinfo parse error: separator not found"));
+			return -EINVAL;
+		}
+		*p = '\0';
+		fs->opt_fields = field_to_str(fs, s);
+		if (!fs->opt_fields)
+			return -ENOMEM;
+		mark_field(fs, fs->opt_fields, MNT_FS_ARENA_OPTFIELDS);
+		s = p + 3;
+	}
 
-		unmangle_string(fs->root);
-		unmangle_string(fs->target);
-		unmangle_string(fs->vfs_optstr);
-		unmangle_string(fstype);
-		unmangle_string(src);
-		unmangle_string(fs->fs_optstr);
+	/* (8) FS type, (9) source, (10) fs options (fs specific) */
+	fstype = next_field(&s);
+	src = fstype ? next_field(&s) : NULL;
+	fsopts = src ? next_field(&s) : NULL;
+	if (!fsopts)
+		goto err;
+
+	fs->flags |= MNT_FS_KERNEL;
+	fs->devno = makedev(maj, min);
+
+	fs->root = field_to_str(fs, f[3]);
+	mark_field(fs, fs->root, MNT_FS_ARENA_ROOT);
+	fs->target = field_to_str(fs, f[4]);
+	mark_field(fs, fs->target, MNT_FS_ARENA_TARGET);
+	fstype = field_to_str(fs, fstype);
+	src = field_to_str(fs, src);
+
+	/* the options are always allocated, mnt_optstr_* functions modify
+	 * the strings by realloc() */
+	unmangle_field(f[5]);
+	unmangle_field(fsopts);
+	fs->vfs_optstr = strdup(f[5]);
+	fs->fs_optstr = strdup(fsopts);
+
+	if (!fs->root || !fs->target || !fstype || !src ||
+	    !fs->vfs_optstr || !fs->fs_optstr) {
+		free_field(fs, fstype);
+		free_field(fs, src);
+		return -ENOMEM;
+	}
 
-		rc = __mnt_fs_set_fstype_ptr(fs, fstype);
-		if (!rc) {
-			fstype = NULL;
-			rc = __mnt_fs_set_source_ptr(fs, src);
-			if (!rc)
-				src = NULL;
-		}
+	rc = __mnt_fs_set_fstype_ptr(fs, fstype);
+	if (!rc) {
+		mark_field(fs, fstype, MNT_FS_ARENA_FSTYPE);
+		rc = __mnt_fs_set_source_ptr(fs, src);
+	}
+	if (!rc)
+		mark_field(fs, src, MNT_FS_ARENA_SOURCE);
 
-		/* merge VFS and FS options to one string */
+	/* merge VFS and FS options to one string */
+	if (!rc) {
 		fs->optstr = mnt_fs_strdup_options(fs);
 		if (!fs->optstr)
 			rc = -ENOMEM;
-	} else {
-		free(fstype);
-		free(src);
-		DBG(TAB, mnt_debug(
-			"mountinfo parse error [sscanf rc=%d]: '%s'", rc, s));
-		rc = -EINVAL;
 	}
 	return rc;
+err:
+	DBG(TAB, mnt_debug("mountinfo parse error: '%s'", s));
+	return -EINVAL;
 }
 
 /*
@@ -473,6 +539,17 @@ next_line:
 		if (tb->fmt == MNT_FMT_SWAPS)
 			goto next_line;			/* skip swap header */
 	}
+	if (tb->fmt == MNT_FMT_SWAPS && strncmp(s, "Filename\t", 9) == 0)
+		goto next_line;				/* skip swap header */
+
+	/* raw line filter, the line is ignored before it's parsed */
+	if (tb->linecb) {
+		rc = tb->linecb(tb, s, tb->linecb_data);
+		if (rc < 0)
+			return rc;
+		if (rc)
+			goto next_line;
+	}
 
 	switch (tb->fmt) {
 	case MNT_FMT_FSTAB:
@@ -485,8 +562,6 @@ next_line:
 		rc = mnt_parse_utab_line(fs, s);
 		break;
 	case MNT_FMT_SWAPS:
-		if (strncmp(s, "Filename\t", 9) == 0)
-			goto next_line;			/* skip swap header */
 		rc = mnt_parse_swaps_line(fs, s);
 		break;
 	default:
@@ -574,6 +649,112 @@ static int kernel_fs_postparse(struct libmnt_table *tb,
 	return rc;
 }
 
+/*
+ * The mountinfo file may be huge (thousands of lines), so the file is read by
+ * one read() into the arena and the lines are tokenized in place, the strings
+ * in libmnt_fs point to the arena. The entries are always allocated from the
+ * arena, if the arena is not enabled for the table then a private arena is
+ * used.
+ */
+static int parse_mountinfo_stream(struct libmnt_table *tb, FILE *f,
+				  const char *filename)
+{
+	struct libmnt_arena *ar = tb->arena;
+	char *line, *next, *data;
+	size_t sz = 0;
+	int nlines = 0, rc = 0;
+	pid_t tid = -1;
+
+	if (ar)
+		mnt_ref_arena(ar);
+	else {
+		ar = mnt_new_arena();
+		if (!ar)
+			return -ENOMEM;
+	}
+
+	errno = 0;
+	data = mnt_arena_read_stream(ar, f, &sz);
+	if (!data) {
+		rc = errno ? -errno : -ENOMEM;
+		mnt_unref_arena(ar);
+		return rc;
+	}
+
+	DBG(TAB, mnt_debug_h(tb, "%s: read %zu bytes", filename, sz));
+
+	for (line = data; line && *line; line = next) {
+		struct libmnt_fs *fs;
+		char *s;
+
+		nlines++;
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			DBG(TAB, mnt_debug_h(tb, "%s: no final newline", filename));
+
+		s = line + strlen(line);
+		if (s > line && *(s - 1) == '\r')
+			*(s - 1) = '\0';
+
+		s = (char *) skip_blank(line);
+		if (*s == '\0' || *s == '#')
+			continue;
+
+		if (tb->linecb) {
+			rc = tb->linecb(tb, s, tb->linecb_data);
+			if (rc < 0)
+				break;
+			if (rc) {
+				rc = 0;
+				continue;	/* filtered out by line callback */
+			}
+		}
+
+		fs = mnt_new_arena_fs(ar);
+		if (!fs) {
+			rc = -ENOMEM;
+			break;
+		}
+
+		/* the strings are not copied */
+		fs->arena_flags |= MNT_FS_ARENA_LINE;
+		rc = mnt_parse_mountinfo_line(fs, s);
+		fs->arena_flags &= ~MNT_FS_ARENA_LINE;
+		if (rc) {
+			DBG(TAB, mnt_debug_h(tb, "%s:%d: mountinfo parse error",
+						filename, nlines));
+			rc = tb->errcb ? tb->errcb(tb, filename, nlines) : 1;
+		}
+
+		if (!rc && tb->fltrcb && tb->fltrcb(fs, tb->fltrcb_data))
+			rc = 1;	/* filtered out by callback... */
+
+		if (!rc) {
+			rc = mnt_table_add_fs(tb, fs);
+			if (rc == 0)
+				rc = kernel_fs_postparse(tb, fs, &tid, filename);
+		}
+		mnt_unref_fs(fs);
+
+		if (rc == 1)
+			rc = 0;		/* recoverable error */
+		else if (rc)
+			break;		/* fatal error */
+	}
+
+	mnt_unref_arena(ar);
+
+	if (rc) {
+		DBG(TAB, mnt_debug_h(tb, "%s: parse error (rc=%d)", filename, rc));
+		return rc;
+	}
+	DBG(TAB, mnt_debug_h(tb, "%s: stop parsing (%d entries)",
+				filename, mnt_table_get_nents(tb)));
+	return 0;
+}
+
 /**
  * mnt_table_parse_stream:
  * @tb: tab pointer
@@ -603,8 +784,16 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 	if (filename && strcmp(filename, _PATH_PROC_MOUNTS) == 0)
 		flags = MNT_FS_KERNEL;
 
+	/* /proc/<pid>/mountinfo */
+	if (tb->fmt == MNT_FMT_GUESS && filename && endswith(filename, "/mountinfo"))
+		tb->fmt = MNT_FMT_MOUNTINFO;
+
+	if (tb->fmt == MNT_FMT_MOUNTINFO)
+		return parse_mountinfo_stream(tb, f, filename);
+
 	while (!feof(f)) {
-		struct libmnt_fs *fs = mnt_new_fs();
+		struct libmnt_fs *fs = tb->arena ? mnt_new_arena_fs(tb->arena) :
+						   mnt_new_fs();
 
 		if (!fs)
 			goto err;
@@ -640,6 +829,84 @@ err:
 	return rc;
 }
 
+/**
+ * mnt_table_parse_next_fs:
+ * @tb: tab pointer
+ * @f: file stream
+ * @filename: filename used for debug and error messages
+ * @fs: returns the next filesystem
+ *
+ * Reads and parses the next entry from the stream. The entry is not added to
+ * the table, @tb provides only the parser setting (format, error and filter
+ * callbacks, see mnt_table_set_parser_errcb() and
+ * mnt_table_set_parser_linecb()). It's possible to read the whole file entry
+ * by entry without allocating memory for the entries which are not
+ * necessary. The reference counter of @fs is incremented, use
+ * mnt_unref_fs() to deallocate the entry.
+ *
+ * The line counter (for the error callback) is reset by mnt_reset_table().
+ *
+ * <informalexample>
+ *   <programlisting>
+ *	while (mnt_table_parse_next_fs(tb, f, "/etc/fstab", &fs) == 0) {
+ *		...
+ *		mnt_unref_fs(fs);
+ *	}
+ *   </programlisting>
+ * </informalexample>
+ *
+ * Returns: 0 on success, 1 at the end of the stream, negative number in case
+ * of error.
+ */
+int mnt_table_parse_next_fs(struct libmnt_table *tb, FILE *f,
+			    const char *filename, struct libmnt_fs **fs)
+{
+	int rc;
+
+	if (!tb || !f || !fs)
+		return -EINVAL;
+	*fs = NULL;
+
+	if (!tb->nlines) {
+		tb->tid = -1;
+		if (tb->fmt == MNT_FMT_GUESS && filename
+		    && endswith(filename, "/mountinfo"))
+			tb->fmt = MNT_FMT_MOUNTINFO;
+	}
+
+	do {
+		struct libmnt_fs *x;
+
+		if (feof(f))
+			return 1;
+		x = mnt_new_fs();
+		if (!x)
+			return -ENOMEM;
+
+		rc = mnt_table_parse_next(tb, f, x, filename, &tb->nlines);
+
+		if (!rc && tb->fltrcb && tb->fltrcb(x, tb->fltrcb_data))
+			rc = 1;	/* filtered out by callback... */
+		if (!rc) {
+			if (filename && strcmp(filename, _PATH_PROC_MOUNTS) == 0)
+				x->flags |= MNT_FS_KERNEL;
+			if (tb->fmt == MNT_FMT_MOUNTINFO)
+				rc = kernel_fs_postparse(tb, x, &tb->tid, filename);
+		}
+		if (!rc) {
+			*fs = x;
+			return 0;
+		}
+		mnt_unref_fs(x);
+
+		if (rc < 0 && feof(f))
+			return 1;	/* fgets() returned nothing */
+	} while (rc == 1);		/* recoverable error */
+
+	DBG(TAB, mnt_debug_h(tb, "%s: parse error (rc=%d)", filename, rc));
+	return rc;
+}
+
 /**
  * mnt_table_parse_file:
  * @tb: tab pointer
@@ -901,6 +1168,39 @@ int mnt_table_set_parser_fltrcb(struct libmnt_table *tb,
 	return 0;
 }
 
+/**
+ * mnt_table_set_parser_linecb:
+ * @tb: pointer to table
+ * @cb: pointer to callback function
+ * @data: callback private data
+ *
+ * The callback is called by the table parser for each non-comment line before
+ * the line is parsed and before memory for the new entry is allocated. The
+ * @line is the raw line from the file without the final newline and leading
+ * blanks. It's a cheap way how to quickly ignore unwanted entries, for example
+ * by strstr(). The callback return codes:
+ *
+ *   <0  : fatal error (abort parsing)
+ *    0	 : parse the line
+ *   >0  : ignore the line
+ *
+ * See also mnt_table_parse_next_fs().
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_table_set_parser_linecb(struct libmnt_table *tb,
+		int (*cb)(struct libmnt_table *tb, const char *line, void *data),
+		void *data)
+{
+	if (!tb)
+		return -EINVAL;
+
+	DBG(TAB, mnt_debug_h(tb, "%s table parser line filter", cb ? "set" : "unset"));
+	tb->linecb = cb;
+	tb->linecb_data = data;
+	return 0;
+}
+
 /**
  * mnt_table_parse_swaps:
  * @tb: table
@@ -967,6 +1267,19 @@ int mnt_table_parse_fstab(struct libmnt_table *tb, const char *filename)
 	return rc;
 }
 
+static int is_user_fs_of(struct libmnt_fs *fs, const char *src,
+			 const char *target, const char *root)
+{
+	const char *r = mnt_fs_get_root(fs);
+
+	if (fs->flags & MNT_FS_MERGED)
+		return 0;
+
+	return r && strcmp(r, root) == 0
+		 && mnt_fs_streq_target(fs, target)
+		 && mnt_fs_streq_srcpath(fs, src);
+}
+
 /*
  * This function uses @uf to find a corresponding record in @tb, then the record
  * from @tb is updated (user specific mount options are added).
@@ -978,9 +1291,11 @@ int mnt_table_parse_fstab(struct libmnt_table *tb, const char *filename)
  */
 static struct libmnt_fs *mnt_table_merge_user_fs(struct libmnt_table *tb, struct libmnt_fs *uf)
 {
-	struct libmnt_fs *fs;
+	struct libmnt_fs *fs = NULL, *x;
+	struct libmnt_idxent *cur = NULL;
 	struct libmnt_iter itr;
 	const char *optstr, *src, *target, *root, *attrs;
+	int rc;
 
 	assert(tb);
 	assert(uf);
@@ -998,18 +1313,22 @@ static struct libmnt_fs *mnt_table_merge_user_fs(struct libmnt_table *tb, struct
 	if (!src || !target || !root || (!attrs && !optstr))
 		return NULL;
 
-	mnt_reset_iter(&itr, MNT_ITER_BACKWARD);
-
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		const char *r = mnt_fs_get_root(fs);
+	/* the last not yet merged entry, the candidates are in the table
+	 * order and the index is built only once for all utab entries */
+	while ((rc = mnt_table_index_next(tb, MNT_INDEX_TARGET, target, 0,
+					  &cur, &x, NULL)) == 0) {
+		if (is_user_fs_of(x, src, target, root))
+			fs = x;
+	}
 
-		if (fs->flags & MNT_FS_MERGED)
-			continue;
+	if (rc < 0) {
+		/* no index, no memory... try it in the old way */
+		mnt_reset_iter(&itr, MNT_ITER_BACKWARD);
 
-		if (r && strcmp(r, root) == 0
-		    && mnt_fs_streq_target(fs, target)
-		    && mnt_fs_streq_srcpath(fs, src))
-			break;
+		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+			if (is_user_fs_of(fs, src, target, root))
+				break;
+		}
 	}
 
 	if (fs) {
@@ -25,6 +25,7 @@
 #include "mountP.h"
 #include "mangle.h"
 #include "pathnames.h"
+#include "all-io.h"
 
 struct libmnt_update {
 	char		*target;
@@ -689,6 +690,46 @@ static int add_file_entry(struct libmnt_table *tb, struct libmnt_update *upd)
 	return update_table(upd, tb);
 }
 
+/*
+ * Appends the new entry to the end of the utab file. The entry is written by
+ * one write(2) call, so readers without the lock see the whole line or
+ * nothing, and the file is not parsed and rewritten for every mount.
+ */
+static int append_utab_entry(struct libmnt_update *upd)
+{
+	FILE *f;
+	char *buf = NULL;
+	size_t sz = 0;
+	int rc, fd;
+
+	assert(upd);
+	assert(upd->fs);
+
+	DBG(UPDATE, mnt_debug_h(upd, "%s: appending", upd->filename));
+
+	f = open_memstream(&buf, &sz);
+	if (!f)
+		return -errno;
+	rc = fprintf_utab_fs(f, upd->fs);
+	if (fclose(f) != 0 && !rc)
+		rc = -errno;
+	if (rc)
+		goto done;
+
+	fd = open(upd->filename, O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC,
+			S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if (fd < 0) {
+		rc = -errno;
+		goto done;
+	}
+	rc = write_all(fd, buf, sz) ? -errno : 0;
+	if (close(fd) != 0 && !rc)
+		rc = -errno;
+done:
+	free(buf);
+	return rc;
+}
+
 static int update_add_entry(struct libmnt_update *upd, struct libmnt_lock *lc)
 {
 	struct libmnt_table *tb;
@@ -704,8 +745,14 @@ static int update_add_entry(struct libmnt_update *upd, struct libmnt_lock *lc)
 	if (rc)
 		return rc;
 
-	tb = __mnt_new_table_from_file(upd->filename,
-			upd->userspace_only ? MNT_FMT_UTAB : MNT_FMT_MTAB);
+	if (upd->userspace_only) {
+		rc = append_utab_entry(upd);
+		if (lc)
+			mnt_unlock_file(lc);
+		return rc;
+	}
+
+	tb = __mnt_new_table_from_file(upd->filename, MNT_FMT_MTAB);
 	if (tb)
 		rc = add_file_entry(tb, upd);
 	if (lc)
@@ -23,6 +23,7 @@
 #include "canonicalize.h"
 #include "env.h"
 #include "match.h"
+#include "all-io.h"
 
 int append_string(char **a, const char *b)
 {
@@ -90,20 +91,13 @@ int mnt_tag_is_valid(const char *tag)
 
 int mnt_parse_offset(const char *str, size_t len, uintmax_t *res)
 {
-	char *p;
-	int rc = 0;
-
 	if (!str || !*str)
 		return -EINVAL;
 
-	p = strndup(str, len);
-	if (!p)
-		return -errno;
-
-	if (strtosize(p, res))
-		rc = -EINVAL;
-	free(p);
-	return rc;
+	/* the value is not NUL terminated, it's usually a part of options string */
+	if (parse_size_len(str, strnlen(str, len), res, NULL))
+		return -EINVAL;
+	return 0;
 }
 
 /* used as a callback by bsearch in mnt_fstype_is_pseudofs() */
@@ -308,16 +302,272 @@ int mnt_fstype_is_pseudofs(const char *type)
  */
 int mnt_fstype_is_netfs(const char *type)
 {
+	/* This array must remain sorted when adding new fstypes */
+	static const char *netfs[] = {
+		"afs",
+		"cifs",
+		"ncpfs",
+		"smbfs"
+	};
+
 	assert(type);
 
-	if (strcmp(type, "cifs")   == 0 ||
-	    strcmp(type, "smbfs")  == 0 ||
-	    strncmp(type,"nfs", 3) == 0 ||
-	    strcmp(type, "afs")    == 0 ||
-	    strcmp(type, "ncpfs")  == 0 ||
-	    strncmp(type,"9p", 2)  == 0)
+	/* all nfs* and 9p* types */
+	if (strncmp(type, "nfs", 3) == 0 || strncmp(type, "9p", 2) == 0)
 		return 1;
-	return 0;
+
+	return !(bsearch(&type, netfs, ARRAY_SIZE(netfs),
+				sizeof(char*), fstype_cmp) == NULL);
+}
+
+/* FNV-1a */
+uint64_t mnt_hash_string(const char *str, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char) str[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/*
+ * The trailing slash is ignored, so the paths equal for mnt_fs_streq_target()
+ * and mnt_fs_streq_srcpath() have the same hash.
+ */
+uint64_t mnt_hash_path(const char *path)
+{
+	size_t len = strlen(path);
+
+	if (len && path[len - 1] == '/')
+		len--;
+	return mnt_hash_string(path, len);
+}
+
+static struct libmnt_pattern *new_pattern(const char *pattern)
+{
+	struct libmnt_pattern *pat = calloc(1, sizeof(*pat));
+	size_t sz = strlen(pattern) + 1;
+
+	if (!pat)
+		return NULL;
+	pat->str = malloc(sz * 2);
+	if (!pat->str) {
+		free(pat);
+		return NULL;
+	}
+	memcpy(pat->str, pattern, sz);
+	pat->buf = pat->str + sz;
+	memcpy(pat->buf, pattern, sz);
+	return pat;
+}
+
+void mnt_free_pattern(struct libmnt_pattern *pat)
+{
+	if (!pat)
+		return;
+	free(pat->str);
+	free(pat);
+}
+
+/*
+ * Splits @pattern to the items in the same way as mnt_match_fstype(). The
+ * pattern is parsed only once, the match does not have to search for commas.
+ *
+ * Returns: new pattern or NULL in case of error (or too many items).
+ */
+struct libmnt_pattern *mnt_compile_fstype_pattern(const char *pattern)
+{
+	struct libmnt_pattern *pat;
+	char *p;
+
+	assert(pattern);
+
+	pat = new_pattern(pattern);
+	if (!pat)
+		return NULL;
+
+	p = pat->buf;
+	if (!strncmp(p, "no", 2)) {
+		pat->no = 1;
+		p += 2;
+	}
+
+	while (p) {
+		struct libmnt_pattern_item *it;
+		char *sep = strchr(p, ',');
+
+		if (pat->nitems == MNT_PATTERN_MAXITEMS) {
+			mnt_free_pattern(pat);
+			return NULL;
+		}
+		if (sep)
+			*sep++ = '\0';
+
+		it = &pat->items[pat->nitems++];
+		it->name = p;
+		it->len = strlen(p);
+		it->no = !strncmp(p, "no", 2);
+		p = sep;
+	}
+
+	return pat;
+}
+
+/*
+ * Returns: 1 if @type matches the compiled pattern, see mnt_match_fstype().
+ */
+int mnt_pattern_match_fstype(const struct libmnt_pattern *pat, const char *type)
+{
+	size_t i, len;
+
+	assert(pat);
+	assert(type);
+
+	len = strlen(type);
+
+	for (i = 0; i < pat->nitems; i++) {
+		const struct libmnt_pattern_item *it = &pat->items[i];
+
+		/* "nofoo" item */
+		if (it->no && it->len == len + 2 && !memcmp(it->name + 2, type, len))
+			return 0;
+		if (it->len == len && !memcmp(it->name, type, len))
+			return !pat->no;
+	}
+	return pat->no;
+}
+
+/*
+ * Splits @pattern to the items in the same way as mnt_match_options(), the
+ * "no" and "+" prefixes are already evaluated (and removed from the items).
+ *
+ * Returns: new pattern or NULL in case of error (or too many items).
+ */
+struct libmnt_pattern *mnt_compile_options_pattern(const char *pattern)
+{
+	struct libmnt_pattern *pat;
+	char *p;
+
+	assert(pattern);
+
+	pat = new_pattern(pattern);
+	if (!pat)
+		return NULL;
+
+	for (p = pat->buf; p; ) {
+		struct libmnt_pattern_item *it;
+		char *sep = strchr(p, ',');
+
+		if (sep)
+			*sep++ = '\0';
+		if (!*p) {
+			p = sep;
+			continue;	/* if two ',' appear in a row */
+		}
+		if (pat->nitems == MNT_PATTERN_MAXITEMS) {
+			mnt_free_pattern(pat);
+			return NULL;
+		}
+
+		it = &pat->items[pat->nitems++];
+		if (*p == '+')
+			p++;
+		else if (!strncmp(p, "no", 2)) {
+			it->no = 1;
+			p += 2;
+		}
+		it->name = p;
+		it->len = strlen(p);
+		it->hash = mnt_hash_string(p, it->len);
+		p = sep;
+	}
+
+	return pat;
+}
+
+/*
+ * Returns: 1 if @optstr matches the compiled pattern, see mnt_match_options().
+ * The options string is scanned only once for all the pattern items.
+ */
+int mnt_pattern_match_options(const struct libmnt_pattern *pat, const char *optstr)
+{
+	const char *p, *end;
+	uint64_t found = 0;
+	size_t i;
+
+	assert(pat);
+
+	end = optstr ? optstr + strlen(optstr) : NULL;
+
+	for (p = optstr; p && p < end; p++) {
+		const char *sep = strchr(p, ',');
+		size_t plen = sep ? (size_t) (sep - p) : (size_t) (end - p);
+		uint64_t hash = mnt_hash_string(p, plen);
+
+		for (i = 0; i < pat->nitems; i++) {
+			const struct libmnt_pattern_item *it = &pat->items[i];
+
+			if (it->hash == hash && it->len == plen &&
+			    !memcmp(it->name, p, plen))
+				found |= (1ULL << i);
+		}
+		p += plen;
+	}
+
+	for (i = 0; i < pat->nitems; i++) {
+		int has = (found & (1ULL << i)) ? 1 : 0;
+
+		if (has == pat->items[i].no)
+			return 0;	/* any match failure means failure */
+	}
+
+	/* no match failures in list means success */
+	return 1;
+}
+
+/*
+ * mnt_match_fstype() and mnt_match_options() are usually called with the same
+ * pattern for all entries in the table, so the last compiled pattern is kept
+ * (per thread) and compiled again only if the pattern is changed.
+ */
+enum {
+	LAST_FSTYPE_PAT = 0,
+	LAST_OPTIONS_PAT
+};
+
+#ifdef HAVE_TLS
+static __thread struct libmnt_pattern *last_pats[2];
+#endif
+
+static struct libmnt_pattern *get_pattern(int what, const char *pattern,
+			struct libmnt_pattern *(*compile)(const char *))
+{
+#ifdef HAVE_TLS
+	struct libmnt_pattern **last = &last_pats[what];
+
+	if (*last && strcmp((*last)->str, pattern) == 0)
+		return *last;
+
+	mnt_free_pattern(*last);
+	*last = compile(pattern);
+	return *last;
+#else
+	/* not thread-safe to keep it */
+	(void) what;
+	return compile(pattern);
+#endif
+}
+
+static void put_pattern(struct libmnt_pattern *pat)
+{
+#ifdef HAVE_TLS
+	(void) pat;
+#else
+	mnt_free_pattern(pat);
+#endif
 }
 
 /**
@@ -341,10 +591,24 @@ int mnt_fstype_is_netfs(const char *type)
  */
 int mnt_match_fstype(const char *type, const char *pattern)
 {
-	return match_fstype(type, pattern);
+	struct libmnt_pattern *pat;
+	int rc;
+
+	if (!pattern || !type)
+		return match_fstype(type, pattern);
+
+	pat = get_pattern(LAST_FSTYPE_PAT, pattern, mnt_compile_fstype_pattern);
+	if (!pat)
+		return match_fstype(type, pattern);
+
+	rc = mnt_pattern_match_fstype(pat, type);
+	put_pattern(pat);
+	return rc;
 }
 
 
+static int match_options(const char *optstr, const char *pattern);
+
 /* Returns 1 if needle found or noneedle not found in haystack
  * Otherwise returns 0
  */
@@ -408,14 +672,29 @@ static int check_option(const char *haystack, size_t len,
  */
 int mnt_match_options(const char *optstr, const char *pattern)
 {
-	const char *p;
-	size_t len, optstr_len = 0;
+	struct libmnt_pattern *pat;
+	int rc;
 
 	if (!pattern && !optstr)
 		return 1;
 	if (!pattern)
 		return 0;
 
+	pat = get_pattern(LAST_OPTIONS_PAT, pattern, mnt_compile_options_pattern);
+	if (!pat)
+		return match_options(optstr, pattern);
+
+	rc = mnt_pattern_match_options(pat, optstr);
+	put_pattern(pat);
+	return rc;
+}
+
+/* not compiled version, used if the pattern is too long */
+static int match_options(const char *optstr, const char *pattern)
+{
+	const char *p;
+	size_t len, optstr_len = 0;
+
 	len = strlen(pattern);
 	if (optstr)
 		optstr_len = strlen(optstr);
@@ -485,7 +764,7 @@ err:
 	return -ENOMEM;
 }
 
-static int get_filesystems(const char *filename, char ***filesystems, const char *pattern)
+static int get_filesystems(const char *filename, char ***filesystems)
 {
 	int rc = 0;
 	FILE *f;
@@ -502,14 +781,12 @@ static int get_filesystems(const char *filename, char ***filesystems, const char
 
 		if (*line == '#' || strncmp(line, "nodev", 5) == 0)
 			continue;
-		if (sscanf(line, " %128[^\n ]\n", name) != 1)
+		if (sscanf(line, " %127[^\n ]\n", name) != 1)
 			continue;
 		if (strcmp(name, "*") == 0) {
 			rc = 1;
 			break;		/* end of the /etc/filesystems */
 		}
-		if (pattern && !mnt_match_fstype(name, pattern))
-			continue;
 		rc = add_filesystem(filesystems, name);
 		if (rc)
 			break;
@@ -520,8 +797,6 @@ static int get_filesystems(const char *filename, char ***filesystems, const char
 }
 
 /*
- * Always check the @filesystems pointer!
- *
  * man mount:
  *
  * ...mount will try to read the file /etc/filesystems, or, if that does not
@@ -530,26 +805,199 @@ static int get_filesystems(const char *filename, char ***filesystems, const char
  * proc  and  nfs).  If /etc/filesystems ends in a line with a single * only,
  * mount will read /proc/filesystems afterwards.
  */
-int mnt_get_filesystems(char ***filesystems, const char *pattern)
+static int read_filesystems(char ***filesystems, int *proc)
 {
 	int rc;
 
-	if (!filesystems)
-		return -EINVAL;
-
 	*filesystems = NULL;
+	*proc = 0;
 
-	rc = get_filesystems(_PATH_FILESYSTEMS, filesystems, pattern);
+	rc = get_filesystems(_PATH_FILESYSTEMS, filesystems);
 	if (rc != 1)
 		return rc;
 
-	rc = get_filesystems(_PATH_PROC_FILESYSTEMS, filesystems, pattern);
+	*proc = 1;
+	rc = get_filesystems(_PATH_PROC_FILESYSTEMS, filesystems);
 	if (rc == 1 && *filesystems)
 		rc = 0;			/* /proc/filesystems not found */
 
 	return rc;
 }
 
+#ifdef HAVE_TLS
+/*
+ * The parsed filesystems list is cached (per thread). The /etc/filesystems
+ * file is verified by stat(), but the /proc/filesystems mtime is not updated
+ * when a new filesystem is registered, so the content of the file is compared.
+ */
+struct fslist_cache {
+	char		**filesystems;	/* without pattern */
+
+	struct stat	etc_st;		/* /etc/filesystems */
+	unsigned int	etc_exists : 1,
+			proc : 1;	/* /proc/filesystems used */
+
+	char		*proc_data;	/* /proc/filesystems content */
+	size_t		proc_sz;
+};
+
+static __thread struct fslist_cache fslist;
+
+/* returns newly allocated content of the file, or NULL */
+static char *read_proc_filesystems(size_t *sz)
+{
+	size_t bufsz = 1024;
+	char *buf = NULL;
+	int fd;
+
+	fd = open(_PATH_PROC_FILESYSTEMS, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	do {
+		char *tmp;
+		ssize_t len;
+
+		bufsz *= 2;
+		tmp = realloc(buf, bufsz);
+		if (!tmp) {
+			free(buf);
+			buf = NULL;
+			break;
+		}
+		buf = tmp;
+		lseek(fd, 0, SEEK_SET);
+		len = read_all(fd, buf, bufsz);
+		if (len < 0) {
+			free(buf);
+			buf = NULL;
+			break;
+		}
+		*sz = len;
+	} while (*sz == bufsz);
+
+	close(fd);
+	return buf;
+}
+
+static int fslist_is_valid(struct fslist_cache *fc, char **data, size_t *sz)
+{
+	struct stat st;
+	int exists = stat(_PATH_FILESYSTEMS, &st) == 0;
+
+	if ((unsigned int) exists != fc->etc_exists)
+		return 0;
+	if (exists && (st.st_dev != fc->etc_st.st_dev ||
+		       st.st_ino != fc->etc_st.st_ino ||
+		       st.st_size != fc->etc_st.st_size ||
+		       st.st_mtime != fc->etc_st.st_mtime))
+		return 0;
+	if (!fc->proc)
+		return 1;
+
+	*data = read_proc_filesystems(sz);
+	return *data && fc->proc_data && *sz == fc->proc_sz &&
+	       memcmp(*data, fc->proc_data, *sz) == 0;
+}
+
+static int get_cached_filesystems(struct fslist_cache *fc)
+{
+	char *data = NULL;
+	size_t sz = 0;
+	int rc, proc, valid;
+
+	valid = fc->filesystems && fslist_is_valid(fc, &data, &sz);
+	free(data);
+	if (valid)
+		return 0;
+
+	DBG(UTILS, mnt_debug("filesystems list cache: refresh"));
+
+	mnt_free_filesystems(fc->filesystems);
+	free(fc->proc_data);
+	memset(fc, 0, sizeof(*fc));
+
+	if (stat(_PATH_FILESYSTEMS, &fc->etc_st) == 0)
+		fc->etc_exists = 1;
+
+	rc = read_filesystems(&fc->filesystems, &proc);
+	if (rc) {
+		fc->filesystems = NULL;		/* already deallocated */
+		return rc;
+	}
+	if (proc) {
+		fc->proc_data = read_proc_filesystems(&fc->proc_sz);
+		fc->proc = 1;
+	}
+	return 0;
+}
+#endif /* HAVE_TLS */
+
+/* copies the names which match @pattern */
+static int dup_filesystems(char **src, char ***filesystems, const char *pattern)
+{
+	size_t n = 0, i;
+	char **p;
+
+	*filesystems = NULL;
+	if (!src)
+		return 0;
+
+	for (p = src; *p; p++)
+		n++;
+	*filesystems = calloc(n + 1, sizeof(char *));
+	if (!*filesystems)
+		return -ENOMEM;
+
+	for (i = 0, p = src; *p; p++) {
+		if (pattern && !mnt_match_fstype(*p, pattern))
+			continue;
+		(*filesystems)[i] = strdup(*p);
+		if (!(*filesystems)[i++]) {
+			mnt_free_filesystems(*filesystems);
+			*filesystems = NULL;
+			return -ENOMEM;
+		}
+	}
+
+	if (!i) {
+		free(*filesystems);
+		*filesystems = NULL;
+	}
+	return 0;
+}
+
+/*
+ * Always check the @filesystems pointer! See read_filesystems() for more
+ * details about the lists.
+ */
+int mnt_get_filesystems(char ***filesystems, const char *pattern)
+{
+	int rc;
+
+	if (!filesystems)
+		return -EINVAL;
+
+	*filesystems = NULL;
+
+#ifdef HAVE_TLS
+	rc = get_cached_filesystems(&fslist);
+	if (!rc)
+		rc = dup_filesystems(fslist.filesystems, filesystems, pattern);
+#else
+	{
+		char **list = NULL;
+		int proc;
+
+		rc = read_filesystems(&list, &proc);
+		if (!rc)
+			rc = dup_filesystems(list, filesystems, pattern);
+		mnt_free_filesystems(list);
+	}
+#endif
+	return rc;
+}
+
 static size_t get_pw_record_size(void)
 {
 #ifdef _SC_GETPW_R_SIZE_MAX
@@ -70,6 +70,7 @@
 #endif
 #ifdef HAVE_SYS_UN_H
 #include <sys/un.h>
+#include <sys/mman.h>	/* uuidd shared memory */
 #endif
 #ifdef HAVE_SYS_SOCKIO_H
 #include <sys/sockio.h>
@@ -83,6 +84,9 @@
 #ifdef HAVE_NET_IF_DL_H
 #include <net/if_dl.h>
 #endif
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 #if defined(__linux__) && defined(HAVE_SYS_SYSCALL_H)
 #include <sys/syscall.h>
 #endif
@@ -91,6 +95,7 @@
 #include "uuidP.h"
 #include "uuidd.h"
 #include "randutils.h"
+#include "env.h"
 #include "c.h"
 
 #ifdef HAVE_TLS
@@ -213,6 +218,246 @@ static int get_node_id(unsigned char *node_id)
 /* Assume that the gettimeofday() has microsecond granularity */
 #define MAX_ADJUSTMENT 10
 
+/* 100ns intervals since the UUID epoch (15 Oct 1582) */
+static uint64_t timeval_to_clock_reg(const struct timeval *tv, int adjustment)
+{
+	uint64_t clock_reg;
+
+	clock_reg = tv->tv_usec*10 + adjustment;
+	clock_reg += ((uint64_t) tv->tv_sec)*10000000;
+	clock_reg += (((uint64_t) 0x01B21DD2) << 32) + 0x13814000;
+	return clock_reg;
+}
+
+/*
+ * Reads the clock state file, the file has to be locked by the caller.
+ * Returns 0 on success, -1 if the file is empty or corrupted.
+ */
+static int read_clock_state(FILE *state_f, uint16_t *clock_seq,
+			    struct timeval *last, int *adjustment)
+{
+	unsigned int cl;
+	unsigned long tv1, tv2;
+	int a;
+
+	rewind(state_f);
+	if (fscanf(state_f, "clock: %04x tv: %lu %lu adj: %d\n",
+		   &cl, &tv1, &tv2, &a) != 4)
+		return -1;
+
+	*clock_seq = cl & 0x3FFF;
+	last->tv_sec = tv1;
+	last->tv_usec = tv2;
+	*adjustment = a;
+	return 0;
+}
+
+/* Rewrites the clock state file, the file has to be locked by the caller. */
+static void write_clock_state(FILE *state_f, uint16_t clock_seq,
+			      const struct timeval *last, int adjustment)
+{
+	int len;
+
+	rewind(state_f);
+	len = fprintf(state_f,
+		      "clock: %04x tv: %016lu %08lu adj: %08d\n",
+		      clock_seq, last->tv_sec, last->tv_usec, adjustment);
+	fflush(state_f);
+	if (ftruncate(fileno(state_f), len) < 0) {
+		fprintf(state_f, "                   \n");
+		fflush(state_f);
+	}
+	rewind(state_f);
+}
+
+#if defined(HAVE_LIBPTHREAD) && defined(__GNUC__)
+/*
+ * In-process clock, enabled by LIBUUID_INPROCESS_CLOCK=1 environment variable.
+ *
+ * The default get_clock() locks, reads and rewrites the clock state file on
+ * each call, so all threads (and processes) serialize on the file lock. The
+ * in-process clock reads the file only once and then all threads share one
+ * 64-bit counter with the last used timestamp, updated by compare-and-swap.
+ *
+ * The process uses a private clock sequence (the file value + 1, the file is
+ * rewritten with + 2), so its UUIDs never collide with UUIDs generated by
+ * other processes although the timestamps are not synchronized by the file.
+ * The last timestamp is written back to the file every
+ * INPROCESS_CLOCK_SYNC seconds and at exit. The trade-off: after a crash the
+ * file may be behind the timestamps used by the process. It is harmless
+ * unless the 14-bit clock sequence wraps around (8192 in-process clocks
+ * started since) and the system time goes backward at the same time.
+ */
+#define USE_INPROCESS_CLOCK
+#define INPROCESS_CLOCK_SYNC	10	/* seconds */
+
+static struct {
+	volatile int	state;		/* 0: not initialized, 1: on, -1: off */
+	uint64_t	clock_reg;	/* the last used timestamp */
+	uint16_t	clock_seq;
+	int		ret;		/* -1 if the state file is not available */
+	FILE		*state_f;
+	time_t		synced;		/* the last write to the file */
+} inproc;
+
+static pthread_mutex_t inproc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int lock_clock_state(FILE *state_f)
+{
+	while (flock(fileno(state_f), LOCK_EX) < 0) {
+		if ((errno == EAGAIN) || (errno == EINTR))
+			continue;
+		return -1;
+	}
+	return 0;
+}
+
+/* Writes the last used timestamp to the file, the caller holds inproc_lock */
+static void inproc_clock_sync(void)
+{
+	struct timeval tv = { 0, 0 };
+	uint64_t clock_reg;
+	uint16_t clock_seq;
+	int adjustment = 0;
+
+	if (!inproc.state_f || lock_clock_state(inproc.state_f) != 0)
+		return;
+
+	clock_reg = __sync_fetch_and_add(&inproc.clock_reg, 0);
+
+	/* keep the clock sequence from the file, it's not ours */
+	if (read_clock_state(inproc.state_f, &clock_seq, &tv, &adjustment) != 0)
+		clock_seq = (inproc.clock_seq + 1) & 0x3FFF;
+
+	if (timeval_to_clock_reg(&tv, adjustment) < clock_reg) {
+		clock_reg -= (((uint64_t) 0x01B21DD2) << 32) + 0x13814000;
+		adjustment = clock_reg % 10;
+		tv.tv_usec = (clock_reg / 10) % 1000000;
+		tv.tv_sec = clock_reg / 10000000;
+		write_clock_state(inproc.state_f, clock_seq, &tv, adjustment);
+	}
+	flock(fileno(inproc.state_f), LOCK_UN);
+	inproc.synced = time(NULL);
+}
+
+static void inproc_clock_atexit(void)
+{
+	if (inproc.state <= 0)
+		return;
+	pthread_mutex_lock(&inproc_lock);
+	inproc_clock_sync();
+	pthread_mutex_unlock(&inproc_lock);
+}
+
+/* the child must not continue with the parent's clock sequence */
+static void inproc_clock_atfork_child(void)
+{
+	pthread_mutex_init(&inproc_lock, NULL);
+	if (inproc.state_f)
+		fclose(inproc.state_f);
+	inproc.state_f = NULL;
+	inproc.state = 0;
+}
+
+/* the caller holds inproc_lock */
+static void inproc_clock_init(void)
+{
+	static int registered;
+	struct timeval tv = { 0, 0 };
+	const char *str;
+	mode_t save_umask;
+	uint16_t clock_seq;
+	int fd, adjustment = 0;
+
+	str = safe_getenv("LIBUUID_INPROCESS_CLOCK");
+	if (!str || strcmp(str, "1") != 0) {
+		inproc.state = -1;
+		return;
+	}
+
+	save_umask = umask(0);
+	fd = open(LIBUUID_CLOCK_FILE, O_RDWR|O_CREAT|O_CLOEXEC, 0660);
+	(void) umask(save_umask);
+	if (fd >= 0) {
+		inproc.state_f = fdopen(fd, "r+" UL_CLOEXECSTR);
+		if (!inproc.state_f)
+			close(fd);
+	}
+	if (inproc.state_f && lock_clock_state(inproc.state_f) != 0) {
+		fclose(inproc.state_f);
+		inproc.state_f = NULL;
+	}
+	inproc.ret = inproc.state_f ? 0 : -1;
+
+	if (!inproc.state_f
+	    || read_clock_state(inproc.state_f, &clock_seq, &tv, &adjustment) != 0) {
+		random_get_bytes(&clock_seq, sizeof(clock_seq));
+		gettimeofday(&tv, 0);
+		adjustment = 0;
+	}
+
+	inproc.clock_seq = (clock_seq + 1) & 0x3FFF;
+	inproc.clock_reg = 0;
+
+	if (inproc.state_f) {
+		write_clock_state(inproc.state_f, (clock_seq + 2) & 0x3FFF,
+				  &tv, adjustment);
+		flock(fileno(inproc.state_f), LOCK_UN);
+	}
+	inproc.synced = time(NULL);
+
+	if (!registered) {
+		atexit(inproc_clock_atexit);
+		pthread_atfork(NULL, NULL, inproc_clock_atfork_child);
+		registered = 1;
+	}
+	inproc.state = 1;
+}
+
+static int use_inprocess_clock(void)
+{
+	if (inproc.state == 0) {
+		pthread_mutex_lock(&inproc_lock);
+		if (inproc.state == 0)
+			inproc_clock_init();
+		pthread_mutex_unlock(&inproc_lock);
+	}
+	return inproc.state > 0;
+}
+
+static int get_clock_inprocess(uint32_t *clock_high, uint32_t *clock_low,
+			       uint16_t *ret_clock_seq, int *num)
+{
+	struct timeval tv;
+	uint64_t now, last, next, n;
+
+	n = num && *num > 1 ? *num : 1;
+
+	gettimeofday(&tv, 0);
+	now = timeval_to_clock_reg(&tv, 0);
+
+	/* reserve <next, next + n - 1>; the counter never goes backward */
+	do {
+		last = inproc.clock_reg;
+		next = now > last ? now : last + 1;
+	} while (!__sync_bool_compare_and_swap(&inproc.clock_reg,
+					       last, next + n - 1));
+
+	if (tv.tv_sec >= inproc.synced + INPROCESS_CLOCK_SYNC
+	    && pthread_mutex_trylock(&inproc_lock) == 0) {
+		if (tv.tv_sec >= inproc.synced + INPROCESS_CLOCK_SYNC)
+			inproc_clock_sync();
+		pthread_mutex_unlock(&inproc_lock);
+	}
+
+	*clock_high = next >> 32;
+	*clock_low = next;
+	*ret_clock_seq = inproc.clock_seq;
+	return inproc.ret;
+}
+#endif /* USE_INPROCESS_CLOCK */
+
+
 /*
  * Get clock from global sequence clock counter.
  *
@@ -230,9 +475,13 @@ static int get_clock(uint32_t *clock_high, uint32_t *clock_low,
 	struct timeval			tv;
 	uint64_t			clock_reg;
 	mode_t				save_umask;
-	int				len;
 	int				ret = 0;
 
+#ifdef USE_INPROCESS_CLOCK
+	if (use_inprocess_clock())
+		return get_clock_inprocess(clock_high, clock_low,
+					   ret_clock_seq, num);
+#endif
 	if (state_fd == -2) {
 		save_umask = umask(0);
 		state_fd = open(LIBUUID_CLOCK_FILE, O_RDWR|O_CREAT|O_CLOEXEC, 0660);
@@ -260,19 +509,8 @@ static int get_clock(uint32_t *clock_high, uint32_t *clock_low,
 			break;
 		}
 	}
-	if (state_fd >= 0) {
-		unsigned int cl;
-		unsigned long tv1, tv2;
-		int a;
-
-		if (fscanf(state_f, "clock: %04x tv: %lu %lu adj: %d\n",
-			   &cl, &tv1, &tv2, &a) == 4) {
-			clock_seq = cl & 0x3FFF;
-			last.tv_sec = tv1;
-			last.tv_usec = tv2;
-			adjustment = a;
-		}
-	}
+	if (state_fd >= 0)
+		read_clock_state(state_f, &clock_seq, &last, &adjustment);
 
 	if ((last.tv_sec == 0) && (last.tv_usec == 0)) {
 		random_get_bytes(&clock_seq, sizeof(clock_seq));
@@ -299,9 +537,7 @@ try_again:
 		last = tv;
 	}
 
-	clock_reg = tv.tv_usec*10 + adjustment;
-	clock_reg += ((uint64_t) tv.tv_sec)*10000000;
-	clock_reg += (((uint64_t) 0x01B21DD2) << 32) + 0x13814000;
+	clock_reg = timeval_to_clock_reg(&tv, adjustment);
 
 	if (num && (*num > 1)) {
 		adjustment += *num - 1;
@@ -312,16 +548,7 @@ try_again:
 	}
 
 	if (state_fd >= 0) {
-		rewind(state_f);
-		len = fprintf(state_f,
-			      "clock: %04x tv: %016lu %08lu adj: %08d\n",
-			      clock_seq, last.tv_sec, last.tv_usec, adjustment);
-		fflush(state_f);
-		if (ftruncate(state_fd, len) < 0) {
-			fprintf(state_f, "                   \n");
-			fflush(state_f);
-		}
-		rewind(state_f);
+		write_clock_state(state_f, clock_seq, &last, adjustment);
 		flock(state_fd, LOCK_UN);
 	}
 
@@ -332,29 +559,148 @@ try_again:
 }
 
 #if defined(HAVE_UUIDD) && defined(HAVE_SYS_UN_H)
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+#ifndef SOCK_CLOEXEC
+# define SOCK_CLOEXEC 0
+#endif
+
 /*
- * Try using the uuidd daemon to generate the UUID
- *
- * Returns 0 on success, non-zero on failure.
+ * The connection to uuidd is persistent, every thread has its own connection
+ * (so no locking is necessary). The connection is closed when the thread
+ * exits and it's not shared with child processes after fork(). The socket is
+ * identified by dev/ino, the application may close the file descriptor and
+ * reuse the number for something else.
  */
-static int get_uuid_via_daemon(int op, uuid_t out, int *num)
+#if defined(HAVE_TLS) && defined(HAVE_LIBPTHREAD)
+# define UUIDD_PERSISTENT_CONNECTION
+THREAD_LOCAL int uuidd_fd = -1;
+THREAD_LOCAL dev_t uuidd_dev;
+THREAD_LOCAL ino_t uuidd_ino;
+THREAD_LOCAL pid_t uuidd_pid;
+
+static pthread_once_t uuidd_once = PTHREAD_ONCE_INIT;
+static pthread_key_t uuidd_key;
+static int uuidd_key_ok;
+
+static void uuidd_atfork_child(void)
+{
+	/* the child is a copy of the thread which called fork() */
+	if (uuidd_fd >= 0)
+		close(uuidd_fd);
+	uuidd_fd = -1;
+	if (uuidd_key_ok)
+		pthread_setspecific(uuidd_key, NULL);
+}
+
+static void uuidd_thread_exit(void *data)
+{
+	int fd = (int) (intptr_t) data - 1;
+	struct stat st;
+
+	if (fstat(fd, &st) == 0 && st.st_dev == uuidd_dev
+	    && st.st_ino == uuidd_ino)
+		close(fd);
+}
+
+static void uuidd_init_once(void)
+{
+	if (pthread_key_create(&uuidd_key, uuidd_thread_exit) == 0)
+		uuidd_key_ok = 1;
+	pthread_atfork(NULL, NULL, uuidd_atfork_child);
+}
+
+static void uuidd_set_fd(int fd)
+{
+	struct stat st;
+
+	if (fd >= 0 && fstat(fd, &st) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	if (fd >= 0) {
+		uuidd_dev = st.st_dev;
+		uuidd_ino = st.st_ino;
+		uuidd_pid = getpid();
+	}
+	uuidd_fd = fd;
+	/* the key value is fd + 1, NULL means no connection */
+	if (uuidd_key_ok)
+		pthread_setspecific(uuidd_key, (void *) (intptr_t) (fd + 1));
+}
+
+/* returns 1 if the cached file descriptor is still our connection to uuidd */
+static int uuidd_fd_is_valid(void)
+{
+	struct stat st;
+
+	if (uuidd_fd < 0)
+		return 0;
+
+	if (uuidd_pid != getpid()) {
+		/* forked without atfork handlers, the socket is shared */
+		close(uuidd_fd);
+		uuidd_set_fd(-1);
+		return 0;
+	}
+	if (fstat(uuidd_fd, &st) != 0 || !S_ISSOCK(st.st_mode)
+	    || st.st_dev != uuidd_dev || st.st_ino != uuidd_ino) {
+		/* closed (and maybe reused) by application, don't close */
+		uuidd_set_fd(-1);
+		return 0;
+	}
+	return 1;
+}
+#endif
+
+static int connect_daemon(void)
 {
-	char op_buf[64];
-	int op_len;
-	int s;
-	ssize_t ret;
-	int32_t reply_len = 0, expected = 16;
 	struct sockaddr_un srv_addr;
+	int s;
 
-	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	if ((s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
 		return -1;
 
 	srv_addr.sun_family = AF_UNIX;
 	strcpy(srv_addr.sun_path, UUIDD_SOCKET_PATH);
 
 	if (connect(s, (const struct sockaddr *) &srv_addr,
-		    sizeof(struct sockaddr_un)) < 0)
-		goto fail;
+		    sizeof(struct sockaddr_un)) < 0) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+static int call_daemon(int s, char *op_buf, int op_len, int32_t expected)
+{
+	int32_t reply_len = 0;
+	ssize_t ret;
+
+	ret = send(s, op_buf, op_len, MSG_NOSIGNAL);
+	if (ret != op_len)
+		return -1;
+
+	ret = read_all(s, (char *) &reply_len, sizeof(reply_len));
+	if (ret != sizeof(reply_len) || reply_len != expected)
+		return -1;
+
+	ret = read_all(s, op_buf, reply_len);
+	return ret == expected ? 0 : -1;
+}
+
+/*
+ * Try using the uuidd daemon to generate the UUID
+ *
+ * Returns 0 on success, non-zero on failure.
+ */
+static int get_uuid_via_daemon(int op, uuid_t out, int *num)
+{
+	char op_buf[64];
+	int op_len, rc, s;
+	int32_t expected = 16;
 
 	op_buf[0] = op;
 	op_len = 1;
@@ -364,30 +710,141 @@ static int get_uuid_via_daemon(int op, uuid_t out, int *num)
 		expected += sizeof(*num);
 	}
 
-	ret = write(s, op_buf, op_len);
-	if (ret < 1)
-		goto fail;
+#ifdef UUIDD_PERSISTENT_CONNECTION
+	pthread_once(&uuidd_once, uuidd_init_once);
 
-	ret = read_all(s, (char *) &reply_len, sizeof(reply_len));
-	if (ret < 0)
-		goto fail;
+	if (uuidd_fd_is_valid()) {
+		char req[5];
 
-	if (reply_len != expected)
-		goto fail;
+		memcpy(req, op_buf, op_len);
+		if (call_daemon(uuidd_fd, op_buf, op_len, expected) == 0)
+			goto done;
 
-	ret = read_all(s, op_buf, reply_len);
+		/* closed by daemon (restart or idle timeout), reconnect */
+		close(uuidd_fd);
+		uuidd_set_fd(-1);
+		memcpy(op_buf, req, op_len);
+	}
+#endif
+	s = connect_daemon();
+	if (s < 0)
+		return -1;
 
+	rc = call_daemon(s, op_buf, op_len, expected);
+#ifdef UUIDD_PERSISTENT_CONNECTION
+	if (rc == 0 && uuidd_key_ok)
+		uuidd_set_fd(s);
+	else
+#endif
+		close(s);
+	if (rc)
+		return -1;
+#ifdef UUIDD_PERSISTENT_CONNECTION
+done:
+#endif
+	/* number of UUIDs in the range reserved by uuidd */
 	if (op == UUIDD_OP_BULK_TIME_UUID)
-		memcpy(op_buf+16, num, sizeof(int));
+		memcpy(num, op_buf+16, sizeof(int));
 
 	memcpy(out, op_buf, 16);
+	return 0;
+}
 
-	close(s);
-	return ((ret == expected) ? 0 : -1);
+/*
+ * Maps the time UUID ranges published by uuidd --shm. The file is not
+ * available if the daemon does not use the shared memory, so try to open it
+ * once per second only. The file is trusted only if it's owned by the owner
+ * of the uuidd directory (or root) and it's not writable for others.
+ */
+static struct uuidd_shm *map_uuidd_shm(void)
+{
+	static struct uuidd_shm *shm;
+	static time_t last_try;
+	struct uuidd_shm *p;
+	struct stat st, dir;
+	time_t now;
+	int fd;
 
-fail:
-	close(s);
-	return -1;
+	if (shm)
+		return shm;
+
+	now = time(0);
+	if (now == last_try)
+		return NULL;
+	last_try = now;
+
+	fd = open(UUIDD_SHM_PATH, O_RDWR | O_CLOEXEC | O_NOFOLLOW);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(*p)
+	    || !S_ISREG(st.st_mode) || (st.st_mode & S_IWOTH)
+	    || stat(UUIDD_DIR, &dir) != 0
+	    || (st.st_uid != dir.st_uid && st.st_uid != 0)) {
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, sizeof(*p), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+	if (p->magic != UUIDD_SHM_MAGIC || p->nranges != UUIDD_SHM_RANGES
+	    || !__sync_bool_compare_and_swap(&shm, NULL, p))
+		munmap(p, sizeof(*p));
+	return shm;
+}
+
+/* adds @n to the 60-bit timestamp of the UUID */
+static void uuid_add_time(struct uuid *uu, uint32_t n)
+{
+	uint64_t t = ((uint64_t) (uu->time_hi_and_version & 0x0FFF) << 48) |
+		     ((uint64_t) uu->time_mid << 32) | uu->time_low;
+
+	t += n;
+	uu->time_low = t;
+	uu->time_mid = t >> 32;
+	uu->time_hi_and_version = (uu->time_hi_and_version & 0xF000) |
+				  ((t >> 48) & 0x0FFF);
+}
+
+/*
+ * Claims up to @num time UUIDs from the range published by uuidd in the
+ * shared memory, without a context switch to the daemon. The @num is updated
+ * to the number of the claimed UUIDs.
+ *
+ * Returns: 0 on success, -1 if the shared memory is not available or the
+ * current range is drained or expired.
+ */
+static int get_uuid_via_shm(uuid_t out, int *num)
+{
+	struct uuidd_shm *shm = map_uuidd_shm();
+	struct uuidd_shm_range *r;
+	struct uuid uu;
+	uuid_t first;
+	uint64_t claim;
+	uint32_t gen, used, n;
+
+	if (!shm)
+		return -1;
+	do {
+		claim = shm->claim;
+		gen = claim >> 32;
+		used = claim;
+		r = &shm->ranges[gen % UUIDD_SHM_RANGES];
+		__sync_synchronize();
+
+		if (r->gen != gen || used >= r->count || time(0) > r->time + 1)
+			return -1;
+		n = min((uint32_t) *num, r->count - used);
+		memcpy(first, r->uuid, sizeof(first));
+
+		/* the range is valid if the generation did not change */
+	} while (!__sync_bool_compare_and_swap(&shm->claim, claim, claim + n));
+
+	uuid_unpack(first, &uu);
+	uuid_add_time(&uu, used);
+	uuid_pack(&uu, out);
+	*num = n;
+	return 0;
 }
 
 #else /* !defined(HAVE_UUIDD) && defined(HAVE_SYS_UN_H) */
@@ -395,6 +852,11 @@ static int get_uuid_via_daemon(int op, uuid_t out, int *num)
 {
 	return -1;
 }
+
+static int get_uuid_via_shm(uuid_t out, int *num)
+{
+	return -1;
+}
 #endif
 
 int __uuid_generate_time(uuid_t out, int *num)
@@ -433,29 +895,53 @@ int __uuid_generate_time(uuid_t out, int *num)
  * or, if uuidd is not usable, by using the global clock state counter (see get_clock()).
  * If neither of these is possible (e.g. because of insufficient permissions), it generates
  * the UUID anyway, but returns -1. Otherwise, returns 0.
+ *
+ * The thread leases a range of UUIDS_PER_LEASE time UUIDs (from uuidd or from
+ * the clock state counter) and the next UUIDs are generated from the range
+ * without the daemon or the state file. The lease expires after one or two
+ * seconds to keep the timestamps close to the real time, and it's not used
+ * by a child process after fork().
  */
+#define UUIDS_PER_LEASE		1000
+
 static int uuid_generate_time_generic(uuid_t out) {
 #ifdef HAVE_TLS
 	THREAD_LOCAL int		num = 0;
 	THREAD_LOCAL struct uuid	uu;
 	THREAD_LOCAL time_t		last_time = 0;
+	THREAD_LOCAL int		lease_ret = 0;
+	THREAD_LOCAL pid_t		lease_pid = 0;
 	time_t				now;
+	pid_t				pid = getpid();
 
 	if (num > 0) {
 		now = time(0);
 		if (now > last_time+1)
 			num = 0;
+		/* the range is leased by the parent, don't copy it after fork */
+		else if (pid != lease_pid)
+			num = 0;
 	}
 	if (num <= 0) {
-		num = 1000;
-		if (get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID,
-					out, &num) == 0) {
+		lease_pid = pid;
+		num = UUIDS_PER_LEASE;
+		if (get_uuid_via_shm(out, &num) == 0 ||
+		    (get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID,
+					 out, &num) == 0 && num > 0)) {
 			last_time = time(0);
 			uuid_unpack(out, &uu);
+			lease_ret = 0;
 			num--;
 			return 0;
 		}
-		num = 0;
+
+		/* no uuidd, reserve the range in the clock state file */
+		num = UUIDS_PER_LEASE;
+		lease_ret = __uuid_generate_time(out, &num);
+		last_time = time(0);
+		uuid_unpack(out, &uu);
+		num--;
+		return lease_ret;
 	}
 	if (num > 0) {
 		uu.time_low++;
@@ -466,9 +952,13 @@ static int uuid_generate_time_generic(uuid_t out) {
 		}
 		num--;
 		uuid_pack(&uu, out);
-		return 0;
+		return lease_ret;
 	}
 #else
+	int num = 1;
+
+	if (get_uuid_via_shm(out, &num) == 0)
+		return 0;
 	if (get_uuid_via_daemon(UUIDD_OP_TIME_UUID, out, 0) == 0)
 		return 0;
 #endif
@@ -493,27 +983,43 @@ int uuid_generate_time_safe(uuid_t out)
 }
 
 
+/* random bytes are read in chunks of this number of UUIDs */
+#define UUIDS_PER_RANDOM_CHUNK	256
+
+/*
+ * Generates @n random UUIDs to the continuous buffer @out. The entropy is
+ * read in large chunks directly to @out and the version and variant bits are
+ * set in the place.
+ */
+static void generate_random_n(unsigned char *out, size_t n)
+{
+	while (n > 0) {
+		size_t i, chunk = min(n, (size_t) UUIDS_PER_RANDOM_CHUNK);
+
+		random_get_bytes(out, chunk * sizeof(uuid_t));
+
+		for (i = 0; i < chunk; i++) {
+			unsigned char *cp = out + i * sizeof(uuid_t);
+
+			cp[6] = (cp[6] & 0x0F) | 0x40;	/* version 4 */
+			cp[8] = (cp[8] & 0x3F) | 0x80;	/* DCE variant */
+		}
+		out += chunk * sizeof(uuid_t);
+		n -= chunk;
+	}
+}
+
 void __uuid_generate_random(uuid_t out, int *num)
 {
-	uuid_t	buf;
-	struct uuid uu;
-	int i, n;
+	int n;
 
 	if (!num || !*num)
 		n = 1;
 	else
 		n = *num;
 
-	for (i = 0; i < n; i++) {
-		random_get_bytes(buf, sizeof(buf));
-		uuid_unpack(buf, &uu);
-
-		uu.clock_seq = (uu.clock_seq & 0x3FFF) | 0x8000;
-		uu.time_hi_and_version = (uu.time_hi_and_version & 0x0FFF)
-			| 0x4000;
-		uuid_pack(&uu, out);
-		out += sizeof(uuid_t);
-	}
+	if (n > 0)
+		generate_random_n(out, n);
 }
 
 void uuid_generate_random(uuid_t out)
@@ -524,6 +1030,17 @@ void uuid_generate_random(uuid_t out)
 	__uuid_generate_random(out, &num);
 }
 
+/*
+ * Generates @n random-based UUIDs to the array @out. It's the same as
+ * uuid_generate_random() called @n times, but the entropy is read by large
+ * chunks.
+ */
+void uuid_generate_random_n(uuid_t *out, size_t n)
+{
+	if (out && n)
+		generate_random_n((unsigned char *) out, n);
+}
+
 /*
  * Check whether good random source (/dev/random or /dev/urandom)
  * is available.
@@ -32,48 +32,44 @@
  * %End-Header%
  */
 
-#include <stdlib.h>
-#include <stdio.h>
-#include <ctype.h>
 #include <string.h>
 
 #include "uuidP.h"
 
+/* value of the hex digit + 1, zero for invalid characters */
+static const unsigned char hexvals[256] = {
+	['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,
+	['5'] = 6,  ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16
+};
+
 int uuid_parse(const char *in, uuid_t uu)
 {
-	struct uuid	uuid;
-	int 		i;
-	const char	*cp;
-	char		buf[3];
+	const unsigned char *cp = (const unsigned char *) in;
+	unsigned int invalid = 0;
+	uuid_t buf;
+	int i;
 
 	if (strlen(in) != 36)
 		return -1;
-	for (i=0, cp = in; i <= 36; i++,cp++) {
-		if ((i == 8) || (i == 13) || (i == 18) ||
-		    (i == 23)) {
-			if (*cp == '-')
-				continue;
-			else
-				return -1;
-		}
-		if (i== 36)
-			if (*cp == 0)
-				continue;
-		if (!isxdigit(*cp))
-			return -1;
-	}
-	uuid.time_low = strtoul(in, NULL, 16);
-	uuid.time_mid = strtoul(in+9, NULL, 16);
-	uuid.time_hi_and_version = strtoul(in+14, NULL, 16);
-	uuid.clock_seq = strtoul(in+19, NULL, 16);
-	cp = in+24;
-	buf[2] = 0;
-	for (i=0; i < 6; i++) {
-		buf[0] = *cp++;
-		buf[1] = *cp++;
-		uuid.node[i] = strtoul(buf, NULL, 16);
+	if (in[8] != '-' || in[13] != '-' || in[18] != '-' || in[23] != '-')
+		return -1;
+
+	/* don't branch on every digit, check the result at the end */
+	for (i = 0; i < 16; i++) {
+		unsigned int hi, lo;
+
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			cp++;
+		hi = hexvals[*cp++];
+		lo = hexvals[*cp++];
+		invalid |= (hi == 0) | (lo == 0);
+		buf[i] = ((hi - 1) << 4) | (lo - 1);
 	}
+	if (invalid)
+		return -1;
 
-	uuid_pack(&uuid, uu);
+	memcpy(uu, buf, sizeof(buf));
 	return 0;
 }
@@ -0,0 +1,314 @@
+/*
+ * test_uuid_bench.c --- benchmark of the UUID library
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * Measures the throughput and per-call latency of the generate and
+ * (un)parse functions in more threads and processes. The result is printed
+ * as one line of KEY=value pairs for each test, for example:
+ *
+ *	test=time threads=4 processes=1 uuids=4000000 uuidd=1 \
+ *		ops_per_sec=33012345 p50_ns=30 p99_ns=71
+ *
+ * The latency includes clock_gettime() overhead.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "uuid.h"
+#include "uuidd.h"
+#include "c.h"
+
+struct bench_test {
+	const char	*name;
+	const char	*desc;
+	void		(*op)(void);
+};
+
+/* timestamps of one worker (thread), shared with the parent process */
+struct bench_worker {
+	uint64_t	start;
+	uint64_t	end;
+};
+
+struct bench {
+	const struct bench_test	*test;
+	size_t			count;		/* calls per worker */
+	int			nthreads;
+	int			nprocs;
+	int			uuidd;		/* daemon is running */
+
+	struct bench_worker	*workers;	/* nthreads * nprocs */
+	uint64_t		*lat;		/* latencies of all calls */
+};
+
+struct bench_thread {
+	struct bench	*bench;
+	size_t		idx;			/* worker index */
+};
+
+static char parse_str[37];
+static uuid_t unparse_uu;
+
+static void op_time(void)
+{
+	uuid_t uu;
+	uuid_generate_time(uu);
+}
+
+static void op_time_safe(void)
+{
+	uuid_t uu;
+	uuid_generate_time_safe(uu);
+}
+
+/* the clock state file, without uuidd and without leasing */
+static void op_time_local(void)
+{
+	uuid_t uu;
+	__uuid_generate_time(uu, NULL);
+}
+
+static void op_random(void)
+{
+	uuid_t uu;
+	uuid_generate_random(uu);
+}
+
+static void op_parse(void)
+{
+	uuid_t uu;
+	uuid_parse(parse_str, uu);
+}
+
+static void op_unparse(void)
+{
+	char str[37];
+	uuid_unparse(unparse_uu, str);
+}
+
+static const struct bench_test tests[] = {
+	{ "time",       "uuid_generate_time()",      op_time },
+	{ "time-safe",  "uuid_generate_time_safe()", op_time_safe },
+	{ "time-local", "clock state file only",     op_time_local },
+	{ "random",     "uuid_generate_random()",    op_random },
+	{ "parse",      "uuid_parse()",              op_parse },
+	{ "unparse",    "uuid_unparse()",            op_unparse }
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *bench_thread(void *data)
+{
+	struct bench_thread *th = (struct bench_thread *) data;
+	struct bench *b = th->bench;
+	struct bench_worker *wk = &b->workers[th->idx];
+	uint64_t *lat = b->lat + th->idx * b->count;
+	void (*op)(void) = b->test->op;
+	size_t i;
+
+	wk->start = now_ns();
+	for (i = 0; i < b->count; i++) {
+		uint64_t t = now_ns();
+
+		op();
+		lat[i] = now_ns() - t;
+	}
+	wk->end = now_ns();
+	return NULL;
+}
+
+static void bench_process(struct bench *b, int proc)
+{
+	pthread_t *tids = calloc(b->nthreads, sizeof(pthread_t));
+	struct bench_thread *ths = calloc(b->nthreads, sizeof(*ths));
+	int i;
+
+	if (!tids || !ths)
+		err(EXIT_FAILURE, "cannot allocate threads");
+
+	for (i = 0; i < b->nthreads; i++) {
+		ths[i].bench = b;
+		ths[i].idx = (size_t) proc * b->nthreads + i;
+		if (pthread_create(&tids[i], NULL, bench_thread, &ths[i]))
+			err(EXIT_FAILURE, "pthread_create failed");
+	}
+	for (i = 0; i < b->nthreads; i++)
+		pthread_join(tids[i], NULL);
+
+	free(tids);
+	free(ths);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* asks uuidd for its PID to check that the daemon is running */
+static int have_uuidd(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	char op = UUIDD_OP_GETPID;
+	int32_t len = 0;
+	int s, rc = 0;
+
+	s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0)
+		return 0;
+	strncpy(addr.sun_path, UUIDD_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+	if (connect(s, (struct sockaddr *) &addr, sizeof(addr)) == 0 &&
+	    write(s, &op, 1) == 1 &&
+	    read(s, &len, sizeof(len)) == sizeof(len))
+		rc = len > 0;
+	close(s);
+	return rc;
+}
+
+static void run_bench(struct bench *b)
+{
+	size_t nworkers = (size_t) b->nthreads * b->nprocs;
+	size_t total = nworkers * b->count, i;
+	size_t sz = nworkers * sizeof(struct bench_worker) +
+		    total * sizeof(uint64_t);
+	uint64_t start = UINT64_MAX, end = 0;
+	void *mem;
+	int p;
+
+	/* shared by all processes */
+	mem = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		err(EXIT_FAILURE, "cannot allocate %zu bytes", sz);
+	b->workers = mem;
+	b->lat = (uint64_t *) (b->workers + nworkers);
+
+	if (b->nprocs == 1)
+		bench_process(b, 0);
+	else {
+		for (p = 0; p < b->nprocs; p++) {
+			switch (fork()) {
+			case -1:
+				err(EXIT_FAILURE, "fork failed");
+			case 0:
+				bench_process(b, p);
+				_exit(EXIT_SUCCESS);
+			}
+		}
+		while (wait(NULL) > 0 || errno == EINTR)
+			;
+	}
+
+	for (i = 0; i < nworkers; i++) {
+		start = min(start, b->workers[i].start);
+		end = max(end, b->workers[i].end);
+	}
+	qsort(b->lat, total, sizeof(uint64_t), cmp_u64);
+
+	printf("test=%s threads=%d processes=%d uuids=%zu uuidd=%d "
+	       "ops_per_sec=%.0f p50_ns=%ju p99_ns=%ju\n",
+		b->test->name, b->nthreads, b->nprocs, total, b->uuidd,
+		end > start ? total * 1e9 / (end - start) : 0.0,
+		(uintmax_t) b->lat[total / 2],
+		(uintmax_t) b->lat[total * 99 / 100]);
+	fflush(stdout);
+
+	munmap(mem, sz);
+}
+
+static void __attribute__((__noreturn__)) usage(FILE *out)
+{
+	size_t i;
+
+	fprintf(out, "\nUsage:\n %s [options] [<test> ...]\n",
+			program_invocation_short_name);
+	fputs("\nOptions:\n"
+	      " -n, --count <num>      calls per thread (default 100000)\n"
+	      " -t, --threads <num>    threads per process (default 1)\n"
+	      " -p, --processes <num>  processes (default 1)\n"
+	      " -h, --help             display this help and exit\n", out);
+	fputs("\nTests (default all):\n", out);
+	for (i = 0; i < ARRAY_SIZE(tests); i++)
+		fprintf(out, " %-12s %s\n", tests[i].name, tests[i].desc);
+	exit(out == stderr ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench b = { .count = 100000, .nthreads = 1, .nprocs = 1 };
+	size_t i;
+	int c;
+
+	static const struct option longopts[] = {
+		{ "count",     required_argument, NULL, 'n' },
+		{ "threads",   required_argument, NULL, 't' },
+		{ "processes", required_argument, NULL, 'p' },
+		{ "help",      no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((c = getopt_long(argc, argv, "n:t:p:h", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			b.count = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			b.nthreads = atoi(optarg);
+			break;
+		case 'p':
+			b.nprocs = atoi(optarg);
+			break;
+		case 'h':
+			usage(stdout);
+		default:
+			usage(stderr);
+		}
+	}
+	if (!b.count || b.nthreads < 1 || b.nprocs < 1)
+		usage(stderr);
+
+	b.uuidd = have_uuidd();
+	uuid_generate(unparse_uu);
+	uuid_unparse(unparse_uu, parse_str);
+
+	if (optind == argc) {
+		for (i = 0; i < ARRAY_SIZE(tests); i++) {
+			b.test = &tests[i];
+			run_bench(&b);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	for ( ; optind < argc; optind++) {
+		for (i = 0; i < ARRAY_SIZE(tests); i++) {
+			if (strcmp(argv[optind], tests[i].name) == 0)
+				break;
+		}
+		if (i == ARRAY_SIZE(tests))
+			errx(EXIT_FAILURE, "%s: unknown test", argv[optind]);
+		b.test = &tests[i];
+		run_bench(&b);
+	}
+	return EXIT_SUCCESS;
+}
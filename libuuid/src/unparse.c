@@ -32,45 +32,45 @@
  * %End-Header%
  */
 
-#include <stdio.h>
-
 #include "uuidP.h"
 
-static const char *fmt_lower =
-	"%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x";
-
-static const char *fmt_upper =
-	"%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X";
+static const char *hexdigits_lower = "0123456789abcdef";
+static const char *hexdigits_upper = "0123456789ABCDEF";
 
 #ifdef UUID_UNPARSE_DEFAULT_UPPER
-#define FMT_DEFAULT fmt_upper
+#define HEXDIGITS_DEFAULT hexdigits_upper
 #else
-#define FMT_DEFAULT fmt_lower
+#define HEXDIGITS_DEFAULT hexdigits_lower
 #endif
 
-static void uuid_unparse_x(const uuid_t uu, char *out, const char *fmt)
+/*
+ * The UUID is stored in network byte order, so the string is just the bytes
+ * in the hex notation with the dashes after the 4th, 6th, 8th and 10th byte.
+ */
+static void uuid_unparse_x(const uuid_t uu, char *out, const char *hexdigits)
 {
-	struct uuid uuid;
+	int i;
 
-	uuid_unpack(uu, &uuid);
-	sprintf(out, fmt,
-		uuid.time_low, uuid.time_mid, uuid.time_hi_and_version,
-		uuid.clock_seq >> 8, uuid.clock_seq & 0xFF,
-		uuid.node[0], uuid.node[1], uuid.node[2],
-		uuid.node[3], uuid.node[4], uuid.node[5]);
+	for (i = 0; i < 16; i++) {
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			*out++ = '-';
+		*out++ = hexdigits[uu[i] >> 4];
+		*out++ = hexdigits[uu[i] & 0x0F];
+	}
+	*out = '\0';
 }
 
 void uuid_unparse_lower(const uuid_t uu, char *out)
 {
-	uuid_unparse_x(uu, out,	fmt_lower);
+	uuid_unparse_x(uu, out,	hexdigits_lower);
 }
 
 void uuid_unparse_upper(const uuid_t uu, char *out)
 {
-	uuid_unparse_x(uu, out,	fmt_upper);
+	uuid_unparse_x(uu, out,	hexdigits_upper);
 }
 
 void uuid_unparse(const uuid_t uu, char *out)
 {
-	uuid_unparse_x(uu, out, FMT_DEFAULT);
+	uuid_unparse_x(uu, out, HEXDIGITS_DEFAULT);
 }
@@ -78,6 +78,7 @@ void uuid_copy(uuid_t dst, const uuid_t src);
 /* gen_uuid.c */
 void uuid_generate(uuid_t out);
 void uuid_generate_random(uuid_t out);
+void uuid_generate_random_n(uuid_t *out, size_t n);
 void uuid_generate_time(uuid_t out);
 int uuid_generate_time_safe(uuid_t out);
 
@@ -35,10 +35,13 @@
 #ifndef _UUID_UUIDD_H
 #define _UUID_UUIDD_H
 
+#include <stdint.h>
+
 #define UUIDD_DIR		_PATH_LOCALSTATEDIR "/uuidd"
 #define UUIDD_SOCKET_PATH	UUIDD_DIR "/request"
 #define UUIDD_PIDFILE_PATH	UUIDD_DIR "/uuidd.pid"
 #define UUIDD_PATH		"/usr/sbin/uuidd"
+#define UUIDD_SHM_PATH		UUIDD_DIR "/time"
 
 #define UUIDD_OP_GETPID			0
 #define UUIDD_OP_GET_MAXOP		1
@@ -46,7 +49,35 @@
 #define UUIDD_OP_RANDOM_UUID		3
 #define UUIDD_OP_BULK_TIME_UUID		4
 #define UUIDD_OP_BULK_RANDOM_UUID	5
-#define UUIDD_MAX_OP			UUIDD_OP_BULK_RANDOM_UUID
+#define UUIDD_OP_GET_STATS		6
+#define UUIDD_MAX_OP			UUIDD_OP_GET_STATS
+
+/*
+ * Time UUID ranges published by uuidd --shm in UUIDD_SHM_PATH file. The daemon
+ * reserves the ranges by its clock, the clients claim UUIDs from the current
+ * range by compare-and-swap on @claim and call the daemon only if the range is
+ * drained or expired. The daemon writes a new range to the next slot and then
+ * publishes it by @claim, so the slot of the current generation is never
+ * modified while clients read it.
+ */
+#define UUIDD_SHM_MAGIC		0x75756964	/* "uuid" */
+#define UUIDD_SHM_RANGES	4		/* ring of ranges */
+#define UUIDD_SHM_RANGE_SIZE	10000		/* UUIDs in one range */
+
+struct uuidd_shm_range {
+	uint32_t	gen;		/* generation of the range */
+	uint32_t	count;		/* number of UUIDs */
+	int64_t		time;		/* time of the reservation */
+	unsigned char	uuid[16];	/* the first UUID of the range */
+};
+
+struct uuidd_shm {
+	uint32_t	magic;
+	uint32_t	nranges;
+	uint64_t	claim;		/* generation << 32 | claimed UUIDs */
+
+	struct uuidd_shm_range ranges[UUIDD_SHM_RANGES];
+};
 
 extern int __uuid_generate_time(uuid_t out, int *num);
 extern void __uuid_generate_random(uuid_t out, int *num);
@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/fcntl.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <stdio.h>
 #include <ctype.h>
@@ -49,6 +50,7 @@
 #include "carefulputc.h"
 #include "strutils.h"
 #include "timeutils.h"
+#include "xxhash.h"
 
 #if defined(_HAVE_UT_TV)
 # define UL_UT_TIME ut_tv.tv_sec
@@ -72,7 +74,9 @@
 # define LAST_TIMESTAMP_LEN 32
 #endif
 
-#define UCHUNKSIZE	16384	/* How much we read at once. */
+#define ULIST_HASHSZ	1024	/* Buckets of the pending logouts */
+#define DNS_HASHSZ	256	/* Buckets of the DNS lookups cache */
+#define SEEK_SLACK	512	/* Tolerated out-of-order wtmp records */
 
 struct last_control {
 	unsigned int lastb :1,	  /* Is this command 'lastb' */
@@ -99,13 +103,26 @@ struct last_control {
 	unsigned int time_fmt;	/* time format */
 };
 
-/* Double linked list of struct utmp's */
+/*
+ * Hash of the pending logout records by ut_line. Only the latest record
+ * for the line is kept: a login is matched with the latest logout on its
+ * line, and all the older records for the line are dropped.
+ */
 struct utmplist {
 	struct utmp ut;
-	struct utmplist *next;
-	struct utmplist *prev;
+	struct utmplist *next;	/* next in the bucket */
+};
+static struct utmplist *utmplist[ULIST_HASHSZ];
+static size_t utmplist_nents;
+
+/* Cache of dns_lookup() results */
+struct dnscache {
+	int32_t addr[4];
+	int rc;
+	char *result;
+	struct dnscache *next;
 };
-struct utmplist *utmplist = NULL;
+static struct dnscache *dnscache[DNS_HASHSZ];
 
 /* Types of listing */
 enum {
@@ -154,94 +171,89 @@ static int which_time_format(const char *optarg)
 	errx(EXIT_FAILURE, _("unknown time format: %s"), optarg);
 }
 
-/*
- *	Read one utmp entry, return in new format.
- *	Automatically reposition file pointer.
- */
-static int uread(const struct last_control *ctl, FILE *fp, struct utmp *u,
-		 int *quit)
+static unsigned int utmplist_hash(const char *line)
 {
-	static int utsize;
-	static char buf[UCHUNKSIZE];
-	char tmp[1024];
-	static off_t fpos;
-	static int bpos;
-	off_t o;
-
-	if (quit == NULL && u != NULL) {
-		/*
-		 *	Normal read.
-		 */
-		return fread(u, sizeof(struct utmp), 1, fp);
-	}
+	return xxhash64(0, line, strnlen(line, UT_LINESIZE)) % ULIST_HASHSZ;
+}
 
-	if (u == NULL) {
-		/*
-		 *	Initialize and position.
-		 */
-		utsize = sizeof(struct utmp);
-		fseeko(fp, 0, SEEK_END);
-		fpos = ftello(fp);
-		if (fpos == 0)
-			return 0;
-		o = ((fpos - 1) / UCHUNKSIZE) * UCHUNKSIZE;
-		if (fseeko(fp, o, SEEK_SET) < 0) {
-			warn(_("seek on %s failed"), ctl->altv[ctl->alti]);
-			return 0;
-		}
-		bpos = (int)(fpos - o);
-		if (fread(buf, bpos, 1, fp) != 1) {
-			warn(_("cannot read %s"), ctl->altv[ctl->alti]);
-			return 0;
-		}
-		fpos = o;
-		return 1;
-	}
+static struct utmplist **utmplist_find(const char *line)
+{
+	struct utmplist **pp = &utmplist[utmplist_hash(line)];
 
-	/*
-	 *	Read one struct. From the buffer if possible.
-	 */
-	bpos -= utsize;
-	if (bpos >= 0) {
-		memcpy(u, buf + bpos, sizeof(struct utmp));
-		return 1;
+	for (; *pp; pp = &(*pp)->next) {
+		if (strncmp((*pp)->ut.ut_line, line, UT_LINESIZE) == 0)
+			break;
 	}
+	return pp;
+}
 
-	/*
-	 *	Oops we went "below" the buffer. We should be able to
-	 *	seek back UCHUNKSIZE bytes.
-	 */
-	fpos -= UCHUNKSIZE;
-	if (fpos < 0)
-		return 0;
+/* adds the record, or replaces the older record for the line */
+static void utmplist_add(const struct utmp *ut)
+{
+	struct utmplist **pp = utmplist_find(ut->ut_line);
 
-	/*
-	 *	Copy whatever is left in the buffer.
-	 */
-	memcpy(tmp + (-bpos), buf, utsize + bpos);
-	if (fseeko(fp, fpos, SEEK_SET) < 0) {
-		warn(_("seek on %s failed"), ctl->altv[ctl->alti]);
-		return 0;
+	if (!*pp) {
+		*pp = xcalloc(1, sizeof(struct utmplist));
+		utmplist_nents++;
 	}
+	memcpy(&(*pp)->ut, ut, sizeof(struct utmp));
+}
 
-	/*
-	 *	Read another UCHUNKSIZE bytes.
-	 */
-	if (fread(buf, UCHUNKSIZE, 1, fp) != 1) {
-		warn(_("cannot read %s"), ctl->altv[ctl->alti]);
-		return 0;
+static void utmplist_del(struct utmplist **pp)
+{
+	struct utmplist *p = *pp;
+
+	*pp = p->next;
+	free(p);
+	utmplist_nents--;
+}
+
+static void utmplist_free(void)
+{
+	size_t i;
+
+	for (i = 0; utmplist_nents && i < ULIST_HASHSZ; i++) {
+		while (utmplist[i])
+			utmplist_del(&utmplist[i]);
 	}
+}
 
-	/*
-	 *	The end of the UCHUNKSIZE byte buffer should be the first
-	 *	few bytes of the current struct utmp.
-	 */
-	memcpy(tmp, buf + UCHUNKSIZE + bpos, -bpos);
-	bpos += UCHUNKSIZE;
+static time_t utmp_time_at(const char *data, off_t off)
+{
+	struct utmp ut;
 
-	memcpy(u, tmp, sizeof(struct utmp));
+	memcpy(&ut, data + off, sizeof(struct utmp));
+	return ut.UL_UT_TIME;
+}
 
-	return 1;
+/*
+ *	Returns offset of the last entry not newer than @until. The wtmp file
+ *	is ordered by time, except clock changes, so binary search is used and
+ *	the boundary is moved to the next entries if any of the SEEK_SLACK
+ *	following entries is not newer than @until.
+ */
+static off_t seek_until(const char *data, off_t size, time_t until)
+{
+	const off_t utsize = sizeof(struct utmp);
+	off_t lo, hi, n, i, base = size % utsize;
+
+	/* the first entry newer than @until (in entries from @base) */
+	n = size / utsize;
+	lo = 0, hi = n;
+	while (lo < hi) {
+		off_t mid = lo + (hi - lo) / 2;
+
+		if (utmp_time_at(data, base + mid * utsize) > until)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	for (i = hi; i < n && i < hi + SEEK_SLACK; i++) {
+		if (utmp_time_at(data, base + i * utsize) <= until)
+			hi = i + 1;
+	}
+	return base + (hi - 1) * utsize;
 }
 
 /*
@@ -315,6 +327,34 @@ static int dns_lookup(char *result, int size, int useip, int32_t *a)
 	return getnameinfo(sa, salen, result, size, NULL, 0, flags);
 }
 
+/*
+ *	Lookup a host with DNS, the results are cached. The same hosts are
+ *	usually in many records.
+ */
+static int dns_lookup_cached(char *result, int size, int useip, int32_t *a)
+{
+	unsigned int h = xxhash64(0, a, 4 * sizeof(int32_t)) % DNS_HASHSZ;
+	struct dnscache *dc;
+	char buf[256];
+
+	for (dc = dnscache[h]; dc; dc = dc->next) {
+		if (memcmp(dc->addr, a, sizeof(dc->addr)) == 0)
+			break;
+	}
+	if (!dc) {
+		dc = xcalloc(1, sizeof(*dc));
+		memcpy(dc->addr, a, sizeof(dc->addr));
+		dc->rc = dns_lookup(buf, sizeof(buf), useip, a);
+		if (dc->rc == 0)
+			dc->result = xstrdup(buf);
+		dc->next = dnscache[h];
+		dnscache[h] = dc;
+	}
+	if (dc->rc == 0)
+		xstrncpy(result, dc->result, size);
+	return dc->rc;
+}
+
 static int time_formatter(const struct last_control *ctl, char *dst,
 			  size_t dlen, time_t *when, int pos)
 {
@@ -484,7 +524,7 @@ static int list(const struct last_control *ctl, struct utmp *p, time_t t, int wh
 	 */
 	r = -1;
 	if (ctl->usedns || ctl->useip)
-		r = dns_lookup(domain, sizeof(domain), ctl->useip, p->ut_addr_v6);
+		r = dns_lookup_cached(domain, sizeof(domain), ctl->useip, p->ut_addr_v6);
 	if (r < 0) {
 		len = UT_HOSTSIZE;
 		if (len >= (int)sizeof(domain)) len = sizeof(domain) - 1;
@@ -575,11 +615,12 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 
 static void process_wtmp_file(const struct last_control *ctl)
 {
-	FILE *fp;		/* Filepointer of wtmp file */
+	int fd;			/* wtmp file */
+	char *data = NULL;	/* mmap()ed wtmp file */
+	off_t off = -1;		/* Offset of the current entry */
 
 	struct utmp ut;		/* Current utmp entry */
-	struct utmplist *p;	/* Pointer into utmplist */
-	struct utmplist *next;	/* Pointer into utmplist */
+	struct utmplist **pp;	/* Pointer into utmplist */
 
 	time_t lastboot = 0;	/* Last boottime */
 	time_t lastrch = 0;	/* Last run level change */
@@ -591,6 +632,7 @@ static void process_wtmp_file(const struct last_control *ctl)
 	struct stat st;		/* To stat the [uw]tmp file */
 	int quit = 0;		/* Flag */
 	int down = 0;		/* Down flag */
+	size_t older = 0;	/* Entries older than --since in row */
 
 	time(&lastdown);
 	lastrch = lastdown;
@@ -609,42 +651,54 @@ static void process_wtmp_file(const struct last_control *ctl)
 	/*
 	 * Open the utmp file
 	 */
-	if ((fp = fopen(ctl->altv[ctl->alti], "r")) == NULL)
+	if ((fd = open(ctl->altv[ctl->alti], O_RDONLY)) < 0)
 		err(EXIT_FAILURE, _("cannot open %s"), ctl->altv[ctl->alti]);
+	if (fstat(fd, &st) != 0)
+		err(EXIT_FAILURE, _("stat failed %s"), ctl->altv[ctl->alti]);
 
 	/*
-	 * Optimize the buffer size.
+	 * Map the whole file, the entries are read backwards from the end
+	 * of the file.
 	 */
-	setvbuf(fp, NULL, _IOFBF, UCHUNKSIZE);
+	if (st.st_size >= (off_t) sizeof(struct utmp)) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			warn(_("cannot read %s"), ctl->altv[ctl->alti]);
+			data = NULL;
+		} else {
+			off = st.st_size - sizeof(struct utmp);
+			if (ctl->until)
+				off = seek_until(data, st.st_size, ctl->until);
+			else if (!ctl->since)
+				posix_madvise(data, st.st_size, POSIX_MADV_WILLNEED);
+		}
+	}
 
 	/*
 	 * Read first structure to capture the time field
 	 */
-	if (uread(ctl, fp, &ut, NULL) == 1)
+	if (data) {
+		memcpy(&ut, data, sizeof(struct utmp));
 		begintime = ut.UL_UT_TIME;
-	else {
-		if (fstat(fileno(fp), &st) != 0)
-			err(EXIT_FAILURE, _("stat failed %s"), ctl->altv[ctl->alti]);
+	} else {
 		begintime = st.st_ctime;
 		quit = 1;
 	}
 
-	/*
-	 * Go to end of file minus one structure
-	 * and/or initialize utmp reading code.
-	 */
-	uread(ctl, fp, NULL, NULL);
-
 	/*
 	 * Read struct after struct backwards from the file.
 	 */
-	while (!quit) {
+	for ( ; !quit && off >= 0; off -= sizeof(struct utmp)) {
 
-		if (uread(ctl, fp, &ut, &quit) != 1)
-			break;
+		memcpy(&ut, data + off, sizeof(struct utmp));
 
-		if (ctl->since && ut.UL_UT_TIME < ctl->since)
+		if (ctl->since && ut.UL_UT_TIME < ctl->since) {
+			/* the rest of the file is older (except clock changes) */
+			if (++older >= SEEK_SLACK)
+				break;
 			continue;
+		}
+		older = 0;
 
 		if (ctl->until && ctl->until < ut.UL_UT_TIME)
 			continue;
@@ -741,22 +795,11 @@ static void process_wtmp_file(const struct last_control *ctl)
 			 * the same ut_line.
 			 */
 			c = 0;
-			for (p = utmplist; p; p = next) {
-				next = p->next;
-				if (strncmp(p->ut.ut_line, ut.ut_line,
-				    UT_LINESIZE) == 0) {
-					/* Show it */
-					if (c == 0) {
-						quit = list(ctl, &ut, p->ut.UL_UT_TIME, R_NORMAL);
-						c = 1;
-					}
-					if (p->next) p->next->prev = p->prev;
-					if (p->prev)
-						p->prev->next = p->next;
-					else
-						utmplist = p->next;
-					free(p);
-				}
+			pp = utmplist_find(ut.ut_line);
+			if (*pp) {
+				quit = list(ctl, &ut, (*pp)->ut.UL_UT_TIME, R_NORMAL);
+				utmplist_del(pp);
+				c = 1;
 			}
 			/*
 			 * Not found? Then crashed, down, still
@@ -783,12 +826,7 @@ static void process_wtmp_file(const struct last_control *ctl)
 			 */
 			if (ut.ut_line[0] == 0)
 				break;
-			p = xmalloc(sizeof(struct utmplist));
-			memcpy(&p->ut, &ut, sizeof(struct utmp));
-			p->next  = utmplist;
-			p->prev  = NULL;
-			if (utmplist) utmplist->prev = p;
-			utmplist = p;
+			utmplist_add(&ut);
 			break;
 
 		case EMPTY:
@@ -809,21 +847,16 @@ static void process_wtmp_file(const struct last_control *ctl)
 		if (down) {
 			lastboot = ut.UL_UT_TIME;
 			whydown = (ut.ut_type == SHUTDOWN_TIME) ? R_DOWN : R_CRASH;
-			for (p = utmplist; p; p = next) {
-				next = p->next;
-				free(p);
-			}
-			utmplist = NULL;
+			utmplist_free();
 			down = 0;
 		}
 	}
 
 	printf(_("\n%s begins %s"), basename(ctl->altv[ctl->alti]), ctime(&begintime));
-	fclose(fp);
-	for (p = utmplist; p; p = next) {
-		next = p->next;
-		free(p);
-	}
+	if (data)
+		munmap(data, st.st_size);
+	close(fd);
+	utmplist_free();
 }
 
 int main(int argc, char **argv)
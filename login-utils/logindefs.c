@@ -38,12 +38,28 @@
 struct item {
 	char *name;		/* name of the option.  */
 	char *value;		/* value of the option.  */
-	char *path;		/* name of config file for this option.  */
+	const char *path;	/* name of config file for this option.  */
 
 	struct item *next;	/* pointer to next option.  */
+	struct item *hnext;	/* next option in the same hash bucket.  */
 };
 
+struct itempath {
+	struct itempath *next;
+	char name[];
+};
+
+#define LOGINDEFS_HASHSZ	64
+
+/*
+ * All options are in the list (the last stored is the first), and in the
+ * hash table for search(). The newer option overrides the older one with
+ * the same name, so both are always prepended.
+ */
 static struct item *list = NULL;
+static struct item *hash[LOGINDEFS_HASHSZ];
+static struct itempath *paths = NULL;
+static int defaults_loaded;
 
 void (*logindefs_load_defaults)(void) = NULL;
 
@@ -55,34 +71,69 @@ void free_getlogindefs_data(void)
 	while (ptr) {
 		struct item *tmp = ptr->next;
 
-		free(ptr->path);
 		free(ptr->name);
 		free(ptr->value);
 		free(ptr);
 		ptr = tmp;
 	}
+	while (paths) {
+		struct itempath *tmp = paths->next;
+
+		free(paths);
+		paths = tmp;
+	}
 
 	list = NULL;
+	memset(hash, 0, sizeof(hash));
+	defaults_loaded = 0;
+}
+
+/* the option names are case insensitive */
+static unsigned int hash_name(const char *name)
+{
+	unsigned int h = 5381;
+
+	for (; *name; name++)
+		h = h * 33 + tolower((unsigned char) *name);
+	return h % LOGINDEFS_HASHSZ;
 }
 
 static void store(const char *name, const char *value, const char *path)
 {
 	struct item *new = xmalloc(sizeof(struct item));
+	unsigned int h;
 
 	if (!name)
 		abort();
 
 	new->name = xstrdup(name);
 	new->value = value && *value ? xstrdup(value) : NULL;
-	new->path = xstrdup(path);
+	new->path = path;
 	new->next = list;
 	list = new;
+
+	h = hash_name(name);
+	new->hnext = hash[h];
+	hash[h] = new;
+}
+
+/* the file name is shared by all options from the file */
+static const char *store_path(const char *filename)
+{
+	size_t sz = strlen(filename) + 1;
+	struct itempath *p = xmalloc(sizeof(struct itempath) + sz);
+
+	memcpy(p->name, filename, sz);
+	p->next = paths;
+	paths = p;
+	return p->name;
 }
 
 void logindefs_load_file(const char *filename)
 {
 	FILE *f;
 	char buf[BUFSIZ];
+	const char *path = NULL;
 
 	f = fopen(filename, "r");
 	if (!f)
@@ -135,7 +186,9 @@ void logindefs_load_file(const char *filename)
 		while (p > data && (isspace((unsigned)*p) || *p == '"'))
 			*p-- = '\0';
 
-		store(name, data, filename);
+		if (!path)
+			path = store_path(filename);
+		store(name, data, path);
 	}
 
 	fclose(f);
@@ -153,28 +206,15 @@ static struct item *search(const char *name)
 {
 	struct item *ptr;
 
-	if (!list)
+	/* try the defaults only once, the files may be empty or missing */
+	if (!list && !defaults_loaded) {
+		defaults_loaded = 1;
 		load_defaults();
-
-	ptr = list;
-	while (ptr != NULL) {
-		if (strcasecmp(name, ptr->name) == 0)
-			return ptr;
-		ptr = ptr->next;
 	}
 
-	return NULL;
-}
-
-static const char *search_config(const char *name)
-{
-	struct item *ptr;
-
-	ptr = list;
-	while (ptr != NULL) {
+	for (ptr = hash[hash_name(name)]; ptr; ptr = ptr->hnext) {
 		if (strcasecmp(name, ptr->name) == 0)
-			return ptr->path;
-		ptr = ptr->next;
+			return ptr;
 	}
 
 	return NULL;
@@ -201,7 +241,7 @@ unsigned long getlogindefs_num(const char *name, long dflt)
 		return retval;
 
 	syslog(LOG_NOTICE, _("%s: %s contains invalid numerical value: %s"),
-	       search_config(name), name, ptr->value);
+	       ptr->path, name, ptr->value);
 	return dflt;
 }
 
@@ -53,6 +53,7 @@ enum
 #include <security/pam_misc.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 #include <syslog.h>
 #include <utmp.h>
 
@@ -83,6 +84,12 @@ enum
 #include "logindefs.h"
 #include "su-common.h"
 
+enum
+{
+  NO_PAM_SESSION_OPTION = CHAR_MAX + 1,
+  TIMING_OPTION
+};
+
 /* The shell to run if none is given in the user's passwd entry.  */
 #define DEFAULT_SHELL "/bin/sh"
 
@@ -114,6 +121,14 @@ static int su_mode;
 /* Don't print PAM info messages (Last login, etc.). */
 static int suppress_pam_info;
 
+/* If true, don't open PAM session and don't keep the parent process
+   (runuser --no-pam-session). */
+static bool no_pam_session;
+
+/* If true, print duration of the setup phases (--timing). */
+static bool print_timing;
+static struct timeval timing_start, timing_last;
+
 static bool _pam_session_opened;
 static bool _pam_cred_established;
 static sig_atomic_t volatile caught_signal = false;
@@ -246,6 +261,34 @@ cleanup_pam (int retcode)
   errno = saved_errno;
 }
 
+/* Print time spent since the previous phase and since start on stderr.  */
+static void
+timing_phase (const char *name)
+{
+  struct timeval now, phase, total;
+
+  if (!print_timing)
+    return;
+
+  gettimeofday (&now, NULL);
+  if (!name)
+    {
+      timing_start = timing_last = now;
+      return;
+    }
+
+  timersub (&now, &timing_last, &phase);
+  timersub (&now, &timing_start, &total);
+  timing_last = now;
+
+  fprintf (stderr, _("%s: timing: %-14s %6ld.%03ld ms (total %ld.%03ld ms)\n"),
+	   program_invocation_short_name, name,
+	   (long) (phase.tv_sec * 1000 + phase.tv_usec / 1000),
+	   (long) (phase.tv_usec % 1000),
+	   (long) (total.tv_sec * 1000 + total.tv_usec / 1000),
+	   (long) (total.tv_usec % 1000));
+}
+
 /* Signal handler for parent process.  */
 static void
 su_catch_sig (int sig)
@@ -681,6 +724,8 @@ usage (int status)
     fputs(USAGE_OPTIONS, stdout);
 
     fputs (_(" -u, --user <user>             username\n"), stdout);
+    fputs (_("     --no-pam-session          do not open PAM session, run the command\n"
+             "                                 directly without the parent process\n"), stdout);
 
   } else {
     fputs(USAGE_HEADER, stdout);
@@ -702,6 +747,7 @@ usage (int status)
            "                                   and do not create a new session\n"), stdout);
   fputs (_(" -f, --fast                      pass -f to the shell (for csh or tcsh)\n"), stdout);
   fputs (_(" -s, --shell <shell>             run <shell> if /etc/shells allows it\n"), stdout);
+  fputs (_("     --timing                    print duration of the setup phases\n"), stdout);
 
   fputs(USAGE_SEPARATOR, stdout);
   fputs(USAGE_HELP, stdout);
@@ -763,6 +809,8 @@ su_main (int argc, char **argv, int mode)
     {"group", required_argument, NULL, 'g'},
     {"supp-group", required_argument, NULL, 'G'},
     {"user", required_argument, NULL, 'u'},		/* runuser only */
+    {"no-pam-session", no_argument, NULL, NO_PAM_SESSION_OPTION}, /* runuser only */
+    {"timing", no_argument, NULL, TIMING_OPTION},
     {"help", no_argument, 0, 'h'},
     {"version", no_argument, 0, 'V'},
     {NULL, 0, NULL, 0}
@@ -836,6 +884,16 @@ su_main (int argc, char **argv, int mode)
 	  runuser_user = optarg;
 	  break;
 
+	case NO_PAM_SESSION_OPTION:
+	  if (su_mode != RUNUSER_MODE)
+	    usage (EXIT_FAILURE);
+	  no_pam_session = true;
+	  break;
+
+	case TIMING_OPTION:
+	  print_timing = true;
+	  break;
+
 	case 'h':
 	  usage(0);
 
@@ -848,6 +906,7 @@ su_main (int argc, char **argv, int mode)
 	}
     }
 
+  timing_phase (NULL);
   restricted = evaluate_uid ();
 
   if (optind < argc && !strcmp (argv[optind], "-"))
@@ -922,7 +981,10 @@ su_main (int argc, char **argv, int mode)
     num_supp_groups++;
   }
 
+  timing_phase (_("user lookup"));
+
   authenticate (pw);
+  timing_phase (_("authenticate"));
 
   if (request_same_session || !command || !pw->pw_uid)
     same_session = 1;
@@ -946,12 +1008,17 @@ su_main (int argc, char **argv, int mode)
   }
 
   init_groups (pw, groups, num_supp_groups);
+  timing_phase (_("groups"));
 
   if (!simulate_login || command)
     suppress_pam_info = 1;		/* don't print PAM info messages */
 
-  create_watching_parent ();
-  /* Now we're in the child.  */
+  if (!no_pam_session)
+    {
+      create_watching_parent ();
+      /* Now we're in the child.  */
+      timing_phase (_("session"));
+    }
 
   change_identity (pw);
   if (!same_session)
@@ -965,6 +1032,8 @@ su_main (int argc, char **argv, int mode)
   if (simulate_login && chdir (pw->pw_dir) != 0)
     warn (_("warning: cannot change directory to %s"), pw->pw_dir);
 
+  timing_phase (_("environment"));
+
   if (shell)
     run_shell (shell, command, argv + optind, max (0, argc - optind));
   else {
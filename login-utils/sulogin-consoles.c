@@ -267,6 +267,31 @@ char* scandev(DIR *dir, dev_t comparedev)
 	return name;
 }
 
+/*
+ * The kernel usually knows the name of the device, so try /dev/<name> before
+ * the expensive scan of the whole /dev directory.
+ */
+static
+#ifdef __GNUC__
+__attribute__((__nonnull__(1),__malloc__))
+#endif
+char *console_device(DIR *dir, const char *name, dev_t comparedev)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (name && *name && strchr(name, '/') == NULL &&
+	    (size_t) snprintf(path, sizeof(path), "/dev/%s", name) < sizeof(path) &&
+	    stat(path, &st) == 0 && S_ISCHR(st.st_mode) &&
+	    st.st_rdev == comparedev) {
+		DBG(dbgprint("found %s for %u:%u", path,
+				major(comparedev), minor(comparedev)));
+		return canonicalize_path(path);
+	}
+
+	return scandev(dir, comparedev);
+}
+
 /*
  * Default control characters for an unknown terminal line.
  */
@@ -321,7 +346,7 @@ int append_console(struct list_head *consoles, const char *name)
  */
 static int detect_consoles_from_proc(struct list_head *consoles)
 {
-	char fbuf[16 + 1];
+	char fbuf[16 + 1], tty[64 + 1];
 	DIR *dir = NULL;
 	FILE *fc = NULL;
 	int maj, min, rc = 1;
@@ -337,14 +362,14 @@ static int detect_consoles_from_proc(struct list_head *consoles)
 	if (!dir)
 		goto done;
 
-	while (fscanf(fc, "%*s %*s (%16[^)]) %d:%d", fbuf, &maj, &min) == 3) {
+	while (fscanf(fc, "%64s %*s (%16[^)]) %d:%d", tty, fbuf, &maj, &min) == 4) {
 		char *name;
 		dev_t comparedev;
 
 		if (!strchr(fbuf, 'E'))
 			continue;
 		comparedev = makedev(maj, min);
-		name = scandev(dir, comparedev);
+		name = console_device(dir, tty, comparedev);
 		if (!name)
 			continue;
 		rc = append_console(consoles, name);
@@ -391,7 +416,7 @@ static int detect_consoles_from_sysfs(struct list_head *consoles)
 		goto done;
 
 	while ((token = strsep(&words, " \t\r\n"))) {
-		char *name;
+		char *name, *active = NULL;
 		dev_t comparedev;
 
 		if (*token == '\0')
@@ -399,14 +424,14 @@ static int detect_consoles_from_sysfs(struct list_head *consoles)
 
 		comparedev = devattr(token);
 		if (comparedev == makedev(TTY_MAJOR, 0)) {
-			char *tmp = actattr(token);
-			if (!tmp)
+			active = actattr(token);
+			if (!active)
 				continue;
-			comparedev = devattr(tmp);
-			free(tmp);
+			comparedev = devattr(active);
 		}
 
-		name = scandev(dir, comparedev);
+		name = console_device(dir, active ? active : token, comparedev);
+		free(active);
 		if (!name)
 			continue;
 		rc = append_console(consoles, name);
@@ -494,7 +519,7 @@ static int detect_consoles_from_cmdline(struct list_head *consoles)
 #endif
 		close(fd);
 
-		name = scandev(dir, comparedev);
+		name = console_device(dir, token, comparedev);
 		if (!name)
 			continue;
 		rc = append_console(consoles, name);
@@ -773,6 +773,7 @@ int main(int argc, char **argv)
 	int c, status = 0;
 	int reconnect = 0;
 	int opt_e = 0;
+	int nconsoles;
 	pid_t pid;
 
 	static const struct option longopts[] = {
@@ -881,43 +882,54 @@ int main(int argc, char **argv)
 	}
 
 	/*
-	 * Ask for the password on the consoles.
+	 * Ask for the password on the consoles. The open() is non-blocking,
+	 * but the terminal setup (tcinit()) may hang on a broken line, so it's
+	 * done in the child processes and all consoles are initialized
+	 * at the same time. The consoles which cannot be opened are ignored.
 	 */
+	nconsoles = 0;
 	list_for_each(ptr, &consoles) {
 		con = list_entry(ptr, struct console, entry);
 		if (con->id >= CONMAX)
 			break;
-		if (con->fd >= 0) {
-			openfd |= (1 << con->fd);
-			tcinit(con);
-			continue;
-		}
-		if ((con->fd = open(con->tty, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0)
+		if (con->fd < 0)
+			con->fd = open(con->tty, O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if (con->fd < 0)
 			continue;
 		openfd |= (1 << con->fd);
-		tcinit(con);
+		nconsoles++;
 	}
-	ptr = (&consoles)->next;
 	usemask = (uint32_t*) mmap(NULL, sizeof(uint32_t),
 					PROT_READ|PROT_WRITE,
 					MAP_ANONYMOUS|MAP_SHARED, -1, 0);
 
-	if (ptr->next == &consoles) {
-		con = list_entry(ptr, struct console, entry);
+	if (nconsoles <= 1) {
+		/* the only console (or the first one if nothing is usable) */
+		list_for_each(ptr, &consoles) {
+			con = list_entry(ptr, struct console, entry);
+			if (con->fd >= 0)
+				break;
+		}
+		if (ptr == &consoles)
+			con = list_entry(consoles.next, struct console, entry);
 		goto nofork;
 	}
 
 	mask_signal(SIGCHLD, chld_handler, &saved_sigchld);
-	do {
+	list_for_each(ptr, &consoles) {
 		con = list_entry(ptr, struct console, entry);
 		if (con->id >= CONMAX)
 			break;
+		if (con->fd < 0)
+			continue;
 
 		switch ((con->pid = fork())) {
 		case 0:
 			mask_signal(SIGCHLD, SIG_DFL, NULL);
 			/* fall through */
 		nofork:
+			if (con->fd >= 0)
+				tcinit(con);
 			setup(con);
 			while (1) {
 				const char *passwd = pwd->pw_passwd;
@@ -970,10 +982,7 @@ int main(int argc, char **argv)
 		default:
 			break;
 		}
-
-		ptr = ptr->next;
-
-	} while (ptr != &consoles);
+	}
 
 	while ((pid = wait(&status))) {
 		if (errno == ECHILD)
@@ -982,6 +991,8 @@ int main(int argc, char **argv)
 			continue;
 		list_for_each(ptr, &consoles) {
 			con = list_entry(ptr, struct console, entry);
+			if (con->pid <= 0)
+				continue;	/* not used console */
 			if (con->pid == pid) {
 				*usemask &= ~(1<<con->id);
 				continue;
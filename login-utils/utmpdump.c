@@ -44,35 +44,172 @@
 #include "nls.h"
 #include "xalloc.h"
 #include "closestream.h"
+#include "strutils.h"
 
-static char *timetostr(const time_t time)
+enum {
+	OUT_TEXT = 0,
+	OUT_JSON,
+	OUT_CSV
+};
+
+static int outfmt = OUT_TEXT;
+
+#define UTBLOCK		256		/* records read at once */
+#define OUTBUFSZ	(64 * 1024)
+#define UTLINE_MAX	2048		/* max length of one output line */
+
+static char outbuf[OUTBUFSZ];
+static size_t outlen;
+
+static void flush_output(FILE *out)
 {
-	static char s[29];	/* [Sun Sep 01 00:00:00 1998 PST] */
+	if (outlen)
+		ignore_result( fwrite(outbuf, 1, outlen, out) );
+	outlen = 0;
+}
 
-	if (time != 0)
-		strftime(s, 29, "%a %b %d %T %Y %Z", localtime(&time));
-	else
+/*
+ * The offset from UTC is the same for all the hour in almost all cases,
+ * the broken-down time is cached for the hour of the last converted time.
+ */
+struct timecache {
+	time_t	start;		/* cached interval */
+	time_t	end;
+	int	secs;		/* seconds from the begin of the hour at @start */
+
+	char	text_pre[24];	/* "Sun Sep 01 00:" */
+	char	text_suf[24];	/* " 1998 PST" */
+	char	iso_pre[24];	/* "1998-09-01T00:" */
+	char	iso_suf[16];	/* "-08:00" */
+};
+
+static struct timecache tcache;
+
+static void timecache_fill(struct timecache *tc, time_t t)
+{
+	struct tm tm, end;
+	time_t start, last;
+	int off;
+
+	memset(tc, 0, sizeof(*tc));
+	if (!localtime_r(&t, &tm))
+		return;
+
+	start = t - tm.tm_min * 60 - tm.tm_sec;
+	last = start + 3599;
+
+	if (localtime_r(&last, &end) && end.tm_hour == tm.tm_hour &&
+	    end.tm_gmtoff == tm.tm_gmtoff && end.tm_isdst == tm.tm_isdst) {
+		tc->start = start;
+		tc->end = start + 3600;
+	} else {
+		/* offset changed within the hour, cache this second only */
+		tc->start = t;
+		tc->end = t + 1;
+		tc->secs = tm.tm_min * 60 + tm.tm_sec;
+	}
+
+	strftime(tc->text_pre, sizeof(tc->text_pre), "%a %b %d %H:", &tm);
+	strftime(tc->text_suf, sizeof(tc->text_suf), " %Y %Z", &tm);
+	strftime(tc->iso_pre, sizeof(tc->iso_pre), "%Y-%m-%dT%H:", &tm);
+
+	off = tm.tm_gmtoff / 60;
+	snprintf(tc->iso_suf, sizeof(tc->iso_suf), "%c%02d:%02d",
+			off < 0 ? '-' : '+', (abs(off) / 60) % 100, abs(off) % 60);
+}
+
+/* "Sun Sep 01 00:00:00 1998 PST" or "1998-09-01T00:00:00-08:00" */
+static char *timetostr(const time_t time, int iso)
+{
+	static char s[64];
+	struct timecache *tc = &tcache;
+	char *p;
+	int secs;
+
+	if (time == 0) {
 		s[0] = '\0';
+		return s;
+	}
+	if (!(tc->start <= time && time < tc->end))
+		timecache_fill(tc, time);
+	if (tc->start == tc->end) {
+		s[0] = '\0';
+		return s;
+	}
 
+	secs = tc->secs + (time - tc->start);
+	p = stpcpy(s, iso ? tc->iso_pre : tc->text_pre);
+	*p++ = '0' + secs / 600;
+	*p++ = '0' + secs / 60 % 10;
+	*p++ = ':';
+	*p++ = '0' + secs % 60 / 10;
+	*p++ = '0' + secs % 10;
+	stpcpy(p, iso ? tc->iso_suf : tc->text_suf);
 	return s;
 }
 
+/*
+ * The hours converted by mktime() are cached in the same way as by
+ * timetostr(), the key is the time string without minutes and seconds.
+ */
 static time_t strtotime(const char *s_time)
 {
+	static char key[29];
+	static time_t base = (time_t) -1;
+	char tmp[29];
 	struct tm tm;
-
-	memset(&tm, '\0', sizeof(struct tm));
+	time_t t, end;
+	int cache;
 
 	if (s_time[0] == ' ' || s_time[0] == '\0')
 		return (time_t)0;
 
-	strptime(s_time, "%a %b %d %T %Y", &tm);
+	/* "Sun Sep 01 00:00:00 1998 PST" */
+	cache = strlen(s_time) > 26 && s_time[13] == ':' && s_time[16] == ':' &&
+		isdigit(s_time[14]) && isdigit(s_time[15]) &&
+		isdigit(s_time[17]) && isdigit(s_time[18]);
+	if (cache) {
+		xstrncpy(tmp, s_time, sizeof(tmp));
+		memcpy(tmp + 14, "00:00", 5);
+		t = (s_time[14] - '0') * 600 + (s_time[15] - '0') * 60 +
+		    (s_time[17] - '0') * 10 + (s_time[18] - '0');
+
+		if (base != (time_t) -1 && strcmp(key, tmp) == 0)
+			return base + t;
+	}
+
+	memset(&tm, '\0', sizeof(struct tm));
+	if (!strptime(s_time, "%a %b %d %T %Y", &tm))
+		cache = 0;
 
 	/* Cheesy way of checking for DST */
 	if (s_time[26] == 'D')
 		tm.tm_isdst = 1;
 
-	return mktime(&tm);
+	if (!cache)
+		return mktime(&tm);
+
+	tm.tm_min = tm.tm_sec = 0;
+	base = mktime(&tm);
+
+	memset(&tm, '\0', sizeof(struct tm));
+	strptime(tmp, "%a %b %d %T %Y", &tm);
+	if (s_time[26] == 'D')
+		tm.tm_isdst = 1;
+	tm.tm_min = tm.tm_sec = 59;
+	end = mktime(&tm);
+
+	if (base == (time_t) -1 || end != base + 3599) {
+		/* DST change within the hour */
+		base = (time_t) -1;
+		memset(&tm, '\0', sizeof(struct tm));
+		strptime(s_time, "%a %b %d %T %Y", &tm);
+		if (s_time[26] == 'D')
+			tm.tm_isdst = 1;
+		return mktime(&tm);
+	}
+	memcpy(key, tmp, sizeof(key));
+	return base + t;
 }
 
 #define cleanse(x) xcleanse(x, sizeof(x))
@@ -83,10 +220,82 @@ static void xcleanse(char *s, int len)
 			*s = '?';
 }
 
+/* like "%-<width>.<maxlen>s" */
+static char *put_str(char *p, const char *str, size_t maxlen, size_t width)
+{
+	size_t len = strnlen(str, maxlen);
+
+	memcpy(p, str, len);
+	p += len;
+	for ( ; len < width; len++)
+		*p++ = ' ';
+	return p;
+}
+
+/* like "%0<width>ld" */
+static char *put_num(char *p, long num, int width)
+{
+	char digits[sizeof(long) * 3];
+	unsigned long n = num < 0 ? -(unsigned long) num : (unsigned long) num;
+	int len = 0;
+
+	do {
+		digits[len++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+
+	if (num < 0) {
+		*p++ = '-';
+		width--;
+	}
+	for ( ; width > len; width--)
+		*p++ = '0';
+	while (len)
+		*p++ = digits[--len];
+	return p;
+}
+
+/* quoted string for JSON or CSV */
+static char *put_quoted(char *p, const char *str, size_t maxlen)
+{
+	const char *end = str + strnlen(str, maxlen);
+
+	*p++ = '"';
+	for ( ; str < end; str++) {
+		if (*str == '"')
+			*p++ = outfmt == OUT_JSON ? '\\' : '"';
+		else if (*str == '\\' && outfmt == OUT_JSON)
+			*p++ = '\\';
+		*p++ = *str;
+	}
+	*p++ = '"';
+	return p;
+}
+
+static char *put_field(char *p, const char *name, int sep)
+{
+	if (sep)
+		*p++ = ',';
+	if (outfmt == OUT_JSON) {
+		*p++ = '"';
+		p = stpcpy(p, name);
+		*p++ = '"';
+		*p++ = ':';
+	}
+	return p;
+}
+
+static void print_header(FILE *out)
+{
+	if (outfmt == OUT_CSV)
+		fputs("type,pid,id,user,line,host,addr,time\n", out);
+}
+
 static void print_utline(struct utmp ut, FILE *out)
 {
 	const char *addr_string, *time_string;
 	char buffer[INET6_ADDRSTRLEN];
+	char *p;
 
 	if (ut.ut_addr_v6[1] || ut.ut_addr_v6[2] || ut.ut_addr_v6[3])
 		addr_string = inet_ntop(AF_INET6, &(ut.ut_addr_v6), buffer, sizeof(buffer));
@@ -94,20 +303,79 @@ static void print_utline(struct utmp ut, FILE *out)
 		addr_string = inet_ntop(AF_INET, &(ut.ut_addr_v6), buffer, sizeof(buffer));
 
 #if defined(_HAVE_UT_TV)
-	time_string = timetostr(ut.ut_tv.tv_sec);
+	time_string = timetostr(ut.ut_tv.tv_sec, outfmt != OUT_TEXT);
 #else
-	time_string = timetostr((time_t)ut.ut_time);	/* ut_time is not always a time_t */
+	time_string = timetostr((time_t)ut.ut_time, outfmt != OUT_TEXT);	/* ut_time is not always a time_t */
 #endif
 	cleanse(ut.ut_id);
 	cleanse(ut.ut_user);
 	cleanse(ut.ut_line);
 	cleanse(ut.ut_host);
 
-	/*            pid    id       user     line     host     addr       time */
-	fprintf(out, "[%d] [%05d] [%-4.4s] [%-*.*s] [%-*.*s] [%-*.*s] [%-15s] [%-28.28s]\n",
-	       ut.ut_type, ut.ut_pid, ut.ut_id, 8, UT_NAMESIZE, ut.ut_user,
-	       12, UT_LINESIZE, ut.ut_line, 20, UT_HOSTSIZE, ut.ut_host,
-	       addr_string, time_string);
+	if (outlen > OUTBUFSZ - UTLINE_MAX)
+		flush_output(out);
+	p = outbuf + outlen;
+
+	if (outfmt == OUT_TEXT) {
+		/* "[%d] [%05d] [%-4.4s] [%-8.*s] [%-12.*s] [%-20.*s] [%-15s] [%-28.28s]" */
+		*p++ = '[';
+		p = put_num(p, ut.ut_type, 0);
+		p = stpcpy(p, "] [");
+		p = put_num(p, ut.ut_pid, 5);
+		p = stpcpy(p, "] [");
+		p = put_str(p, ut.ut_id, 4, 4);
+		p = stpcpy(p, "] [");
+		p = put_str(p, ut.ut_user, UT_NAMESIZE, 8);
+		p = stpcpy(p, "] [");
+		p = put_str(p, ut.ut_line, UT_LINESIZE, 12);
+		p = stpcpy(p, "] [");
+		p = put_str(p, ut.ut_host, UT_HOSTSIZE, 20);
+		p = stpcpy(p, "] [");
+		p = put_str(p, addr_string, INET6_ADDRSTRLEN, 15);
+		p = stpcpy(p, "] [");
+		p = put_str(p, time_string, 28, 28);
+		*p++ = ']';
+	} else {
+		if (outfmt == OUT_JSON)
+			*p++ = '{';
+		p = put_field(p, "type", 0);
+		p = put_num(p, ut.ut_type, 0);
+		p = put_field(p, "pid", 1);
+		p = put_num(p, ut.ut_pid, 0);
+		p = put_field(p, "id", 1);
+		p = put_quoted(p, ut.ut_id, sizeof(ut.ut_id));
+		p = put_field(p, "user", 1);
+		p = put_quoted(p, ut.ut_user, UT_NAMESIZE);
+		p = put_field(p, "line", 1);
+		p = put_quoted(p, ut.ut_line, UT_LINESIZE);
+		p = put_field(p, "host", 1);
+		p = put_quoted(p, ut.ut_host, UT_HOSTSIZE);
+		p = put_field(p, "addr", 1);
+		p = put_quoted(p, addr_string, INET6_ADDRSTRLEN);
+		p = put_field(p, "time", 1);
+		p = put_quoted(p, time_string, 64);
+		if (outfmt == OUT_JSON)
+			*p++ = '}';
+	}
+	*p++ = '\n';
+	outlen = p - outbuf;
+}
+
+/* prints all complete records from the current position, returns number of records */
+static size_t print_utlines(FILE *in, FILE *out)
+{
+	static struct utmp uts[UTBLOCK];
+	size_t n, i, count = 0;
+
+	do {
+		n = fread(uts, sizeof(struct utmp), UTBLOCK, in);
+		for (i = 0; i < n; i++)
+			print_utline(uts[i], out);
+		count += n;
+	} while (n == UTBLOCK);
+
+	flush_output(out);
+	return count;
 }
 
 #ifdef HAVE_INOTIFY_INIT
@@ -118,8 +386,7 @@ static void roll_file(const char *filename, off_t *size, FILE *out)
 {
 	FILE *in;
 	struct stat st;
-	struct utmp ut;
-	off_t pos;
+	size_t count = 0;
 
 	if (!(in = fopen(filename, "r")))
 		err(EXIT_FAILURE, _("cannot open %s"), filename);
@@ -130,17 +397,22 @@ static void roll_file(const char *filename, off_t *size, FILE *out)
 	if (st.st_size == *size)
 		goto done;
 
+	/* all the appended records at once; an incomplete record (the writer
+	 * is not done yet) is read again by the next call */
 	if (fseek(in, *size, SEEK_SET) != (off_t) -1) {
-		while (fread(&ut, sizeof(ut), 1, in) == 1)
-			print_utline(ut, out);
+		count = print_utlines(in, out);
+		fflush(out);
 	}
 
-	pos = ftello(in);
-	/* If we've successfully read something, use the file position, this
-	 * avoids data duplication.  If we read nothing or hit an error,
-	 * reset to the reported size, this handles truncated files.
+	/* If we've successfully read something, use the end of the last
+	 * record, this avoids data duplication.  If we read nothing or hit an
+	 * error, reset to the reported size, this handles truncated files.
 	 */
-	*size = (pos != -1 && pos != *size) ? pos : st.st_size;
+	if (count)
+		*size += count * sizeof(struct utmp);
+	else if (st.st_size < *size ||
+		 st.st_size - *size >= (off_t) sizeof(struct utmp))
+		*size = st.st_size;
 
 done:
 	fclose(in);
@@ -201,8 +473,8 @@ static FILE *dump(FILE *in, const char *filename, int follow, FILE *out)
 	if (follow)
 		ignore_result( fseek(in, -10 * sizeof(ut), SEEK_END) );
 
-	while (fread(&ut, sizeof(ut), 1, in) == 1)
-		print_utline(ut, out);
+	print_header(out);
+	print_utlines(in, out);
 
 	if (!follow)
 		return in;
@@ -215,8 +487,9 @@ static FILE *dump(FILE *in, const char *filename, int follow, FILE *out)
 		/* fallback for systems without inotify or with non-free
 		 * inotify instances */
 		for (;;) {
-			while (fread(&ut, sizeof(ut), 1, in) == 1)
-				print_utline(ut, out);
+			clearerr(in);
+			print_utlines(in, out);
+			fflush(out);
 			sleep(1);
 		}
 
@@ -224,54 +497,64 @@ static FILE *dump(FILE *in, const char *filename, int follow, FILE *out)
 }
 
 
-/* This function won't work properly if there's a ']' or a ' ' in the real
- * token.  Thankfully, this should never happen.  */
-static int gettok(char *line, char *dest, int size, int eatspace)
+/* Returns the next [token] and moves @line behind the token. This function
+ * won't work properly if there's a ']' in the real token.  Thankfully, this
+ * should never happen.  */
+static char *gettok(char **line, size_t *len)
 {
-	int bpos, epos, eaten;
+	char *tok, *end;
 
-	bpos = strchr(line, '[') - line;
-	if (bpos < 0)
+	tok = strchr(*line, '[');
+	if (!tok)
 		errx(EXIT_FAILURE, _("Extraneous newline in file. Exiting."));
-
-	line += 1 + bpos;
-	epos = strchr(line, ']') - line;
-	if (epos < 0)
+	tok++;
+	end = strchr(tok, ']');
+	if (!end)
 		errx(EXIT_FAILURE, _("Extraneous newline in file. Exiting."));
 
-	line[epos] = '\0';
-	eaten = bpos + epos + 1;
+	*len = end - tok;
+	*line = end + 1;
+	return tok;
+}
 
-	if (eatspace) {
-		char *t;
-		if ((t = strchr(line, ' ')))
-			*t = 0;
-	}
-	strncpy(dest, line, size);
+/* copies the token up to the first space */
+static void copytok(char **line, char *dest, size_t size)
+{
+	size_t len;
+	char *tok = gettok(line, &len), *sp;
 
-	return eaten + 1;
+	sp = memchr(tok, ' ', len);
+	if (sp)
+		len = sp - tok;
+	memcpy(dest, tok, min(len, size));
 }
 
 static void undump(FILE *in, FILE *out)
 {
 	struct utmp ut;
-	char s_addr[INET6_ADDRSTRLEN + 1], s_time[29], *linestart, *line;
-	int count = 0;
+	char s_addr[INET6_ADDRSTRLEN + 1], s_time[29], *linestart = NULL, *line, *tok;
+	size_t sz = 0, len;
 
-	linestart = xmalloc(1024 * sizeof(*linestart));
-	s_time[28] = 0;
-
-	while (fgets(linestart, 1023, in)) {
+	while (getline(&linestart, &sz, in) > 0) {
 		line = linestart;
 		memset(&ut, '\0', sizeof(ut));
-		sscanf(line, "[%hd] [%d] [%4c] ", &ut.ut_type, &ut.ut_pid, ut.ut_id);
-
-		line += 19;
-		line += gettok(line, ut.ut_user, sizeof(ut.ut_user), 1);
-		line += gettok(line, ut.ut_line, sizeof(ut.ut_line), 1);
-		line += gettok(line, ut.ut_host, sizeof(ut.ut_host), 1);
-		line += gettok(line, s_addr, sizeof(s_addr) - 1, 1);
-		gettok(line, s_time, sizeof(s_time) - 1, 0);
+		memset(s_addr, '\0', sizeof(s_addr));
+		memset(s_time, '\0', sizeof(s_time));
+
+		tok = gettok(&line, &len);
+		ut.ut_type = strtol(tok, NULL, 10);
+		tok = gettok(&line, &len);
+		ut.ut_pid = strtol(tok, NULL, 10);
+		tok = gettok(&line, &len);
+		memcpy(ut.ut_id, tok, min(len, sizeof(ut.ut_id)));
+
+		copytok(&line, ut.ut_user, sizeof(ut.ut_user));
+		copytok(&line, ut.ut_line, sizeof(ut.ut_line));
+		copytok(&line, ut.ut_host, sizeof(ut.ut_host));
+		copytok(&line, s_addr, sizeof(s_addr) - 1);
+		tok = gettok(&line, &len);
+		memcpy(s_time, tok, min(len, sizeof(s_time) - 1));
+
 		if (strchr(s_addr, '.'))
 			inet_pton(AF_INET, s_addr, &(ut.ut_addr_v6));
 		else
@@ -282,8 +565,6 @@ static void undump(FILE *in, FILE *out)
 		ut.ut_time = strtotime(s_time);
 #endif
 		ignore_result( fwrite(&ut, sizeof(ut), 1, out) );
-
-		++count;
 	}
 
 	free(linestart);
@@ -300,6 +581,8 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(_(" -f, --follow         output appended data as the file grows\n"), out);
 	fputs(_(" -r, --reverse        write back dumped data into utmp file\n"), out);
 	fputs(_(" -o, --output <file>  write to file instead of standard output\n"), out);
+	fputs(_(" -J, --json           use JSON output format\n"), out);
+	fputs(_(" -C, --csv            use CSV output format\n"), out);
 	fputs(USAGE_HELP, out);
 	fputs(USAGE_VERSION, out);
 
@@ -318,6 +601,8 @@ int main(int argc, char **argv)
 		{ "follow",  0, 0, 'f' },
 		{ "reverse", 0, 0, 'r' },
 		{ "output",  required_argument, 0, 'o' },
+		{ "json",    0, 0, 'J' },
+		{ "csv",     0, 0, 'C' },
 		{ "help",    0, 0, 'h' },
 		{ "version", 0, 0, 'V' },
 		{ NULL, 0, 0, 0 }
@@ -328,7 +613,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while ((c = getopt_long(argc, argv, "fro:hV", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "fro:JChV", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'r':
 			reverse = 1;
@@ -345,6 +630,13 @@ int main(int argc, char **argv)
 				    optarg);
 			break;
 
+		case 'J':
+			outfmt = OUT_JSON;
+			break;
+		case 'C':
+			outfmt = OUT_CSV;
+			break;
+
 		case 'h':
 			usage(stdout);
 			break;
@@ -358,6 +650,9 @@ int main(int argc, char **argv)
 
 	if (!out)
 		out = stdout;
+	if (reverse && outfmt != OUT_TEXT)
+		errx(EXIT_FAILURE, _("--reverse is supported for the default format only"));
+	tzset();
 
 	if (optind < argc) {
 		filename = argv[optind];
@@ -17,13 +17,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
-#ifdef HAVE_GETOPT_H
 #include <getopt.h>
-#else
-extern int getopt(int argc, char * const argv[], const char *optstring);
-extern char *optarg;
-extern int optind;
-#endif
+#include <sys/wait.h>
 
 #define OUTPUT_VALUE_ONLY	(1 << 1)
 #define OUTPUT_DEVICE_ONLY	(1 << 2)
@@ -68,7 +63,7 @@ static void usage(int error)
 	fprintf(out,
 		"Usage:\n"
 		" %1$s -L <label> | -U <uuid>\n\n"
-		" %1$s [-c <file>] [-ghlLv] [-o <format>] [-s <tag>] \n"
+		" %1$s [-c <file>] [-ghlLv] [-j <num>] [-o <format>] [-s <tag>] \n"
 		"       [-t <token>] [<dev> ...]\n\n"
 		" %1$s -p [-s <tag>] [-O <offset>] [-S <size>] \n"
 		"       [-o <format>] <dev> ...\n\n"
@@ -79,6 +74,9 @@ static void usage(int error)
 		" -d          don't encode non-printing characters\n"
 		" -h          print this usage message and exit\n"
 		" -g          garbage collect the blkid cache\n"
+		" -j, --jobs <num>\n"
+		"             probe devices by <num> parallel threads (processes\n"
+		"               for low-level probing)\n"
 		" -o <format> output format; can be one of:\n"
 		"               value, device, export or full; (default: full)\n"
 		" -k          list all known filesystems/RAIDs and exit\n"
@@ -96,6 +94,8 @@ static void usage(int error)
 		" -O <offset> probe at the given offset\n"
 		" -u <list>   filter by \"usage\" (e.g. -u filesystem,raid)\n"
 		" -n <list>   filter by filesystem type (e.g. -n vfat,ext3)\n"
+		"     --stats print probing statistics\n"
+		"     --stdin read device names from standard input\n"
 		"\n", program_invocation_short_name);
 
 	exit(error);
@@ -236,7 +236,7 @@ static void pretty_print_dev(blkid_dev dev)
 	pretty_print_line(devname, fs_type, label, mtpt, uuid);
 }
 
-static void print_udev_format(const char *name, const char *value)
+static void print_udev_format(FILE *out, const char *name, const char *value)
 {
 	char enc[265], safe[256];
 	size_t namelen = strlen(name);
@@ -245,40 +245,40 @@ static void print_udev_format(const char *name, const char *value)
 
 	if (!strcmp(name, "TYPE") || !strcmp(name, "VERSION")) {
 		blkid_encode_string(value, enc, sizeof(enc));
-		printf("ID_FS_%s=%s\n", name, enc);
+		fprintf(out, "ID_FS_%s=%s\n", name, enc);
 
 	} else if (!strcmp(name, "UUID") ||
 		 !strcmp(name, "LABEL") ||
 		 !strcmp(name, "UUID_SUB")) {
 
 		blkid_safe_string(value, safe, sizeof(safe));
-		printf("ID_FS_%s=%s\n", name, safe);
+		fprintf(out, "ID_FS_%s=%s\n", name, safe);
 
 		blkid_encode_string(value, enc, sizeof(enc));
-		printf("ID_FS_%s_ENC=%s\n", name, enc);
+		fprintf(out, "ID_FS_%s_ENC=%s\n", name, enc);
 
 	} else if (!strcmp(name, "PTUUID")) {
-		printf("ID_PART_TABLE_UUID=%s\n", value);
+		fprintf(out, "ID_PART_TABLE_UUID=%s\n", value);
 
 	} else if (!strcmp(name, "PTTYPE")) {
-		printf("ID_PART_TABLE_TYPE=%s\n", value);
+		fprintf(out, "ID_PART_TABLE_TYPE=%s\n", value);
 
 	} else if (!strcmp(name, "PART_ENTRY_NAME") ||
 		  !strcmp(name, "PART_ENTRY_TYPE")) {
 
 		blkid_encode_string(value, enc, sizeof(enc));
-		printf("ID_%s=%s\n", name, enc);
+		fprintf(out, "ID_%s=%s\n", name, enc);
 
 	} else if (!strncmp(name, "PART_ENTRY_", 11))
-		printf("ID_%s=%s\n", name, value);
+		fprintf(out, "ID_%s=%s\n", name, value);
 
 	else if (namelen >= 15 && (
 		   !strcmp(name + (namelen - 12), "_SECTOR_SIZE") ||
 		   !strcmp(name + (namelen - 8), "_IO_SIZE") ||
 		   !strcmp(name, "ALIGNMENT_OFFSET")))
-			printf("ID_IOLIMIT_%s=%s\n", name, value);
+			fprintf(out, "ID_IOLIMIT_%s=%s\n", name, value);
 	else
-		printf("ID_FS_%s=%s\n", name, value);
+		fprintf(out, "ID_FS_%s=%s\n", name, value);
 }
 
 static int has_item(char *ary[], const char *item)
@@ -299,7 +299,7 @@ static void print_value(int output, int num, const char *devname,
 		fputc('\n', stdout);
 
 	} else if (output & OUTPUT_UDEV_LIST) {
-		print_udev_format(name, value);
+		print_udev_format(stdout, name, value);
 
 	} else if (output & OUTPUT_EXPORT_LIST) {
 		if (num == 1 && devname)
@@ -479,9 +479,65 @@ static int lowprobe_topology(blkid_probe pr)
 	return blkid_do_fullprobe(pr);
 }
 
+static void print_stats(blkid_probe pr, const char *devname)
+{
+	uint64_t st[BLKID_STAT_SKIPPED + 1];
+	const char *chain, *name;
+	size_t i;
+
+	printf("%s: probing statistics:\n", devname);
+	printf("%-12s %-29s %10s %10s %6s %6s %6s %6s %7s\n",
+		"CHAIN", "PROBER", "TIME(us)", "BYTES", "READS",
+		"HITS", "MISSES", "CALLS", "SKIPPED");
+
+	for (i = 0; blkid_probe_get_stats(pr, i, &chain, &name,
+					  st, ARRAY_SIZE(st)) == 0; i++) {
+		if (!st[BLKID_STAT_CALLS] && (name || !st[BLKID_STAT_SKIPPED]))
+			continue;	/* not used */
+		printf("%-12s %-29s %10ju %10ju %6ju %6ju %6ju %6ju %7ju\n",
+			chain, name ? name : "(total)",
+			(uintmax_t) st[BLKID_STAT_TIME],
+			(uintmax_t) st[BLKID_STAT_BYTES],
+			(uintmax_t) st[BLKID_STAT_READS],
+			(uintmax_t) st[BLKID_STAT_HITS],
+			(uintmax_t) st[BLKID_STAT_MISSES],
+			(uintmax_t) st[BLKID_STAT_CALLS],
+			(uintmax_t) st[BLKID_STAT_SKIPPED]);
+	}
+}
+
+/*
+ * udev output is composed directly from libblkid, see print_udev_value(). The
+ * values are buffered and printed only if the device has been successfully
+ * probed.
+ */
+struct udev_output {
+	char	**show;		/* wanted values */
+	FILE	*f;		/* buffer */
+	char	*buf;
+	size_t	bufsz;
+};
+
+static int print_udev_value(blkid_probe pr __attribute__((__unused__)),
+			    const char *name, const char *data,
+			    size_t len __attribute__((__unused__)),
+			    void *userdata)
+{
+	struct udev_output *out = (struct udev_output *) userdata;
+
+	if (out->show[0] && !has_item(out->show, name))
+		return 0;
+
+	print_udev_format(out->f, name, data);
+	return 0;
+}
+
+/* nothing printed by lowprobe_device() yet */
+static int lowprobe_first = 1;
+
 static int lowprobe_device(blkid_probe pr, const char *devname,
 			int chain, char *show[], int output,
-			blkid_loff_t offset, blkid_loff_t size)
+			blkid_loff_t offset, blkid_loff_t size, int stats)
 {
 	const char *data;
 	const char *name;
@@ -489,7 +545,7 @@ static int lowprobe_device(blkid_probe pr, const char *devname,
 	size_t len;
 	int fd;
 	int rc = 0;
-	static int first = 1;
+	struct udev_output uout = { .show = show };
 
 	fd = open(devname, O_RDONLY|O_CLOEXEC);
 	if (fd < 0) {
@@ -498,17 +554,44 @@ static int lowprobe_device(blkid_probe pr, const char *devname,
 	}
 	if (blkid_probe_set_device(pr, fd, offset, size))
 		goto done;
+	if (stats)
+		blkid_probe_enable_stats(pr, TRUE);	/* reset counters */
+	if (output & OUTPUT_UDEV_LIST) {
+		uout.f = open_memstream(&uout.buf, &uout.bufsz);
+		if (!uout.f) {
+			fprintf(stderr, "error: cannot allocate buffer: %m\n");
+			rc = -1;
+			goto done;
+		}
+		blkid_probe_set_value_function(pr, print_udev_value, &uout);
+	}
 
 	if (chain & LOWPROBE_TOPOLOGY)
 		rc = lowprobe_topology(pr);
 	if (rc >= 0 && (chain & LOWPROBE_SUPERBLOCKS))
 		rc = lowprobe_superblocks(pr);
+
+	blkid_probe_set_value_function(pr, NULL, NULL);
+	if (uout.f)
+		fclose(uout.f);
 	if (rc < 0)
 		goto done;
 
 	if (!rc)
 		nvals = blkid_probe_numof_values(pr);
 
+	if (output & OUTPUT_UDEV_LIST) {
+		/* composed by print_udev_value() */
+		if (uout.bufsz) {
+			if (!lowprobe_first)
+				/* add extra line between output from devices */
+				fputc('\n', stdout);
+			fwrite(uout.buf, 1, uout.bufsz, stdout);
+		}
+		lowprobe_first = 0;
+		goto done;
+	}
+
 	if (nvals &&
 	    !(chain & LOWPROBE_TOPOLOGY) &&
 	    !(output & OUTPUT_UDEV_LIST) &&
@@ -524,7 +607,8 @@ static int lowprobe_device(blkid_probe pr, const char *devname,
 		 */
 		nvals = 0;
 
-	if (nvals && !first && output & (OUTPUT_UDEV_LIST | OUTPUT_EXPORT_LIST))
+	if (nvals && !lowprobe_first &&
+	    output & (OUTPUT_UDEV_LIST | OUTPUT_EXPORT_LIST))
 		/* add extra line between output from devices */
 		fputc('\n', stdout);
 
@@ -542,12 +626,14 @@ static int lowprobe_device(blkid_probe pr, const char *devname,
 		print_value(output, num++, devname, (char *) data, name, len);
 	}
 
-	if (first)
-		first = 0;
+	if (lowprobe_first)
+		lowprobe_first = 0;
 	if (nvals >= 1 && !(output & (OUTPUT_VALUE_ONLY |
 					OUTPUT_UDEV_LIST | OUTPUT_EXPORT_LIST)))
 		printf("\n");
 done:
+	if (stats)
+		print_stats(pr, devname);
 	if (rc == -2) {
 		if (output & OUTPUT_UDEV_LIST)
 			print_udev_ambivalent(pr);
@@ -559,6 +645,7 @@ done:
 				devname);
 	}
 	close(fd);
+	free(uout.buf);
 
 	if (rc == -2)
 		return BLKID_EXIT_AMBIVAL;	/* ambivalent probing result */
@@ -568,6 +655,113 @@ done:
 	return 0;		/* success */
 }
 
+struct lowprobe_job {
+	pid_t	pid;
+	FILE	*out;		/* stdout and stderr of the worker */
+	FILE	*err;
+};
+
+static FILE *lowprobe_tmpfile(void)
+{
+	FILE *f = tmpfile();
+
+	if (!f) {
+		fprintf(stderr, "error: cannot create temporary file: %m\n");
+		exit(BLKID_EXIT_OTHER);
+	}
+	return f;
+}
+
+static void lowprobe_flush(FILE *in, FILE *out)
+{
+	char buf[BUFSIZ];
+	size_t sz;
+
+	rewind(in);
+	while ((sz = fread(buf, 1, sizeof(buf), in)) > 0)
+		fwrite(buf, 1, sz, out);
+	fflush(out);
+	fclose(in);
+}
+
+/*
+ * Probes @devices by @jobs processes. Every process uses the same already
+ * initialized probe (with filters) for the continuous part of the @devices.
+ * The output of the processes is buffered and printed in order of the
+ * devices, the probing is stopped on the first error as in the serial mode.
+ */
+static int lowprobe_parallel(blkid_probe pr, char **devices, size_t numdev,
+			size_t jobs, int chain, char *show[], int output,
+			blkid_loff_t offset, blkid_loff_t size, int stats)
+{
+	struct lowprobe_job *job, *jobarr;
+	size_t i, n, chunk;
+	int rc = 0;
+
+	if (jobs > numdev)
+		jobs = numdev;
+	chunk = (numdev + jobs - 1) / jobs;
+	jobs = (numdev + chunk - 1) / chunk;
+
+	jobarr = xcalloc(jobs, sizeof(*jobarr));
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < jobs; i++) {
+		job = &jobarr[i];
+		job->out = lowprobe_tmpfile();
+		job->err = lowprobe_tmpfile();
+
+		job->pid = fork();
+		if (job->pid < 0) {
+			fprintf(stderr, "error: fork failed: %m\n");
+			exit(BLKID_EXIT_OTHER);
+		}
+		if (job->pid)
+			continue;
+
+		/* worker */
+		if (dup2(fileno(job->out), STDOUT_FILENO) < 0 ||
+		    dup2(fileno(job->err), STDERR_FILENO) < 0)
+			exit(BLKID_EXIT_OTHER);
+
+		/* the previous worker printed something if we are here */
+		if (i)
+			lowprobe_first = 0;
+		for (n = i * chunk; n < numdev && n < (i + 1) * chunk; n++) {
+			rc = lowprobe_device(pr, devices[n], chain, show,
+					output, offset, size, stats);
+			if (rc)
+				break;
+		}
+		exit(rc);
+	}
+
+	for (i = 0; i < jobs; i++) {
+		int status = 0;
+
+		job = &jobarr[i];
+		while (waitpid(job->pid, &status, 0) < 0 && errno == EINTR);
+
+		if (rc) {
+			/* ignore output after the failed device */
+			fclose(job->out);
+			fclose(job->err);
+			continue;
+		}
+		lowprobe_flush(job->out, stdout);
+		lowprobe_flush(job->err, stderr);
+
+		if (!WIFEXITED(status))
+			rc = BLKID_EXIT_OTHER;
+		else
+			rc = WEXITSTATUS(status);
+	}
+
+	free(jobarr);
+	return rc;
+}
+
 /* converts comma separated list to BLKID_USAGE_* mask */
 static int list_to_usage(const char *list, int *flag)
 {
@@ -661,13 +855,13 @@ int main(int argc, char **argv)
 	int fltr_usage = 0;
 	char **fltr_type = NULL;
 	int fltr_flag = BLKID_FLTR_ONLYIN;
-	unsigned int numdev = 0, numtag = 0;
+	unsigned int numdev = 0, numargs = 0, numtag = 0;
 	int version = 0;
 	int err = BLKID_EXIT_OTHER;
 	unsigned int i;
 	int output_format = 0;
 	int lookup = 0, gc = 0, lowprobe = 0, eval = 0;
-	int c;
+	int c, jobs = 1, stats = 0, from_stdin = 0;
 	uintmax_t offset = 0, size = 0;
 
 	static const ul_excl_t excl[] = {       /* rows and cols in in ASCII order */
@@ -676,11 +870,23 @@ int main(int argc, char **argv)
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
 
+	enum {
+		OPT_STATS = CHAR_MAX + 1,
+		OPT_STDIN
+	};
+	static const struct option longopts[] = {
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "stats", no_argument, NULL, OPT_STATS },
+		{ "stdin", no_argument, NULL, OPT_STDIN },
+		{ NULL, 0, NULL, 0 }
+	};
+
 	show[0] = NULL;
 	atexit(close_stdout);
 
-	while ((c = getopt (argc, argv,
-			    "c:df:ghilL:n:ko:O:ps:S:t:u:U:w:Vv")) != EOF) {
+	while ((c = getopt_long(argc, argv,
+			    "c:df:ghij:lL:n:ko:O:ps:S:t:u:U:w:Vv",
+			    longopts, NULL)) != EOF) {
 
 		err_exclusive_options(c, NULL, excl, excl_st);
 
@@ -713,6 +919,9 @@ int main(int argc, char **argv)
 		case 'i':
 			lowprobe |= LOWPROBE_TOPOLOGY;
 			break;
+		case 'j':
+			jobs = strtou32_or_err(optarg, "invalid jobs argument");
+			break;
 		case 'l':
 			lookup++;
 			break;
@@ -785,6 +994,12 @@ int main(int argc, char **argv)
 		case 'w':
 			/* ignore - backward compatibility */
 			break;
+		case OPT_STATS:
+			stats = 1;
+			break;
+		case OPT_STDIN:
+			from_stdin = 1;
+			break;
 		case 'h':
 			err = 0;
 			/* fallthrough */
@@ -800,6 +1015,24 @@ int main(int argc, char **argv)
 		while (optind < argc)
 			devices[numdev++] = argv[optind++];
 	}
+	numargs = numdev;
+
+	/* one device name per line */
+	if (from_stdin) {
+		char *line = NULL;
+		size_t sz = 0;
+		ssize_t len;
+
+		while ((len = getline(&line, &sz, stdin)) > 0) {
+			if (line[len - 1] == '\n')
+				line[--len] = '\0';
+			if (!len)
+				continue;
+			devices = xrealloc(devices, (numdev + 1) * sizeof(char *));
+			devices[numdev++] = xstrdup(line);
+		}
+		free(line);
+	}
 
 	if (version) {
 		print_version(stdout);
@@ -856,7 +1089,8 @@ int main(int argc, char **argv)
 			blkid_probe_set_superblocks_flags(pr,
 				BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
 				BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE |
-				BLKID_SUBLKS_USAGE | BLKID_SUBLKS_VERSION);
+				BLKID_SUBLKS_USAGE | BLKID_SUBLKS_VERSION |
+				BLKID_SUBLKS_ZEROSKIP);
 
 			if (fltr_usage && blkid_probe_filter_superblocks_usage(
 						pr, fltr_flag, fltr_usage))
@@ -867,11 +1101,16 @@ int main(int argc, char **argv)
 				goto exit;
 		}
 
-		for (i = 0; i < numdev; i++) {
+		if (jobs > 1 && numdev > 1)
+			err = lowprobe_parallel(pr, devices, numdev, jobs,
+					lowprobe, show, output_format,
+					(blkid_loff_t) offset,
+					(blkid_loff_t) size, stats);
+		else for (i = 0; i < numdev; i++) {
 			err = lowprobe_device(pr, devices[i], lowprobe, show,
 					output_format,
 					(blkid_loff_t) offset,
-					(blkid_loff_t) size);
+					(blkid_loff_t) size, stats);
 			if (err)
 				break;
 		}
@@ -910,7 +1149,10 @@ int main(int argc, char **argv)
 		blkid_dev_iterate	iter;
 		blkid_dev		dev;
 
-		blkid_probe_all(cache);
+		if (jobs > 1)
+			blkid_probe_all_parallel(cache, jobs);
+		else
+			blkid_probe_all(cache);
 
 		iter = blkid_dev_iterate_begin(cache);
 		blkid_dev_set_search(iter, search_type, search_value);
@@ -943,6 +1185,8 @@ exit:
 	free_types_list(fltr_type);
 	if (!lowprobe && !eval)
 		blkid_put_cache(cache);
+	for (i = numargs; i < numdev; i++)
+		free(devices[i]);
 	free(devices);
 	return err;
 }
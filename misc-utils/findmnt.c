@@ -29,9 +29,12 @@
 # include <sys/ioctl.h>
 #endif
 #include <assert.h>
-#include <poll.h>
+#include <time.h>
 #include <sys/statvfs.h>
 #include <sys/types.h>
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
 #ifdef HAVE_LIBUDEV
 # include <libudev.h>
 #endif
@@ -59,7 +62,8 @@ enum {
 	FL_POLL		= (1 << 9),
 	FL_DF		= (1 << 10),
 	FL_ALL		= (1 << 11),
-	FL_UNIQ		= (1 << 12)
+	FL_UNIQ		= (1 << 12),
+	FL_NONETFS	= (1 << 13)
 };
 
 /* column IDs */
@@ -449,14 +453,289 @@ static char *get_tag(struct libmnt_fs *fs, const char *tagname, int col
 	return res;
 }
 
+/*
+ * statvfs() for SIZE, AVAIL, USED and USE% columns
+ *
+ * The filesystems are queried by a pool of threads, and the output waits
+ * vfs_timeout milliseconds for every filesystem, so one hung (network)
+ * filesystem does not block the whole output. The timed-out filesystems are
+ * printed with "?" in the columns.
+ */
+#define VFS_NTHREADS	16
+#define VFS_TIMEOUT	5000	/* default in milliseconds */
+
+enum {
+	VFS_WAITING = 0,
+	VFS_RUNNING,
+	VFS_DONE
+};
+
+struct vfs_query {
+	struct libmnt_fs	*fs;		/* the query is @fs userdata */
+	char			*target;
+	int			state;		/* VFS_* */
+	struct timespec		started;	/* CLOCK_MONOTONIC */
+	int			timeout;	/* no result in time */
+	int			orphan;		/* released, free by worker */
+
+	int			rc;		/* statvfs() return code */
+	struct statvfs		buf;
+};
+
+static struct vfs_pool {
+	struct vfs_query	**queue;
+	size_t			nqueue;
+	size_t			maxqueue;
+	size_t			next;		/* the next query for workers */
+	int			nworkers;	/* running workers */
+	int			nstuck;		/* timed-out workers */
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+#endif
+	unsigned int		initialized : 1;
+} vfspool;
+
+static int vfs_timeout = VFS_TIMEOUT;
+
+static void vfs_query_run(struct vfs_query *q)
+{
+	q->rc = statvfs(q->target, &q->buf);
+}
+
+static void vfs_free_query(struct vfs_query *q)
+{
+	free(q->target);
+	free(q);
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *vfs_worker(void *data __attribute__((__unused__)))
+{
+	struct vfs_pool *vp = &vfspool;
+
+	pthread_mutex_lock(&vp->lock);
+	while (vp->next < vp->nqueue) {
+		struct vfs_query *q = vp->queue[vp->next++];
+
+		q->state = VFS_RUNNING;
+		clock_gettime(CLOCK_MONOTONIC, &q->started);
+		pthread_cond_broadcast(&vp->cond);
+		pthread_mutex_unlock(&vp->lock);
+
+		vfs_query_run(q);
+
+		pthread_mutex_lock(&vp->lock);
+		if (q->timeout)
+			vp->nstuck--;
+		if (q->orphan)
+			vfs_free_query(q);
+		else
+			q->state = VFS_DONE;
+		pthread_cond_broadcast(&vp->cond);
+	}
+	vp->nworkers--;
+	pthread_mutex_unlock(&vp->lock);
+	return NULL;
+}
+
+/* starts a new worker if necessary, the lock has to be held */
+static void vfs_start_worker(struct vfs_pool *vp)
+{
+	pthread_attr_t attr;
+	pthread_t tid;
+
+	if (vp->next >= vp->nqueue ||
+	    vp->nworkers - vp->nstuck >= VFS_NTHREADS)
+		return;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&tid, &attr, vfs_worker, NULL) == 0)
+		vp->nworkers++;
+	pthread_attr_destroy(&attr);
+}
+
+static void vfs_pool_init(struct vfs_pool *vp)
+{
+	pthread_condattr_t cattr;
+
+	pthread_mutex_init(&vp->lock, NULL);
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&vp->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+	vp->initialized = 1;
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/* adds @fs to the queue, the query is stored in the @fs userdata */
+static struct vfs_query *vfs_add_query(struct libmnt_fs *fs)
+{
+	struct vfs_pool *vp = &vfspool;
+	struct vfs_query *q = mnt_fs_get_userdata(fs);
+
+	if (q || !mnt_fs_get_target(fs))
+		return q;
+	if ((flags & FL_NONETFS) && mnt_fs_is_netfs(fs))
+		return NULL;
+
+	q = xcalloc(1, sizeof(*q));
+	q->target = xstrdup(mnt_fs_get_target(fs));
+	q->fs = fs;
+	mnt_fs_set_userdata(fs, q);
+
+#ifdef HAVE_LIBPTHREAD
+	if (!vp->initialized)
+		vfs_pool_init(vp);
+	pthread_mutex_lock(&vp->lock);
+#endif
+	if (vp->nqueue == vp->maxqueue) {
+		vp->maxqueue = vp->maxqueue ? vp->maxqueue * 2 : 64;
+		vp->queue = xrealloc(vp->queue,
+				vp->maxqueue * sizeof(struct vfs_query *));
+	}
+	vp->queue[vp->nqueue++] = q;
+#ifdef HAVE_LIBPTHREAD
+	vfs_start_worker(vp);
+	pthread_mutex_unlock(&vp->lock);
+#endif
+	return q;
+}
+
+/* returns the finished query for @fs or NULL */
+static struct vfs_query *vfs_get_result(struct libmnt_fs *fs)
+{
+	struct vfs_query *q = vfs_add_query(fs);
+
+	if (!q)
+		return NULL;
+#ifdef HAVE_LIBPTHREAD
+	{
+		struct vfs_pool *vp = &vfspool;
+
+		pthread_mutex_lock(&vp->lock);
+		if (vp->nworkers == 0 && q->state == VFS_WAITING) {
+			/* no thread, query in this thread */
+			q->state = VFS_DONE;
+			vp->next = vp->nqueue;
+			pthread_mutex_unlock(&vp->lock);
+			vfs_query_run(q);
+			return q;
+		}
+		while (q->state != VFS_DONE && !q->timeout) {
+			struct timespec tmo;
+
+			if (q->state == VFS_WAITING || vfs_timeout <= 0) {
+				pthread_cond_wait(&vp->cond, &vp->lock);
+				continue;
+			}
+			tmo = q->started;
+			tmo.tv_sec += vfs_timeout / 1000;
+			tmo.tv_nsec += (vfs_timeout % 1000) * 1000000;
+			if (tmo.tv_nsec >= 1000000000) {
+				tmo.tv_sec++;
+				tmo.tv_nsec -= 1000000000;
+			}
+			if (pthread_cond_timedwait(&vp->cond, &vp->lock,
+						   &tmo) == ETIMEDOUT &&
+			    q->state != VFS_DONE) {
+				/* the worker is stuck, replace it */
+				q->timeout = 1;
+				vp->nstuck++;
+				vfs_start_worker(vp);
+			}
+		}
+		pthread_mutex_unlock(&vp->lock);
+	}
+#else
+	if (q->state != VFS_DONE) {
+		vfs_query_run(q);
+		q->state = VFS_DONE;
+	}
+#endif
+	if (!q->timeout && q->rc != 0)
+		return NULL;
+	return q;
+}
+
+/*
+ * Releases all queries, must be called before the filesystems are
+ * deallocated. The query still running in a stuck worker is only marked
+ * as orphan and deallocated by the worker when statvfs() returns.
+ */
+static void vfs_pool_reset(void)
+{
+	struct vfs_pool *vp = &vfspool;
+	size_t i;
+
+	if (!vp->nqueue)
+		return;
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_lock(&vp->lock);
+#endif
+	for (i = 0; i < vp->nqueue; i++) {
+		struct vfs_query *q = vp->queue[i];
+
+		mnt_fs_set_userdata(q->fs, NULL);
+		if (q->state == VFS_RUNNING)
+			q->orphan = 1;
+		else
+			vfs_free_query(q);
+	}
+	vp->nqueue = vp->next = 0;
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_unlock(&vp->lock);
+#endif
+}
+
+/*
+ * Starts statvfs() for all filesystems in the output. The filesystems not
+ * queried here (e.g. --poll) are queried on demand.
+ */
+static void vfs_prefetch(struct libmnt_table *tb)
+{
+	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_FORWARD);
+	struct libmnt_fs *fs;
+
+	if (!itr)
+		return;
+	while (mnt_table_next_fs(tb, itr, &fs) == 0) {
+		if ((flags & FL_SUBMOUNTS) || match_func(fs, NULL))
+			vfs_add_query(fs);
+	}
+	mnt_free_iter(itr);
+}
+
+static int has_vfs_column(void)
+{
+	int i;
+
+	for (i = 0; i < ncolumns; i++) {
+		switch (get_column_id(i)) {
+		case COL_SIZE:
+		case COL_AVAIL:
+		case COL_USED:
+		case COL_USEPERC:
+			return 1;
+		}
+	}
+	return 0;
+}
+
 static char *get_vfs_attr(struct libmnt_fs *fs, int sizetype)
 {
+	struct vfs_query *q;
 	struct statvfs buf;
 	uint64_t vfs_attr = 0;
 	char *sizestr;
 
-	if (statvfs(mnt_fs_get_target(fs), &buf) != 0)
+	q = vfs_get_result(fs);
+	if (!q)
 		return NULL;
+	if (q->timeout)
+		return xstrdup("?");
+	buf = q->buf;
 
 	switch(sizetype) {
 	case COL_SIZE:
@@ -484,11 +763,50 @@ static char *get_vfs_attr(struct libmnt_fs *fs, int sizetype)
 
 /* reads FS data from libmount
  */
+/*
+ * Returns (not allocated) libmount string for the columns where no
+ * conversion is necessary, or 1 if the data have to be generated by
+ * get_data().
+ */
+static int get_fs_string(struct libmnt_fs *fs, int col_id, const char **str)
+{
+	switch (col_id) {
+	case COL_TARGET:
+		*str = mnt_fs_get_target(fs);
+		break;
+	case COL_FSTYPE:
+		*str = mnt_fs_get_fstype(fs);
+		break;
+	case COL_OPTIONS:
+		*str = mnt_fs_get_options(fs);
+		break;
+	case COL_VFS_OPTIONS:
+		*str = mnt_fs_get_vfs_options(fs);
+		break;
+	case COL_FS_OPTIONS:
+		*str = mnt_fs_get_fs_options(fs);
+		break;
+	case COL_OPT_FIELDS:
+		*str = mnt_fs_get_optional_fields(fs);
+		break;
+	case COL_FSROOT:
+		*str = mnt_fs_get_root(fs);
+		break;
+	default:
+		return 1;
+	}
+	return 0;
+}
+
 static char *get_data(struct libmnt_fs *fs, int num)
 {
 	char *str = NULL;
+	const char *cstr;
 	int col_id = get_column_id(num);
 
+	if (get_fs_string(fs, col_id, &cstr) == 0)
+		return xstrdup(cstr);
+
 	switch (col_id) {
 	case COL_SOURCE:
 	{
@@ -509,24 +827,6 @@ static char *get_data(struct libmnt_fs *fs, int num)
 			str = xstrdup(spec);
 		break;
 	}
-	case COL_TARGET:
-		str = xstrdup(mnt_fs_get_target(fs));
-		break;
-	case COL_FSTYPE:
-		str = xstrdup(mnt_fs_get_fstype(fs));
-		break;
-	case COL_OPTIONS:
-		str = xstrdup(mnt_fs_get_options(fs));
-		break;
-	case COL_VFS_OPTIONS:
-		str = xstrdup(mnt_fs_get_vfs_options(fs));
-		break;
-	case COL_FS_OPTIONS:
-		str = xstrdup(mnt_fs_get_fs_options(fs));
-		break;
-	case COL_OPT_FIELDS:
-		str = xstrdup(mnt_fs_get_optional_fields(fs));
-		break;
 	case COL_UUID:
 		str = get_tag(fs, "UUID", col_id);
 		break;
@@ -546,7 +846,8 @@ static char *get_data(struct libmnt_fs *fs, int num)
 		if (!devno)
 			break;
 
-		if ((tt_flags & TT_FL_RAW) || (tt_flags & TT_FL_EXPORT))
+		if ((tt_flags & TT_FL_RAW) || (tt_flags & TT_FL_EXPORT) ||
+		    (tt_flags & TT_FL_JSON))
 			xasprintf(&str, "%u:%u", major(devno), minor(devno));
 		else
 			xasprintf(&str, "%3u:%-3u", major(devno), minor(devno));
@@ -558,9 +859,6 @@ static char *get_data(struct libmnt_fs *fs, int num)
 	case COL_USEPERC:
 		str = get_vfs_attr(fs, col_id);
 		break;
-	case COL_FSROOT:
-		str = xstrdup(mnt_fs_get_root(fs));
-		break;
 	case COL_TID:
 		if (mnt_fs_get_tid(fs))
 			xasprintf(&str, "%d", mnt_fs_get_tid(fs));
@@ -665,8 +963,15 @@ static struct tt_line *add_line(struct tt *tt, struct libmnt_fs *fs,
 		warn(_("failed to add line to output"));
 		return NULL;
 	}
-	for (i = 0; i < ncolumns; i++)
-		tt_line_set_data(line, i, get_data(fs, i));
+	for (i = 0; i < ncolumns; i++) {
+		const char *str;
+
+		/* copy to the table memory rather than strdup() */
+		if (get_fs_string(fs, get_column_id(i), &str) == 0)
+			tt_line_set_data_copy(line, i, str);
+		else
+			tt_line_set_data(line, i, get_data(fs, i));
+	}
 
 	tt_line_set_userdata(line, fs);
 	return line;
@@ -871,6 +1176,35 @@ static int match_func(struct libmnt_fs *fs,
 	return !rc;
 }
 
+/*
+ * Returns 0 for the filesystems which will be never printed, the filter does
+ * not use source and target patterns, because they require evaluated tags.
+ */
+static int evaluate_match_func(struct libmnt_fs *fs,
+			       void *data __attribute__ ((__unused__)))
+{
+	const char *m;
+
+	if (flags & (FL_INVERT | FL_SUBMOUNTS))
+		return 1;
+
+	m = get_match(COL_FSTYPE);
+	if (m && !mnt_fs_match_fstype(fs, m))
+		return 0;
+
+	m = get_match(COL_OPTIONS);
+	if (m && !mnt_fs_match_options(fs, m))
+		return 0;
+
+	if ((flags & FL_DF) && !(flags & FL_ALL)) {
+		const char *type = mnt_fs_get_fstype(fs);
+
+		if (!(type && strstr(type, "tmpfs")) && mnt_fs_is_pseudofs(fs))
+			return 0;
+	}
+	return 1;
+}
+
 /* iterate over filesystems in @tb */
 static struct libmnt_fs *get_next_fs(struct libmnt_table *tb,
 				     struct libmnt_iter *itr)
@@ -983,21 +1317,12 @@ static int poll_match(struct libmnt_fs *fs)
 	return rc;
 }
 
-static int poll_table(struct libmnt_table *tb, const char *tabfile,
-		  int timeout, struct tt *tt, int direction)
+static int poll_table(const char *tabfile, int timeout, int interval,
+		      struct tt *tt, int direction)
 {
-	FILE *f = NULL;
 	int rc = -1;
 	struct libmnt_iter *itr = NULL;
-	struct libmnt_table *tb_new = NULL;
-	struct libmnt_tabdiff *diff = NULL;
-	struct pollfd fds[1];
-
-	tb_new = mnt_new_table();
-	if (!tb_new) {
-		warn(_("failed to initialize libmount table"));
-		goto done;
-	}
+	struct libmnt_monitor *mn = NULL;
 
 	itr = mnt_new_iter(direction);
 	if (!itr) {
@@ -1005,33 +1330,26 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 		goto done;
 	}
 
-	diff = mnt_new_tabdiff();
-	if (!diff) {
-		warn(_("failed to initialize libmount tabdiff"));
+	mn = mnt_new_monitor();
+	if (!mn) {
+		warn(_("failed to initialize libmount monitor"));
 		goto done;
 	}
 
-	/* cache is unnecessary to detect changes */
-	mnt_table_set_cache(tb, NULL);
-	mnt_table_set_cache(tb_new, NULL);
+	mnt_monitor_set_parser_errcb(mn, parser_errcb);
+	mnt_monitor_set_interval(mn, interval);
 
-	f = fopen(tabfile, "r");
-	if (!f) {
+	if (mnt_monitor_set_file(mn, tabfile) ||
+	    mnt_monitor_get_fd(mn) < 0) {
 		warn(_("cannot open %s"), tabfile);
 		goto done;
 	}
 
-	mnt_table_set_parser_errcb(tb_new, parser_errcb);
-
-	fds[0].fd = fileno(f);
-	fds[0].events = POLLPRI;
-
 	while (1) {
-		struct libmnt_table *tmp;
 		struct libmnt_fs *old, *new;
 		int change, count;
 
-		count = poll(fds, 1, timeout);
+		count = mnt_monitor_wait(mn, timeout);
 		if (count == 0)
 			break;	/* timeout */
 		if (count < 0) {
@@ -1039,17 +1357,10 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 			goto done;
 		}
 
-		rewind(f);
-		rc = mnt_table_parse_stream(tb_new, f, tabfile);
-		if (!rc)
-			rc = mnt_diff_tables(diff, tb, tb_new);
-		if (rc < 0)
-			goto done;
-
 		count = 0;
 		mnt_reset_iter(itr, direction);
-		while(mnt_tabdiff_next_change(
-				diff, itr, &old, &new, &change) == 0) {
+		while(mnt_monitor_next_change(
+				mn, itr, &old, &new, &change) == 0) {
 
 			if (!has_poll_action(change))
 				continue;
@@ -1069,13 +1380,8 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 				goto done;
 		}
 
-		/* swap tables */
-		tmp = tb;
-		tb = tb_new;
-		tb_new = tmp;
-
 		tt_remove_lines(tt);
-		mnt_reset_table(tb_new);
+		vfs_pool_reset();
 
 		if (count && (flags & FL_FIRSTONLY))
 			break;
@@ -1083,11 +1389,9 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 
 	rc = 0;
 done:
-	mnt_unref_table(tb_new);
-	mnt_free_tabdiff(diff);
+	vfs_pool_reset();
+	mnt_unref_monitor(mn);
 	mnt_free_iter(itr);
-	if (f)
-		fclose(f);
 	return rc;
 }
 
@@ -1119,6 +1423,8 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputc('\n', out);
 	fputs(_(" -p, --poll[=<list>]    monitor changes in table of mounted filesystems\n"), out);
 	fputs(_(" -w, --timeout <num>    upper limit in milliseconds that --poll will block\n"), out);
+	fputs(_("     --poll-interval <num>\n"
+	        "                        minimal delay in milliseconds between --poll updates\n"), out);
 	fputc('\n', out);
 
 	fputs(_(" -A, --all              disable all built-in filters, print all filesystems\n"), out);
@@ -1131,6 +1437,7 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(_(" -F, --tab-file <path>  alternative file for -s, -m or -k options\n"), out);
 	fputs(_(" -f, --first-only       print the first found filesystem only\n"), out);
 	fputs(_(" -i, --invert           invert the sense of matching\n"), out);
+	fputs(_(" -J, --json             use JSON output format\n"), out);
 	fputs(_(" -l, --list             use list format output\n"), out);
 	fputs(_(" -N, --task <tid>       use alternative namespace (/proc/<tid>/mountinfo file)\n"), out);
 	fputs(_(" -n, --noheadings       don't print column headings\n"), out);
@@ -1143,6 +1450,10 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(_(" -t, --types <list>     limit the set of filesystems by FS types\n"), out);
 	fputs(_(" -v, --nofsroot         don't print [/dir] for bind or btrfs mounts\n"), out);
 	fputs(_(" -R, --submounts        print all submounts for the matching filesystems\n"), out);
+	fputs(_("     --skip-netfs       don't read SIZE, AVAIL, USED and USE% of network filesystems\n"), out);
+	fputs(_("     --statvfs-timeout <num>\n"
+	        "                        upper limit in milliseconds to wait for SIZE, AVAIL, USED\n"
+	        "                          and USE% of one filesystem\n"), out);
 	fputs(_(" -S, --source <string>  the device to mount (by name, maj:min, \n"
 	        "                          LABEL=, UUID=, PARTUUID=, PARTLABEL=)\n"), out);
 	fputs(_(" -T, --target <string>  the mountpoint to use\n"), out);
@@ -1166,12 +1477,18 @@ int main(int argc, char *argv[])
 	struct libmnt_table *tb = NULL;
 	char **tabfiles = NULL;
 	int direction = MNT_ITER_FORWARD;
-	int i, c, rc = -1, timeout = -1;
+	int i, c, rc = -1, timeout = -1, interval = 0;
 	int ntabfiles = 0, tabtype = 0;
 	char *outarg = NULL;
 
 	struct tt *tt = NULL;
 
+	enum {
+		FINDMNT_OPT_POLL_INTERVAL = CHAR_MAX + 1,
+		FINDMNT_OPT_SKIP_NETFS,
+		FINDMNT_OPT_STATVFS_TIMEOUT
+	};
+
 	static const struct option longopts[] = {
 	    { "all",          0, 0, 'A' },
 	    { "ascii",        0, 0, 'a' },
@@ -1183,6 +1500,7 @@ int main(int argc, char *argv[])
 	    { "fstab",        0, 0, 's' },
 	    { "help",         0, 0, 'h' },
 	    { "invert",       0, 0, 'i' },
+	    { "json",         0, 0, 'J' },
 	    { "kernel",       0, 0, 'k' },
 	    { "list",         0, 0, 'l' },
 	    { "mtab",         0, 0, 'm' },
@@ -1191,10 +1509,13 @@ int main(int argc, char *argv[])
 	    { "options",      1, 0, 'O' },
 	    { "output",       1, 0, 'o' },
 	    { "poll",         2, 0, 'p' },
+	    { "poll-interval", 1, 0, FINDMNT_OPT_POLL_INTERVAL },
 	    { "pairs",        0, 0, 'P' },
 	    { "raw",          0, 0, 'r' },
 	    { "types",        1, 0, 't' },
 	    { "nofsroot",     0, 0, 'v' },
+	    { "skip-netfs",   0, 0, FINDMNT_OPT_SKIP_NETFS },
+	    { "statvfs-timeout", 1, 0, FINDMNT_OPT_STATVFS_TIMEOUT },
 	    { "submounts",    0, 0, 'R' },
 	    { "source",       1, 0, 'S' },
 	    { "tab-file",     1, 0, 'F' },
@@ -1208,6 +1529,7 @@ int main(int argc, char *argv[])
 	};
 
 	static const ul_excl_t excl[] = {	/* rows and cols in in ASCII order */
+		{ 'J','P','r' },		/* json,pairs,raw */
 		{ 'N','k','m','s' },		/* task,kernel,mtab,fstab */
 		{ 'P','l','r' },		/* pairs,list,raw */
 		{ 'm','p','s' },		/* mtab,poll,fstab */
@@ -1226,7 +1548,7 @@ int main(int argc, char *argv[])
 	tt_flags |= TT_FL_TREE;
 
 	while ((c = getopt_long(argc, argv,
-				"AacDd:ehifF:o:O:p::PklmnN:rst:uvRS:T:Uw:V",
+				"AacDd:ehifF:o:O:p::PklmnN:rst:uvRS:T:Uw:VJ",
 				longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
@@ -1314,6 +1636,9 @@ int main(int argc, char *argv[])
 		case 'l':
 			tt_flags &= ~TT_FL_TREE; /* disable the default */
 			break;
+		case 'J':
+			tt_flags |= TT_FL_JSON;
+			break;
 		case 'n':
 			tt_flags |= TT_FL_NOHEADINGS;
 			break;
@@ -1343,6 +1668,17 @@ int main(int argc, char *argv[])
 		case 'w':
 			timeout = strtos32_or_err(optarg, _("invalid timeout argument"));
 			break;
+		case FINDMNT_OPT_POLL_INTERVAL:
+			interval = strtou32_or_err(optarg, _("invalid poll interval argument"));
+			if (interval < 0)
+				errx(EXIT_FAILURE, _("invalid poll interval argument"));
+			break;
+		case FINDMNT_OPT_SKIP_NETFS:
+			flags |= FL_NONETFS;
+			break;
+		case FINDMNT_OPT_STATVFS_TIMEOUT:
+			vfs_timeout = strtos32_or_err(optarg, _("invalid timeout argument"));
+			break;
 		case 'V':
 			printf(UTIL_LINUX_VERSION);
 			return EXIT_SUCCESS;
@@ -1435,17 +1771,29 @@ int main(int argc, char *argv[])
 	}
 	mnt_table_set_cache(tb, cache);
 
-	if (flags & FL_UNIQ)
+	if (flags & FL_EVALUATE)
+		/* all the tags from the table by one blkid call */
+		mnt_cache_resolve_table_tags(cache, tb, evaluate_match_func, NULL);
+
+	if ((flags & FL_UNIQ) && tabtype == TABTYPE_KERNEL)
+		/* kernel paths are already canonicalized */
+		mnt_table_uniq_fs_by_key(tb, MNT_UNIQ_KEEPTREE, MNT_UNIQ_TARGET);
+	else if (flags & FL_UNIQ)
 		mnt_table_uniq_fs(tb, MNT_UNIQ_KEEPTREE, uniq_fs_target_cmp);
 
 	/*
-	 * initialize output formatting (tt.h)
+	 * initialize output formatting (tt.h), the list is printed as the
+	 * lines are added, --submounts needs all lines to detect duplicates
 	 */
+	if (!(tt_flags & TT_FL_TREE) && !(flags & FL_SUBMOUNTS))
+		tt_flags |= TT_FL_STREAM;
+
 	tt = tt_new_table(tt_flags | TT_FL_FREEDATA);
 	if (!tt) {
 		warn(_("failed to initialize output table"));
 		goto leave;
 	}
+	tt_set_name(tt, "filesystems");
 
 	for (i = 0; i < ncolumns; i++) {
 		int fl = get_column_flags(i);
@@ -1466,12 +1814,16 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (!(flags & (FL_POLL | FL_FIRSTONLY)) && has_vfs_column())
+		vfs_prefetch(tb);
+
 	/*
 	 * Fill in data to the output table
 	 */
 	if (flags & FL_POLL) {
 		/* poll mode (accept the first tabfile only) */
-		rc = poll_table(tb, tabfiles ? *tabfiles : _PATH_PROC_MOUNTINFO, timeout, tt, direction);
+		rc = poll_table(tabfiles ? *tabfiles : _PATH_PROC_MOUNTINFO,
+				timeout, interval, tt, direction);
 
 	} else if ((tt_flags & TT_FL_TREE) && !(flags & FL_SUBMOUNTS)) {
 		/* whole tree */
@@ -1501,6 +1853,8 @@ int main(int argc, char *argv[])
 		tt_print_table(tt);
 leave:
 	tt_free_table(tt);
+	vfs_pool_reset();
+	free(vfspool.queue);
 
 	mnt_unref_table(tb);
 	mnt_unref_cache(cache);
@@ -157,6 +157,8 @@ int main (int argc, char *argv[])
     int errors, numsig, pid;
     char *ep, *arg;
     int do_pid, do_kill, check_all;
+    struct proc_snapshot snap;
+    int has_snap = 0;
 
     setlocale(LC_ALL, "");
     bindtextdomain(PACKAGE, LOCALEDIR);
@@ -283,19 +285,22 @@ int main (int argc, char *argv[])
 	if (! *ep)
 	    errors += kill_verbose (arg, pid, numsig);
 	else  {
-	    struct proc_processes *ps = proc_open_processes();
+	    struct proc_entry **ents;
+	    size_t i, n;
 	    int ct = 0;
 
-	    if (!ps)
-	        continue;
-
-	    if (!check_all)
-		proc_processes_filter_by_uid(ps, getuid());
-
-	    proc_processes_filter_by_name(ps, arg);
+	    /* /proc is read only once for all the names */
+	    if (!has_snap) {
+		if (proc_snapshot_read(&snap, 0) != 0)
+		    continue;
+		has_snap = 1;
+	    }
 
-	    while (proc_next_pid(ps, &pid) == 0) {
-		errors += kill_verbose(arg, pid, numsig);
+	    ents = proc_snapshot_get_name(&snap, arg, &n);
+	    for (i = 0; i < n; i++) {
+		if (!check_all && ents[i]->uid != getuid())
+		    continue;
+		errors += kill_verbose(arg, ents[i]->pid, numsig);
 		ct++;
 	    }
 
@@ -303,9 +308,10 @@ int main (int argc, char *argv[])
 		errors++;
 		warnx (_("cannot find process \"%s\""), arg);
 	    }
-	    proc_close_processes(ps);
 	}
     }
+    if (has_snap)
+	proc_snapshot_deinit(&snap);
     if (errors != 0)
 	errors = EXIT_FAILURE;
     return errors;
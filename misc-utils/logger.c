@@ -46,6 +46,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <getopt.h>
@@ -125,7 +126,29 @@ static int pencode(char *s)
 	return ((lev & LOG_PRIMASK) | (fac & LOG_FACMASK));
 }
 
-static int unix_socket(const char *path, const int socket_type)
+/* the messages read from stdin are sent in batches, see logger_flush() */
+#define LOGGER_BATCHSZ	64
+#define LOGGER_MSGSZ	1000
+
+struct logger_ctl {
+	int	fd;
+	int	logflags;
+	int	socket_type;
+	int	stream;			/* fd is SOCK_STREAM */
+	char	*unix_socket;
+	char	*server;
+	char	*port;
+
+	char	hdr[256];		/* "tag[pid]: " */
+	time_t	now;
+	char	timestamp[16];		/* "Mmm dd hh:mm:ss" of 'now' */
+
+	size_t	nmsgs;
+	struct iovec iov[LOGGER_BATCHSZ];
+	char	msgs[LOGGER_BATCHSZ][LOGGER_MSGSZ];
+};
+
+static int unix_socket(const char *path, const int socket_type, int quiet)
 {
 	int fd, i;
 	static struct sockaddr_un s_addr;	/* AF_UNIX address of local logger */
@@ -152,14 +175,16 @@ static int unix_socket(const char *path, const int socket_type)
 		break;
 	}
 
-	if (i == 0)
+	if (i == 0) {
+		if (quiet)
+			return -1;
 		err(EXIT_FAILURE, _("socket %s"), path);
-
+	}
 	return fd;
 }
 
 static int inet_socket(const char *servername, const char *port,
-		       const int socket_type)
+		       const int socket_type, int quiet)
 {
 	int fd, errcode, i;
 	struct addrinfo hints, *res;
@@ -181,9 +206,12 @@ static int inet_socket(const char *servername, const char *port,
 			continue;
 		hints.ai_family = AF_UNSPEC;
 		errcode = getaddrinfo(servername, p, &hints, &res);
-		if (errcode != 0)
+		if (errcode != 0) {
+			if (quiet)
+				return -1;
 			errx(EXIT_FAILURE, _("failed to resolve name %s port %s: %s"),
 			     servername, p, gai_strerror(errcode));
+		}
 		if ((fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) == -1) {
 			freeaddrinfo(res);
 			continue;
@@ -198,38 +226,216 @@ static int inet_socket(const char *servername, const char *port,
 		break;
 	}
 
-	if (i == 0)
+	if (i == 0) {
+		if (quiet)
+			return -1;
 		errx(EXIT_FAILURE, _("failed to connect to %s port %s"), servername, p);
-
+	}
 	return fd;
 }
 
-static void mysyslog(int fd, int logflags, int pri, char *tag, char *msg)
+static int logger_open(struct logger_ctl *ctl, int quiet)
+{
+	int st = 0;
+	socklen_t len = sizeof(st);
+
+	if (ctl->server)
+		ctl->fd = inet_socket(ctl->server, ctl->port, ctl->socket_type, quiet);
+	else
+		ctl->fd = unix_socket(ctl->unix_socket, ctl->socket_type, quiet);
+	if (ctl->fd < 0)
+		return -1;
+
+	ctl->stream = getsockopt(ctl->fd, SOL_SOCKET, SO_TYPE, &st, &len) == 0
+			&& st == SOCK_STREAM;
+	return 0;
+}
+
+/*
+ * Sends the queued messages from @idx; returns number of the completely sent
+ * messages or -1 on error. A partially written message on stream socket is
+ * not counted, its iovec is adjusted to the rest of the message.
+ */
+static ssize_t logger_send(struct logger_ctl *ctl, size_t idx)
+{
+	size_t n = ctl->nmsgs - idx;
+	ssize_t rc;
+
+	if (ctl->stream) {
+		struct msghdr mh = { .msg_iov = &ctl->iov[idx], .msg_iovlen = n };
+		size_t done;
+
+		rc = sendmsg(ctl->fd, &mh, MSG_NOSIGNAL);
+		if (rc < 0)
+			return -1;
+		for (done = 0; done < n; done++) {
+			struct iovec *iov = &ctl->iov[idx + done];
+
+			if ((size_t) rc < iov->iov_len) {
+				iov->iov_base = (char *) iov->iov_base + rc;
+				iov->iov_len -= rc;
+				break;
+			}
+			rc -= iov->iov_len;
+		}
+		return done;
+	}
+#ifdef HAVE_SENDMMSG
+	{
+		struct mmsghdr mh[LOGGER_BATCHSZ];
+		size_t i;
+
+		memset(mh, 0, n * sizeof(struct mmsghdr));
+		for (i = 0; i < n; i++) {
+			mh[i].msg_hdr.msg_iov = &ctl->iov[idx + i];
+			mh[i].msg_hdr.msg_iovlen = 1;
+		}
+		rc = sendmmsg(ctl->fd, mh, n, MSG_NOSIGNAL);
+		if (rc < 0 && errno == ENOSYS)
+			rc = send(ctl->fd, ctl->iov[idx].iov_base,
+				  ctl->iov[idx].iov_len, MSG_NOSIGNAL) < 0 ? -1 : 1;
+	}
+#else
+	rc = send(ctl->fd, ctl->iov[idx].iov_base,
+		  ctl->iov[idx].iov_len, MSG_NOSIGNAL) < 0 ? -1 : 1;
+#endif
+	return rc;
+}
+
+/*
+ * Writes all the queued messages to the socket. The connection is kept open
+ * for all messages; when the syslog daemon closes it (restart, rotation...)
+ * we reconnect once and resend the rest of the batch. The messages are
+ * silently dropped on error as it has been always done by logger.
+ */
+static void logger_flush(struct logger_ctl *ctl)
 {
-       char buf[1000], pid[30], *cp, *tp;
-       time_t now;
-
-       if (fd > -1) {
-               if (logflags & LOG_PID)
-                       snprintf (pid, sizeof(pid), "[%d]", getpid());
-	       else
-		       pid[0] = 0;
-               if (tag)
-		       cp = tag;
-	       else {
-		       cp = getlogin();
-		       if (!cp)
-			       cp = "<someone>";
-	       }
-               (void)time(&now);
-	       tp = ctime(&now)+4;
-
-               snprintf(buf, sizeof(buf), "<%d>%.15s %.200s%s: %.400s",
-			pri, tp, cp, pid, msg);
-
-               if (write(fd, buf, strlen(buf)+1) < 0)
-                       return; /* error */
-       }
+	size_t idx = 0;
+	int reconnect = 1;
+
+	while (idx < ctl->nmsgs) {
+		ssize_t rc;
+
+		if (ctl->fd >= 0)
+			rc = logger_send(ctl, idx);
+		else {
+			rc = -1;
+			errno = ENOTCONN;
+		}
+		if (rc > 0) {
+			idx += rc;
+			continue;
+		}
+		if (rc == 0 || errno == EINTR)
+			continue;
+		if (!reconnect--)
+			break;
+		if (ctl->fd >= 0) {
+			if (errno != ECONNREFUSED && errno != ENOTCONN &&
+			    errno != ECONNRESET && errno != EPIPE)
+				break;
+			close(ctl->fd);
+		}
+		if (logger_open(ctl, 1) != 0)
+			break;
+
+		/* don't send the rest of a half-written message to the new
+		 * connection */
+		if (ctl->iov[idx].iov_base != ctl->msgs[idx])
+			idx++;
+	}
+	ctl->nmsgs = 0;
+}
+
+/* queues the message, the batch is sent by logger_flush() */
+static void mysyslog(struct logger_ctl *ctl, int pri, char *msg)
+{
+	time_t now;
+	char *buf;
+	int len;
+
+	if (ctl->nmsgs == LOGGER_BATCHSZ)
+		logger_flush(ctl);
+
+	time(&now);
+	if (now != ctl->now) {
+		ctl->now = now;
+		memcpy(ctl->timestamp, ctime(&now) + 4, 15);
+	}
+
+	buf = ctl->msgs[ctl->nmsgs];
+	len = snprintf(buf, LOGGER_MSGSZ, "<%d>%.15s %s%.400s",
+			pri, ctl->timestamp, ctl->hdr, msg);
+	if (len < 0)
+		return;
+	if (len >= LOGGER_MSGSZ)
+		len = LOGGER_MSGSZ - 1;
+
+	ctl->iov[ctl->nmsgs].iov_base = buf;
+	ctl->iov[ctl->nmsgs].iov_len = len + 1;	/* including terminator */
+	ctl->nmsgs++;
+}
+
+static void logger_msg(struct logger_ctl *ctl, int pri, char *msg)
+{
+	if (!ctl->unix_socket && !ctl->server)
+		syslog(pri, "%s", msg);
+	else
+		mysyslog(ctl, pri, msg);
+}
+
+static void logger_line(struct logger_ctl *ctl, char *msg, int pri, int prio_prefix)
+{
+	if (prio_prefix && msg[0] == '<')
+		msg = get_prio_prefix(msg, &pri);
+	logger_msg(ctl, pri, msg);
+}
+
+/*
+ * Reads stdin in big blocks and logs one message for each line. The lines
+ * are split to the same messages as by fgets() with 1024 bytes buffer. All
+ * lines from one read() are sent by one system call, so there is no delay
+ * for interactive input.
+ */
+static void logger_stdin(struct logger_ctl *ctl, int pri, int prio_prefix)
+{
+	char buf[64 * 1024], line[1024];
+	size_t len = 0;
+	int eof = 0;
+
+	while (!eof) {
+		size_t off = 0;
+		ssize_t rc = read(STDIN_FILENO, buf + len, sizeof(buf) - len);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			eof = 1;
+		else
+			len += rc;
+
+		while (off < len) {
+			size_t sz = min(len - off, sizeof(line) - 1);
+			char *nl = memchr(buf + off, '\n', sz);
+
+			if (nl)
+				sz = nl - (buf + off) + 1;
+			else if (sz < sizeof(line) - 1 && !eof)
+				break;		/* incomplete line */
+
+			memcpy(line, buf + off, sz);
+			line[nl ? sz - 1 : sz] = '\0';
+			off += sz;
+
+			logger_line(ctl, line, pri, prio_prefix);
+		}
+		if (off) {
+			len -= off;
+			memmove(buf, buf + off, len);
+		}
+		if (ctl->nmsgs)
+			logger_flush(ctl);
+	}
 }
 
 static void __attribute__ ((__noreturn__)) usage(FILE *out)
@@ -266,12 +472,9 @@ static void __attribute__ ((__noreturn__)) usage(FILE *out)
  */
 int main(int argc, char **argv)
 {
-	int ch, logflags, pri, prio_prefix;
+	int ch, pri, prio_prefix;
 	char *tag, buf[1024];
-	char *usock = NULL;
-	char *server = NULL;
-	char *port = NULL;
-	int LogSock = -1, socket_type = ALL_TYPES;
+	static struct logger_ctl ctl;	/* too large for stack */
 
 	static const struct option longopts[] = {
 		{ "id",		no_argument,	    0, 'i' },
@@ -295,9 +498,10 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
+	ctl.fd = -1;
+	ctl.socket_type = ALL_TYPES;
 	tag = NULL;
 	pri = LOG_NOTICE;
-	logflags = 0;
 	prio_prefix = 0;
 	while ((ch = getopt_long(argc, argv, "f:ip:st:u:dTn:P:Vh",
 					    longopts, NULL)) != -1) {
@@ -308,31 +512,31 @@ int main(int argc, char **argv)
 				    optarg);
 			break;
 		case 'i':		/* log process id also */
-			logflags |= LOG_PID;
+			ctl.logflags |= LOG_PID;
 			break;
 		case 'p':		/* priority */
 			pri = pencode(optarg);
 			break;
 		case 's':		/* log to standard error */
-			logflags |= LOG_PERROR;
+			ctl.logflags |= LOG_PERROR;
 			break;
 		case 't':		/* tag */
 			tag = optarg;
 			break;
 		case 'u':		/* unix socket */
-			usock = optarg;
+			ctl.unix_socket = optarg;
 			break;
 		case 'd':
-			socket_type = TYPE_UDP;
+			ctl.socket_type = TYPE_UDP;
 			break;
 		case 'T':
-			socket_type = TYPE_TCP;
+			ctl.socket_type = TYPE_TCP;
 			break;
 		case 'n':
-			server = optarg;
+			ctl.server = optarg;
 			break;
 		case 'P':
-			port = optarg;
+			ctl.port = optarg;
 			break;
 		case 'V':
 			printf(UTIL_LINUX_VERSION);
@@ -351,12 +555,24 @@ int main(int argc, char **argv)
 	argv += optind;
 
 	/* setup for logging */
-	if (server)
-		LogSock = inet_socket(server, port, socket_type);
-	else if (usock)
-		LogSock = unix_socket(usock, socket_type);
-	else
-		openlog(tag ? tag : getlogin(), logflags, 0);
+	if (ctl.server || ctl.unix_socket) {
+		char pid[30];
+		const char *cp = tag;
+
+		logger_open(&ctl, 0);
+
+		if (ctl.logflags & LOG_PID)
+			snprintf(pid, sizeof(pid), "[%d]", getpid());
+		else
+			pid[0] = 0;
+		if (!cp) {
+			cp = getlogin();
+			if (!cp)
+				cp = "<someone>";
+		}
+		snprintf(ctl.hdr, sizeof(ctl.hdr), "%.200s%s: ", cp, pid);
+	} else
+		openlog(tag ? tag : getlogin(), ctl.logflags, 0);
 
 	/* log input line if appropriate */
 	if (argc > 0) {
@@ -366,56 +582,29 @@ int main(int argc, char **argv)
 		for (p = buf, endp = buf + sizeof(buf) - 2; *argv;) {
 			len = strlen(*argv);
 			if (p + len > endp && p > buf) {
-			    if (!usock && !server)
-				syslog(pri, "%s", buf);
-			    else
-				mysyslog(LogSock, logflags, pri, tag, buf);
+				logger_msg(&ctl, pri, buf);
 				p = buf;
 			}
-			if (len > sizeof(buf) - 1) {
-			    if (!usock && !server)
-				syslog(pri, "%s", *argv++);
-			    else
-				mysyslog(LogSock, logflags, pri, tag, *argv++);
-			} else {
+			if (len > sizeof(buf) - 1)
+				logger_msg(&ctl, pri, *argv++);
+			else {
 				if (p != buf)
 					*p++ = ' ';
 				memmove(p, *argv++, len);
 				*(p += len) = '\0';
 			}
 		}
-		if (p != buf) {
-		    if (!usock && !server)
-			syslog(pri, "%s", buf);
-		    else
-			mysyslog(LogSock, logflags, pri, tag, buf);
-		}
-	} else {
-		char *msg;
-		int default_priority = pri;
-		while (fgets(buf, sizeof(buf), stdin) != NULL) {
-		    /* glibc is buggy and adds an additional newline,
-		       so we have to remove it here until glibc is fixed */
-		    int len = strlen(buf);
-
-		    if (len > 0 && buf[len - 1] == '\n')
-			    buf[len - 1] = '\0';
-
-			msg = buf;
-			pri = default_priority;
-			if (prio_prefix && msg[0] == '<')
-				msg = get_prio_prefix(msg, &pri);
-
-		    if (!usock && !server)
-			syslog(pri, "%s", msg);
-		    else
-			mysyslog(LogSock, logflags, pri, tag, msg);
-		}
-	}
-	if (!usock && !server)
+		if (p != buf)
+			logger_msg(&ctl, pri, buf);
+		if (ctl.nmsgs)
+			logger_flush(&ctl);
+	} else
+		logger_stdin(&ctl, pri, prio_prefix);
+
+	if (!ctl.unix_socket && !ctl.server)
 		closelog();
-	else
-		close(LogSock);
+	else if (ctl.fd >= 0)
+		close(ctl.fd);
 
 	return EXIT_SUCCESS;
 }
@@ -57,8 +57,11 @@
 #include <ctype.h>
 #include <getopt.h>
 
+#include <stdint.h>
+#include <unistd.h>
+
 #include "nls.h"
-#include "xalloc.h"
+#include "c.h"
 #include "pathnames.h"
 #include "closestream.h"
 
@@ -67,11 +70,13 @@
 #define	LESS		(-1)
 
 int dflag, fflag;
-/* uglified the source a bit with globals, so that we only need
-   to allocate comparbuf once */
-int stringlen;
+/* uglified the source a bit with globals, the string is folded and
+   the translation tables are initialized only once */
+size_t stringlen;
 char *string;
-char *comparbuf;
+
+static unsigned char fold_tbl[256];	/* -f: tolower() */
+static unsigned char keep_tbl[256];	/* -d: isalnum() */
 
 static char *binary_search (char *, char *);
 static int compare (char *, char *);
@@ -152,6 +157,11 @@ main(int argc, char *argv[])
 
 	if ((fd = open(file, O_RDONLY, 0)) < 0 || fstat(fd, &sb))
 		err(EXIT_FAILURE, "%s", file);
+	if (sb.st_size == 0)
+		return EXIT_FAILURE;		/* nothing to search */
+	if ((uintmax_t) sb.st_size > SIZE_MAX)
+		errx(EXIT_FAILURE, _("%s: file too large"), file);
+
 	front = mmap(NULL, (size_t) sb.st_size, PROT_READ,
 #ifdef MAP_FILE
 		     MAP_FILE |
@@ -175,32 +185,52 @@ main(int argc, char *argv[])
 	return look(front, back);
 }
 
+#if defined(MADV_RANDOM) && defined(MADV_SEQUENTIAL)
+/* random access for binary search, sequential for print */
+static void advise(char *front, char *back, int advice)
+{
+	static long pagesz;
+	uintptr_t start;
+
+	if (!pagesz)
+		pagesz = sysconf(_SC_PAGESIZE);
+
+	start = (uintptr_t) front & ~((uintptr_t) pagesz - 1);
+	madvise((void *) start, back - (char *) start, advice);
+}
+#endif
+
 int
 look(char *front, char *back)
 {
 	int ch;
 	char *readp, *writep;
 
-	/* Reformat string string to avoid doing it multiple times later. */
-	if (dflag) {
-		for (readp = writep = string; (ch = *readp++) != 0;) {
-			if (isalnum(ch))
-				*(writep++) = ch;
-		}
-		*writep = '\0';
-		stringlen = writep - string;
-	} else
-		stringlen = strlen(string);
+	for (ch = 0; ch < 256; ch++) {
+		fold_tbl[ch] = fflag ? tolower(ch) : ch;
+		keep_tbl[ch] = !dflag || isalnum(ch);
+	}
 
-	comparbuf = xmalloc(stringlen+1);
+	/* Reformat string string to avoid doing it multiple times later. */
+	for (readp = writep = string; (ch = (unsigned char) *readp++) != 0;) {
+		if (keep_tbl[ch])
+			*(writep++) = fold_tbl[ch];
+	}
+	*writep = '\0';
+	stringlen = writep - string;
 
+#if defined(MADV_RANDOM) && defined(MADV_SEQUENTIAL)
+	advise(front, back, MADV_RANDOM);
+#endif
 	front = binary_search(front, back);
 	front = linear_search(front, back);
 
-	if (front)
+	if (front) {
+#if defined(MADV_RANDOM) && defined(MADV_SEQUENTIAL)
+		advise(front, back, MADV_SEQUENTIAL);
+#endif
 		print_from(front, back);
-
-	free(comparbuf);
+	}
 
 	return (front ? 0 : 1);
 }
@@ -241,7 +271,17 @@ look(char *front, char *back)
  *	more trouble than it's worth.
  */
 #define	SKIP_PAST_NEWLINE(p, back) \
-	while (p < back && *p++ != '\n')
+	(p = skip_past_newline(p, back))
+
+static inline char *skip_past_newline(char *p, char *back)
+{
+	char *nl;
+
+	if (p >= back)
+		return p;
+	nl = memchr(p, '\n', back - p);
+	return nl ? nl + 1 : back;
+}
 
 char *
 binary_search(char *front, char *back)
@@ -302,19 +342,12 @@ linear_search(char *front, char *back)
 void
 print_from(char *front, char *back)
 {
-	int eol;
-
 	while (front < back && compare(front, back) == EQUAL) {
-		if (compare(front, back) == EQUAL) {
-			eol = 0;
-			while (front < back && !eol) {
-				if (putchar(*front) == EOF)
-					err(EXIT_FAILURE, "stdout");
-				if (*front++ == '\n')
-					eol = 1;
-			}
-		} else
-			SKIP_PAST_NEWLINE(front, back);
+		char *eol = skip_past_newline(front, back);
+
+		if (fwrite(front, 1, eol - front, stdout) != (size_t) (eol - front))
+			err(EXIT_FAILURE, "stdout");
+		front = eol;
 	}
 }
 
@@ -328,37 +361,43 @@ print_from(char *front, char *back)
  * Compare understands about the -f and -d flags, and treats comparisons
  * appropriately.
  *
- * The string "string" is null terminated.  The string "s2" is '\n' terminated
- * (or "s2end" terminated).
+ * The string "string" is null terminated and already folded.  The string
+ * "s2" is '\n' terminated (or "s2end" terminated).
  *
- * We use strcasecmp etc, since it knows how to ignore case also
- * in other locales.
+ * The -f and -d flags are implemented by translation tables, initialized
+ * by tolower() and isalnum(), so the case is ignored also in other locales.
+ * Without the flags memchr() and memcmp() are used.
  */
 int
 compare(char *s2, char *s2end) {
-	int i;
-	char *p;
-
-	/* copy, ignoring things that should be ignored */
-	p = comparbuf;
-	i = stringlen;
-	while(s2 < s2end && *s2 != '\n' && i) {
-		if (!dflag || isalnum(*s2))
-		{
-			*p++ = *s2;
-			i--;
-		}
-		s2++;
+	const unsigned char *p = (unsigned char *) s2,
+			    *end = (unsigned char *) s2end,
+			    *str = (unsigned char *) string;
+	size_t i = 0;
+
+	if (!dflag && !fflag) {
+		size_t n = min((size_t) (end - p), stringlen);
+		const unsigned char *nl = memchr(p, '\n', n);
+		int rc;
+
+		if (nl)
+			n = nl - p;
+		rc = memcmp(p, str, n);
+		if (rc == 0 && n < stringlen)
+			rc = -1;		/* line is shorter */
+		return ((rc > 0) ? LESS : (rc < 0) ? GREATER : EQUAL);
 	}
-	*p = 0;
 
-	/* and compare */
-	if (fflag)
-		i = strncasecmp(comparbuf, string, stringlen);
-	else
-		i = strncmp(comparbuf, string, stringlen);
+	for (; p < end && *p != '\n' && i < stringlen; p++) {
+		unsigned char c = fold_tbl[*p];
 
-	return ((i > 0) ? LESS : (i < 0) ? GREATER : EQUAL);
+		if (!keep_tbl[*p])
+			continue;
+		if (c != str[i])
+			return c > str[i] ? LESS : GREATER;
+		i++;
+	}
+	return i < stringlen ? GREATER : EQUAL;
 }
 
 static void __attribute__ ((__noreturn__)) usage(FILE * out)
@@ -46,6 +46,13 @@
 #include <libudev.h>
 #endif
 
+/* udev context is not thread-safe, every probing thread needs its own */
+#if defined(HAVE_LIBPTHREAD) && (defined(HAVE_TLS) || !defined(HAVE_LIBUDEV))
+# define LSBLK_PROBE_THREADS	1
+# include <pthread.h>
+# include <time.h>
+#endif
+
 #include <assert.h>
 
 #include "c.h"
@@ -56,7 +63,6 @@
 #include "tt.h"
 #include "xalloc.h"
 #include "strutils.h"
-#include "at.h"
 #include "sysfs.h"
 #include "closestream.h"
 #include "mangle.h"
@@ -69,6 +75,7 @@ enum {
 	COL_MAJMIN,
 	COL_FSTYPE,
 	COL_TARGET,
+	COL_TARGETS,
 	COL_LABEL,
 	COL_UUID,
 	COL_PARTLABEL,
@@ -122,6 +129,7 @@ static struct colinfo infos[] = {
 	[COL_MAJMIN] = { "MAJ:MIN", 6, 0, N_("major:minor device number") },
 	[COL_FSTYPE] = { "FSTYPE",  0.1, TT_FL_TRUNC, N_("filesystem type") },
 	[COL_TARGET] = { "MOUNTPOINT", 0.10, TT_FL_TRUNC, N_("where the device is mounted") },
+	[COL_TARGETS] = { "MOUNTPOINTS", 0.10, TT_FL_TRUNC, N_("all locations where the device is mounted") },
 	[COL_LABEL]  = { "LABEL",   0.1, 0, N_("filesystem LABEL") },
 	[COL_UUID]   = { "UUID",    36,  0, N_("filesystem UUID") },
 
@@ -168,6 +176,9 @@ struct lsblk {
 	unsigned int nodeps:1;		/* don't print slaves/holders */
 	unsigned int scsi:1;		/* print only device with HCTL (SCSI) */
 	unsigned int paths:1;		/* print devnames with "/dev" prefix */
+
+	struct sysfs_blktopo topo;	/* snapshot of /sys/block */
+	struct probe_queue *probeq;	/* deferred probing or NULL */
 };
 
 struct lsblk *lsblk;	/* global handler */
@@ -183,10 +194,13 @@ static int includes[256];
 static size_t nincludes;
 
 static struct libmnt_table *mtab, *swaps;
-static struct libmnt_cache *mntcache;
 
 #ifdef HAVE_LIBUDEV
+# ifdef LSBLK_PROBE_THREADS
+static __thread struct udev *udev;
+# else
 struct udev *udev;
+# endif
 #endif
 
 struct blkdev_cxt {
@@ -201,6 +215,8 @@ struct blkdev_cxt {
 	char *filename;		/* path to device node */
 
 	struct sysfs_cxt  sysfs;
+	struct sysfs_blkdev *blkdev;	/* device in lsblk->topo */
+	struct probe_job *job;		/* deferred probing */
 
 	int partition;		/* is partition? TRUE/FALSE */
 
@@ -306,23 +322,6 @@ static int is_dm(const char *name)
 	return strncmp(name, "dm-", 3) ? 0 : 1;
 }
 
-static struct dirent *xreaddir(DIR *dp)
-{
-	struct dirent *d;
-
-	assert(dp);
-
-	while ((d = readdir(dp))) {
-		if (!strcmp(d->d_name, ".") ||
-		    !strcmp(d->d_name, ".."))
-			continue;
-
-		/* blacklist here? */
-		break;
-	}
-	return d;
-}
-
 static char *get_device_path(struct blkdev_cxt *cxt)
 {
 	char path[PATH_MAX];
@@ -337,87 +336,241 @@ static char *get_device_path(struct blkdev_cxt *cxt)
 	return xstrdup(path);
 }
 
-static int is_active_swap(const char *filename)
+/*
+ * Mountpoints index -- mountinfo and /proc/swaps are parsed only once and
+ * the entries are sorted by device number, the paths are not canonicalized.
+ */
+struct mountpoint {
+	dev_t			devno;
+	size_t			idx;		/* order in the tables */
+	struct libmnt_fs	*fs;
+	int			swap;
+};
+
+static struct mountpoint *mountpoints;
+static size_t nmountpoints;
+static int mountpoints_loaded;
+
+/*
+ * Note that maj:min in /proc/self/mountinfo does not have to match with
+ * devno as returned by stat() (e.g. btrfs), so try the source device too.
+ */
+static dev_t get_fs_devno(struct libmnt_fs *fs, int swap)
 {
-	if (!swaps) {
-		swaps = mnt_new_table();
-		if (!swaps)
-			return 0;
-		if (!mntcache)
-			mntcache = mnt_new_cache();
-
-		mnt_table_set_cache(swaps, mntcache);
-		mnt_table_parse_swaps(swaps, NULL);
-	}
+	const char *src;
+	struct stat st;
+	dev_t devno = swap ? 0 : mnt_fs_get_devno(fs);
 
-	return mnt_table_find_srcpath(swaps, filename, MNT_ITER_BACKWARD) != 0;
+	if (major(devno))
+		return devno;
+
+	src = mnt_fs_get_srcpath(fs);
+	if (src && *src == '/' && stat(src, &st) == 0 && S_ISBLK(st.st_mode))
+		return st.st_rdev;
+	return devno;
 }
 
-static char *get_device_mountpoint(struct blkdev_cxt *cxt)
+static void add_mountpoints(struct libmnt_table *tb, int swap)
 {
+	struct libmnt_iter *itr;
 	struct libmnt_fs *fs;
-	const char *fsroot;
+
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr)
+		return;
+
+	while (mnt_table_next_fs(tb, itr, &fs) == 0) {
+		struct mountpoint *mp;
+		dev_t devno = get_fs_devno(fs, swap);
+
+		if (!devno)
+			continue;
+		if (nmountpoints % 64 == 0)
+			mountpoints = xrealloc(mountpoints,
+				(nmountpoints + 64) * sizeof(struct mountpoint));
+		mp = &mountpoints[nmountpoints];
+		mp->devno = devno;
+		mp->idx = nmountpoints++;
+		mp->fs = fs;
+		mp->swap = swap;
+	}
+	mnt_free_iter(itr);
+}
+
+static int cmp_mountpoints(const void *a, const void *b)
+{
+	const struct mountpoint *x = a, *y = b;
+
+	if (x->devno != y->devno)
+		return x->devno < y->devno ? -1 : 1;
+	return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+static void load_mountpoints(void)
+{
+	mountpoints_loaded = 1;
+
+	mtab = mnt_new_table();
+	if (mtab && mnt_table_parse_mtab(mtab, NULL) == 0)
+		add_mountpoints(mtab, 0);
+
+	swaps = mnt_new_table();
+	if (swaps && mnt_table_parse_swaps(swaps, NULL) == 0)
+		add_mountpoints(swaps, 1);
+
+	qsort(mountpoints, nmountpoints, sizeof(struct mountpoint), cmp_mountpoints);
+}
+
+/*
+ * Returns the mountpoints of the device, the entries are in the mountinfo
+ * order, the swap areas are after the mountpoints.
+ */
+static struct mountpoint *get_device_mountpoints(struct blkdev_cxt *cxt,
+						 size_t *n)
+{
+	dev_t devno = makedev(cxt->maj, cxt->min);
+	size_t lo = 0, hi, first;
 
 	assert(cxt);
-	assert(cxt->filename);
 
-	if (!mtab) {
-		mtab = mnt_new_table();
-		if (!mtab)
-			return NULL;
-		if (!mntcache)
-			mntcache = mnt_new_cache();
+	if (!mountpoints_loaded)
+		load_mountpoints();
+
+	/* the first entry with the devno */
+	hi = nmountpoints;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
 
-		mnt_table_set_cache(mtab, mntcache);
-		mnt_table_parse_mtab(mtab, NULL);
+		if (mountpoints[mid].devno < devno)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+	first = lo;
+	while (lo < nmountpoints && mountpoints[lo].devno == devno)
+		lo++;
 
-	/* Note that maj:min in /proc/self/mouninfo does not have to match with
-	 * devno as returned by stat(), so we have to try devname too
-	 */
-	fs = mnt_table_find_devno(mtab, makedev(cxt->maj, cxt->min), MNT_ITER_BACKWARD);
-	if (!fs)
-		fs = mnt_table_find_srcpath(mtab, cxt->filename, MNT_ITER_BACKWARD);
-	if (!fs)
-		return is_active_swap(cxt->filename) ? xstrdup("[SWAP]") : NULL;
-
-	/* found */
-	fsroot = mnt_fs_get_root(fs);
-	if (fsroot && strcmp(fsroot, "/") != 0) {
-		/* hmm.. we found bind mount or btrfs subvolume, let's try to
-		 * get real FS root mountpoint */
-		struct libmnt_fs *rfs;
-		struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_BACKWARD);
-
-		mnt_table_set_iter(mtab, itr, fs);
-		while (mnt_table_next_fs(mtab, itr, &rfs) == 0) {
-			fsroot = mnt_fs_get_root(rfs);
-			if ((!fsroot || strcmp(fsroot, "/") == 0)
-			    && mnt_fs_match_source(rfs, cxt->filename, mntcache)) {
-				fs = rfs;
-				break;
-			}
+	*n = lo - first;
+	return *n ? &mountpoints[first] : NULL;
+}
+
+static char *get_device_mountpoint(struct blkdev_cxt *cxt)
+{
+	struct mountpoint *mp;
+	size_t i, n;
+	struct libmnt_fs *fs = NULL;
+
+	mp = get_device_mountpoints(cxt, &n);
+
+	/* the last mounted, but the real FS root rather than a bind mount
+	 * or btrfs subvolume */
+	for (i = n; i > 0; i--) {
+		const char *fsroot;
+
+		if (mp[i - 1].swap)
+			continue;
+		if (!fs)
+			fs = mp[i - 1].fs;
+		fsroot = mnt_fs_get_root(mp[i - 1].fs);
+		if (!fsroot || strcmp(fsroot, "/") == 0) {
+			fs = mp[i - 1].fs;
+			break;
 		}
-		mnt_free_iter(itr);
 	}
+	if (fs)
+		return xstrdup(mnt_fs_get_target(fs));
+	return n ? xstrdup("[SWAP]") : NULL;
+}
 
-	return xstrdup(mnt_fs_get_target(fs));
+/*
+ * Returns all mountpoints of the device separated by comma.
+ */
+static char *get_device_mountpoints_str(struct blkdev_cxt *cxt)
+{
+	struct mountpoint *mp;
+	size_t i, n, sz = 0;
+	char *res = NULL;
+	int swap = 0;
+
+	mp = get_device_mountpoints(cxt, &n);
+
+	for (i = 0; i < n; i++) {
+		const char *target = mp[i].swap ? "[SWAP]" :
+				     mnt_fs_get_target(mp[i].fs);
+		size_t len;
+
+		if (!target || (mp[i].swap && swap++))
+			continue;
+		len = strlen(target);
+		res = xrealloc(res, sz + len + 2);
+		if (sz)
+			res[sz++] = ',';
+		memcpy(res + sz, target, len + 1);
+		sz += len;
+	}
+	return res;
 }
 
-#ifndef HAVE_LIBUDEV
-static int get_udev_properties(struct blkdev_cxt *cxt
-				__attribute__((__unused__)))
+/*
+ * Reads the properties from the udev database file /run/udev/data/b<maj>:<min>.
+ * It's more effective than libudev, which reads sysfs and all the properties
+ * for every device. Returns 1 if there is no database file for the device.
+ */
+static int get_udevdb_properties(struct blkdev_cxt *cxt)
 {
-	return -1;
+	char path[sizeof(_PATH_UDEV_DATA) + 32], buf[BUFSIZ];
+	FILE *f;
+
+	snprintf(path, sizeof(path), _PATH_UDEV_DATA "/b%d:%d", cxt->maj, cxt->min);
+	f = fopen(path, "r" UL_CLOEXECSTR);
+	if (!f)
+		return 1;
+
+	while (fgets(buf, sizeof(buf), f)) {
+		char *name, *data, **res = NULL;
+		int mangled = 0;
+
+		if (strncmp(buf, "E:", 2) != 0)
+			continue;		/* not a property */
+		name = buf + 2;
+		data = strchr(name, '=');
+		if (!data)
+			continue;
+		*data++ = '\0';
+		data[strcspn(data, "\n")] = '\0';
+
+		if (!strcmp(name, "ID_FS_LABEL_ENC"))
+			res = &cxt->label, mangled = 1;
+		else if (!strcmp(name, "ID_FS_UUID_ENC"))
+			res = &cxt->uuid, mangled = 1;
+		else if (!strcmp(name, "ID_PART_ENTRY_NAME"))
+			res = &cxt->partlabel, mangled = 1;
+		else if (!strcmp(name, "ID_FS_TYPE"))
+			res = &cxt->fstype;
+		else if (!strcmp(name, "ID_PART_ENTRY_UUID"))
+			res = &cxt->partuuid;
+		else if (!strcmp(name, "ID_WWN"))
+			res = &cxt->wwn;
+		else if (!strcmp(name, "ID_SERIAL_SHORT"))
+			res = &cxt->serial;
+
+		if (!res || *res)
+			continue;
+		*res = xstrdup(data);
+		if (mangled)
+			unhexmangle_string(*res);
+	}
+
+	fclose(f);
+	cxt->probed = 1;
+	return 0;
 }
-#else
-static int get_udev_properties(struct blkdev_cxt *cxt)
+
+#ifdef HAVE_LIBUDEV
+static int get_libudev_properties(struct blkdev_cxt *cxt)
 {
 	struct udev_device *dev;
 
-	if (cxt->probed)
-		return 0;		/* already done */
-
 	if (!udev)
 		udev = udev_new();
 	if (!udev)
@@ -452,10 +605,23 @@ static int get_udev_properties(struct blkdev_cxt *cxt)
 	}
 
 	return cxt->probed == 1 ? 0 : -1;
-
 }
 #endif /* HAVE_LIBUDEV */
 
+static int get_udev_properties(struct blkdev_cxt *cxt)
+{
+	if (cxt->probed)
+		return 0;		/* already done */
+
+	if (get_udevdb_properties(cxt) == 0)
+		return 0;
+#ifdef HAVE_LIBUDEV
+	return get_libudev_properties(cxt);
+#else
+	return -1;
+#endif
+}
+
 static void probe_device(struct blkdev_cxt *cxt)
 {
 	blkid_probe pr = NULL;
@@ -507,6 +673,338 @@ static void probe_device(struct blkdev_cxt *cxt)
 	return;
 }
 
+static void set_probe_data(struct blkdev_cxt *cxt, struct tt_line *ln,
+			   int col, int id)
+{
+	const char *data = NULL;
+
+	switch (id) {
+	case COL_FSTYPE:
+		data = cxt->fstype;
+		break;
+	case COL_LABEL:
+		data = cxt->label;
+		break;
+	case COL_UUID:
+		data = cxt->uuid;
+		break;
+	case COL_PARTLABEL:
+		data = cxt->partlabel;
+		break;
+	case COL_PARTUUID:
+		data = cxt->partuuid;
+		break;
+	case COL_WWN:
+		data = cxt->wwn;
+		break;
+	case COL_SERIAL:
+		data = cxt->serial;
+		break;
+	}
+	if (data)
+		tt_line_set_data_copy(ln, col, data);
+}
+
+#ifdef LSBLK_PROBE_THREADS
+/*
+ * Deferred probing -- the udev and libblkid probing may hang on unresponsive
+ * devices (e.g. dead FC paths). If the probing columns are requested, the
+ * cells are not filled when the devices are listed, but the devices are added
+ * to the queue, and the queue is processed by more threads after the listing.
+ * The table is filled in the original order and a device which is not probed
+ * within LSBLK_PROBE_TIMEOUT seconds is reported as "timeout"; the blocked
+ * thread is replaced by a new one.
+ */
+#define LSBLK_PROBE_TIMEOUT	10	/* seconds per device */
+
+enum {
+	PROBE_QUEUED = 0,
+	PROBE_RUNNING,
+	PROBE_DONE,
+	PROBE_TIMEOUT		/* the thread is still blocked */
+};
+
+struct probe_job {
+	struct blkdev_cxt	cxt;		/* name, filename, size and the result */
+	int			state;
+	int			blkid;		/* use libblkid if udev is not available */
+	uint64_t		started;	/* PROBE_RUNNING since (msec) */
+};
+
+struct probe_cell {
+	struct tt_line		*ln;
+	int			col;
+	int			id;
+	struct probe_job	*job;
+};
+
+struct probe_queue {
+	struct probe_job	**jobs;
+	size_t			njobs;
+	size_t			next;		/* the first unprocessed job */
+	size_t			first;		/* the first unfinished job */
+
+	struct probe_cell	*cells;
+	size_t			ncells;
+
+	int			nthreads;	/* running threads */
+	int			nblocked;	/* threads with timed out job */
+
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+};
+
+static uint64_t probe_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void probe_defer(struct blkdev_cxt *cxt, struct tt_line *ln,
+			int col, int id)
+{
+	struct probe_queue *q = lsblk->probeq;
+	struct probe_job *job = cxt->job;
+	struct probe_cell *cl;
+
+	if (!job) {
+		job = xcalloc(1, sizeof(*job));
+		job->cxt.sysfs.dir_fd = -1;
+		job->cxt.name = xstrdup(cxt->name);
+		job->cxt.filename = xstrdup(cxt->filename);
+		job->cxt.size = cxt->size;
+		job->cxt.maj = cxt->maj;
+		job->cxt.min = cxt->min;
+
+		if (q->njobs % 64 == 0)
+			q->jobs = xrealloc(q->jobs,
+					(q->njobs + 64) * sizeof(*q->jobs));
+		q->jobs[q->njobs++] = job;
+		cxt->job = job;
+	}
+	if (id != COL_WWN && id != COL_SERIAL)
+		job->blkid = 1;
+
+	if (q->ncells % 64 == 0)
+		q->cells = xrealloc(q->cells, (q->ncells + 64) * sizeof(*q->cells));
+	cl = &q->cells[q->ncells++];
+	cl->ln = ln;
+	cl->col = col;
+	cl->id = id;
+	cl->job = job;
+}
+
+static void *probe_worker(void *data)
+{
+	struct probe_queue *q = (struct probe_queue *) data;
+
+	for (;;) {
+		struct probe_job *job = NULL;
+		struct blkdev_cxt res = {};
+
+		pthread_mutex_lock(&q->lock);
+		if (q->next < q->njobs) {
+			job = q->jobs[q->next++];
+			job->state = PROBE_RUNNING;
+			job->started = probe_now();
+		}
+		pthread_mutex_unlock(&q->lock);
+
+		if (!job)
+			break;
+
+		/* don't touch the job until the result is complete */
+		res.sysfs.dir_fd = -1;
+		res.name = job->cxt.name;
+		res.filename = job->cxt.filename;
+		res.size = job->cxt.size;
+		res.maj = job->cxt.maj;
+		res.min = job->cxt.min;
+
+		if (job->blkid)
+			probe_device(&res);
+		get_udev_properties(&res);
+
+		pthread_mutex_lock(&q->lock);
+		if (job->state == PROBE_TIMEOUT) {
+			/* too late, the thread has been replaced */
+			q->nblocked--;
+			q->nthreads--;
+			pthread_cond_broadcast(&q->cond);
+			pthread_mutex_unlock(&q->lock);
+
+			res.name = res.filename = NULL;
+			reset_blkdev_cxt(&res);
+			goto done;
+		}
+		job->cxt.fstype = res.fstype;
+		job->cxt.uuid = res.uuid;
+		job->cxt.label = res.label;
+		job->cxt.partuuid = res.partuuid;
+		job->cxt.partlabel = res.partlabel;
+		job->cxt.wwn = res.wwn;
+		job->cxt.serial = res.serial;
+		job->state = PROBE_DONE;
+		pthread_cond_broadcast(&q->cond);
+		pthread_mutex_unlock(&q->lock);
+	}
+
+	pthread_mutex_lock(&q->lock);
+	q->nthreads--;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+done:
+#ifdef HAVE_LIBUDEV
+	udev_unref(udev);
+	udev = NULL;
+#endif
+	return NULL;
+}
+
+/* requires q->lock */
+static int probe_start_thread(struct probe_queue *q)
+{
+	pthread_attr_t attr;
+	pthread_t th;
+	int rc;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	rc = pthread_create(&th, &attr, probe_worker, q);
+	pthread_attr_destroy(&attr);
+
+	if (!rc)
+		q->nthreads++;
+	return rc;
+}
+
+/*
+ * Marks the timed out jobs and returns the nearest deadline of the running
+ * jobs. Requires q->lock.
+ */
+static uint64_t probe_check_timeouts(struct probe_queue *q)
+{
+	uint64_t now = probe_now(), deadline = now + LSBLK_PROBE_TIMEOUT * 1000;
+	size_t i;
+
+	while (q->first < q->next && q->jobs[q->first]->state >= PROBE_DONE)
+		q->first++;
+
+	for (i = q->first; i < q->next; i++) {
+		struct probe_job *job = q->jobs[i];
+		uint64_t end = job->started + LSBLK_PROBE_TIMEOUT * 1000;
+
+		if (job->state != PROBE_RUNNING)
+			continue;
+		if (end > now) {
+			deadline = min(deadline, end);
+			continue;
+		}
+		warnx(_("%s: probing timed out"), job->cxt.name);
+		job->state = PROBE_TIMEOUT;
+		job->cxt.fstype = xstrdup("timeout");
+		q->nblocked++;
+		probe_start_thread(q);
+	}
+	return deadline;
+}
+
+static void probe_wait(struct probe_queue *q, struct probe_job *job)
+{
+	pthread_mutex_lock(&q->lock);
+	while (job->state < PROBE_DONE) {
+		uint64_t deadline = probe_check_timeouts(q);
+		struct timespec ts;
+
+		if (job->state >= PROBE_DONE)
+			break;
+		ts.tv_sec = deadline / 1000;
+		ts.tv_nsec = (deadline % 1000) * 1000000;
+		pthread_cond_timedwait(&q->cond, &q->lock, &ts);
+	}
+	pthread_mutex_unlock(&q->lock);
+}
+
+/*
+ * Probes the queued devices, fills the deferred cells and deallocates @q.
+ */
+static void probe_run(struct probe_queue *q)
+{
+	pthread_condattr_t attr;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t i, nthreads = ncpus > 0 ? ncpus * 4 : 4;	/* I/O bound */
+
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&q->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (nthreads > q->njobs)
+		nthreads = q->njobs;
+
+	pthread_mutex_lock(&q->lock);
+	for (i = 0; i < nthreads; i++) {
+		if (probe_start_thread(q))
+			break;
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	/* if we have no thread, probe in the current thread */
+	if (q->njobs && !q->nthreads) {
+		q->nthreads++;
+		probe_worker(q);
+	}
+
+	for (i = 0; i < q->ncells; i++) {
+		struct probe_cell *cl = &q->cells[i];
+
+		probe_wait(q, cl->job);
+		set_probe_data(&cl->job->cxt, cl->ln, cl->col, cl->id);
+	}
+
+	pthread_mutex_lock(&q->lock);
+	while (q->nthreads > q->nblocked)
+		pthread_cond_wait(&q->cond, &q->lock);
+	pthread_mutex_unlock(&q->lock);
+
+	/* the blocked threads still use the queue */
+	if (q->nblocked)
+		return;
+
+	for (i = 0; i < q->njobs; i++) {
+		reset_blkdev_cxt(&q->jobs[i]->cxt);
+		free(q->jobs[i]);
+	}
+	free(q->jobs);
+	free(q->cells);
+	pthread_cond_destroy(&q->cond);
+	pthread_mutex_destroy(&q->lock);
+	free(q);
+}
+#endif /* LSBLK_PROBE_THREADS */
+
+/*
+ * Sets the cell from udev or libblkid, the probing is deferred if possible.
+ */
+static void set_probe_tt_data(struct blkdev_cxt *cxt, struct tt_line *ln,
+			      int col, int id)
+{
+#ifdef LSBLK_PROBE_THREADS
+	if (lsblk->probeq) {
+		probe_defer(cxt, ln, col, id);
+		return;
+	}
+#endif
+	if (id == COL_WWN || id == COL_SERIAL)
+		get_udev_properties(cxt);
+	else
+		probe_device(cxt);
+	set_probe_data(cxt, ln, col, id);
+}
+
 static int is_readonly_device(struct blkdev_cxt *cxt)
 {
 	int fd, ro = 0;
@@ -650,7 +1148,8 @@ static char *get_transport(struct blkdev_cxt *cxt)
 }
 
 #define is_parsable(_l)	(((_l)->tt->flags & TT_FL_RAW) || \
-			 ((_l)->tt->flags & TT_FL_EXPORT))
+			 ((_l)->tt->flags & TT_FL_EXPORT) || \
+			 ((_l)->tt->flags & TT_FL_JSON))
 
 static char *mk_name(const char *name)
 {
@@ -702,14 +1201,14 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 	{
 		struct passwd *pw = st_rc ? NULL : getpwuid(cxt->st.st_uid);
 		if (pw)
-			tt_line_set_data(ln, col, xstrdup(pw->pw_name));
+			tt_line_set_data_copy(ln, col, pw->pw_name);
 		break;
 	}
 	case COL_GROUP:
 	{
 		struct group *gr = st_rc ? NULL : getgrgid(cxt->st.st_gid);
 		if (gr)
-			tt_line_set_data(ln, col, xstrdup(gr->gr_name));
+			tt_line_set_data_copy(ln, col, gr->gr_name);
 		break;
 	}
 	case COL_MODE:
@@ -718,7 +1217,7 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 
 		if (!st_rc) {
 			strmode(cxt->st.st_mode, md);
-			tt_line_set_data(ln, col, xstrdup(md));
+			tt_line_set_data_copy(ln, col, md);
 		}
 		break;
 	}
@@ -730,9 +1229,12 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 		tt_line_set_data(ln, col, p);
 		break;
 	case COL_FSTYPE:
-		probe_device(cxt);
-		if (cxt->fstype)
-			tt_line_set_data(ln, col, xstrdup(cxt->fstype));
+	case COL_LABEL:
+	case COL_UUID:
+	case COL_PARTLABEL:
+	case COL_PARTUUID:
+	case COL_WWN:
+		set_probe_tt_data(cxt, ln, col, id);
 		break;
 	case COL_TARGET:
 		if (!(cxt->nholders + cxt->npartitions)) {
@@ -740,34 +1242,11 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 				tt_line_set_data(ln, col, p);
 		}
 		break;
-	case COL_LABEL:
-		probe_device(cxt);
-		if (!cxt->label)
-			break;
-
-		tt_line_set_data(ln, col, xstrdup(cxt->label));
-		break;
-	case COL_UUID:
-		probe_device(cxt);
-		if (cxt->uuid)
-			tt_line_set_data(ln, col, xstrdup(cxt->uuid));
-		break;
-	case COL_PARTLABEL:
-		probe_device(cxt);
-		if (!cxt->partlabel)
-			break;
-
-		tt_line_set_data(ln, col, xstrdup(cxt->partlabel));
-		break;
-	case COL_PARTUUID:
-		probe_device(cxt);
-		if (cxt->partuuid)
-			tt_line_set_data(ln, col, xstrdup(cxt->partuuid));
-		break;
-	case COL_WWN:
-		get_udev_properties(cxt);
-		if (cxt->wwn)
-			tt_line_set_data(ln, col, xstrdup(cxt->wwn));
+	case COL_TARGETS:
+		if (!(cxt->nholders + cxt->npartitions)) {
+			if ((p = get_device_mountpoints_str(cxt)))
+				tt_line_set_data(ln, col, p);
+		}
 		break;
 	case COL_RA:
 		p = sysfs_strdup(&cxt->sysfs, "queue/read_ahead_kb");
@@ -775,8 +1254,7 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 			tt_line_set_data(ln, col, p);
 		break;
 	case COL_RO:
-		tt_line_set_data(ln, col, is_readonly_device(cxt) ?
-					xstrdup("1") : xstrdup("0"));
+		tt_line_set_data_copy(ln, col, is_readonly_device(cxt) ? "1" : "0");
 		break;
 	case COL_RM:
 		p = sysfs_strdup(&cxt->sysfs, "removable");
@@ -803,11 +1281,8 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 		}
 		break;
 	case COL_SERIAL:
-		if (!cxt->partition && cxt->nslaves == 0) {
-			get_udev_properties(cxt);
-			if (cxt->serial)
-				tt_line_set_data(ln, col, xstrdup(cxt->serial));
-		}
+		if (!cxt->partition && cxt->nslaves == 0)
+			set_probe_tt_data(cxt, ln, col, id);
 		break;
 	case COL_REV:
 		if (!cxt->partition && cxt->nslaves == 0) {
@@ -903,7 +1378,7 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 		if (cxt->discard && p)
 			tt_line_set_data(ln, col, p);
 		else
-			tt_line_set_data(ln, col, xstrdup("0"));
+			tt_line_set_data_copy(ln, col, "0");
 		break;
 	case COL_DGRAN:
 		if (lsblk->bytes)
@@ -936,7 +1411,7 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 		if (cxt->discard && p)
 			tt_line_set_data(ln, col, p);
 		else
-			tt_line_set_data(ln, col, xstrdup("0"));
+			tt_line_set_data_copy(ln, col, "0");
 		break;
 	case COL_WSAME:
 		if (lsblk->bytes)
@@ -980,12 +1455,12 @@ static int set_cxt(struct blkdev_cxt *cxt,
 		return -1;
 	}
 
-	devno = sysfs_devname_to_devno(name, wholedisk ? wholedisk->name : NULL);
-
-	if (!devno) {
+	cxt->blkdev = sysfs_blktopo_get_name(&lsblk->topo, name);
+	if (!cxt->blkdev) {
 		warnx(_("%s: unknown device name"), name);
 		return -1;
 	}
+	devno = cxt->blkdev->devno;
 
 	if (lsblk->inverse) {
 		if (sysfs_init(&cxt->sysfs, devno, wholedisk ? &wholedisk->sysfs : NULL)) {
@@ -1000,17 +1475,12 @@ static int set_cxt(struct blkdev_cxt *cxt,
 			return -1;
 		}
 	}
+	sysfs_enable_cache(&cxt->sysfs);
 
 	cxt->maj = major(devno);
 	cxt->min = minor(devno);
-	cxt->size = 0;
-
-	if (sysfs_read_u64(&cxt->sysfs, "size", &cxt->size) == 0)	/* in sectors */
-		cxt->size <<= 9;					/* in bytes */
-
-	if (sysfs_read_int(&cxt->sysfs,
-			   "queue/discard_granularity", &cxt->discard) != 0)
-		cxt->discard = 0;
+	cxt->size = cxt->blkdev->size << 9;		/* in bytes */
+	cxt->discard = cxt->blkdev->discard_granularity;
 
 	/* Ignore devices of zero size */
 	if (!lsblk->all_devices && cxt->size == 0)
@@ -1024,9 +1494,9 @@ static int set_cxt(struct blkdev_cxt *cxt,
 		}
 	}
 
-	cxt->npartitions = sysfs_count_partitions(&cxt->sysfs, name);
-	cxt->nholders = sysfs_count_dirents(&cxt->sysfs, "holders");
-	cxt->nslaves = sysfs_count_dirents(&cxt->sysfs, "slaves");
+	cxt->npartitions = cxt->blkdev->nparts;
+	cxt->nholders = cxt->blkdev->nholders;
+	cxt->nslaves = cxt->blkdev->nslaves;
 
 	/* ignore non-SCSI devices */
 	if (lsblk->scsi && sysfs_scsi_get_hctl(&cxt->sysfs, NULL, NULL, NULL, NULL))
@@ -1044,9 +1514,8 @@ static int process_blkdev(struct blkdev_cxt *cxt, struct blkdev_cxt *parent,
 static int list_partitions(struct blkdev_cxt *wholedisk_cxt, struct blkdev_cxt *parent_cxt,
 			   const char *part_name)
 {
-	DIR *dir;
-	struct dirent *d;
 	struct blkdev_cxt part_cxt = {};
+	size_t i;
 	int r = -1;
 
 	assert(wholedisk_cxt);
@@ -1058,16 +1527,11 @@ static int list_partitions(struct blkdev_cxt *wholedisk_cxt, struct blkdev_cxt *
 	if (!wholedisk_cxt->npartitions || wholedisk_cxt->partition)
 		return -1;
 
-	dir = sysfs_opendir(&wholedisk_cxt->sysfs, NULL);
-	if (!dir)
-		err(EXIT_FAILURE, _("failed to open device directory in sysfs"));
+	for (i = 0; i < wholedisk_cxt->blkdev->nparts; i++) {
+		const char *pname = wholedisk_cxt->blkdev->parts[i]->name;
 
-	while ((d = xreaddir(dir))) {
 		/* Process particular partition only? */
-		if (part_name && strcmp(part_name, d->d_name))
-			continue;
-
-		if (!(sysfs_is_partition_dirent(dir, d, wholedisk_cxt->name)))
+		if (part_name && strcmp(part_name, pname))
 			continue;
 
 		if (lsblk->inverse) {
@@ -1077,7 +1541,7 @@ static int list_partitions(struct blkdev_cxt *wholedisk_cxt, struct blkdev_cxt *
 			 *   `-<wholedisk_cxt>
 			 *    `-...
 			 */
-			if (set_cxt(&part_cxt, parent_cxt, wholedisk_cxt, d->d_name))
+			if (set_cxt(&part_cxt, parent_cxt, wholedisk_cxt, pname))
 				goto next;
 
 			if (!parent_cxt && part_cxt.nholders)
@@ -1094,7 +1558,7 @@ static int list_partitions(struct blkdev_cxt *wholedisk_cxt, struct blkdev_cxt *
 			 *   `-<part_cxt>
 			 *    `-...
 			 */
-			int ps = set_cxt(&part_cxt, wholedisk_cxt, wholedisk_cxt, d->d_name);
+			int ps = set_cxt(&part_cxt, wholedisk_cxt, wholedisk_cxt, pname);
 
 			/* Print whole disk only once */
 			if (r)
@@ -1107,76 +1571,40 @@ static int list_partitions(struct blkdev_cxt *wholedisk_cxt, struct blkdev_cxt *
 		r = 0;
 	}
 
-	closedir(dir);
 	return r;
 }
 
-static int get_wholedisk_from_partition_dirent(DIR *dir, const char *dirname,
-				struct dirent *d, struct blkdev_cxt *cxt)
-{
-	char path[PATH_MAX];
-	char *p;
-	int len;
-
-	if ((len = readlink_at(dirfd(dir), dirname,
-			       d->d_name, path, sizeof(path) - 1)) < 0)
-		return 0;
-
-	path[len] = '\0';
-
-	/* The path ends with ".../<device>/<partition>" */
-	p = strrchr(path, '/');
-	if (!p)
-		return 0;
-	*p = '\0';
-
-	p = strrchr(path, '/');
-	if (!p)
-		return 0;
-	p++;
-
-	return set_cxt(cxt, NULL, NULL, p);
-}
-
 /*
  * List device dependencies: partitions, holders (inverse = 0) or slaves (inverse = 1).
  */
 static int list_deps(struct blkdev_cxt *cxt)
 {
-	DIR *dir;
-	struct dirent *d;
 	struct blkdev_cxt dep = {};
-	char dirname[PATH_MAX];
-	const char *depname;
+	struct sysfs_blkdev **deps;
+	size_t i, ndeps;
 
 	assert(cxt);
 
 	if (lsblk->nodeps)
 		return 0;
 
-	if (!(lsblk->inverse ? cxt->nslaves : cxt->nholders))
-		return 0;
-
-	depname = lsblk->inverse ? "slaves" : "holders";
-	dir = sysfs_opendir(&cxt->sysfs, depname);
-	if (!dir)
-		return 0;
+	deps = lsblk->inverse ? cxt->blkdev->slaves : cxt->blkdev->holders;
+	ndeps = lsblk->inverse ? cxt->blkdev->nslaves : cxt->blkdev->nholders;
 
-	snprintf(dirname, sizeof(dirname), "%s/%s", cxt->sysfs.dir_path, depname);
+	for (i = 0; i < ndeps; i++) {
+		struct sysfs_blkdev *d = deps[i];
 
-	while ((d = xreaddir(dir))) {
 		/* Is the dependency a partition? */
-		if (sysfs_is_partition_dirent(dir, d, NULL)) {
-		    if (!get_wholedisk_from_partition_dirent(dir, dirname, d, &dep))
-			    process_blkdev(&dep, cxt, 1, d->d_name);
+		if (d->wholedisk) {
+		    if (!set_cxt(&dep, NULL, NULL, d->wholedisk->name))
+			    process_blkdev(&dep, cxt, 1, d->name);
 		}
 		/* The dependency is a whole device. */
-		else if (!set_cxt(&dep, cxt, NULL, d->d_name))
+		else if (!set_cxt(&dep, cxt, NULL, d->name))
 			process_blkdev(&dep, cxt, 1, NULL);
 
 		reset_blkdev_cxt(&dep);
 	}
-	closedir(dir);
 
 	return 0;
 }
@@ -1194,31 +1622,27 @@ static int process_blkdev(struct blkdev_cxt *cxt, struct blkdev_cxt *parent,
 /* Iterate devices in sysfs */
 static int iterate_block_devices(void)
 {
-	DIR *dir;
-	struct dirent *d;
 	struct blkdev_cxt cxt = {};
+	size_t i;
 
-	if (!(dir = opendir(_PATH_SYS_BLOCK)))
-		return EXIT_FAILURE;
-
-	while ((d = xreaddir(dir))) {
-		if (set_cxt(&cxt, NULL, NULL, d->d_name))
-			goto next;
+	for (i = 0; i < lsblk->topo.ndevs; i++) {
+		struct sysfs_blkdev *d = lsblk->topo.devs[i];
+		int maj = major(d->devno);
 
-		if (is_maj_excluded(cxt.maj) || !is_maj_included(cxt.maj))
-			goto next;
+		if (d->wholedisk)
+			continue;
+		if (is_maj_excluded(maj) || !is_maj_included(maj))
+			continue;
 
 		/* Skip devices in the middle of dependency tree. */
-		if ((lsblk->inverse ? cxt.nholders : cxt.nslaves) > 0)
-			goto next;
+		if ((lsblk->inverse ? d->nholders : d->nslaves) > 0)
+			continue;
 
-		process_blkdev(&cxt, NULL, 1, NULL);
-	next:
+		if (set_cxt(&cxt, NULL, NULL, d->name) == 0)
+			process_blkdev(&cxt, NULL, 1, NULL);
 		reset_blkdev_cxt(&cxt);
 	}
 
-	closedir(dir);
-
 	return EXIT_SUCCESS;
 }
 
@@ -1374,6 +1798,7 @@ static void __attribute__((__noreturn__)) help(FILE *out)
 	fputs(_(" -f, --fs             output info about filesystems\n"), out);
 	fputs(_(" -i, --ascii          use ascii characters only\n"), out);
 	fputs(_(" -I, --include <list> show only devices with specified major numbers\n"), out);
+	fputs(_(" -J, --json           use JSON output format\n"), out);
 	fputs(_(" -l, --list           use list format output\n"), out);
 	fputs(_(" -m, --perms          output info about permissions\n"), out);
 	fputs(_(" -n, --noheadings     don't print headings\n"), out);
@@ -1428,6 +1853,7 @@ int main(int argc, char *argv[])
 		{ "fs",         0, 0, 'f' },
 		{ "exclude",    1, 0, 'e' },
 		{ "include",    1, 0, 'I' },
+		{ "json",       0, 0, 'J' },
 		{ "topology",   0, 0, 't' },
 		{ "paths",      0, 0, 'p' },
 		{ "pairs",      0, 0, 'P' },
@@ -1438,6 +1864,7 @@ int main(int argc, char *argv[])
 
 	static const ul_excl_t excl[] = {       /* rows and cols in in ASCII order */
 		{ 'I','e' },
+		{ 'J','P','r' },
 		{ 'P','l','r' },
 		{ 0 }
 	};
@@ -1452,7 +1879,7 @@ int main(int argc, char *argv[])
 	memset(lsblk, 0, sizeof(*lsblk));
 
 	while((c = getopt_long(argc, argv,
-			       "abdDe:fhlnmo:pPiI:rstVS", longopts, NULL)) != -1) {
+			       "abdDe:fhlnmo:pPiI:JrstVS", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -1501,6 +1928,9 @@ int main(int argc, char *argv[])
 		case 'I':
 			parse_includes(optarg);
 			break;
+		case 'J':
+			tt_flags |= TT_FL_JSON;
+			break;
 		case 'r':
 			tt_flags &= ~TT_FL_TREE;	/* disable the default */
 			tt_flags |= TT_FL_RAW;		/* enable raw */
@@ -1576,10 +2006,32 @@ int main(int argc, char *argv[])
 	mnt_init_debug(0);
 
 	/*
-	 * initialize output columns
+	 * initialize output columns, the list is printed as the devices
+	 * are found
 	 */
+#ifdef LSBLK_PROBE_THREADS
+	for (i = 0; i < ncolumns; i++) {
+		switch (get_column_id(i)) {
+		case COL_FSTYPE:
+		case COL_LABEL:
+		case COL_UUID:
+		case COL_PARTLABEL:
+		case COL_PARTUUID:
+		case COL_WWN:
+		case COL_SERIAL:
+			if (!lsblk->probeq)
+				lsblk->probeq = xcalloc(1, sizeof(struct probe_queue));
+			break;
+		}
+	}
+#endif
+	/* the deferred cells are filled after all devices are listed */
+	if (!(tt_flags & TT_FL_TREE) && !lsblk->probeq)
+		tt_flags |= TT_FL_STREAM;
+
 	if (!(lsblk->tt = tt_new_table(tt_flags | TT_FL_FREEDATA)))
 		errx(EXIT_FAILURE, _("failed to initialize output table"));
+	tt_set_name(lsblk->tt, "blockdevices");
 
 	for (i = 0; i < ncolumns; i++) {
 		struct colinfo *ci = get_column_info(i);
@@ -1594,19 +2046,31 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (sysfs_blktopo_scan(&lsblk->topo)) {
+		warn(_("failed to read %s"), _PATH_SYS_BLOCK);
+		goto leave;
+	}
+
 	if (optind == argc)
 		status = iterate_block_devices();
 	else while (optind < argc)
 		status = process_one_device(argv[optind++]);
 
+#ifdef LSBLK_PROBE_THREADS
+	if (lsblk->probeq) {
+		probe_run(lsblk->probeq);
+		lsblk->probeq = NULL;
+	}
+#endif
 	tt_print_table(lsblk->tt);
 
 leave:
 	tt_free_table(lsblk->tt);
+	sysfs_blktopo_deinit(&lsblk->topo);
 
 	mnt_unref_table(mtab);
 	mnt_unref_table(swaps);
-	mnt_unref_cache(mntcache);
+	free(mountpoints);
 #ifdef HAVE_LIBUDEV
 	udev_unref(udev);
 #endif
@@ -109,6 +109,26 @@ static void disable_columns_truncate(void)
 		infos[i].flags &= ~TT_FL_TRUNC;
 }
 
+/*
+ * Associate the device's mountpoint for a filename
+ */
+static char *get_fallback_filename(dev_t dev)
+{
+	struct libmnt_fs *fs;
+
+	if (!tab) {
+		tab = mnt_new_table_from_file(_PATH_PROC_MOUNTINFO);
+		if (!tab)
+			return NULL;
+	}
+
+	fs = mnt_table_find_devno(tab, dev, MNT_ITER_BACKWARD);
+	if (!fs)
+		return NULL;
+
+	return xstrdup(mnt_fs_get_target(fs));
+}
+
 /*
  * Return a PID's command name
  */
@@ -132,83 +152,157 @@ out:
 }
 
 /*
- * Associate the device's mountpoint for a filename
+ * Open files of one process, /proc/PID/fd/ is read only once for all the
+ * locks of the process.
  */
-static char *get_fallback_filename(dev_t dev)
-{
-	struct libmnt_fs *fs;
+struct proc_fd {
+	ino_t	ino;
+	off_t	size;
+	int	fd;
+};
 
-	if (!tab) {
-		tab = mnt_new_table_from_file(_PATH_PROC_MOUNTINFO);
-		if (!tab)
-			return NULL;
-	}
+struct proc_fds {
+	pid_t		pid;
+	char		*cmdname;
+	struct proc_fd	*fds;		/* sorted by inode */
+	size_t		nfds;
+};
 
-	fs = mnt_table_find_devno(tab, dev, MNT_ITER_BACKWARD);
-	if (!fs)
-		return NULL;
+static struct proc_fds *procs;		/* sorted by PID */
+static size_t nprocs;
 
-	return xstrdup(mnt_fs_get_target(fs));
+static int cmp_proc_fd(const void *a, const void *b)
+{
+	const struct proc_fd *x = a, *y = b;
+
+	if (x->ino != y->ino)
+		return x->ino < y->ino ? -1 : 1;
+	return x->fd - y->fd;
 }
 
-/*
- * Return the absolute path of a file from
- * a given inode number (and its size)
- */
-static char *get_filename_sz(ino_t inode, pid_t pid, size_t *size)
+static void read_proc_fds(struct proc_fds *pr)
 {
-	struct stat sb;
+	char path[PATH_MAX];
 	struct dirent *dp;
+	size_t nalloc = 0;
 	DIR *dirp;
-	size_t len;
 	int fd;
-	char path[PATH_MAX], sym[PATH_MAX], *ret = NULL;
-
-	*size = 0;
-	memset(path, 0, sizeof(path));
-	memset(sym, 0, sizeof(sym));
 
 	/*
 	 * We know the pid so we don't have to
 	 * iterate the *entire* filesystem searching
 	 * for the damn file.
 	 */
-	sprintf(path, "/proc/%d/fd/", pid);
+	sprintf(path, "/proc/%d/fd/", pr->pid);
 	if (!(dirp = opendir(path)))
-		return NULL;
-
-	if ((len = strlen(path)) >= (sizeof(path) - 2))
-		goto out;
+		return;
 
-	if ((fd = dirfd(dirp)) < 0 )
-		goto out;
+	fd = dirfd(dirp);
 
 	while ((dp = readdir(dirp))) {
-		if (!strcmp(dp->d_name, ".") ||
-		    !strcmp(dp->d_name, ".."))
-			continue;
+		struct stat sb;
+		char *end;
+		long num;
 
 		/* care only for numerical descriptors */
-		if (!strtol(dp->d_name, (char **) NULL, 10))
+		errno = 0;
+		num = strtol(dp->d_name, &end, 10);
+		if (errno || end == dp->d_name || *end || num < 0)
 			continue;
 
-		if (!fstat_at(fd, path, dp->d_name, &sb, 0)
-		    && inode != sb.st_ino)
+		if (fstat_at(fd, path, dp->d_name, &sb, 0) != 0)
 			continue;
 
-		if ((len = readlink_at(fd, path, dp->d_name,
-				       sym, sizeof(sym) - 1)) < 1)
-			goto out;
+		if (pr->nfds == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 32;
+			pr->fds = xrealloc(pr->fds, nalloc * sizeof(*pr->fds));
+		}
+		pr->fds[pr->nfds].ino = sb.st_ino;
+		pr->fds[pr->nfds].size = sb.st_size;
+		pr->fds[pr->nfds].fd = num;
+		pr->nfds++;
+	}
+	closedir(dirp);
 
-		*size = sb.st_size;
-		sym[len] = '\0';
+	qsort(pr->fds, pr->nfds, sizeof(*pr->fds), cmp_proc_fd);
+}
 
-		ret = xstrdup(sym);
-		break;
+static struct proc_fds *get_proc_fds(pid_t id)
+{
+	size_t lo = 0, hi = nprocs;
+	struct proc_fds *pr;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (procs[mid].pid == id)
+			return &procs[mid];
+		if (procs[mid].pid < id)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-out:
-	closedir(dirp);
-	return ret;
+
+	procs = xrealloc(procs, (nprocs + 1) * sizeof(*procs));
+	memmove(&procs[lo + 1], &procs[lo], (nprocs - lo) * sizeof(*procs));
+	nprocs++;
+
+	pr = &procs[lo];
+	memset(pr, 0, sizeof(*pr));
+	pr->pid = id;
+	pr->cmdname = get_cmdname(id);
+	read_proc_fds(pr);
+	return pr;
+}
+
+static void free_procs(void)
+{
+	size_t i;
+
+	for (i = 0; i < nprocs; i++) {
+		free(procs[i].cmdname);
+		free(procs[i].fds);
+	}
+	free(procs);
+	procs = NULL;
+	nprocs = 0;
+}
+
+/*
+ * Return the absolute path of a file from
+ * a given inode number (and its size)
+ */
+static char *get_filename_sz(ino_t inode, struct proc_fds *pr, size_t *size)
+{
+	struct proc_fd *f = NULL;
+	char path[PATH_MAX], sym[PATH_MAX];
+	size_t lo = 0, hi = pr->nfds;
+	ssize_t len;
+
+	*size = 0;
+
+	/* the first descriptor with the inode */
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (pr->fds[mid].ino < inode)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < pr->nfds && pr->fds[lo].ino == inode)
+		f = &pr->fds[lo];
+	if (!f)
+		return NULL;
+
+	snprintf(path, sizeof(path), "/proc/%d/fd/%d", pr->pid, f->fd);
+	if ((len = readlink(path, sym, sizeof(sym) - 1)) < 1)
+		return NULL;
+
+	*size = f->size;
+	sym[len] = '\0';
+
+	return xstrdup(sym);
 }
 
 /*
@@ -276,9 +370,6 @@ static int get_local_locks(struct list_head *locks)
 				 * to the list, no need to worry now.
 				 */
 				l->pid = strtos32_or_err(tok, _("failed to parse pid"));
-				l->cmdname = get_cmdname(l->pid);
-				if (!l->cmdname)
-					l->cmdname = xstrdup(_("(unknown)"));
 				break;
 
 			case 5: /* device major:minor and inode number */
@@ -299,20 +390,29 @@ static int get_local_locks(struct list_head *locks)
 			default:
 				break;
 			}
+		}
 
-			l->path = get_filename_sz(inode, l->pid, &sz);
+		sz = 0;
+
+		/* the filtered out locks are necessary for BLOCKER only */
+		if (!pid || pid == l->pid) {
+			struct proc_fds *pr = get_proc_fds(l->pid);
+
+			l->cmdname = xstrdup(pr->cmdname ? pr->cmdname :
+							   _("(unknown)"));
+			l->path = get_filename_sz(inode, pr, &sz);
 			if (!l->path)
 				/* probably no permission to peek into l->pid's path */
 				l->path = get_fallback_filename(dev);
-
-			/* avoid leaking */
-			szstr = size_to_human_string(SIZE_SUFFIX_1LETTER, sz);
-			l->size = xstrdup(szstr);
-			free(szstr);
 		}
 
+		szstr = size_to_human_string(SIZE_SUFFIX_1LETTER, sz);
+		l->size = xstrdup(szstr);
+		free(szstr);
+
 		list_add(&l->locks, locks);
 	}
+	free_procs();
 
 	fclose(fp);
 	return 0;
@@ -455,6 +555,7 @@ static int show_locks(struct list_head *locks, int tt_flags)
 		warn(_("failed to initialize output table"));
 		return -1;
 	}
+	tt_set_name(tt, "locks");
 
 	for (i = 0; i < ncolumns; i++) {
 		struct colinfo *col = get_column_info(i);
@@ -500,6 +601,7 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -p, --pid <pid>        process id\n"
+		" -J, --json             use JSON output format\n"
 		" -o, --output <list>    define which output columns to use\n"
 		" -n, --noheadings       don't print headings\n"
 		" -r, --raw              use the raw output format\n"
@@ -530,6 +632,7 @@ int main(int argc, char *argv[])
 		{ "version",    no_argument,       NULL, 'V' },
 		{ "noheadings", no_argument,       NULL, 'n' },
 		{ "raw",        no_argument,       NULL, 'r' },
+		{ "json",       no_argument,       NULL, 'J' },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -539,7 +642,7 @@ int main(int argc, char *argv[])
 	atexit(close_stdout);
 
 	while ((c = getopt_long(argc, argv,
-				"p:o:nruhV", long_opts, NULL)) != -1) {
+				"p:o:JnruhV", long_opts, NULL)) != -1) {
 
 		switch(c) {
 		case 'p':
@@ -559,6 +662,9 @@ int main(int argc, char *argv[])
 		case 'r':
 			tt_flags |= TT_FL_RAW;
 			break;
+		case 'J':
+			tt_flags |= TT_FL_JSON;
+			break;
 		case 'u':
 			disable_columns_truncate();
 			break;
@@ -8,7 +8,7 @@
  * message-digest algorithm to generate a 128-bit hexadecimal number for
  * use with xauth(1).
  *
- * NOTE: Unless /dev/random is available, this program does not actually
+ * NOTE: Unless getrandom() or /dev/urandom is available, this program does not actually
  * gather 128 bits of random information, so the magic cookie generated
  * will be considerably easier to guess than one might expect.
  *
@@ -22,44 +22,54 @@
 #include "md5.h"
 #include "nls.h"
 #include "closestream.h"
+#include "randutils.h"
+#include "strutils.h"
 
 #include <fcntl.h>
 #include <getopt.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
 #include <unistd.h>
 
-#define BUFFERSIZE	4096
+#define BUFFERSIZE	(128 * 1024)	/* read() size for the seed file */
+#define RAND_BYTES	128		/* bytes from random_get_bytes() */
 
-struct rngs {
-	const char *path;
-	int minlength, maxlength;
-} rngs[] = {
-	{"/dev/random",		16, 16},  /* 16 bytes = 128 bits suffice */
-	{"/proc/interrupts",	 0,  0},
-	{"/proc/slabinfo",	 0,  0},
-	{"/proc/stat",		 0,  0},
-	{"/dev/urandom",	32, 64},
-};
-
-#define RNGS (sizeof(rngs)/sizeof(struct rngs))
-
-/* The basic function to hash a file */
-static off_t hash_file(struct MD5Context *ctx, int fd)
+/* The basic function to hash a file, reads at most @max bytes (0 means all) */
+static off_t hash_file(struct MD5Context *ctx, int fd, uintmax_t max)
 {
 	off_t count = 0;
 	ssize_t r;
-	unsigned char buf[BUFFERSIZE];
+	unsigned char *buf;
+
+	buf = malloc(BUFFERSIZE);
+	if (!buf)
+		err(EXIT_FAILURE, _("cannot allocate %d bytes"), BUFFERSIZE);
 
-	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	for (;;) {
+		size_t sz = BUFFERSIZE;
+
+		if (max && max - count < sz)
+			sz = max - count;
+		if (!sz)
+			break;
+		r = read(fd, buf, sz);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
 		MD5Update(ctx, buf, r);
 		count += r;
 	}
 	/* Separate files with a null byte */
 	buf[0] = '\0';
 	MD5Update(ctx, buf, 1);
+	free(buf);
 	return count;
 }
 
@@ -70,10 +80,11 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 	      _(" %s [options]\n"), program_invocation_short_name);
 
 	fputs(_("\nOptions:\n"), out);
-	fputs(_(" -f, --file <file> use file as a cookie seed\n"
-		" -v, --verbose     explain what is being done\n"
-		" -V, --version     output version information and exit\n"
-		" -h, --help        display this help and exit\n\n"), out);
+	fputs(_(" -f, --file <file>     use file as a cookie seed\n"
+		" -m, --max-size <num>  limit how much is read from seed files\n"
+		" -v, --verbose         explain what is being done\n"
+		" -V, --version         output version information and exit\n"
+		" -h, --help            display this help and exit\n\n"), out);
 
 	exit(out == stderr ? EXIT_FAILURE : EXIT_SUCCESS);
 }
@@ -83,18 +94,19 @@ int main(int argc, char **argv)
 	size_t i;
 	struct MD5Context ctx;
 	unsigned char digest[MD5LENGTH];
-	unsigned char buf[BUFFERSIZE];
+	unsigned char buf[RAND_BYTES];
 	int fd;
 	int c;
 	pid_t pid;
 	char *file = NULL;
 	int verbose = 0;
-	int r;
+	uintmax_t max_size = 0;
 	struct timeval tv;
 	struct timezone tz;
 
 	static const struct option longopts[] = {
 		{"file", required_argument, NULL, 'f'},
+		{"max-size", required_argument, NULL, 'm'},
 		{"verbose", no_argument, NULL, 'v'},
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
@@ -107,7 +119,7 @@ int main(int argc, char **argv)
 	atexit(close_stdout);
 
 	while ((c =
-		getopt_long(argc, argv, "f:vVh", longopts, NULL)) != -1)
+		getopt_long(argc, argv, "f:m:vVh", longopts, NULL)) != -1)
 		switch (c) {
 		case 'v':
 			verbose = 1;
@@ -115,6 +127,10 @@ int main(int argc, char **argv)
 		case 'f':
 			file = optarg;
 			break;
+		case 'm':
+			max_size = strtosize_or_err(optarg,
+					_("failed to parse length"));
+			break;
 		case 'V':
 			printf(UTIL_LINUX_VERSION);
 			return EXIT_SUCCESS;
@@ -134,7 +150,7 @@ int main(int argc, char **argv)
 	MD5Update(&ctx, (unsigned char *) &pid, sizeof(pid));
 
 	if (file) {
-		int count = 0;
+		off_t count = 0;
 
 		if (file[0] == '-' && !file[1])
 			fd = STDIN_FILENO;
@@ -144,12 +160,12 @@ int main(int argc, char **argv)
 		if (fd < 0) {
 			warn(_("cannot open %s"), file);
 		} else {
-			count = hash_file(&ctx, fd);
+			count = hash_file(&ctx, fd, max_size);
 			if (verbose)
 				fprintf(stderr,
-					P_("Got %d byte from %s\n",
-					   "Got %d bytes from %s\n", count),
-					count, file);
+					P_("Got %jd byte from %s\n",
+					   "Got %jd bytes from %s\n", count),
+					(intmax_t) count, file);
 
 			if (fd != STDIN_FILENO)
 				if (close(fd))
@@ -158,28 +174,13 @@ int main(int argc, char **argv)
 		}
 	}
 
-	for (i = 0; i < RNGS; i++) {
-		if ((fd = open(rngs[i].path, O_RDONLY | O_NONBLOCK)) >= 0) {
-			int count = sizeof(buf);
-
-			if (rngs[i].maxlength && count > rngs[i].maxlength)
-				count = rngs[i].maxlength;
-			r = read(fd, buf, count);
-			if (r > 0)
-				MD5Update(&ctx, buf, r);
-			else
-				r = 0;
-			close(fd);
-			if (verbose)
-				fprintf(stderr,
-					P_("Got %d byte from %s\n",
-					   "Got %d bytes from %s\n", r),
-					r, rngs[i].path);
-			if (rngs[i].minlength && r >= rngs[i].minlength)
-				break;
-		} else if (verbose)
-			warn(_("cannot open %s"), rngs[i].path);
-	}
+	random_get_bytes(buf, RAND_BYTES);
+	MD5Update(&ctx, buf, RAND_BYTES);
+	if (verbose)
+		fprintf(stderr,
+			P_("Got %d byte from %s\n",
+			   "Got %d bytes from %s\n", RAND_BYTES),
+			RAND_BYTES, random_tell_source());
 
 	MD5Final(digest, &ctx);
 	for (i = 0; i < MD5LENGTH; i++)
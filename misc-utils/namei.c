@@ -38,6 +38,7 @@
 #include "widechar.h"
 #include "strutils.h"
 #include "closestream.h"
+#include "xxhash.h"
 
 #ifndef MAXSYMLINKS
 #define MAXSYMLINKS 256
@@ -71,6 +72,29 @@ struct idcache {
 	struct idcache		*next;
 };
 
+/*
+ * The same path prefixes are usually examined many times (every argument
+ * starts with the same directories and symlinks are resolved again and again),
+ * so the stat() and readlink() results are cached for the whole run.
+ */
+struct stcache {
+	char		*path;
+	struct stat	st;
+	int		follow;		/* stat() rather than lstat() */
+	int		err;		/* errno from stat() */
+	char		*link;		/* readlink() result or NULL */
+	ssize_t		linksz;
+	uint64_t	hash;
+	struct stcache	*next;
+};
+
+/* the hash table is doubled if the number of entries exceeds the size */
+#define STCACHE_MINSIZE	256
+
+static struct stcache **stcache;
+static size_t stcache_size;
+static size_t stcache_nents;
+
 static int flags;
 static int uwidth;		/* maximal width of username */
 static int gwidth;		/* maximal width of groupname */
@@ -162,6 +186,95 @@ add_gid(unsigned long int id)
 	}
 }
 
+static void
+grow_stcache(void)
+{
+	size_t i, size = stcache_size ? stcache_size * 2 : STCACHE_MINSIZE;
+	struct stcache **tb = xcalloc(size, sizeof(*tb));
+
+	for (i = 0; i < stcache_size; i++) {
+		while (stcache[i]) {
+			struct stcache *sc = stcache[i];
+			size_t h = sc->hash % size;
+
+			stcache[i] = sc->next;
+			sc->next = tb[h];
+			tb[h] = sc;
+		}
+	}
+	free(stcache);
+	stcache = tb;
+	stcache_size = size;
+}
+
+static struct stcache *
+get_stcache(const char *path, int follow)
+{
+	uint64_t hash = xxhash64(follow, path, strlen(path));
+	struct stcache *sc;
+	size_t h;
+
+	if (stcache_nents >= stcache_size)
+		grow_stcache();
+
+	h = hash % stcache_size;
+	for (sc = stcache[h]; sc; sc = sc->next) {
+		if (sc->hash == hash && sc->follow == follow &&
+		    strcmp(sc->path, path) == 0)
+			return sc;
+	}
+
+	sc = xcalloc(1, sizeof(*sc));
+	sc->path = xstrdup(path);
+	sc->follow = follow;
+	sc->hash = hash;
+	if ((follow ? stat(path, &sc->st) : lstat(path, &sc->st)) != 0)
+		sc->err = errno;
+
+	sc->next = stcache[h];
+	stcache[h] = sc;
+	stcache_nents++;
+	return sc;
+}
+
+static ssize_t
+stcache_readlink(struct stcache *sc, char *buf, size_t bufsz)
+{
+	if (!sc->link) {
+		char sym[PATH_MAX];
+
+		sc->linksz = readlink(sc->path, sym, sizeof(sym));
+		if (sc->linksz < 1)
+			return sc->linksz;
+		sc->link = xmalloc(sc->linksz);
+		memcpy(sc->link, sym, sc->linksz);
+	}
+	if ((size_t) sc->linksz > bufsz)
+		return -1;
+	memcpy(buf, sc->link, sc->linksz);
+	return sc->linksz;
+}
+
+static void
+free_stcache(void)
+{
+	size_t i;
+
+	for (i = 0; i < stcache_size; i++) {
+		while (stcache[i]) {
+			struct stcache *next = stcache[i]->next;
+
+			free(stcache[i]->path);
+			free(stcache[i]->link);
+			free(stcache[i]);
+			stcache[i] = next;
+		}
+	}
+	free(stcache);
+	stcache = NULL;
+	stcache_size = stcache_nents = 0;
+}
+
 static void
 free_namei(struct namei *nm)
 {
@@ -175,13 +288,13 @@ free_namei(struct namei *nm)
 }
 
 static void
-readlink_to_namei(struct namei *nm, const char *path)
+readlink_to_namei(struct namei *nm, struct stcache *sc, const char *path)
 {
 	char sym[PATH_MAX];
 	ssize_t sz;
 	int isrel = 0;
 
-	sz = readlink(path, sym, sizeof(sym));
+	sz = stcache_readlink(sc, sym, sizeof(sym));
 	if (sz < 1)
 		err(EXIT_FAILURE, _("failed to read symlink: %s"), path);
 	if (*sym != '/') {
@@ -213,6 +326,7 @@ readlink_to_namei(struct namei *nm, const char *path)
 static struct stat *
 dotdot_stat(const char *dirname, struct stat *st)
 {
+	struct stcache *sc;
 	char *path;
 	size_t len;
 
@@ -227,8 +341,12 @@ dotdot_stat(const char *dirname, struct stat *st)
 	memcpy(path, dirname, len);
 	memcpy(path + len, DOTDOTDIR, sizeof(DOTDOTDIR));
 
-	if (stat(path, st))
+	sc = get_stcache(path, 1);
+	if (sc->err) {
+		errno = sc->err;
 		err(EXIT_FAILURE, _("stat failed %s"), path);
+	}
+	*st = sc->st;
 	free(path);
 	return st;
 }
@@ -237,6 +355,7 @@ static struct namei *
 new_namei(struct namei *parent, const char *path, const char *fname, int lev)
 {
 	struct namei *nm;
+	struct stcache *sc;
 
 	if (!fname)
 		return NULL;
@@ -247,12 +366,14 @@ new_namei(struct namei *parent, const char *path, const char *fname, int lev)
 	nm->level = lev;
 	nm->name = xstrdup(fname);
 
-	nm->noent = (lstat(path, &nm->st) == -1);
+	sc = get_stcache(path, 0);
+	nm->noent = sc->err != 0;
 	if (nm->noent)
 		return nm;
+	nm->st = sc->st;
 
 	if (S_ISLNK(nm->st.st_mode))
-		readlink_to_namei(nm, path);
+		readlink_to_namei(nm, sc, path);
 	if (flags & NAMEI_OWNERS) {
 		add_uid(nm->st.st_uid);
 		add_gid(nm->st.st_gid);
@@ -505,9 +626,8 @@ main(int argc, char **argv)
 	for(; optind < argc; optind++) {
 		char *path = argv[optind];
 		struct namei *nm = NULL;
-		struct stat st;
 
-		if (stat(path, &st) != 0)
+		if (get_stcache(path, 1)->err)
 			rc = EXIT_FAILURE;
 
 		nm = add_namei(NULL, path, 0, NULL);
@@ -530,6 +650,7 @@ main(int argc, char **argv)
 
 	free_idcache(ucache);
 	free_idcache(gcache);
+	free_stcache();
 
 	return rc;
 }
@@ -19,78 +19,225 @@ for i in $@; do N=`echo "$i" | sed "s/$FROM/$TO/g"`; mv "$i" "$N"; done
 #include <errno.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 
 #include "nls.h"
 #include "xalloc.h"
 #include "c.h"
 #include "closestream.h"
 
-static int do_rename(char *from, char *to, char *s, int verbose, int symtarget)
+#ifndef RENAME_NOREPLACE
+# define RENAME_NOREPLACE	(1 << 0)
+#endif
+
+struct rename_ctl {
+	const char	*from;
+	const char	*to;
+	size_t		flen;
+	size_t		tlen;
+
+	char		*newname;	/* buffer for the new names */
+	size_t		newsz;
+
+	char		*dirname;	/* directory of the last file */
+	size_t		dirsz;
+	int		dirfd;		/* opened dirname or -1 */
+
+	size_t		nrenamed;	/* bulk mode statistic */
+	size_t		nunchanged;
+	size_t		nfailed;
+
+	unsigned int	verbose : 1,
+			symtarget : 1,
+			noreplace : 1,
+			bulk : 1;	/* names from stdin, don't exit on error */
+};
+
+/*
+ * Returns file descriptor of the directory @len bytes of @path, the last
+ * directory is kept open, because the names from find(1) are in the same
+ * directory in sequence.
+ */
+static int get_dirfd(struct rename_ctl *ctl, const char *path, size_t len)
 {
-	char *newname, *where, *p, *q, *target = NULL;
-	int flen, tlen, slen;
-	struct stat sb;
+	if (!len)
+		return AT_FDCWD;
 
-	if (symtarget) {
-		if (lstat(s, &sb) == -1)
-			err(EXIT_FAILURE, _("%s: lstat failed"), s);
+	if (ctl->dirfd >= 0 && ctl->dirname && strlen(ctl->dirname) == len &&
+	    strncmp(ctl->dirname, path, len) == 0)
+		return ctl->dirfd;
 
-		if (!S_ISLNK(sb.st_mode))
-			errx(EXIT_FAILURE, _("%s: not a symbolic link"), s);
+	if (ctl->dirfd >= 0)
+		close(ctl->dirfd);
+	if (ctl->dirsz < len + 1) {
+		ctl->dirsz = len + 1;
+		ctl->dirname = xrealloc(ctl->dirname, ctl->dirsz);
+	}
+	memcpy(ctl->dirname, path, len);
+	ctl->dirname[len] = '\0';
 
-		target = xmalloc(sb.st_size + 1);
-		if (readlink(s, target, sb.st_size + 1) < 0)
-			err(EXIT_FAILURE, _("%s: readlink failed"), s);
+	ctl->dirfd = open(ctl->dirname, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	return ctl->dirfd;
+}
 
-		target[sb.st_size] = '\0';
-		where = strstr(target, from);
-	} else
-		where = strstr(s, from);
+static int rename_file(struct rename_ctl *ctl, int dirfd,
+		       const char *oldname, const char *newname)
+{
+	struct stat st;
 
-	if (where == NULL)
-		return 0;
+	if (!ctl->noreplace)
+		return renameat(dirfd, oldname, dirfd, newname);
+#ifdef SYS_renameat2
+	{
+		static int unsupported;
 
-	flen = strlen(from);
-	tlen = strlen(to);
-	if (symtarget) {
-		slen = strlen(target);
+		if (!unsupported) {
+			int rc = syscall(SYS_renameat2, dirfd, oldname,
+					 dirfd, newname, RENAME_NOREPLACE);
+			if (rc == 0 || (errno != ENOSYS && errno != EINVAL))
+				return rc;
+			if (errno == ENOSYS)
+				unsupported = 1;
+		}
+	}
+#endif
+	/* not atomic fallback (old kernel or filesystem) */
+	if (fstatat(dirfd, newname, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+		errno = EEXIST;
+		return -1;
+	}
+	return renameat(dirfd, oldname, dirfd, newname);
+}
+
+/*
+ * Returns 1 if the file has been renamed, 0 if the name does not match
+ * and -1 on error.
+ */
+static int do_rename(struct rename_ctl *ctl, char *s)
+{
+	char *where, *p, *q, *target = NULL;
+	const char *base, *oldname = s, *newname;
+	size_t slen, dirlen;
+	int dirfd = AT_FDCWD, rc = -1;
+	struct stat sb;
+
+	/* the file relative to its directory */
+	base = strrchr(s, '/');
+	base = base ? base + 1 : s;
+	dirlen = base - s;
+	if (dirlen > 1)
+		dirlen--;		/* "a/b" for "a/b/c", "/" for "/c" */
+
+	if (*base && (ctl->bulk || ctl->symtarget)) {
+		dirfd = get_dirfd(ctl, s, dirlen);
+		if (dirfd == -1) {
+			warn(_("cannot open %s"), ctl->dirname);
+			return -1;
+		}
+		oldname = base;
+	}
+
+	if (ctl->symtarget) {
+		ssize_t sz;
+
+		if (fstatat(dirfd, oldname, &sb, AT_SYMLINK_NOFOLLOW) == -1) {
+			warn(_("%s: lstat failed"), s);
+			return -1;
+		}
+		if (!S_ISLNK(sb.st_mode)) {
+			warnx(_("%s: not a symbolic link"), s);
+			return -1;
+		}
+		target = xmalloc(sb.st_size + 1);
+		sz = readlinkat(dirfd, oldname, target, sb.st_size + 1);
+		if (sz < 0) {
+			warn(_("%s: readlink failed"), s);
+			goto done;
+		}
+		target[min((size_t) sz, (size_t) sb.st_size)] = '\0';
 		p = target;
-	} else {
-		slen = strlen(s);
+	} else
 		p = s;
+
+	where = strstr(p, ctl->from);
+	if (where == NULL) {
+		rc = 0;
+		goto done;
+	}
+
+	slen = strlen(p);
+	if (ctl->newsz < ctl->tlen + slen + 1) {
+		ctl->newsz = ctl->tlen + slen + 1;
+		ctl->newname = xrealloc(ctl->newname, ctl->newsz);
 	}
-	newname = xmalloc(tlen + slen + 1);
 
-	q = newname;
+	q = ctl->newname;
 	while (p < where)
 		*q++ = *p++;
-	p = to;
-	while (*p)
-		*q++ = *p++;
-	p = where + flen;
+	memcpy(q, ctl->to, ctl->tlen);
+	q += ctl->tlen;
+	p = where + ctl->flen;
 	while (*p)
 		*q++ = *p++;
 	*q = 0;
+	newname = ctl->newname;
 
-	if (symtarget) {
-		if (0 > unlink(s))
-			err(EXIT_FAILURE, _("%s: unlink failed"), s);
-		if (symlink(newname, s) != 0)
-			err(EXIT_FAILURE, _("%s: symlinking to %s failed"), s, newname);
-		if (verbose)
+	if (ctl->symtarget) {
+		if (unlinkat(dirfd, oldname, 0) != 0) {
+			warn(_("%s: unlink failed"), s);
+			goto done;
+		}
+		if (symlinkat(newname, dirfd, oldname) != 0) {
+			warn(_("%s: symlinking to %s failed"), s, newname);
+			goto done;
+		}
+		if (ctl->verbose)
 			printf("%s: `%s' -> `%s'\n", s, target, newname);
 	} else {
-		if (rename(s, newname) != 0)
-			err(EXIT_FAILURE, _("%s: rename to %s failed"), s, newname);
-		if (verbose)
-			printf("`%s' -> `%s'\n", s, newname);
+		/* use the directory only if the new name is in the same
+		 * directory, otherwise (expression matches the path) use
+		 * the full paths */
+		if (oldname != s) {
+			if (where >= base && !strchr(ctl->to, '/'))
+				newname += base - s;
+			else {
+				dirfd = AT_FDCWD;
+				oldname = s;
+			}
+		}
+		if (rename_file(ctl, dirfd, oldname, newname) != 0) {
+			warn(_("%s: rename to %s failed"), s, ctl->newname);
+			goto done;
+		}
+		if (ctl->verbose)
+			printf("`%s' -> `%s'\n", s, ctl->newname);
 	}
-
-	free(newname);
+	rc = 1;
+done:
 	free(target);
-	return 1;
+	return rc;
+}
+
+static void rename_result(struct rename_ctl *ctl, int rc)
+{
+	switch (rc) {
+	case 1:
+		ctl->nrenamed++;
+		break;
+	case 0:
+		ctl->nunchanged++;
+		break;
+	default:
+		if (!ctl->bulk)
+			exit(EXIT_FAILURE);
+		ctl->nfailed++;
+		break;
+	}
 }
 
 static void __attribute__ ((__noreturn__)) usage(FILE * out)
@@ -99,9 +246,14 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 	fprintf(out,
 	      _(" %s [options] expression replacement file...\n"),
 		program_invocation_short_name);
+	fprintf(out,
+	      _(" %s [options] -0 expression replacement < files\n"),
+		program_invocation_short_name);
 	fputs(USAGE_OPTIONS, out);
-	fputs(_(" -v, --verbose    explain what is being done\n"), out);
-	fputs(_(" -s, --symlink    act on symlink target\n"), out);
+	fputs(_(" -v, --verbose       explain what is being done\n"), out);
+	fputs(_(" -s, --symlink       act on symlink target\n"), out);
+	fputs(_(" -o, --no-overwrite  don't overwrite existing files\n"), out);
+	fputs(_(" -0, --null          read NUL-terminated file names from stdin\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	fputs(USAGE_HELP, out);
 	fputs(USAGE_VERSION, out);
@@ -111,14 +263,16 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 
 int main(int argc, char **argv)
 {
-	char *from, *to;
-	int i, c, symtarget=0, verbose = 0;
+	struct rename_ctl ctl = { .dirfd = -1 };
+	int i, c;
 
 	static const struct option longopts[] = {
 		{"verbose", no_argument, NULL, 'v'},
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
 		{"symlink", no_argument, NULL, 's'},
+		{"no-overwrite", no_argument, NULL, 'o'},
+		{"null", no_argument, NULL, '0'},
 		{NULL, 0, NULL, 0}
 	};
 
@@ -127,13 +281,19 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while ((c = getopt_long(argc, argv, "vsVh", longopts, NULL)) != -1)
+	while ((c = getopt_long(argc, argv, "vsoVh0", longopts, NULL)) != -1)
 		switch (c) {
 		case 'v':
-			verbose = 1;
+			ctl.verbose = 1;
 			break;
 		case 's':
-			symtarget = 1;
+			ctl.symtarget = 1;
+			break;
+		case 'o':
+			ctl.noreplace = 1;
+			break;
+		case '0':
+			ctl.bulk = 1;
 			break;
 		case 'V':
 			printf(UTIL_LINUX_VERSION);
@@ -147,16 +307,54 @@ int main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
-	if (argc < 3) {
+	if (argc < (ctl.bulk ? 2 : 3)) {
 		warnx(_("not enough arguments"));
 		usage(stderr);
 	}
+	if (ctl.bulk && argc > 2) {
+		warnx(_("file names are read from stdin with --null"));
+		usage(stderr);
+	}
 
-	from = argv[0];
-	to = argv[1];
+	ctl.from = argv[0];
+	ctl.to = argv[1];
+	ctl.flen = strlen(ctl.from);
+	ctl.tlen = strlen(ctl.to);
+
+	if (ctl.bulk) {
+		char *name = NULL;
+		size_t sz = 0;
+		ssize_t len;
+
+		while ((len = getdelim(&name, &sz, '\0', stdin)) >= 0) {
+			if (len && name[len - 1] == '\0')
+				len--;
+			if (!len)
+				continue;
+			name[len] = '\0';
+			rename_result(&ctl, do_rename(&ctl, name));
+		}
+		if (ferror(stdin)) {
+			warn(_("read failed"));
+			ctl.nfailed++;
+		}
+		free(name);
+
+		printf(P_("%zu file renamed", "%zu files renamed", ctl.nrenamed),
+				ctl.nrenamed);
+		printf(P_(", %zu unchanged", ", %zu unchanged", ctl.nunchanged),
+				ctl.nunchanged);
+		printf(P_(", %zu failed\n", ", %zu failed\n", ctl.nfailed),
+				ctl.nfailed);
+	} else {
+		for (i = 2; i < argc; i++)
+			rename_result(&ctl, do_rename(&ctl, argv[i]));
+	}
 
-	for (i = 2; i < argc; i++)
-		do_rename(from, to, argv[i], verbose, symtarget);
+	if (ctl.dirfd >= 0)
+		close(ctl.dirfd);
+	free(ctl.dirname);
+	free(ctl.newname);
 
-	return EXIT_SUCCESS;
+	return ctl.nfailed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -20,9 +20,12 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <string.h>
+#include <poll.h>
+#include <time.h>
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #else
@@ -37,6 +40,7 @@ extern int optind;
 #include "c.h"
 #include "closestream.h"
 #include "strutils.h"
+#include "xalloc.h"
 
 #ifdef USE_SOCKET_ACTIVATION
 #include "sd-daemon.h"
@@ -62,7 +66,8 @@ struct uuidd_cxt_t {
 	unsigned int	debug: 1,
 			quiet: 1,
 			no_fork: 1,
-			no_sock: 1;
+			no_sock: 1,
+			shm: 1;
 };
 
 static void __attribute__ ((__noreturn__)) usage(FILE * out)
@@ -82,6 +87,8 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 		" -P, --no-pid            do not create pid file\n"
 		" -F, --no-fork           do not daemonize using double-fork\n"
 		" -S, --socket-activation do not create listening socket\n"
+		" -m, --shm               publish time UUIDs by shared memory\n"
+		"     --stats             print statistics of running daemon\n"
 		" -d, --debug             run in debugging mode\n"
 		" -q, --quiet             turn on quiet mode\n"
 		" -V, --version           output version information and exit\n"
@@ -103,6 +110,94 @@ static void create_daemon(void)
 }
 
 static const char *cleanup_pidfile, *cleanup_socket;
+static struct uuidd_shm *uuidd_shm;
+
+/* request latency histogram buckets: <10us, <100us, ... <1s, >=1s */
+#define UUIDD_LATENCY_BUCKETS	7
+
+/* server statistics, see UUIDD_OP_GET_STATS */
+static struct uuidd_stats {
+	time_t		start;
+	uint64_t	nconns;				/* accepted connections */
+	unsigned int	nclients;			/* active connections */
+	uint64_t	nreqs[UUIDD_MAX_OP + 1];	/* requests per op */
+	uint64_t	ninvalid;			/* invalid requests */
+	uint64_t	nuuids;				/* UUIDs served */
+	uint64_t	nrefills;			/* shared memory ranges */
+	uint64_t	nseqbumps;			/* clock sequence changes */
+	uint64_t	latency[UUIDD_LATENCY_BUCKETS];
+
+	int		clock_seq;			/* the last clock sequence */
+} stats = { .clock_seq = -1 };
+
+static void publish_shm_range(struct uuidd_shm *shm, time_t now, int num);
+
+/* counts the clock sequence changes (the system time went backward etc.) */
+static void account_time_uuid(const uuid_t uu)
+{
+	int clock_seq = ((uu[8] & 0x3F) << 8) | uu[9];
+
+	if (stats.clock_seq >= 0 && stats.clock_seq != clock_seq)
+		stats.nseqbumps++;
+	stats.clock_seq = clock_seq;
+}
+
+static void account_latency(const struct timespec *start)
+{
+	struct timespec now;
+	uint64_t usec, limit = 10;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usec = (now.tv_sec - start->tv_sec) * 1000000 +
+	       (now.tv_nsec - start->tv_nsec) / 1000;
+
+	for (i = 0; i < UUIDD_LATENCY_BUCKETS - 1; i++, limit *= 10) {
+		if (usec < limit)
+			break;
+	}
+	stats.latency[i]++;
+}
+
+static int32_t sprint_stats(char *buf, size_t bufsz)
+{
+	static const char *opnames[] = {
+		[UUIDD_OP_GETPID]		= "getpid",
+		[UUIDD_OP_GET_MAXOP]		= "get-maxop",
+		[UUIDD_OP_TIME_UUID]		= "time-uuid",
+		[UUIDD_OP_RANDOM_UUID]		= "random-uuid",
+		[UUIDD_OP_BULK_TIME_UUID]	= "bulk-time-uuid",
+		[UUIDD_OP_BULK_RANDOM_UUID]	= "bulk-random-uuid",
+		[UUIDD_OP_GET_STATS]		= "get-stats"
+	};
+	static const char *latnames[UUIDD_LATENCY_BUCKETS] = {
+		"10us", "100us", "1ms", "10ms", "100ms", "1s", "inf"
+	};
+	size_t len = 0;
+	int i;
+
+#define print_stat(_fmt, ...) \
+	len += snprintf(buf + len, len < bufsz ? bufsz - len : 0, \
+			_fmt "\n", __VA_ARGS__)
+
+	print_stat("uptime %ld", (long) (time(NULL) - stats.start));
+	print_stat("connections %ju", (uintmax_t) stats.nconns);
+	print_stat("active-connections %u", stats.nclients);
+	for (i = 0; i <= UUIDD_MAX_OP; i++)
+		print_stat("op-%s %ju", opnames[i], (uintmax_t) stats.nreqs[i]);
+	print_stat("op-invalid %ju", (uintmax_t) stats.ninvalid);
+	print_stat("uuids %ju", (uintmax_t) stats.nuuids);
+	print_stat("shm-refills %ju", (uintmax_t) stats.nrefills);
+	print_stat("clock-seq-bumps %ju", (uintmax_t) stats.nseqbumps);
+	for (i = 0; i < UUIDD_LATENCY_BUCKETS; i++)
+		print_stat("latency-%s %ju", latnames[i],
+			   (uintmax_t) stats.latency[i]);
+#undef print_stat
+
+	if (len >= bufsz)
+		len = bufsz - 1;
+	return len + 1;		/* with terminating zero */
+}
 
 static void terminate_intr(int signo CODE_ATTR((unused)))
 {
@@ -110,6 +205,8 @@ static void terminate_intr(int signo CODE_ATTR((unused)))
 		unlink(cleanup_pidfile);
 	if (cleanup_socket)
 		unlink(cleanup_socket);
+	if (uuidd_shm)
+		publish_shm_range(uuidd_shm, 0, 0);	/* empty range */
 	exit(EXIT_SUCCESS);
 }
 
@@ -184,15 +281,16 @@ static int call_daemon(const char *socket_path, int op, char *buf,
 	}
 	ret = read_all(s, (char *) buf, reply_len);
 
+	/* number of UUIDs really generated by the daemon */
 	if ((ret > 0) && (op == UUIDD_OP_BULK_TIME_UUID)) {
 		if (reply_len >= (int) (UUID_LEN + sizeof(int)))
-			memcpy(buf + UUID_LEN, num, sizeof(int));
+			memcpy(num, buf + UUID_LEN, sizeof(int));
 		else
 			*num = -1;
 	}
 	if ((ret > 0) && (op == UUIDD_OP_BULK_RANDOM_UUID)) {
 		if (reply_len >= (int) sizeof(int))
-			memcpy(buf, num, sizeof(int));
+			memcpy(num, buf, sizeof(int));
 		else
 			*num = -1;
 	}
@@ -290,16 +388,372 @@ static int create_socket(const char *socket_path, int will_fork, int quiet)
 	return s;
 }
 
+/*
+ * Maps the shared memory with time UUID ranges for clients. The file is
+ * not removed by the daemon, so the clients which already mapped it continue
+ * to use it after uuidd restart.
+ */
+static struct uuidd_shm *create_shm(const char *path, int quiet)
+{
+	struct uuidd_shm *shm;
+	mode_t save_umask;
+	struct stat st;
+	int fd;
+
+	save_umask = umask(0);
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0660);
+	umask(save_umask);
+	if (fd < 0) {
+		if (!quiet)
+			warn(_("cannot open %s"), path);
+		return NULL;
+	}
+
+	/* the file may be left by the previous instance, or created by someone else */
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid()) {
+		if (!quiet)
+			warnx(_("%s: not a regular file owned by uuidd"), path);
+		close(fd);
+		return NULL;
+	}
+	if (fchown(fd, -1, getegid()) != 0 || fchmod(fd, 0660) != 0) {
+		if (!quiet)
+			warn(_("cannot set permissions of %s"), path);
+		close(fd);
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(*shm)) != 0) {
+		if (!quiet)
+			warn(_("cannot resize %s"), path);
+		close(fd);
+		return NULL;
+	}
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		if (!quiet)
+			warn(_("cannot map %s"), path);
+		return NULL;
+	}
+
+	/* keep the generation from the previous instance */
+	if (shm->magic != UUIDD_SHM_MAGIC || shm->nranges != UUIDD_SHM_RANGES) {
+		memset(shm, 0, sizeof(*shm));
+		shm->nranges = UUIDD_SHM_RANGES;
+		__sync_synchronize();
+		shm->magic = UUIDD_SHM_MAGIC;
+	}
+	return shm;
+}
+
+/*
+ * Reserves @num time UUIDs and publishes them as the next generation. The
+ * range is written to the next slot of the ring before the claims are
+ * redirected to it.
+ */
+static void publish_shm_range(struct uuidd_shm *shm, time_t now, int num)
+{
+	struct uuidd_shm_range *r;
+	uint64_t claim;
+	uint32_t gen;
+
+	gen = (uint32_t) (__sync_fetch_and_add(&shm->claim, 0) >> 32) + 1;
+	r = &shm->ranges[gen % UUIDD_SHM_RANGES];
+
+	if (num > 0) {
+		__uuid_generate_time(r->uuid, &num);
+		account_time_uuid(r->uuid);
+		stats.nrefills++;
+	}
+	r->count = num > 0 ? num : 0;
+	r->time = now;
+	__sync_synchronize();
+	r->gen = gen;
+	__sync_synchronize();
+
+	do {
+		claim = shm->claim;
+	} while (!__sync_bool_compare_and_swap(&shm->claim, claim,
+					       (uint64_t) gen << 32));
+}
+
+/* refills the shared memory if the current range is expired or half used */
+static void refill_shm(struct uuidd_shm *shm, time_t now)
+{
+	uint64_t claim = __sync_fetch_and_add(&shm->claim, 0);
+	uint32_t gen = claim >> 32, used = claim;
+	struct uuidd_shm_range *r = &shm->ranges[gen % UUIDD_SHM_RANGES];
+
+	if (r->gen == gen && used < r->count / 2 && r->time == now)
+		return;
+	publish_shm_range(shm, now, UUIDD_SHM_RANGE_SIZE);
+}
+
+/* maximal number of UUIDs returned by UUIDD_OP_BULK_RANDOM_UUID (256 KiB) */
+#define UUIDD_MAX_BULK		16384
+
+/* maximal number of clients in flight, the others wait in listen() backlog */
+#define UUIDD_MAX_CLIENTS	256
+
+/* seconds, drop clients which don't send the request or read the reply */
+#define UUIDD_CLIENT_TIMEOUT	5
+
+/* seconds, drop idle persistent connections */
+#define UUIDD_IDLE_TIMEOUT	30
+
+/* client connection state */
+struct uuidd_client {
+	int	fd;
+	time_t	start;
+
+	char	req[1 + sizeof(int32_t)];	/* op and optional num */
+	size_t	req_len;			/* already read bytes */
+	struct timespec req_start;		/* the first byte of the request */
+
+	char	*reply;				/* reply_len and reply data */
+	size_t	reply_sz;			/* size of the reply */
+	size_t	reply_len;			/* already written bytes */
+
+	unsigned int nreqs;			/* already served requests */
+};
+
+/* size of the UUIDD_OP_GET_STATS reply */
+#define UUIDD_STATS_BUFSZ	1024
+
+/* the connection waits for the next request */
+#define is_idle_client(_cl)	((_cl)->nreqs && !(_cl)->req_len && !(_cl)->reply)
+
+/*
+ * Generates the reply for the request to @reply_buf. All requests are
+ * processed in the main loop one by one, so the time UUIDs (and the time UUID
+ * ranges reserved by UUIDD_OP_BULK_TIME_UUID) are always generated in order.
+ *
+ * Returns: length of the reply or -1 for invalid operation.
+ */
+static int32_t process_request(const struct uuidd_cxt_t *uuidd_cxt,
+			       char op, int num, char *reply_buf)
+{
+	int32_t reply_len = 0;
+	char str[UUID_STR_LEN], *cp;
+	uuid_t uu;
+	int i;
+
+	switch (op) {
+	case UUIDD_OP_GETPID:
+		sprintf(reply_buf, "%d", getpid());
+		reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_GET_MAXOP:
+		sprintf(reply_buf, "%d", UUIDD_MAX_OP);
+		reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_GET_STATS:
+		reply_len = sprint_stats(reply_buf, UUIDD_STATS_BUFSZ);
+		break;
+	case UUIDD_OP_TIME_UUID:
+		num = 1;
+		__uuid_generate_time(uu, &num);
+		account_time_uuid(uu);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated time UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_RANDOM_UUID:
+		num = 1;
+		__uuid_generate_random(uu, &num);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated random UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_BULK_TIME_UUID:
+		__uuid_generate_time(uu, &num);
+		account_time_uuid(uu);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, P_("Generated time UUID %s "
+					   "and %d following\n",
+					   "Generated time UUID %s "
+					   "and %d following\n", num - 1),
+			       str, num - 1);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		memcpy(reply_buf + reply_len, &num, sizeof(num));
+		reply_len += sizeof(num);
+		break;
+	case UUIDD_OP_BULK_RANDOM_UUID:
+		if (num < 0)
+			num = 1;
+		if (num > UUIDD_MAX_BULK)
+			num = UUIDD_MAX_BULK;
+		__uuid_generate_random((unsigned char *) reply_buf +
+				      sizeof(num), &num);
+		if (uuidd_cxt->debug) {
+			fprintf(stderr, P_("Generated %d UUID:\n",
+					   "Generated %d UUIDs:\n", num), num);
+			for (i = 0, cp = reply_buf + sizeof(num);
+			     i < num;
+			     i++, cp += UUID_LEN) {
+				uuid_unparse((unsigned char *)cp, str);
+				fprintf(stderr, "\t%s\n", str);
+			}
+		}
+		reply_len = (num * UUID_LEN) + sizeof(num);
+		memcpy(reply_buf, &num, sizeof(num));
+		break;
+	default:
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("Invalid operation %d\n"), op);
+		stats.ninvalid++;
+		return -1;
+	}
+
+	stats.nreqs[(int) op]++;
+	if (op == UUIDD_OP_TIME_UUID || op == UUIDD_OP_RANDOM_UUID)
+		stats.nuuids++;
+	else if (op == UUIDD_OP_BULK_TIME_UUID ||
+		 op == UUIDD_OP_BULK_RANDOM_UUID)
+		stats.nuuids += num;
+	return reply_len;
+}
+
+static void close_client(struct uuidd_client *cl)
+{
+	close(cl->fd);
+	free(cl->reply);
+	memset(cl, 0, sizeof(*cl));
+	cl->fd = -1;
+}
+
+/*
+ * Reads the client request and generates the reply.
+ *
+ * Returns: 0 if more data are expected, 1 if the reply is ready, -1 on error.
+ */
+static int read_request(const struct uuidd_cxt_t *uuidd_cxt,
+			struct uuidd_client *cl)
+{
+	size_t want = 1;
+	int32_t reply_len;
+	ssize_t len;
+	int num = 0;
+	char op;
+
+	if (cl->req_len && (cl->req[0] == UUIDD_OP_BULK_TIME_UUID ||
+			    cl->req[0] == UUIDD_OP_BULK_RANDOM_UUID))
+		want += sizeof(int32_t);
+	else if (!cl->req_len)
+		clock_gettime(CLOCK_MONOTONIC, &cl->req_start);
+
+	len = read(cl->fd, cl->req + cl->req_len, want - cl->req_len);
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (len <= 0) {
+		if (is_idle_client(cl))
+			;	/* persistent connection closed by client */
+		else if (len < 0)
+			warn(_("read failed"));
+		else if (cl->req_len == 0)
+			warnx(_("error reading from client, len = %d"), (int) len);
+		return -1;
+	}
+	cl->req_len += len;
+
+	op = cl->req[0];
+	if (cl->req_len == 1 && (op == UUIDD_OP_BULK_TIME_UUID ||
+				 op == UUIDD_OP_BULK_RANDOM_UUID))
+		return read_request(uuidd_cxt, cl);	/* read num */
+	if (cl->req_len < want)
+		return 0;
+
+	if ((op == UUIDD_OP_BULK_TIME_UUID) ||
+	    (op == UUIDD_OP_BULK_RANDOM_UUID)) {
+		memcpy(&num, cl->req + 1, sizeof(num));
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("operation %d, incoming num = %d\n"),
+			       op, num);
+	} else if (uuidd_cxt->debug)
+		fprintf(stderr, _("operation %d\n"), op);
+
+	if (op == UUIDD_OP_BULK_RANDOM_UUID) {
+		size_t n = num < 1 ? 1 : min(num, UUIDD_MAX_BULK);
+
+		cl->reply = xmalloc(sizeof(reply_len) + sizeof(num) +
+				    n * UUID_LEN);
+	} else if (op == UUIDD_OP_GET_STATS)
+		cl->reply = xmalloc(sizeof(reply_len) + UUIDD_STATS_BUFSZ);
+	else
+		cl->reply = xmalloc(sizeof(reply_len) + 64);
+
+	reply_len = process_request(uuidd_cxt, op, num,
+				    cl->reply + sizeof(reply_len));
+	if (reply_len < 0)
+		return -1;
+
+	memcpy(cl->reply, &reply_len, sizeof(reply_len));
+	cl->reply_sz = sizeof(reply_len) + reply_len;
+	return 1;
+}
+
+/*
+ * Writes the reply. The connection is persistent -- when the reply is
+ * complete the client may send the next request (or close the connection).
+ * The pipelined requests are processed in order.
+ *
+ * Returns: 0 if more data have to be written or the next request is
+ * expected, -1 on error.
+ */
+static int write_reply(struct uuidd_client *cl, time_t now)
+{
+	ssize_t len = write(cl->fd, cl->reply + cl->reply_len,
+			    cl->reply_sz - cl->reply_len);
+	if (len < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+
+	cl->reply_len += len;
+	if (cl->reply_len == cl->reply_sz) {
+		account_latency(&cl->req_start);
+		free(cl->reply);
+		cl->reply = NULL;
+		cl->reply_sz = cl->reply_len = cl->req_len = 0;
+		cl->start = now;
+		cl->nreqs++;
+	}
+	return 0;
+}
+
+/* closes the oldest idle connection to make a room for a new client */
+static int drop_idle_client(struct uuidd_client *clients)
+{
+	struct uuidd_client *old = NULL;
+	int i;
+
+	for (i = 0; i < UUIDD_MAX_CLIENTS; i++) {
+		struct uuidd_client *cl = &clients[i];
+
+		if (cl->fd >= 0 && is_idle_client(cl) &&
+		    (!old || cl->start < old->start))
+			old = cl;
+	}
+	if (!old)
+		return -1;
+	close_client(old);
+	return 0;
+}
+
 static void server_loop(const char *socket_path, const char *pidfile_path,
 			const struct uuidd_cxt_t *uuidd_cxt)
 {
-	struct sockaddr_un	from_addr;
-	socklen_t		fromlen;
-	int32_t			reply_len = 0;
-	uuid_t			uu;
-	char			reply_buf[1024], *cp;
-	char			op, str[UUID_STR_LEN];
-	int			i, ns, len, num;
+	struct uuidd_client	*clients;
+	struct pollfd		*fds;
+	char			reply_buf[1024];
+	int			i, nclients = 0;
 	int			s = 0;
 	int			fd_pidfile = -1;
 	int			ret;
@@ -352,6 +806,14 @@ static void server_loop(const char *socket_path, const char *pidfile_path,
 	signal(SIGALRM, terminate_intr);
 	signal(SIGPIPE, SIG_IGN);
 
+	stats.start = time(NULL);
+
+	if (uuidd_cxt->shm) {
+		uuidd_shm = create_shm(UUIDD_SHM_PATH, uuidd_cxt->quiet);
+		if (uuidd_shm)
+			refill_shm(uuidd_shm, time(NULL));
+	}
+
 #ifdef USE_SOCKET_ACTIVATION
 	if (uuidd_cxt->no_sock) {
 		if (sd_listen_fds(0) != 1)
@@ -361,112 +823,104 @@ static void server_loop(const char *socket_path, const char *pidfile_path,
 	}
 #endif
 
+	/*
+	 * The clients are served by non-blocking I/O, so a slow client does
+	 * not block the others. fds[0] is the listening socket, fds[i + 1] is
+	 * the clients[i].
+	 */
+	clients = xcalloc(UUIDD_MAX_CLIENTS, sizeof(struct uuidd_client));
+	fds = xcalloc(UUIDD_MAX_CLIENTS + 1, sizeof(struct pollfd));
+	for (i = 0; i < UUIDD_MAX_CLIENTS; i++)
+		clients[i].fd = -1;
+
 	while (1) {
-		fromlen = sizeof(from_addr);
-		if (uuidd_cxt->timeout > 0)
-			alarm(uuidd_cxt->timeout);
-		ns = accept(s, (struct sockaddr *) &from_addr, &fromlen);
-		alarm(0);
-		if (ns < 0) {
+		int timeout = -1, nreqs = 0;
+		time_t now;
+
+		if (nclients == UUIDD_MAX_CLIENTS && drop_idle_client(clients) == 0)
+			nclients--;
+		fds[0].fd = nclients < UUIDD_MAX_CLIENTS ? s : -1;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+
+		for (i = 0; i < UUIDD_MAX_CLIENTS; i++) {
+			fds[i + 1].fd = clients[i].fd;
+			fds[i + 1].events = clients[i].reply ? POLLOUT : POLLIN;
+			fds[i + 1].revents = 0;
+		}
+
+		if (nclients)
+			timeout = 1000;		/* check clients timeout */
+		else if (uuidd_cxt->timeout > 0)
+			timeout = uuidd_cxt->timeout * 1000;
+
+		stats.nclients = nclients;
+		ret = poll(fds, UUIDD_MAX_CLIENTS + 1, timeout);
+		if (ret < 0) {
 			if ((errno == EAGAIN) || (errno == EINTR))
 				continue;
-			else
-				err(EXIT_FAILURE, "accept");
+			err(EXIT_FAILURE, "poll");
 		}
-		len = read(ns, &op, 1);
-		if (len != 1) {
-			if (len < 0)
-				warn(_("read failed"));
+		if (ret == 0 && !nclients)
+			terminate_intr(0);	/* inactivity timeout */
+
+		now = time(NULL);
+
+		for (i = 0; i < UUIDD_MAX_CLIENTS; i++) {
+			struct uuidd_client *cl = &clients[i];
+			short rev = fds[i + 1].revents;
+
+			if (cl->fd < 0)
+				continue;
+			if (rev & POLLIN) {
+				ret = read_request(uuidd_cxt, cl);
+				if (ret > 0)
+					nreqs++;
+			} else if (rev & POLLOUT)
+				ret = 0;
+			else if (rev & (POLLERR | POLLHUP | POLLNVAL))
+				ret = -1;
+			else if (now - cl->start > (is_idle_client(cl) ?
+							UUIDD_IDLE_TIMEOUT :
+							UUIDD_CLIENT_TIMEOUT))
+				ret = -1;
 			else
-				warnx(_("error reading from client, len = %d"),
-						len);
-			goto shutdown_socket;
-		}
-		if ((op == UUIDD_OP_BULK_TIME_UUID) ||
-		    (op == UUIDD_OP_BULK_RANDOM_UUID)) {
-			if (read_all(ns, (char *) &num, sizeof(num)) != 4)
-				goto shutdown_socket;
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("operation %d, incoming num = %d\n"),
-				       op, num);
-		} else if (uuidd_cxt->debug)
-			fprintf(stderr, _("operation %d\n"), op);
-
-		switch (op) {
-		case UUIDD_OP_GETPID:
-			sprintf(reply_buf, "%d", getpid());
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_GET_MAXOP:
-			sprintf(reply_buf, "%d", UUIDD_MAX_OP);
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_TIME_UUID:
-			num = 1;
-			__uuid_generate_time(uu, &num);
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated time UUID: %s\n"), str);
+				continue;
+
+			if (ret >= 0 && cl->reply)
+				ret = write_reply(cl, now);	/* try to write now */
+			if (ret != 0) {
+				close_client(cl);
+				nclients--;
 			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_RANDOM_UUID:
-			num = 1;
-			__uuid_generate_random(uu, &num);
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated random UUID: %s\n"), str);
+		}
+
+		/* the clients call the daemon when the range is drained */
+		if (uuidd_shm && nreqs)
+			refill_shm(uuidd_shm, now);
+
+		if (fds[0].revents & POLLIN) {
+			int ns = accept(s, NULL, NULL);
+
+			if (ns < 0) {
+				if ((errno == EAGAIN) || (errno == EINTR))
+					continue;
+				err(EXIT_FAILURE, "accept");
 			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_BULK_TIME_UUID:
-			__uuid_generate_time(uu, &num);
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, P_("Generated time UUID %s "
-						   "and %d following\n",
-						   "Generated time UUID %s "
-						   "and %d following\n", num - 1),
-				       str, num - 1);
+			if (fcntl(ns, F_SETFL, O_NONBLOCK) < 0) {
+				warn("fcntl");
+				close(ns);
+				continue;
 			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			memcpy(reply_buf + reply_len, &num, sizeof(num));
-			reply_len += sizeof(num);
-			break;
-		case UUIDD_OP_BULK_RANDOM_UUID:
-			if (num < 0)
-				num = 1;
-			if (num > 1000)
-				num = 1000;
-			if (num * UUID_LEN > (int) (sizeof(reply_buf) - sizeof(num)))
-				num = (sizeof(reply_buf) - sizeof(num)) / UUID_LEN;
-			__uuid_generate_random((unsigned char *) reply_buf +
-					      sizeof(num), &num);
-			if (uuidd_cxt->debug) {
-				fprintf(stderr, P_("Generated %d UUID:\n",
-						   "Generated %d UUIDs:\n", num), num);
-				for (i = 0, cp = reply_buf + sizeof(num);
-				     i < num;
-				     i++, cp += UUID_LEN) {
-					uuid_unparse((unsigned char *)cp, str);
-					fprintf(stderr, "\t%s\n", str);
-				}
+			for (i = 0; i < UUIDD_MAX_CLIENTS; i++) {
+				if (clients[i].fd < 0)
+					break;
 			}
-			reply_len = (num * UUID_LEN) + sizeof(num);
-			memcpy(reply_buf, &num, sizeof(num));
-			break;
-		default:
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("Invalid operation %d\n"), op);
-			goto shutdown_socket;
+			clients[i].fd = ns;
+			clients[i].start = now;
+			nclients++;
+			stats.nconns++;
 		}
-		write_all(ns, (char *) &reply_len, sizeof(reply_len));
-		write_all(ns, reply_buf, reply_len);
-	shutdown_socket:
-		close(ns);
 	}
 }
 
@@ -485,12 +939,15 @@ int main(int argc, char **argv)
 	char		str[UUID_STR_LEN];
 	uuid_t		uu;
 	int		i, c, ret;
-	int		do_type = 0, do_kill = 0, num = 0;
+	int		do_type = 0, do_kill = 0, do_stats = 0, num = 0;
 	int		no_pid = 0;
 	int		s_flag = 0;
 
 	struct uuidd_cxt_t uuidd_cxt = { .timeout = 0 };
 
+	enum {
+		OPT_STATS = CHAR_MAX + 1
+	};
 	static const struct option longopts[] = {
 		{"pid", required_argument, NULL, 'p'},
 		{"socket", required_argument, NULL, 's'},
@@ -502,6 +959,8 @@ int main(int argc, char **argv)
 		{"no-pid", no_argument, NULL, 'P'},
 		{"no-fork", no_argument, NULL, 'F'},
 		{"socket-activation", no_argument, NULL, 'S'},
+		{"shm", no_argument, NULL, 'm'},
+		{"stats", no_argument, NULL, OPT_STATS},
 		{"debug", no_argument, NULL, 'd'},
 		{"quiet", no_argument, NULL, 'q'},
 		{"version", no_argument, NULL, 'V'},
@@ -515,7 +974,7 @@ int main(int argc, char **argv)
 	atexit(close_stdout);
 
 	while ((c =
-		getopt_long(argc, argv, "p:s:T:krtn:PFSdqVh", longopts,
+		getopt_long(argc, argv, "p:s:T:krtn:PFSmdqVh", longopts,
 			    NULL)) != -1) {
 		switch (c) {
 		case 'd':
@@ -524,6 +983,12 @@ int main(int argc, char **argv)
 		case 'k':
 			do_kill++;
 			break;
+		case 'm':
+			uuidd_cxt.shm = 1;
+			break;
+		case OPT_STATS:
+			do_stats = 1;
+			break;
 		case 'n':
 			num = strtou32_or_err(optarg,
 						_("failed to parse --uuids"));
@@ -588,8 +1053,16 @@ int main(int argc, char **argv)
 			"Ignoring --socket."));
 
 	if (num && do_type) {
-		ret = call_daemon(socket_path, do_type + 2, buf,
-				  sizeof(buf), &num, &err_context);
+		char *rbuf = buf;
+		size_t rbufsz = sizeof(buf);
+
+		if (do_type == UUIDD_OP_RANDOM_UUID) {
+			num = min(num, UUIDD_MAX_BULK);
+			rbufsz = sizeof(num) + num * UUID_LEN;
+			rbuf = xmalloc(rbufsz);
+		}
+		ret = call_daemon(socket_path, do_type + 2, rbuf,
+				  rbufsz, &num, &err_context);
 		if (ret < 0)
 			err(EXIT_FAILURE, _("error calling uuidd daemon (%s)"),
 					err_context ? : _("unexpected error"));
@@ -598,20 +1071,21 @@ int main(int argc, char **argv)
 			if (ret != sizeof(uu) + sizeof(num))
 				unexpected_size(ret);
 
-			uuid_unparse((unsigned char *) buf, str);
+			uuid_unparse((unsigned char *) rbuf, str);
 
 			printf(P_("%s and %d subsequent UUID\n",
 				  "%s and %d subsequent UUIDs\n", num - 1),
 			       str, num - 1);
 		} else {
 			printf(_("List of UUIDs:\n"));
-			cp = buf + 4;
+			cp = rbuf + 4;
 			if (ret != (int) (sizeof(num) + num * sizeof(uu)))
 				unexpected_size(ret);
 			for (i = 0; i < num; i++, cp += UUID_LEN) {
 				uuid_unparse((unsigned char *) cp, str);
 				printf("\t%s\n", str);
 			}
+			free(rbuf);
 		}
 		return EXIT_SUCCESS;
 	}
@@ -630,6 +1104,18 @@ int main(int argc, char **argv)
 		return EXIT_SUCCESS;
 	}
 
+	if (do_stats) {
+		ret = call_daemon(socket_path, UUIDD_OP_GET_STATS, buf,
+				  sizeof(buf), 0, &err_context);
+		if (ret < 0)
+			err(EXIT_FAILURE, _("error calling uuidd daemon (%s)"),
+					err_context ? : _("unexpected error"));
+		if (ret < 1 || buf[ret - 1] != '\0')
+			unexpected_size(ret);
+		fputs(buf, stdout);
+		return EXIT_SUCCESS;
+	}
+
 	if (do_kill) {
 		ret = call_daemon(socket_path, UUIDD_OP_GETPID, buf, sizeof(buf), 0, NULL);
 		if ((ret > 0) && ((do_kill = atoi((char *) buf)) > 0)) {
@@ -25,10 +25,17 @@ extern int optind;
 #include "nls.h"
 #include "c.h"
 #include "closestream.h"
+#include "strutils.h"
+#include "xalloc.h"
 
 #define DO_TYPE_TIME	1
 #define DO_TYPE_RANDOM	2
 
+#define UUID_STR_LEN	37
+
+/* number of UUIDs generated and written at once */
+#define UUIDGEN_CHUNK	1024
+
 static void __attribute__ ((__noreturn__)) usage(FILE * out)
 {
 	fputs(_("\nUsage:\n"), out);
@@ -36,25 +43,57 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 	      _(" %s [options]\n"), program_invocation_short_name);
 
 	fputs(_("\nOptions:\n"), out);
-	fputs(_(" -r, --random     generate random-based uuid\n"
-		" -t, --time       generate time-based uuid\n"
-		" -V, --version    output version information and exit\n"
-		" -h, --help       display this help and exit\n\n"), out);
+	fputs(_(" -r, --random       generate random-based uuid\n"
+		" -t, --time         generate time-based uuid\n"
+		" -C, --count <num>  generate more uuids\n"
+		" -b, --binary       write 16-byte binary uuids\n"
+		" -V, --version      output version information and exit\n"
+		" -h, --help         display this help and exit\n\n"), out);
 
 	exit(out == stderr ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
+/*
+ * Without the type the first UUID is generated by uuid_generate() and the
+ * rest uses the same type, so the random source is checked only once.
+ */
+static void generate_uuids(uuid_t *uus, size_t n, int *do_type)
+{
+	size_t i;
+
+	if (!*do_type) {
+		uuid_generate(uus[0]);
+		*do_type = uuid_type(uus[0]) == UUID_TYPE_DCE_TIME ?
+				DO_TYPE_TIME : DO_TYPE_RANDOM;
+		uus++;
+		n--;
+	}
+
+	switch (*do_type) {
+	case DO_TYPE_TIME:
+		for (i = 0; i < n; i++)
+			uuid_generate_time(uus[i]);
+		break;
+	case DO_TYPE_RANDOM:
+		uuid_generate_random_n(uus, n);
+		break;
+	}
+}
+
 int
 main (int argc, char *argv[])
 {
 	int    c;
-	int    do_type = 0;
-	char   str[37];
-	uuid_t uu;
+	int    do_type = 0, binary = 0;
+	uint64_t count = 1;
+	char   *str = NULL;
+	uuid_t *uus;
 
 	static const struct option longopts[] = {
 		{"random", no_argument, NULL, 'r'},
 		{"time", no_argument, NULL, 't'},
+		{"count", required_argument, NULL, 'C'},
+		{"binary", no_argument, NULL, 'b'},
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
@@ -65,7 +104,7 @@ main (int argc, char *argv[])
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while ((c = getopt_long(argc, argv, "rtVh", longopts, NULL)) != -1)
+	while ((c = getopt_long(argc, argv, "rtC:bVh", longopts, NULL)) != -1)
 		switch (c) {
 		case 't':
 			do_type = DO_TYPE_TIME;
@@ -73,6 +112,12 @@ main (int argc, char *argv[])
 		case 'r':
 			do_type = DO_TYPE_RANDOM;
 			break;
+		case 'C':
+			count = strtou64_or_err(optarg, _("invalid count argument"));
+			break;
+		case 'b':
+			binary = 1;
+			break;
 		case 'V':
 			printf(UTIL_LINUX_VERSION);
 			return EXIT_SUCCESS;
@@ -82,21 +127,32 @@ main (int argc, char *argv[])
 			usage(stderr);
 		}
 
-	switch (do_type) {
-	case DO_TYPE_TIME:
-		uuid_generate_time(uu);
-		break;
-	case DO_TYPE_RANDOM:
-		uuid_generate_random(uu);
-		break;
-	default:
-		uuid_generate(uu);
-		break;
-	}
+	uus = xmalloc(UUIDGEN_CHUNK * sizeof(uuid_t));
+	if (!binary)
+		str = xmalloc(UUIDGEN_CHUNK * UUID_STR_LEN);
+
+	while (count > 0) {
+		size_t i, n = min(count, (uint64_t) UUIDGEN_CHUNK);
 
-	uuid_unparse(uu, str);
+		generate_uuids(uus, n, &do_type);
 
-	printf("%s\n", str);
+		if (binary) {
+			if (fwrite(uus, sizeof(uuid_t), n, stdout) != n)
+				err(EXIT_FAILURE, _("write failed"));
+		} else {
+			for (i = 0; i < n; i++) {
+				char *p = str + i * UUID_STR_LEN;
+
+				uuid_unparse(uus[i], p);
+				p[UUID_STR_LEN - 1] = '\n';
+			}
+			if (fwrite(str, UUID_STR_LEN, n, stdout) != n)
+				err(EXIT_FAILURE, _("write failed"));
+		}
+		count -= n;
+	}
 
+	free(uus);
+	free(str);
 	return EXIT_SUCCESS;
 }
@@ -68,6 +68,12 @@ enum {
 	ALL_DIRS = BIN_DIR | MAN_DIR | SRC_DIR
 };
 
+/* directory entry, see wh_dirlist_read() */
+struct wh_dirent {
+	char	*name;
+	size_t	pos;		/* readdir() order */
+};
+
 /* directories */
 struct wh_dirlist {
 	int	type;
@@ -75,6 +81,10 @@ struct wh_dirlist {
 	ino_t	st_ino;
 	char	*path;
 
+	struct wh_dirent *ents;	/* sorted by name, read on demand */
+	size_t	nents;
+	unsigned int loaded :1;
+
 	struct wh_dirlist *next;
 };
 
@@ -323,6 +333,9 @@ static void free_dirlist(struct wh_dirlist **ls0, int type)
 
 			DBG(printf("freeing dir: %s", ls->path));
 
+			while (ls->nents > 0)
+				free(ls->ents[--ls->nents].name);
+			free(ls->ents);
 			free(ls->path);
 			free(ls);
 			ls = next;
@@ -372,33 +385,150 @@ static int filename_equal(const char *cp, const char *dp)
 	return 0;
 }
 
-static void findin(const char *dir, const char *pattern, int *count, char **wait)
+static int cmp_dirent_name(const void *a, const void *b)
+{
+	return strcmp(((const struct wh_dirent *) a)->name,
+		      ((const struct wh_dirent *) b)->name);
+}
+
+static int cmp_dirent_pos(const void *a, const void *b)
+{
+	const struct wh_dirent *x = *(const struct wh_dirent * const *) a,
+			       *y = *(const struct wh_dirent * const *) b;
+
+	return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+/*
+ * Reads the directory only once for all the patterns, the entries are
+ * sorted by name to find the entries with the pattern prefix.
+ */
+static void wh_dirlist_read(struct wh_dirlist *ls)
 {
 	DIR *dirp;
 	struct dirent *dp;
+	size_t nalloc = 0;
+
+	if (ls->loaded)
+		return;
+	ls->loaded = 1;
 
-	dirp = opendir(dir);
+	dirp = opendir(ls->path);
 	if (dirp == NULL)
 		return;
 
-	DBG(printf("find '%s' in '%s'", pattern, dir));
+	DBG(printf("read '%s'", ls->path));
 
 	while ((dp = readdir(dirp)) != NULL) {
-		if (!filename_equal(pattern, dp->d_name))
-			continue;
+		if (ls->nents == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			ls->ents = xrealloc(ls->ents, nalloc * sizeof(*ls->ents));
+		}
+		ls->ents[ls->nents].name = xstrdup(dp->d_name);
+		ls->ents[ls->nents].pos = ls->nents;
+		ls->nents++;
+	}
+	closedir(dirp);
+
+	qsort(ls->ents, ls->nents, sizeof(*ls->ents), cmp_dirent_name);
+}
+
+/* the first entry >= @prefix */
+static size_t wh_dirlist_lower(struct wh_dirlist *ls, const char *prefix)
+{
+	size_t lo = 0, hi = ls->nents;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (strcmp(ls->ents[mid].name, prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* returns 1 if any entry starts with @prefix */
+static int wh_dirlist_has_prefix(struct wh_dirlist *ls, const char *prefix)
+{
+	size_t i = wh_dirlist_lower(ls, prefix);
+
+	return i < ls->nents &&
+	       strncmp(ls->ents[i].name, prefix, strlen(prefix)) == 0;
+}
+
+/* adds entries which start with @prefix and match @pattern to @res */
+static size_t wh_dirlist_match(struct wh_dirlist *ls, const char *prefix,
+			       const char *pattern, struct wh_dirent **res,
+			       size_t nres)
+{
+	size_t i, len = strlen(prefix);
+
+	for (i = wh_dirlist_lower(ls, prefix);
+	     i < ls->nents && strncmp(ls->ents[i].name, prefix, len) == 0; i++) {
+		if (filename_equal(pattern, ls->ents[i].name))
+			res[nres++] = &ls->ents[i];
+	}
+	return nres;
+}
+
+static void findin(struct wh_dirlist *ls, const char *pattern, int *count, char **wait)
+{
+	const char *dir = ls->path;
+	struct wh_dirent **res;
+	char *sprefix = NULL;
+	size_t i, nres, lvl, plen = strlen(pattern);
+
+	wh_dirlist_read(ls);
+	if (!ls->nents)
+		return;
+
+	DBG(printf("find '%s' in '%s'", pattern, dir));
+
+	/*
+	 * filename_equal() accepts "<pattern>..." and (recursively)
+	 * "s.<pattern>...", "s.s.<pattern>...", etc.
+	 */
+	res = xmalloc(ls->nents * sizeof(*res));
+	nres = wh_dirlist_match(ls, pattern, pattern, res, 0);
+
+	for (lvl = 1; ; lvl++) {
+		sprefix = xrealloc(sprefix, 2 * lvl + plen + 1);
+		memcpy(sprefix + 2 * (lvl - 1), "s.", 2);
+
+		/* no more "s." levels in the directory */
+		sprefix[2 * lvl] = '\0';
+		if (!wh_dirlist_has_prefix(ls, sprefix))
+			break;
+
+		/* for example "s.s" pattern, the "s.s.s" entries are already in res[] */
+		memcpy(sprefix + 2 * lvl, pattern, plen + 1);
+		if (strncmp(sprefix, pattern, plen) == 0)
+			break;
+
+		nres = wh_dirlist_match(ls, sprefix, pattern, res, nres);
+	}
+	free(sprefix);
+
+	/* print in the readdir() order */
+	qsort(res, nres, sizeof(*res), cmp_dirent_pos);
+
+	for (i = 0; i < nres; i++) {
+		const char *name = res[i]->name;
 
 		if (uflag && *count == 0)
-			xasprintf(wait, "%s/%s", dir, dp->d_name);
+			xasprintf(wait, "%s/%s", dir, name);
 
 		else if (uflag && *count == 1 && *wait) {
-			printf("%s: %s %s/%s", pattern, *wait, dir,  dp->d_name);
+			printf("%s: %s %s/%s", pattern, *wait, dir, name);
 			free(*wait);
 			*wait = NULL;
 		} else
-			printf(" %s/%s", dir, dp->d_name);
+			printf(" %s/%s", dir, name);
 		++(*count);
 	}
-	closedir(dirp);
+	free(res);
 	return;
 }
 
@@ -425,7 +555,7 @@ static void lookup(const char *pattern, struct wh_dirlist *ls, int want)
 
 	for (; ls; ls = ls->next) {
 		if ((ls->type & want) && ls->path)
-			findin(ls->path, patbuf, &count, &wait);
+			findin(ls, patbuf, &count, &wait);
 	}
 
 	free(wait);
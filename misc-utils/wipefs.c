@@ -29,6 +29,7 @@
 #include <getopt.h>
 #include <string.h>
 #include <limits.h>
+#include <sys/wait.h>
 
 #include <blkid.h>
 
@@ -166,14 +167,23 @@ clone_offset(struct wipe_desc *wp0)
 	return wp;
 }
 
+/*
+ * Adds the signature detected by @pr to the @wp list and returns the new head
+ * of the list. The @found is set to the new (or updated with data from the
+ * disk) item, or to NULL if there is nothing new.
+ */
 static struct wipe_desc *
-get_desc_for_probe(struct wipe_desc *wp, blkid_probe pr)
+get_desc_for_probe(struct wipe_desc *wp, blkid_probe pr,
+		   struct wipe_desc **found)
 {
 	const char *off, *type, *mag, *p, *usage = NULL;
+	struct wipe_desc *w;
 	size_t len;
 	loff_t offset;
 	int rc;
 
+	*found = NULL;
+
 	/* superblocks */
 	if (blkid_probe_lookup_value(pr, "TYPE", &type, NULL) == 0) {
 		rc = blkid_probe_lookup_value(pr, "SBMAGIC_OFFSET", &off, NULL);
@@ -198,26 +208,33 @@ get_desc_for_probe(struct wipe_desc *wp, blkid_probe pr)
 
 	offset = strtoll(off, NULL, 10);
 
-	wp = add_offset(wp, offset, 0);
-	if (!wp)
-		return NULL;
+	for (w = wp; w; w = w->next) {
+		if (w->offset == offset)
+			break;
+	}
+	/* already detected (and maybe already wiped) signature */
+	if (w && w->on_disk)
+		return wp;
+	if (!w)
+		wp = w = add_offset(wp, offset, 0);
 
 	if (usage || blkid_probe_lookup_value(pr, "USAGE", &usage, NULL) == 0)
-		wp->usage = xstrdup(usage);
+		w->usage = xstrdup(usage);
 
-	wp->type = xstrdup(type);
-	wp->on_disk = 1;
+	w->type = xstrdup(type);
+	w->on_disk = 1;
 
-	wp->magic = xmalloc(len);
-	memcpy(wp->magic, mag, len);
-	wp->len = len;
+	w->magic = xmalloc(len);
+	memcpy(w->magic, mag, len);
+	w->len = len;
 
 	if (blkid_probe_lookup_value(pr, "LABEL", &p, NULL) == 0)
-		wp->label = xstrdup(p);
+		w->label = xstrdup(p);
 
 	if (blkid_probe_lookup_value(pr, "UUID", &p, NULL) == 0)
-		wp->uuid = xstrdup(p);
+		w->uuid = xstrdup(p);
 
+	*found = w;
 	return wp;
 }
 
@@ -249,7 +266,7 @@ new_probe(const char *devname, int mode)
 	blkid_probe_set_superblocks_flags(pr, BLKID_SUBLKS_MAGIC |
 			BLKID_SUBLKS_TYPE | BLKID_SUBLKS_USAGE |
 			BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
-			BLKID_SUBLKS_BADCSUM);
+			BLKID_SUBLKS_BADCSUM | BLKID_SUBLKS_ZEROSKIP);
 
 	blkid_probe_enable_partitions(pr, 1);
 	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_MAGIC);
@@ -270,9 +287,9 @@ read_offsets(struct wipe_desc *wp, const char *devname)
 		return NULL;
 
 	while (blkid_do_probe(pr) == 0) {
-		wp = get_desc_for_probe(wp, pr);
-		if (!wp)
-			break;
+		struct wipe_desc *found;
+
+		wp = get_desc_for_probe(wp, pr, &found);
 	}
 
 	blkid_free_probe(pr);
@@ -296,18 +313,10 @@ free_wipe(struct wipe_desc *wp)
 	}
 }
 
-static void do_wipe_real(blkid_probe pr, const char *devname,
-			struct wipe_desc *w, int flags)
+static void print_wiped(const char *devname, struct wipe_desc *w)
 {
 	size_t i;
 
-	if (blkid_do_wipe(pr, (flags & WP_FL_NOACT) != 0))
-		warn(_("%s: failed to erase %s magic string at offset 0x%08jx"),
-		     devname, w->type, w->offset);
-
-	if (flags & WP_FL_QUIET)
-		return;
-
 	printf(P_("%s: %zd byte was erased at offset 0x%08jx (%s): ",
 		  "%s: %zd bytes were erased at offset 0x%08jx (%s): ",
 		  w->len),
@@ -321,6 +330,52 @@ static void do_wipe_real(blkid_probe pr, const char *devname,
 	putchar('\n');
 }
 
+static int cmp_wipe_offsets(const void *a, const void *b)
+{
+	const struct wipe_desc *wa = *((struct wipe_desc * const *) a),
+			       *wb = *((struct wipe_desc * const *) b);
+
+	return wa->offset < wb->offset ? -1 : wa->offset > wb->offset ? 1 : 0;
+}
+
+/*
+ * Erases all @ws magic strings. The areas are sorted and overlapping or
+ * adjacent areas are merged, so every continuous area is zeroed by one write.
+ */
+static int do_wipe_areas(int fd, struct wipe_desc **ws, size_t nws)
+{
+	struct wipe_desc **sorted;
+	char *zeros = NULL;
+	size_t i, zsz = 0;
+	int rc = 0;
+
+	sorted = xmalloc(nws * sizeof(struct wipe_desc *));
+	memcpy(sorted, ws, nws * sizeof(struct wipe_desc *));
+	qsort(sorted, nws, sizeof(struct wipe_desc *), cmp_wipe_offsets);
+
+	for (i = 0; i < nws; ) {
+		loff_t start = sorted[i]->offset,
+		       end = start + sorted[i]->len;
+
+		for (i++; i < nws && sorted[i]->offset <= end; i++) {
+			if (sorted[i]->offset + (loff_t) sorted[i]->len > end)
+				end = sorted[i]->offset + sorted[i]->len;
+		}
+
+		if ((size_t) (end - start) > zsz) {
+			zsz = end - start;
+			zeros = xrealloc(zeros, zsz);
+			memset(zeros, 0, zsz);
+		}
+		if (pwrite_all(fd, zeros, end - start, start) != 0)
+			rc = -errno;
+	}
+
+	free(zeros);
+	free(sorted);
+	return rc;
+}
+
 static void do_backup(struct wipe_desc *wp, const char *base)
 {
 	char *fname = NULL;
@@ -364,38 +419,70 @@ do_wipe(struct wipe_desc *wp, const char *devname, int flags)
 
 	wp0 = clone_offset(wp);
 
-	while (blkid_do_probe(pr) == 0) {
-		wp = get_desc_for_probe(wp, pr);
-		if (!wp)
+	/*
+	 * Collect all signatures, wipe them by one batch and then probe again,
+	 * because some signatures are visible only when the primary signature
+	 * is removed (e.g. backup superblocks).
+	 */
+	do {
+		struct wipe_desc **ws = NULL;
+		size_t nws = 0, i;
+
+		while (blkid_do_probe(pr) == 0) {
+			struct wipe_desc *found;
+
+			wp = get_desc_for_probe(wp, pr, &found);
+			if (!found)
+				continue;	/* nothing new */
+
+			/* Check if offset is in provided list */
+			w = wp0;
+			while(w && w->offset != found->offset)
+				w = w->next;
+			if (wp0 && !w)
+				continue;
+
+			/* Mark done if found in provided list */
+			if (w)
+				w->on_disk = found->on_disk;
+
+			if (!zap)
+				continue;
+
+			ws = xrealloc(ws, (nws + 1) * sizeof(struct wipe_desc *));
+			ws[nws++] = found;
+		}
+
+		if (!nws)
 			break;
 
-		/* Check if offset is in provided list */
-		w = wp0;
-		while(w && w->offset != wp->offset)
-			w = w->next;
-		if (wp0 && !w)
-			continue;
+		for (i = 0; backup && i < nws; i++)
+			do_backup(ws[i], backup);
 
-		/* Mark done if found in provided list */
-		if (w)
-			w->on_disk = wp->on_disk;
+		if (!(flags & WP_FL_NOACT)) {
+			int fd = blkid_probe_get_fd(pr);
 
-		if (!wp->on_disk)
-			continue;
+			if (do_wipe_areas(fd, ws, nws) != 0)
+				warn(_("%s: failed to erase magic strings"), devname);
 
-		if (zap) {
-			if (backup)
-				do_backup(wp, backup);
-			do_wipe_real(pr, devname, wp, flags);
+			/* drop cached data and start probing from scratch */
+			blkid_probe_set_device(pr, fd, 0, 0);
 		}
-	}
+
+		for (i = 0; !(flags & WP_FL_QUIET) && i < nws; i++)
+			print_wiped(devname, ws[i]);
+		free(ws);
+
+	} while (!(flags & WP_FL_NOACT));
 
 	for (w = wp0; w != NULL; w = w->next) {
 		if (!w->on_disk && !(flags & WP_FL_QUIET))
 			warnx(_("%s: offset 0x%jx not found"), devname, w->offset);
 	}
 
-	fsync(blkid_probe_get_fd(pr));
+	/* one fsync() for all the batches */
+	if (!(flags & WP_FL_NOACT) && fsync(blkid_probe_get_fd(pr)) != 0)
+		warn(_("%s: fsync failed"), devname);
 	close(blkid_probe_get_fd(pr));
 	blkid_free_probe(pr);
 	free_wipe(wp0);
@@ -403,7 +490,93 @@ do_wipe(struct wipe_desc *wp, const char *devname, int flags)
 
 	return wp;
 }
+static void wipe_device(struct wipe_desc *wp0, const char *devname, int flags)
+{
+	struct wipe_desc *wp = clone_offset(wp0);
+
+	wp = do_wipe(wp, devname, flags);
+	free_wipe(wp);
+}
+
+struct wipe_job {
+	pid_t	pid;		/* running child or zero */
+	int	status;
+	FILE	*out;		/* stdout of the child */
+};
 
+/*
+ * Wipes up to @njobs devices at the same time, every device in a separate
+ * process. The output is buffered by the children and printed in order of
+ * the @devs, so it's the same as for the serial wipe.
+ */
+static int wipe_parallel(struct wipe_desc *wp0, char **devs, size_t ndevs,
+			 int flags, size_t njobs)
+{
+	struct wipe_job *jobs = xcalloc(ndevs, sizeof(struct wipe_job));
+	size_t next = 0, done = 0, running = 0, i;
+	int rc = EXIT_SUCCESS;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	while (done < ndevs) {
+		struct wipe_job *job;
+		char buf[BUFSIZ];
+		size_t sz;
+		pid_t pid;
+		int status;
+
+		for ( ; next < ndevs && running < njobs; next++, running++) {
+			job = &jobs[next];
+			job->out = tmpfile();
+			if (!job->out)
+				err(EXIT_FAILURE, _("cannot create temporary file"));
+
+			job->pid = fork();
+			switch (job->pid) {
+			case -1:
+				err(EXIT_FAILURE, _("fork failed"));
+			case 0:
+				if (dup2(fileno(job->out), STDOUT_FILENO) < 0)
+					err(EXIT_FAILURE, _("dup2 failed"));
+				wipe_device(wp0, devs[next], flags);
+				exit(EXIT_SUCCESS);
+			}
+		}
+
+		pid = wait(&status);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, _("waitpid failed"));
+		}
+		for (i = done; i < next; i++) {
+			if (jobs[i].pid == pid) {
+				jobs[i].pid = 0;
+				jobs[i].status = status;
+				running--;
+				break;
+			}
+		}
+
+		/* print output of the finished devices */
+		for ( ; done < next && jobs[done].pid == 0; done++) {
+			job = &jobs[done];
+
+			rewind(job->out);
+			while ((sz = fread(buf, 1, sizeof(buf), job->out)) > 0)
+				fwrite(buf, 1, sz, stdout);
+			fflush(stdout);
+			fclose(job->out);
+
+			if (!WIFEXITED(job->status) || WEXITSTATUS(job->status))
+				rc = EXIT_FAILURE;
+		}
+	}
+
+	free(jobs);
+	return rc;
+}
 
 static void __attribute__((__noreturn__))
 usage(FILE *out)
@@ -417,6 +590,7 @@ usage(FILE *out)
 		" -b, --backup        create a signature backup in $HOME\n"
 		" -f, --force         force erasure\n"
 		" -h, --help          show this help text\n"
+		" -j, --jobs <num>    wipe up to <num> devices at the same time\n"
 		" -n, --no-act        do everything except the actual write() call\n"
 		" -o, --offset <num>  offset to erase, in bytes\n"
 		" -p, --parsable      print out in parsable instead of printable format\n"
@@ -433,15 +607,17 @@ usage(FILE *out)
 int
 main(int argc, char **argv)
 {
-	struct wipe_desc *wp0 = NULL, *wp;
+	struct wipe_desc *wp0 = NULL;
 	int c, has_offset = 0, flags = 0;
 	int mode = WP_MODE_PRETTY;
+	size_t njobs = 1;
 
 	static const struct option longopts[] = {
 	    { "all",       0, 0, 'a' },
 	    { "backup",    0, 0, 'b' },
 	    { "force",     0, 0, 'f' },
 	    { "help",      0, 0, 'h' },
+	    { "jobs",      1, 0, 'j' },
 	    { "no-act",    0, 0, 'n' },
 	    { "offset",    1, 0, 'o' },
 	    { "parsable",  0, 0, 'p' },
@@ -462,7 +638,7 @@ main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while ((c = getopt_long(argc, argv, "afhno:pqt:V", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "afhj:no:pqt:V", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -479,6 +655,11 @@ main(int argc, char **argv)
 		case 'h':
 			usage(stdout);
 			break;
+		case 'j':
+			njobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!njobs)
+				errx(EXIT_FAILURE, _("invalid jobs argument"));
+			break;
 		case 'n':
 			flags |= WP_FL_NOACT;
 			break;
@@ -521,15 +702,18 @@ main(int argc, char **argv)
 				print_all(wp0, mode);
 			free_wipe(wp0);
 		}
+	} else if (njobs > 1 && argc - optind > 1) {
+		/*
+		 * Erase more devices at the same time
+		 */
+		return wipe_parallel(wp0, argv + optind, argc - optind,
+				     flags, njobs);
 	} else {
 		/*
 		 * Erase
 		 */
-		while (optind < argc) {
-			wp = clone_offset(wp0);
-			wp = do_wipe(wp, argv[optind++], flags);
-			free_wipe(wp);
-		}
+		while (optind < argc)
+			wipe_device(wp0, argv[optind++], flags);
 	}
 
 	return EXIT_SUCCESS;
@@ -44,6 +44,13 @@ struct taskset {
 	size_t		buflen;
 	unsigned int	use_list:1,	/* use list rather than masks */
 			get_only:1;	/* print the mask, but not modify */
+
+	/* batch mode statistic */
+	size_t		ntasks;		/* all tasks */
+	size_t		nfailed;	/* failed sched_setaffinity() */
+	size_t		ngone;		/* tasks which no longer exist */
+	pid_t		err_pid;	/* the first failed task */
+	int		err_errno;
 };
 
 static void __attribute__((__noreturn__)) usage(FILE *out)
@@ -57,6 +64,8 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 		" -a, --all-tasks         operate on all the tasks (threads) for a given pid\n"
 		" -p, --pid               operate on existing given pid\n"
 		" -c, --cpu-list          display and specify cpus in list format\n"
+		" -b, --batch             set the mask for all the given pids\n"
+		" -g, --cgroup <dir>      set the mask for all the tasks in cgroup (implies --batch)\n"
 		" -h, --help              display this help\n"
 		" -V, --version           output version information\n\n"));
 
@@ -70,7 +79,9 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 		"List format uses a comma-separated list instead of a mask:\n"
 		"    %1$s -pc 0,3,7-11 700\n"
 		"Ranges in list format can take a stride argument:\n"
-		"    e.g. 0-31:2 is equivalent to mask 0x55555555\n"),
+		"    e.g. 0-31:2 is equivalent to mask 0x55555555\n"
+		"Set the mask for all threads of more processes:\n"
+		"    %1$s -ab 03 700 701 702\n"),
 		program_invocation_short_name);
 
 	fprintf(out, _("\nFor more information see taskset(1).\n"));
@@ -125,11 +136,99 @@ static void do_taskset(struct taskset *ts, size_t setsize, cpu_set_t *set)
 	}
 }
 
+/*
+ * Batch mode -- the mask is set for many tasks, the affinity is not printed
+ * and the errors are reported in aggregate.
+ */
+static void batch_taskset(struct taskset *ts, pid_t pid,
+			  size_t setsize, cpu_set_t *set)
+{
+	ts->ntasks++;
+
+	if (sched_setaffinity(pid, setsize, set) == 0)
+		return;
+	if (errno == ESRCH) {
+		ts->ngone++;		/* exited in the meantime */
+		return;
+	}
+	if (!ts->nfailed++) {
+		ts->err_pid = pid;
+		ts->err_errno = errno;
+	}
+}
+
+static void batch_taskset_pid(struct taskset *ts, pid_t pid, int all_tasks,
+			      size_t setsize, cpu_set_t *set)
+{
+	struct proc_tasks *tasks;
+	pid_t tid;
+
+	if (!all_tasks) {
+		batch_taskset(ts, pid, setsize, set);
+		return;
+	}
+	tasks = proc_open_tasks(pid);
+	if (!tasks) {
+		ts->ntasks++;
+		ts->ngone++;
+		return;
+	}
+	while (!proc_next_tid(tasks, &tid))
+		batch_taskset(ts, tid, setsize, set);
+	proc_close_tasks(tasks);
+}
+
+/*
+ * Reads PIDs from cgroup.procs, or all threads from cgroup.threads (v2) or
+ * tasks (v1) file.
+ */
+static void batch_taskset_cgroup(struct taskset *ts, const char *dir,
+				 int all_tasks, size_t setsize, cpu_set_t *set)
+{
+	char path[PATH_MAX];
+	FILE *f = NULL;
+	int pid;
+
+	if (all_tasks) {
+		snprintf(path, sizeof(path), "%s/cgroup.threads", dir);
+		f = fopen(path, "r" UL_CLOEXECSTR);
+		if (!f) {
+			snprintf(path, sizeof(path), "%s/tasks", dir);
+			f = fopen(path, "r" UL_CLOEXECSTR);
+		}
+	} else {
+		snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+		f = fopen(path, "r" UL_CLOEXECSTR);
+	}
+	if (!f)
+		err(EXIT_FAILURE, _("cannot open %s"), path);
+
+	while (fscanf(f, "%d", &pid) == 1)
+		batch_taskset(ts, pid, setsize, set);
+
+	if (ferror(f))
+		err(EXIT_FAILURE, _("cannot read %s"), path);
+	fclose(f);
+}
+
+static int batch_report(struct taskset *ts)
+{
+	if (!ts->nfailed)
+		return EXIT_SUCCESS;
+
+	errno = ts->err_errno;
+	warn(P_("failed to set affinity of %zu task (of %zu), pid %d",
+		"failed to set affinity of %zu tasks (of %zu), the first pid %d",
+		ts->nfailed), ts->nfailed, ts->ntasks, ts->err_pid);
+	return EXIT_FAILURE;
+}
+
 int main(int argc, char **argv)
 {
 	cpu_set_t *new_set;
 	pid_t pid = 0;
-	int c, all_tasks = 0;
+	int c, all_tasks = 0, batch = 0;
+	const char *cgroup = NULL;
 	int ncpus;
 	size_t new_setsize, nbits;
 	struct taskset ts;
@@ -138,6 +237,8 @@ int main(int argc, char **argv)
 		{ "all-tasks",	0, NULL, 'a' },
 		{ "pid",	0, NULL, 'p' },
 		{ "cpu-list",	0, NULL, 'c' },
+		{ "batch",	0, NULL, 'b' },
+		{ "cgroup",	1, NULL, 'g' },
 		{ "help",	0, NULL, 'h' },
 		{ "version",	0, NULL, 'V' },
 		{ NULL,		0, NULL,  0  }
@@ -150,7 +251,7 @@ int main(int argc, char **argv)
 
 	memset(&ts, 0, sizeof(ts));
 
-	while ((c = getopt_long(argc, argv, "+apchV", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "+apcbg:hV", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'a':
 			all_tasks = 1;
@@ -162,6 +263,13 @@ int main(int argc, char **argv)
 		case 'c':
 			ts.use_list = 1;
 			break;
+		case 'b':
+			batch = 1;
+			break;
+		case 'g':
+			batch = 1;
+			cgroup = optarg;
+			break;
 		case 'V':
 			printf(_("%s from %s\n"), program_invocation_short_name,
 			       PACKAGE_STRING);
@@ -175,7 +283,13 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if ((!pid && argc - optind < 2)
+	if (batch) {
+		if (pid)
+			errx(EXIT_FAILURE, _("--pid and --batch are mutually exclusive"));
+		if ((cgroup && argc - optind != 1) ||
+		    (!cgroup && argc - optind < 2))
+			usage(stderr);
+	} else if ((!pid && argc - optind < 2)
 	    || (pid && (argc - optind < 1 || argc - optind > 2)))
 		usage(stderr);
 
@@ -205,7 +319,7 @@ int main(int argc, char **argv)
 	if (!new_set)
 		err(EXIT_FAILURE, _("cpuset_alloc failed"));
 
-	if (argc - optind == 1)
+	if (argc - optind == 1 && !batch)
 		ts.get_only = 1;
 
 	else if (ts.use_list) {
@@ -217,6 +331,29 @@ int main(int argc, char **argv)
 		     argv[optind]);
 	}
 
+	if (batch) {
+		int i, rc, npids = argc - optind - 1;
+		pid_t *pids = xcalloc(npids + 1, sizeof(pid_t));
+
+		/* check all the arguments before the first change */
+		for (i = 0; i < npids; i++)
+			pids[i] = strtos32_or_err(argv[optind + 1 + i],
+						  _("invalid PID argument"));
+		if (cgroup)
+			batch_taskset_cgroup(&ts, cgroup, all_tasks,
+					     new_setsize, new_set);
+		for (i = 0; i < npids; i++)
+			batch_taskset_pid(&ts, pids[i], all_tasks,
+					  new_setsize, new_set);
+		rc = batch_report(&ts);
+		free(pids);
+
+		free(ts.buf);
+		cpuset_free(ts.set);
+		cpuset_free(new_set);
+		return rc;
+	}
+
 	if (all_tasks && pid) {
 		struct proc_tasks *tasks = proc_open_tasks(pid);
 		while (!proc_next_tid(tasks, &ts.pid))
@@ -20,6 +20,9 @@
  * This program uses BLKDISCARD ioctl to discard part or the whole block
  * device if the device supports it. You can specify range (start and
  * length) to be discarded, or simply discard the whole device.
+ *
+ * The range may be discarded by steps (smaller ioctls), optionally by more
+ * threads and limited by rate.
  */
 
 
@@ -34,12 +37,18 @@
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <linux/fs.h>
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
 
 #include "nls.h"
 #include "strutils.h"
 #include "c.h"
 #include "closestream.h"
+#include "sysfs.h"
+#include "xalloc.h"
 
 #ifndef BLKDISCARD
 #define BLKDISCARD	_IO(0x12,119)
@@ -49,6 +58,197 @@
 #define BLKSECDISCARD	_IO(0x12,125)
 #endif
 
+#ifndef BLKZEROOUT
+#define BLKZEROOUT	_IO(0x12,127)
+#endif
+
+enum {
+	ACT_DISCARD = 0,	/* default */
+	ACT_SECURE,
+	ACT_ZEROOUT
+};
+
+struct discard_ctl {
+	const char	*path;
+	int		fd;
+	int		act;
+	int		verbose;
+
+	uint64_t	start;		/* the range */
+	uint64_t	end;
+	uint64_t	step;
+	uint64_t	rate;		/* bytes per second or zero */
+	unsigned int	nthreads;
+
+	uint64_t	next;		/* the next step offset */
+	uint64_t	done;		/* discarded bytes */
+	int		error;		/* errno from the failed ioctl */
+	struct timeval	t0;		/* the begin */
+	struct timeval	last;		/* the last progress line */
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_t	lock;
+#endif
+};
+
+static const struct {
+	unsigned long	req;
+	const char	*name;
+} discard_ioctls[] = {
+	[ACT_DISCARD] = { BLKDISCARD,    "BLKDISCARD" },
+	[ACT_SECURE]  = { BLKSECDISCARD, "BLKSECDISCARD" },
+	[ACT_ZEROOUT] = { BLKZEROOUT,    "BLKZEROOUT" }
+};
+
+static inline void discard_lock(struct discard_ctl *ctl __attribute__((__unused__)))
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_lock(&ctl->lock);
+#endif
+}
+
+static inline void discard_unlock(struct discard_ctl *ctl __attribute__((__unused__)))
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_unlock(&ctl->lock);
+#endif
+}
+
+static uint64_t elapsed_usec(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000ULL +
+	       now.tv_usec - start->tv_usec;
+}
+
+/* returns discard_granularity of the whole disk or zero */
+static uint64_t get_discard_granularity(dev_t devno)
+{
+	struct sysfs_cxt cxt = UL_SYSFSCXT_EMPTY;
+	uint64_t dg = 0;
+	dev_t disk = 0;
+
+	/* the queue attributes are provided for whole devices only */
+	if (sysfs_devno_to_wholedisk(devno, NULL, 0, &disk) || !disk)
+		disk = devno;
+	if (sysfs_init(&cxt, disk, NULL) == 0) {
+		if (sysfs_read_u64(&cxt, "queue/discard_granularity", &dg))
+			dg = 0;
+		sysfs_deinit(&cxt);
+	}
+	return dg;
+}
+
+static void print_progress(struct discard_ctl *ctl)
+{
+	uint64_t total = ctl->end - ctl->start;
+
+	/* TRANSLATORS: The standard value here is a very large number. */
+	printf(_("%s: Discarded %" PRIu64 " bytes of %" PRIu64 " (%d%%)\n"),
+			ctl->path, ctl->done, total,
+			total ? (int) (ctl->done * 100 / total) : 100);
+	fflush(stdout);
+}
+
+/* sleeps until the offset @off is allowed by the rate limit */
+static void discard_throttle(struct discard_ctl *ctl, uint64_t off)
+{
+	uint64_t want, now;
+
+	if (!ctl->rate)
+		return;
+	want = (off - ctl->start) / ctl->rate * 1000000ULL +
+	       (off - ctl->start) % ctl->rate * 1000000ULL / ctl->rate;
+	now = elapsed_usec(&ctl->t0);
+
+	while (now < want) {
+		uint64_t us = min(want - now, (uint64_t) 1000000);
+
+		usleep((useconds_t) us);
+		now = elapsed_usec(&ctl->t0);
+	}
+}
+
+/*
+ * Discards the steps of the range until the end. The steps are aligned to the
+ * multiple of ctl->step from the begin of the device, so the ioctls don't
+ * split the discard granularity.
+ */
+static void *discard_steps(void *data)
+{
+	struct discard_ctl *ctl = (struct discard_ctl *) data;
+
+	while (1) {
+		uint64_t range[2];
+
+		discard_lock(ctl);
+		if (ctl->error || ctl->next >= ctl->end) {
+			discard_unlock(ctl);
+			break;
+		}
+		range[0] = ctl->next;
+		range[1] = min(ctl->end, (range[0] / ctl->step + 1) * ctl->step)
+			   - range[0];
+		ctl->next += range[1];
+		discard_unlock(ctl);
+
+		discard_throttle(ctl, range[0]);
+
+		if (ioctl(ctl->fd, discard_ioctls[ctl->act].req, &range)) {
+			discard_lock(ctl);
+			if (!ctl->error)
+				ctl->error = errno;
+			discard_unlock(ctl);
+			break;
+		}
+
+		discard_lock(ctl);
+		ctl->done += range[1];
+		if (ctl->verbose && elapsed_usec(&ctl->last) >= 1000000) {
+			print_progress(ctl);
+			gettimeofday(&ctl->last, NULL);
+		}
+		discard_unlock(ctl);
+	}
+	return NULL;
+}
+
+static int discard_by_steps(struct discard_ctl *ctl)
+{
+	gettimeofday(&ctl->t0, NULL);
+	ctl->last = ctl->t0;
+	ctl->next = ctl->start;
+
+#ifdef HAVE_LIBPTHREAD
+	if (ctl->nthreads > 1) {
+		pthread_t *th = xcalloc(ctl->nthreads, sizeof(pthread_t));
+		unsigned int i, n;
+
+		pthread_mutex_init(&ctl->lock, NULL);
+		for (n = 0; n < ctl->nthreads; n++) {
+			if (pthread_create(&th[n], NULL, discard_steps, ctl)) {
+				warnx(_("failed to create thread"));
+				break;
+			}
+		}
+		if (!n)
+			discard_steps(ctl);
+		for (i = 0; i < n; i++)
+			pthread_join(th[i], NULL);
+		pthread_mutex_destroy(&ctl->lock);
+		free(th);
+	} else
+#endif
+		discard_steps(ctl);
+
+	if (ctl->error) {
+		errno = ctl->error;
+		return -1;
+	}
+	return 0;
+}
+
 static void __attribute__((__noreturn__)) usage(FILE *out)
 {
 	fputs(USAGE_HEADER, out);
@@ -57,7 +257,11 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -o, --offset <num>  offset in bytes to discard from\n"
 		" -l, --length <num>  length of bytes to discard from the offset\n"
+		" -p, --step <num>    size of the discard iterations within the offset\n"
+		" -j, --jobs <num>    number of threads for --step\n"
+		" -r, --rate <num>    discard at most <num> bytes per second (for --step)\n"
 		" -s, --secure        perform secure discard\n"
+		" -z, --zeroout       zero-fill rather than discard\n"
 		" -v, --verbose       print aligned length and offset\n"),
 		out);
 	fputs(USAGE_SEPARATOR, out);
@@ -70,17 +274,22 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 int main(int argc, char **argv)
 {
 	char *path;
-	int c, fd, verbose = 0, secure = 0, secsize;
-	uint64_t end, blksize, range[2];
+	int c, fd, secsize;
+	uint64_t end, blksize, dg, range[2];
 	struct stat sb;
+	struct discard_ctl ctl = { .nthreads = 1 };
 
 	static const struct option longopts[] = {
 	    { "help",      0, 0, 'h' },
 	    { "version",   0, 0, 'V' },
 	    { "offset",    1, 0, 'o' },
 	    { "length",    1, 0, 'l' },
+	    { "step",      1, 0, 'p' },
+	    { "jobs",      1, 0, 'j' },
+	    { "rate",      1, 0, 'r' },
 	    { "secure",    0, 0, 's' },
 	    { "verbose",   0, 0, 'v' },
+	    { "zeroout",   0, 0, 'z' },
 	    { NULL,        0, 0, 0 }
 	};
 
@@ -92,7 +301,7 @@ int main(int argc, char **argv)
 	range[0] = 0;
 	range[1] = ULLONG_MAX;
 
-	while ((c = getopt_long(argc, argv, "hVsvo:l:", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hVsvo:l:p:j:r:z", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'h':
 			usage(stdout);
@@ -108,11 +317,28 @@ int main(int argc, char **argv)
 			range[0] = strtosize_or_err(optarg,
 					_("failed to parse offset"));
 			break;
+		case 'p':
+			ctl.step = strtosize_or_err(optarg,
+					_("failed to parse step"));
+			break;
+		case 'j':
+			ctl.nthreads = strtou32_or_err(optarg,
+					_("failed to parse jobs"));
+			if (!ctl.nthreads)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
+		case 'r':
+			ctl.rate = strtosize_or_err(optarg,
+					_("failed to parse rate"));
+			break;
 		case 's':
-			secure = 1;
+			ctl.act = ACT_SECURE;
+			break;
+		case 'z':
+			ctl.act = ACT_ZEROOUT;
 			break;
 		case 'v':
-			verbose = 1;
+			ctl.verbose = 1;
 			break;
 		default:
 			usage(stderr);
@@ -129,6 +355,8 @@ int main(int argc, char **argv)
 		warnx(_("unexpected number of arguments"));
 		usage(stderr);
 	}
+	if (!ctl.step && (ctl.rate || ctl.nthreads > 1))
+		errx(EXIT_FAILURE, _("--rate and --jobs require --step"));
 
 	fd = open(path, O_WRONLY);
 	if (fd < 0)
@@ -153,15 +381,26 @@ int main(int argc, char **argv)
 	if (end < range[0] || end > blksize)
 		range[1] = blksize - range[0];
 
-	if (secure) {
-		if (ioctl(fd, BLKSECDISCARD, &range))
-			err(EXIT_FAILURE, _("%s: BLKSECDISCARD ioctl failed"), path);
-	} else {
-		if (ioctl(fd, BLKDISCARD, &range))
-			err(EXIT_FAILURE, _("%s: BLKDISCARD ioctl failed"), path);
-	}
+	if (ctl.step) {
+		/* align the step to the discard granularity */
+		dg = ctl.act == ACT_ZEROOUT ? 0 : get_discard_granularity(sb.st_rdev);
+		if (dg < (uint64_t) secsize)
+			dg = secsize;
+		ctl.step = (ctl.step + dg - 1) / dg * dg;
+
+		ctl.path = path;
+		ctl.fd = fd;
+		ctl.start = range[0];
+		ctl.end = range[0] + range[1];
+
+		if (discard_by_steps(&ctl))
+			err(EXIT_FAILURE, _("%s: %s ioctl failed"), path,
+					discard_ioctls[ctl.act].name);
+	} else if (ioctl(fd, discard_ioctls[ctl.act].req, &range))
+		err(EXIT_FAILURE, _("%s: %s ioctl failed"), path,
+				discard_ioctls[ctl.act].name);
 
-	if (verbose)
+	if (ctl.verbose)
 		/* TRANSLATORS: The standard value here is a very large number. */
 		printf(_("%s: Discarded %" PRIu64 " bytes from the "
 			 "offset %" PRIu64"\n"), path,
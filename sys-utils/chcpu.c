@@ -45,6 +45,9 @@
 
 #define EXCL_ERROR "--{configure,deconfigure,disable,dispatch,enable}"
 
+/* partial success, otherwise we return regular EXIT_{SUCCESS,FAILURE} */
+#define CHCPU_EXIT_SOMEOK	64
+
 #define _PATH_SYS_CPU		"/sys/devices/system/cpu"
 #define _PATH_SYS_CPU_ONLINE	_PATH_SYS_CPU "/online"
 #define _PATH_SYS_CPU_RESCAN	_PATH_SYS_CPU "/rescan"
@@ -66,21 +69,40 @@ enum {
 	CMD_CPU_DISPATCH_VERTICAL,
 };
 
+/*
+ * Returns 0 if all the requested CPUs have been successfully changed (or are
+ * already in the requested state), -1 if all failed and 1 on partial success.
+ */
+static int cpu_status(const char *what, size_t total, size_t fails)
+{
+	if (!fails)
+		return 0;
+	if (total > 1)
+		warnx(P_("%s failed for %zu of %zu CPU",
+			 "%s failed for %zu of %zu CPUs", total),
+			what, fails, total);
+	return fails == total ? -1 : 1;
+}
+
 static int cpu_enable(cpu_set_t *cpu_set, size_t setsize, int enable)
 {
 	unsigned int cpu;
 	int online, rc;
 	int configured = -1;
+	size_t total = 0, fails = 0;
 
-	for (cpu = 0; cpu < setsize; cpu++) {
-		if (!CPU_ISSET(cpu, cpu_set))
+	for (cpu = 0; cpu < (unsigned int) maxcpus; cpu++) {
+		if (!CPU_ISSET_S(cpu, setsize, cpu_set))
 			continue;
+		total++;
 		if (!path_exist(_PATH_SYS_CPU "/cpu%d", cpu)) {
 			printf(_("CPU %d does not exist\n"), cpu);
+			fails++;
 			continue;
 		}
 		if (!path_exist(_PATH_SYS_CPU "/cpu%d/online", cpu)) {
 			printf(_("CPU %d is not hot pluggable\n"), cpu);
+			fails++;
 			continue;
 		}
 		online = path_read_s32(_PATH_SYS_CPU "/cpu%d/online", cpu);
@@ -103,23 +125,27 @@ static int cpu_enable(cpu_set_t *cpu_set, size_t setsize, int enable)
 				warn(_("CPU %d enable failed"), cpu);
 			else
 				printf(_("CPU %d enabled\n"), cpu);
+			if (rc == -1)
+				fails++;
 		} else {
 			if (onlinecpus && num_online_cpus() == 1) {
 				printf(_("CPU %d disable failed "
 					 "(last enabled CPU)\n"), cpu);
+				fails++;
 				continue;
 			}
 			rc = path_write_str("0", _PATH_SYS_CPU "/cpu%d/online", cpu);
-			if (rc == -1)
+			if (rc == -1) {
 				warn(_("CPU %d disable failed"), cpu);
-			else {
+				fails++;
+			} else {
 				printf(_("CPU %d disabled\n"), cpu);
 				if (onlinecpus)
-					CPU_CLR(cpu, onlinecpus);
+					CPU_CLR_S(cpu, setsize, onlinecpus);
 			}
 		}
 	}
-	return EXIT_SUCCESS;
+	return cpu_status(enable ? _("enable") : _("disable"), total, fails);
 }
 
 static int cpu_rescan(void)
@@ -153,16 +179,20 @@ static int cpu_configure(cpu_set_t *cpu_set, size_t setsize, int configure)
 {
 	unsigned int cpu;
 	int rc, current;
+	size_t total = 0, fails = 0;
 
-	for (cpu = 0; cpu < setsize; cpu++) {
-		if (!CPU_ISSET(cpu, cpu_set))
+	for (cpu = 0; cpu < (unsigned int) maxcpus; cpu++) {
+		if (!CPU_ISSET_S(cpu, setsize, cpu_set))
 			continue;
+		total++;
 		if (!path_exist(_PATH_SYS_CPU "/cpu%d", cpu)) {
 			printf(_("CPU %d does not exist\n"), cpu);
+			fails++;
 			continue;
 		}
 		if (!path_exist(_PATH_SYS_CPU "/cpu%d/configure", cpu)) {
 			printf(_("CPU %d is not configurable\n"), cpu);
+			fails++;
 			continue;
 		}
 		current = path_read_s32(_PATH_SYS_CPU "/cpu%d/configure", cpu);
@@ -178,6 +208,7 @@ static int cpu_configure(cpu_set_t *cpu_set, size_t setsize, int configure)
 		    is_cpu_online(cpu)) {
 			printf(_("CPU %d deconfigure failed "
 				 "(CPU is enabled)\n"), cpu);
+			fails++;
 			continue;
 		}
 		if (configure) {
@@ -193,8 +224,11 @@ static int cpu_configure(cpu_set_t *cpu_set, size_t setsize, int configure)
 			else
 				printf(_("CPU %d deconfigured\n"), cpu);
 		}
+		if (rc == -1)
+			fails++;
 	}
-	return EXIT_SUCCESS;
+	return cpu_status(configure ? _("configure") : _("deconfigure"),
+			  total, fails);
 }
 
 static void cpu_parse(char *cpu_string, cpu_set_t *cpu_set, size_t setsize)
@@ -233,7 +267,7 @@ int main(int argc, char *argv[])
 	cpu_set_t *cpu_set;
 	size_t setsize;
 	int cmd = -1;
-	int c;
+	int c, rc;
 
 	static const struct option longopts[] = {
 		{ "configure",	required_argument, 0, 'c' },
@@ -317,19 +351,27 @@ int main(int argc, char *argv[])
 
 	switch (cmd) {
 	case CMD_CPU_ENABLE:
-		return cpu_enable(cpu_set, maxcpus, 1);
+		rc = cpu_enable(cpu_set, setsize, 1);
+		break;
 	case CMD_CPU_DISABLE:
-		return cpu_enable(cpu_set, maxcpus, 0);
+		rc = cpu_enable(cpu_set, setsize, 0);
+		break;
 	case CMD_CPU_CONFIGURE:
-		return cpu_configure(cpu_set, maxcpus, 1);
+		rc = cpu_configure(cpu_set, setsize, 1);
+		break;
 	case CMD_CPU_DECONFIGURE:
-		return cpu_configure(cpu_set, maxcpus, 0);
+		rc = cpu_configure(cpu_set, setsize, 0);
+		break;
 	case CMD_CPU_RESCAN:
 		return cpu_rescan();
 	case CMD_CPU_DISPATCH_HORIZONTAL:
 		return cpu_set_dispatch(0);
 	case CMD_CPU_DISPATCH_VERTICAL:
 		return cpu_set_dispatch(1);
+	default:
+		return EXIT_SUCCESS;
 	}
-	return EXIT_SUCCESS;
+
+	return rc == 0 ? EXIT_SUCCESS :
+	       rc < 0 ? EXIT_FAILURE : CHCPU_EXIT_SOMEOK;
 }
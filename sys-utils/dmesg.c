@@ -21,6 +21,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <string.h>
 
 #include "c.h"
 #include "colors.h"
@@ -34,6 +36,7 @@
 #include "optutils.h"
 #include "mangle.h"
 #include "pager.h"
+#include "timeutils.h"
 
 /* Close the log.  Currently a NOP. */
 #define SYSLOG_ACTION_CLOSE          0
@@ -58,6 +61,12 @@
 /* Return size of the log buffer */
 #define SYSLOG_ACTION_SIZE_BUFFER   10
 
+/* stdout buffer size, the output is written by large chunks */
+#define DMESG_OUTBUF_SIZ	(64 * 1024)
+
+/* the cursor is valid for the current boot only */
+#define _PATH_PROC_BOOTID	"/proc/sys/kernel/random/boot_id"
+
 /*
  * Colors
  */
@@ -156,6 +165,12 @@ struct dmesg_control {
 	ssize_t		kmsg_first_read;/* initial read() return code */
 	char		kmsg_buf[BUFSIZ];/* buffer to read kmsg data */
 
+	uint64_t	since_seq;	/* print records after the sequence number */
+	struct timeval	since;		/* print records since the time (after boot) */
+	const char	*cursor;	/* file with the last read sequence number */
+	uint64_t	last_seq;	/* the last read record */
+	char		boot_id[40];	/* the current boot ID for the cursor */
+
 	/*
 	 * For the --file option we mmap whole file. The unnecessary (already
 	 * printed) pages are always unmapped. The result is that we have in
@@ -172,6 +187,9 @@ struct dmesg_control {
 			fltr_fac:1,	/* filter out by facilities[] */
 			decode:1,	/* use "facility: level: " prefix */
 			pager:1,	/* pipe output into a pager */
+			fltr_seq:1,	/* filter out by since_seq */
+			fltr_since:1,	/* filter out by since */
+			has_last_seq:1,	/* last_seq is valid */
 			color:1;	/* colorize messages */
 };
 
@@ -182,6 +200,7 @@ struct dmesg_record {
 	int		level;
 	int		facility;
 	struct timeval  tv;
+	uint64_t	seq;		/* /dev/kmsg sequence number */
 
 	const char	*next;		/* buffer with next unparsed record */
 	size_t		next_size;	/* size of the next buffer */
@@ -194,6 +213,7 @@ struct dmesg_record {
 		(_r)->level = -1; \
 		(_r)->tv.tv_sec = 0; \
 		(_r)->tv.tv_usec = 0; \
+		(_r)->seq = 0; \
 	} while (0)
 
 static int read_kmsg(struct dmesg_control *ctl);
@@ -257,6 +277,10 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(_(" -e, --reltime               show local time and time delta in readable format\n"), out);
 	fputs(_(" -T, --ctime                 show human readable timestamp\n"), out);
 	fputs(_(" -t, --notime                don't print messages timestamp\n"), out);
+	fputs(_("     --since <time>          display messages since the specified time\n"), out);
+	fputs(_("     --since-seq <num>       display messages after the sequence number\n"), out);
+	fputs(_("     --cursor <file>         display messages after the last run, use the file\n"
+		"                               to save the sequence number of the last message\n"), out);
 	fputs(_("     --time-format <format>  show time stamp using format:\n"
 		"                               [delta|reltime|ctime|notime|iso]\n"
 		"Suspending/resume will make ctime and iso timestamps inaccurate.\n"), out);
@@ -459,6 +483,27 @@ static const char *parse_kmsg_timestamp(const char *str0, struct timeval *tv)
 	return end + 1;	/* skip separator */
 }
 
+/*
+ * Parses sequence number from /dev/kmsg, the separators are the same as for
+ * the timestamp.
+ */
+static const char *parse_kmsg_seq(const char *str0, uint64_t *seq)
+{
+	char *end = NULL;
+	uint64_t num;
+
+	if (!str0)
+		return str0;
+
+	errno = 0;
+	num = strtoumax(str0, &end, 10);
+
+	if (errno || !end || (*end != ';' && *end != ','))
+		return str0;
+
+	*seq = num;
+	return end + 1;	/* skip separator */
+}
 
 static double time_diff(struct timeval *a, struct timeval *b)
 {
@@ -646,6 +691,17 @@ static void safe_fwrite(const char *buf, size_t size, FILE *out)
 
 static const char *skip_item(const char *begin, const char *end, const char *sep)
 {
+	/* one separator (usually the end of the message) -- use memchr() */
+	if (begin < end && sep[1] == '\0') {
+		size_t len = end - begin;
+		const char *p = memchr(begin, *sep, len),
+			   *z = memchr(begin, '\0', p ? (size_t) (p - begin) : len);
+
+		if (z)
+			return z + 1;
+		return p ? p + 1 : end;
+	}
+
 	while (begin < end) {
 		int c = *begin++;
 
@@ -739,6 +795,9 @@ static int get_next_syslog_record(struct dmesg_control *ctl,
 
 static int accept_record(struct dmesg_control *ctl, struct dmesg_record *rec)
 {
+	if (ctl->fltr_since && timercmp(&rec->tv, &ctl->since, <))
+		return 0;
+
 	if (ctl->fltr_lev && (rec->facility < 0 ||
 			      !isset(ctl->levels, rec->level)))
 		return 0;
@@ -1004,14 +1063,104 @@ static ssize_t read_kmsg_one(struct dmesg_control *ctl)
 	return size;
 }
 
-static int init_kmsg(struct dmesg_control *ctl)
+static void read_boot_id(struct dmesg_control *ctl)
+{
+	FILE *f = fopen(_PATH_PROC_BOOTID, "r");
+
+	*ctl->boot_id = '\0';
+	if (!f)
+		return;
+	if (!fgets(ctl->boot_id, sizeof(ctl->boot_id), f))
+		*ctl->boot_id = '\0';
+	ctl->boot_id[strcspn(ctl->boot_id, "\n")] = '\0';
+	fclose(f);
+}
+
+/*
+ * The cursor file format is "<seqnum> <boot-id>\n". The cursor from another
+ * boot is ignored, the sequence numbers start from zero after reboot.
+ */
+static void read_cursor(struct dmesg_control *ctl)
 {
-	int mode = O_RDONLY;
+	char id[sizeof(ctl->boot_id)];
+	uintmax_t seq;
+	FILE *f;
 
-	if (!ctl->follow)
-		mode |= O_NONBLOCK;
+	read_boot_id(ctl);
+
+	f = fopen(ctl->cursor, "r");
+	if (!f) {
+		if (errno != ENOENT)
+			warn(_("cannot open %s"), ctl->cursor);
+		return;
+	}
+	if (fscanf(f, "%ju %39s", &seq, id) == 2 && strcmp(id, ctl->boot_id) == 0) {
+		ctl->since_seq = seq;
+		ctl->fltr_seq = 1;
+	}
+	fclose(f);
+}
+
+/*
+ * The file is replaced by rename() to be sure it's never truncated. The
+ * cursor is not moved if the records have not been written to stdout.
+ */
+static void write_cursor(struct dmesg_control *ctl)
+{
+	char *tmp = NULL;
+	FILE *f;
+	int rc;
 
-	ctl->kmsg = open("/dev/kmsg", mode);
+	if (!ctl->cursor || !ctl->has_last_seq)
+		return;
+	if (fflush(stdout) != 0 || ferror(stdout))
+		return;
+
+	xasprintf(&tmp, "%s.new", ctl->cursor);
+	f = fopen(tmp, "w" UL_CLOEXECSTR);
+	if (!f) {
+		warn(_("cannot open %s"), tmp);
+		goto done;
+	}
+	fprintf(f, "%ju %s\n", (uintmax_t) ctl->last_seq, ctl->boot_id);
+	rc = fflush(f) == 0 && fsync(fileno(f)) == 0 ? 0 : -1;
+	if (close_stream(f) != 0 || rc != 0) {
+		warn(_("write failed: %s"), tmp);
+		unlink(tmp);
+	} else if (rename(tmp, ctl->cursor) != 0) {
+		warn(_("cannot rename %s to %s"), tmp, ctl->cursor);
+		unlink(tmp);
+	}
+done:
+	free(tmp);
+}
+
+/*
+ * Waits for the next record in the --follow mode. The already composed output
+ * is flushed before the wait.
+ */
+static int wait_kmsg(struct dmesg_control *ctl)
+{
+	struct pollfd fds = { .fd = ctl->kmsg, .events = POLLIN };
+	int rc;
+
+	fflush(stdout);
+	write_cursor(ctl);
+
+	do {
+		rc = poll(&fds, 1, -1);
+	} while (rc < 0 && errno == EINTR);
+
+	return rc == 1 && (fds.revents & POLLIN) ? 0 : -1;
+}
+
+static int init_kmsg(struct dmesg_control *ctl)
+{
+	/*
+	 * The non-blocking mode is used for --follow too, the messages are read
+	 * until EAGAIN and then we wait by poll().
+	 */
+	ctl->kmsg = open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
 	if (ctl->kmsg < 0)
 		return -1;
 
@@ -1031,7 +1180,9 @@ static int init_kmsg(struct dmesg_control *ctl)
 	 * read_kmsg().
 	 */
 	ctl->kmsg_first_read = read_kmsg_one(ctl);
-	if (ctl->kmsg_first_read < 0) {
+	if (ctl->kmsg_first_read < 0 && errno == EAGAIN)
+		ctl->kmsg_first_read = 0;		/* empty buffer */
+	else if (ctl->kmsg_first_read < 0) {
 		close(ctl->kmsg);
 		ctl->kmsg = -1;
 		return -1;
@@ -1079,15 +1230,27 @@ static int parse_kmsg_record(struct dmesg_control *ctl,
 		goto mesg;
 
 	/* B) sequence number */
-	p = skip_item(p, end, ",;");
+	if (ctl->fltr_seq || ctl->cursor) {
+		p = parse_kmsg_seq(p, &rec->seq);
+		ctl->last_seq = rec->seq;
+		ctl->has_last_seq = 1;
+
+		/* already read, don't parse the rest of the record */
+		if (ctl->fltr_seq && rec->seq <= ctl->since_seq)
+			return -1;
+	} else
+		p = skip_item(p, end, ",;");
 	if (LAST_KMSG_FIELD(p))
 		goto mesg;
 
 	/* C) timestamp */
-	if (is_timefmt(ctl, NONE))
+	if (is_timefmt(ctl, NONE) && !ctl->fltr_since)
 		p = skip_item(p, end, ",;");
-	else
+	else {
 		p = parse_kmsg_timestamp(p, &rec->tv);
+		if (ctl->fltr_since && timercmp(&rec->tv, &ctl->since, <))
+			return -1;
+	}
 	if (LAST_KMSG_FIELD(p))
 		goto mesg;
 
@@ -1111,7 +1274,9 @@ mesg:
 	 * definition of "non-printable" is too strict. On UTF8 console we can
 	 * print many chars, so let's decode from kernel.
 	 */
-	unhexmangle_to_buffer(rec->mesg, (char *) rec->mesg, rec->mesg_size + 1);
+	if (memchr(rec->mesg, '\\', rec->mesg_size))
+		unhexmangle_to_buffer(rec->mesg, (char *) rec->mesg,
+				      rec->mesg_size + 1);
 
 	/* F) message tags (ignore) */
 
@@ -1125,6 +1290,9 @@ mesg:
  * So this function does not compose one huge buffer (like read_syslog_buffer())
  * and print_buffer() is unnecessary. All is done in this function.
  *
+ * The records are read until EAGAIN, in the --follow mode we wait by poll()
+ * for the next records then.
+ *
  * Returns 0 on success, -1 on error.
  */
 static int read_kmsg(struct dmesg_control *ctl)
@@ -1142,16 +1310,24 @@ static int read_kmsg(struct dmesg_control *ctl)
 	 */
 	sz = ctl->kmsg_first_read;
 
-	while (sz > 0) {
-		*(ctl->kmsg_buf + sz) = '\0';	/* for debug messages */
+	while (1) {
+		if (sz > 0) {
+			*(ctl->kmsg_buf + sz) = '\0';	/* for debug messages */
 
-		if (parse_kmsg_record(ctl, &rec,
-				      ctl->kmsg_buf, (size_t) sz) == 0)
-			print_record(ctl, &rec);
+			if (parse_kmsg_record(ctl, &rec,
+					      ctl->kmsg_buf, (size_t) sz) == 0)
+				print_record(ctl, &rec);
+
+		} else if (sz < 0 && errno != EAGAIN)
+			break;
+		else if (!ctl->follow || wait_kmsg(ctl) != 0)
+			break;			/* no more messages */
 
 		sz = read_kmsg_one(ctl);
 	}
 
+	write_cursor(ctl);
+
 	return 0;
 }
 
@@ -1172,6 +1348,7 @@ static int which_time_format(const char *optarg)
 
 int main(int argc, char *argv[])
 {
+	static char outbuf[DMESG_OUTBUF_SIZ];
 	char *buf = NULL;
 	int  c, nopager = 0;
 	int  console_level = 0;
@@ -1188,6 +1365,9 @@ int main(int argc, char *argv[])
 	int colormode = UL_COLORMODE_NEVER;
 	enum {
 		OPT_TIME_FORMAT = CHAR_MAX + 1,
+		OPT_SINCE,
+		OPT_SINCE_SEQ,
+		OPT_CURSOR
 	};
 
 	static const struct option longopts[] = {
@@ -1216,6 +1396,9 @@ int main(int argc, char *argv[])
 		{ "userspace",     no_argument,       NULL, 'u' },
 		{ "version",       no_argument,	      NULL, 'V' },
 		{ "time-format",   required_argument, NULL, OPT_TIME_FORMAT },
+		{ "since",         required_argument, NULL, OPT_SINCE },
+		{ "since-seq",     required_argument, NULL, OPT_SINCE_SEQ },
+		{ "cursor",        required_argument, NULL, OPT_CURSOR },
 		{ NULL,	           0, NULL, 0 }
 	};
 
@@ -1224,6 +1407,7 @@ int main(int argc, char *argv[])
 		{ 'H','r' },			/* human, raw */
 		{ 'L','r' },			/* color, raw */
 		{ 'S','w' },			/* syslog,follow */
+		{ OPT_SINCE_SEQ, OPT_CURSOR },	/* since-seq,cursor */
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -1337,6 +1521,25 @@ int main(int argc, char *argv[])
 		case OPT_TIME_FORMAT:
 			ctl.time_fmt = which_time_format(optarg);
 			break;
+		case OPT_SINCE:
+		{
+			usec_t usec;
+
+			if (parse_timestamp(optarg, &usec) != 0)
+				errx(EXIT_FAILURE, _("invalid time value \"%s\""), optarg);
+			ctl.since.tv_sec = usec / USEC_PER_SEC;
+			ctl.since.tv_usec = usec % USEC_PER_SEC;
+			ctl.fltr_since = 1;
+			break;
+		}
+		case OPT_SINCE_SEQ:
+			ctl.since_seq = strtou64_or_err(optarg,
+					_("invalid sequence number argument"));
+			ctl.fltr_seq = 1;
+			break;
+		case OPT_CURSOR:
+			ctl.cursor = optarg;
+			break;
 		case '?':
 		default:
 			usage(stderr);
@@ -1356,6 +1559,20 @@ int main(int argc, char *argv[])
 			ctl.time_fmt = DMESG_TIMEFTM_NONE;
 	}
 
+	if (ctl.fltr_since) {
+		struct timeval boot;
+
+		/* the records use time since boot */
+		if (get_boot_time(&boot) != 0)
+			errx(EXIT_FAILURE, _("cannot get system boot time"));
+		if (timercmp(&ctl.since, &boot, <))
+			timerclear(&ctl.since);
+		else
+			timersub(&ctl.since, &boot, &ctl.since);
+	}
+	if (ctl.cursor)
+		read_cursor(&ctl);
+
 	if (delta)
 		switch (ctl.time_fmt) {
 		case DMESG_TIMEFTM_CTIME:
@@ -1389,8 +1606,12 @@ int main(int argc, char *argv[])
 	case SYSLOG_ACTION_READ_CLEAR:
 		if (ctl.method == DMESG_METHOD_KMSG && init_kmsg(&ctl) != 0)
 			ctl.method = DMESG_METHOD_SYSLOG;
+		if ((ctl.fltr_seq || ctl.cursor) && ctl.method != DMESG_METHOD_KMSG)
+			errx(EXIT_FAILURE, _("sequence numbers are supported "
+					     "for /dev/kmsg only"));
 		if (ctl.pager)
 			setup_pager();
+		setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
 		n = read_buffer(&ctl, &buf);
 		if (n > 0)
 			print_buffer(&ctl, buf, n);
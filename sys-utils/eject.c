@@ -659,15 +659,42 @@ static int eject_tape(int fd)
 }
 
 
-/* umount a device. */
-static void umount_one(const char *name)
+static struct libmnt_table *get_mtab(void)
 {
-	int status;
+	struct libmnt_cache *cache;
+	int rc;
 
-	if (!name)
-		return;
+	if (mtab)
+		return mtab;
 
-	verbose(_("%s: unmounting"), name);
+	mtab = mnt_new_table();
+	if (!mtab)
+		err(EXIT_FAILURE, _("failed to initialize libmount table"));
+
+	cache = mnt_new_cache();
+	mnt_table_set_cache(mtab, cache);
+	mnt_unref_cache(cache);
+
+	if (p_option)
+		rc = mnt_table_parse_file(mtab, _PATH_PROC_MOUNTINFO);
+	else
+		rc = mnt_table_parse_mtab(mtab, NULL);
+	if (rc)
+		err(EXIT_FAILURE, _("failed to parse mount table"));
+	return mtab;
+}
+
+/*
+ * umount a device. The mount table is parsed only once (see get_mtab()) and
+ * it's shared with libmount, the table is not updated after umount.
+ */
+/*
+ * The non-root users are allowed to unmount the filesystems with the "user"
+ * options only, this is checked by umount(8) executed with the real user ID.
+ */
+static void umount_one_exec(const char *name)
+{
+	int status;
 
 	switch (fork()) {
 	case 0: /* child */
@@ -700,6 +727,50 @@ static void umount_one(const char *name)
 	}
 }
 
+/*
+ * root unmounts in-process by libmount, the already parsed mount table is
+ * reused for all the filesystems.
+ */
+static void umount_one(const char *name)
+{
+	struct libmnt_context *cxt;
+	int rc;
+
+	if (!name)
+		return;
+
+	verbose(_("%s: unmounting"), name);
+
+	if (getuid() != 0 || geteuid() != 0) {
+		umount_one_exec(name);
+		return;
+	}
+
+	cxt = mnt_new_context();
+	if (!cxt)
+		err(EXIT_FAILURE, _("failed to initialize libmount context"));
+
+	if (p_option)
+		mnt_context_disable_mtab(cxt, 1);
+	if (mnt_context_set_mtab(cxt, get_mtab()) ||
+	    mnt_context_set_target(cxt, name))
+		err(EXIT_FAILURE, _("failed to set umount target"));
+
+	rc = mnt_context_umount(cxt);
+	if (rc || mnt_context_get_status(cxt) != 1) {
+		if (mnt_context_helper_executed(cxt))
+			errx(EXIT_FAILURE, _("unmount of `%s' failed\n"), name);
+		if (mnt_context_syscall_called(cxt) &&
+		    mnt_context_get_syscall_errno(cxt)) {
+			errno = mnt_context_get_syscall_errno(cxt);
+			err(EXIT_FAILURE, _("unmount of `%s' failed"), name);
+		}
+		errx(EXIT_FAILURE, _("unmount of `%s' failed\n"), name);
+	}
+
+	mnt_free_context(cxt);
+}
+
 /* Open a device file. */
 static int open_device(const char *name)
 {
@@ -719,28 +790,9 @@ static int open_device(const char *name)
 static int device_get_mountpoint(char **devname, char **mnt)
 {
 	struct libmnt_fs *fs;
-	int rc;
 
 	*mnt = NULL;
-
-	if (!mtab) {
-		struct libmnt_cache *cache;
-
-		mtab = mnt_new_table();
-		if (!mtab)
-			err(EXIT_FAILURE, _("failed to initialize libmount table"));
-
-		cache = mnt_new_cache();
-		mnt_table_set_cache(mtab, cache);
-		mnt_unref_cache(cache);
-
-		if (p_option)
-			rc = mnt_table_parse_file(mtab, _PATH_PROC_MOUNTINFO);
-		else
-			rc = mnt_table_parse_mtab(mtab, NULL);
-		if (rc)
-			err(EXIT_FAILURE, _("failed to parse mount table"));
-	}
+	get_mtab();
 
 	fs = mnt_table_find_source(mtab, *devname, MNT_ITER_BACKWARD);
 	if (!fs) {
@@ -774,10 +826,21 @@ static char *get_disk_devname(const char *device)
 	return st.st_rdev == diskno ? NULL : find_device(diskname);
 }
 
+/*
+ * Unmounts all filesystems (including bind mounts) on the partitions of the
+ * @disk. The partitions are compared by devno with the mount table, the
+ * table is walked only once.
+ *
+ * Returns: number of the mounted partitions.
+ */
 static int umount_partitions(const char *disk, int checkonly)
 {
 	struct sysfs_cxt cxt = UL_SYSFSCXT_EMPTY;
-	dev_t devno;
+	struct libmnt_iter *itr = NULL;
+	struct libmnt_fs *fs;
+	dev_t devno, *parts = NULL;
+	char *mounted = NULL;
+	size_t nparts = 0, i;
 	DIR *dir = NULL;
 	struct dirent *d;
 	int count = 0;
@@ -792,25 +855,65 @@ static int umount_partitions(const char *disk, int checkonly)
 
 	/* scan for partition subdirs */
 	while ((d = readdir(dir))) {
+		char path[NAME_MAX + sizeof("/dev")];
+		unsigned int maj, min;
+
 		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
 			continue;
+		if (!sysfs_is_partition_dirent(dir, d, disk))
+			continue;
 
-		if (sysfs_is_partition_dirent(dir, d, disk)) {
-			char *mnt = NULL;
-			char *dev = find_device(d->d_name);
+		snprintf(path, sizeof(path), "%s/dev", d->d_name);
+		if (sysfs_scanf(&cxt, path, "%u:%u", &maj, &min) != 2)
+			continue;
 
-			if (dev && device_get_mountpoint(&dev, &mnt) == 0) {
-				verbose(_("%s: mounted on %s"), dev, mnt);
-				if (!checkonly)
-					umount_one(mnt);
-				count++;
-			}
-			free(dev);
-			free(mnt);
+		parts = xrealloc(parts, (nparts + 1) * sizeof(dev_t));
+		parts[nparts++] = makedev(maj, min);
+	}
+	if (!nparts)
+		goto done;
+
+	mounted = xcalloc(nparts, 1);
+	itr = mnt_new_iter(MNT_ITER_BACKWARD);
+	if (!itr)
+		err(EXIT_FAILURE, _("failed to initialize libmount iterator"));
+
+	/* backward, the last mounted is the first unmounted */
+	while (mnt_table_next_fs(get_mtab(), itr, &fs) == 0) {
+		const char *src = mnt_fs_get_srcpath(fs);
+
+		devno = mnt_fs_get_devno(fs);
+
+		/* mtab without devno, or anonymous devno (e.g. btrfs) */
+		if (!major(devno) && src) {
+			struct stat st;
+
+			if (stat(src, &st) == 0 && S_ISBLK(st.st_mode))
+				devno = st.st_rdev;
+		}
+		if (!devno)
+			continue;
+
+		for (i = 0; i < nparts; i++)
+			if (parts[i] == devno)
+				break;
+		if (i == nparts)
+			continue;
+
+		verbose(_("%s: mounted on %s"), src ? src : mnt_fs_get_source(fs),
+				mnt_fs_get_target(fs));
+		if (!mounted[i]) {
+			mounted[i] = 1;
+			count++;
 		}
+		if (!checkonly)
+			umount_one(mnt_fs_get_target(fs));
 	}
 
 done:
+	mnt_free_iter(itr);
+	free(mounted);
+	free(parts);
 	if (dir)
 		closedir(dir);
 	sysfs_deinit(&cxt);
@@ -31,6 +31,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <limits.h>
+#include <string.h>
 
 #ifndef HAVE_FALLOCATE
 # include <sys/syscall.h>
@@ -48,10 +49,24 @@
 # define FALLOC_FL_PUNCH_HOLE 2
 #endif
 
+#ifndef SEEK_DATA
+# define SEEK_DATA 3
+#endif
+#ifndef SEEK_HOLE
+# define SEEK_HOLE 4
+#endif
+
 #include "nls.h"
 #include "strutils.h"
 #include "c.h"
 #include "closestream.h"
+#include "xalloc.h"
+
+/* the read buffer for --dig-holes */
+#define DIG_BUFSIZ	(1024 * 1024)
+
+static int verbose;
+static char *filename;
 
 static void __attribute__((__noreturn__)) usage(FILE *out)
 {
@@ -61,8 +76,10 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -n, --keep-size     don't modify the length of the file\n"
 		" -p, --punch-hole    punch holes in the file\n"
+		" -d, --dig-holes     detect and dig holes\n"
 		" -o, --offset <num>  offset of the allocation, in bytes\n"
-		" -l, --length <num>  length of the allocation, in bytes\n"), out);
+		" -l, --length <num>  length of the allocation, in bytes\n"
+		" -v, --verbose       verbose mode\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	fputs(USAGE_HELP, out);
 	fputs(USAGE_VERSION, out);
@@ -81,13 +98,162 @@ static loff_t cvtnum(char *s)
 	return x;
 }
 
+static void xfallocate(int fd, int mode, off_t offset, off_t length)
+{
+	int error;
+
+#ifdef HAVE_FALLOCATE
+	error = fallocate(fd, mode, offset, length);
+#else
+	error = syscall(SYS_fallocate, fd, mode, offset, length);
+#endif
+	/*
+	 * EOPNOTSUPP: The FALLOC_FL_KEEP_SIZE is unsupported
+	 * ENOSYS: The filesystem does not support sys_fallocate
+	 */
+	if (error < 0) {
+		if ((mode & FALLOC_FL_KEEP_SIZE) && errno == EOPNOTSUPP)
+			errx(EXIT_FAILURE,
+				_("keep size mode (-n option) unsupported"));
+		err(EXIT_FAILURE, _("%s: fallocate failed"), filename);
+	}
+}
+
+/*
+ * Returns non-zero if the first @len bytes from @buf are all NULs. The
+ * comparison of the buffer with itself is done by memcmp(), which is
+ * vectorized in libc.
+ */
+static int is_nul(const unsigned char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len && i < 16; i++)
+		if (buf[i])
+			return 0;
+	return len <= 16 || memcmp(buf, buf + 16, len - 16) == 0;
+}
+
+/*
+ * Reads the file from @off to @end and punches holes in the blocks with zeros
+ * only. The holes in the file are skipped by SEEK_DATA and SEEK_HOLE, the
+ * scanned data are dropped from the page cache.
+ */
+static void dig_holes(int fd, off_t off, off_t end)
+{
+	off_t hole_start = 0, hole_sz = 0, total = 0, cache_start = off;
+	size_t bufsz, blksz;
+	unsigned char *buf;
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+		err(EXIT_FAILURE, _("stat failed %s"), filename);
+	if (!end || end > st.st_size)
+		end = st.st_size;
+
+	blksz = st.st_blksize > 0 ? (size_t) st.st_blksize : 4096;
+	bufsz = DIG_BUFSIZ / blksz * blksz;
+	if (!bufsz)
+		bufsz = blksz;
+
+	/* the holes are aligned to the filesystem blocks */
+	off = (off + blksz - 1) / blksz * blksz;
+
+	if (posix_memalign((void **) &buf, getpagesize(), bufsz))
+		err(EXIT_FAILURE, _("cannot allocate %zu bytes"), bufsz);
+
+#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
+	posix_fadvise(fd, off, end - off, POSIX_FADV_SEQUENTIAL);
+#endif
+	while (off < end) {
+		off_t data_end, x;
+		ssize_t rsz;
+
+		/* skip the hole */
+		x = lseek(fd, off, SEEK_DATA);
+		if (x < 0) {
+			if (errno == ENXIO)
+				break;		/* no more data */
+			if (errno != EINVAL)
+				err(EXIT_FAILURE, _("%s: seek failed"), filename);
+			x = off;		/* SEEK_DATA unsupported */
+		}
+		if (x > off) {
+			if (hole_sz) {
+				xfallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+					   hole_start, hole_sz);
+				total += hole_sz;
+				hole_sz = 0;
+			}
+			off = x / blksz * blksz;
+			if (off >= end)
+				break;
+		}
+
+		/* read only the data, not the next hole */
+		data_end = lseek(fd, off, SEEK_HOLE);
+		if (data_end < 0 || data_end > end)
+			data_end = end;
+		if (data_end <= off)
+			data_end = min(off + (off_t) bufsz, end);
+
+		rsz = pread(fd, buf, min((off_t) bufsz, data_end - off), off);
+		if (rsz < 0)
+			err(EXIT_FAILURE, _("%s: read failed"), filename);
+		if (rsz == 0)
+			break;
+
+		for (x = 0; x < rsz; x += blksz) {
+			size_t sz = min((size_t) (rsz - x), blksz);
+
+			/* the tail of the file is not a whole block */
+			if (sz == blksz && is_nul(buf + x, sz)) {
+				if (!hole_sz)
+					hole_start = off + x;
+				hole_sz += sz;
+			} else if (hole_sz) {
+				xfallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+					   hole_start, hole_sz);
+				total += hole_sz;
+				hole_sz = 0;
+			}
+		}
+		off += rsz;
+
+#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
+		/* don't pollute the cache by the scanned file */
+		if (off - cache_start > 32 * DIG_BUFSIZ) {
+			posix_fadvise(fd, cache_start, off - cache_start,
+				      POSIX_FADV_DONTNEED);
+			cache_start = off;
+		}
+#endif
+	}
+
+	if (hole_sz) {
+		xfallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			   hole_start, hole_sz);
+		total += hole_sz;
+	}
+#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
+	posix_fadvise(fd, cache_start, 0, POSIX_FADV_DONTNEED);
+#endif
+	free(buf);
+
+	if (verbose) {
+		char *str = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE, total);
+		fprintf(stdout, _("%s: %s (%ju bytes) converted to sparse holes.\n"),
+				filename, str, (uintmax_t) total);
+		free(str);
+	}
+}
+
 int main(int argc, char **argv)
 {
-	char	*fname;
 	int	c;
-	int	error;
 	int	fd;
 	int	mode = 0;
+	int	dig = 0;
 	loff_t	length = -2LL;
 	loff_t	offset = 0;
 
@@ -96,8 +262,10 @@ int main(int argc, char **argv)
 	    { "version",   0, 0, 'V' },
 	    { "keep-size", 0, 0, 'n' },
 	    { "punch-hole", 0, 0, 'p' },
+	    { "dig-holes", 0, 0, 'd' },
 	    { "offset",    1, 0, 'o' },
 	    { "length",    1, 0, 'l' },
+	    { "verbose",   0, 0, 'v' },
 	    { NULL,        0, 0, 0 }
 	};
 
@@ -106,7 +274,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while ((c = getopt_long(argc, argv, "hVnpl:o:", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hVnpdl:o:v", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'h':
 			usage(stdout);
@@ -120,55 +288,64 @@ int main(int argc, char **argv)
 		case 'n':
 			mode |= FALLOC_FL_KEEP_SIZE;
 			break;
+		case 'd':
+			dig = 1;
+			break;
 		case 'l':
 			length = cvtnum(optarg);
 			break;
 		case 'o':
 			offset = cvtnum(optarg);
 			break;
+		case 'v':
+			verbose++;
+			break;
 		default:
 			usage(stderr);
 			break;
 		}
 	}
 
-	if (length == -2LL)
-		errx(EXIT_FAILURE, _("no length argument specified"));
-	if (length <= 0)
-		errx(EXIT_FAILURE, _("invalid length value specified"));
+	if (dig) {
+		if (mode != 0)
+			errx(EXIT_FAILURE,
+			     _("Can't use other modes with --dig-holes"));
+		if (length == -2LL)
+			length = 0;
+		if (length < 0)
+			errx(EXIT_FAILURE, _("invalid length value specified"));
+	} else {
+		if (length == -2LL)
+			errx(EXIT_FAILURE, _("no length argument specified"));
+		if (length <= 0)
+			errx(EXIT_FAILURE, _("invalid length value specified"));
+	}
 	if (offset < 0)
 		errx(EXIT_FAILURE, _("invalid offset value specified"));
 	if (optind == argc)
 		errx(EXIT_FAILURE, _("no filename specified."));
 
-	fname = argv[optind++];
+	filename = argv[optind++];
 
 	if (optind != argc) {
 		warnx(_("unexpected number of arguments"));
 		usage(stderr);
 	}
 
-	fd = open(fname, O_WRONLY|O_CREAT, 0644);
-	if (fd < 0)
-		err(EXIT_FAILURE, _("cannot open %s"), fname);
-
-#ifdef HAVE_FALLOCATE
-	error = fallocate(fd, mode, offset, length);
-#else
-	error = syscall(SYS_fallocate, fd, mode, offset, length);
-#endif
-	/*
-	 * EOPNOTSUPP: The FALLOC_FL_KEEP_SIZE is unsupported
-	 * ENOSYS: The filesystem does not support sys_fallocate
-	 */
-	if (error < 0) {
-		if ((mode & FALLOC_FL_KEEP_SIZE) && errno == EOPNOTSUPP)
-			errx(EXIT_FAILURE,
-				_("keep size mode (-n option) unsupported"));
-		err(EXIT_FAILURE, _("%s: fallocate failed"), fname);
+	if (dig) {
+		/* don't create the file */
+		fd = open(filename, O_RDWR);
+		if (fd < 0)
+			err(EXIT_FAILURE, _("cannot open %s"), filename);
+		dig_holes(fd, offset, length ? offset + length : 0);
+	} else {
+		fd = open(filename, O_WRONLY|O_CREAT, 0644);
+		if (fd < 0)
+			err(EXIT_FAILURE, _("cannot open %s"), filename);
+		xfallocate(fd, mode, offset, length);
 	}
 
 	if (close_fd(fd) != 0)
-		err(EXIT_FAILURE, _("write failed: %s"), fname);
+		err(EXIT_FAILURE, _("write failed: %s"), filename);
 	return EXIT_SUCCESS;
 }
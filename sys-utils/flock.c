@@ -51,7 +51,8 @@ static void __attribute__((__noreturn__)) usage(int ex)
 	fprintf(stderr,
 		_(" %1$s [options] <file|directory> <command> [<arguments>...]\n"
 		  " %1$s [options] <file|directory> -c <command>\n"
-		  " %1$s [options] <file descriptor number>\n"),
+		  " %1$s [options] <file descriptor number>\n"
+		  " %1$s [options] --batch <file|directory> < <commands>\n"),
 		program_invocation_short_name);
 	fputs(USAGE_OPTIONS, stderr);
 	fputs(_(  " -s  --shared             get a shared lock\n"), stderr);
@@ -62,6 +63,8 @@ static void __attribute__((__noreturn__)) usage(int ex)
 	fputs(_(  " -E  --conflict-exit-code <number>  exit code after conflict or timeout\n"), stderr);
 	fputs(_(  " -o  --close              close file descriptor before running command\n"), stderr);
 	fputs(_(  " -c  --command <command>  run a single command string through the shell\n"), stderr);
+	fputs(_(  " -b  --batch              run commands from stdin, lock only once\n"), stderr);
+	fputs(_(  " -j  --jobs <number>      run commands in parallel (with --shared)\n"), stderr);
 	fprintf(stderr, USAGE_SEPARATOR);
 	fprintf(stderr, USAGE_HELP);
 	fprintf(stderr, USAGE_VERSION);
@@ -105,6 +108,109 @@ static int open_file(const char *filename, int *flags)
 	return fd;
 }
 
+static char *get_shell(void)
+{
+	char *sh = getenv("SHELL");
+
+	return sh && *sh ? sh : _PATH_BSHELL;
+}
+
+/* converts waitpid() status to the flock exit code */
+static int child_status(int status)
+{
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	if (WIFSIGNALED(status))
+		return WTERMSIG(status) + 128;
+	/* WTF? */
+	return EX_OSERR;
+}
+
+static pid_t run_command(char **cmd_argv, int fd, int do_close, int nullstdin)
+{
+	pid_t f = fork();
+
+	if (f < 0)
+		err(EX_OSERR, _("fork failed"));
+	if (f == 0) {
+		if (do_close)
+			close(fd);
+		if (nullstdin) {
+			/* don't steal commands from the batch */
+			int nfd = open("/dev/null", O_RDONLY);
+
+			if (nfd >= 0 && nfd != STDIN_FILENO) {
+				dup2(nfd, STDIN_FILENO);
+				close(nfd);
+			}
+		}
+		execvp(cmd_argv[0], cmd_argv);
+		/* execvp() failed */
+		warn(_("failed to execute %s"), cmd_argv[0]);
+		_exit((errno == ENOMEM) ? EX_OSERR : EX_UNAVAILABLE);
+	}
+	return f;
+}
+
+/*
+ * Waits for @f, or for any child if @f is -1. Returns the exit code.
+ */
+static int wait_command(pid_t f)
+{
+	int status;
+	pid_t w;
+
+	do {
+		w = waitpid(f, &status, 0);
+		if (w == -1 && errno != EINTR)
+			break;
+	} while (w == -1);
+
+	if (w == -1) {
+		warn(_("waitpid failed"));
+		return EXIT_FAILURE;
+	}
+	return child_status(status);
+}
+
+/*
+ * Reads commands (one per line) from stdin and runs them by the shell while
+ * the lock is held. Returns the exit code of the first failed command.
+ */
+static int run_batch(int fd, int do_close, size_t jobs)
+{
+	char *cmd_argv[4] = { get_shell(), "-c", NULL, NULL };
+	char *line = NULL;
+	size_t sz = 0, running = 0;
+	ssize_t len;
+	int rc = EX_OK, st;
+
+	while ((len = getline(&line, &sz, stdin)) != -1) {
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (!*skip_space(line))
+			continue;
+
+		if (running == jobs) {
+			st = wait_command(-1);
+			if (st && rc == EX_OK)
+				rc = st;
+			running--;
+		}
+		cmd_argv[2] = line;
+		run_command(cmd_argv, fd, do_close, 1);
+		running++;
+	}
+
+	for (; running; running--) {
+		st = wait_command(-1);
+		if (st && rc == EX_OK)
+			rc = st;
+	}
+	free(line);
+	return rc;
+}
+
 int main(int argc, char *argv[])
 {
 	struct itimerval timeout, old_timer;
@@ -115,6 +221,8 @@ int main(int argc, char *argv[])
 	int fd = -1;
 	int opt, ix;
 	int do_close = 0;
+	int batch = 0;
+	size_t jobs = 1;
 	int status;
 	/*
 	 * The default exit code for lock conflict or timeout
@@ -135,6 +243,8 @@ int main(int argc, char *argv[])
 		{"wait", required_argument, NULL, 'w'},
 		{"conflict-exit-code", required_argument, NULL, 'E'},
 		{"close", no_argument, NULL, 'o'},
+		{"batch", no_argument, NULL, 'b'},
+		{"jobs", required_argument, NULL, 'j'},
 		{"help", no_argument, NULL, 'h'},
 		{"version", no_argument, NULL, 'V'},
 		{NULL, 0, NULL, 0}
@@ -152,7 +262,7 @@ int main(int argc, char *argv[])
 
 	optopt = 0;
 	while ((opt =
-		getopt_long(argc, argv, "+sexnouw:E:hV?", long_options,
+		getopt_long(argc, argv, "+sexnoubj:w:E:hV?", long_options,
 			    &ix)) != EOF) {
 		switch (opt) {
 		case 's':
@@ -168,6 +278,14 @@ int main(int argc, char *argv[])
 		case 'o':
 			do_close = 1;
 			break;
+		case 'b':
+			batch = 1;
+			break;
+		case 'j':
+			jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			if (!jobs)
+				errx(EX_USAGE, _("invalid number of jobs"));
+			break;
 		case 'n':
 			block = LOCK_NB;
 			break;
@@ -194,7 +312,19 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (argc > optind + 1) {
+	if (jobs > 1 && (!batch || type != LOCK_SH))
+		errx(EX_USAGE, _("--jobs requires --batch and --shared"));
+
+	if (batch) {
+		/* Run commands from stdin */
+		if (argc != optind + 1)
+			errx(EX_USAGE, _("--batch requires exactly one file or directory"));
+		if (type == LOCK_UN)
+			errx(EX_USAGE, _("--batch cannot be used with --unlock"));
+		filename = argv[optind];
+		fd = open_file(filename, &open_flags);
+
+	} else if (argc > optind + 1) {
 		/* Run command */
 		if (!strcmp(argv[optind + 1], "-c") ||
 		    !strcmp(argv[optind + 1], "--command")) {
@@ -203,9 +333,7 @@ int main(int argc, char *argv[])
 				     _("%s requires exactly one command argument"),
 				     argv[optind + 1]);
 			cmd_argv = sh_c_argv;
-			cmd_argv[0] = getenv("SHELL");
-			if (!cmd_argv[0] || !*cmd_argv[0])
-				cmd_argv[0] = _PATH_BSHELL;
+			cmd_argv[0] = get_shell();
 			cmd_argv[1] = "-c";
 			cmd_argv[2] = argv[optind + 2];
 			cmd_argv[3] = 0;
@@ -282,39 +410,15 @@ int main(int argc, char *argv[])
 
 	status = EX_OK;
 
-	if (cmd_argv) {
-		pid_t w, f;
+	if (cmd_argv || batch) {
 		/* Clear any inherited settings */
 		signal(SIGCHLD, SIG_DFL);
-		f = fork();
 
-		if (f < 0) {
-			err(EX_OSERR, _("fork failed"));
-		} else if (f == 0) {
-			if (do_close)
-				close(fd);
-			execvp(cmd_argv[0], cmd_argv);
-			/* execvp() failed */
-			warn(_("failed to execute %s"), cmd_argv[0]);
-			_exit((errno == ENOMEM) ? EX_OSERR : EX_UNAVAILABLE);
-		} else {
-			do {
-				w = waitpid(f, &status, 0);
-				if (w == -1 && errno != EINTR)
-					break;
-			} while (w != f);
-
-			if (w == -1) {
-				status = EXIT_FAILURE;
-				warn(_("waitpid failed"));
-			} else if (WIFEXITED(status))
-				status = WEXITSTATUS(status);
-			else if (WIFSIGNALED(status))
-				status = WTERMSIG(status) + 128;
-			else
-				/* WTF? */
-				status = EX_OSERR;
-		}
+		if (batch)
+			status = run_batch(fd, do_close, jobs);
+		else
+			status = wait_command(run_command(cmd_argv, fd,
+							  do_close, 0));
 	}
 
 	return status;
@@ -35,6 +35,8 @@
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 #include <linux/fs.h>
 
 #include "nls.h"
@@ -44,6 +46,7 @@
 #include "pathnames.h"
 #include "sysfs.h"
 #include "exitcodes.h"
+#include "xalloc.h"
 
 #include <libmount.h>
 
@@ -56,16 +59,101 @@ struct fstrim_range {
 #define FITRIM		_IOWR('X', 121, struct fstrim_range)
 #endif
 
+struct fstrim_control {
+	struct fstrim_range range;	/* the range template */
+
+	uint64_t	chunk;		/* discard by chunks of this size */
+	unsigned int	duty;		/* busy time in percent */
+	unsigned int	jobs;		/* parallel --all workers */
+	int		verbose;
+};
+
+/* filesystem for fstrim --all */
+struct fstrim_ent {
+	char	*target;
+	dev_t	disk;		/* whole disk devno */
+	size_t	idx;		/* order in mountinfo */
+};
+
+static uint64_t elapsed_usec(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000ULL +
+	       now.tv_usec - start->tv_usec;
+}
+
+/*
+ * Sleeps to keep the device busy only for ctl->duty percent of the time, the
+ * @busy is the time spent in the last FITRIM.
+ */
+static void fstrim_throttle(struct fstrim_control *ctl, uint64_t busy)
+{
+	uint64_t idle;
+
+	if (!ctl->duty || ctl->duty >= 100)
+		return;
+
+	idle = busy * (100 - ctl->duty) / ctl->duty;
+	while (idle) {
+		useconds_t us = idle > 1000000 ? 1000000 : idle;
+
+		usleep(us);
+		idle -= us;
+	}
+}
+
+/*
+ * Discards the range by ctl->chunk large parts. The kernel stops at the end
+ * of the filesystem, the unknown end of the default range is detected by
+ * EINVAL (start behind the end of the filesystem). Note that the part which
+ * discards nothing does not mean the end, the filesystem may skip already
+ * trimmed groups.
+ */
+static int fstrim_chunks(int fd, struct fstrim_control *ctl, uint64_t *trimmed)
+{
+	uint64_t start = ctl->range.start, end;
+
+	end = ctl->range.len > UINT64_MAX - start ?
+				UINT64_MAX : start + ctl->range.len;
+	*trimmed = 0;
+
+	while (start < end) {
+		struct fstrim_range range = ctl->range;
+		struct timeval tv;
+
+		range.start = start;
+		range.len = min(end - start, ctl->chunk);
+
+		gettimeofday(&tv, NULL);
+		errno = 0;
+		if (ioctl(fd, FITRIM, &range)) {
+			if (errno == EINVAL && start != ctl->range.start)
+				break;		/* behind the end */
+			return -errno;
+		}
+		*trimmed += range.len;
+
+		/* no progress possible, the range is done */
+		if (end - start <= ctl->chunk)
+			break;
+		start += ctl->chunk;
+
+		fstrim_throttle(ctl, elapsed_usec(&tv));
+	}
+	return 0;
+}
+
 /* returns: 0 = success, 1 = unsupported, < 0 = error */
-static int fstrim_filesystem(const char *path, struct fstrim_range *rangetpl,
-			    int verbose)
+static int fstrim_filesystem(const char *path, struct fstrim_control *ctl)
 {
-	int fd;
+	int fd, rc;
 	struct stat sb;
 	struct fstrim_range range;
 
 	/* kernel modifies the range */
-	memcpy(&range, rangetpl, sizeof(range));
+	memcpy(&range, &ctl->range, sizeof(range));
 
 	if (stat(path, &sb) == -1) {
 		warn(_("stat failed %s"), path);
@@ -81,9 +169,16 @@ static int fstrim_filesystem(const char *path, struct fstrim_range *rangetpl,
 		warn(_("cannot open %s"), path);
 		return -1;
 	}
-	errno = 0;
-	if (ioctl(fd, FITRIM, &range)) {
-		int rc = errno == EOPNOTSUPP || errno == ENOTTY ? 1 : -1;
+	if (ctl->chunk) {
+		uint64_t trimmed = 0;
+
+		rc = fstrim_chunks(fd, ctl, &trimmed);
+		range.len = trimmed;
+	} else
+		rc = ioctl(fd, FITRIM, &range) ? -errno : 0;
+	if (rc) {
+		errno = -rc;
+		rc = errno == EOPNOTSUPP || errno == ENOTTY ? 1 : -1;
 
 		if (rc != 1)
 			warn(_("%s: FITRIM ioctl failed"), path);
@@ -91,7 +186,7 @@ static int fstrim_filesystem(const char *path, struct fstrim_range *rangetpl,
 		return rc;
 	}
 
-	if (verbose) {
+	if (ctl->verbose) {
 		char *str = size_to_human_string(
 				SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE,
 				(uint64_t) range.len);
@@ -104,7 +199,8 @@ static int fstrim_filesystem(const char *path, struct fstrim_range *rangetpl,
 	return 0;
 }
 
-static int has_discard(const char *devname, struct sysfs_cxt *wholedisk)
+static int has_discard(const char *devname, struct sysfs_cxt *wholedisk,
+		       dev_t *diskno)
 {
 	struct sysfs_cxt cxt, *parent = NULL;
 	uint64_t dg = 0;
@@ -130,6 +226,7 @@ static int has_discard(const char *devname, struct sysfs_cxt *wholedisk)
 		}
 		parent = wholedisk;
 	}
+	*diskno = disk;
 
 	rc = sysfs_init(&cxt, dev, parent);
 	if (!rc)
@@ -139,13 +236,86 @@ static int has_discard(const char *devname, struct sysfs_cxt *wholedisk)
 	return rc == 0 && dg > 0;
 }
 
+static int cmp_ents_disk(const void *a, const void *b)
+{
+	const struct fstrim_ent *x = a, *y = b;
+
+	if (x->disk != y->disk)
+		return x->disk < y->disk ? -1 : 1;
+	return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+/* trims the filesystems and returns number of failed */
+static size_t fstrim_ents(struct fstrim_ent *ents, size_t nents,
+			  struct fstrim_control *ctl)
+{
+	size_t i, cnt_err = 0;
+
+	/*
+	 * We're able to detect that the device supports discard, but
+	 * things also depend on filesystem or device mapping, for
+	 * example vfat or LUKS (by default) does not support FSTRIM.
+	 *
+	 * This is reason why we ignore EOPNOTSUPP and ENOTTY errors
+	 * from discard ioctl.
+	 */
+	for (i = 0; i < nents; i++) {
+		if (fstrim_filesystem(ents[i].target, ctl) < 0)
+		       cnt_err++;
+	}
+	return cnt_err;
+}
+
+/* waits for one worker, returns -1 if there is no worker */
+static int wait_worker(size_t *cnt_err)
+{
+	int status;
 
-static int uniq_fs_target_cmp(
-		struct libmnt_table *tb __attribute__((__unused__)),
-		struct libmnt_fs *a,
-		struct libmnt_fs *b)
+	while (wait(&status) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+	*cnt_err += WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+	return 0;
+}
+
+/*
+ * Trims filesystems on different whole disks in parallel, the filesystems on
+ * the same disk are trimmed one by one. Returns number of failed.
+ */
+static size_t fstrim_ents_parallel(struct fstrim_ent *ents, size_t nents,
+				   struct fstrim_control *ctl)
 {
-	return !mnt_fs_streq_target(a, mnt_fs_get_target(b));
+	size_t i, n, cnt_err = 0, running = 0;
+
+	qsort(ents, nents, sizeof(struct fstrim_ent), cmp_ents_disk);
+	fflush(stdout);
+
+	for (i = 0; i < nents; i = n) {
+		/* the next disk */
+		for (n = i + 1; n < nents && ents[n].disk == ents[i].disk; n++);
+
+		if (running >= ctl->jobs && wait_worker(&cnt_err) == 0)
+			running--;
+
+		switch (fork()) {
+		case -1:
+			warn(_("fork failed"));
+			cnt_err += fstrim_ents(&ents[i], n - i, ctl);
+			break;
+		case 0:
+			/* don't mix lines from more processes */
+			setvbuf(stdout, NULL, _IOLBF, 0);
+			exit(min(fstrim_ents(&ents[i], n - i, ctl), (size_t) 255));
+		default:
+			running++;
+			break;
+		}
+	}
+
+	while (running && wait_worker(&cnt_err) == 0)
+		running--;
+	return cnt_err;
 }
 
 /*
@@ -155,13 +325,14 @@ static int uniq_fs_target_cmp(
  * 32 = all failed
  * 64 = some failed, some success
  */
-static int fstrim_all(struct fstrim_range *rangetpl, int verbose)
+static int fstrim_all(struct fstrim_control *ctl)
 {
 	struct libmnt_fs *fs;
 	struct libmnt_iter *itr;
 	struct libmnt_table *tab;
 	struct sysfs_cxt wholedisk = UL_SYSFSCXT_EMPTY;
-	int cnt = 0, cnt_err = 0;
+	struct fstrim_ent *ents = NULL;
+	size_t cnt = 0, cnt_err, i;
 
 	mnt_init_debug(0);
 
@@ -174,12 +345,13 @@ static int fstrim_all(struct fstrim_range *rangetpl, int verbose)
 		err(MOUNT_EX_FAIL, _("failed to parse %s"), _PATH_PROC_MOUNTINFO);
 
 	/* de-duplicate the table */
-	mnt_table_uniq_fs(tab, 0, uniq_fs_target_cmp);
+	mnt_table_uniq_fs_by_key(tab, 0, MNT_UNIQ_TARGET);
 
 	while (mnt_table_next_fs(tab, itr, &fs) == 0) {
 		const char *src = mnt_fs_get_srcpath(fs),
 			   *tgt = mnt_fs_get_target(fs);
 		char *path;
+		dev_t disk = 0;
 		int rc = 1;
 
 		if (!src || !tgt || *src != '/' ||
@@ -196,26 +368,30 @@ static int fstrim_all(struct fstrim_range *rangetpl, int verbose)
 		if (rc)
 			continue;	/* overlaying mount */
 
-		if (!has_discard(src, &wholedisk))
+		if (!has_discard(src, &wholedisk, &disk))
 			continue;
-		cnt++;
 
-		/*
-		 * We're able to detect that the device supports discard, but
-		 * things also depend on filesystem or device mapping, for
-		 * example vfat or LUKS (by default) does not support FSTRIM.
-		 *
-		 * This is reason why we ignore EOPNOTSUPP and ENOTTY errors
-		 * from discard ioctl.
-		 */
-		if (fstrim_filesystem(tgt, rangetpl, verbose) < 0)
-		       cnt_err++;
+		ents = xrealloc(ents, (cnt + 1) * sizeof(struct fstrim_ent));
+		ents[cnt].target = xstrdup(tgt);
+		ents[cnt].disk = disk;
+		ents[cnt].idx = cnt;
+		cnt++;
 	}
 
 	sysfs_deinit(&wholedisk);
 	mnt_unref_table(tab);
+	mnt_free_iter(itr);
+
+	if (ctl->jobs > 1 && cnt > 1)
+		cnt_err = fstrim_ents_parallel(ents, cnt, ctl);
+	else
+		cnt_err = fstrim_ents(ents, cnt, ctl);
+
+	for (i = 0; i < cnt; i++)
+		free(ents[i].target);
+	free(ents);
 
-	if (cnt && cnt == cnt_err)
+	if (cnt && cnt_err >= cnt)
 		return MOUNT_EX_FAIL;		/* all failed */
 	if (cnt && cnt_err)
 		return MOUNT_EX_SOMEOK;		/* some ok */
@@ -233,6 +409,10 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(_(" -o, --offset <num>  the offset in bytes to start discarding from\n"), out);
 	fputs(_(" -l, --length <num>  the number of bytes to discard\n"), out);
 	fputs(_(" -m, --minimum <num> the minimum extent length to discard\n"), out);
+	fputs(_(" -c, --chunk <num>   discard the range by chunks of <num> bytes\n"), out);
+	fputs(_(" -d, --duty-cycle <percent>\n"
+		"                     busy time of the device for --chunk in percent\n"), out);
+	fputs(_(" -j, --jobs <num>    trim filesystems on up to <num> disks at the same time\n"), out);
 	fputs(_(" -v, --verbose       print number of discarded bytes\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -245,8 +425,8 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 int main(int argc, char **argv)
 {
 	char *path;
-	int c, rc, verbose = 0, all = 0;
-	struct fstrim_range range;
+	int c, rc, all = 0;
+	struct fstrim_control ctl = { .jobs = 1 };
 
 	static const struct option longopts[] = {
 	    { "all",       0, 0, 'a' },
@@ -256,6 +436,9 @@ int main(int argc, char **argv)
 	    { "length",    1, 0, 'l' },
 	    { "minimum",   1, 0, 'm' },
 	    { "verbose",   0, 0, 'v' },
+	    { "chunk",     1, 0, 'c' },
+	    { "duty-cycle", 1, 0, 'd' },
+	    { "jobs",      1, 0, 'j' },
 	    { NULL,        0, 0, 0 }
 	};
 
@@ -264,14 +447,31 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	memset(&range, 0, sizeof(range));
-	range.len = ULLONG_MAX;
+	ctl.range.len = ULLONG_MAX;
 
-	while ((c = getopt_long(argc, argv, "ahVo:l:m:v", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "ac:d:hj:Vo:l:m:v", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'a':
 			all = 1;
 			break;
+		case 'c':
+			ctl.chunk = strtosize_or_err(optarg,
+					_("failed to parse chunk size"));
+			if (!ctl.chunk)
+				errx(EXIT_FAILURE, _("invalid chunk size"));
+			break;
+		case 'd':
+			ctl.duty = strtou32_or_err(optarg,
+					_("failed to parse duty cycle"));
+			if (!ctl.duty || ctl.duty > 100)
+				errx(EXIT_FAILURE, _("duty cycle out of range <1-100>"));
+			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg,
+					_("failed to parse jobs"));
+			if (!ctl.jobs)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
 		case 'h':
 			usage(stdout);
 			break;
@@ -279,19 +479,19 @@ int main(int argc, char **argv)
 			printf(UTIL_LINUX_VERSION);
 			return EXIT_SUCCESS;
 		case 'l':
-			range.len = strtosize_or_err(optarg,
+			ctl.range.len = strtosize_or_err(optarg,
 					_("failed to parse length"));
 			break;
 		case 'o':
-			range.start = strtosize_or_err(optarg,
+			ctl.range.start = strtosize_or_err(optarg,
 					_("failed to parse offset"));
 			break;
 		case 'm':
-			range.minlen = strtosize_or_err(optarg,
+			ctl.range.minlen = strtosize_or_err(optarg,
 					_("failed to parse minimum extent length"));
 			break;
 		case 'v':
-			verbose = 1;
+			ctl.verbose = 1;
 			break;
 		default:
 			usage(stderr);
@@ -309,11 +509,13 @@ int main(int argc, char **argv)
 		warnx(_("unexpected number of arguments"));
 		usage(stderr);
 	}
+	if (ctl.duty && !ctl.chunk)
+		errx(EXIT_FAILURE, _("--duty-cycle requires --chunk"));
 
 	if (all)
-		rc = fstrim_all(&range, verbose);
+		rc = fstrim_all(&ctl);
 	else {
-		rc = fstrim_filesystem(path, &range, verbose);
+		rc = fstrim_filesystem(path, &ctl);
 		if (rc == 1) {
 			warnx(_("%s: discard operation not supported."), path);
 			rc = EXIT_FAILURE;
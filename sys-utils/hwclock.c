@@ -503,6 +503,11 @@ set_hardware_clock(const time_t newtime,
 	}
 }
 
+/* set_hardware_clock_exact() busy-waits only for this time (in seconds) */
+#define SETHW_SPIN_TIME		0.001
+/* the longest sleep, must be shorter than the forward time reset limit */
+#define SETHW_SLEEP_STEP	0.05
+
 /*
  * Set the Hardware Clock to the time "sethwtime", in local time zone or
  * UTC, according to "universal".
@@ -528,7 +533,7 @@ set_hardware_clock_exact(const time_t sethwtime,
 {
 	time_t newhwtime = sethwtime;
 	struct timeval beginsystime, nowsystime;
-	double tdiff;
+	double tdiff, rest;
 	int time_resync = 1;
 
 	/*
@@ -562,6 +567,20 @@ set_hardware_clock_exact(const time_t sethwtime,
 		}
 		beginsystime = nowsystime;
 		tdiff = time_diff(nowsystime, refsystime);
+
+		/*
+		 * Sleep until the last millisecond before the goal and spin
+		 * only then. The sleep is in short steps to keep the time
+		 * reset detection above working.
+		 */
+		rest = newhwtime - sethwtime + 0.5 - tdiff;
+		if (rest > SETHW_SPIN_TIME) {
+			struct timespec req = { .tv_sec = 0 };
+
+			rest = min(rest - SETHW_SPIN_TIME, SETHW_SLEEP_STEP);
+			req.tv_nsec = (long) (rest * 1E9);
+			nanosleep(&req, NULL);
+		}
 	} while (newhwtime == sethwtime + (int)(tdiff + 0.5));
 
 	set_hardware_clock(newhwtime, universal, testing);
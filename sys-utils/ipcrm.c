@@ -19,10 +19,15 @@
 #include <sys/sem.h>
 #include <sys/shm.h>
 #include <sys/types.h>
+#include <unistd.h>
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
 #include "c.h"
 #include "nls.h"
 #include "strutils.h"
 #include "closestream.h"
+#include "xalloc.h"
 
 #ifndef HAVE_UNION_SEMUN
 /* according to X/OPEN we have to define it ourselves */
@@ -34,6 +39,10 @@ union semun {
 };
 #endif
 
+/* minimal number of objects removed by one thread */
+#define RM_IDS_PER_THREAD	1024
+#define RM_MAX_THREADS		8
+
 typedef enum type_id {
 	SHM,
 	SEM,
@@ -229,10 +238,81 @@ static int key_to_id(type_id type, char *optarg)
 	return id;
 }
 
+struct rm_thread {
+	type_id		type;
+	int		*ids;
+	size_t		nids;
+	size_t		first;		/* removes ids[first + n * step] */
+	size_t		step;
+	int		ret;
+};
+
+static void *remove_ids_thread(void *data)
+{
+	struct rm_thread *th = (struct rm_thread *) data;
+	size_t i;
+
+	for (i = th->first; i < th->nids; i += th->step)
+		th->ret |= remove_id(th->type, 0, th->ids[i]);
+	return NULL;
+}
+
+/* removes the objects by more threads if there is many of them */
+static int remove_ids(type_id type, int *ids, size_t nids)
+{
+	struct rm_thread one = {
+		.type = type, .ids = ids, .nids = nids, .step = 1
+	};
+#ifdef HAVE_LIBPTHREAD
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nthreads = nids / RM_IDS_PER_THREAD, i;
+
+	if (ncpus > 0 && nthreads > (size_t) ncpus)
+		nthreads = ncpus;
+	if (nthreads > RM_MAX_THREADS)
+		nthreads = RM_MAX_THREADS;
+
+	if (nthreads > 1) {
+		struct rm_thread *ths = xcalloc(nthreads, sizeof(*ths));
+		pthread_t *tids = xcalloc(nthreads, sizeof(pthread_t));
+		int ret = 0;
+
+		for (i = 0; i < nthreads; i++) {
+			ths[i] = one;
+			ths[i].first = i;
+			ths[i].step = nthreads;
+			if (pthread_create(&tids[i], NULL, remove_ids_thread, &ths[i]))
+				err(EXIT_FAILURE, _("failed to create thread"));
+		}
+		for (i = 0; i < nthreads; i++) {
+			pthread_join(tids[i], NULL);
+			ret |= ths[i].ret;
+		}
+		free(ths);
+		free(tids);
+		return ret;
+	}
+#endif
+	remove_ids_thread(&one);
+	return one.ret;
+}
+
+/* adds @id to the @ids array of @n items */
+static void add_id(int **ids, size_t *n, size_t *max, int id)
+{
+	if (*n == *max) {
+		*max = *max ? *max * 2 : 64;
+		*ids = xrealloc(*ids, *max * sizeof(int));
+	}
+	(*ids)[(*n)++] = id;
+}
+
 static int remove_all(type_id type)
 {
 	int ret = 0;
 	int id, rm_me, maxid;
+	int *ids = NULL;
+	size_t nids, maxids = 0;
 
 	struct shmid_ds shmseg;
 	struct shm_info shm_info;
@@ -244,18 +324,23 @@ static int remove_all(type_id type)
 	struct msqid_ds msgque;
 	struct msginfo msginfo;
 
+	/*
+	 * The objects are collected first and then removed (by more threads
+	 * if there are many of them).
+	 */
 	if (type == SHM || type == ALL) {
 		maxid =
 		    shmctl(0, SHM_INFO, (struct shmid_ds *)(void *)&shm_info);
 		if (maxid < 0)
 			errx(EXIT_FAILURE,
 			     _("kernel not configured for shared memory"));
-		for (id = 0; id <= maxid; id++) {
+		for (nids = 0, id = 0; id <= maxid; id++) {
 			rm_me = shmctl(id, SHM_STAT, &shmseg);
 			if (rm_me < 0)
 				continue;
-			ret |= remove_id(SHM, 0, rm_me);
+			add_id(&ids, &nids, &maxids, rm_me);
 		}
+		ret |= remove_ids(SHM, ids, nids);
 	}
 	if (type == SEM || type == ALL) {
 		arg.array = (ushort *) (void *)&seminfo;
@@ -263,13 +348,14 @@ static int remove_all(type_id type)
 		if (maxid < 0)
 			errx(EXIT_FAILURE,
 			     _("kernel not configured for semaphores"));
-		for (id = 0; id <= maxid; id++) {
+		for (nids = 0, id = 0; id <= maxid; id++) {
 			arg.buf = (struct semid_ds *)&semary;
 			rm_me = semctl(id, 0, SEM_STAT, arg);
 			if (rm_me < 0)
 				continue;
-			ret |= remove_id(SEM, 0, rm_me);
+			add_id(&ids, &nids, &maxids, rm_me);
 		}
+		ret |= remove_ids(SEM, ids, nids);
 	}
 	if (type == MSG || type == ALL) {
 		maxid =
@@ -277,13 +363,15 @@ static int remove_all(type_id type)
 		if (maxid < 0)
 			errx(EXIT_FAILURE,
 			     _("kernel not configured for message queues"));
-		for (id = 0; id <= maxid; id++) {
+		for (nids = 0, id = 0; id <= maxid; id++) {
 			rm_me = msgctl(id, MSG_STAT, &msgque);
 			if (rm_me < 0)
 				continue;
-			ret |= remove_id(MSG, 0, rm_me);
+			add_id(&ids, &nids, &maxids, rm_me);
 		}
+		ret |= remove_ids(MSG, ids, nids);
 	}
+	free(ids);
 	return ret;
 }
 
@@ -22,6 +22,7 @@
 #include "c.h"
 #include "nls.h"
 #include "closestream.h"
+#include "tt.h"
 
 #include "ipcutils.h"
 
@@ -37,12 +38,26 @@ enum {
 	OPT_HUMAN = CHAR_MAX + 1
 };
 
+/* --json output; the column names are the same as in the default output */
+static const char *shm_columns[] = {
+	"key", "shmid", "owner", "perms", "bytes", "nattch", "status"
+};
+static const char *sem_columns[] = {
+	"key", "semid", "owner", "perms", "nsems"
+};
+static const char *msg_columns[] = {
+	"key", "msqid", "owner", "perms", "used-bytes", "messages"
+};
+
 static void do_shm (char format, int unit);
 static void print_shm (int id, int unit);
 static void do_sem (char format);
 static void print_sem (int id);
 static void do_msg (char format, int unit);
 static void print_msg (int id, int unit);
+static void json_shm (void);
+static void json_sem (void);
+static void json_msg (void);
 
 /* we read time as int64_t from /proc, so cast... */
 #define xctime(_x)	ctime((time_t *) (_x))
@@ -54,6 +69,7 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 	fprintf(out, " %s [resource] -i <id>\n", program_invocation_short_name);
 	fprintf(out, USAGE_OPTIONS);
 	fputs(_(" -i, --id <id>  print details on resource identified by id\n"), out);
+	fputs(_(" -J, --json     use JSON output format\n"), out);
 	fprintf(out, USAGE_HELP);
 	fprintf(out, USAGE_VERSION);
 	fputs(_("\n"), out);
@@ -77,7 +93,7 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 
 int main (int argc, char **argv)
 {
-	int opt, msg = 0, shm = 0, sem = 0, id = 0, specific = 0;
+	int opt, msg = 0, shm = 0, sem = 0, id = 0, specific = 0, json = 0;
 	char format = NOTSPECIFIED;
 	int unit = IPC_UNIT_DEFAULT;
 	static const struct option longopts[] = {
@@ -92,12 +108,13 @@ int main (int argc, char **argv)
 		{"limits", no_argument, NULL, 'l'},
 		{"summary", no_argument, NULL, 'u'},
 		{"human", no_argument, NULL, OPT_HUMAN},
+		{"json", no_argument, NULL, 'J'},
 		{"bytes", no_argument, NULL, 'b'},
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
-	char options[] = "i:qmsatpclubVh";
+	char options[] = "i:qmsatpclubJVh";
 
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
@@ -140,6 +157,9 @@ int main (int argc, char **argv)
 		case OPT_HUMAN:
 			unit = IPC_UNIT_HUMAN;
 			break;
+		case 'J':
+			json = 1;
+			break;
 		case 'b':
 			unit = IPC_UNIT_BYTES;
 			break;
@@ -156,7 +176,20 @@ int main (int argc, char **argv)
 	if (specific && (msg + shm + sem != 1))
 		errx (EXIT_FAILURE,
 		      _("when using an ID, a single resource must be specified"));
-	if (specific) {
+	if (json && (specific || format != NOTSPECIFIED))
+		errx (EXIT_FAILURE,
+		      _("--json is supported for the default output format only"));
+	if (json && (msg + shm + sem != 1))
+		errx (EXIT_FAILURE,
+		      _("when using --json, a single resource must be specified"));
+	if (json) {
+		if (msg)
+			json_msg ();
+		if (shm)
+			json_shm ();
+		if (sem)
+			json_sem ();
+	} else if (specific) {
 		if (msg)
 			print_msg (id, unit);
 		if (shm)
@@ -550,6 +583,126 @@ static void do_msg (char format, int unit)
 	return;
 }
 
+static struct tt *new_json_table(const char *name,
+				 const char **columns, size_t ncolumns)
+{
+	struct tt *tt;
+	size_t i;
+
+	tt = tt_new_table(TT_FL_JSON);
+	if (!tt)
+		errx(EXIT_FAILURE, _("failed to initialize output table"));
+	tt_set_name(tt, name);
+
+	for (i = 0; i < ncolumns; i++) {
+		if (!tt_define_column(tt, columns[i], 0, 0))
+			errx(EXIT_FAILURE, _("failed to initialize output column"));
+	}
+	return tt;
+}
+
+static struct tt_line *add_json_line(struct tt *tt, struct ipc_stat *perm)
+{
+	struct tt_line *ln = tt_add_line(tt, NULL);
+	struct passwd *pw;
+	char buf[64];
+
+	if (!ln)
+		errx(EXIT_FAILURE, _("failed to initialize output line"));
+
+	snprintf(buf, sizeof(buf), "0x%08x", perm->key);
+	tt_line_set_data_copy(ln, 0, buf);
+	snprintf(buf, sizeof(buf), "%d", perm->id);
+	tt_line_set_data_copy(ln, 1, buf);
+	pw = getpwuid(perm->uid);
+	if (pw)
+		tt_line_set_data_copy(ln, 2, pw->pw_name);
+	else {
+		snprintf(buf, sizeof(buf), "%u", perm->uid);
+		tt_line_set_data_copy(ln, 2, buf);
+	}
+	snprintf(buf, sizeof(buf), "%o", perm->mode & 0777);
+	tt_line_set_data_copy(ln, 3, buf);
+	return ln;
+}
+
+static void set_json_u64(struct tt_line *ln, int colnum, uint64_t num)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%ju", (uintmax_t) num);
+	tt_line_set_data_copy(ln, colnum, buf);
+}
+
+static void json_shm (void)
+{
+	struct tt *tt = new_json_table("shmems", shm_columns,
+				       ARRAY_SIZE(shm_columns));
+	struct shm_data *shmds, *p;
+
+	if (ipc_shm_get_info(-1, &shmds) > 0) {
+		for (p = shmds; p->next != NULL; p = p->next) {
+			struct tt_line *ln = add_json_line(tt, &p->shm_perm);
+			const char *status = "";
+
+			set_json_u64(ln, 4, p->shm_segsz);
+			set_json_u64(ln, 5, p->shm_nattch);
+
+			if ((p->shm_perm.mode & SHM_DEST) &&
+			    (p->shm_perm.mode & SHM_LOCKED))
+				status = "dest,locked";
+			else if (p->shm_perm.mode & SHM_DEST)
+				status = "dest";
+			else if (p->shm_perm.mode & SHM_LOCKED)
+				status = "locked";
+			tt_line_set_data_copy(ln, 6, status);
+		}
+		ipc_shm_free_info(shmds);
+	}
+
+	tt_print_table(tt);
+	tt_free_table(tt);
+}
+
+static void json_sem (void)
+{
+	struct tt *tt = new_json_table("semaphores", sem_columns,
+				       ARRAY_SIZE(sem_columns));
+	struct sem_data *semds, *p;
+
+	if (ipc_sem_get_info(-1, &semds) > 0) {
+		for (p = semds; p->next != NULL; p = p->next) {
+			struct tt_line *ln = add_json_line(tt, &p->sem_perm);
+
+			set_json_u64(ln, 4, p->sem_nsems);
+		}
+		ipc_sem_free_info(semds);
+	}
+
+	tt_print_table(tt);
+	tt_free_table(tt);
+}
+
+static void json_msg (void)
+{
+	struct tt *tt = new_json_table("queues", msg_columns,
+				       ARRAY_SIZE(msg_columns));
+	struct msg_data *msgds, *p;
+
+	if (ipc_msg_get_info(-1, &msgds) > 0) {
+		for (p = msgds; p->next != NULL; p = p->next) {
+			struct tt_line *ln = add_json_line(tt, &p->msg_perm);
+
+			set_json_u64(ln, 4, p->q_cbytes);
+			set_json_u64(ln, 5, p->q_qnum);
+		}
+		ipc_msg_free_info(msgds);
+	}
+
+	tt_print_table(tt);
+	tt_free_table(tt);
+}
+
 static void print_shm(int shmid, int unit)
 {
 	struct shm_data *shmdata;
@@ -622,6 +775,8 @@ static void print_sem(int semid)
 		return;
 	}
 
+	ipc_sem_get_elements(semdata);
+
 	printf(_("\nSemaphore Array semid=%d\n"), semid);
 	printf(_("uid=%u\t gid=%u\t cuid=%u\t cgid=%u\n"),
 	       semdata->sem_perm.uid, semdata->sem_perm.uid,
@@ -213,22 +213,35 @@ void ipc_shm_free_info(struct shm_data *shmds)
 	}
 }
 
-static void get_sem_elements(struct sem_data *p)
+/*
+ * Reads the semaphore values by one GETALL call, the other per-semaphore
+ * information is not available in bulk. The elements are not read by
+ * ipc_sem_get_info(), call this function for the arrays where the elements
+ * are really necessary.
+ */
+int ipc_sem_get_elements(struct sem_data *p)
 {
+	unsigned short *vals;
+	union semun arg;
 	size_t i;
 
 	if (!p || !p->sem_nsems || p->sem_perm.id < 0)
-		return;
+		return -EINVAL;
+	if (p->elements)
+		return 0;
 
 	p->elements = xcalloc(p->sem_nsems, sizeof(struct sem_elem));
+	vals = xcalloc(p->sem_nsems, sizeof(unsigned short));
+
+	arg.array = vals;
+	if (semctl(p->sem_perm.id, 0, GETALL, arg) < 0)
+		err(EXIT_FAILURE, _("%s failed"), "semctl(GETALL)");
 
 	for (i = 0; i < p->sem_nsems; i++) {
 		struct sem_elem *e = &p->elements[i];
-		union semun arg = { .val = 0 };
 
-		e->semval = semctl(p->sem_perm.id, i, GETVAL, arg);
-		if (e->semval < 0)
-			err(EXIT_FAILURE, _("%s failed"), "semctl(GETVAL)");
+		arg.val = 0;
+		e->semval = vals[i];
 
 		e->ncount = semctl(p->sem_perm.id, i, GETNCNT, arg);
 		if (e->ncount < 0)
@@ -242,6 +255,9 @@ static void get_sem_elements(struct sem_data *p)
 		if (e->pid < 0)
 			err(EXIT_FAILURE, _("%s failed"), "semctl(GETPID)");
 	}
+
+	free(vals);
+	return 0;
 }
 
 int ipc_sem_get_info(int id, struct sem_data **semds)
@@ -280,7 +296,6 @@ int ipc_sem_get_info(int id, struct sem_data **semds)
 		if (id > -1) {
 			/* ID specified */
 			if (id == p->sem_perm.id) {
-				get_sem_elements(p);
 				i = 1;
 				break;
 			} else
@@ -339,10 +354,8 @@ int ipc_sem_get_info(int id, struct sem_data **semds)
 			p = p->next;
 			p->next = NULL;
 			i++;
-		} else {
-			get_sem_elements(p);
+		} else
 			return 1;
-		}
 	}
 
 	return i;
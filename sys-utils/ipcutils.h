@@ -162,6 +162,7 @@ struct sem_data {
 
 extern int ipc_sem_get_info(int id, struct sem_data **semds);
 extern void ipc_sem_free_info(struct sem_data *semds);
+extern int ipc_sem_get_elements(struct sem_data *p);
 
 /* See 'struct msg_queue' in kernel sources
  */
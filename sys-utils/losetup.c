@@ -255,9 +255,14 @@ static int set_tt_data(struct loopdev_cxt *lc, struct tt_line *ln)
 		}
 		case COL_MAJMIN:
 		{
+			struct sysfs_cxt *sysfs = loopcxt_get_sysfs(lc);
 			struct stat st;
 
-			if (loopcxt_get_device(lc)
+			/* the iterator initializes sysfs without stat() */
+			if (sysfs && sysfs->devno)
+				xasprintf(&np, "%3u:%-3u", major(sysfs->devno),
+							   minor(sysfs->devno));
+			else if (loopcxt_get_device(lc)
 			    && stat(loopcxt_get_device(lc), &st) == 0
 			    && S_ISBLK(st.st_mode)
 			    && major(st.st_rdev) == LOOPDEV_MAJOR)
@@ -639,6 +644,7 @@ int main(int argc, char **argv)
 	case A_CREATE:
 	{
 		int hasdev = loopcxt_has_device(&lc);
+		int ntries = 0;
 
 		if (hasdev && !is_loopdev(loopcxt_get_device(&lc)))
 			loopcxt_add_device(&lc);
@@ -666,8 +672,9 @@ int main(int argc, char **argv)
 			res = loopcxt_setup_device(&lc);
 			if (res == 0)
 				break;			/* success */
-			if (errno == EBUSY)
-				continue;
+			if (errno == EBUSY && !hasdev &&
+			    ++ntries < LOOPDEV_SETUP_MAXTRIES)
+				continue;	/* device stolen, try next one */
 
 			/* errors */
 			errpre = hasdev && loopcxt_get_fd(&lc) < 0 ?
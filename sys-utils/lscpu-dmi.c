@@ -32,6 +32,10 @@
 #include "all-io.h"
 #include "lscpu.h"
 
+#define _PATH_SYS_DMI_TABLES	"/sys/firmware/dmi/tables"
+#define _PATH_SYS_DMI_ENTRY	_PATH_SYS_DMI_TABLES "/smbios_entry_point"
+#define _PATH_SYS_DMI_TABLE	_PATH_SYS_DMI_TABLES "/DMI"
+
 #define WORD(x) (uint16_t)(*(const uint16_t *)(x))
 #define DWORD(x) (uint32_t)(*(const uint32_t *)(x))
 
@@ -106,23 +110,21 @@ static char *dmi_string(const struct dmi_header *dm, uint8_t s)
 	return bp;
 }
 
-static int hypervisor_from_dmi_table(uint32_t base, uint16_t len,
-				uint16_t num, const char *devmem)
+/*
+ * Walks the DMI structures in @buf, @num is the number of the structures or
+ * zero if unknown (SMBIOS 3.0).
+ */
+static int hypervisor_decode_dmi_table(uint8_t *buf, size_t len, uint16_t num)
 {
-	uint8_t *buf;
-	uint8_t *data;
+	uint8_t *data = buf;
 	int i = 0;
 	char *vendor = NULL;
 	char *product = NULL;
 	char *manufacturer = NULL;
 	int rc = HYPER_NONE;
 
-	data = buf = get_mem_chunk(base, len, devmem);
-	if (!buf)
-		goto done;
-
 	 /* 4 is the length of an SMBIOS structure header */
-	while (i < num && data + 4 <= buf + len) {
+	while ((!num || i < num) && data + 4 <= buf + len) {
 		uint8_t *next;
 		struct dmi_header h;
 
@@ -138,10 +140,12 @@ static int hypervisor_from_dmi_table(uint32_t base, uint16_t len,
 
 		/* look for the next handle */
 		next = data + h.length;
-		while (next - buf + 1 < len && (next[0] != 0 || next[1] != 0))
+		while ((size_t) (next - buf + 1) < len && (next[0] != 0 || next[1] != 0))
 			next++;
 		next += 2;
 		switch (h.type) {
+			case 127:	/* end of table */
+				goto decode;
 			case 0:
 				vendor = dmi_string(&h, data[0x04]);
 				break;
@@ -156,15 +160,29 @@ static int hypervisor_from_dmi_table(uint32_t base, uint16_t len,
 		data = next;
 		i++;
 	}
+decode:
 	if (manufacturer && !strcmp(manufacturer, "innotek GmbH"))
 		rc = HYPER_INNOTEK;
 	else if (manufacturer && strstr(manufacturer, "HITACHI") &&
 					product && strstr(product, "LPAR"))
 		rc = HYPER_HITACHI;
-	else if (!vendor && strcmp(vendor, "Parallels"))
+	else if (vendor && !strcmp(vendor, "Parallels"))
 		rc = HYPER_PARALLELS;
 done:
-	free(buf);
+	return rc;
+}
+
+static int hypervisor_from_dmi_table(uint32_t base, uint16_t len,
+				uint16_t num, const char *devmem)
+{
+	uint8_t *buf;
+	int rc = HYPER_NONE;
+
+	buf = get_mem_chunk(base, len, devmem);
+	if (buf) {
+		rc = hypervisor_decode_dmi_table(buf, len, num);
+		free(buf);
+	}
 	return rc;
 }
 
@@ -228,6 +246,81 @@ static int address_from_efi(size_t *address)
 	return ret;
 }
 
+/*
+ * Reads the whole sysfs file, the files are small and the DMI table is not
+ * mmap-able in sysfs. Returns the size of the data or -1.
+ */
+static ssize_t read_sysfs_file(const char *path, uint8_t **buf)
+{
+	size_t bufsz = 0x1000;
+	ssize_t len = -1;
+	int fd;
+
+	*buf = NULL;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	do {
+		uint8_t *tmp;
+
+		bufsz *= 2;
+		tmp = realloc(*buf, bufsz);
+		if (!tmp) {
+			len = -1;
+			break;
+		}
+		*buf = tmp;
+		if (lseek(fd, 0, SEEK_SET) == (off_t) -1)
+			len = -1;
+		else
+			len = read_all(fd, (char *) *buf, bufsz);
+	} while (len > 0 && (size_t) len == bufsz);
+
+	close(fd);
+	if (len <= 0) {
+		free(*buf);
+		*buf = NULL;
+		return -1;
+	}
+	return len;
+}
+
+/*
+ * Linux 4.2 and newer exports the SMBIOS entry point and the DMI table, it
+ * does not require root permissions (for /dev/mem) and the memory is not
+ * scanned for the anchors. Returns -1 if the files are not available.
+ */
+static int hypervisor_from_sysfs(void)
+{
+	uint8_t *ep = NULL, *tab = NULL;
+	ssize_t eplen, tablen;
+	uint16_t num = 0;
+	int rc = -1;
+
+	eplen = read_sysfs_file(_PATH_SYS_DMI_ENTRY, &ep);
+	if (eplen < 0)
+		goto done;
+	tablen = read_sysfs_file(_PATH_SYS_DMI_TABLE, &tab);
+	if (tablen < 0)
+		goto done;
+
+	if (eplen >= 0x20 && memcmp(ep, "_SM_", 4) == 0)
+		num = WORD(ep + 0x1C);
+	else if (eplen >= 0x18 && memcmp(ep, "_SM3_", 5) == 0)
+		num = 0;			/* terminated by type 127 */
+	else if (eplen >= 0x0F && memcmp(ep, "_DMI_", 5) == 0)
+		num = WORD(ep + 0x0C);
+	else
+		goto done;
+
+	rc = hypervisor_decode_dmi_table(tab, tablen, num);
+done:
+	free(ep);
+	free(tab);
+	return rc;
+}
+
 int read_hypervisor_dmi(void)
 {
 	int rc = HYPER_NONE;
@@ -240,6 +333,12 @@ int read_hypervisor_dmi(void)
 	    || '\0' != 0)
 		return rc;
 
+	/* First try sysfs, it's the same table as in the memory */
+	rc = hypervisor_from_sysfs();
+	if (rc >= 0)
+		return rc;
+	rc = HYPER_NONE;
+
 	/* First try EFI (ia64, Intel-based Mac) */
 	switch (address_from_efi(&fp)) {
 		case EFI_NOT_FOUND:
@@ -101,6 +101,7 @@ struct cpu_cache {
 
 	int		nsharedmaps;
 	cpu_set_t	**sharedmaps;
+	uint32_t	*sharedhashes;	/* hashes of the sharedmaps */
 };
 
 /* dispatching modes */
@@ -183,16 +184,19 @@ struct lscpu_desc {
 	 * hardware threads within the same book */
 	int		nbooks;		/* number of all online books */
 	cpu_set_t	**bookmaps;	/* unique book_siblings */
+	uint32_t	*bookhashes;
 
 	/* sockets -- based on core_siblings (internal kernel map of cpuX's
 	 * hardware threads within the same physical_package_id (socket)) */
 	int		nsockets;	/* number of all online sockets */
 	cpu_set_t	**socketmaps;	/* unique core_siblings */
+	uint32_t	*sockethashes;
 
 	/* cores -- based on thread_siblings (internel kernel map of cpuX's
 	 * hardware threads within the same core as cpuX) */
 	int		ncores;		/* number of all online cores */
 	cpu_set_t	**coremaps;	/* unique thread_siblings */
+	uint32_t	*corehashes;
 
 	int		*polarization;	/* cpu polarization */
 	int		*addresses;	/* physical cpu addresses */
@@ -668,21 +672,41 @@ read_hypervisor(struct lscpu_desc *desc, struct lscpu_modifier *mod)
 	}
 }
 
-/* add @set to the @ary, unnecessary set is deallocated. */
-static int add_cpuset_to_array(cpu_set_t **ary, int *items, cpu_set_t *set)
+/* FNV-1a hash of the CPU set */
+static uint32_t cpuset_hash(cpu_set_t *set, size_t setsize)
+{
+	const unsigned char *p = (const unsigned char *) set;
+	uint32_t h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < setsize; i++) {
+		h ^= p[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+ * Add @set to the @ary, unnecessary set is deallocated. The @hashes are used
+ * to avoid comparison of the whole sets (the kernel masks are large).
+ */
+static int add_cpuset_to_array(cpu_set_t **ary, uint32_t *hashes,
+			       int *items, cpu_set_t *set)
 {
 	int i;
 	size_t setsize = CPU_ALLOC_SIZE(maxcpus);
+	uint32_t h = cpuset_hash(set, setsize);
 
 	if (!ary)
 		return -1;
 
 	for (i = 0; i < *items; i++) {
-		if (CPU_EQUAL_S(setsize, set, ary[i]))
+		if (hashes[i] == h && CPU_EQUAL_S(setsize, set, ary[i]))
 			break;
 	}
 	if (i == *items) {
 		ary[*items] = set;
+		hashes[*items] = h;
 		++*items;
 		return 0;
 	}
@@ -691,22 +715,18 @@ static int add_cpuset_to_array(cpu_set_t **ary, int *items, cpu_set_t *set)
 }
 
 static void
-read_topology(struct lscpu_desc *desc, int idx)
+read_topology(struct lscpu_desc *desc, struct path_cxt *pc)
 {
 	cpu_set_t *thread_siblings, *core_siblings, *book_siblings;
-	int num = real_cpu_num(desc, idx);
 
-	if (!path_exist(_PATH_SYS_CPU "/cpu%d/topology/thread_siblings", num))
+	thread_siblings = path_read_cpusetat(pc, maxcpus, "topology/thread_siblings");
+	if (!thread_siblings)
 		return;
-
-	thread_siblings = path_read_cpuset(maxcpus, _PATH_SYS_CPU
-					"/cpu%d/topology/thread_siblings", num);
-	core_siblings = path_read_cpuset(maxcpus, _PATH_SYS_CPU
-					"/cpu%d/topology/core_siblings", num);
-	book_siblings = NULL;
-	if (path_exist(_PATH_SYS_CPU "/cpu%d/topology/book_siblings", num))
-		book_siblings = path_read_cpuset(maxcpus, _PATH_SYS_CPU
-					    "/cpu%d/topology/book_siblings", num);
+	core_siblings = path_read_cpusetat(pc, maxcpus, "topology/core_siblings");
+	if (!core_siblings)
+		errx(EXIT_FAILURE, _("cannot read %s/topology/core_siblings"),
+				pc->dir_path);
+	book_siblings = path_read_cpusetat(pc, maxcpus, "topology/book_siblings");
 
 	if (!desc->coremaps) {
 		int nbooks, nsockets, ncores, nthreads;
@@ -749,30 +769,35 @@ read_topology(struct lscpu_desc *desc, int idx)
 		 * have multiple sockets of different sizes.
 		 */
 		desc->coremaps = xcalloc(desc->ncpuspos, sizeof(cpu_set_t *));
+		desc->corehashes = xcalloc(desc->ncpuspos, sizeof(uint32_t));
 		desc->socketmaps = xcalloc(desc->ncpuspos, sizeof(cpu_set_t *));
-		if (book_siblings)
+		desc->sockethashes = xcalloc(desc->ncpuspos, sizeof(uint32_t));
+		if (book_siblings) {
 			desc->bookmaps = xcalloc(desc->ncpuspos, sizeof(cpu_set_t *));
+			desc->bookhashes = xcalloc(desc->ncpuspos, sizeof(uint32_t));
+		}
 	}
 
-	add_cpuset_to_array(desc->socketmaps, &desc->nsockets, core_siblings);
-	add_cpuset_to_array(desc->coremaps, &desc->ncores, thread_siblings);
+	add_cpuset_to_array(desc->socketmaps, desc->sockethashes,
+			    &desc->nsockets, core_siblings);
+	add_cpuset_to_array(desc->coremaps, desc->corehashes,
+			    &desc->ncores, thread_siblings);
 	if (book_siblings)
-		add_cpuset_to_array(desc->bookmaps, &desc->nbooks, book_siblings);
+		add_cpuset_to_array(desc->bookmaps, desc->bookhashes,
+				    &desc->nbooks, book_siblings);
 }
 
 static void
-read_polarization(struct lscpu_desc *desc, int idx)
+read_polarization(struct lscpu_desc *desc, struct path_cxt *pc, int idx)
 {
 	char mode[64];
-	int num = real_cpu_num(desc, idx);
 
 	if (desc->dispatching < 0)
 		return;
-	if (!path_exist(_PATH_SYS_CPU "/cpu%d/polarization", num))
+	if (path_read_strat(pc, mode, sizeof(mode), "polarization") != 0)
 		return;
 	if (!desc->polarization)
 		desc->polarization = xcalloc(desc->ncpuspos, sizeof(int));
-	path_read_str(mode, sizeof(mode), _PATH_SYS_CPU "/cpu%d/polarization", num);
 	if (strncmp(mode, "vertical:low", sizeof(mode)) == 0)
 		desc->polarization[idx] = POLAR_VLOW;
 	else if (strncmp(mode, "vertical:medium", sizeof(mode)) == 0)
@@ -786,55 +811,51 @@ read_polarization(struct lscpu_desc *desc, int idx)
 }
 
 static void
-read_address(struct lscpu_desc *desc, int idx)
+read_address(struct lscpu_desc *desc, struct path_cxt *pc, int idx)
 {
-	int num = real_cpu_num(desc, idx);
+	int addr;
 
-	if (!path_exist(_PATH_SYS_CPU "/cpu%d/address", num))
+	if (path_read_s32at(pc, &addr, "address") != 0)
 		return;
 	if (!desc->addresses)
 		desc->addresses = xcalloc(desc->ncpuspos, sizeof(int));
-	desc->addresses[idx] = path_read_s32(_PATH_SYS_CPU "/cpu%d/address", num);
+	desc->addresses[idx] = addr;
 }
 
 static void
-read_configured(struct lscpu_desc *desc, int idx)
+read_configured(struct lscpu_desc *desc, struct path_cxt *pc, int idx)
 {
-	int num = real_cpu_num(desc, idx);
+	int conf;
 
-	if (!path_exist(_PATH_SYS_CPU "/cpu%d/configure", num))
+	if (path_read_s32at(pc, &conf, "configure") != 0)
 		return;
 	if (!desc->configured)
 		desc->configured = xcalloc(desc->ncpuspos, sizeof(int));
-	desc->configured[idx] = path_read_s32(_PATH_SYS_CPU "/cpu%d/configure", num);
+	desc->configured[idx] = conf;
 }
 
 static void
-read_max_mhz(struct lscpu_desc *desc, int idx)
+read_max_mhz(struct lscpu_desc *desc, struct path_cxt *pc, int idx)
 {
-	int num = real_cpu_num(desc, idx);
+	int freq;
 
-	if (!path_exist(_PATH_SYS_CPU "/cpu%d/cpufreq/cpuinfo_max_freq", num))
+	if (path_read_s32at(pc, &freq, "cpufreq/cpuinfo_max_freq") != 0)
 		return;
 	if (!desc->maxmhz)
 		desc->maxmhz = xcalloc(desc->ncpuspos, sizeof(char *));
-	xasprintf(&(desc->maxmhz[idx]), "%.4f",
-		  (float)path_read_s32(_PATH_SYS_CPU
-				       "/cpu%d/cpufreq/cpuinfo_max_freq", num) / 1000);
+	xasprintf(&(desc->maxmhz[idx]), "%.4f", (float) freq / 1000);
 }
 
 static void
-read_min_mhz(struct lscpu_desc *desc, int idx)
+read_min_mhz(struct lscpu_desc *desc, struct path_cxt *pc, int idx)
 {
-	int num = real_cpu_num(desc, idx);
+	int freq;
 
-	if (!path_exist(_PATH_SYS_CPU "/cpu%d/cpufreq/cpuinfo_min_freq", num))
+	if (path_read_s32at(pc, &freq, "cpufreq/cpuinfo_min_freq") != 0)
 		return;
 	if (!desc->minmhz)
 		desc->minmhz = xcalloc(desc->ncpuspos, sizeof(char *));
-	xasprintf(&(desc->minmhz[idx]), "%.4f",
-		  (float)path_read_s32(_PATH_SYS_CPU
-				       "/cpu%d/cpufreq/cpuinfo_min_freq", num) / 1000);
+	xasprintf(&(desc->minmhz[idx]), "%.4f", (float) freq / 1000);
 }
 
 static int
@@ -847,15 +868,13 @@ cachecmp(const void *a, const void *b)
 }
 
 static void
-read_cache(struct lscpu_desc *desc, int idx)
+read_cache(struct lscpu_desc *desc, struct path_cxt *pc)
 {
 	char buf[256];
 	int i;
-	int num = real_cpu_num(desc, idx);
 
 	if (!desc->ncaches) {
-		while(path_exist(_PATH_SYS_SYSTEM "/cpu/cpu%d/cache/index%d",
-					num, desc->ncaches))
+		while (path_existat(pc, "cache/index%d", desc->ncaches))
 			desc->ncaches++;
 
 		if (!desc->ncaches)
@@ -867,16 +886,16 @@ read_cache(struct lscpu_desc *desc, int idx)
 		struct cpu_cache *ca = &desc->caches[i];
 		cpu_set_t *map;
 
-		if (!path_exist(_PATH_SYS_SYSTEM "/cpu/cpu%d/cache/index%d",
-				num, i))
+		if (!path_existat(pc, "cache/index%d", i))
 			continue;
 		if (!ca->name) {
 			int type, level;
 
 			/* cache type */
-			path_read_str(buf, sizeof(buf),
-					_PATH_SYS_CPU "/cpu%d/cache/index%d/type",
-					num, i);
+			if (path_read_strat(pc, buf, sizeof(buf),
+					    "cache/index%d/type", i) != 0)
+				err(EXIT_FAILURE, _("cannot read %s/cache/index%d/type"),
+						pc->dir_path, i);
 			if (!strcmp(buf, "Data"))
 				type = 'd';
 			else if (!strcmp(buf, "Instruction"))
@@ -885,8 +904,9 @@ read_cache(struct lscpu_desc *desc, int idx)
 				type = 0;
 
 			/* cache level */
-			level = path_read_s32(_PATH_SYS_CPU "/cpu%d/cache/index%d/level",
-					num, i);
+			if (path_read_s32at(pc, &level, "cache/index%d/level", i) != 0)
+				err(EXIT_FAILURE, _("cannot read %s/cache/index%d/level"),
+						pc->dir_path, i);
 			if (type)
 				snprintf(buf, sizeof(buf), "L%d%c", level, type);
 			else
@@ -895,20 +915,26 @@ read_cache(struct lscpu_desc *desc, int idx)
 			ca->name = xstrdup(buf);
 
 			/* cache size */
-			path_read_str(buf, sizeof(buf),
-					_PATH_SYS_CPU "/cpu%d/cache/index%d/size",
-					num, i);
+			if (path_read_strat(pc, buf, sizeof(buf),
+					    "cache/index%d/size", i) != 0)
+				err(EXIT_FAILURE, _("cannot read %s/cache/index%d/size"),
+						pc->dir_path, i);
 			ca->size = xstrdup(buf);
 		}
 
 		/* information about how CPUs share different caches */
-		map = path_read_cpuset(maxcpus,
-				  _PATH_SYS_CPU "/cpu%d/cache/index%d/shared_cpu_map",
-				  num, i);
+		map = path_read_cpusetat(pc, maxcpus,
+				"cache/index%d/shared_cpu_map", i);
+		if (!map)
+			err(EXIT_FAILURE, _("cannot read %s/cache/index%d/shared_cpu_map"),
+					pc->dir_path, i);
 
-		if (!ca->sharedmaps)
+		if (!ca->sharedmaps) {
 			ca->sharedmaps = xcalloc(desc->ncpuspos, sizeof(cpu_set_t *));
-		add_cpuset_to_array(ca->sharedmaps, &ca->nsharedmaps, map);
+			ca->sharedhashes = xcalloc(desc->ncpuspos, sizeof(uint32_t));
+		}
+		add_cpuset_to_array(ca->sharedmaps, ca->sharedhashes,
+				    &ca->nsharedmaps, map);
 	}
 }
 
@@ -1513,13 +1539,22 @@ int main(int argc, char *argv[])
 	read_basicinfo(desc, mod);
 
 	for (i = 0; i < desc->ncpuspos; i++) {
-		read_topology(desc, i);
-		read_cache(desc, i);
-		read_polarization(desc, i);
-		read_address(desc, i);
-		read_configured(desc, i);
-		read_max_mhz(desc, i);
-		read_min_mhz(desc, i);
+		struct path_cxt pc = UL_PATHCXT_EMPTY;
+
+		/* all the attributes are read relative to the cpuN directory */
+		if (path_init_cxt(&pc, _PATH_SYS_CPU "/cpu%d",
+				  real_cpu_num(desc, i)) != 0)
+			continue;
+
+		read_topology(desc, &pc);
+		read_cache(desc, &pc);
+		read_polarization(desc, &pc, i);
+		read_address(desc, &pc, i);
+		read_configured(desc, &pc, i);
+		read_max_mhz(desc, &pc, i);
+		read_min_mhz(desc, &pc, i);
+
+		path_deinit_cxt(&pc);
 	}
 
 	if (desc->caches)
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <stdarg.h>
 #include <libmount.h>
 #include <ctype.h>
@@ -167,6 +168,21 @@ static void print_all(struct libmnt_context *cxt, char *pattern, int show_label)
 	mnt_free_iter(itr);
 }
 
+/*
+ * mount -a -F -v, called when a child finished
+ */
+static void fork_child_cb(struct libmnt_context *cxt __attribute__((__unused__)),
+			  struct libmnt_fs *fs, int status)
+{
+	const char *tgt = mnt_fs_get_target(fs);
+
+	if (status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		printf(_("%-25s: successfully mounted\n"), tgt);
+	else
+		printf(_("%-25s: mount failed\n"), tgt);
+	fflush(stdout);
+}
+
 /*
  * mount -a [-F]
  */
@@ -184,6 +200,9 @@ static int mount_all(struct libmnt_context *cxt)
 		return MOUNT_EX_SYSERR;
 	}
 
+	if (mnt_context_is_fork(cxt) && mnt_context_is_verbose(cxt))
+		mnt_context_set_child_cb(cxt, fork_child_cb);
+
 	while (mnt_context_next_mount(cxt, itr, &fs, &mntrc, &ignored) == 0) {
 
 		const char *tgt = mnt_fs_get_target(fs);
@@ -207,6 +226,10 @@ static int mount_all(struct libmnt_context *cxt)
 			} else
 				nerrs++;
 		}
+
+		/* don't duplicate unwritten output in the next child */
+		if (mnt_context_is_fork(cxt))
+			fflush(stdout);
 	}
 
 	if (mnt_context_is_parent(cxt)) {
@@ -707,6 +730,7 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	" -c, --no-canonicalize   don't canonicalize paths\n"
 	" -f, --fake              dry run; skip the mount(2) syscall\n"
 	" -F, --fork              fork off for each device (use with -a)\n"
+	"     --fork-limit <num>  maximal number of running children (use with -F)\n"
 	" -T, --fstab <path>      alternative file to /etc/fstab\n"));
 	fprintf(out, _(
 	" -h, --help              display this help text and exit\n"
@@ -785,7 +809,8 @@ int main(int argc, char **argv)
 		MOUNT_OPT_RPRIVATE,
 		MOUNT_OPT_RUNBINDABLE,
 		MOUNT_OPT_TARGET,
-		MOUNT_OPT_SOURCE
+		MOUNT_OPT_SOURCE,
+		MOUNT_OPT_FORK_LIMIT
 	};
 
 	static const struct option longopts[] = {
@@ -793,6 +818,7 @@ int main(int argc, char **argv)
 		{ "fake", 0, 0, 'f' },
 		{ "fstab", 1, 0, 'T' },
 		{ "fork", 0, 0, 'F' },
+		{ "fork-limit", 1, 0, MOUNT_OPT_FORK_LIMIT },
 		{ "help", 0, 0, 'h' },
 		{ "no-mtab", 0, 0, 'n' },
 		{ "read-only", 0, 0, 'r' },
@@ -871,6 +897,10 @@ int main(int argc, char **argv)
 		case 'F':
 			mnt_context_enable_fork(cxt, TRUE);
 			break;
+		case MOUNT_OPT_FORK_LIMIT:
+			mnt_context_set_fork_limit(cxt, strtou32_or_err(optarg,
+					_("failed to parse fork limit")));
+			break;
 		case 'h':
 			usage(stdout);
 			break;
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -95,6 +96,39 @@ static int dir_to_device(const char *spec, dev_t *dev)
 	return rc;
 }
 
+/*
+ * Compares mount IDs of the directory and its parent, /proc/self/mountinfo
+ * is not used at all. The directory is a mountpoint also if it's the same as
+ * its parent (root directory).
+ *
+ * Returns: 1 for mountpoint, 0 if not, -1 if the mount ID is not available
+ *          (old kernel or libc) and the caller has to use mountinfo.
+ */
+static int dir_is_mountpoint(const char *spec)
+{
+#ifdef HAVE_STRUCT_STATX_STX_MNT_ID
+	struct statx st, pst;
+	unsigned int mask = STATX_MNT_ID | STATX_INO;
+	int fd, rc = -1;
+
+	fd = open(spec, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (statx(fd, "", AT_EMPTY_PATH | AT_NO_AUTOMOUNT, mask, &st) == 0 &&
+	    statx(fd, "..", AT_NO_AUTOMOUNT, mask, &pst) == 0 &&
+	    (st.stx_mask & STATX_MNT_ID) && (pst.stx_mask & STATX_MNT_ID))
+		rc = st.stx_mnt_id != pst.stx_mnt_id ||
+		     st.stx_ino == pst.stx_ino;
+
+	close(fd);
+	return rc;
+#else
+	(void) spec;
+	return -1;
+#endif
+}
+
 static int print_devno(const char *devname, struct stat *st)
 {
 	struct stat stbuf;
@@ -198,7 +232,11 @@ int main(int argc, char **argv)
 			return EXIT_FAILURE;
 		}
 
-		if ( dir_to_device(spec, &src)) {
+		if (!fs_devno)
+			rc = dir_is_mountpoint(spec);
+		if (fs_devno || rc < 0)
+			rc = dir_to_device(spec, &src) == 0;
+		if (!rc) {
 			if (!quiet)
 				printf(_("%s is not a mountpoint\n"), spec);
 			return EXIT_FAILURE;
@@ -207,6 +245,7 @@ int main(int argc, char **argv)
 			printf("%u:%u\n", major(src), minor(src));
 		else if (!quiet)
 			printf(_("%s is a mountpoint\n"), spec);
+		rc = 0;
 	}
 
 	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
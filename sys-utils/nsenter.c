@@ -26,6 +26,8 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <paths.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -77,6 +79,7 @@ static void usage(int status)
 	fputs(_(" -r, --root  [=<dir>]   set the root directory\n"), out);
 	fputs(_(" -w, --wd    [=<dir>]   set the working directory\n"), out);
 	fputs(_(" -F, --no-fork          do not fork before exec'ing <program>\n"), out);
+	fputs(_(" -b, --batch            run commands from stdin in the namespaces\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	fputs(USAGE_HELP, out);
@@ -159,6 +162,67 @@ static void continue_as_child(void)
 	exit(EXIT_FAILURE);
 }
 
+/*
+ * Runs commands from stdin (one per line) by the shell. The namespaces are
+ * already entered, so every command costs only fork() and exec(). Returns the
+ * exit code of the first failed command.
+ */
+static int run_batch(void)
+{
+	const char *shell = getenv("SHELL");
+	char *line = NULL;
+	size_t sz = 0;
+	ssize_t len;
+	int rc = EXIT_SUCCESS;
+
+	if (!shell || !*shell)
+		shell = _PATH_BSHELL;
+
+	while ((len = getline(&line, &sz, stdin)) != -1) {
+		int status, st;
+		pid_t child, ret;
+
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (!*skip_space(line))
+			continue;
+
+		child = fork();
+		if (child < 0)
+			err(EXIT_FAILURE, _("fork failed"));
+		if (child == 0) {
+			/* don't steal commands from the batch */
+			int fd = open("/dev/null", O_RDONLY);
+
+			if (fd >= 0 && fd != STDIN_FILENO) {
+				dup2(fd, STDIN_FILENO);
+				close(fd);
+			}
+			execl(shell, shell, "-c", line, (char *) NULL);
+			warn(_("failed to execute %s"), shell);
+			_exit(EXIT_FAILURE);
+		}
+
+		do {
+			ret = waitpid(child, &status, 0);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret == -1)
+			err(EXIT_FAILURE, _("waitpid failed"));
+		if (WIFEXITED(status))
+			st = WEXITSTATUS(status);
+		else if (WIFSIGNALED(status))
+			st = WTERMSIG(status) + 128;
+		else
+			st = EXIT_FAILURE;
+		if (st && rc == EXIT_SUCCESS)
+			rc = st;
+	}
+
+	free(line);
+	return rc;
+}
+
 int main(int argc, char *argv[])
 {
 	static const struct option longopts[] = {
@@ -176,12 +240,13 @@ int main(int argc, char *argv[])
 		{ "root", optional_argument, NULL, 'r' },
 		{ "wd", optional_argument, NULL, 'w' },
 		{ "no-fork", no_argument, NULL, 'F' },
+		{ "batch", no_argument, NULL, 'b' },
 		{ NULL, 0, NULL, 0 }
 	};
 
 	struct namespace_file *nsfile;
 	int c, namespaces = 0;
-	bool do_rd = false, do_wd = false;
+	bool do_rd = false, do_wd = false, batch = false;
 	int do_fork = -1; /* unknown yet */
 	uid_t uid = 0;
 	gid_t gid = 0;
@@ -192,7 +257,7 @@ int main(int argc, char *argv[])
 	atexit(close_stdout);
 
 	while ((c =
-		getopt_long(argc, argv, "hVt:m::u::i::n::p::U::S:G:r::w::F",
+		getopt_long(argc, argv, "hVt:m::u::i::n::p::U::S:G:r::w::Fb",
 			    longopts, NULL)) != -1) {
 		switch (c) {
 		case 'h':
@@ -249,6 +314,9 @@ int main(int argc, char *argv[])
 		case 'F':
 			do_fork = 0;
 			break;
+		case 'b':
+			batch = true;
+			break;
 		case 'r':
 			if (optarg)
 				open_target_fd(&root_fd, "root", optarg);
@@ -266,6 +334,9 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (batch && optind < argc)
+		errx(EXIT_FAILURE, _("--batch and <program> are mutually exclusive"));
+
 	/*
 	 * Open remaining namespace and directory descriptors.
 	 */
@@ -324,7 +395,8 @@ int main(int argc, char *argv[])
 		wd_fd = -1;
 	}
 
-	if (do_fork == 1)
+	/* the batch commands are forked, so they are in the PID namespace */
+	if (do_fork == 1 && !batch)
 		continue_as_child();
 
 	if (namespaces & CLONE_NEWUSER) {
@@ -334,6 +406,9 @@ int main(int argc, char *argv[])
 			err(EXIT_FAILURE, _("setgid failed"));
 	}
 
+	if (batch)
+		return run_batch();
+
 	if (optind < argc) {
 		execvp(argv[optind], argv + optind);
 		err(EXIT_FAILURE, _("failed to execute %s"), argv[optind]);
@@ -34,6 +34,7 @@
 #include "strutils.h"
 #include "list.h"
 #include "closestream.h"
+#include "procutils.h"
 
 #ifndef RLIMIT_RTTIME
 # define RLIMIT_RTTIME 15
@@ -101,6 +102,7 @@ enum {
 	COL_SOFT,
 	COL_HARD,
 	COL_UNITS,
+	COL_PID,
 };
 
 /* column names */
@@ -118,6 +120,7 @@ struct colinfo infos[] = {
 	[COL_SOFT]    = { "SOFT",        0.1,  TT_FL_RIGHT, N_("soft limit")},
 	[COL_HARD]    = { "HARD",        1,    TT_FL_RIGHT, N_("hard limit (ceiling)")},
 	[COL_UNITS]   = { "UNITS",       0.1,  TT_FL_TRUNC, N_("units")},
+	[COL_PID]     = { "PID",         5,    TT_FL_RIGHT, N_("process ID")},
 };
 
 #define NCOLS ARRAY_SIZE(infos)
@@ -134,6 +137,10 @@ static int columns[NCOLS], ncolumns;
 static pid_t pid; /* calling process (default) */
 static int verbose;
 
+/* more processes (--pid more than once, --tree, --pgid or --cgroup) */
+static pid_t *pids;
+static size_t npids, pids_alloc;
+
 #ifndef HAVE_PRLIMIT
 # include <sys/syscall.h>
 static int prlimit(pid_t p, int resource,
@@ -157,6 +164,9 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 
 	fputs(_("\nGeneral Options:\n"), out);
 	fputs(_(" -p, --pid <pid>        process id\n"
+		"     --tree <pid>       the process and all its descendants\n"
+		"     --pgid <pgid>      all processes in the process group\n"
+		"     --cgroup <dir>     all processes in the cgroup directory\n"
 		" -o, --output <list>    define which output columns to use\n"
 		"     --noheadings       don't print headings\n"
 		"     --raw              use the raw output format\n"
@@ -207,7 +217,7 @@ static inline struct colinfo *get_column_info(unsigned num)
 	return &infos[ get_column_id(num) ];
 }
 
-static void add_tt_line(struct tt *tt, struct prlimit *l)
+static void add_tt_line(struct tt *tt, struct prlimit *l, pid_t p)
 {
 	int i;
 	struct tt_line *line;
@@ -246,6 +256,9 @@ static void add_tt_line(struct tt *tt, struct prlimit *l)
 		case COL_UNITS:
 			str = l->desc->unit ? xstrdup(_(l->desc->unit)) : NULL;
 			break;
+		case COL_PID:
+			xasprintf(&str, "%d", p ? p : getpid());
+			break;
 		default:
 			break;
 		}
@@ -304,7 +317,7 @@ static int show_limits(struct list_head *lims, int tt_flags)
 	list_for_each_safe(p, pnext, lims) {
 		struct prlimit *lim = list_entry(p, struct prlimit, lims);
 
-		add_tt_line(tt, lim);
+		add_tt_line(tt, lim, pid);
 		rem_prlim(lim);
 	}
 
@@ -378,6 +391,216 @@ static void do_prlimit(struct list_head *lims)
 	}
 }
 
+static void add_pid(pid_t p)
+{
+	if (npids == pids_alloc) {
+		pids_alloc = pids_alloc ? pids_alloc * 2 : 64;
+		pids = xrealloc(pids, pids_alloc * sizeof(pid_t));
+	}
+	pids[npids++] = p;
+}
+
+static int cmp_pids(const void *a, const void *b)
+{
+	pid_t x = *(const pid_t *) a, y = *(const pid_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int cmp_ents_ppid(const void *a, const void *b)
+{
+	const struct proc_entry *x = *(const struct proc_entry **) a,
+				*y = *(const struct proc_entry **) b;
+
+	return x->ppid < y->ppid ? -1 : x->ppid > y->ppid;
+}
+
+/* adds @top and all its descendants */
+static void add_tree_pids(struct proc_snapshot *snap, pid_t top)
+{
+	struct proc_entry **byppid;
+	size_t i, n = npids;
+
+	if (!proc_snapshot_get_pid(snap, top))
+		errx(EXIT_FAILURE, _("process %d not found"), top);
+
+	byppid = xmalloc(snap->nents * sizeof(struct proc_entry *));
+	for (i = 0; i < snap->nents; i++)
+		byppid[i] = &snap->ents[i];
+	qsort(byppid, snap->nents, sizeof(struct proc_entry *), cmp_ents_ppid);
+
+	/* breadth-first, the children are appended to the array */
+	add_pid(top);
+	for (; n < npids; n++) {
+		size_t lo = 0, hi = snap->nents;
+
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+
+			if (byppid[mid]->ppid < pids[n])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for (i = lo; i < snap->nents && byppid[i]->ppid == pids[n]; i++)
+			add_pid(byppid[i]->pid);
+	}
+	free(byppid);
+}
+
+static void add_pgid_pids(struct proc_snapshot *snap, pid_t pgid)
+{
+	size_t i, n = npids;
+
+	for (i = 0; i < snap->nents; i++) {
+		if (getpgid(snap->ents[i].pid) == pgid)
+			add_pid(snap->ents[i].pid);
+	}
+	if (n == npids)
+		errx(EXIT_FAILURE, _("no process in process group %d"), pgid);
+}
+
+static void add_cgroup_pids(const char *dir)
+{
+	char path[PATH_MAX];
+	FILE *f;
+	int p;
+
+	snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+	f = fopen(path, "r" UL_CLOEXECSTR);
+	if (!f)
+		err(EXIT_FAILURE, _("cannot open %s"), path);
+
+	while (fscanf(f, "%d", &p) == 1)
+		add_pid(p);
+
+	if (ferror(f))
+		err(EXIT_FAILURE, _("cannot read %s"), path);
+	fclose(f);
+}
+
+/*
+ * Sets the limit for process @p. The current limit is read only if one of
+ * the soft and hard limits is not specified.
+ */
+static int set_pid_limit(pid_t p, struct prlimit *lim)
+{
+	struct rlimit new = lim->rlim;
+
+	if (lim->modify != (PRLIMIT_HARD | PRLIMIT_SOFT)) {
+		struct rlimit old;
+
+		if (prlimit(p, lim->desc->resource, NULL, &old) == -1)
+			return -errno;
+		if (!(lim->modify & PRLIMIT_SOFT))
+			new.rlim_cur = old.rlim_cur;
+		else
+			new.rlim_max = old.rlim_max;
+	}
+	if (prlimit(p, lim->desc->resource, &new, NULL) == -1)
+		return -errno;
+	return 0;
+}
+
+/*
+ * The same as do_prlimit() and show_limits() for more processes. The limits
+ * are set for all the processes and the errors are reported by one warning,
+ * the processes which exit in the meantime are ignored.
+ */
+static int do_prlimit_pids(struct list_head *lims, int tt_flags)
+{
+	struct list_head *p, *pnext;
+	size_t i, nsets = 0, nfails = 0, ngone = 0;
+	pid_t err_pid = 0;
+	int err_errno = 0, nquery = 0;
+
+	list_for_each(p, lims) {
+		struct prlimit *lim = list_entry(p, struct prlimit, lims);
+
+		if (lim->modify == (PRLIMIT_HARD | PRLIMIT_SOFT) &&
+		    (lim->rlim.rlim_cur > lim->rlim.rlim_max) &&
+		    (lim->rlim.rlim_cur != RLIM_INFINITY ||
+		     lim->rlim.rlim_max != RLIM_INFINITY))
+			errx(EXIT_FAILURE, _("the soft limit %s cannot exceed the hard limit"),
+					lim->desc->name);
+		if (!lim->modify)
+			nquery++;
+	}
+
+	for (i = 0; i < npids; i++) {
+		list_for_each(p, lims) {
+			struct prlimit *lim = list_entry(p, struct prlimit, lims);
+			int rc;
+
+			if (!lim->modify)
+				continue;
+			rc = set_pid_limit(pids[i], lim);
+			if (rc == -ESRCH) {
+				ngone++;
+				break;
+			}
+			if (rc) {
+				if (!nfails++) {
+					err_pid = pids[i];
+					err_errno = -rc;
+				}
+			} else
+				nsets++;
+		}
+	}
+
+	if (verbose && (nsets || nfails))
+		printf(P_("%zu limit set for %zu processes (%zu exited)\n",
+			  "%zu limits set for %zu processes (%zu exited)\n",
+			  nsets), nsets, npids, ngone);
+	if (nfails) {
+		errno = err_errno;
+		warn(P_("failed to set %zu resource limit (of %zu), pid %d",
+			"failed to set %zu resource limits (of %zu), the first pid %d",
+			nfails), nfails, nsets + nfails, err_pid);
+	}
+
+	if (nquery) {
+		struct tt *tt = tt_new_table(tt_flags | TT_FL_FREEDATA);
+
+		if (!tt)
+			err(EXIT_FAILURE, _("failed to initialize output table"));
+
+		for (i = 0; i < (size_t) ncolumns; i++) {
+			struct colinfo *col = get_column_info(i);
+
+			if (!tt_define_column(tt, col->name, col->whint, col->flags))
+				errx(EXIT_FAILURE, _("failed to initialize output column"));
+		}
+
+		for (i = 0; i < npids; i++) {
+			list_for_each(p, lims) {
+				struct prlimit *lim = list_entry(p, struct prlimit, lims);
+
+				if (lim->modify)
+					continue;
+				if (prlimit(pids[i], lim->desc->resource,
+					    NULL, &lim->rlim) == -1) {
+					if (errno == ESRCH)
+						break;
+					warn(_("failed to get the %s resource limit of %d"),
+							lim->desc->name, pids[i]);
+					nfails++;
+					continue;
+				}
+				add_tt_line(tt, lim, pids[i]);
+			}
+		}
+		tt_print_table(tt);
+		tt_free_table(tt);
+	}
+
+	list_for_each_safe(p, pnext, lims)
+		rem_prlim(list_entry(p, struct prlimit, lims));
+
+	return nfails ? -1 : 0;
+}
+
 static int get_range(char *str, rlim_t *soft, rlim_t *hard, int *found)
 {
 	char *end = NULL;
@@ -478,8 +701,15 @@ int main(int argc, char **argv)
 	enum {
 		VERBOSE_OPTION = CHAR_MAX + 1,
 		RAW_OPTION,
-		NOHEADINGS_OPTION
+		NOHEADINGS_OPTION,
+		TREE_OPTION,
+		PGID_OPTION,
+		CGROUP_OPTION
 	};
+	pid_t tree = 0, pgid = 0;
+	const char *cgroup = NULL;
+	size_t i;
+	int rc;
 
 	static const struct option longopts[] = {
 		{ "pid",	required_argument, NULL, 'p' },
@@ -505,6 +735,9 @@ int main(int argc, char **argv)
 		{ "noheadings", no_argument, NULL, NOHEADINGS_OPTION },
 		{ "raw",        no_argument, NULL, RAW_OPTION },
 		{ "verbose",    no_argument, NULL, VERBOSE_OPTION },
+		{ "tree",       required_argument, NULL, TREE_OPTION },
+		{ "pgid",       required_argument, NULL, PGID_OPTION },
+		{ "cgroup",     required_argument, NULL, CGROUP_OPTION },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -575,9 +808,22 @@ int main(int argc, char **argv)
 			break;
 
 		case 'p':
-			if (pid)
-				errx(EXIT_FAILURE, _("option --pid may be specified only once"));
-			pid = strtos32_or_err(optarg, _("invalid PID argument"));
+			add_pid(strtos32_or_err(optarg, _("invalid PID argument")));
+			break;
+		case TREE_OPTION:
+			if (tree)
+				errx(EXIT_FAILURE, _("option --tree may be specified only once"));
+			tree = strtos32_or_err(optarg, _("invalid PID argument"));
+			break;
+		case PGID_OPTION:
+			if (pgid)
+				errx(EXIT_FAILURE, _("option --pgid may be specified only once"));
+			pgid = strtos32_or_err(optarg, _("invalid PGID argument"));
+			break;
+		case CGROUP_OPTION:
+			if (cgroup)
+				errx(EXIT_FAILURE, _("option --cgroup may be specified only once"));
+			cgroup = optarg;
 			break;
 		case 'h':
 			usage(stdout);
@@ -606,9 +852,45 @@ int main(int argc, char **argv)
 			usage(stderr);
 		}
 	}
-	if (argc > optind && pid)
+	if (argc > optind && (npids || tree || pgid || cgroup))
 		errx(EXIT_FAILURE, _("options --pid and COMMAND are mutually exclusive"));
-	if (!ncolumns) {
+
+	if (tree || pgid) {
+		struct proc_snapshot snap;
+
+		if (proc_snapshot_read(&snap, 0) != 0)
+			err(EXIT_FAILURE, _("cannot read %s"), "/proc");
+		if (tree)
+			add_tree_pids(&snap, tree);
+		if (pgid)
+			add_pgid_pids(&snap, pgid);
+		proc_snapshot_deinit(&snap);
+	}
+	if (cgroup)
+		add_cgroup_pids(cgroup);
+
+	if (npids == 1 && !tree && !pgid && !cgroup) {
+		pid = pids[0];
+		npids = 0;
+	} else if (npids > 1) {
+		/* the same process may be specified more times */
+		size_t n = 1;
+
+		qsort(pids, npids, sizeof(pid_t), cmp_pids);
+		for (i = 1; i < npids; i++) {
+			if (pids[i] != pids[n - 1])
+				pids[n++] = pids[i];
+		}
+		npids = n;
+	}
+
+	if (!ncolumns && npids) {
+		/* default columns for more processes */
+		columns[ncolumns++] = COL_PID;
+		columns[ncolumns++] = COL_RES;
+		columns[ncolumns++] = COL_SOFT;
+		columns[ncolumns++] = COL_HARD;
+	} else if (!ncolumns) {
 		/* default columns */
 		columns[ncolumns++] = COL_RES;
 		columns[ncolumns++] = COL_HELP;
@@ -625,6 +907,14 @@ int main(int argc, char **argv)
 			add_prlim(NULL, &lims, n);
 	}
 
+	if (npids) {
+		rc = do_prlimit_pids(&lims, tt_flags);
+		free(pids);
+		return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	if (tree || pgid || cgroup)
+		errx(EXIT_FAILURE, _("no process found"));
+
 	do_prlimit(&lims);
 
 	if (!list_empty(&lims))
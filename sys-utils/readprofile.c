@@ -40,6 +40,7 @@
  * "readprofile -s -m /boot/System.map-test | grep __d_lookup | sort -n -k3"
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
@@ -54,6 +55,7 @@
 #include "nls.h"
 #include "xalloc.h"
 #include "closestream.h"
+#include "strutils.h"
 
 #define S_LEN 128
 
@@ -125,26 +127,150 @@ static void __attribute__ ((__noreturn__))
 	exit(out == stderr ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
+/* symbol from System.map */
+struct sym {
+	unsigned long long	addr;
+	size_t			bucket;	/* profile buffer index of the address */
+	unsigned int		count;	/* ticks in the function */
+	int			lineno;	/* map line, keeps the order of aliases */
+	char			*name;
+};
+
+static int cmp_sym(const void *a, const void *b)
+{
+	const struct sym *x = a, *y = b;
+
+	if (x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	return x->lineno - y->lineno;
+}
+
+/* splits "<address> <mode> <name>" map line, the line is modified */
+static int parse_map_line(char *line, unsigned long long *addr,
+			  char **mode, char **name)
+{
+	char *p, *end;
+
+	errno = 0;
+	*addr = strtoull(line, &end, 16);
+	if (errno || end == line)
+		return -1;
+
+	p = (char *) skip_space(end);
+	*mode = p;
+	while (*p && !isspace((unsigned char) *p))
+		p++;
+	if (p == *mode || !*p)
+		return -1;
+	*p++ = '\0';
+
+	p = (char *) skip_space(p);
+	*name = p;
+	while (*p && !isspace((unsigned char) *p))
+		p++;
+	if (p == *name)
+		return -1;
+	*p = '\0';
+	return 0;
+}
+
+/*
+ * Reads text symbols from the map. The first returned symbol is _stext, the
+ * last one is _etext (or the last text symbol) and it's used as the end of
+ * the previous function only. The symbols are sorted by address.
+ */
+static size_t read_map(FILE *map, const char *mapFile, struct sym **res)
+{
+	struct sym *syms = NULL;
+	size_t nsyms = 0, nalloc = 0;
+	char mapline[S_LEN], *name, *mode;
+	unsigned long long addr;
+	int maplineno = 0, sorted = 1;
+
+	while (fgets(mapline, S_LEN, map)) {
+		maplineno++;
+		if (parse_map_line(mapline, &addr, &mode, &name) != 0)
+			errx(EXIT_FAILURE, _("%s(%i): wrong map line"), mapFile,
+			     maplineno);
+		if (!nsyms) {
+			/* only elf works like this */
+			if (strcmp(name, "_stext") && strcmp(name, "__stext"))
+				continue;
+		} else if (strcmp(name, "_etext") && strcmp(name, "__etext")) {
+			/* ignore any LEADING (before a '[tT]' symbol
+			 * is found) Absolute symbols and __init_end
+			 * because some architectures place it before
+			 * .text section */
+			if ((*mode == 'A' || *mode == '?')
+			    && (nsyms == 1 || !strcmp(name, "__init_end")))
+				continue;
+			if (*mode != 'T' && *mode != 't' &&
+			    *mode != 'W' && *mode != 'w')
+				break;	/* only text is profiled */
+		}
+
+		if (nsyms == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 1024;
+			syms = xrealloc(syms, nalloc * sizeof(*syms));
+		}
+		if (nsyms > 1 && addr < syms[nsyms - 1].addr)
+			sorted = 0;
+		syms[nsyms].addr = addr;
+		syms[nsyms].bucket = 0;
+		syms[nsyms].count = 0;
+		syms[nsyms].lineno = maplineno;
+		syms[nsyms].name = xstrdup(name);
+		nsyms++;
+
+		/* the kernel only profiles up to _etext */
+		if (nsyms > 1 && (!strcmp(name, "_etext") ||
+				  !strcmp(name, "__etext")))
+			break;
+	}
+
+	if (!nsyms)
+		errx(EXIT_FAILURE, _("can't find \"_stext\" in %s"), mapFile);
+
+	if (!sorted)
+		qsort(syms + 1, nsyms - 1, sizeof(*syms), cmp_sym);
+	*res = syms;
+	return nsyms;
+}
+
+/* returns the last function (from the first @nsyms) which starts at or
+ * before the profile buffer index @indx */
+static size_t find_sym(const struct sym *syms, size_t nsyms, size_t indx)
+{
+	size_t lo = 0, hi = nsyms;
+
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (syms[mid].bucket <= indx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
 int main(int argc, char **argv)
 {
 	FILE *map;
 	int proFd;
 	char *mapFile, *proFile, *mult = 0;
-	size_t len = 0, indx = 1;
+	size_t len = 0, indx, nents, i;
 	unsigned long long add0 = 0;
 	unsigned int step;
 	unsigned int *buf, total, fn_len;
-	unsigned long long fn_add, next_add;	/* current and next address */
-	char fn_name[S_LEN], next_name[S_LEN];	/* current and next name */
-	char mode[8];
+	unsigned long long fn_add;
+	struct sym *syms;
+	size_t nsyms, nfuncs;
 	int c;
 	ssize_t rc;
 	int optAll = 0, optInfo = 0, optReset = 0, optVerbose = 0, optNative = 0;
 	int optBins = 0, optSub = 0;
-	char mapline[S_LEN];
-	int maplineno = 1;
 	int popenMap;		/* flag to tell if popen() has been used */
-	int header_printed;
 
 	static const struct option longopts[] = {
 		{"mapfile", required_argument, NULL, 'm'},
@@ -162,8 +288,6 @@ int main(int argc, char **argv)
 		{NULL, 0, 0, 0}
 	};
 
-#define next (current^1)
-
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
 	textdomain(PACKAGE);
@@ -256,7 +380,6 @@ int main(int argc, char **argv)
 		int entries = len / sizeof(*buf);
 		int big = 0, small = 0;
 		unsigned *p;
-		size_t i;
 
 		for (p = buf + 1; p < buf + entries; p++) {
 			if (*p & ~0U << (sizeof(*buf) * 4))
@@ -294,103 +417,81 @@ int main(int argc, char **argv)
 	if (map == NULL)
 		err(EXIT_FAILURE, "%s", mapFile);
 
-	while (fgets(mapline, S_LEN, map)) {
-		if (sscanf(mapline, "%llx %s %s", &fn_add, mode, fn_name) != 3)
-			errx(EXIT_FAILURE, _("%s(%i): wrong map line"), mapFile,
-			     maplineno);
-		/* only elf works like this */
-		if (!strcmp(fn_name, "_stext") || !strcmp(fn_name, "__stext")) {
-			add0 = fn_add;
-			break;
-		}
-		maplineno++;
-	}
+	nsyms = read_map(map, mapFile, &syms);
+	popenMap ? pclose(map) : fclose(map);
 
+	add0 = syms[0].addr;
 	if (!add0)
 		errx(EXIT_FAILURE, _("can't find \"_stext\" in %s"), mapFile);
 
+	/* the last symbol is the end of the text only */
+	nfuncs = nsyms - 1;
+	nents = len / sizeof(*buf);
+
+	if (nfuncs && max((syms[nfuncs - 1].addr - add0) / step, 1ULL) >= nents)
+		errx(EXIT_FAILURE,
+		     _("profile address out of range. Wrong map file?"));
+
+	for (i = 0; i < nsyms; i++) {
+		unsigned long long b = syms[i].addr < add0 ? 0 :
+				       (syms[i].addr - add0) / step;
+		syms[i].bucket = min(b, (unsigned long long) nents);
+	}
+
 	/*
-	 * Main loop.
+	 * Assign the ticks to the functions, the buffer index 0 is the step.
 	 */
-	while (fgets(mapline, S_LEN, map)) {
-		unsigned int this = 0;
-		int done = 0;
+	for (i = 1; nfuncs && i < syms[nfuncs].bucket; i++) {
+		if (!buf[i])
+			continue;
+		syms[find_sym(syms, nfuncs, i)].count += buf[i];
+		total += buf[i];
+	}
 
-		if (sscanf(mapline, "%llx %s %s", &next_add, mode, next_name) != 3)
-			errx(EXIT_FAILURE, _("%s(%i): wrong map line"), mapFile,
-			     maplineno);
-		header_printed = 0;
+	for (i = 0; i < nfuncs; i++) {
+		struct sym *fn = &syms[i], *nx = &syms[i + 1];
+		unsigned int this = fn->count;
 
-		/* the kernel only profiles up to _etext */
-		if (!strcmp(next_name, "_etext") ||
-		    !strcmp(next_name, "__etext"))
-			done = 1;
-		else {
-			/* ignore any LEADING (before a '[tT]' symbol
-			 * is found) Absolute symbols and __init_end
-			 * because some architectures place it before
-			 * .text section */
-			if ((*mode == 'A' || *mode == '?')
-			    && (total == 0 || !strcmp(next_name, "__init_end")))
-				continue;
-			if (*mode != 'T' && *mode != 't' &&
-			    *mode != 'W' && *mode != 'w')
-				break;	/* only text is profiled */
-		}
-
-		if (indx >= len / sizeof(*buf))
-			errx(EXIT_FAILURE,
-			     _("profile address out of range. Wrong map file?"));
+		if (optBins) {
+			int header_printed = 0;
 
-		while (indx < (next_add - add0) / step) {
-			if (optBins && (buf[indx] || optAll)) {
+			for (indx = max(fn->bucket, (size_t) 1); indx < nx->bucket; indx++) {
+				if (!buf[indx] && !optAll)
+					continue;
 				if (!header_printed) {
-					printf("%s:\n", fn_name);
+					printf("%s:\n", fn->name);
 					header_printed = 1;
 				}
 				printf("\t%llx\t%u\n", (indx - 1) * step + add0,
 				       buf[indx]);
 			}
-			this += buf[indx++];
-		}
-		total += this;
-
-		if (optBins) {
 			if (optVerbose || this > 0)
 				printf("  total\t\t\t\t%u\n", this);
 		} else if ((this || optAll) &&
-			   (fn_len = next_add - fn_add) != 0) {
+			   (fn_len = nx->addr - fn->addr) != 0) {
 			if (optVerbose)
-				printf("%016llx %-40s %6i %8.4f\n", fn_add,
-				       fn_name, this, this / (double)fn_len);
+				printf("%016llx %-40s %6i %8.4f\n", fn->addr,
+				       fn->name, this, this / (double)fn_len);
 			else
 				printf("%6i %-40s %8.4f\n",
-				       this, fn_name, this / (double)fn_len);
+				       this, fn->name, this / (double)fn_len);
 			if (optSub) {
-				unsigned long long scan;
+				size_t scan;
 
-				for (scan = (fn_add - add0) / step + 1;
-				     scan < (next_add - add0) / step;
-				     scan++) {
+				for (scan = fn->bucket + 1; scan < nx->bucket; scan++) {
 					unsigned long long addr;
 					addr = (scan - 1) * step + add0;
 					printf("\t%#llx\t%s+%#llx\t%u\n",
-					       addr, fn_name, addr - fn_add,
+					       addr, fn->name, addr - fn->addr,
 					       buf[scan]);
 				}
 			}
 		}
-
-		fn_add = next_add;
-		strcpy(fn_name, next_name);
-
-		maplineno++;
-		if (done)
-			break;
 	}
+	fn_add = syms[nfuncs].addr;
 
 	/* clock ticks, out of kernel text - probably modules */
-	printf("%6i %s\n", buf[len / sizeof(*buf) - 1], "*unknown*");
+	printf("%6i %s\n", buf[nents - 1], "*unknown*");
 
 	/* trailer */
 	if (optVerbose)
@@ -400,6 +501,9 @@ int main(int argc, char **argv)
 		printf("%6i %-40s %8.4f\n",
 		       total, _("total"), total / (double)(fn_add - add0));
 
-	popenMap ? pclose(map) : fclose(map);
+	for (i = 0; i < nsyms; i++)
+		free(syms[i].name);
+	free(syms);
+	free(buf);
 	exit(EXIT_SUCCESS);
 }
@@ -56,6 +56,25 @@ int is_active_swap(const char *filename)
 	return st && mnt_table_find_source(st, filename, MNT_ITER_BACKWARD);
 }
 
+/*
+ * Adds @filename to the in-memory /proc/swaps table, so the duplicate
+ * entries (e.g. in fstab) are detected by is_active_swap().
+ */
+void add_active_swap(const char *filename)
+{
+	struct libmnt_table *st = get_swaps();
+	struct libmnt_fs *fs;
+
+	if (!st)
+		return;
+	fs = mnt_new_fs();
+	if (!fs)
+		return;
+	if (mnt_fs_set_source(fs, filename) == 0)
+		mnt_table_add_fs(st, fs);
+	mnt_unref_fs(fs);
+}
+
 
 int cannot_find(const char *special)
 {
@@ -11,6 +11,7 @@ extern void free_tables(void);
 
 extern int match_swap(struct libmnt_fs *fs, void *data);
 extern int is_active_swap(const char *filename);
+extern void add_active_swap(const char *filename);
 
 extern int cannot_find(const char *special);
 
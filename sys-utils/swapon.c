@@ -11,6 +11,9 @@
 #include <fcntl.h>
 #include <stdint.h>
 #include <ctype.h>
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
 
 #include <libmount.h>
 
@@ -79,6 +82,42 @@ enum {
 #define SWAP_SIGNATURE		"SWAPSPACE2"
 #define SWAP_SIGNATURE_SZ	(sizeof(SWAP_SIGNATURE) - 1)
 
+#define PROBE_NTHREADS	8	/* swapon --all */
+
+/*
+ * The device properties read by swap_probe(). The probing does not print
+ * anything, so it's possible to probe more devices in parallel. The result is
+ * evaluated (and reported) by swap_check().
+ */
+enum {
+	PROBE_OK = 0,
+	PROBE_ERR_STAT,
+	PROBE_ERR_OPEN,
+	PROBE_ERR_SIZE,
+	PROBE_ERR_HEADER
+};
+
+struct swap_prop {
+	struct stat		st;
+	unsigned long long	devsize;
+	char			*hdr;
+	int			sig;
+	unsigned int		pagesize;
+
+	int			err;		/* PROBE_ERR_* */
+	int			errsv;		/* errno of the failed step */
+};
+
+/* swapon --all entry */
+struct swap_entry {
+	char			*special;
+	int			prio;
+	int			discard;
+	size_t			idx;		/* fstab order */
+
+	struct swap_prop	prop;
+};
+
 static int all;
 static int priority = -1;	/* non-prioritized swap by default */
 static int discard;		/* don't send swap discards by default */
@@ -242,6 +281,7 @@ static int show_table(int tt_flags, int bytes)
 		warn(_("failed to initialize output table"));
 		goto done;
 	}
+	tt_set_name(tt, "swapdevices");
 
 	for (i = 0; i < ncolumns; i++) {
 		struct colinfo *col = get_column_info(i);
@@ -449,91 +489,120 @@ static void swap_get_info(const char *hdr, char **label, char **uuid)
 	}
 }
 
-static int swapon_checks(const char *special)
+static void swap_probe(const char *special, struct swap_prop *prop)
+{
+	int fd;
+
+	memset(prop, 0, sizeof(*prop));
+
+	if (stat(special, &prop->st) < 0) {
+		prop->err = PROBE_ERR_STAT;
+		goto err;
+	}
+
+	/* file with holes, reported by swap_check() */
+	if (S_ISREG(prop->st.st_mode)) {
+		if (prop->st.st_blocks * 512 < prop->st.st_size)
+			return;
+		prop->devsize = prop->st.st_size;
+	}
+
+	fd = open(special, O_RDONLY);
+	if (fd == -1) {
+		prop->err = PROBE_ERR_OPEN;
+		goto err;
+	}
+
+	if (S_ISBLK(prop->st.st_mode) && blkdev_get_size(fd, &prop->devsize))
+		prop->err = PROBE_ERR_SIZE;
+	else {
+		prop->hdr = swap_get_header(fd, &prop->sig, &prop->pagesize);
+		if (!prop->hdr)
+			prop->err = PROBE_ERR_HEADER;
+	}
+	if (prop->err)
+		prop->errsv = errno;
+	close(fd);
+	return;
+err:
+	prop->errsv = errno;
+}
+
+static int swap_check(const char *special, struct swap_prop *prop)
 {
-	struct stat st;
-	int fd = -1, sig;
-	char *hdr = NULL;
-	unsigned int pagesize;
-	unsigned long long devsize = 0;
 	int permMask;
+	int rc = -1;
 
-	if (stat(special, &st) < 0) {
+	if (prop->err == PROBE_ERR_STAT) {
+		errno = prop->errsv;
 		warn(_("stat failed %s"), special);
-		goto err;
+		goto done;
 	}
 
-	permMask = S_ISBLK(st.st_mode) ? 07007 : 07077;
-	if ((st.st_mode & permMask) != 0)
+	permMask = S_ISBLK(prop->st.st_mode) ? 07007 : 07077;
+	if ((prop->st.st_mode & permMask) != 0)
 		warnx(_("%s: insecure permissions %04o, %04o suggested."),
-				special, st.st_mode & 07777,
+				special, prop->st.st_mode & 07777,
 				~permMask & 0666);
 
-	if (S_ISREG(st.st_mode) && st.st_uid != 0)
+	if (S_ISREG(prop->st.st_mode) && prop->st.st_uid != 0)
 		warnx(_("%s: insecure file owner %d, 0 (root) suggested."),
-				special, st.st_uid);
+				special, prop->st.st_uid);
 
 	/* test for holes by LBT */
-	if (S_ISREG(st.st_mode)) {
-		if (st.st_blocks * 512 < st.st_size) {
-			warnx(_("%s: skipping - it appears to have holes."),
-				special);
-			goto err;
-		}
-		devsize = st.st_size;
+	if (S_ISREG(prop->st.st_mode) &&
+	    prop->st.st_blocks * 512 < prop->st.st_size) {
+		warnx(_("%s: skipping - it appears to have holes."), special);
+		goto done;
 	}
 
-	fd = open(special, O_RDONLY);
-	if (fd == -1) {
+	errno = prop->errsv;
+	switch (prop->err) {
+	case PROBE_ERR_OPEN:
 		warn(_("cannot open %s"), special);
-		goto err;
-	}
-
-	if (S_ISBLK(st.st_mode) && blkdev_get_size(fd, &devsize)) {
+		goto done;
+	case PROBE_ERR_SIZE:
 		warn(_("%s: get size failed"), special);
-		goto err;
-	}
-
-	hdr = swap_get_header(fd, &sig, &pagesize);
-	if (!hdr) {
+		goto done;
+	case PROBE_ERR_HEADER:
 		warn(_("%s: read swap header failed"), special);
-		goto err;
+		goto done;
 	}
 
-	if (sig == SIG_SWAPSPACE && pagesize) {
+	if (prop->sig == SIG_SWAPSPACE && prop->pagesize) {
 		unsigned long long swapsize =
-				swap_get_size(hdr, special, pagesize);
+				swap_get_size(prop->hdr, special, prop->pagesize);
 		int syspg = getpagesize();
 
 		if (verbose)
 			warnx(_("%s: pagesize=%d, swapsize=%llu, devsize=%llu"),
-				special, pagesize, swapsize, devsize);
+				special, prop->pagesize, swapsize, prop->devsize);
 
-		if (swapsize > devsize) {
+		if (swapsize > prop->devsize) {
 			if (verbose)
 				warnx(_("%s: last_page 0x%08llx is larger"
 					" than actual size of swapspace"),
 					special, swapsize);
-		} else if (syspg < 0 || (unsigned) syspg != pagesize) {
+		} else if (syspg < 0 || (unsigned) syspg != prop->pagesize) {
 			if (fixpgsz) {
 				char *label = NULL, *uuid = NULL;
-				int rc;
+				int ret;
 
-				swap_get_info(hdr, &label, &uuid);
+				swap_get_info(prop->hdr, &label, &uuid);
 
 				warnx(_("%s: swap format pagesize does not match."),
 					special);
-				rc = swap_reinitialize(special, label, uuid);
+				ret = swap_reinitialize(special, label, uuid);
 				free(label);
 				free(uuid);
-				if (rc < 0)
-					goto err;
+				if (ret < 0)
+					goto done;
 			} else
 				warnx(_("%s: swap format pagesize does not match. "
 					"(Use --fixpgsz to reinitialize it.)"),
 					special);
 		}
-	} else if (sig == SIG_SWSUSPEND) {
+	} else if (prop->sig == SIG_SWSUSPEND) {
 		/* We have to reinitialize swap with old (=useless) software suspend
 		 * data. The problem is that if we don't do it, then we get data
 		 * corruption the next time an attempt at unsuspending is made.
@@ -541,39 +610,30 @@ static int swapon_checks(const char *special)
 		warnx(_("%s: software suspend data detected. "
 				"Rewriting the swap signature."),
 			special);
-		if (swap_rewrite_signature(special, pagesize) < 0)
-			goto err;
+		if (swap_rewrite_signature(special, prop->pagesize) < 0)
+			goto done;
 	}
+	rc = 0;
+done:
+	free(prop->hdr);
+	prop->hdr = NULL;
+	return rc;
+}
 
-	free(hdr);
-	close(fd);
-	return 0;
-err:
-	if (fd != -1)
-		close(fd);
-	free(hdr);
-	return -1;
+static int swapon_checks(const char *special)
+{
+	struct swap_prop prop;
+
+	swap_probe(special, &prop);
+	return swap_check(special, &prop);
 }
 
-static int do_swapon(const char *orig_special, int prio,
-		     int fl_discard, int canonic)
+static int swapon_device(const char *special, const char *orig_special,
+			 int prio, int fl_discard)
 {
 	int status;
-	const char *special = orig_special;
 	int flags = 0;
 
-	if (verbose)
-		printf(_("swapon %s\n"), orig_special);
-
-	if (!canonic) {
-		special = mnt_resolve_spec(orig_special, mntcache);
-		if (!special)
-			return cannot_find(orig_special);
-	}
-
-	if (swapon_checks(special))
-		return -1;
-
 #ifdef SWAP_FLAG_PREFER
 	if (prio >= 0) {
 		if (prio > SWAP_FLAG_PRIO_MASK)
@@ -607,6 +667,26 @@ static int do_swapon(const char *orig_special, int prio,
 	return status;
 }
 
+static int do_swapon(const char *orig_special, int prio,
+		     int fl_discard, int canonic)
+{
+	const char *special = orig_special;
+
+	if (verbose)
+		printf(_("swapon %s\n"), orig_special);
+
+	if (!canonic) {
+		special = mnt_resolve_spec(orig_special, mntcache);
+		if (!special)
+			return cannot_find(orig_special);
+	}
+
+	if (swapon_checks(special))
+		return -1;
+
+	return swapon_device(special, orig_special, prio, fl_discard);
+}
+
 static int swapon_by_label(const char *label, int prio, int dsc)
 {
 	const char *special = mnt_resolve_tag("LABEL", label, mntcache);
@@ -621,11 +701,82 @@ static int swapon_by_uuid(const char *uuid, int prio, int dsc)
 			 cannot_find(uuid);
 }
 
+#ifdef HAVE_LIBPTHREAD
+struct probe_queue {
+	struct swap_entry	*ents;
+	size_t			nents;
+	size_t			next;
+	pthread_mutex_t		lock;
+};
+
+static void *probe_worker(void *data)
+{
+	struct probe_queue *q = (struct probe_queue *) data;
+
+	for (;;) {
+		struct swap_entry *e;
+
+		pthread_mutex_lock(&q->lock);
+		e = q->next < q->nents ? &q->ents[q->next++] : NULL;
+		pthread_mutex_unlock(&q->lock);
+		if (!e)
+			break;
+		swap_probe(e->special, &e->prop);
+	}
+	return NULL;
+}
+#endif
+
+/* reads the swap headers of all the entries, in parallel if possible */
+static void swap_probe_all(struct swap_entry *ents, size_t nents)
+{
+	size_t i = 0;
+#ifdef HAVE_LIBPTHREAD
+	struct probe_queue q = { .ents = ents, .nents = nents };
+	pthread_t threads[PROBE_NTHREADS];
+	size_t n = 0;
+
+	if (nents > 1) {
+		pthread_mutex_init(&q.lock, NULL);
+		while (n < min(nents, (size_t) PROBE_NTHREADS) &&
+		       pthread_create(&threads[n], NULL, probe_worker, &q) == 0)
+			n++;
+		/* the rest (or everything on error) in this thread */
+		probe_worker(&q);
+		while (n > 0)
+			pthread_join(threads[--n], NULL);
+		pthread_mutex_destroy(&q.lock);
+		return;
+	}
+#endif
+	for (i = 0; i < nents; i++)
+		swap_probe(ents[i].special, &ents[i].prop);
+}
+
+/* higher priority first, the default (-1) priority in fstab order */
+static int cmp_swap_entry(const void *a, const void *b)
+{
+	const struct swap_entry *x = (const struct swap_entry *) a,
+				*y = (const struct swap_entry *) b;
+
+	if (x->prio != y->prio)
+		return x->prio > y->prio ? -1 : 1;
+	return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+/*
+ * The fstab entries are resolved and filtered first, then all the devices are
+ * probed in parallel. The signatures are checked (and rewritten if necessary)
+ * for all the devices before the first swapon(2), and the swap areas are
+ * activated in the priority order.
+ */
 static int swapon_all(void)
 {
 	struct libmnt_table *tb = get_fstab();
 	struct libmnt_iter *itr;
 	struct libmnt_fs *fs;
+	struct swap_entry *ents = NULL;
+	size_t nents = 0, i;
 	int status = 0;
 
 	if (!tb)
@@ -666,12 +817,44 @@ static int swapon_all(void)
 			continue;
 		}
 
-		if (!is_active_swap(src) &&
-		    (!nofail || !access(src, R_OK)))
-			status |= do_swapon(src, pri, dsc, CANONIC);
+		if (is_active_swap(src) || (nofail && access(src, R_OK)))
+			continue;
+		add_active_swap(src);		/* skip duplicate entries */
+
+		if (nents % 16 == 0)
+			ents = xrealloc(ents, (nents + 16) * sizeof(*ents));
+		ents[nents].special = src;
+		ents[nents].prio = pri < 0 ? -1 : pri;
+		ents[nents].discard = dsc;
+		ents[nents].idx = nents;
+		nents++;
 	}
-
 	mnt_free_iter(itr);
+
+	if (!nents)
+		return status;
+
+	qsort(ents, nents, sizeof(*ents), cmp_swap_entry);
+	swap_probe_all(ents, nents);
+
+	for (i = 0; i < nents; i++) {
+		struct swap_entry *e = &ents[i];
+
+		if (verbose)
+			printf(_("swapon %s\n"), e->special);
+		if (swap_check(e->special, &e->prop)) {
+			status |= -1;
+			e->special = NULL;
+		}
+	}
+
+	for (i = 0; i < nents; i++) {
+		if (ents[i].special)
+			status |= swapon_device(ents[i].special, ents[i].special,
+						ents[i].prio, ents[i].discard);
+	}
+
+	free(ents);
 	return status;
 }
 
@@ -692,6 +875,7 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 		"     --show[=<columns>]   display summary in definable table\n"
 		"     --noheadings         don't print headings, use with --show\n"
 		"     --raw                use the raw output format, use with --show\n"
+		"     --json               use the JSON output format, use with --show\n"
 		"     --bytes              display swap size in bytes in --show output\n"
 		" -v, --verbose            verbose mode\n"), out);
 
@@ -733,7 +917,8 @@ int main(int argc, char *argv[])
 		SHOW_OPTION = CHAR_MAX + 1,
 		RAW_OPTION,
 		NOHEADINGS_OPTION,
-		BYTES_OPTION
+		BYTES_OPTION,
+		JSON_OPTION
 	};
 
 	static const struct option long_opts[] = {
@@ -750,6 +935,7 @@ int main(int argc, char *argv[])
 		{ "noheadings", 0, 0, NOHEADINGS_OPTION },
 		{ "raw",      0, 0, RAW_OPTION },
 		{ "bytes",    0, 0, BYTES_OPTION },
+		{ "json",     0, 0, JSON_OPTION },
 		{ NULL, 0, 0, 0 }
 	};
 
@@ -826,6 +1012,9 @@ int main(int argc, char *argv[])
 		case BYTES_OPTION:
 			bytes = 1;
 			break;
+		case JSON_OPTION:
+			tt_flags |= TT_FL_JSON;
+			break;
 		case 'V':		/* version */
 			printf(UTIL_LINUX_VERSION);
 			return EXIT_SUCCESS;
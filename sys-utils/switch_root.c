@@ -45,10 +45,13 @@
 #define MNT_DETACH       0x00000002	/* Just detach from the tree */
 #endif
 
-/* remove all files/directories below dirName -- don't cross mountpoints */
-static int recursiveRemove(int fd)
+/*
+ * Remove all files/directories below dirName -- don't cross mountpoints. The
+ * @dev is the device of the directory, so the subdirectories are stat()ed
+ * only once (the directory entry type is good enough for the other files).
+ */
+static int recursiveRemove(int fd, dev_t dev)
 {
-	struct stat rb;
 	DIR *dir;
 	int rc = -1;
 	int dfd;
@@ -61,13 +64,9 @@ static int recursiveRemove(int fd)
 	/* fdopendir() precludes us from continuing to use the input fd */
 	dfd = dirfd(dir);
 
-	if (fstat(dfd, &rb)) {
-		warn(_("stat failed"));
-		goto done;
-	}
-
 	while(1) {
 		struct dirent *d;
+		int isdir;
 
 		errno = 0;
 		if (!(d = readdir(dir))) {
@@ -81,29 +80,45 @@ static int recursiveRemove(int fd)
 		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
 			continue;
 
-		if (d->d_type == DT_DIR) {
+		isdir = d->d_type == DT_DIR;
+
+		if (d->d_type == DT_UNKNOWN) {
 			struct stat sb;
 
 			if (fstatat(dfd, d->d_name, &sb, AT_SYMLINK_NOFOLLOW)) {
 				warn(_("stat failed %s"), d->d_name);
 				continue;
 			}
+			isdir = S_ISDIR(sb.st_mode);
+		}
+
+		if (isdir) {
+			struct stat sb;
+			int cfd;
+
+			cfd = openat(dfd, d->d_name,
+				     O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+			if (cfd < 0) {
+				warn(_("cannot open %s"), d->d_name);
+				continue;
+			}
+			if (fstat(cfd, &sb)) {
+				warn(_("stat failed %s"), d->d_name);
+				close(cfd);
+				continue;
+			}
 
 			/* remove subdirectories if device is same as dir */
-			if (sb.st_dev == rb.st_dev) {
-				int cfd;
-
-				cfd = openat(dfd, d->d_name, O_RDONLY);
-				if (cfd >= 0) {
-					recursiveRemove(cfd);
-					close(cfd);
-				}
-			} else
+			if (sb.st_dev != dev) {
+				close(cfd);
 				continue;
+			}
+
+			/* closed by closedir() in the recursive call */
+			recursiveRemove(cfd, dev);
 		}
 
-		if (unlinkat(dfd, d->d_name,
-			     d->d_type == DT_DIR ? AT_REMOVEDIR : 0))
+		if (unlinkat(dfd, d->d_name, isdir ? AT_REMOVEDIR : 0))
 			warn(_("failed to unlink %s"), d->d_name);
 	}
 
@@ -112,6 +127,8 @@ static int recursiveRemove(int fd)
 done:
 	if (dir)
 		closedir(dir);
+	else
+		close(fd);
 	return rc;
 }
 
@@ -175,16 +192,18 @@ static int switchroot(const char *newroot)
 		pid = fork();
 		if (pid <= 0) {
 			if (fstat(cfd, &sb) == 0) {
-				if (sb.st_dev == makedev(0, 1))
-					recursiveRemove(cfd);
-				else
+				if (sb.st_dev == makedev(0, 1)) {
+					recursiveRemove(cfd, sb.st_dev);
+					cfd = -1;
+				} else
 					warn(_("old root filesystem is not an initramfs"));
 			}
 
 			if (pid == 0)
 				exit(EXIT_SUCCESS);
 		}
-		close(cfd);
+		if (cfd >= 0)
+			close(cfd);
 	}
 	return 0;
 }
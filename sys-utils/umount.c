@@ -26,6 +26,7 @@
 #include <getopt.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include <libmount.h>
 
@@ -38,6 +39,7 @@
 #include "pathnames.h"
 #include "canonicalize.h"
 #include "xalloc.h"
+#include "strutils.h"
 
 static int table_parser_errcb(struct libmnt_table *tb __attribute__((__unused__)),
 			const char *filename, int line)
@@ -91,6 +93,8 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(_(" -l, --lazy              detach the filesystem now, clean up things later\n"), out);
 	fputs(_(" -O, --test-opts <list>  limit the set of filesystems (use with -a)\n"), out);
 	fputs(_(" -R, --recursive         recursively unmount a target with all its children\n"), out);
+	fputs(_("     --fork-limit <num>  unmount up to <num> filesystems in parallel (use with -R)\n"), out);
+	fputs(_("     --detach-tree       detach the whole tree by one lazy umount (use with -R)\n"), out);
 	fputs(_(" -r, --read-only         in case unmounting fails, try to remount read-only\n"), out);
 	fputs(_(" -t, --types <list>      limit the set of filesystem types\n"), out);
 	fputs(_(" -v, --verbose           say what is being done\n"), out);
@@ -351,45 +355,261 @@ static int umount_one_if_mounted(struct libmnt_context *cxt, const char *spec)
 	return rc;
 }
 
-static int umount_do_recurse(struct libmnt_context *cxt,
-		struct libmnt_table *tb, struct libmnt_fs *fs)
+/*
+ * umount --recursive
+ *
+ * All the filesystems of the tree are collected (children first) and
+ * unmounted level by level; the leaves first, then the filesystems where all
+ * the children have been already unmounted, etc. The filesystems on the same
+ * level are independent, so they may be unmounted in parallel.
+ */
+struct umount_tree {
+	struct libmnt_table	*tb;
+	struct libmnt_fs	**ents;		/* filesystems, children first */
+	int			*levels;	/* height of the subtree */
+	size_t			nents;
+	int			nlevels;
+
+	unsigned int		is_mtab : 1;	/* @tb usable by context as mtab */
+};
+
+static int fork_limit;		/* max number of umount processes */
+static int detach_tree;		/* detach whole tree by one umount(2) */
+
+/* returns the height of the @fs subtree or -1 on error */
+static int umount_tree_add(struct umount_tree *tr, struct libmnt_fs *fs)
 {
 	struct libmnt_fs *child;
 	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_BACKWARD);
-	int rc;
+	int rc, level = 0;
 
 	if (!itr)
 		err(MOUNT_EX_SYSERR, _("libmount iterator allocation failed"));
 
-	/* umount all childern */
 	for (;;) {
-		rc = mnt_table_next_child_fs(tb, itr, fs, &child);
+		rc = mnt_table_next_child_fs(tr->tb, itr, fs, &child);
 		if (rc < 0) {
 			warnx(_("failed to get child fs of %s"),
 					mnt_fs_get_target(fs));
-			rc = MOUNT_EX_SOFTWARE;
+			level = -1;
 			goto done;
 		} else if (rc == 1)
 			break;		/* no more children */
 
-		rc = umount_do_recurse(cxt, tb, child);
-		if (rc != MOUNT_EX_SUCCESS)
+		rc = umount_tree_add(tr, child);
+		if (rc < 0) {
+			level = -1;
 			goto done;
+		}
+		if (rc + 1 > level)
+			level = rc + 1;
 	}
 
-	rc = umount_one_if_mounted(cxt, mnt_fs_get_target(fs));
+	if (tr->nents % 64 == 0) {
+		tr->ents = xrealloc(tr->ents, (tr->nents + 64) * sizeof(*tr->ents));
+		tr->levels = xrealloc(tr->levels, (tr->nents + 64) * sizeof(*tr->levels));
+	}
+
+	mnt_ref_fs(fs);
+	tr->ents[tr->nents] = fs;
+	tr->levels[tr->nents] = level;
+	tr->nents++;
+
+	if (level + 1 > tr->nlevels)
+		tr->nlevels = level + 1;
 done:
 	mnt_free_iter(itr);
+	return level;
+}
+
+static int umount_tree_fs(struct libmnt_context *cxt, struct umount_tree *tr,
+			  struct libmnt_fs *fs)
+{
+	int rc;
+
+	if (tr->is_mtab)
+		/* don't read mtab again for each filesystem */
+		mnt_context_set_mtab(cxt, tr->tb);
+
+	rc = umount_one_if_mounted(cxt, mnt_fs_get_target(fs));
+
+	/* keep @tb up to date, it's used to find the next targets */
+	if (rc == MOUNT_EX_SUCCESS)
+		mnt_table_remove_fs(tr->tb, fs);
+	return rc;
+}
+
+static int umount_tree_level(struct libmnt_context *cxt,
+			     struct umount_tree *tr, int level)
+{
+	size_t i, n = 0;
+	int w, nworkers, rc = MOUNT_EX_SUCCESS;
+	pid_t *pids;
+
+	for (i = 0; i < tr->nents; i++) {
+		if (tr->levels[i] == level)
+			n++;
+	}
+
+	nworkers = fork_limit > 1 ? min(fork_limit, (int) n) : 1;
+	if (nworkers <= 1) {
+		for (i = 0; i < tr->nents && rc == MOUNT_EX_SUCCESS; i++) {
+			if (tr->levels[i] == level)
+				rc = umount_tree_fs(cxt, tr, tr->ents[i]);
+		}
+		return rc;
+	}
+
+	/* don't duplicate unwritten output in the workers */
+	fflush(stdout);
+	fflush(stderr);
+
+	pids = xcalloc(nworkers, sizeof(pid_t));
+
+	for (w = 0; w < nworkers; w++) {
+		pids[w] = fork();
+		if (pids[w] < 0) {
+			warn(_("fork failed"));
+			rc = MOUNT_EX_SYSERR;
+			break;
+		}
+		if (pids[w] == 0) {
+			/* worker -- every nworkers-th filesystem on the level */
+			size_t k = 0;
+
+			for (i = 0; i < tr->nents && rc == MOUNT_EX_SUCCESS; i++) {
+				if (tr->levels[i] != level)
+					continue;
+				if (k++ % nworkers == (size_t) w)
+					rc = umount_tree_fs(cxt, tr, tr->ents[i]);
+			}
+			exit(rc);
+		}
+	}
+
+	for (w = 0; w < nworkers && pids[w] > 0; w++) {
+		int status = 0;
+
+		while (waitpid(pids[w], &status, 0) < 0 && errno == EINTR);
+
+		if (rc == MOUNT_EX_SUCCESS && !(WIFEXITED(status) &&
+						WEXITSTATUS(status) == 0))
+			rc = WIFEXITED(status) ? WEXITSTATUS(status) : MOUNT_EX_FAIL;
+	}
+	free(pids);
+
+	/* unmounted by the workers, update our copy of the table */
+	if (rc == MOUNT_EX_SUCCESS) {
+		for (i = 0; i < tr->nents; i++) {
+			if (tr->levels[i] == level)
+				mnt_table_remove_fs(tr->tb, tr->ents[i]);
+		}
+	}
 	return rc;
 }
 
+/*
+ * Detach the tree by one lazy umount(2) of the top-level filesystem and
+ * remove the children from utab (or mtab).
+ */
+static int umount_tree_detach(struct libmnt_context *cxt, struct umount_tree *tr)
+{
+	struct libmnt_update *upd;
+	int rc, regular;
+	size_t i;
+
+	mnt_context_enable_lazy(cxt, TRUE);
+
+	rc = umount_tree_fs(cxt, tr, tr->ents[tr->nents - 1]);
+	if (rc != MOUNT_EX_SUCCESS || tr->nents == 1)
+		return rc;
+
+	/* the children are detached too */
+	for (i = 0; i + 1 < tr->nents; i++)
+		mnt_table_remove_fs(tr->tb, tr->ents[i]);
+
+	if (mnt_context_is_nomtab(cxt) || mnt_context_is_fake(cxt))
+		return rc;
+
+	upd = mnt_new_update();
+	if (!upd)
+		err(MOUNT_EX_SYSERR, _("libmount update allocation failed"));
+
+	regular = mnt_has_regular_mtab(NULL, NULL);
+
+	for (i = 0; i + 1 < tr->nents; i++) {
+		struct libmnt_fs *fs = tr->ents[i];
+
+		/* utab contains only filesystems with userspace options */
+		if (!regular && !mnt_fs_get_user_options(fs))
+			continue;
+		if (mnt_update_set_fs(upd, 0, mnt_fs_get_target(fs), NULL) == 0)
+			mnt_update_table(upd, NULL);
+	}
+
+	mnt_free_update(upd);
+	return rc;
+}
+
+static int umount_do_recurse(struct libmnt_context *cxt,
+		struct libmnt_table *tb, int is_mtab, struct libmnt_fs *fs)
+{
+	struct umount_tree tr = { .tb = tb, .is_mtab = is_mtab ? 1 : 0 };
+	int rc = MOUNT_EX_SUCCESS, level;
+	size_t i;
+
+	if (umount_tree_add(&tr, fs) < 0)
+		rc = MOUNT_EX_SOFTWARE;
+	else if (detach_tree)
+		rc = umount_tree_detach(cxt, &tr);
+	else {
+		for (level = 0; level < tr.nlevels && rc == MOUNT_EX_SUCCESS; level++)
+			rc = umount_tree_level(cxt, &tr, level);
+	}
+
+	for (i = 0; i < tr.nents; i++)
+		mnt_unref_fs(tr.ents[i]);
+	free(tr.ents);
+	free(tr.levels);
+	return rc;
+}
+
+/*
+ * Returns mountinfo with utab, or mountinfo only if the system uses regular
+ * /etc/mtab. The @is_mtab is set if the table is usable by the context.
+ */
+static struct libmnt_table *new_mount_tree(struct libmnt_context *cxt, int *is_mtab)
+{
+	struct libmnt_table *tb;
+
+	*is_mtab = 0;
+	if (mnt_has_regular_mtab(NULL, NULL))
+		return new_mountinfo(cxt);
+
+	tb = mnt_new_table();
+	if (!tb)
+		err(MOUNT_EX_SYSERR, _("libmount table allocation failed"));
+
+	mnt_table_set_parser_errcb(tb, table_parser_errcb);
+	mnt_table_set_cache(tb, mnt_context_get_cache(cxt));
+
+	if (mnt_table_parse_mtab(tb, NULL)) {
+		warn(_("failed to parse %s"), _PATH_PROC_MOUNTINFO);
+		mnt_unref_table(tb);
+		return NULL;
+	}
+
+	*is_mtab = 1;
+	return tb;
+}
+
 static int umount_recursive(struct libmnt_context *cxt, const char *spec)
 {
 	struct libmnt_table *tb;
 	struct libmnt_fs *fs;
-	int rc;
+	int rc, is_mtab;
 
-	tb = new_mountinfo(cxt);
+	tb = new_mount_tree(cxt, &is_mtab);
 	if (!tb)
 		return MOUNT_EX_SOFTWARE;
 
@@ -398,7 +618,7 @@ static int umount_recursive(struct libmnt_context *cxt, const char *spec)
 
 	fs = mnt_table_find_target(tb, spec, MNT_ITER_BACKWARD);
 	if (fs)
-		rc = umount_do_recurse(cxt, tb, fs);
+		rc = umount_do_recurse(cxt, tb, is_mtab, fs);
 	else {
 		rc = MOUNT_EX_USAGE;
 		warnx(access(spec, F_OK) == 0 ?
@@ -410,13 +630,64 @@ static int umount_recursive(struct libmnt_context *cxt, const char *spec)
 	return rc;
 }
 
+/*
+ * Unmounts @fs from @tb; the table is used as mtab by the context if possible
+ * and @fs is removed from the table on success. Returns -EAGAIN (and does
+ * not print anything) if umount(2) failed in a way which suggests that the
+ * filesystem has been already unmounted by someone else, then the caller is
+ * expected to re-read the mount table.
+ */
+static int umount_alltargets_fs(struct libmnt_context *cxt,
+				struct libmnt_table *tb, int is_mtab,
+				struct libmnt_fs *fs, int quiet)
+{
+	int rc, syserr;
+
+	if (is_mtab)
+		mnt_context_set_mtab(cxt, tb);
+	if (mnt_context_set_target(cxt, mnt_fs_get_target(fs)))
+		err(MOUNT_EX_SYSERR, _("failed to set umount target"));
+
+	rc = mnt_context_umount(cxt);
+	syserr = mnt_context_get_syscall_errno(cxt);
+
+	if (rc && quiet && mnt_context_syscall_called(cxt)
+	    && (syserr == EINVAL || syserr == ENOENT)) {
+		mnt_reset_context(cxt);
+		return -EAGAIN;
+	}
+
+	rc = mk_exit_code(cxt, rc);
+	if (rc == MOUNT_EX_SUCCESS) {
+		if (mnt_context_is_verbose(cxt))
+			success_message(cxt);
+		mnt_table_remove_fs(tb, fs);
+	}
+	mnt_reset_context(cxt);
+	return rc;
+}
+
+/*
+ * umount --all-targets
+ *
+ * The mount table is parsed only once, the filesystems with the same source
+ * device are searched in the table (the last mounted first) and the table is
+ * updated in memory after each umount. The table is re-read only if umount(2)
+ * suggests that the mount table has been modified by someone else.
+ */
 static int umount_alltargets(struct libmnt_context *cxt, const char *spec, int rec)
 {
 	struct libmnt_fs *fs;
 	struct libmnt_table *tb;
-	struct libmnt_iter *itr = NULL;
 	dev_t devno = 0;
-	int rc;
+	int rc, is_mtab, reparsed = 0;
+
+	tb = new_mount_tree(cxt, &is_mtab);
+	if (!tb)
+		return MOUNT_EX_SOFTWARE;
+	if (is_mtab)
+		/* don't read mtab again to resolve @spec */
+		mnt_context_set_mtab(cxt, tb);
 
 	/* Convert @spec to device name, Use the same logic like regular
 	 * "umount <spec>".
@@ -427,46 +698,45 @@ static int umount_alltargets(struct libmnt_context *cxt, const char *spec, int r
 		warnx(access(spec, F_OK) == 0 ?
 				_("%s: not mounted") :
 				_("%s: not found"), spec);
-		return rc;
+		goto done;
+	}
+	if (rc < 0) {
+		rc = mk_exit_code(cxt, rc);		/* error */
+		goto done;
 	}
-	if (rc < 0)
-		return mk_exit_code(cxt, rc);		/* error */
 
 	if (!mnt_fs_get_srcpath(fs) || !mnt_fs_get_devno(fs))
 		err(MOUNT_EX_USAGE, _("%s: failed to determine source"), spec);
 
-	itr = mnt_new_iter(MNT_ITER_BACKWARD);
-	if (!itr)
-		err(MOUNT_EX_SYSERR, _("libmount iterator allocation failed"));
-
-	/* get on @cxt independent mountinfo */
-	tb = new_mountinfo(cxt);
-	if (!tb)
-		return MOUNT_EX_SOFTWARE;
-
 	/* Note that @fs is from mount context and the context will be reseted
 	 * after each umount() call */
 	devno = mnt_fs_get_devno(fs);
-	fs = NULL;
 
 	mnt_reset_context(cxt);
 
-	while (mnt_table_next_fs(tb, itr, &fs) == 0) {
-		if (mnt_fs_get_devno(fs) != devno)
-			continue;
+	while ((fs = mnt_table_find_devno(tb, devno, MNT_ITER_BACKWARD))) {
 		mnt_context_disable_swapmatch(cxt, 1);
 		if (rec)
-			rc = umount_do_recurse(cxt, tb, fs);
+			rc = umount_do_recurse(cxt, tb, is_mtab, fs);
 		else
-			rc = umount_one_if_mounted(cxt, mnt_fs_get_target(fs));
-
+			rc = umount_alltargets_fs(cxt, tb, is_mtab, fs, !reparsed);
+
+		if (rc == -EAGAIN) {
+			/* the table is out of date, read it again */
+			mnt_unref_table(tb);
+			tb = new_mount_tree(cxt, &is_mtab);
+			if (!tb)
+				return MOUNT_EX_SOFTWARE;
+			reparsed = 1;
+			rc = MOUNT_EX_SUCCESS;
+			continue;
+		}
 		if (rc != MOUNT_EX_SUCCESS)
 			break;
+		reparsed = 0;
 	}
-
-	mnt_free_iter(itr);
+done:
 	mnt_unref_table(tb);
-
 	return rc;
 }
 
@@ -496,14 +766,18 @@ int main(int argc, char **argv)
 
 	enum {
 		UMOUNT_OPT_FAKE = CHAR_MAX + 1,
+		UMOUNT_OPT_FORK_LIMIT,
+		UMOUNT_OPT_DETACH_TREE
 	};
 
 	static const struct option longopts[] = {
 		{ "all", 0, 0, 'a' },
 		{ "all-targets", 0, 0, 'A' },
 		{ "detach-loop", 0, 0, 'd' },
+		{ "detach-tree", 0, 0, UMOUNT_OPT_DETACH_TREE },
 		{ "fake", 0, 0, UMOUNT_OPT_FAKE },
 		{ "force", 0, 0, 'f' },
+		{ "fork-limit", 1, 0, UMOUNT_OPT_FORK_LIMIT },
 		{ "help", 0, 0, 'h' },
 		{ "internal-only", 0, 0, 'i' },
 		{ "lazy", 0, 0, 'l' },
@@ -569,6 +843,13 @@ int main(int argc, char **argv)
 		case 'f':
 			mnt_context_enable_force(cxt, TRUE);
 			break;
+		case UMOUNT_OPT_FORK_LIMIT:
+			fork_limit = strtou32_or_err(optarg,
+					_("failed to parse fork limit"));
+			break;
+		case UMOUNT_OPT_DETACH_TREE:
+			detach_tree = 1;
+			break;
 		case 'h':
 			usage(stdout);
 			break;
@@ -173,6 +173,7 @@ static void usage(FILE *out)
 	fputs(_(" -f, --flags <list>     print selected flags only\n"
 		" -F, --noflags          don't print information about flags\n"
 		" -I, --noident          don't print watchdog identity information\n"
+		" -J, --json             use JSON output format for flags table (implies -x)\n"
 		" -n, --noheadings       don't print headings for flags table\n"
 		" -O, --oneline          print all information on one line\n"
 		" -o, --output <list>    output columns of the flags\n"
@@ -250,6 +251,7 @@ static int show_flags(struct wdinfo *wd, int tt_flags, uint32_t wanted)
 		warn(_("failed to initialize output table"));
 		return -1;
 	}
+	tt_set_name(tt, "flags");
 
 	/* define columns */
 	for (i = 0; i < (size_t) ncolumns; i++) {
@@ -475,6 +477,7 @@ int main(int argc, char *argv[])
 		{ "noflags",    no_argument,       NULL, 'F' },
 		{ "noheadings", no_argument,       NULL, 'n' },
 		{ "noident",	no_argument,       NULL, 'I' },
+		{ "json",       no_argument,       NULL, 'J' },
 		{ "notimeouts", no_argument,       NULL, 'T' },
 		{ "settimeout", required_argument, NULL, 's' },
 		{ "output",     required_argument, NULL, 'o' },
@@ -486,6 +489,7 @@ int main(int argc, char *argv[])
 
 	static const ul_excl_t excl[] = {       /* rows and cols in in ASCII order */
 		{ 'F','f' },			/* noflags,flags*/
+		{ 'J','O' },			/* json,oneline */
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -496,7 +500,7 @@ int main(int argc, char *argv[])
 	atexit(close_stdout);
 
 	while ((c = getopt_long(argc, argv,
-				"d:f:hFnITo:s:OrVx", long_opts, NULL)) != -1) {
+				"d:f:hFnIJTo:s:OrVx", long_opts, NULL)) != -1) {
 
 		err_exclusive_options(c, long_opts, excl, excl_st);
 
@@ -526,6 +530,11 @@ int main(int argc, char *argv[])
 		case 'I':
 			noident = 1;
 			break;
+		case 'J':
+			tt_flags |= TT_FL_JSON;
+			noident = 1;
+			notimeouts = 1;
+			break;
 		case 'T':
 			notimeouts = 1;
 			break;
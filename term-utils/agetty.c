@@ -134,6 +134,9 @@ struct options {
 	char *erasechars;		/* string with erase chars */
 	char *killchars;		/* string with kill chars */
 	char *osrelease;		/* /etc/os-release data */
+	char *issuedata;		/* cached issue file */
+	size_t issuesz;
+	time_t issuemtime;
 	int delay;			/* Sleep seconds before prompt */
 	int nice;			/* Run login with this priority */
 	int numspeed;			/* number of baud rates to try */
@@ -169,6 +172,7 @@ enum {
 #define F_LONGHNAME	(1<<19) /* Show Full qualified hostname */
 #define F_NOHINTS	(1<<20) /* Don't print hints */
 #define F_REMOTE	(1<<21) /* Add '-h fakehost' to login(1) command line */
+#define F_LAZYUTMP	(1<<22) /* Update utmp after the login name is entered */
 
 #define serial_tty_option(opt, flag)	\
 	(((opt)->flags & (F_VCONSOLE|(flag))) == (flag))
@@ -331,7 +335,8 @@ int main(int argc, char **argv)
 
 	/* Update the utmp file. */
 #ifdef	SYSV_STYLE
-	update_utmp(&options);
+	if (!(options.flags & F_LAZYUTMP))
+		update_utmp(&options);
 #endif
 	if (options.delay)
 	    sleep(options.delay);
@@ -418,6 +423,12 @@ int main(int argc, char **argv)
 	if (options.timeout)
 		alarm(0);
 
+#ifdef	SYSV_STYLE
+	/* Now (when somebody wants to login) update the utmp file. */
+	if (options.flags & F_LAZYUTMP)
+		update_utmp(&options);
+#endif
+
 	if ((options.flags & F_VCONSOLE) == 0) {
 		/* Finalize the termios settings. */
 		termio_final(&options, &termios, &chardata);
@@ -471,6 +482,7 @@ int main(int argc, char **argv)
 				options.tty);
 	}
 	free(options.osrelease);
+	free(options.issuedata);
 #ifdef DEBUGGING
 	fprintf(dbf, "read %c\n", ch);
 	if (close_stream(dbf) != 0)
@@ -576,6 +588,7 @@ static void parse_args(int argc, char **argv, struct options *op)
 		HELP_OPTION,
 		ERASE_CHARS_OPTION,
 		KILL_CHARS_OPTION,
+		LAZYUTMP_OPTION,
 	};
 	const struct option longopts[] = {
 		{  "8bits",	     no_argument,	 0,  '8'  },
@@ -611,6 +624,7 @@ static void parse_args(int argc, char **argv, struct options *op)
 		{  "help",	     no_argument,	 0,  HELP_OPTION     },
 		{  "erase-chars",    required_argument,  0,  ERASE_CHARS_OPTION },
 		{  "kill-chars",     required_argument,  0,  KILL_CHARS_OPTION },
+		{  "lazy-utmp",      no_argument,        0,  LAZYUTMP_OPTION },
 		{ NULL, 0, 0, 0 }
 	};
 
@@ -716,6 +730,9 @@ static void parse_args(int argc, char **argv, struct options *op)
 		case LONGHOSTNAME_OPTION:
 			op->flags |= F_LONGHNAME;
 			break;
+		case LAZYUTMP_OPTION:
+			op->flags |= F_LAZYUTMP;
+			break;
 		case ERASE_CHARS_OPTION:
 			op->erasechars = optarg;
 			break;
@@ -1413,6 +1430,96 @@ done:
 	return ret;
 }
 
+/*
+ * uname() and the hostname lookup are called only once for the prompt, the
+ * results are used by all the escape sequences.
+ */
+static struct {
+	struct utsname	uts;
+	struct addrinfo	*canon;		/* hostname with AI_CANONNAME */
+	unsigned int	have_uts : 1,
+			have_canon : 1;
+} prompt_cache;
+
+static void reset_prompt_cache(void)
+{
+	if (prompt_cache.canon)
+		freeaddrinfo(prompt_cache.canon);
+	memset(&prompt_cache, 0, sizeof(prompt_cache));
+}
+
+static struct utsname *prompt_uname(void)
+{
+	if (!prompt_cache.have_uts) {
+		uname(&prompt_cache.uts);
+		prompt_cache.have_uts = 1;
+	}
+	return &prompt_cache.uts;
+}
+
+static struct addrinfo *prompt_canonname(void)
+{
+	if (!prompt_cache.have_canon) {
+		char *host = xgethostname();
+		struct addrinfo hints;
+
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_flags = AI_CANONNAME;
+
+		if (host && getaddrinfo(host, NULL, &hints, &prompt_cache.canon) != 0)
+			prompt_cache.canon = NULL;
+		prompt_cache.have_canon = 1;
+		free(host);
+	}
+	return prompt_cache.canon;
+}
+
+#ifdef	ISSUE
+/*
+ * The issue file is read only once and then parsed from memory, it's read
+ * again if modified. (The prompt is shown again after every empty login name.)
+ */
+static FILE *open_issue(struct options *op)
+{
+	struct stat st;
+	int fd;
+
+	if (stat(op->issue, &st) != 0)
+		return NULL;
+
+	if (op->issuedata && st.st_mtime == op->issuemtime
+	    && (size_t) st.st_size == op->issuesz)
+		goto done;
+
+	free(op->issuedata);
+	op->issuedata = NULL;
+	op->issuesz = 0;
+
+	if (!S_ISREG(st.st_mode) || st.st_size > 4 * 1024 * 1024)
+		return fopen(op->issue, "r");
+	if (st.st_size == 0)
+		return NULL;
+
+	fd = open(op->issue, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	op->issuedata = malloc(st.st_size);
+	if (!op->issuedata)
+		log_err(_("failed to allocate memory: %m"));
+	if (read_all(fd, op->issuedata, st.st_size) != (ssize_t) st.st_size) {
+		free(op->issuedata);
+		op->issuedata = NULL;
+		close(fd);
+		return fopen(op->issue, "r");
+	}
+	close(fd);
+	op->issuesz = st.st_size;
+	op->issuemtime = st.st_mtime;
+done:
+	return fmemopen(op->issuedata, op->issuesz, "r");
+}
+#endif	/* ISSUE */
+
 /* Show login prompt, optionally preceded by /etc/issue contents. */
 static void do_prompt(struct options *op, struct termios *tp)
 {
@@ -1420,13 +1527,15 @@ static void do_prompt(struct options *op, struct termios *tp)
 	FILE *fd;
 #endif				/* ISSUE */
 
+	reset_prompt_cache();
+
 	if ((op->flags & F_NONL) == 0) {
 		/* Issue not in use, start with a new line. */
 		write_all(STDOUT_FILENO, "\r\n", 2);
 	}
 
 #ifdef	ISSUE
-	if ((op->flags & F_ISSUE) && (fd = fopen(op->issue, "r"))) {
+	if ((op->flags & F_ISSUE) && (fd = open_issue(op))) {
 		int c, oflag = tp->c_oflag;	    /* Save current setting. */
 
 		if ((op->flags & F_VCONSOLE) == 0) {
@@ -1498,21 +1607,14 @@ static void do_prompt(struct options *op, struct termios *tp)
 					*dot = '\0';
 
 			} else if (dot == NULL) {
-				struct addrinfo hints;
-
-				memset(&hints, 0, sizeof(hints));
-				hints.ai_flags = AI_CANONNAME;
-
-				if (!getaddrinfo(hn, NULL, &hints, &res)
-				    && res && res->ai_canonname)
+				res = prompt_canonname();
+				if (res && res->ai_canonname)
 					cn = res->ai_canonname;
 			}
 
 			write_all(STDOUT_FILENO, cn, strlen(cn));
 			write_all(STDOUT_FILENO, " ", 1);
 
-			if (res)
-				freeaddrinfo(res);
 			free(hn);
 		}
 	}
@@ -1841,6 +1943,7 @@ static void __attribute__ ((__noreturn__)) usage(FILE *out)
 	fputs(_("     --long-hostname        show full qualified hostname\n"), out);
 	fputs(_("     --erase-chars <string> additional backspace chars\n"), out);
 	fputs(_("     --kill-chars <string>  additional kill chars\n"), out);
+	fputs(_("     --lazy-utmp            update utmp after the login name is entered\n"), out);
 	fputs(_("     --help                 display this help and exit\n"), out);
 	fputs(_("     --version              output version information and exit\n"), out);
 	fprintf(out, USAGE_MAN_TAIL("agetty(8)"));
@@ -2012,25 +2115,23 @@ static char *get_escape_argument(FILE *fd, char *buf, size_t bufsz)
 static void output_special_char(unsigned char c, struct options *op,
 				struct termios *tp, FILE *fp)
 {
-	struct utsname uts;
-
-	uname(&uts);
+	struct utsname *uts = prompt_uname();
 
 	switch (c) {
 	case 's':
-		printf("%s", uts.sysname);
+		printf("%s", uts->sysname);
 		break;
 	case 'n':
-		printf("%s", uts.nodename);
+		printf("%s", uts->nodename);
 		break;
 	case 'r':
-		printf("%s", uts.release);
+		printf("%s", uts->release);
 		break;
 	case 'v':
-		printf("%s", uts.version);
+		printf("%s", uts->version);
 		break;
 	case 'm':
-		printf("%s", uts.machine);
+		printf("%s", uts->machine);
 		break;
 	case 'o':
 	{
@@ -2043,13 +2144,9 @@ static void output_special_char(unsigned char c, struct options *op,
 	case 'O':
 	{
 		char *dom = NULL;
-		char *host = xgethostname();
-		struct addrinfo hints, *info = NULL;
-
-		memset(&hints, 0, sizeof(hints));
-		hints.ai_flags = AI_CANONNAME;
+		struct addrinfo *info = prompt_canonname();
 
-		if (host && getaddrinfo(host, NULL, &hints, &info) == 0 && info) {
+		if (info) {
 			char *canon;
 
 			if (info->ai_canonname &&
@@ -2057,9 +2154,6 @@ static void output_special_char(unsigned char c, struct options *op,
 				dom = canon + 1;
 		}
 		fputs(dom ? dom : "unknown_domain", stdout);
-		if (info)
-			freeaddrinfo(info);
-		free(host);
 		break;
 	}
 	case 'd':
@@ -2109,13 +2203,13 @@ static void output_special_char(unsigned char c, struct options *op,
 		if (get_escape_argument(fp, varname, sizeof(varname)))
 			var = read_os_release(op, varname);
 		else if (!(var = read_os_release(op, "PRETTY_NAME")))
-			var = uts.sysname;
+			var = uts->sysname;
 		if (var) {
 			if (strcmp(varname, "ANSI_COLOR") == 0)
 				printf("\033[%sm", var);
 			else
 				printf("%s", var);
-			if (var != uts.sysname)
+			if (var != uts->sysname)
 				free(var);
 		}
 		break;
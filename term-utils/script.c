@@ -59,12 +59,14 @@
 #include <locale.h>
 #include <stddef.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
 #include <poll.h>
 
 #include "closestream.h"
 #include "nls.h"
 #include "c.h"
 #include "ttyutils.h"
+#include "all-io.h"
 
 #if defined(HAVE_LIBUTIL) && defined(HAVE_PTY_H)
 # include <pty.h>
@@ -76,25 +78,26 @@
 
 #define DEFAULT_OUTPUT "typescript"
 
-void finish(int);
+#define SCRIPT_BUFSIZ	(64 * 1024)	/* I/O buffer size */
+
 void done(void);
 void fail(void);
-void resize(int);
 void fixtty(void);
 void getmaster(void);
 void getslave(void);
-void doinput(void);
-void dooutput(FILE *timingfd);
+void do_io(void);
 void doshell(void);
 
 char	*shell;
 FILE	*fscript;
+FILE	*timingfd;
 int	master = -1;
 int	slave;
 pid_t	child;
-pid_t	subchild;
 int	childstatus;
 char	*fname;
+sigset_t oldmask;		/* signal mask of the shell */
+double	oldtime;		/* time of the last output for -t */
 
 struct	termios tt;
 struct	winsize win;
@@ -112,9 +115,6 @@ int	tflg = 0;
 int	forceflg = 0;
 int	isterm;
 
-int die;
-int resized;
-
 static void
 die_if_link(char *fn) {
 	struct stat s;
@@ -160,10 +160,8 @@ usage(FILE *out)
 
 int
 main(int argc, char **argv) {
-	sigset_t block_mask, unblock_mask;
-	struct sigaction sa;
+	sigset_t mask;
 	int ch;
-	FILE *timingfd = NULL;
 
 	enum { FORCE_OPTION = CHAR_MAX + 1 };
 
@@ -251,212 +249,237 @@ main(int argc, char **argv) {
 #ifdef HAVE_LIBUTEMPTER
 	utempter_add_record(master, NULL);
 #endif
-	/* setup SIGCHLD handler */
-	sigemptyset(&sa.sa_mask);
-	sa.sa_flags = 0;
-	sa.sa_handler = finish;
-	sigaction(SIGCHLD, &sa, NULL);
+	/* SIGCHLD and SIGWINCH are read from signalfd in do_io() */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGWINCH);
+	sigprocmask(SIG_BLOCK, &mask, &oldmask);
 
-	/* init mask for SIGCHLD */
-	sigprocmask(SIG_SETMASK, NULL, &block_mask);
-	sigaddset(&block_mask, SIGCHLD);
-
-	sigprocmask(SIG_SETMASK, &block_mask, &unblock_mask);
 	child = fork();
-	sigprocmask(SIG_SETMASK, &unblock_mask, NULL);
-
 	if (child < 0) {
 		warn(_("fork failed"));
 		fail();
 	}
-	if (child == 0) {
-
-		sigprocmask(SIG_SETMASK, &block_mask, NULL);
-		subchild = child = fork();
-		sigprocmask(SIG_SETMASK, &unblock_mask, NULL);
-
-		if (child < 0) {
-			warn(_("fork failed"));
-			fail();
-		}
-		if (child) {
-			if (!timingfd)
-				timingfd = fdopen(STDERR_FILENO, "w");
-			dooutput(timingfd);
-		} else
-			doshell();
-	} else {
-		sa.sa_handler = resize;
-		sigaction(SIGWINCH, &sa, NULL);
-	}
-	doinput();
+	if (child == 0)
+		doshell();
 
-	if (close_stream(timingfd) != 0)
-		errx(EXIT_FAILURE, _("write error"));
+	if (!timingfd)
+		timingfd = fdopen(STDERR_FILENO, "w");
+	do_io();
 	return EXIT_SUCCESS;
 }
 
-static void wait_for_empty_fd(int fd)
+/*
+ * Stop extremely silly gcc complaint on %c:
+ *  warning: `%c' yields only last 2 digits of year in some locales
+ */
+static void
+my_strftime(char *buf, size_t len, const char *fmt, const struct tm *tm) {
+	strftime(buf, len, fmt, tm);
+}
+
+#ifdef HAVE_LIBUTIL
+/* returns 1 if there is unread data on the fd */
+static int has_input(int fd)
 {
 	struct pollfd fds[] = {
 		{ .fd = fd, .events = POLLIN }
 	};
 
-	while (poll(fds, 1, 50) == 1);
+	return poll(fds, 1, 0) == 1;
 }
+#endif
 
-void
-doinput(void) {
-	ssize_t cc = 0;
-	char ibuf[BUFSIZ];
-
-	if (close_stream(fscript) != 0)
-		errx(EXIT_FAILURE, _("write error"));
-
-	while (die == 0) {
-		if ((cc = read(STDIN_FILENO, ibuf, BUFSIZ)) > 0) {
-			ssize_t wrt = write(master, ibuf, cc);
-			if (wrt < 0) {
-				warn (_("write failed"));
-				fail();
-			}
-		}
-		else if (cc < 0 && errno == EINTR && resized)
-		{
-			/* transmit window change information to the child */
-			if (isterm) {
-				ioctl(STDIN_FILENO, TIOCGWINSZ, (char *)&win);
-				ioctl(slave, TIOCSWINSZ, (char *)&win);
-			}
-			resized = 0;
+/*
+ * Forwards EOF from stdin (a non-terminal input) to the shell. For example:
+ *
+ *	echo "ps" | script
+ *
+ * The EOF has to be written when the shell has read all the previous
+ * input, otherwise the EOF may be ignored and the typescript is incomplete.
+ */
+static void write_eof(void)
+{
+	char c = DEF_EOF;
 
-		} else
-			break;
+	if (write_all(master, &c, 1)) {
+		warn (_("write failed"));
+		fail();
 	}
+}
 
-	/* To be sure that we don't miss any data */
-	wait_for_empty_fd(slave);
-	wait_for_empty_fd(master);
-
-	if (cc == 0 && errno == 0) {
-		/*
-		 * Forward EOF from stdin (detected by read() above) to slave
-		 * (shell) to correctly terminate the session. It seems we have
-		 * to wait for empty terminal FDs otherwise EOF maybe ignored
-		 * (why?) and typescript is incomplete.      -- kzak Dec-2013
-		 *
-		 * We usually use this when stdin is not a tty, for example:
-		 * echo "ps" | script
-		 */
-		int c = DEF_EOF;
-
-		if (write(master, &c, 1) < 0) {
-			warn (_("write failed"));
-			fail();
-		}
+static void write_output(char *obuf, ssize_t cc, struct timeval *tv)
+{
+	if (tflg) {
+		double newtime = tv->tv_sec + (double) tv->tv_usec / 1000000;
 
-		/* wait for "exit" message from shell before we print "Script
-		 * done" in done() */
-		wait_for_empty_fd(master);
+		fprintf(timingfd, "%f %zd\n", newtime - oldtime, cc);
+		oldtime = newtime;
 	}
-
-	finish(0);	/* wait for childern */
-	done();
+	if (write_all(STDOUT_FILENO, obuf, cc)) {
+		warn (_("write failed"));
+		fail();
+	}
+	if (fwrite_all(obuf, 1, cc, fscript)) {
+		warn (_("cannot write script file"));
+		fail();
+	}
+	if (fflg)
+		fflush(fscript);
 }
 
-void
-finish(int dummy __attribute__ ((__unused__))) {
-	int status;
-	pid_t pid;
-	int errsv = errno;
-
-	while ((pid = wait3(&status, WNOHANG, 0)) > 0)
-		if (pid == child) {
-			childstatus = status;
-			die = 1;
-		}
+/*
+ * Reads all the available output (the master is non-blocking). Returns the
+ * number of bytes or -1 if the master is closed.
+ */
+static ssize_t read_output(char *obuf, size_t sz)
+{
+	size_t len = 0;
 
-	errno = errsv;
-}
+	while (len < sz) {
+		ssize_t cc = read(master, obuf + len, sz - len);
 
-void
-resize(int dummy __attribute__ ((__unused__))) {
-	resized = 1;
+		if (cc > 0) {
+			len += cc;
+			continue;
+		}
+		if (cc < 0 && errno == EINTR)
+			continue;
+		if (len || (cc < 0 && errno == EAGAIN))
+			break;
+		return -1;		/* EOF or EIO */
+	}
+	return len;
 }
 
 /*
- * Stop extremely silly gcc complaint on %c:
- *  warning: `%c' yields only last 2 digits of year in some locales
+ * Copies stdin to the shell, and the shell output to stdout and to the
+ * typescript. The signals are read from signalfd and the master is
+ * non-blocking, so all is done by one process with one poll() loop.
  */
-static void
-my_strftime(char *buf, size_t len, const char *fmt, const struct tm *tm) {
-	strftime(buf, len, fmt, tm);
-}
-
 void
-dooutput(FILE *timingfd) {
-	ssize_t cc;
-	time_t tvec;
-	char obuf[BUFSIZ];
+do_io(void) {
+	static char obuf[SCRIPT_BUFSIZ], ibuf[SCRIPT_BUFSIZ];
+	enum { POLLFD_SIGNAL = 0, POLLFD_MASTER, POLLFD_STDIN };
+	struct pollfd pfd[3];
+	struct signalfd_siginfo info;
 	struct timeval tv;
-	double oldtime=time(NULL), newtime;
-	int flgs = 0;
-	ssize_t wrt;
-	ssize_t fwrt;
+	time_t tvec;
+	sigset_t mask;
+	int sigfd, eof = 0, mclosed = 0, done_io = 0;
+	size_t ioff = 0, ilen = 0;	/* input not written to the master yet */
+	ssize_t cc;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGWINCH);
+	sigfd = signalfd(-1, &mask, SFD_CLOEXEC);
+	if (sigfd < 0) {
+		warn(_("cannot create signalfd"));
+		fail();
+	}
+	if (fcntl(master, F_SETFL, fcntl(master, F_GETFL, 0) | O_NONBLOCK) == -1) {
+		warn(_("cannot set master non-blocking"));
+		fail();
+	}
 
-	close(STDIN_FILENO);
-#ifdef HAVE_LIBUTIL
-	close(slave);
-#endif
 	tvec = time((time_t *)NULL);
+	oldtime = tvec;
 	my_strftime(obuf, sizeof obuf, "%c\n", localtime(&tvec));
 	fprintf(fscript, _("Script started on %s"), obuf);
 
-	do {
-		if (die && flgs == 0) {
-			/* ..child is dead, but it doesn't mean that there is
-			 * nothing in buffers.
-			 */
-			flgs = fcntl(master, F_GETFL, 0);
-			if (fcntl(master, F_SETFL, (flgs | O_NONBLOCK)) == -1)
-				break;
-		}
+	pfd[POLLFD_SIGNAL].fd = sigfd;
+	pfd[POLLFD_SIGNAL].events = POLLIN;
+	pfd[POLLFD_STDIN].events = POLLIN;
+
+	while (!done_io) {
+		int rc;
+
+		/* don't read more input than the shell is able to get */
+		pfd[POLLFD_MASTER].fd = mclosed ? -1 : master;
+		pfd[POLLFD_MASTER].events = POLLIN | (ilen ? POLLOUT : 0);
+		pfd[POLLFD_STDIN].fd = eof || ilen ? -1 : STDIN_FILENO;
+
+		/* the timing of the output is the time before the wait for
+		 * it, scriptreplay expects it */
 		if (tflg)
 			gettimeofday(&tv, NULL);
 
-		errno = 0;
-		cc = read(master, obuf, sizeof (obuf));
-
-		if (die && errno == EINTR && cc <= 0)
-			/* read() has been interrupted by SIGCHLD, try it again
-			 * with O_NONBLOCK
-			 */
+		/* after EOF on stdin poll with timeout to see when the shell
+		 * has read all the input and there is no output */
+		rc = poll(pfd, ARRAY_SIZE(pfd), eof == 1 ? 50 : -1);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			warn(_("poll failed"));
+			fail();
+		}
+		if (rc == 0 && eof == 1) {
+#ifdef HAVE_LIBUTIL
+			if (has_input(slave))
+				continue;
+#endif
+			write_eof();
+			eof = 2;
 			continue;
-		if (cc <= 0)
-			break;
-		if (tflg) {
-			newtime = tv.tv_sec + (double) tv.tv_usec / 1000000;
-			fprintf(timingfd, "%f %zd\n", newtime - oldtime, cc);
-			oldtime = newtime;
 		}
-		wrt = write(STDOUT_FILENO, obuf, cc);
-		if (wrt < 0) {
-			warn (_("write failed"));
-			fail();
+
+		if (pfd[POLLFD_MASTER].revents & (POLLIN | POLLHUP | POLLERR)) {
+			cc = read_output(obuf, sizeof(obuf));
+			if (cc > 0)
+				write_output(obuf, cc, &tv);
+			else if (cc < 0)
+				mclosed = 1;	/* wait for SIGCHLD */
 		}
-		fwrt = fwrite(obuf, 1, cc, fscript);
-		if (fwrt < cc) {
-			warn (_("cannot write script file"));
-			fail();
+
+		if (ilen && (pfd[POLLFD_MASTER].revents & POLLOUT)) {
+			cc = write(master, ibuf + ioff, ilen);
+			if (cc > 0) {
+				ioff += cc;
+				ilen -= cc;
+			} else if (cc < 0 && errno != EINTR && errno != EAGAIN) {
+				warn (_("write failed"));
+				fail();
+			}
 		}
-		if (fflg)
-			fflush(fscript);
-	} while(1);
 
-	if (flgs)
-		fcntl(master, F_SETFL, flgs);
-	if (close_stream(timingfd) != 0)
-		errx(EXIT_FAILURE, _("write error"));
+		if (pfd[POLLFD_STDIN].revents) {
+			cc = read(STDIN_FILENO, ibuf, sizeof(ibuf));
+			if (cc > 0) {
+				ioff = 0;
+				ilen = cc;
+			} else if (cc == 0 || (errno != EINTR && errno != EAGAIN)) {
+				/* forward EOF to the shell only for
+				 * non-terminal input, see write_eof() */
+				eof = isterm ? 2 : 1;
+			}
+		}
+
+		if (pfd[POLLFD_SIGNAL].revents &&
+		    read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+			if (info.ssi_signo == SIGWINCH) {
+				/* transmit window change information to the child */
+				if (isterm) {
+					ioctl(STDIN_FILENO, TIOCGWINSZ, (char *)&win);
+					ioctl(slave, TIOCSWINSZ, (char *)&win);
+				}
+			} else if (info.ssi_signo == SIGCHLD &&
+				   waitpid(child, &childstatus, WNOHANG) == child) {
+				/* ..child is dead, but it doesn't mean that
+				 * there is nothing in buffers */
+				do {
+					if (tflg)
+						gettimeofday(&tv, NULL);
+					cc = read_output(obuf, sizeof(obuf));
+					if (cc > 0)
+						write_output(obuf, cc, &tv);
+				} while (cc > 0);
+				done_io = 1;
+			}
+		}
+	}
+
+	close(sigfd);
 	done();
 }
 
@@ -490,6 +513,7 @@ doshell(void) {
 	 * Let's restore the default behavior.
 	 */
 	signal(SIGTERM, SIG_DFL);
+	sigprocmask(SIG_SETMASK, &oldmask, NULL);
 
 	if (access(shell, X_OK) == 0) {
 		if (cflg)
@@ -530,8 +554,8 @@ void __attribute__((__noreturn__))
 done(void) {
 	time_t tvec;
 
-	if (subchild) {
-		/* output process */
+	if (child > 0) {
+		/* the shell is running or we are after do_io() */
 		if (!qflg) {
 			char buf[BUFSIZ];
 			tvec = time((time_t *)NULL);
@@ -540,21 +564,18 @@ done(void) {
 		}
 		if (close_stream(fscript) != 0)
 			errx(EXIT_FAILURE, _("write error"));
-		close(master);
+		if (timingfd && close_stream(timingfd) != 0)
+			errx(EXIT_FAILURE, _("write error"));
+	}
 
-		master = -1;
-	} else {
-		/* input process */
-		if (isterm)
-			tcsetattr(STDIN_FILENO, TCSADRAIN, &tt);
-		if (!qflg)
-			printf(_("Script done, file is %s\n"), fname);
+	if (isterm)
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &tt);
+	if (!qflg)
+		printf(_("Script done, file is %s\n"), fname);
 #ifdef HAVE_LIBUTEMPTER
-		if (master >= 0)
-			utempter_remove_record(master);
+	if (master >= 0)
+		utempter_remove_record(master);
 #endif
-		kill(child, SIGTERM);	/* make sure we don't create orphans */
-	}
 
 	if(eflg) {
 		if (WIFSIGNALED(childstatus))
@@ -20,20 +20,23 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <time.h>
 #include <limits.h>
 #include <math.h>
-#include <sys/select.h>
 #include <unistd.h>
 #include <getopt.h>
 
 #include "closestream.h"
 #include "nls.h"
 #include "c.h"
+#include "all-io.h"
 
 #define SCRIPT_MIN_DELAY 0.0001		/* from original sripreplay.pl */
 
+#define EMIT_BUFSIZ	(64 * 1024)	/* max. size of coalesced output */
+
 static void __attribute__((__noreturn__))
 usage(FILE *out)
 {
@@ -46,6 +49,7 @@ usage(FILE *out)
 	fputs(_(" -t, --timing <file>     script timing output file\n"
 		" -s, --typescript <file> script terminal session output file\n"
 		" -d, --divisor <num>     speed up or slow down execution with time divisor\n"
+		" -m, --min-delay <num>   don't wait for delays shorter than <num> seconds\n"
 		" -V, --version           output version information and exit\n"
 		" -h, --help              display this help and exit\n\n"), out);
 
@@ -53,7 +57,7 @@ usage(FILE *out)
 }
 
 static double
-getnum(const char *s)
+getnum(const char *s, const char *errmesg)
 {
 	double d;
 	char *end;
@@ -65,41 +69,50 @@ getnum(const char *s)
 		errx(EXIT_FAILURE, _("expected a number, but got '%s'"), s);
 
 	if ((d == HUGE_VAL || d == -HUGE_VAL) && ERANGE == errno)
-		err(EXIT_FAILURE, _("divisor '%s'"), s);
+		err(EXIT_FAILURE, errmesg, s);
 
 	if (!(d==d)) { /* did they specify "nan"? */
 		errno = EINVAL;
-		err(EXIT_FAILURE, _("divisor '%s'"), s);
+		err(EXIT_FAILURE, errmesg, s);
 	}
 	return d;
 }
 
+/* seconds since start */
+static double
+time_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+	       (now.tv_nsec - start->tv_nsec) / 1.0e9;
+}
+
+/*
+ * Sleeps until start + elapsed. The deadlines are absolute, so the time
+ * spent by output and by the sleep wakeups is not accumulated.
+ */
 static void
-delay_for(double delay)
+delay_until(const struct timespec *start, double elapsed)
 {
-#ifdef HAVE_NANOSLEEP
-	struct timespec ts, remainder;
-	ts.tv_sec = (time_t) delay;
-	ts.tv_nsec = (delay - ts.tv_sec) * 1.0e9;
-
-	while (-1 == nanosleep(&ts, &remainder)) {
-		if (EINTR == errno)
-			ts = remainder;
-		else
-			break;
+	struct timespec ts;
+	time_t sec = (time_t) elapsed;
+
+	ts.tv_sec = start->tv_sec + sec;
+	ts.tv_nsec = start->tv_nsec + (long) ((elapsed - sec) * 1.0e9);
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
 	}
-#else
-	struct timeval tv;
-	tv.tv_sec = (long) delay;
-	tv.tv_usec = (delay - tv.tv_sec) * 1.0e6;
-	select(0, NULL, NULL, NULL, &tv);
-#endif
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
 }
 
 static void
 emit(FILE *fd, const char *filename, size_t ct)
 {
-	char buf[BUFSIZ];
+	static char buf[EMIT_BUFSIZ];
 
 	while(ct) {
 		size_t len, cc;
@@ -111,8 +124,7 @@ emit(FILE *fd, const char *filename, size_t ct)
 		       break;
 
 		ct -= len;
-		cc = write(STDOUT_FILENO, buf, len);
-		if (cc != len)
+		if (write_all(STDOUT_FILENO, buf, len))
 			err(EXIT_FAILURE, _("write to stdout failed"));
 	}
 
@@ -124,22 +136,58 @@ emit(FILE *fd, const char *filename, size_t ct)
 	err(EXIT_FAILURE, _("failed to read typescript file %s"), filename);
 }
 
+/*
+ * Parses the next "<delay> <size>" timing entry. Returns 0 on success, 1 at
+ * the end of the file and -1 in case of error.
+ */
+static int
+read_timing(FILE *f, char **buf, size_t *bufsz, double *delay, size_t *blk)
+{
+	char *p, *end;
+	ssize_t len;
+
+	do {
+		len = getline(buf, bufsz, f);
+		if (len <= 0)
+			return ferror(f) ? -1 : 1;
+		for (p = *buf; *p && isspace((unsigned char) *p); p++);
+	} while (!*p);			/* empty line */
+
+	if ((*buf)[len - 1] != '\n')
+		return 1;		/* incomplete last entry */
+
+	errno = 0;
+	*delay = strtod(p, &end);
+	if (errno || end == p || !isspace((unsigned char) *end))
+		goto fail;
+	p = end;
+	*blk = strtoul(p, &end, 10);
+	if (errno || end == p || *end != '\n')
+		goto fail;
+	return 0;
+fail:
+	errno = EINVAL;
+	return -1;
+}
 
 int
 main(int argc, char *argv[])
 {
 	FILE *tfile, *sfile;
 	const char *sname = NULL, *tname = NULL;
-	double divi = 1;
-	int c, diviopt = FALSE, idx;
+	double divi = 1, mindelay = SCRIPT_MIN_DELAY, elapsed = 0;
+	int c, diviopt = FALSE, idx, rc;
 	unsigned long line;
-	size_t oldblk = 0;
+	size_t oldblk = 0, pending = 0, bufsz = 0;
+	struct timespec start;
+	char *buf = NULL;
 	char ch;
 
 	static const struct option longopts[] = {
 		{ "timing",	required_argument,	0, 't' },
 		{ "typescript",	required_argument,	0, 's' },
 		{ "divisor",	required_argument,	0, 'd' },
+		{ "min-delay",	required_argument,	0, 'm' },
 		{ "version",	no_argument,		0, 'V' },
 		{ "help",	no_argument,		0, 'h' },
 		{ NULL,		0, 0, 0 }
@@ -156,7 +204,7 @@ main(int argc, char *argv[])
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while ((ch = getopt_long(argc, argv, "t:s:d:Vh", longopts, NULL)) != -1)
+	while ((ch = getopt_long(argc, argv, "t:s:d:m:Vh", longopts, NULL)) != -1)
 		switch(ch) {
 		case 't':
 			tname = optarg;
@@ -166,7 +214,10 @@ main(int argc, char *argv[])
 			break;
 		case 'd':
 			diviopt = TRUE;
-			divi = getnum(optarg);
+			divi = getnum(optarg, _("divisor '%s'"));
+			break;
+		case 'm':
+			mindelay = getnum(optarg, _("minimal delay '%s'"));
 			break;
 		case 'V':
 			printf(_("%s from %s\n"), program_invocation_short_name,
@@ -190,7 +241,7 @@ main(int argc, char *argv[])
 	if (!sname)
 		sname = idx < argc ? argv[idx++] : "typescript";
 	if (!diviopt)
-		divi = idx < argc ? getnum(argv[idx]) : 1;
+		divi = idx < argc ? getnum(argv[idx], _("divisor '%s'")) : 1;
 
 	tfile = fopen(tname, "r");
 	if (!tfile)
@@ -202,14 +253,16 @@ main(int argc, char *argv[])
 	/* ignore the first typescript line */
 	while((c = fgetc(sfile)) != EOF && c != '\n');
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	for(line = 0; ; line++) {
 		double delay;
 		size_t blk;
-		char nl;
-		if (fscanf(tfile, "%lf %zu%c\n", &delay, &blk, &nl) != 3 ||
-				                                 nl != '\n') {
-			if (feof(tfile))
-				break;
+
+		rc = read_timing(tfile, &buf, &bufsz, &delay, &blk);
+		if (rc == 1)
+			break;
+		if (rc < 0) {
 			if (ferror(tfile))
 				err(EXIT_FAILURE,
 					_("failed to read timing file %s"), tname);
@@ -217,16 +270,25 @@ main(int argc, char *argv[])
 				_("timings file %s: %lu: unexpected format"),
 				tname, line);
 		}
-		delay /= divi;
+		elapsed += delay / divi;
 
-		if (delay > SCRIPT_MIN_DELAY)
-			delay_for(delay);
+		/* the blocks in the shorter delays are written at once */
+		if (elapsed - time_since(&start) > mindelay) {
+			emit(sfile, sname, pending);
+			pending = 0;
+			delay_until(&start, elapsed);
+		}
 
-		if (oldblk)
-			emit(sfile, sname, oldblk);
+		pending += oldblk;
 		oldblk = blk;
+		if (pending >= EMIT_BUFSIZ) {
+			emit(sfile, sname, pending);
+			pending = 0;
+		}
 	}
+	emit(sfile, sname, pending);
 
+	free(buf);
 	fclose(sfile);
 	fclose(tfile);
 	printf("\n");
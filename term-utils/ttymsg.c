@@ -52,8 +52,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <poll.h>
+#include <time.h>
 
 #include "nls.h"
+#include "xalloc.h"
 #include "closestream.h"
 #include "pathnames.h"
 #include "ttymsg.h"
@@ -190,3 +193,159 @@ ttymsg(struct iovec *iov, size_t iovcnt, char *line, int tmout) {
 		_exit(EXIT_SUCCESS);
 	return (NULL);
 }
+
+/*
+ * Terminal with not yet written message, see ttymsg_all().
+ */
+struct ttymsg_tty {
+	const char	*line;
+	int		fd;
+	size_t		done;		/* already written bytes */
+	int64_t		deadline;	/* in milliseconds */
+};
+
+static int64_t now_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* returns 1 if the message has been written (or failed), 0 if would block */
+static int tty_write(struct ttymsg_tty *t, const char *buf, size_t len)
+{
+	while (t->done < len) {
+		ssize_t n = write(t->fd, buf + t->done, len - t->done);
+
+		if (n > 0) {
+			t->done += n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EWOULDBLOCK)
+			return 0;
+		/*
+		 * We get ENODEV on a slip line if we're running as root,
+		 * and EIO if the line just went away.
+		 */
+		if (n < 0 && errno != ENODEV && errno != EIO)
+			warn("%s%s", _PATH_DEV, t->line);
+		break;
+	}
+	close(t->fd);
+	return 1;
+}
+
+/* waits for the pending terminals, removes the finished and timed out */
+static void tty_poll(struct ttymsg_tty *ttys, size_t *nttys, struct pollfd *fds,
+		     const char *buf, size_t len)
+{
+	int64_t now = now_msec(), tmout = -1;
+	size_t i;
+	int rc;
+
+	for (i = 0; i < *nttys; i++) {
+		fds[i].fd = ttys[i].fd;
+		fds[i].events = POLLOUT;
+		fds[i].revents = 0;
+		if (tmout < 0 || ttys[i].deadline - now < tmout)
+			tmout = max(ttys[i].deadline - now, (int64_t) 0);
+	}
+
+	rc = poll(fds, *nttys, (int) tmout);
+	if (rc < 0 && errno != EINTR)
+		err(EXIT_FAILURE, _("poll failed"));
+
+	now = now_msec();
+	for (i = *nttys; i > 0; i--) {
+		struct ttymsg_tty *t = &ttys[i - 1];
+		int done;
+
+		if (rc > 0 && fds[i - 1].revents)
+			done = tty_write(t, buf, len);
+		else
+			done = 0;
+		if (!done && t->deadline <= now) {
+			close(t->fd);		/* hung terminal */
+			done = 1;
+		}
+		if (done)
+			*t = ttys[--(*nttys)];
+	}
+}
+
+/*
+ * Writes the message to all the @lines. The terminals are opened in
+ * non-blocking mode and the rest of the message that would block is written
+ * by one child process from one poll() loop, every terminal gets at most
+ * @tmout seconds. The errors are reported by warn(), the "normal" errors are
+ * ignored in the same way as by ttymsg().
+ */
+void ttymsg_all(const char *buf, size_t len, char **lines, size_t nlines, int tmout)
+{
+	struct ttymsg_tty *ttys;
+	struct pollfd *fds;
+	size_t i, nttys = 0;
+
+	if (!nlines)
+		return;
+
+	ttys = xcalloc(nlines, sizeof(*ttys));
+	fds = xcalloc(nlines, sizeof(*fds));
+
+	for (i = 0; i < nlines; i++) {
+		char device[MAXNAMLEN];
+		struct ttymsg_tty *t = &ttys[nttys];
+
+		if (strlen(lines[i]) + sizeof(_PATH_DEV) + 1 > sizeof(device)) {
+			warnx(_("excessively long line arg"));
+			continue;
+		}
+		sprintf(device, "%s%s", _PATH_DEV, lines[i]);
+
+		/* out of file descriptors, wait for the pending terminals */
+		while ((t->fd = open(device, O_WRONLY|O_NONBLOCK, 0)) < 0 &&
+		       errno == EMFILE && nttys) {
+			tty_poll(ttys, &nttys, fds, buf, len);
+			t = &ttys[nttys];
+		}
+		/*
+		 * open will fail on slip lines or exclusive-use lines
+		 * if not running as root; not an error.
+		 */
+		if (t->fd < 0) {
+			if (errno != EBUSY && errno != EACCES)
+				warn("%s", device);
+			continue;
+		}
+		t->line = lines[i];
+		t->done = 0;
+		t->deadline = now_msec() + (int64_t) tmout * 1000;
+
+		if (!tty_write(t, buf, len))
+			nttys++;
+	}
+
+	if (nttys) {
+		pid_t pid = fork();
+
+		if (pid == 0) {
+			while (nttys)
+				tty_poll(ttys, &nttys, fds, buf, len);
+			_exit(EXIT_SUCCESS);
+		}
+		if (pid > 0) {
+			/* parent, the child finishes the work */
+			for (i = 0; i < nttys; i++)
+				close(ttys[i].fd);
+		} else {
+			while (nttys)
+				tty_poll(ttys, &nttys, fds, buf, len);
+		}
+	}
+
+	free(ttys);
+	free(fds);
+}
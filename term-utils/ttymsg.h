@@ -1,2 +1,3 @@
 char *ttymsg(struct iovec *iov, size_t iovcnt, char *line, int tmout);
 
+void ttymsg_all(const char *buf, size_t len, char **lines, size_t nlines, int tmout);
@@ -94,10 +94,9 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 int main(int argc, char **argv)
 {
 	int ch;
-	struct iovec iov;
 	struct utmp *utmpptr;
-	char *p;
-	char line[sizeof(utmpptr->ut_line) + 1];
+	char **lines = NULL;
+	size_t nlines = 0, i;
 	int print_banner = TRUE;
 	char *mbuf, *fname = NULL;
 	size_t mbufsize;
@@ -152,8 +151,6 @@ int main(int argc, char **argv)
 
 	mbuf = makemsg(fname, mvec, mvecsz, &mbufsize, print_banner);
 
-	iov.iov_base = mbuf;
-	iov.iov_len = mbufsize;
 	while((utmpptr = getutent())) {
 		if (!utmpptr->ut_user[0])
 			continue;
@@ -167,11 +164,19 @@ int main(int argc, char **argv)
 		if (utmpptr->ut_line[0] == ':')
 			continue;
 
-		xstrncpy(line, utmpptr->ut_line, sizeof(utmpptr->ut_line));
-		if ((p = ttymsg(&iov, 1, line, timeout)) != NULL)
-			warnx("%s", p);
+		if (nlines % 64 == 0)
+			lines = xrealloc(lines, (nlines + 64) * sizeof(char *));
+		lines[nlines++] = xstrndup(utmpptr->ut_line,
+					   sizeof(utmpptr->ut_line));
 	}
 	endutent();
+
+	/* all the terminals at once, a hung terminal does not delay the others */
+	ttymsg_all(mbuf, mbufsize, lines, nlines, timeout);
+
+	for (i = 0; i < nlines; i++)
+		free(lines[i]);
+	free(lines);
 	free(mbuf);
 	exit(EXIT_SUCCESS);
 }
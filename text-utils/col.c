@@ -112,7 +112,7 @@ int no_backspaces;		/* if not to output any backspaces */
 int pass_unknown_seqs;		/* whether to pass unknown control sequences */
 
 #define	PUTC(ch) \
-	if (putwchar(ch) == WEOF) \
+	if (putwchar_mb(ch) == WEOF) \
 		wrerr();
 
 static void __attribute__((__noreturn__)) usage(FILE *out)
@@ -224,7 +224,7 @@ int main(int argc, char **argv)
 
 	while (feof(stdin) == 0) {
 		errno = 0;
-		if ((ch = getwchar()) == WEOF) {
+		if ((ch = getwchar_unlocked()) == WEOF) {
 			if (errno == EILSEQ) {
 				warn(NULL);
 				ret = EXIT_FAILURE;
@@ -242,7 +242,7 @@ int main(int argc, char **argv)
 				cur_col = 0;
 				continue;
 			case ESC:		/* just ignore EOF */
-				switch(getwchar()) {
+				switch(getwchar_unlocked()) {
 				case RLF:
 					cur_line -= 2;
 					break;
@@ -152,7 +152,7 @@ void colcrt(FILE *f) {
 	int i, w;
 
 	for (;;) {
-		c = getwc(f);
+		c = getwc_unlocked(f);
 		if (c == WEOF) {
 			pflush(outline);
 			fflush(stdout);
@@ -169,7 +169,7 @@ void colcrt(FILE *f) {
 		case '\017':
 			continue;
 		case 033:
-			c = getwc(f);
+			c = getwc_unlocked(f);
 			switch (c) {
 			case '9':
 				if (outline >= 266)
@@ -269,12 +269,12 @@ void pflush(int ol)
 		lastomit = 0;
 		while (*cp) {
 			if ((w = wcwidth(*cp)) > 0) {
-				putwchar(*cp);
+				putwchar_mb(*cp);
 				cp += w;
 			} else
 				cp++;
 		}
-		putwchar('\n');
+		putwchar_mb('\n');
 	}
 	memmove(page, page[ol], (267 - ol) * 132 * sizeof(wchar_t));
 	memset(page[267 - ol], '\0', ol * 132 * sizeof(wchar_t));
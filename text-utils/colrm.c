@@ -40,6 +40,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 #include <unistd.h>
 
@@ -70,18 +71,75 @@ static void __attribute__ ((__noreturn__)) usage(FILE * out)
 	exit(out == stderr ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
-static int process_input(unsigned long first, unsigned long last)
+/* decodes the next character of the line, WEOF at the end of the line */
+static wint_t next_wc(const char **p, const char *end, int *rc)
 {
+#ifdef HAVE_WIDECHAR
+	wchar_t wc;
+	mbstate_t st;
+	size_t n;
+
+	if (*p >= end)
+		return WEOF;
+	memset(&st, 0, sizeof(st));
+	n = mbrtowc(&wc, *p, end - *p, &st);
+	if (n == (size_t) -1 || n == (size_t) -2) {
+		*rc = 0;	/* invalid or incomplete, stop as getwc() */
+		return WEOF;
+	}
+	*p += n ? n : 1;
+	return wc;
+#else
+	if (*p >= end)
+		return WEOF;
+	return (unsigned char) *(*p)++;
+#endif
+}
+
+/* printable ASCII only, all the characters are one column wide */
+static int is_ascii_line(const char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] < 0x20 || buf[i] > 0x7e)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Processes one line (the last line may be without '\n'). Returns 1 to
+ * continue, or 0 on invalid multibyte sequence.
+ */
+static int process_line(const char *buf, size_t len,
+			unsigned long first, unsigned long last)
+{
+	const char *p = buf, *end = buf + len;
 	unsigned long ct = 0;
 	wint_t c;
 	unsigned long i;
 	int w;
 	int padding;
+	int rc = 1;
+	int nl = len && buf[len - 1] == '\n';
+
+	/* copy the column ranges */
+	if (is_ascii_line(buf, len - nl) && (!last || last >= first)) {
+		size_t sz = len - nl;
+
+		fwrite(buf, 1, first ? min(first - 1, sz) : sz, stdout);
+		if (first && last && last < sz)
+			fwrite(buf + last, 1, sz - last, stdout);
+		if (nl)
+			putchar('\n');
+		return 1;
+	}
 
 	for (;;) {
-		c = getwc(stdin);
+		c = next_wc(&p, end, &rc);
 		if (c == WEOF)
-			return 0;
+			return rc;
 		if (c == '\t')
 			w = ((ct + 8) & ~7) - ct;
 		else if (c == '\b')
@@ -93,28 +151,26 @@ static int process_input(unsigned long first, unsigned long last)
 		}
 		ct += w;
 		if (c == '\n') {
-			putwc(c, stdout);
-			ct = 0;
-			continue;
-
+			putwchar_mb(c);
+			return 1;
 		}
 		if (!first || ct < first) {
-			putwc(c, stdout);
+			putwchar_mb(c);
 			continue;
 		}
 		break;
 	}
 
 	for (i = ct - w + 1; i < first; i++)
-		putwc(' ', stdout);
+		putwchar_mb(' ');
 
 	/* Loop getting rid of characters */
 	while (!last || ct < last) {
-		c = getwc(stdin);
+		c = next_wc(&p, end, &rc);
 		if (c == WEOF)
-			return 0;
+			return rc;
 		if (c == '\n') {
-			putwc(c, stdout);
+			putwchar_mb(c);
 			return 1;
 		}
 		if (c == '\t')
@@ -133,26 +189,29 @@ static int process_input(unsigned long first, unsigned long last)
 
 	/* Output last of the line */
 	for (;;) {
-		c = getwc(stdin);
+		c = next_wc(&p, end, &rc);
 		if (c == WEOF)
 			break;
 		if (c == '\n') {
-			putwc(c, stdout);
+			putwchar_mb(c);
 			return 1;
 		}
 		if (padding == 0 && last < ct) {
 			for (i = last; i < ct; i++)
-				putwc(' ', stdout);
+				putwchar_mb(' ');
 			padding = 1;
 		}
-		putwc(c, stdout);
+		putwchar_mb(c);
 	}
-	return 0;
+	return rc;
 }
 
 int main(int argc, char **argv)
 {
 	unsigned long first = 0, last = 0;
+	char *buf = NULL;
+	size_t sz = 0;
+	ssize_t len;
 	int opt;
 
 	static const struct option longopts[] = {
@@ -186,8 +245,13 @@ int main(int argc, char **argv)
 	if (argc > 2)
 		last = strtoul_or_err(*++argv, _("second argument"));
 
-	while (process_input(first, last))
-		;
+	/* the lines are read as bytes and decoded by mbrtowc(), the
+	 * printable ASCII lines are copied without decoding */
+	while ((len = getline(&buf, &sz, stdin)) > 0) {
+		if (!process_line(buf, len, first, last))
+			break;
+	}
+	free(buf);
 
 	fflush(stdout);
 	return EXIT_SUCCESS;
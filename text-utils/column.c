@@ -48,6 +48,9 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#ifdef HAVE_LANGINFO_H
+# include <langinfo.h>
+#endif
 
 #include "nls.h"
 #include "widechar.h"
@@ -56,6 +59,7 @@
 #include "strutils.h"
 #include "closestream.h"
 #include "ttyutils.h"
+#include "tt.h"
 
 #ifdef HAVE_WIDECHAR
 #define wcs_width(s) wcswidth(s,wcslen(s))
@@ -78,12 +82,56 @@ static void r_columnate(int maxlength, long termwidth, wchar_t **list, int entri
 static wchar_t *local_wcstok(wchar_t *p, const wchar_t *separator, int greedy, wchar_t **wcstok_state);
 static void maketbl(wchar_t **list, int entries, wchar_t *separator, int greedy, wchar_t *colsep);
 static void print(wchar_t **list, int entries);
+static int btable_usable(const char *sep);
 
 typedef struct _tbl {
 	wchar_t **list;
 	int cols, *len;
 } TBL;
 
+/*
+ * Byte oriented table (-t) for UTF-8 and single-byte locales. The lines are
+ * kept in one buffer as they are read, the cells are found when the line is
+ * measured and again when printed. The display width is calculated by
+ * libc only for cells with non-ASCII (or non-printable) bytes.
+ *
+ * In two-pass mode the input files are read twice and nothing is kept in
+ * memory, the first pass calculates width of the columns.
+ *
+ * The table is printed by lib/tt.c if the column names, JSON or the output
+ * width are requested.
+ */
+struct btable {
+	unsigned char	issep[256];	/* input separators */
+	int		greedy;
+	const char	*colsep;	/* output separator */
+	int		twopass;
+
+	char		*colnames;	/* --table-columns */
+	const char	*name;		/* --table-name */
+	size_t		outwidth;	/* --output-width */
+	int		json;		/* --json */
+
+	ssize_t		*widths;	/* width of the columns */
+	size_t		ncols;		/* allocated widths */
+	size_t		maxcols;	/* max number of cells in line */
+
+	char		*buf;		/* all lines, zero terminated */
+	size_t		bufsz;
+	size_t		bufused;
+	size_t		*lines;		/* offsets of the lines in buf */
+	size_t		nlines;
+
+	off_t		stdin_off;	/* two-pass stdin start */
+};
+
+enum {
+	BTABLE_MEASURE,
+	BTABLE_PRINT
+};
+
+static int btable(struct btable *tb, char **files, const char *sep);
+
 static void __attribute__((__noreturn__)) usage(int rc)
 {
 	FILE *out = rc == EXIT_FAILURE ? stderr : stdout;
@@ -93,10 +141,16 @@ static void __attribute__((__noreturn__)) usage(int rc)
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -c, --columns <width>    width of output in number of characters\n"), out);
 	fputs(_(" -t, --table              create a table\n"), out);
+	fputs(_(" -N, --table-columns <names>  comma separated columns names\n"), out);
+	fputs(_(" -n, --table-name <name>  table name for JSON output\n"), out);
+	fputs(_(" -J, --json               use JSON output format for table\n"), out);
+	fputs(_("     --output-width <width>  width of table output\n"), out);
 	fputs(_(" -s, --separator <string> possible table delimiters\n"), out);
 	fputs(_(" -o, --output-separator <string>\n"
 	        "                          columns separator for table output; default is two spaces\n"), out);
 	fputs(_(" -x, --fillrows           fill rows before columns\n"), out);
+	fputs(_("     --two-pass           read the input files twice, don't keep the\n"
+		"                          table in memory\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	fputs(USAGE_HELP, out);
 	fputs(USAGE_VERSION, out);
@@ -120,19 +174,33 @@ int main(int argc, char **argv)
 	/* field separator for table option */
 	wchar_t default_separator[] = { '\t', ' ', 0 };
 	wchar_t *separator = default_separator;
+	const char *separator_mbs = "\t ";
+	struct btable tb;
 
+	enum {
+		OPT_TWO_PASS = CHAR_MAX + 1,
+		OPT_OUTPUT_WIDTH
+	};
 	static const struct option longopts[] =
 	{
 		{ "help",	0, 0, 'h' },
 		{ "version",    0, 0, 'V' },
 		{ "columns",	1, 0, 'c' },
 		{ "table",	0, 0, 't' },
+		{ "table-columns", 1, 0, 'N' },
+		{ "table-name",	1, 0, 'n' },
+		{ "json",	0, 0, 'J' },
+		{ "output-width", 1, 0, OPT_OUTPUT_WIDTH },
 		{ "separator",	1, 0, 's' },
 		{ "output-separator", 1, 0, 'o' },
 		{ "fillrows",	0, 0, 'x' },
+		{ "two-pass",	0, 0, OPT_TWO_PASS },
 		{ NULL,		0, 0, 0 },
 	};
 
+	memset(&tb, 0, sizeof(tb));
+	tb.colsep = "  ";
+
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
 	textdomain(PACKAGE);
@@ -143,7 +211,7 @@ int main(int argc, char **argv)
 		termwidth = 80;
 	colsep = mbs_to_wcs("  ");
 
-	while ((ch = getopt_long(argc, argv, "hVc:s:txo:", longopts, NULL)) != -1)
+	while ((ch = getopt_long(argc, argv, "hVc:s:txo:N:n:J", longopts, NULL)) != -1)
 		switch(ch) {
 		case 'h':
 			usage(EXIT_SUCCESS);
@@ -157,11 +225,13 @@ int main(int argc, char **argv)
 			break;
 		case 's':
 			separator = mbs_to_wcs(optarg);
+			separator_mbs = optarg;
 			greedy = 0;
 			break;
 		case 'o':
 			free(colsep);
 			colsep = mbs_to_wcs(optarg);
+			tb.colsep = optarg;
 			break;
 		case 't':
 			tflag = 1;
@@ -169,12 +239,44 @@ int main(int argc, char **argv)
 		case 'x':
 			xflag = 1;
 			break;
+		case OPT_TWO_PASS:
+			tb.twopass = 1;
+			break;
+		case OPT_OUTPUT_WIDTH:
+			tb.outwidth = strtou32_or_err(optarg, _("invalid columns argument"));
+			break;
+		case 'N':
+			tb.colnames = optarg;
+			break;
+		case 'n':
+			tb.name = optarg;
+			break;
+		case 'J':
+			tb.json = 1;
+			break;
 		default:
 			usage(EXIT_FAILURE);
 	}
 	argc -= optind;
 	argv += optind;
 
+	if (!tflag && (tb.twopass || tb.colnames || tb.name || tb.json ||
+		       tb.outwidth))
+		errx(EXIT_FAILURE, _("table options require --table"));
+	if (tb.json && !tb.colnames)
+		errx(EXIT_FAILURE, _("--json requires --table-columns"));
+	if (tb.twopass && (tb.colnames || tb.json || tb.outwidth))
+		errx(EXIT_FAILURE, _("--two-pass cannot be combined with "
+				     "--table-columns, --json or --output-width"));
+
+	if (tflag && btable_usable(separator_mbs)) {
+		tb.greedy = greedy;
+		return btable(&tb, argv, separator_mbs);
+	}
+	if (tb.colnames || tb.json || tb.outwidth)
+		errx(EXIT_FAILURE, _("--table-columns, --json and --output-width "
+				     "are unsupported in this locale"));
+
 	if (!*argv)
 		eval += input(stdin, &maxlength, &list, &entries);
 	else
@@ -410,6 +512,353 @@ static int input(FILE *fp, int *maxlength, wchar_t ***list, int *entries)
 	return eval;
 }
 
+/*
+ * The byte oriented table is possible if the input separators are ASCII
+ * and a multi-byte sequence cannot contain ASCII bytes.
+ */
+static int btable_usable(const char *sep)
+{
+	const unsigned char *p;
+
+	for (p = (const unsigned char *) sep; *p; p++) {
+		if (*p >= 0x80)
+			return 0;
+	}
+#if defined(HAVE_WIDECHAR) && defined(HAVE_LANGINFO_H)
+	if (MB_CUR_MAX > 1 && strcmp(nl_langinfo(CODESET), "UTF-8") != 0)
+		return 0;
+#endif
+	return 1;
+}
+
+/* the same as wcswidth() of the converted cell, -1 for non-printable */
+static ssize_t cell_width(const char *s, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) s;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (p[i] < 0x20 || p[i] >= 0x7f)
+			break;
+	}
+	if (i == len)
+		return len;		/* printable ASCII only */
+#ifdef HAVE_WIDECHAR
+	{
+		mbstate_t st;
+		ssize_t width = i;
+
+		memset(&st, 0, sizeof(st));
+		while (i < len) {
+			wchar_t wc;
+			size_t n = mbrtowc(&wc, s + i, len - i, &st);
+			int w;
+
+			if (n == (size_t) -1 || n == (size_t) -2) {
+				/* invalid sequence, count bytes */
+				memset(&st, 0, sizeof(st));
+				width++;
+				i++;
+				continue;
+			}
+			if (n == 0)
+				n = 1;
+			w = wcwidth(wc);
+			if (w < 0)
+				return -1;
+			width += w;
+			i += n;
+		}
+		return width;
+	}
+#else
+	for (; i < len; i++) {
+		if (!isprint(p[i]))
+			return -1;
+	}
+	return len;
+#endif
+}
+
+static int is_blank_line(const char *s)
+{
+#ifdef HAVE_WIDECHAR
+	mbstate_t st;
+
+	memset(&st, 0, sizeof(st));
+	while (*s) {
+		wchar_t wc;
+		size_t n;
+
+		if ((unsigned char) *s < 0x80) {
+			if (!isspace((unsigned char) *s))
+				return 0;
+			s++;
+			continue;
+		}
+		n = mbrtowc(&wc, s, strlen(s), &st);
+		if (n == (size_t) -1 || n == (size_t) -2 || !iswspace(wc))
+			return 0;
+		s += n;
+	}
+	return 1;
+#else
+	for (; *s; s++) {
+		if (!isspace((unsigned char) *s))
+			return 0;
+	}
+	return 1;
+#endif
+}
+
+/*
+ * Returns the next cell of the line, the same rules as local_wcstok():
+ * the greedy mode ignores empty cells.
+ */
+static const char *btable_next_cell(struct btable *tb, const char **state,
+				    const char *end, size_t *len)
+{
+	const char *p = *state, *cell;
+
+	if (!p)
+		return NULL;
+	if (tb->greedy) {
+		while (p < end && tb->issep[(unsigned char) *p])
+			p++;
+		if (p == end) {
+			*state = NULL;
+			return NULL;
+		}
+	}
+	cell = p;
+	while (p < end && !tb->issep[(unsigned char) *p])
+		p++;
+
+	*len = p - cell;
+	*state = p < end ? p + 1 : NULL;
+	return cell;
+}
+
+static void btable_line(struct btable *tb, const char *line, size_t sz, int what)
+{
+	const char *state = line, *end = line + sz, *cell, *prev = NULL;
+	size_t len, prevlen = 0, col = 0;
+
+	while ((cell = btable_next_cell(tb, &state, end, &len))) {
+		if (what == BTABLE_MEASURE) {
+			ssize_t w = cell_width(cell, len);
+
+			if (col == tb->ncols) {
+				tb->widths = xrealloc(tb->widths,
+						(col + DEFCOLS) * sizeof(ssize_t));
+				memset(tb->widths + col, 0, DEFCOLS * sizeof(ssize_t));
+				tb->ncols += DEFCOLS;
+			}
+			if (w > tb->widths[col])
+				tb->widths[col] = w;
+		} else if (prev) {
+			/* not the last cell */
+			fwrite(prev, 1, prevlen, stdout);
+			printf("%*s", (int) (tb->widths[col - 1] -
+					     cell_width(prev, prevlen)), "");
+			fputs(tb->colsep, stdout);
+		}
+		prev = cell;
+		prevlen = len;
+		col++;
+	}
+	if (col > tb->maxcols)
+		tb->maxcols = col;
+	if (what == BTABLE_PRINT && prev) {
+		fwrite(prev, 1, prevlen, stdout);
+		fputc('\n', stdout);
+	}
+}
+
+static void btable_add_line(struct btable *tb, const char *line, size_t sz)
+{
+	if (tb->nlines % DEFNUM == 0)
+		tb->lines = xrealloc(tb->lines,
+				(tb->nlines + DEFNUM) * sizeof(size_t));
+	if (tb->bufused + sz + 1 > tb->bufsz) {
+		tb->bufsz = max(tb->bufsz * 2, tb->bufused + sz + 1);
+		tb->buf = xrealloc(tb->buf, tb->bufsz);
+	}
+	memcpy(tb->buf + tb->bufused, line, sz + 1);
+	tb->lines[tb->nlines++] = tb->bufused;
+	tb->bufused += sz + 1;
+}
+
+/* reads lines from @fp, the lines are stored or measured or printed */
+static void btable_read(struct btable *tb, FILE *fp, int twopass, int what)
+{
+	char *line = NULL;
+	size_t sz = 0;
+	ssize_t len;
+
+	while ((len = getline(&line, &sz, fp)) >= 0) {
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (is_blank_line(line))
+			continue;
+		if (twopass)
+			btable_line(tb, line, len, what);
+		else
+			btable_add_line(tb, line, len);
+	}
+	free(line);
+}
+
+/* calls btable_read() for all files (or stdin), returns number of errors */
+static int btable_read_files(struct btable *tb, char **files, int twopass, int what)
+{
+	int eval = 0;
+
+	if (!*files) {
+		if (twopass && what == BTABLE_PRINT &&
+		    fseeko(stdin, tb->stdin_off, SEEK_SET) != 0)
+			err(EXIT_FAILURE, _("cannot rewind stdin"));
+		btable_read(tb, stdin, twopass, what);
+		return 0;
+	}
+
+	for (; *files; files++) {
+		FILE *fp = fopen(*files, "r" UL_CLOEXECSTR);
+
+		if (!fp) {
+			if (what == BTABLE_MEASURE)
+				warn("%s", *files);
+			eval++;
+			continue;
+		}
+		btable_read(tb, fp, twopass, what);
+		fclose(fp);
+	}
+	return eval;
+}
+
+/*
+ * Prints the table by lib/tt.c, the cells are terminated in place in the
+ * lines buffer and used by the table without copying.
+ */
+static void btable_print_tt(struct btable *tb)
+{
+	struct tt *tt;
+	char *names = NULL, *name, *save = NULL, **xnames;
+	size_t i, n, ncols, nnamed;
+	int flags = 0;
+
+	if (tb->json)
+		flags |= TT_FL_JSON;
+	if (!tb->colnames)
+		flags |= TT_FL_NOHEADINGS;
+
+	tt = tt_new_table(flags);
+	if (!tt)
+		err(EXIT_FAILURE, _("failed to initialize output table"));
+	if (tb->name)
+		tt_set_name(tt, tb->name);
+	if (tb->outwidth)
+		tt_set_termwidth(tt, tb->outwidth);
+
+	/* named columns, the rest of the cells are in unnamed columns */
+	n = 1;
+	if (tb->colnames) {
+		names = xstrdup(tb->colnames);
+		for (name = names; *name; name++)
+			n += *name == ',';
+	}
+
+	/* the names are not copied by tt, JSON uses column numbers */
+	xnames = xcalloc(max(n, tb->maxcols) + 1, sizeof(char *));
+	nnamed = 0;
+	if (names) {
+		for (name = strtok_r(names, ",", &save); name;
+		     name = strtok_r(NULL, ",", &save))
+			xnames[nnamed++] = name;
+	}
+	ncols = max(nnamed, tb->maxcols);
+
+	for (i = nnamed; tb->json && i < ncols; i++)
+		xasprintf(&xnames[i], "%zu", i + 1);
+
+	/*
+	 * The measured widths are hints; only the last column is truncated if
+	 * the output is wider than the requested width.
+	 */
+	for (i = 0; i < ncols; i++) {
+		double whint = i < tb->maxcols ? tb->widths[i] : 0;
+
+		if (!tt_define_column(tt, xnames[i] ? xnames[i] : "", whint,
+				      i + 1 == ncols ? TT_FL_TRUNC : 0))
+			err(EXIT_FAILURE, _("failed to initialize output column"));
+	}
+
+	for (i = 0; i < tb->nlines; i++) {
+		char *line = tb->buf + tb->lines[i];
+		const char *state = line, *end = line + strlen(line), *cell;
+		struct tt_line *ln = tt_add_line(tt, NULL);
+		size_t len;
+
+		if (!ln)
+			err(EXIT_FAILURE, _("failed to initialize output line"));
+
+		for (n = 0; n < ncols &&
+			    (cell = btable_next_cell(tb, &state, end, &len)); n++) {
+			((char *) cell)[len] = '\0';
+			tt_line_set_data(ln, n, (char *) cell);
+		}
+	}
+
+	tt_print_table(tt);
+	tt_free_table(tt);
+
+	for (i = nnamed; i < ncols; i++)
+		free(xnames[i]);
+	free(xnames);
+	free(names);
+}
+
+static int btable(struct btable *tb, char **files, const char *sep)
+{
+	const unsigned char *p;
+	size_t i;
+	int eval;
+
+	for (p = (const unsigned char *) sep; *p; p++)
+		tb->issep[*p] = 1;
+
+	if (tb->twopass && !*files) {
+		tb->stdin_off = lseek(STDIN_FILENO, 0, SEEK_CUR);
+		if (tb->stdin_off < 0)
+			errx(EXIT_FAILURE, _("--two-pass requires seekable input"));
+	}
+
+	eval = btable_read_files(tb, files, tb->twopass, BTABLE_MEASURE);
+
+	if (tb->twopass)
+		btable_read_files(tb, files, tb->twopass, BTABLE_PRINT);
+	else {
+		for (i = 0; i < tb->nlines; i++) {
+			const char *line = tb->buf + tb->lines[i];
+			btable_line(tb, line, strlen(line), BTABLE_MEASURE);
+		}
+		if (tb->colnames || tb->json || tb->outwidth)
+			btable_print_tt(tb);
+		else {
+			for (i = 0; i < tb->nlines; i++) {
+				const char *line = tb->buf + tb->lines[i];
+				btable_line(tb, line, strlen(line), BTABLE_PRINT);
+			}
+		}
+	}
+
+	free(tb->widths);
+	free(tb->lines);
+	free(tb->buf);
+	return eval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 #ifdef HAVE_WIDECHAR
 static wchar_t *mbs_to_wcs(const char *s)
 {
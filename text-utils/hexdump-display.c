@@ -175,6 +175,117 @@ static void bpad(struct hexdump_pr *pr)
 		;
 }
 
+/*
+ * The well-known formats are displayed without the format interpreter, the
+ * output is the same as the output of the format strings from parse_args().
+ */
+static const char hex_digits[] = "0123456789abcdef";
+
+static char *put_hex(char *p, unsigned long long val, int ndigits)
+{
+	char tmp[sizeof(val) * 2];
+	int n = 0;
+
+	do {
+		tmp[n++] = hex_digits[val & 0xf];
+		val >>= 4;
+	} while (val);
+
+	while (ndigits-- > n)
+		*p++ = '0';
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+static char *put_pad(char *p, int n)
+{
+	while (n-- > 0)
+		*p++ = ' ';
+	return p;
+}
+
+/* "%08.8_ax  " 8/1 "%02x " "  " 8/1 "%02x "  "  |" 16/1 "%_p" "|\n" */
+static char *put_canonical(char *p, unsigned char *bp)
+{
+	static char printable[256];
+	int i;
+
+	if (!printable[0]) {
+		for (i = 0; i < 256; i++)
+			printable[i] = isprint(i) ? i : '.';
+	}
+
+	p = put_hex(p, address, 8);
+	p = put_pad(p, 2);
+
+	for (i = 0; i < 16; i++) {
+		if (eaddress && address + i >= eaddress)
+			p = put_pad(p, 2);
+		else {
+			*p++ = hex_digits[bp[i] >> 4];
+			*p++ = hex_digits[bp[i] & 0xf];
+		}
+		if (i == 7)
+			p = put_pad(p, 2);
+		else if (i != 15)
+			*p++ = ' ';
+	}
+
+	p = put_pad(p, 2);
+	*p++ = '|';
+	for (i = 0; i < 16; i++) {
+		if (eaddress && address + i >= eaddress)
+			break;
+		*p++ = printable[bp[i]];
+	}
+	*p++ = '|';
+	return p;
+}
+
+/* "%07.7_ax " 8/2 "%04x " or 8/2 "   %04x " for -x */
+static char *put_two_bytes_hex(char *p, unsigned char *bp, int pad)
+{
+	int i;
+
+	p = put_hex(p, address, 7);
+	*p++ = ' ';
+
+	for (i = 0; i < 16; i += 2) {
+		p = put_pad(p, pad);
+		if (eaddress && address + i >= eaddress)
+			p = put_pad(p, 4);
+		else {
+			uint16_t val;
+
+			memcpy(&val, bp + i, sizeof(val));
+			p = put_hex(p, val, 4);
+		}
+		if (i != 14)
+			*p++ = ' ';
+	}
+	return p;
+}
+
+static void display_block(struct hexdump *hex, unsigned char *bp)
+{
+	char buf[128], *p = buf;
+
+	switch (hex->format) {
+	case HEXDUMP_FMT_CANONICAL:
+		p = put_canonical(p, bp);
+		break;
+	case HEXDUMP_FMT_TWO_BYTES_HEX:
+		p = put_two_bytes_hex(p, bp, 3);
+		break;
+	case HEXDUMP_FMT_DEFAULT:
+		p = put_two_bytes_hex(p, bp, 0);
+		break;
+	}
+	*p++ = '\n';
+	fwrite(buf, 1, p - buf, stdout);
+}
+
 void display(struct hexdump *hex)
 {
 	register struct list_head *fs;
@@ -188,6 +299,10 @@ void display(struct hexdump *hex)
 	struct list_head *p, *q, *r;
 
 	while ((bp = get(hex)) != NULL) {
+		if (hex->format != HEXDUMP_FMT_CUSTOM && hex->blocksize == 16) {
+			display_block(hex, bp);
+			continue;
+		}
 		fs = &hex->fshead; savebp = bp; saveaddress = address;
 
 		list_for_each(p, fs) {
@@ -253,6 +368,42 @@ void display(struct hexdump *hex)
 
 static char **_argv;
 
+/*
+ * The input is read in large chunks and the blocks are copied from the
+ * chunk. read(2) returns what is available, so the output from a slow pipe
+ * is not delayed until the whole chunk is filled.
+ */
+#define CHUNK_SIZE	(64 * 1024)
+
+static u_char *chunk;
+static size_t chunk_len, chunk_off;
+
+static ssize_t read_input(struct hexdump *hex, u_char *buf, size_t sz)
+{
+	if (chunk_off == chunk_len) {
+		size_t want = CHUNK_SIZE;
+		ssize_t n;
+
+		if (hex->length != -1 && (size_t) hex->length < want)
+			want = hex->length;
+		if (!chunk)
+			chunk = xmalloc(CHUNK_SIZE);
+		do {
+			n = read(fileno(stdin), chunk, want);
+		} while (n < 0 && errno == EINTR);
+
+		if (n <= 0)
+			return n;
+		chunk_len = n;
+		chunk_off = 0;
+	}
+
+	sz = min(sz, chunk_len - chunk_off);
+	memcpy(buf, chunk + chunk_off, sz);
+	chunk_off += sz;
+	return sz;
+}
+
 static u_char *
 get(struct hexdump *hex)
 {
@@ -295,10 +446,10 @@ get(struct hexdump *hex)
 			warnx(_("all input file arguments failed"));
 			goto retnul;
 		}
-		n = fread((char *)curp + nread, sizeof(unsigned char),
-		    hex->length == -1 ? need : min(hex->length, need), stdin);
-		if (!n) {
-			if (ferror(stdin))
+		n = read_input(hex, curp + nread,
+		    hex->length == -1 ? need : min(hex->length, need));
+		if (n <= 0) {
+			if (n < 0)
 				warn("%s", _argv[-1]);
 			ateof = 1;
 			continue;
@@ -326,6 +477,8 @@ get(struct hexdump *hex)
 retnul:
 	free (curp);
 	free (savp);
+	free (chunk);
+	chunk = NULL;
 	return NULL;
 }
 
@@ -378,8 +531,27 @@ doskip(const char *fname, int statok, struct hexdump *hex)
 		}
 	}
 	/* sbuf may be undefined here - do not test it */
-	if (fseek(stdin, hex->skip, SEEK_SET))
-	        err(EXIT_FAILURE, "%s", fname);
+	if (fseek(stdin, hex->skip, SEEK_SET)) {
+		if (errno != ESPIPE)
+			err(EXIT_FAILURE, "%s", fname);
+
+		/* pipe, read and drop the data */
+		if (!chunk)
+			chunk = xmalloc(CHUNK_SIZE);
+		while (hex->skip) {
+			ssize_t n = read(fileno(stdin), chunk,
+					 min(hex->skip, (off_t) CHUNK_SIZE));
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				err(EXIT_FAILURE, "%s", fname);
+			if (n == 0)
+				return;		/* skip the rest in the next file */
+			hex->skip -= n;
+			address += n;
+		}
+		return;
+	}
 	address += hex->skip;
 	hex->skip = 0;
 }
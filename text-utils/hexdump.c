@@ -57,7 +57,7 @@ void hex_free(struct hexdump *);
 int
 parse_args(int argc, char **argv, struct hexdump *hex)
 {
-	int ch;
+	int ch, nfmts = 0, format = HEXDUMP_FMT_CUSTOM;
 	char *hex_offt = "\"%07.7_Ax\n\"";
 
 	static const struct option longopts[] = {
@@ -80,32 +80,40 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 	while ((ch = getopt_long(argc, argv, "bcCde:f:L::n:os:vxhV", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'b':
+			nfmts++;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%03o \" \"\\n\"", hex);
 			break;
 		case 'c':
+			nfmts++;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%3_c \" \"\\n\"", hex);
 			break;
 		case 'C':
+			nfmts++;
+			format = HEXDUMP_FMT_CANONICAL;
 			add_fmt("\"%08.8_Ax\n\"", hex);
 			add_fmt("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ", hex);
 			add_fmt("\"  |\" 16/1 \"%_p\" \"|\\n\"", hex);
 			break;
 		case 'd':
+			nfmts++;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"  %05u \" \"\\n\"", hex);
 			break;
 		case 'e':
+			nfmts++;
 			add_fmt(optarg, hex);
 			break;
 		case 'f':
+			nfmts++;
 			addfile(optarg, hex);
 			break;
 		case 'n':
 			hex->length = strtosize_or_err(optarg, _("failed to parse length"));
 			break;
 		case 'o':
+			nfmts++;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \" %06o \" \"\\n\"", hex);
 			break;
@@ -116,6 +124,8 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 			vflag = ALL;
 			break;
 		case 'x':
+			nfmts++;
+			format = HEXDUMP_FMT_TWO_BYTES_HEX;
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"   %04x \" \"\\n\"", hex);
 			break;
@@ -133,7 +143,11 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 	if (list_empty(&hex->fshead)) {
 		add_fmt(hex_offt, hex);
 		add_fmt("\"%07.7_ax \" 8/2 \"%04x \" \"\\n\"", hex);
-	}
+		format = HEXDUMP_FMT_DEFAULT;
+	} else if (nfmts != 1)
+		format = HEXDUMP_FMT_CUSTOM;
+
+	hex->format = format;
 	return optind;
 }
 
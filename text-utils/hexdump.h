@@ -72,8 +72,17 @@ struct hexdump_fs {			/* format strings */
 	int bcnt;
 };
 
+/* well-known formats displayed without the format interpreter */
+enum {
+	HEXDUMP_FMT_CUSTOM = 0,		/* -e, -f, more options */
+	HEXDUMP_FMT_DEFAULT,		/* no format option */
+	HEXDUMP_FMT_CANONICAL,		/* -C */
+	HEXDUMP_FMT_TWO_BYTES_HEX	/* -x */
+};
+
 struct hexdump {
   struct list_head fshead;				/* head of format strings */
+  int format;				/* HEXDUMP_FMT_* */
   ssize_t blocksize;			/* data block size */
   int exitval;				/* final exit value */
   ssize_t length;			/* max bytes to read */
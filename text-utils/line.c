@@ -16,10 +16,63 @@
  */
 
 #include	<stdio.h>
+#include	<string.h>
 #include	<unistd.h>
+#include	<sys/socket.h>
+#include	<sys/stat.h>
 
 static int	status;		/* exit status */
 
+/*
+ * Reads by blocks if the rest of the block can be returned to the input,
+ * that is by lseek() for regular files and by MSG_PEEK for sockets. We must
+ * not consume more than the line, the input is shared with the caller.
+ */
+static int
+doline_block(int fd)
+{
+	char buf[BUFSIZ], *nl;
+	struct stat st;
+	ssize_t n, len;
+
+	if (fstat(fd, &st) != 0)
+		return -1;
+	if (S_ISREG(st.st_mode)) {
+		if (lseek(fd, 0, SEEK_CUR) == -1)
+			return -1;
+	} else if (!S_ISSOCK(st.st_mode))
+		return -1;
+
+	for (;;) {
+		if (S_ISSOCK(st.st_mode))
+			n = recv(fd, buf, sizeof(buf), MSG_PEEK);
+		else
+			n = read(fd, buf, sizeof(buf));
+		if (n <= 0) {
+			status = 1;
+			break;
+		}
+		nl = memchr(buf, '\n', n);
+		len = nl ? nl - buf + 1 : n;
+
+		if (S_ISSOCK(st.st_mode)) {
+			/* consume the peeked data */
+			if (recv(fd, buf, len, MSG_WAITALL) != len) {
+				status = 1;
+				break;
+			}
+		} else if (len < n && lseek(fd, len - n, SEEK_CUR) == -1) {
+			status = 1;
+			break;
+		}
+		fwrite(buf, 1, nl ? len - 1 : len, stdout);
+		if (nl)
+			break;
+	}
+	putchar('\n');
+	return 0;
+}
+
 static void
 doline(int fd)
 {
@@ -40,6 +93,7 @@ doline(int fd)
 int
 main(void)
 {
-	doline(0);
+	if (doline_block(0) != 0)
+		doline(0);
 	return status;
 }
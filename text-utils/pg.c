@@ -877,6 +877,85 @@ static void __attribute__((__noreturn__)) tmperr(FILE *f, const char *ftype)
 	quit(++exitstatus);
 }
 
+/* Index of the lines in the file buffer, one offset for each line (or part of
+ * the line on the screen). It's kept in memory, the lines are searched
+ * backward and repainted by the index. */
+static off_t *lindex;
+static size_t lindexsz, nlindex;
+
+/* Cache of the file buffer for the lines read by the index. */
+#define CACHESZ		(64 * 1024)
+static char *cache;
+static off_t cacheoff;
+static size_t cachelen;
+
+static void index_add(off_t pos)
+{
+	if (nlindex == lindexsz) {
+		lindexsz = lindexsz ? lindexsz * 2 : 1024;
+		lindex = xrealloc(lindex, lindexsz * sizeof(off_t));
+	}
+	lindex[nlindex++] = pos;
+}
+
+static int cache_read(FILE *fbuf, int nobuf, off_t off)
+{
+	ssize_t ret;
+
+	if (!cache)
+		cache = xmalloc(CACHESZ);
+	/* fbuf is written by stdio */
+	if (!nobuf && fflush(fbuf) != 0)
+		return -1;
+	cacheoff = off;
+	cachelen = 0;
+	while (cachelen < CACHESZ) {
+		ret = pread(fileno(fbuf), cache + cachelen,
+			    CACHESZ - cachelen, off + cachelen);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -1;
+		if (ret == 0)
+			break;
+		cachelen += ret;
+	}
+	return 0;
+}
+
+/* Reads the line at offset pos of the file buffer to b, the same as
+ * fgets(b, READBUF, fbuf) after seek to pos. */
+static char *buffer_gets(FILE *fbuf, int nobuf, off_t pos, char *b)
+{
+	size_t avail = 0, len;
+	char *p, *nl;
+
+	if (pos >= cacheoff && pos <= cacheoff + (off_t) cachelen)
+		avail = cacheoff + cachelen - pos;
+	if (avail < READBUF - 1 &&
+	    (!avail || !memchr(cache + (pos - cacheoff), '\n', avail))) {
+		off_t off = pos;
+
+		/* backward move, keep the previous lines in the cache */
+		if (pos < cacheoff)
+			off = pos + READBUF > CACHESZ ?
+				pos + READBUF - CACHESZ : 0;
+		if (cache_read(fbuf, nobuf, off) != 0)
+			return NULL;
+		avail = cacheoff + cachelen - pos;
+	}
+	p = cache + (pos - cacheoff);
+	len = min(avail, (size_t) READBUF - 1);
+	nl = memchr(p, '\n', len);
+	if (nl)
+		len = nl - p + 1;
+	if (len == 0)
+		return NULL;
+	memcpy(b, p, len);
+	b[len] = '\0';
+	return b;
+}
+
 /* Read the file and respond to user input.  Beware: long and ugly. */
 static void pgfile(FILE *f, const char *name)
 {
@@ -904,9 +983,8 @@ static void pgfile(FILE *f, const char *name)
 	char b[READBUF + 1];
 	char *p;
 	/*   fbuf	an exact copy of the input file as it gets read
-	 *   find	index table for input, one entry per line
 	 *   save	for the s command, to save to a file */
-	FILE *fbuf, *find, *save;
+	FILE *fbuf, *save;
 
 	if (ontty == 0) {
 		/* Just copy stdin to stdout. */
@@ -924,11 +1002,13 @@ static void pgfile(FILE *f, const char *name)
 		fbuf = f;
 		nobuf = 1;
 	}
-	find = tmpfile();
-	if (fbuf == NULL || find == NULL) {
+	if (fbuf == NULL) {
 		warn(_("Cannot create tempfile"));
 		quit(++exitstatus);
 	}
+	nlindex = 0;
+	cacheoff = cachelen = 0;
+
 	if (searchfor) {
 		search = FORWARD;
 		oldline = 0;
@@ -946,15 +1026,9 @@ static void pgfile(FILE *f, const char *name)
 	for (line = startline;;) {
 		/* Get a line from input file or buffer. */
 		if (line < bline) {
-			fseeko(find, line * sizeof pos, SEEK_SET);
-			if (fread(&pos, sizeof pos, 1, find) == 0)
-				tmperr(find, "index");
-			fseeko(find, (off_t)0, SEEK_END);
-			fseeko(fbuf, pos, SEEK_SET);
-			if (fgets(b, READBUF, fbuf) == NULL)
+			if (buffer_gets(fbuf, nobuf, lindex[line], b) == NULL)
 				tmperr(fbuf, "buffer");
 		} else if (eofline == 0) {
-			fseeko(find, (off_t)0, SEEK_END);
 			do {
 				if (!nobuf)
 					fseeko(fbuf, (off_t)0, SEEK_END);
@@ -986,7 +1060,7 @@ static void pgfile(FILE *f, const char *name)
 				} else {
 					if (!nobuf)
 						fputs(b, fbuf);
-					fwrite_all(&pos, sizeof pos, 1, find);
+					index_add(pos);
 					if (!fflag) {
 						oldpos = pos;
 						p = b;
@@ -994,9 +1068,7 @@ static void pgfile(FILE *f, const char *name)
 								     p))
 						       != '\0') {
 							pos = oldpos + (p - b);
-							fwrite_all(&pos,
-								   sizeof pos,
-								   1, find);
+							index_add(pos);
 							fline++;
 							bline++;
 						}
@@ -1140,14 +1212,8 @@ static void pgfile(FILE *f, const char *name)
 				if (line <= 0)
 					goto notfound_bw;
 				while (line) {
-					fseeko(find, --line * sizeof pos,
-					       SEEK_SET);
-					if (fread(&pos, sizeof pos, 1, find) ==
-					    0)
-						tmperr(find, "index");
-					fseeko(find, (off_t)0, SEEK_END);
-					fseeko(fbuf, pos, SEEK_SET);
-					if (fgets(b, READBUF, fbuf) == NULL)
+					if (buffer_gets(fbuf, nobuf,
+							lindex[--line], b) == NULL)
 						tmperr(fbuf, "buffer");
 					colb(b);
 					if (regexec(&re, b, 0, NULL, 0) == 0)
@@ -1195,7 +1261,6 @@ static void pgfile(FILE *f, const char *name)
 					goto newcmd;
 				}
 				/* Advance to EOF. */
-				fseeko(find, (off_t)0, SEEK_END);
 				for (;;) {
 					if (!nobuf)
 						fseeko(fbuf, (off_t)0,
@@ -1207,7 +1272,7 @@ static void pgfile(FILE *f, const char *name)
 					}
 					if (!nobuf)
 						fputs(b, fbuf);
-					fwrite_all(&pos, sizeof pos, 1, find);
+					index_add(pos);
 					if (!fflag) {
 						oldpos = pos;
 						p = b;
@@ -1215,9 +1280,7 @@ static void pgfile(FILE *f, const char *name)
 								     p))
 						       != '\0') {
 							pos = oldpos + (p - b);
-							fwrite_all(&pos,
-								   sizeof pos,
-								   1, find);
+							index_add(pos);
 							fline++;
 							bline++;
 						}
@@ -1348,7 +1411,6 @@ static void pgfile(FILE *f, const char *name)
 							sh = "/bin/sh";
 						if (!nobuf)
 							fclose(fbuf);
-						fclose(find);
 						if (isatty(0) == 0) {
 							close(0);
 							open(tty, O_RDONLY);
@@ -1435,7 +1497,6 @@ static void pgfile(FILE *f, const char *name)
 		if (eof)
 			break;
 	}
-	fclose(find);
 	if (!nobuf)
 		fclose(fbuf);
 }
@@ -64,7 +64,11 @@
 #include "c.h"
 #include "closestream.h"
 
-wchar_t *buf;
+wchar_t *buf;		/* multibyte lines converted to wide chars */
+size_t bufsiz;
+
+/* input is read by blocks, the lines are reversed in the block */
+#define REV_BLOCKSIZ	(64 * 1024)
 
 static void sig_handler(int signo __attribute__ ((__unused__)))
 {
@@ -97,10 +101,108 @@ static void reverse_str(wchar_t *str, size_t n)
 	}
 }
 
+/*
+ * Reverses the line in place. ASCII lines (the most common case) and all
+ * lines in single-byte locales are reversed byte by byte, the other lines are
+ * converted to wide chars. Returns the line size or -1 on invalid multibyte
+ * sequence. The byte behind the line has to be writable.
+ */
+static ssize_t reverse_line(char *line, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if ((unsigned char) line[i] >= 0x80)
+			break;
+	}
+#ifdef HAVE_WIDECHAR
+	if (i < len && MB_CUR_MAX > 1) {
+		size_t n;
+
+		if (len + 1 > bufsiz) {
+			bufsiz = len + 1;
+			buf = xrealloc(buf, bufsiz * sizeof(wchar_t));
+		}
+		line[len] = '\0';
+		n = mbstowcs(buf, line, len + 1);
+		if (n == (size_t) -1)
+			return -1;
+		reverse_str(buf, n);
+		n = wcstombs(line, buf, len + 1);
+		return n == (size_t) -1 ? -1 : (ssize_t) n;
+	}
+#endif
+	for (i = 0; i < len / 2; i++) {
+		char tmp = line[i];
+		line[i] = line[len - 1 - i];
+		line[len - 1 - i] = tmp;
+	}
+	return len;
+}
+
+/* returns 0 on success, -1 on read error or invalid multibyte sequence */
+static int reverse_file(FILE *fp)
+{
+	static char *data;
+	static size_t datasz;
+	size_t used = 0;
+	int eof = 0;
+
+	if (!data) {
+		datasz = REV_BLOCKSIZ;
+		data = xmalloc(datasz + 1);
+	}
+
+	while (!eof) {
+		size_t off = 0;
+		ssize_t n;
+		char *nl;
+
+		if (used == datasz) {
+			/* line longer than buffer */
+			datasz *= 2;
+			data = xrealloc(data, datasz + 1);
+		}
+		/* read() returns what is available, don't wait for a full block */
+		do {
+			n = read(fileno(fp), data + used, datasz - used);
+		} while (n < 0 && errno == EINTR);
+		if (n < 0)
+			return -1;
+		if (n == 0)
+			eof = 1;
+		used += n;
+
+		/* complete lines */
+		while ((nl = memchr(data + off, '\n', used - off))) {
+			ssize_t len = reverse_line(data + off, nl - (data + off));
+
+			if (len < 0)
+				return -1;
+			fwrite(data + off, 1, len, stdout);
+			fputc('\n', stdout);
+			off = nl - data + 1;
+		}
+
+		/* the last line without newline */
+		if (eof && off < used) {
+			ssize_t len = reverse_line(data + off, used - off);
+
+			if (len < 0)
+				return -1;
+			fwrite(data + off, 1, len, stdout);
+			off = used;
+		}
+
+		memmove(data, data + off, used - off);
+		used -= off;
+	}
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	char *filename = "stdin";
-	size_t len, bufsiz = BUFSIZ;
 	FILE *fp = stdin;
 	int ch, rval = EXIT_SUCCESS;
 
@@ -133,6 +235,7 @@ int main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	bufsiz = BUFSIZ;
 	buf = xmalloc(bufsiz * sizeof(wchar_t));
 
 	do {
@@ -146,29 +249,7 @@ int main(int argc, char *argv[])
 			filename = *argv++;
 		}
 
-		while (fgetws(buf, bufsiz, fp)) {
-			len = wcslen(buf);
-
-			/* This is my hack from setpwnam.c -janl */
-			while (buf[len-1] != '\n' && !feof(fp)) {
-				/* Extend input buffer if it failed getting the whole line */
-				/* So now we double the buffer size */
-				bufsiz *= 2;
-
-				buf = xrealloc(buf, bufsiz * sizeof(wchar_t));
-
-				/* And fill the rest of the buffer */
-				if (!fgetws(&buf[len], bufsiz/2, fp))
-					break;
-
-				len = wcslen(buf);
-			}
-			if (buf[len - 1] == '\n')
-				buf[len--] = '\0';
-			reverse_str(buf, len);
-			fputws(buf, stdout);
-		}
-		if (ferror(fp)) {
+		if (reverse_file(fp) != 0) {
 			warn("%s", filename);
 			rval = EXIT_FAILURE;
 		}
@@ -45,50 +45,81 @@
 #include "strutils.h"
 #include "c.h"
 #include "closestream.h"
+#include "all-io.h"
 
 #define DEFAULT_LINES  10
 
+/* the file is read backward and followed in large blocks */
+#define TAILF_BUFSIZ	(64 * 1024)
+
+/*
+ * Prints the last @lines lines of the first @size bytes of the file. The file
+ * is read from the end backward, so the time does not depend on the file
+ * size.
+ */
 static void
-tailf(const char *filename, int lines)
+tailf(const char *filename, int lines, off_t size)
 {
-	char *buf, *p;
-	int  head = 0;
-	int  tail = 0;
-	FILE *str;
-	int  i;
+	char *buf;
+	off_t pos = size, start = 0;
+	int fd, nl = 0;
 
-	if (!(str = fopen(filename, "r")))
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
 		err(EXIT_FAILURE, _("cannot open %s"), filename);
 
-	buf = xmalloc((lines ? lines : 1) * BUFSIZ);
-	p = buf;
-	while (fgets(p, BUFSIZ, str)) {
-		if (++tail >= lines) {
-			tail = 0;
-			head = 1;
+	buf = xmalloc(TAILF_BUFSIZ);
+
+	while (lines > 0 && pos > 0) {
+		size_t sz = min((off_t) TAILF_BUFSIZ, pos);
+		char *p;
+		ssize_t rc;
+
+		pos -= sz;
+		rc = pread_all(fd, buf, sz, pos);
+		if (rc < 0)
+			err(EXIT_FAILURE, _("read failed: %s"), filename);
+		if ((size_t) rc != sz)
+			break;		/* truncated */
+
+		/* the last newline terminates the last line */
+		if (pos + (off_t) sz == size && buf[sz - 1] == '\n')
+			sz--;
+
+		while (sz && (p = memrchr(buf, '\n', sz))) {
+			if (++nl == lines) {
+				start = pos + (p - buf) + 1;
+				goto done;
+			}
+			sz = p - buf;
 		}
-		p = buf + (tail * BUFSIZ);
 	}
-
-	if (head) {
-		for (i = tail; i < lines; i++)
-			fputs(buf + (i * BUFSIZ), stdout);
-		for (i = 0; i < tail; i++)
-			fputs(buf + (i * BUFSIZ), stdout);
-	} else {
-		for (i = head; i < tail; i++)
-			fputs(buf + (i * BUFSIZ), stdout);
+done:
+	if (lines > 0) {
+		off_t off = start;
+
+		while (off < size) {
+			ssize_t rc = pread(fd, buf, min((off_t) TAILF_BUFSIZ,
+						       size - off), off);
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc <= 0)
+				break;
+			if (fwrite_all(buf, 1, rc, stdout))
+				err(EXIT_FAILURE, _("write failed"));
+			off += rc;
+		}
 	}
 
 	fflush(stdout);
 	free(buf);
-	fclose(str);
+	close(fd);
 }
 
 static void
 roll_file(const char *filename, off_t *size)
 {
-	char buf[BUFSIZ];
+	static char *buf;
 	int fd;
 	struct stat st;
 	off_t pos;
@@ -105,10 +136,13 @@ roll_file(const char *filename, off_t *size)
 		return;
 	}
 
+	if (!buf)
+		buf = xmalloc(TAILF_BUFSIZ);
+
 	if (lseek(fd, *size, SEEK_SET) != (off_t)-1) {
 		ssize_t rc, wc;
 
-		while ((rc = read(fd, buf, sizeof(buf))) > 0) {
+		while ((rc = read(fd, buf, TAILF_BUFSIZ)) > 0) {
 			wc = write(STDOUT_FILENO, buf, rc);
 			if (rc != wc)
 				warnx(_("incomplete write to \"%s\" (written %zd, expected %zd)\n"),
@@ -278,8 +312,8 @@ int main(int argc, char **argv)
 	if (stat(filename, &st) != 0)
 		err(EXIT_FAILURE, _("stat failed %s"), filename);
 
-	size = st.st_size;;
-	tailf(filename, lines);
+	size = st.st_size;
+	tailf(filename, lines, size);
 
 #ifdef HAVE_INOTIFY_INIT
 	if (!watch_file_inotify(filename, &size))
@@ -57,10 +57,10 @@
 #include "closestream.h"
 
 #ifdef HAVE_WIDECHAR
-/* Output an ASCII character as a wide character */
+/* Output an ASCII character, see putwchar_mb() */
 static int put1wc(int c)
 {
-	if (putwchar(c) == WEOF)
+	if (putwchar_mb(c) == WEOF)
 		return EOF;
 	else
 		return c;
@@ -242,7 +242,7 @@ static int handle_escape(FILE * f)
 {
 	wint_t c;
 
-	switch (c = getwc(f)) {
+	switch (c = getwc_unlocked(f)) {
 	case HREV:
 		if (halfpos == 0) {
 			mode |= SUPERSC;
@@ -282,7 +282,7 @@ static void filter(FILE *f)
 	wint_t c;
 	int i, w;
 
-	while ((c = getwc(f)) != WEOF)
+	while ((c = getwc_unlocked(f)) != WEOF)
 	switch (c) {
 
 	case '\b':
@@ -307,7 +307,7 @@ static void filter(FILE *f)
 
 	case IESC:
 		if(handle_escape(f)) {
-			c = getwc(f);
+			c = getwc_unlocked(f);
 			errx(EXIT_FAILURE,
 				_("unknown escape sequence in input: %o, %o"),
 				IESC, c);
@@ -337,7 +337,7 @@ static void filter(FILE *f)
 
 	case '\f':
 		flushln();
-		putwchar('\f');
+		putwchar_mb('\f');
 		continue;
 
 	default:
@@ -403,7 +403,7 @@ static void flushln(void)
 	}
 	if (must_overstrike && hadmodes)
 		overstrike();
-	putwchar('\n');
+	putwchar_mb('\n');
 	if (iflag && hadmodes)
 		iattr();
 	fflush(stdout);
@@ -444,17 +444,18 @@ static void overstrike(void)
 			hadbold=1;
 			break;
 		}
-	putwchar('\r');
+	putwchar_mb('\r');
 	for (*cp = ' '; *cp == ' '; cp--)
 		*cp = 0;
-	fputws(lbuf, stdout);
+	for (cp = lbuf; *cp; cp++)
+		putwchar_mb(*cp);
 	if (hadbold) {
-		putwchar('\r');
+		putwchar_mb('\r');
 		for (cp = lbuf; *cp; cp++)
-			putwchar(*cp == '_' ? ' ' : *cp);
-		putwchar('\r');
+			putwchar_mb(*cp == '_' ? ' ' : *cp);
+		putwchar_mb('\r');
 		for (cp = lbuf; *cp; cp++)
-			putwchar(*cp == '_' ? ' ' : *cp);
+			putwchar_mb(*cp == '_' ? ' ' : *cp);
 	}
 }
 
@@ -480,8 +481,9 @@ static void iattr(void)
 		}
 	for (*cp = ' '; *cp == ' '; cp--)
 		*cp = 0;
-	fputws(lbuf, stdout);
-	putwchar('\n');
+	for (cp = lbuf; *cp; cp++)
+		putwchar_mb(*cp);
+	putwchar_mb('\n');
 }
 
 static void initbuf(void)
@@ -568,7 +570,7 @@ static int curmode = 0;
 static void outc(wint_t c, int width) {
 	int i;
 
-	putwchar(c);
+	putwchar_mb(c);
 	if (must_use_uc && (curmode&UNDERL)) {
 		for (i = 0; i < width; i++)
 			print_out(CURS_LEFT);